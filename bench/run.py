@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Run the RustyBASIC benchmarks and compare them with the last run.
+
+  bench/run.py host                      runtime benchmarks as a host program
+  bench/run.py device --port /dev/ttyUSB0  the same program on an ESP32-C3
+
+Both modes also time every phase of compiling examples/*.bas
+(`rustybasic FILE bench`). Benchmarks report lines of the form
+
+  BENCH <name> <iterations> <microseconds>
+
+and are compared by time per iteration. Results are written to
+bench/results/<target>-latest.json. When that file already exists, the new
+run is compared with it first, and the exit status is 1 if anything got
+slower by more than --threshold percent. Copy a results file aside, or pass
+--baseline, to compare against a fixed reference instead.
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BENCH_DIR = os.path.join(ROOT, "bench")
+BUILD_DIR = os.path.join(BENCH_DIR, "build")
+RESULTS_DIR = os.path.join(BENCH_DIR, "results")
+PROGRAM = os.path.join(BENCH_DIR, "runtime.bas")
+
+LINE = re.compile(r"BENCH (\S+) (\d+) (\d+)")
+
+
+def run(cmd, **kwargs):
+    return subprocess.run(cmd, check=True, cwd=ROOT, **kwargs)
+
+
+def parse_lines(lines, results):
+    for line in lines:
+        m = LINE.search(line)
+        if m:
+            name, iterations, us = m.group(1), int(m.group(2)), int(m.group(3))
+            results[name] = {"iterations": iterations, "us": us,
+                             "ns_per_op": us * 1000.0 / max(iterations, 1)}
+
+
+def compiler(args):
+    if args.compiler:
+        return args.compiler
+    run(["cargo", "build", "--release", "-q", "-p", "rustybasic-driver"])
+    return os.path.join(ROOT, "target", "release", "rustybasic")
+
+
+def bench_host(rb, results):
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    obj = os.path.join(BUILD_DIR, "runtime.o")
+    exe = os.path.join(BUILD_DIR, "runtime")
+    run([rb, PROGRAM, "build", "--target", "host", "-O2", "-o", obj])
+    sources = sorted(glob.glob(os.path.join(ROOT, "runtime", "src", "*.c")))
+    cc = os.environ.get("CC", "cc")
+    run([cc, "-O2", "-std=gnu11", "-I" + os.path.join(ROOT, "runtime", "include"),
+         obj] + sources + ["-lm", "-lpthread", "-o", exe])
+    out = run([exe], stdout=subprocess.PIPE, text=True).stdout
+    parse_lines(out.splitlines(), results)
+
+
+def bench_device(rb, args, results):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("device benchmarks need pyserial (pip install pyserial)")
+    if not args.no_flash:
+        run([rb, PROGRAM, "firmware"])
+        run([rb, PROGRAM, "flash", "--port", args.port])
+    deadline = time.monotonic() + args.timeout
+    lines = []
+    with serial.Serial(args.port, args.baud, timeout=1) as port:
+        port.dtr = False        # reset into the freshly flashed program
+        port.rts = True
+        time.sleep(0.1)
+        port.rts = False
+        while time.monotonic() < deadline:
+            line = port.readline().decode("utf-8", "replace").strip()
+            if line:
+                lines.append(line)
+            if line.endswith("BENCH.END"):
+                break
+        else:
+            sys.exit("no BENCH.END from %s within %d s" % (args.port, args.timeout))
+    parse_lines(lines, results)
+
+
+def bench_compile(rb, args, results):
+    for path in sorted(glob.glob(os.path.join(ROOT, "examples", "*.bas"))):
+        proc = subprocess.run([rb, path, "bench", "--runs", str(args.runs)],
+                              cwd=ROOT, stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL, text=True)
+        if proc.returncode != 0:
+            print("skipped %s: it does not compile on its own" % os.path.basename(path))
+            continue
+        parse_lines(proc.stdout.splitlines(), results)
+
+
+def compare(baseline, results, threshold):
+    slower = []
+    print("%-36s %12s %12s %8s" % ("benchmark", "before ns", "now ns", "change"))
+    for name in sorted(results):
+        now = results[name]["ns_per_op"]
+        if name not in baseline:
+            print("%-36s %12s %12.0f %8s" % (name, "-", now, "new"))
+            continue
+        before = baseline[name]["ns_per_op"]
+        change = (now - before) * 100.0 / before if before else 0.0
+        flag = ""
+        if change > threshold:
+            flag = "  slower"
+            slower.append(name)
+        print("%-36s %12.0f %12.0f %+7.1f%%%s" % (name, before, now, change, flag))
+    return slower
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("target", choices=["host", "device"])
+    ap.add_argument("--port", help="serial port of the device")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--timeout", type=int, default=120,
+                    help="seconds to wait for the device to finish")
+    ap.add_argument("--no-flash", action="store_true",
+                    help="the device already runs bench/runtime.bas")
+    ap.add_argument("--runs", type=int, default=20,
+                    help="runs per compiler phase (the median is kept)")
+    ap.add_argument("--skip-compile", action="store_true",
+                    help="leave out the compile-time benchmarks")
+    ap.add_argument("--compiler", help="rustybasic binary to use instead of building one")
+    ap.add_argument("--baseline", help="results file to compare with")
+    ap.add_argument("--threshold", type=float, default=10.0,
+                    help="percent slowdown reported as a regression")
+    args = ap.parse_args()
+    if args.target == "device" and not args.port:
+        ap.error("device needs --port")
+
+    rb = compiler(args)
+    results = {}
+    if args.target == "host":
+        bench_host(rb, results)
+    else:
+        bench_device(rb, args, results)
+    if not args.skip_compile:
+        bench_compile(rb, args, results)
+
+    os.makedirs(RESULTS_DIR, exist_ok=True)
+    latest = os.path.join(RESULTS_DIR, "%s-latest.json" % args.target)
+    baseline_path = args.baseline or (latest if os.path.exists(latest) else None)
+    slower = []
+    if baseline_path:
+        with open(baseline_path) as f:
+            slower = compare(json.load(f)["results"], results, args.threshold)
+
+    commit = subprocess.run(["git", "rev-parse", "--short", "HEAD"], cwd=ROOT,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            text=True).stdout.strip()
+    record = {"target": args.target, "commit": commit,
+              "date": time.strftime("%Y-%m-%dT%H:%M:%S"), "results": results}
+    with open(latest, "w") as f:
+        json.dump(record, f, indent=2, sort_keys=True)
+    print("%d results written to %s" % (len(results), os.path.relpath(latest, ROOT)))
+
+    if slower:
+        print("%d benchmark(s) more than %g%% slower: %s"
+              % (len(slower), args.threshold, ", ".join(slower)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
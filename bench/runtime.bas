@@ -0,0 +1,101 @@
+' Runtime benchmarks: each case runs in batches that double in size until
+' a batch takes at least MIN_US, and prints one line
+'   BENCH <name> <iterations> <microseconds>
+' that bench/run.py collects from stdout (host) or the serial port (device).
+' Fixtures are set up outside the timed batch.
+
+DECLARE SUB Measure (id AS INTEGER, label AS STRING)
+DECLARE SUB RunCase (id AS INTEGER, n AS INTEGER)
+
+CONST MIN_US = 200000
+
+PRINT "BENCH.BEGIN"
+CALL Measure(1, "string.concat")
+CALL Measure(2, "string.mid")
+CALL Measure(3, "string.instr")
+CALL Measure(4, "json.get")
+CALL Measure(5, "json.set")
+CALL Measure(6, "regex.match")
+CALL Measure(7, "array.access")
+CALL Measure(8, "format.int")
+CALL Measure(9, "format.float")
+PRINT "BENCH.END"
+END
+
+SUB Measure (id AS INTEGER, label AS STRING)
+    n% = 16
+    DO
+        CALL RunCase(id, n%)
+        TIMER.MICROS t%
+        IF t% >= MIN_US THEN EXIT DO
+        n% = n% * 2
+    LOOP
+    PRINT "BENCH "; label; " "; n%; " "; t%
+END SUB
+
+' Runs n iterations of case id; TIMER.START marks the end of the setup
+SUB RunCase (id AS INTEGER, n AS INTEGER)
+    DIM i AS INTEGER
+    DIM k AS INTEGER
+    SELECT CASE id
+        CASE 1
+            TIMER.START
+            FOR i = 1 TO n
+                s$ = ""
+                FOR k = 1 TO 16
+                    s$ = s$ + "abcd"
+                NEXT k
+            NEXT i
+        CASE 2
+            text$ = "The quick brown fox jumps over the lazy dog"
+            TIMER.START
+            FOR i = 1 TO n
+                w$ = MID$(text$, 17, 3)
+            NEXT i
+        CASE 3
+            text$ = STRING$(200, 46) + "needle" + STRING$(50, 46)
+            TIMER.START
+            FOR i = 1 TO n
+                p% = INSTR(text$, "needle")
+            NEXT i
+        CASE 4
+            q$ = CHR$(34)
+            body$ = "{" + q$ + "id" + q$ + ":7," + q$ + "name" + q$ + ":" + q$ + "probe" + q$ + "," + q$ + "temp" + q$ + ":21.5}"
+            TIMER.START
+            FOR i = 1 TO n
+                JSON.GET body$, "temp", v$
+            NEXT i
+        CASE 5
+            q$ = CHR$(34)
+            body$ = "{" + q$ + "id" + q$ + ":7," + q$ + "name" + q$ + ":" + q$ + "probe" + q$ + "," + q$ + "temp" + q$ + ":21.5}"
+            TIMER.START
+            FOR i = 1 TO n
+                JSON.SET body$, "temp", "22.0", out$
+            NEXT i
+        CASE 6
+            line$ = "T=21.5C H=40% id=1234"
+            TIMER.START
+            FOR i = 1 TO n
+                REGEX.MATCH "id=[0-9]+", line$, found%
+            NEXT i
+        CASE 7
+            DIM a%(255)
+            TIMER.START
+            FOR i = 1 TO n
+                FOR k = 0 TO 255
+                    a%(k) = a%(255 - k) + k
+                NEXT k
+            NEXT i
+        CASE 8
+            TIMER.START
+            FOR i = 1 TO n
+                s$ = LTRIM$(STR$(i * 7919))
+            NEXT i
+        CASE 9
+            x! = 0.001
+            TIMER.START
+            FOR i = 1 TO n
+                s$ = STR$(x! * i)
+            NEXT i
+    END SELECT
+END SUB
@@ -2,25 +2,33 @@ use std::collections::HashMap;
 use std::path::Path;
 
 use anyhow::{Context, Result};
+use inkwell::attributes::{Attribute, AttributeLoc};
 use inkwell::builder::Builder;
 use inkwell::context::Context as LlvmContext;
-use inkwell::module::Module;
+use inkwell::module::{Linkage, Module};
+use inkwell::passes::PassBuilderOptions;
 use inkwell::targets::{
     CodeModel, FileType, InitializationConfig, RelocMode, Target, TargetMachine, TargetTriple,
 };
-use inkwell::types::{BasicMetadataTypeEnum, BasicType, BasicTypeEnum, FloatType, IntType};
+use inkwell::types::{
+    BasicMetadataTypeEnum, BasicType, BasicTypeEnum, FloatType, IntType, StructType,
+};
 use inkwell::values::{
-    BasicMetadataValueEnum, BasicValue, BasicValueEnum, FunctionValue, IntValue, PointerValue,
+    BasicMetadataValueEnum, BasicValue, BasicValueEnum, FunctionValue, InstructionValue, IntValue,
+    PointerValue,
 };
 use inkwell::AddressSpace;
 use inkwell::FloatPredicate;
 use inkwell::IntPredicate;
 use inkwell::OptimizationLevel;
+use inkwell::ThreadLocalMode;
 
+use rustybasic_common::Span;
 use rustybasic_parser::ast::*;
 use rustybasic_sema::SemaResult;
 
 /// Target configuration for code generation.
+#[derive(Clone)]
 pub struct TargetConfig {
     pub triple: String,
     pub cpu: String,
@@ -54,12 +62,107 @@ impl TargetConfig {
     }
 }
 
+/// Optimization profile, selected with `-O0` .. `-O3`, `-Os` or `-Oz`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum OptLevel {
+    O0,
+    O1,
+    O2,
+    O3,
+    /// Optimize for size (flash-constrained images)
+    Os,
+    /// Optimize aggressively for size
+    Oz,
+}
+
+impl OptLevel {
+    /// New pass manager pipeline for this level. Each `default<..>` pipeline
+    /// includes mem2reg/SROA, inlining, LICM and loop unrolling as
+    /// appropriate for the level.
+    fn pipeline(self) -> &'static str {
+        match self {
+            OptLevel::O0 => "default<O0>",
+            OptLevel::O1 => "default<O1>",
+            OptLevel::O2 => "default<O2>",
+            OptLevel::O3 => "default<O3>",
+            OptLevel::Os => "default<Os>",
+            OptLevel::Oz => "default<Oz>",
+        }
+    }
+
+    fn codegen_level(self) -> OptimizationLevel {
+        match self {
+            OptLevel::O0 => OptimizationLevel::None,
+            OptLevel::O1 => OptimizationLevel::Less,
+            OptLevel::O3 => OptimizationLevel::Aggressive,
+            OptLevel::O2 | OptLevel::Os | OptLevel::Oz => OptimizationLevel::Default,
+        }
+    }
+
+    fn optimizes_for_size(self) -> bool {
+        matches!(self, OptLevel::Os | OptLevel::Oz)
+    }
+}
+
+impl std::str::FromStr for OptLevel {
+    type Err = String;
+
+    fn from_str(s: &str) -> std::result::Result<Self, Self::Err> {
+        match s {
+            "0" => Ok(OptLevel::O0),
+            "1" => Ok(OptLevel::O1),
+            "2" => Ok(OptLevel::O2),
+            "3" => Ok(OptLevel::O3),
+            "s" => Ok(OptLevel::Os),
+            "z" => Ok(OptLevel::Oz),
+            _ => Err(format!("unknown optimization level '{s}' (expected 0, 1, 2, 3, s or z)")),
+        }
+    }
+}
+
+/// Refcount sentinel marking an immortal string (see `RB_STRING_IMMORTAL`
+/// in rb_runtime.h).
+const RB_STRING_IMMORTAL: i32 = i32::MIN;
+
+/// Step result of a finished ASYNC body, step result while it waits on I/O
+/// readiness, and the poll interval of AWAIT UNTIL outside ASYNC
+/// (`RB_ASYNC_DONE` / `RB_ASYNC_IO` / `RB_ASYNC_POLL_MS`).
+const RB_ASYNC_DONE: i32 = -1;
+const RB_ASYNC_IO: i32 = -2;
+const RB_ASYNC_POLL_MS: u64 = 10;
+
+/// Blocking calls an ASYNC body runs on the I/O task (`RB_ASYNC_OP_*`).
+const RB_ASYNC_OP_HTTP_GET: u64 = 0;
+const RB_ASYNC_OP_HTTP_POST: u64 = 1;
+const RB_ASYNC_OP_TCP_RECEIVE: u64 = 2;
+
+/// The file FILE.OPEN opens without a handle variable (`RB_FH_FILE`).
+const RB_FH_FILE: u64 = 0;
+
+/// Refcount bits that route retain/release to the out-of-line slow path
+/// (`RB_STRING_RC_SLOW`: immortal or shared between tasks).
+const RB_STRING_RC_SLOW: i32 = RB_STRING_IMMORTAL | 0x4000_0000;
+
 /// Array metadata for codegen.
 struct ArrayInfo<'ctx> {
     data_ptr_alloca: PointerValue<'ctx>,
     dim_size_allocas: Vec<PointerValue<'ctx>>,
     total_size_alloca: PointerValue<'ctx>,
     element_vt: VarType,
+    /// Per-dimension sizes when every DIM bound is a compile-time constant
+    const_dims: Option<Vec<i64>>,
+}
+
+/// The ASYNC body being compiled. Its variables live in the heap frame the
+/// event loop passes to each step, so they survive a suspension; offset 0
+/// holds the resume state.
+struct AsyncFrame<'ctx> {
+    function: FunctionValue<'ctx>,
+    frame: PointerValue<'ctx>,
+    entry: inkwell::basic_block::BasicBlock<'ctx>,
+    start: inkwell::basic_block::BasicBlock<'ctx>,
+    size: std::cell::Cell<u64>,
+    resume_blocks: Vec<inkwell::basic_block::BasicBlock<'ctx>>,
 }
 
 pub struct Codegen<'ctx> {
@@ -90,7 +193,13 @@ pub struct Codegen<'ctx> {
     rt_string_alloc: Option<FunctionValue<'ctx>>,
     rt_string_concat: Option<FunctionValue<'ctx>>,
     rt_string_compare: Option<FunctionValue<'ctx>>,
+    rt_string_equal: Option<FunctionValue<'ctx>>,
     rt_string_release: Option<FunctionValue<'ctx>>,
+    rt_string_retain: Option<FunctionValue<'ctx>>,
+    rt_string_free: Option<FunctionValue<'ctx>>,
+    rt_string_retain_slow: Option<FunctionValue<'ctx>>,
+    rt_string_release_slow: Option<FunctionValue<'ctx>>,
+    rt_string_append: Option<FunctionValue<'ctx>>,
     rt_panic: Option<FunctionValue<'ctx>>,
     rt_gpio_mode: Option<FunctionValue<'ctx>>,
     rt_gpio_set: Option<FunctionValue<'ctx>>,
@@ -101,42 +210,80 @@ pub struct Codegen<'ctx> {
     rt_i2c_read: Option<FunctionValue<'ctx>>,
     rt_spi_setup: Option<FunctionValue<'ctx>>,
     rt_spi_transfer: Option<FunctionValue<'ctx>>,
+    rt_spi_send: Option<FunctionValue<'ctx>>,
+    rt_spi_transfer_str: Option<FunctionValue<'ctx>>,
+    rt_spi_flush: Option<FunctionValue<'ctx>>,
+    rt_i2c_send: Option<FunctionValue<'ctx>>,
+    rt_i2c_read_str: Option<FunctionValue<'ctx>>,
+    rt_i2c_write_read: Option<FunctionValue<'ctx>>,
     rt_wifi_connect: Option<FunctionValue<'ctx>>,
     rt_wifi_status: Option<FunctionValue<'ctx>>,
     rt_wifi_disconnect: Option<FunctionValue<'ctx>>,
     rt_adc_read: Option<FunctionValue<'ctx>>,
+    rt_adc_stream: Option<FunctionValue<'ctx>>,
+    rt_adc_block: Option<FunctionValue<'ctx>>,
+    rt_adc_stop: Option<FunctionValue<'ctx>>,
     rt_pwm_setup: Option<FunctionValue<'ctx>>,
     rt_pwm_duty: Option<FunctionValue<'ctx>>,
     rt_uart_setup: Option<FunctionValue<'ctx>>,
     rt_uart_write: Option<FunctionValue<'ctx>>,
     rt_uart_read: Option<FunctionValue<'ctx>>,
+    rt_uart_send: Option<FunctionValue<'ctx>>,
+    rt_uart_read_str: Option<FunctionValue<'ctx>>,
+    rt_uart_line: Option<FunctionValue<'ctx>>,
+    rt_on_uart_line: Option<FunctionValue<'ctx>>,
     rt_timer_start: Option<FunctionValue<'ctx>>,
     rt_timer_elapsed: Option<FunctionValue<'ctx>>,
+    rt_timer_micros: Option<FunctionValue<'ctx>>,
+    rt_timer_after: Option<FunctionValue<'ctx>>,
+    rt_timer_every: Option<FunctionValue<'ctx>>,
+    rt_timer_cancel: Option<FunctionValue<'ctx>>,
     rt_http_get: Option<FunctionValue<'ctx>>,
     rt_http_post: Option<FunctionValue<'ctx>>,
+    rt_http_download: Option<FunctionValue<'ctx>>,
+    rt_http_stream: Option<FunctionValue<'ctx>>,
+    rt_http_chunk: Option<FunctionValue<'ctx>>,
     rt_nvs_write: Option<FunctionValue<'ctx>>,
     rt_nvs_read: Option<FunctionValue<'ctx>>,
+    rt_nvs_write_str: Option<FunctionValue<'ctx>>,
+    rt_nvs_read_str: Option<FunctionValue<'ctx>>,
+    rt_nvs_commit: Option<FunctionValue<'ctx>>,
+    rt_nvs_autocommit: Option<FunctionValue<'ctx>>,
     rt_mqtt_connect: Option<FunctionValue<'ctx>>,
     rt_mqtt_disconnect: Option<FunctionValue<'ctx>>,
     rt_mqtt_publish: Option<FunctionValue<'ctx>>,
     rt_mqtt_subscribe: Option<FunctionValue<'ctx>>,
     rt_mqtt_receive: Option<FunctionValue<'ctx>>,
+    rt_mqtt_topic: Option<FunctionValue<'ctx>>,
+    rt_mqtt_coalesce: Option<FunctionValue<'ctx>>,
+    rt_mqtt_flush: Option<FunctionValue<'ctx>>,
     rt_ble_init: Option<FunctionValue<'ctx>>,
     rt_ble_advertise: Option<FunctionValue<'ctx>>,
     rt_ble_scan: Option<FunctionValue<'ctx>>,
     rt_ble_send: Option<FunctionValue<'ctx>>,
     rt_ble_receive: Option<FunctionValue<'ctx>>,
+    rt_ble_interval: Option<FunctionValue<'ctx>>,
+    rt_ble_mtu: Option<FunctionValue<'ctx>>,
     rt_json_get: Option<FunctionValue<'ctx>>,
     rt_json_set: Option<FunctionValue<'ctx>>,
     rt_json_count: Option<FunctionValue<'ctx>>,
+    rt_json_extract: Option<FunctionValue<'ctx>>,
+    rt_json_begin: Option<FunctionValue<'ctx>>,
+    rt_json_end: Option<FunctionValue<'ctx>>,
+    rt_json_add_int: Option<FunctionValue<'ctx>>,
+    rt_json_add_float: Option<FunctionValue<'ctx>>,
+    rt_json_add_str: Option<FunctionValue<'ctx>>,
     rt_led_setup: Option<FunctionValue<'ctx>>,
     rt_led_set: Option<FunctionValue<'ctx>>,
+    rt_led_set_all: Option<FunctionValue<'ctx>>,
     rt_led_show: Option<FunctionValue<'ctx>>,
     rt_led_clear: Option<FunctionValue<'ctx>>,
     rt_deepsleep: Option<FunctionValue<'ctx>>,
     rt_espnow_init: Option<FunctionValue<'ctx>>,
     rt_espnow_send: Option<FunctionValue<'ctx>>,
     rt_espnow_receive: Option<FunctionValue<'ctx>>,
+    rt_espnow_peer: Option<FunctionValue<'ctx>>,
+    rt_espnow_send_to: Option<FunctionValue<'ctx>>,
     rt_powf: Option<FunctionValue<'ctx>>,
     rt_array_alloc: Option<FunctionValue<'ctx>>,
     rt_array_free: Option<FunctionValue<'ctx>>,
@@ -146,9 +293,20 @@ pub struct Codegen<'ctx> {
     rt_data_read_float: Option<FunctionValue<'ctx>>,
     rt_data_read_string: Option<FunctionValue<'ctx>>,
     rt_data_restore: Option<FunctionValue<'ctx>>,
+    rt_prof_enter: Option<FunctionValue<'ctx>>,
+    rt_prof_exit: Option<FunctionValue<'ctx>>,
+    rt_profile_on: Option<FunctionValue<'ctx>>,
+    rt_profile_dump: Option<FunctionValue<'ctx>>,
+    rt_profile_report: Option<FunctionValue<'ctx>>,
+    rt_data_restore_at: Option<FunctionValue<'ctx>>,
+    rt_data_read_ints: Option<FunctionValue<'ctx>>,
+    rt_data_read_floats: Option<FunctionValue<'ctx>>,
 
     // New classic BASIC extensions
     rt_randomize: Option<FunctionValue<'ctx>>,
+    rt_randomize_hw: Option<FunctionValue<'ctx>>,
+    rt_rnd_fill_float: Option<FunctionValue<'ctx>>,
+    rt_rnd_fill_int: Option<FunctionValue<'ctx>>,
     rt_print_using_int: Option<FunctionValue<'ctx>>,
     rt_print_using_float: Option<FunctionValue<'ctx>>,
     rt_print_using_string: Option<FunctionValue<'ctx>>,
@@ -184,14 +342,18 @@ pub struct Codegen<'ctx> {
     rt_try_end: Option<FunctionValue<'ctx>>,
     rt_throw: Option<FunctionValue<'ctx>>,
     rt_get_error_message: Option<FunctionValue<'ctx>>,
+    rt_try_catch: Option<FunctionValue<'ctx>>,
     rt_task_create: Option<FunctionValue<'ctx>>,
+    rt_task_pool: Option<FunctionValue<'ctx>>,
+    rt_spawn: Option<FunctionValue<'ctx>>,
+    rt_wait: Option<FunctionValue<'ctx>>,
     rt_on_gpio_change: Option<FunctionValue<'ctx>>,
     rt_on_timer: Option<FunctionValue<'ctx>>,
     rt_on_mqtt_message: Option<FunctionValue<'ctx>>,
     rt_machine_create: Option<FunctionValue<'ctx>>,
-    rt_machine_add_state: Option<FunctionValue<'ctx>>,
-    rt_machine_add_transition: Option<FunctionValue<'ctx>>,
+    rt_machine_event_id: Option<FunctionValue<'ctx>>,
     rt_machine_event: Option<FunctionValue<'ctx>>,
+    rt_machine_state: Option<FunctionValue<'ctx>>,
     rt_machine_get_state: Option<FunctionValue<'ctx>>,
 
     // New hardware extensions (phase 2)
@@ -201,9 +363,16 @@ pub struct Codegen<'ctx> {
     rt_file_open: Option<FunctionValue<'ctx>>,
     rt_file_write: Option<FunctionValue<'ctx>>,
     rt_file_read: Option<FunctionValue<'ctx>>,
+    rt_file_read_n: Option<FunctionValue<'ctx>>,
     rt_file_close: Option<FunctionValue<'ctx>>,
     rt_file_delete: Option<FunctionValue<'ctx>>,
     rt_file_exists: Option<FunctionValue<'ctx>>,
+    rt_file_open_handle: Option<FunctionValue<'ctx>>,
+    rt_fh_write: Option<FunctionValue<'ctx>>,
+    rt_fh_read: Option<FunctionValue<'ctx>>,
+    rt_fh_readline: Option<FunctionValue<'ctx>>,
+    rt_fh_eof: Option<FunctionValue<'ctx>>,
+    rt_fh_close: Option<FunctionValue<'ctx>>,
     rt_ws_connect: Option<FunctionValue<'ctx>>,
     rt_ws_send: Option<FunctionValue<'ctx>>,
     rt_ws_receive: Option<FunctionValue<'ctx>>,
@@ -213,6 +382,10 @@ pub struct Codegen<'ctx> {
     rt_tcp_send: Option<FunctionValue<'ctx>>,
     rt_tcp_receive: Option<FunctionValue<'ctx>>,
     rt_tcp_close: Option<FunctionValue<'ctx>>,
+    rt_tcp_client: Option<FunctionValue<'ctx>>,
+    rt_tcp_send_to: Option<FunctionValue<'ctx>>,
+    rt_tcp_close_client: Option<FunctionValue<'ctx>>,
+    rt_on_tcp_data: Option<FunctionValue<'ctx>>,
     rt_wdt_enable: Option<FunctionValue<'ctx>>,
     rt_wdt_feed: Option<FunctionValue<'ctx>>,
     rt_wdt_disable: Option<FunctionValue<'ctx>>,
@@ -221,30 +394,69 @@ pub struct Codegen<'ctx> {
     rt_i2s_init: Option<FunctionValue<'ctx>>,
     rt_i2s_write: Option<FunctionValue<'ctx>>,
     rt_i2s_stop: Option<FunctionValue<'ctx>>,
+    rt_i2s_pins: Option<FunctionValue<'ctx>>,
+    rt_i2s_read: Option<FunctionValue<'ctx>>,
+    rt_on_i2s_need: Option<FunctionValue<'ctx>>,
     // Web Server
     rt_web_start: Option<FunctionValue<'ctx>>,
     rt_web_wait: Option<FunctionValue<'ctx>>,
     rt_web_body: Option<FunctionValue<'ctx>>,
     rt_web_reply: Option<FunctionValue<'ctx>>,
     rt_web_stop: Option<FunctionValue<'ctx>>,
+    rt_web_route: Option<FunctionValue<'ctx>>,
+    rt_web_request: Option<FunctionValue<'ctx>>,
+    rt_web_reply_to: Option<FunctionValue<'ctx>>,
+    rt_web_serve: Option<FunctionValue<'ctx>>,
     // SD Card
     rt_sd_init: Option<FunctionValue<'ctx>>,
     rt_sd_open: Option<FunctionValue<'ctx>>,
+    rt_sd_open_handle: Option<FunctionValue<'ctx>>,
     rt_sd_write: Option<FunctionValue<'ctx>>,
     rt_sd_read: Option<FunctionValue<'ctx>>,
+    rt_sd_read_n: Option<FunctionValue<'ctx>>,
     rt_sd_close: Option<FunctionValue<'ctx>>,
     rt_sd_free: Option<FunctionValue<'ctx>>,
+    rt_console_flush: Option<FunctionValue<'ctx>>,
+    rt_console_mode: Option<FunctionValue<'ctx>>,
+    rt_log_open: Option<FunctionValue<'ctx>>,
+    rt_log_write: Option<FunctionValue<'ctx>>,
+    rt_log_flush: Option<FunctionValue<'ctx>>,
+    rt_log_close: Option<FunctionValue<'ctx>>,
+    rt_log_dropped: Option<FunctionValue<'ctx>>,
+    rt_event_coalesced: Option<FunctionValue<'ctx>>,
+    rt_event_dropped: Option<FunctionValue<'ctx>>,
     // Async
     rt_yield: Option<FunctionValue<'ctx>>,
     rt_await: Option<FunctionValue<'ctx>>,
+    rt_async_start: Option<FunctionValue<'ctx>>,
+    rt_async_io_begin: Option<FunctionValue<'ctx>>,
+    rt_async_io_done: Option<FunctionValue<'ctx>>,
+    rt_async_io_take: Option<FunctionValue<'ctx>>,
     // Cron
     rt_cron_add: Option<FunctionValue<'ctx>>,
     rt_cron_check: Option<FunctionValue<'ctx>>,
     rt_cron_remove: Option<FunctionValue<'ctx>>,
+    rt_on_cron: Option<FunctionValue<'ctx>>,
     // Regex
     rt_regex_match: Option<FunctionValue<'ctx>>,
     rt_regex_find: Option<FunctionValue<'ctx>>,
     rt_regex_replace: Option<FunctionValue<'ctx>>,
+    // String Builder
+    rt_sb_new: Option<FunctionValue<'ctx>>,
+    rt_sb_append_int: Option<FunctionValue<'ctx>>,
+    rt_sb_append_float: Option<FunctionValue<'ctx>>,
+    rt_sb_append_str: Option<FunctionValue<'ctx>>,
+    rt_sb_tostring: Option<FunctionValue<'ctx>>,
+    rt_sb_clear: Option<FunctionValue<'ctx>>,
+    rt_sb_free: Option<FunctionValue<'ctx>>,
+    rt_channel_create: Option<FunctionValue<'ctx>>,
+    rt_channel_send_int: Option<FunctionValue<'ctx>>,
+    rt_channel_send_float: Option<FunctionValue<'ctx>>,
+    rt_channel_send_str: Option<FunctionValue<'ctx>>,
+    rt_channel_receive_int: Option<FunctionValue<'ctx>>,
+    rt_channel_receive_float: Option<FunctionValue<'ctx>>,
+    rt_channel_receive_str: Option<FunctionValue<'ctx>>,
+    rt_channel_select: Option<FunctionValue<'ctx>>,
 
     // String built-in function declarations
     rt_fn_len: Option<FunctionValue<'ctx>>,
@@ -256,6 +468,27 @@ pub struct Codegen<'ctx> {
     rt_fn_instr: Option<FunctionValue<'ctx>>,
     rt_fn_str_s: Option<FunctionValue<'ctx>>,
     rt_fn_val: Option<FunctionValue<'ctx>>,
+    rt_fn_val_next: Option<FunctionValue<'ctx>>,
+    rt_fn_val_next_int: Option<FunctionValue<'ctx>>,
+    rt_array_sum_int: Option<FunctionValue<'ctx>>,
+    rt_array_sum_float: Option<FunctionValue<'ctx>>,
+    rt_array_min_int: Option<FunctionValue<'ctx>>,
+    rt_array_max_int: Option<FunctionValue<'ctx>>,
+    rt_array_min_float: Option<FunctionValue<'ctx>>,
+    rt_array_max_float: Option<FunctionValue<'ctx>>,
+    rt_array_dot_int: Option<FunctionValue<'ctx>>,
+    rt_array_dot_float: Option<FunctionValue<'ctx>>,
+    rt_array_fill_int: Option<FunctionValue<'ctx>>,
+    rt_array_fill_float: Option<FunctionValue<'ctx>>,
+    rt_array_copy: Option<FunctionValue<'ctx>>,
+    rt_array_scale_int: Option<FunctionValue<'ctx>>,
+    rt_array_scale_float: Option<FunctionValue<'ctx>>,
+    rt_dsp_fir: Option<FunctionValue<'ctx>>,
+    rt_dsp_biquad: Option<FunctionValue<'ctx>>,
+    rt_dsp_fft: Option<FunctionValue<'ctx>>,
+    rt_dsp_mag: Option<FunctionValue<'ctx>>,
+    rt_dsp_rms: Option<FunctionValue<'ctx>>,
+    rt_dsp_peak: Option<FunctionValue<'ctx>>,
     rt_fn_ucase_s: Option<FunctionValue<'ctx>>,
     rt_fn_lcase_s: Option<FunctionValue<'ctx>>,
     rt_fn_trim_s: Option<FunctionValue<'ctx>>,
@@ -269,6 +502,10 @@ pub struct Codegen<'ctx> {
     rt_fn_atn: Option<FunctionValue<'ctx>>,
     rt_fn_log: Option<FunctionValue<'ctx>>,
     rt_fn_exp: Option<FunctionValue<'ctx>>,
+    rt_fn_sin_fast: Option<FunctionValue<'ctx>>,
+    rt_fn_cos_fast: Option<FunctionValue<'ctx>>,
+    rt_fn_exp_fast: Option<FunctionValue<'ctx>>,
+    rt_fn_log_fast: Option<FunctionValue<'ctx>>,
     rt_fn_int: Option<FunctionValue<'ctx>>,
     rt_fn_fix: Option<FunctionValue<'ctx>>,
     rt_fn_sgn: Option<FunctionValue<'ctx>>,
@@ -280,13 +517,24 @@ pub struct Codegen<'ctx> {
     gosub_counter: i32,
     gosub_return_points: Vec<(i32, inkwell::basic_block::BasicBlock<'ctx>)>,
 
-    // Loop exit stacks (for EXIT FOR / EXIT DO)
-    for_exit_stack: Vec<inkwell::basic_block::BasicBlock<'ctx>>,
-    do_exit_stack: Vec<inkwell::basic_block::BasicBlock<'ctx>>,
+    // Loop exit stacks (for EXIT FOR / EXIT DO): the block after the loop
+    // and how many TRYs were open where the loop starts
+    for_exit_stack: Vec<(inkwell::basic_block::BasicBlock<'ctx>, usize)>,
+    do_exit_stack: Vec<(inkwell::basic_block::BasicBlock<'ctx>, usize)>,
 
     // Current function context
     current_function: Option<FunctionValue<'ctx>>,
     current_exit_bb: Option<inkwell::basic_block::BasicBlock<'ctx>>,
+    // Set while compiling a body that emits something able to free a string
+    // a borrowed parameter may point at: a string array or field store, or
+    // a call to a user SUB/FUNCTION
+    body_may_free_strings: bool,
+
+    // TRY/CATCH: whether the program has any TRY, the CATCH block of each
+    // enclosing TRY, and the SUB/FUNCTION whose exit an error returns through
+    uses_try: bool,
+    try_catch_bbs: Vec<(FunctionValue<'ctx>, inkwell::basic_block::BasicBlock<'ctx>)>,
+    error_exit_fn: Option<FunctionValue<'ctx>>,
 
     // Label basic blocks (string-based)
     label_bbs: HashMap<String, inkwell::basic_block::BasicBlock<'ctx>>,
@@ -300,6 +548,34 @@ pub struct Codegen<'ctx> {
 
     // Enum constant lookup
     enums: HashMap<String, HashMap<String, i32>>,
+    // Event names of each MACHINE, indexed by event number
+    machine_events: HashMap<String, Vec<String>>,
+
+    // Immortal string literal globals, deduplicated by text
+    string_literals: HashMap<String, PointerValue<'ctx>>,
+
+    // Array bounds-check elimination: integer CONST values, and the constant
+    // FROM..TO range of each enclosing FOR counter proven invariant by sema
+    bounds_checks: bool,
+    opt_level: OptLevel,
+    const_ints: HashMap<String, i64>,
+    for_ranges: Vec<(String, i64, i64)>,
+
+    // Table-driven SIN/COS/EXP/LOG (`--fast-math`), and SINGLE CONST
+    // values for folding math built-ins over constants
+    fast_math: bool,
+    const_floats: HashMap<String, f32>,
+
+    // Count calls and cycles per SUB/FUNCTION (`--profile`); each body's
+    // index in the runtime's table
+    profile: bool,
+    prof_ids: HashMap<String, i32>,
+
+    // Byte offset in rb_data_stream of the first DATA after each label
+    data_label_offsets: HashMap<String, u32>,
+
+    // Frame of the ASYNC body under compilation, if any
+    async_frame: Option<AsyncFrame<'ctx>>,
 
     // Sema results
     sema: SemaResult,
@@ -338,7 +614,13 @@ impl<'ctx> Codegen<'ctx> {
             rt_string_alloc: None,
             rt_string_concat: None,
             rt_string_compare: None,
+            rt_string_equal: None,
             rt_string_release: None,
+            rt_string_retain: None,
+            rt_string_free: None,
+            rt_string_retain_slow: None,
+            rt_string_release_slow: None,
+            rt_string_append: None,
             rt_panic: None,
             rt_gpio_mode: None,
             rt_gpio_set: None,
@@ -349,42 +631,80 @@ impl<'ctx> Codegen<'ctx> {
             rt_i2c_read: None,
             rt_spi_setup: None,
             rt_spi_transfer: None,
+            rt_spi_send: None,
+            rt_spi_transfer_str: None,
+            rt_spi_flush: None,
+            rt_i2c_send: None,
+            rt_i2c_read_str: None,
+            rt_i2c_write_read: None,
             rt_wifi_connect: None,
             rt_wifi_status: None,
             rt_wifi_disconnect: None,
             rt_adc_read: None,
+            rt_adc_stream: None,
+            rt_adc_block: None,
+            rt_adc_stop: None,
             rt_pwm_setup: None,
             rt_pwm_duty: None,
             rt_uart_setup: None,
             rt_uart_write: None,
             rt_uart_read: None,
+            rt_uart_send: None,
+            rt_uart_read_str: None,
+            rt_uart_line: None,
+            rt_on_uart_line: None,
             rt_timer_start: None,
             rt_timer_elapsed: None,
+            rt_timer_micros: None,
+            rt_timer_after: None,
+            rt_timer_every: None,
+            rt_timer_cancel: None,
             rt_http_get: None,
             rt_http_post: None,
+            rt_http_download: None,
+            rt_http_stream: None,
+            rt_http_chunk: None,
             rt_nvs_write: None,
             rt_nvs_read: None,
+            rt_nvs_write_str: None,
+            rt_nvs_read_str: None,
+            rt_nvs_commit: None,
+            rt_nvs_autocommit: None,
             rt_mqtt_connect: None,
             rt_mqtt_disconnect: None,
             rt_mqtt_publish: None,
             rt_mqtt_subscribe: None,
             rt_mqtt_receive: None,
+            rt_mqtt_topic: None,
+            rt_mqtt_coalesce: None,
+            rt_mqtt_flush: None,
             rt_ble_init: None,
             rt_ble_advertise: None,
             rt_ble_scan: None,
             rt_ble_send: None,
             rt_ble_receive: None,
+            rt_ble_interval: None,
+            rt_ble_mtu: None,
             rt_json_get: None,
             rt_json_set: None,
             rt_json_count: None,
+            rt_json_extract: None,
+            rt_json_begin: None,
+            rt_json_end: None,
+            rt_json_add_int: None,
+            rt_json_add_float: None,
+            rt_json_add_str: None,
             rt_led_setup: None,
             rt_led_set: None,
+            rt_led_set_all: None,
             rt_led_show: None,
             rt_led_clear: None,
             rt_deepsleep: None,
             rt_espnow_init: None,
             rt_espnow_send: None,
             rt_espnow_receive: None,
+            rt_espnow_peer: None,
+            rt_espnow_send_to: None,
             rt_powf: None,
             rt_array_alloc: None,
             rt_array_free: None,
@@ -394,7 +714,18 @@ impl<'ctx> Codegen<'ctx> {
             rt_data_read_float: None,
             rt_data_read_string: None,
             rt_data_restore: None,
+            rt_prof_enter: None,
+            rt_prof_exit: None,
+            rt_profile_on: None,
+            rt_profile_dump: None,
+            rt_profile_report: None,
+            rt_data_restore_at: None,
+            rt_data_read_ints: None,
+            rt_data_read_floats: None,
             rt_randomize: None,
+            rt_randomize_hw: None,
+            rt_rnd_fill_float: None,
+            rt_rnd_fill_int: None,
             rt_print_using_int: None,
             rt_print_using_float: None,
             rt_print_using_string: None,
@@ -427,14 +758,18 @@ impl<'ctx> Codegen<'ctx> {
             rt_try_end: None,
             rt_throw: None,
             rt_get_error_message: None,
+            rt_try_catch: None,
             rt_task_create: None,
+            rt_task_pool: None,
+            rt_spawn: None,
+            rt_wait: None,
             rt_on_gpio_change: None,
             rt_on_timer: None,
             rt_on_mqtt_message: None,
             rt_machine_create: None,
-            rt_machine_add_state: None,
-            rt_machine_add_transition: None,
+            rt_machine_event_id: None,
             rt_machine_event: None,
+            rt_machine_state: None,
             rt_machine_get_state: None,
             rt_ntp_sync: None,
             rt_ntp_time: None,
@@ -442,9 +777,16 @@ impl<'ctx> Codegen<'ctx> {
             rt_file_open: None,
             rt_file_write: None,
             rt_file_read: None,
+            rt_file_read_n: None,
             rt_file_close: None,
             rt_file_delete: None,
             rt_file_exists: None,
+            rt_file_open_handle: None,
+            rt_fh_write: None,
+            rt_fh_read: None,
+            rt_fh_readline: None,
+            rt_fh_eof: None,
+            rt_fh_close: None,
             rt_ws_connect: None,
             rt_ws_send: None,
             rt_ws_receive: None,
@@ -454,6 +796,10 @@ impl<'ctx> Codegen<'ctx> {
             rt_tcp_send: None,
             rt_tcp_receive: None,
             rt_tcp_close: None,
+            rt_tcp_client: None,
+            rt_tcp_send_to: None,
+            rt_tcp_close_client: None,
+            rt_on_tcp_data: None,
             rt_wdt_enable: None,
             rt_wdt_feed: None,
             rt_wdt_disable: None,
@@ -462,25 +808,63 @@ impl<'ctx> Codegen<'ctx> {
             rt_i2s_init: None,
             rt_i2s_write: None,
             rt_i2s_stop: None,
+            rt_i2s_pins: None,
+            rt_i2s_read: None,
+            rt_on_i2s_need: None,
             rt_web_start: None,
             rt_web_wait: None,
             rt_web_body: None,
             rt_web_reply: None,
             rt_web_stop: None,
+            rt_web_route: None,
+            rt_web_request: None,
+            rt_web_reply_to: None,
+            rt_web_serve: None,
             rt_sd_init: None,
             rt_sd_open: None,
+            rt_sd_open_handle: None,
             rt_sd_write: None,
             rt_sd_read: None,
+            rt_sd_read_n: None,
             rt_sd_close: None,
             rt_sd_free: None,
+            rt_console_flush: None,
+            rt_console_mode: None,
+            rt_log_open: None,
+            rt_log_write: None,
+            rt_log_flush: None,
+            rt_log_close: None,
+            rt_log_dropped: None,
+            rt_event_coalesced: None,
+            rt_event_dropped: None,
             rt_yield: None,
             rt_await: None,
+            rt_async_start: None,
+            rt_async_io_begin: None,
+            rt_async_io_done: None,
+            rt_async_io_take: None,
             rt_cron_add: None,
             rt_cron_check: None,
             rt_cron_remove: None,
+            rt_on_cron: None,
             rt_regex_match: None,
             rt_regex_find: None,
             rt_regex_replace: None,
+            rt_sb_new: None,
+            rt_sb_append_int: None,
+            rt_sb_append_float: None,
+            rt_sb_append_str: None,
+            rt_sb_tostring: None,
+            rt_sb_clear: None,
+            rt_sb_free: None,
+            rt_channel_create: None,
+            rt_channel_send_int: None,
+            rt_channel_send_float: None,
+            rt_channel_send_str: None,
+            rt_channel_receive_int: None,
+            rt_channel_receive_float: None,
+            rt_channel_receive_str: None,
+            rt_channel_select: None,
             rt_fn_len: None,
             rt_fn_asc: None,
             rt_fn_chr_s: None,
@@ -490,6 +874,27 @@ impl<'ctx> Codegen<'ctx> {
             rt_fn_instr: None,
             rt_fn_str_s: None,
             rt_fn_val: None,
+            rt_fn_val_next: None,
+            rt_fn_val_next_int: None,
+            rt_array_sum_int: None,
+            rt_array_sum_float: None,
+            rt_array_min_int: None,
+            rt_array_max_int: None,
+            rt_array_min_float: None,
+            rt_array_max_float: None,
+            rt_array_dot_int: None,
+            rt_array_dot_float: None,
+            rt_array_fill_int: None,
+            rt_array_fill_float: None,
+            rt_array_copy: None,
+            rt_array_scale_int: None,
+            rt_array_scale_float: None,
+            rt_dsp_fir: None,
+            rt_dsp_biquad: None,
+            rt_dsp_fft: None,
+            rt_dsp_mag: None,
+            rt_dsp_rms: None,
+            rt_dsp_peak: None,
             rt_fn_ucase_s: None,
             rt_fn_lcase_s: None,
             rt_fn_trim_s: None,
@@ -501,6 +906,10 @@ impl<'ctx> Codegen<'ctx> {
             rt_fn_atn: None,
             rt_fn_log: None,
             rt_fn_exp: None,
+            rt_fn_sin_fast: None,
+            rt_fn_cos_fast: None,
+            rt_fn_exp_fast: None,
+            rt_fn_log_fast: None,
             rt_fn_int: None,
             rt_fn_fix: None,
             rt_fn_sgn: None,
@@ -513,11 +922,27 @@ impl<'ctx> Codegen<'ctx> {
             do_exit_stack: Vec::new(),
             current_function: None,
             current_exit_bb: None,
+            body_may_free_strings: false,
+            uses_try: false,
+            try_catch_bbs: Vec::new(),
+            error_exit_fn: None,
             label_bbs: HashMap::new(),
             user_functions: HashMap::new(),
             lambda_counter: 0,
             task_counter: 0,
             enums: HashMap::new(),
+            machine_events: HashMap::new(),
+            string_literals: HashMap::new(),
+            bounds_checks: true,
+            opt_level: OptLevel::O2,
+            const_ints: HashMap::new(),
+            fast_math: false,
+            profile: false,
+            prof_ids: HashMap::new(),
+            const_floats: HashMap::new(),
+            data_label_offsets: HashMap::new(),
+            for_ranges: Vec::new(),
+            async_frame: None,
             sema,
         };
         cg.declare_runtime_functions();
@@ -592,11 +1017,53 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        self.rt_string_equal = Some(self.module.add_function(
+            "rb_string_equal",
+            i32_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
         self.rt_string_release = Some(self.module.add_function(
             "rb_string_release",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
+        self.rt_string_retain = Some(self.module.add_function(
+            "rb_string_retain",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_string_free = Some(self.module.add_function(
+            "rb_string_free",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_string_retain_slow = Some(self.module.add_function(
+            "rb_string_retain_slow",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_string_release_slow = Some(self.module.add_function(
+            "rb_string_release_slow",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_string_append = Some(self.module.add_function(
+            "rb_string_append",
+            ptr_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
         self.rt_panic = Some(self.module.add_function(
             "rb_panic",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
@@ -688,6 +1155,39 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
+        self.rt_spi_send = Some(self.module.add_function(
+            "rb_spi_send",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_spi_transfer_str = Some(self.module.add_function(
+            "rb_spi_transfer_str",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_spi_flush = Some(self.module.add_function(
+            "rb_spi_flush",
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_i2c_send = Some(self.module.add_function(
+            "rb_i2c_send",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_i2c_read_str = Some(self.module.add_function(
+            "rb_i2c_read_str",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_i2c_write_read = Some(self.module.add_function(
+            "rb_i2c_write_read",
+            ptr_t.fn_type(
+                &[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)],
+                false,
+            ),
+            None,
+        ));
         self.rt_wifi_connect = Some(self.module.add_function(
             "rb_wifi_connect",
             void_t.fn_type(
@@ -714,6 +1214,21 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
+        self.rt_adc_stream = Some(self.module.add_function(
+            "rb_adc_stream",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_adc_block = Some(self.module.add_function(
+            "rb_adc_block",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_adc_stop = Some(self.module.add_function(
+            "rb_adc_stop",
+            void_t.fn_type(&[], false),
+            None,
+        ));
         self.rt_pwm_setup = Some(self.module.add_function(
             "rb_pwm_setup",
             void_t.fn_type(
@@ -746,6 +1261,7 @@ impl<'ctx> Codegen<'ctx> {
                     BasicMetadataTypeEnum::from(i32_t),
                     BasicMetadataTypeEnum::from(i32_t),
                     BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(i32_t),
                 ],
                 false,
             ),
@@ -767,6 +1283,33 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
+        self.rt_uart_send = Some(self.module.add_function(
+            "rb_uart_send",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_uart_read_str = Some(self.module.add_function(
+            "rb_uart_read_str",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_uart_line = Some(self.module.add_function(
+            "rb_uart_line",
+            ptr_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_on_uart_line = Some(self.module.add_function(
+            "rb_on_uart_line",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
         self.rt_timer_start = Some(self.module.add_function(
             "rb_timer_start",
             void_t.fn_type(&[], false),
@@ -777,6 +1320,26 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[], false),
             None,
         ));
+        self.rt_timer_micros = Some(self.module.add_function(
+            "rb_timer_micros",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_timer_after = Some(self.module.add_function(
+            "rb_timer_after",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_timer_every = Some(self.module.add_function(
+            "rb_timer_every",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_timer_cancel = Some(self.module.add_function(
+            "rb_timer_cancel",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_http_get = Some(self.module.add_function(
             "rb_http_get",
             ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
@@ -793,6 +1356,33 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        self.rt_http_download = Some(self.module.add_function(
+            "rb_http_download",
+            i32_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_http_stream = Some(self.module.add_function(
+            "rb_http_stream",
+            i32_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_http_chunk = Some(self.module.add_function(
+            "rb_http_chunk",
+            ptr_t.fn_type(&[], false),
+            None,
+        ));
         self.rt_nvs_write = Some(self.module.add_function(
             "rb_nvs_write",
             void_t.fn_type(
@@ -809,6 +1399,26 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
+        self.rt_nvs_write_str = Some(self.module.add_function(
+            "rb_nvs_write_str",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_nvs_read_str = Some(self.module.add_function(
+            "rb_nvs_read_str",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_nvs_commit = Some(self.module.add_function(
+            "rb_nvs_commit",
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_nvs_autocommit = Some(self.module.add_function(
+            "rb_nvs_autocommit",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_mqtt_connect = Some(self.module.add_function(
             "rb_mqtt_connect",
             void_t.fn_type(
@@ -831,6 +1441,8 @@ impl<'ctx> Codegen<'ctx> {
                 &[
                     BasicMetadataTypeEnum::from(ptr_t),
                     BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(i32_t),
                 ],
                 false,
             ),
@@ -846,6 +1458,28 @@ impl<'ctx> Codegen<'ctx> {
             ptr_t.fn_type(&[], false),
             None,
         ));
+        self.rt_mqtt_topic = Some(self.module.add_function(
+            "rb_mqtt_topic",
+            ptr_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_mqtt_coalesce = Some(self.module.add_function(
+            "rb_mqtt_coalesce",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_mqtt_flush = Some(self.module.add_function(
+            "rb_mqtt_flush",
+            void_t.fn_type(&[], false),
+            None,
+        ));
         self.rt_ble_init = Some(self.module.add_function(
             "rb_ble_init",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
@@ -871,6 +1505,16 @@ impl<'ctx> Codegen<'ctx> {
             ptr_t.fn_type(&[], false),
             None,
         ));
+        self.rt_ble_interval = Some(self.module.add_function(
+            "rb_ble_interval",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_ble_mtu = Some(self.module.add_function(
+            "rb_ble_mtu",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
         self.rt_json_get = Some(self.module.add_function(
             "rb_json_get",
             ptr_t.fn_type(
@@ -899,6 +1543,61 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
+        self.rt_json_begin = Some(self.module.add_function(
+            "rb_json_begin",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_json_end = Some(self.module.add_function(
+            "rb_json_end",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        let json_add_type = |value_t: BasicMetadataTypeEnum<'ctx>| {
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    value_t,
+                ],
+                false,
+            )
+        };
+        self.rt_json_add_int = Some(self.module.add_function(
+            "rb_json_add_int",
+            json_add_type(BasicMetadataTypeEnum::from(i32_t)),
+            None,
+        ));
+        self.rt_json_add_float = Some(self.module.add_function(
+            "rb_json_add_float",
+            json_add_type(BasicMetadataTypeEnum::from(f32_t)),
+            None,
+        ));
+        self.rt_json_add_str = Some(self.module.add_function(
+            "rb_json_add_str",
+            json_add_type(BasicMetadataTypeEnum::from(ptr_t)),
+            None,
+        ));
+        self.rt_json_extract = Some(self.module.add_function(
+            "rb_json_extract_multi",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
         self.rt_led_setup = Some(self.module.add_function(
             "rb_led_setup",
             void_t.fn_type(
@@ -923,6 +1622,11 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        self.rt_led_set_all = Some(self.module.add_function(
+            "rb_led_set_all",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_led_show = Some(self.module.add_function(
             "rb_led_show",
             void_t.fn_type(&[], false),
@@ -959,6 +1663,16 @@ impl<'ctx> Codegen<'ctx> {
             ptr_t.fn_type(&[], false),
             None,
         ));
+        self.rt_espnow_peer = Some(self.module.add_function(
+            "rb_espnow_peer",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_espnow_send_to = Some(self.module.add_function(
+            "rb_espnow_send_to",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
         self.rt_powf = Some(self.module.add_function(
             "powf",
             f32_t.fn_type(
@@ -997,6 +1711,13 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        // Only reached on the out-of-range path, where it panics
+        let cold = self
+            .context
+            .create_enum_attribute(Attribute::get_named_enum_kind_id("cold"), 0);
+        self.rt_array_bounds_check
+            .unwrap()
+            .add_attribute(AttributeLoc::Function, cold);
         self.rt_array_check_dim_size = Some(self.module.add_function(
             "rb_array_check_dim_size",
             void_t.fn_type(
@@ -1080,46 +1801,155 @@ impl<'ctx> Codegen<'ctx> {
             f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
-        self.rt_fn_ucase_s = Some(self.module.add_function(
-            "rb_fn_ucase_s",
-            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_fn_val_next = Some(self.module.add_function(
+            "rb_fn_val_next",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
-        self.rt_fn_lcase_s = Some(self.module.add_function(
-            "rb_fn_lcase_s",
-            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_fn_val_next_int = Some(self.module.add_function(
+            "rb_fn_val_next_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
-        self.rt_fn_trim_s = Some(self.module.add_function(
-            "rb_fn_trim_s",
-            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_array_sum_int = Some(self.module.add_function(
+            "rb_array_sum_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
-
-        // ── Math built-in functions ──
-        let f32_to_f32 = f32_t.fn_type(&[BasicMetadataTypeEnum::from(f32_t)], false);
-        let f32_to_i32 = i32_t.fn_type(&[BasicMetadataTypeEnum::from(f32_t)], false);
-
-        self.rt_fn_sqr = Some(self.module.add_function("rb_fn_sqr", f32_to_f32, None));
-        self.rt_fn_abs = Some(self.module.add_function("rb_fn_abs", f32_to_f32, None));
-        self.rt_fn_sin = Some(self.module.add_function("rb_fn_sin", f32_to_f32, None));
-        self.rt_fn_cos = Some(self.module.add_function("rb_fn_cos", f32_to_f32, None));
-        self.rt_fn_tan = Some(self.module.add_function("rb_fn_tan", f32_to_f32, None));
-        self.rt_fn_atn = Some(self.module.add_function("rb_fn_atn", f32_to_f32, None));
-        self.rt_fn_log = Some(self.module.add_function("rb_fn_log", f32_to_f32, None));
-        self.rt_fn_exp = Some(self.module.add_function("rb_fn_exp", f32_to_f32, None));
-        self.rt_fn_int = Some(self.module.add_function("rb_fn_int", f32_to_i32, None));
-        self.rt_fn_fix = Some(self.module.add_function("rb_fn_fix", f32_to_i32, None));
-        self.rt_fn_sgn = Some(self.module.add_function("rb_fn_sgn", f32_to_i32, None));
-        self.rt_fn_rnd = Some(self.module.add_function(
-            "rb_fn_rnd",
-            f32_t.fn_type(&[], false),
+        self.rt_array_sum_float = Some(self.module.add_function(
+            "rb_array_sum_float",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
-
-        // ── DATA/READ/RESTORE runtime functions ──
-        self.rt_data_read_int = Some(self.module.add_function(
-            "rb_data_read_int",
+        self.rt_array_min_int = Some(self.module.add_function(
+            "rb_array_min_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_max_int = Some(self.module.add_function(
+            "rb_array_max_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_min_float = Some(self.module.add_function(
+            "rb_array_min_float",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_max_float = Some(self.module.add_function(
+            "rb_array_max_float",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_dot_int = Some(self.module.add_function(
+            "rb_array_dot_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_dot_float = Some(self.module.add_function(
+            "rb_array_dot_float",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_fill_int = Some(self.module.add_function(
+            "rb_array_fill_int",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_fill_float = Some(self.module.add_function(
+            "rb_array_fill_float",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_array_copy = Some(self.module.add_function(
+            "rb_array_copy",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_array_scale_int = Some(self.module.add_function(
+            "rb_array_scale_int",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_array_scale_float = Some(self.module.add_function(
+            "rb_array_scale_float",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_dsp_fir = Some(self.module.add_function(
+            "rb_dsp_fir",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_dsp_biquad = Some(self.module.add_function(
+            "rb_dsp_biquad",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_dsp_fft = Some(self.module.add_function(
+            "rb_dsp_fft",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_dsp_mag = Some(self.module.add_function(
+            "rb_dsp_mag",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_dsp_rms = Some(self.module.add_function(
+            "rb_dsp_rms",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_dsp_peak = Some(self.module.add_function(
+            "rb_dsp_peak",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_fn_ucase_s = Some(self.module.add_function(
+            "rb_fn_ucase_s",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_fn_lcase_s = Some(self.module.add_function(
+            "rb_fn_lcase_s",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_fn_trim_s = Some(self.module.add_function(
+            "rb_fn_trim_s",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+
+        // ── Math built-in functions ──
+        let f32_to_f32 = f32_t.fn_type(&[BasicMetadataTypeEnum::from(f32_t)], false);
+        let f32_to_i32 = i32_t.fn_type(&[BasicMetadataTypeEnum::from(f32_t)], false);
+
+        self.rt_fn_sqr = Some(self.module.add_function("rb_fn_sqr", f32_to_f32, None));
+        self.rt_fn_abs = Some(self.module.add_function("rb_fn_abs", f32_to_f32, None));
+        self.rt_fn_sin = Some(self.module.add_function("rb_fn_sin", f32_to_f32, None));
+        self.rt_fn_cos = Some(self.module.add_function("rb_fn_cos", f32_to_f32, None));
+        self.rt_fn_tan = Some(self.module.add_function("rb_fn_tan", f32_to_f32, None));
+        self.rt_fn_atn = Some(self.module.add_function("rb_fn_atn", f32_to_f32, None));
+        self.rt_fn_log = Some(self.module.add_function("rb_fn_log", f32_to_f32, None));
+        self.rt_fn_exp = Some(self.module.add_function("rb_fn_exp", f32_to_f32, None));
+        self.rt_fn_sin_fast = Some(self.module.add_function("rb_fn_sin_fast", f32_to_f32, None));
+        self.rt_fn_cos_fast = Some(self.module.add_function("rb_fn_cos_fast", f32_to_f32, None));
+        self.rt_fn_exp_fast = Some(self.module.add_function("rb_fn_exp_fast", f32_to_f32, None));
+        self.rt_fn_log_fast = Some(self.module.add_function("rb_fn_log_fast", f32_to_f32, None));
+        self.rt_fn_int = Some(self.module.add_function("rb_fn_int", f32_to_i32, None));
+        self.rt_fn_fix = Some(self.module.add_function("rb_fn_fix", f32_to_i32, None));
+        self.rt_fn_sgn = Some(self.module.add_function("rb_fn_sgn", f32_to_i32, None));
+        self.rt_fn_rnd = Some(self.module.add_function(
+            "rb_fn_rnd",
+            f32_t.fn_type(&[], false),
+            None,
+        ));
+
+        // ── DATA/READ/RESTORE runtime functions ──
+        self.rt_data_read_int = Some(self.module.add_function(
+            "rb_data_read_int",
             i32_t.fn_type(&[], false),
             None,
         ));
@@ -1138,12 +1968,42 @@ impl<'ctx> Codegen<'ctx> {
             void_t.fn_type(&[], false),
             None,
         ));
+        self.rt_data_restore_at = Some(self.module.add_function(
+            "rb_data_restore_at",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_data_read_ints = Some(self.module.add_function(
+            "rb_data_read_ints",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_data_read_floats = Some(self.module.add_function(
+            "rb_data_read_floats",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         // ── New classic BASIC extensions ──
         self.rt_randomize = Some(self.module.add_function(
             "rb_randomize",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
+        self.rt_randomize_hw = Some(self.module.add_function(
+            "rb_randomize_hw",
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_rnd_fill_float = Some(self.module.add_function(
+            "rb_rnd_fill_float",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_rnd_fill_int = Some(self.module.add_function(
+            "rb_rnd_fill_int",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_print_using_int = Some(self.module.add_function(
             "rb_print_using_int",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
@@ -1281,6 +2141,33 @@ impl<'ctx> Codegen<'ctx> {
             None,
         ));
 
+        // ── Profiling runtime ──
+        self.rt_prof_enter = Some(self.module.add_function(
+            "rb_prof_enter",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_prof_exit = Some(self.module.add_function(
+            "rb_prof_exit",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_profile_on = Some(self.module.add_function(
+            "rb_profile_on",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_profile_dump = Some(self.module.add_function(
+            "rb_profile_dump",
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_profile_report = Some(self.module.add_function(
+            "rb_profile_report",
+            ptr_t.fn_type(&[], false),
+            None,
+        ));
+
         // ── Assert runtime ──
         self.rt_assert_fail = Some(self.module.add_function(
             "rb_assert_fail",
@@ -1291,7 +2178,12 @@ impl<'ctx> Codegen<'ctx> {
         // ── TRY/CATCH runtime ──
         self.rt_try_begin = Some(self.module.add_function(
             "rb_try_begin",
-            i32_t.fn_type(&[], false),
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_try_catch = Some(self.module.add_function(
+            "rb_try_catch",
+            ptr_t.fn_type(&[], false),
             None,
         ));
         self.rt_try_end = Some(self.module.add_function(
@@ -1324,6 +2216,29 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        self.rt_task_pool = Some(self.module.add_function(
+            "rb_task_pool",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),  // workers
+                    BasicMetadataTypeEnum::from(i32_t),  // stack_size
+                    BasicMetadataTypeEnum::from(i32_t),  // priority
+                    BasicMetadataTypeEnum::from(i32_t),  // core, -1 = any
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_spawn = Some(self.module.add_function(
+            "rb_spawn",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_wait = Some(self.module.add_function(
+            "rb_wait",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
 
         // ── EVENT runtime ──
         self.rt_on_gpio_change = Some(self.module.add_function(
@@ -1351,26 +2266,23 @@ impl<'ctx> Codegen<'ctx> {
         // ── State Machine runtime ──
         self.rt_machine_create = Some(self.module.add_function(
             "rb_machine_create",
-            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
-            None,
-        ));
-        self.rt_machine_add_state = Some(self.module.add_function(
-            "rb_machine_add_state",
-            void_t.fn_type(
-                &[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)],
+            i32_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),  // name
+                    BasicMetadataTypeEnum::from(i32_t),  // num_states
+                    BasicMetadataTypeEnum::from(i32_t),  // num_events
+                    BasicMetadataTypeEnum::from(ptr_t),  // transition table
+                    BasicMetadataTypeEnum::from(ptr_t),  // state names
+                    BasicMetadataTypeEnum::from(ptr_t),  // event names
+                ],
                 false,
             ),
             None,
         ));
-        self.rt_machine_add_transition = Some(self.module.add_function(
-            "rb_machine_add_transition",
+        self.rt_machine_event_id = Some(self.module.add_function(
+            "rb_machine_event_id",
             void_t.fn_type(
-                &[
-                    BasicMetadataTypeEnum::from(i32_t),  // machine handle
-                    BasicMetadataTypeEnum::from(ptr_t),  // from_state
-                    BasicMetadataTypeEnum::from(ptr_t),  // event_name
-                    BasicMetadataTypeEnum::from(ptr_t),  // to_state
-                ],
+                &[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)],
                 false,
             ),
             None,
@@ -1383,6 +2295,11 @@ impl<'ctx> Codegen<'ctx> {
             ),
             None,
         ));
+        self.rt_machine_state = Some(self.module.add_function(
+            "rb_machine_state",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_machine_get_state = Some(self.module.add_function(
             "rb_machine_get_state",
             ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
@@ -1419,6 +2336,11 @@ impl<'ctx> Codegen<'ctx> {
             ptr_t.fn_type(&[], false),
             None,
         ));
+        self.rt_file_read_n = Some(self.module.add_function(
+            "rb_file_read_n",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_file_close = Some(self.module.add_function(
             "rb_file_close",
             void_t.fn_type(&[], false),
@@ -1434,6 +2356,36 @@ impl<'ctx> Codegen<'ctx> {
             i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
+        self.rt_file_open_handle = Some(self.module.add_function(
+            "rb_file_open_handle",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_fh_write = Some(self.module.add_function(
+            "rb_fh_write",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_fh_read = Some(self.module.add_function(
+            "rb_fh_read",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_fh_readline = Some(self.module.add_function(
+            "rb_fh_readline",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_fh_eof = Some(self.module.add_function(
+            "rb_fh_eof",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_fh_close = Some(self.module.add_function(
+            "rb_fh_close",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_ws_connect = Some(self.module.add_function(
             "rb_ws_connect",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
@@ -1479,6 +2431,26 @@ impl<'ctx> Codegen<'ctx> {
             void_t.fn_type(&[], false),
             None,
         ));
+        self.rt_tcp_client = Some(self.module.add_function(
+            "rb_tcp_client",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_tcp_send_to = Some(self.module.add_function(
+            "rb_tcp_send_to",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_tcp_close_client = Some(self.module.add_function(
+            "rb_tcp_close_client",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_on_tcp_data = Some(self.module.add_function(
+            "rb_on_tcp_data",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
         self.rt_wdt_enable = Some(self.module.add_function(
             "rb_wdt_enable",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
@@ -1519,6 +2491,21 @@ impl<'ctx> Codegen<'ctx> {
             void_t.fn_type(&[], false),
             None,
         ));
+        self.rt_i2s_pins = Some(self.module.add_function(
+            "rb_i2s_pins",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_i2s_read = Some(self.module.add_function(
+            "rb_i2s_read",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_on_i2s_need = Some(self.module.add_function(
+            "rb_on_i2s_need",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
 
         // ── Web Server ──────────────────────────────────────
         self.rt_web_start = Some(self.module.add_function(
@@ -1546,6 +2533,40 @@ impl<'ctx> Codegen<'ctx> {
             void_t.fn_type(&[], false),
             None,
         ));
+        self.rt_web_route = Some(self.module.add_function(
+            "rb_web_route",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_web_request = Some(self.module.add_function(
+            "rb_web_request",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_web_serve = Some(self.module.add_function(
+            "rb_web_serve",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_web_reply_to = Some(self.module.add_function(
+            "rb_web_reply_to",
+            void_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
 
         // ── SD Card ─────────────────────────────────────────
         self.rt_sd_init = Some(self.module.add_function(
@@ -1558,6 +2579,11 @@ impl<'ctx> Codegen<'ctx> {
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
+        self.rt_sd_open_handle = Some(self.module.add_function(
+            "rb_sd_open_handle",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
         self.rt_sd_write = Some(self.module.add_function(
             "rb_sd_write",
             void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
@@ -1568,6 +2594,11 @@ impl<'ctx> Codegen<'ctx> {
             ptr_t.fn_type(&[], false),
             None,
         ));
+        self.rt_sd_read_n = Some(self.module.add_function(
+            "rb_sd_read_n",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
         self.rt_sd_close = Some(self.module.add_function(
             "rb_sd_close",
             void_t.fn_type(&[], false),
@@ -1579,161 +2610,546 @@ impl<'ctx> Codegen<'ctx> {
             None,
         ));
 
-        // ── Async ───────────────────────────────────────────
-        self.rt_yield = Some(self.module.add_function(
-            "rb_yield",
+        // ── Console ─────────────────────────────────────────
+        self.rt_console_flush = Some(self.module.add_function(
+            "rb_console_flush",
             void_t.fn_type(&[], false),
             None,
         ));
-        self.rt_await = Some(self.module.add_function(
-            "rb_await",
-            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+        self.rt_console_mode = Some(self.module.add_function(
+            "rb_console_mode",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
 
-        // ── Cron ────────────────────────────────────────────
-        self.rt_cron_add = Some(self.module.add_function(
-            "rb_cron_add",
-            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+        // ── Data logger ─────────────────────────────────────
+        self.rt_log_open = Some(self.module.add_function(
+            "rb_log_open",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
             None,
         ));
-        self.rt_cron_check = Some(self.module.add_function(
-            "rb_cron_check",
-            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+        self.rt_log_write = Some(self.module.add_function(
+            "rb_log_write",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
             None,
         ));
-        self.rt_cron_remove = Some(self.module.add_function(
-            "rb_cron_remove",
-            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+        self.rt_log_flush = Some(self.module.add_function(
+            "rb_log_flush",
+            void_t.fn_type(&[], false),
             None,
         ));
-
-        // ── Regex ───────────────────────────────────────────
-        self.rt_regex_match = Some(self.module.add_function(
-            "rb_regex_match",
-            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_log_close = Some(self.module.add_function(
+            "rb_log_close",
+            void_t.fn_type(&[], false),
             None,
         ));
-        self.rt_regex_find = Some(self.module.add_function(
-            "rb_regex_find",
-            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_log_dropped = Some(self.module.add_function(
+            "rb_log_dropped",
+            i32_t.fn_type(&[], false),
             None,
         ));
-        self.rt_regex_replace = Some(self.module.add_function(
-            "rb_regex_replace",
-            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+        self.rt_event_coalesced = Some(self.module.add_function(
+            "rb_event_coalesced",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_event_dropped = Some(self.module.add_function(
+            "rb_event_dropped",
+            i32_t.fn_type(&[], false),
             None,
         ));
-    }
-
-    fn qb_to_var(qb: &QBType) -> VarType {
-        VarType::from(qb)
-    }
 
-    fn var_llvm_type(&self, vt: VarType) -> BasicTypeEnum<'ctx> {
-        match vt {
-            VarType::Integer => self.i32_type.as_basic_type_enum(),
+        // ── Async ───────────────────────────────────────────
+        self.rt_yield = Some(self.module.add_function(
+            "rb_yield",
+            void_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_await = Some(self.module.add_function(
+            "rb_await",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_async_start = Some(self.module.add_function(
+            "rb_async_start",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_async_io_begin = Some(self.module.add_function(
+            "rb_async_io_begin",
+            ptr_t.fn_type(
+                &[
+                    BasicMetadataTypeEnum::from(i32_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                    BasicMetadataTypeEnum::from(ptr_t),
+                ],
+                false,
+            ),
+            None,
+        ));
+        self.rt_async_io_done = Some(self.module.add_function(
+            "rb_async_io_done",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_async_io_take = Some(self.module.add_function(
+            "rb_async_io_take",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+
+        // ── Cron ────────────────────────────────────────────
+        self.rt_cron_add = Some(self.module.add_function(
+            "rb_cron_add",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_cron_check = Some(self.module.add_function(
+            "rb_cron_check",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_cron_remove = Some(self.module.add_function(
+            "rb_cron_remove",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_on_cron = Some(self.module.add_function(
+            "rb_on_cron",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+
+        // ── Regex ───────────────────────────────────────────
+        self.rt_regex_match = Some(self.module.add_function(
+            "rb_regex_match",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_regex_find = Some(self.module.add_function(
+            "rb_regex_find",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_regex_replace = Some(self.module.add_function(
+            "rb_regex_replace",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+
+        // ── String Builder ──────────────────────────────────
+        self.rt_sb_new = Some(self.module.add_function(
+            "rb_sb_new",
+            i32_t.fn_type(&[], false),
+            None,
+        ));
+        self.rt_sb_append_int = Some(self.module.add_function(
+            "rb_sb_append_int",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_sb_append_float = Some(self.module.add_function(
+            "rb_sb_append_float",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_sb_append_str = Some(self.module.add_function(
+            "rb_sb_append_str",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_sb_tostring = Some(self.module.add_function(
+            "rb_sb_tostring",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_sb_clear = Some(self.module.add_function(
+            "rb_sb_clear",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_sb_free = Some(self.module.add_function(
+            "rb_sb_free",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+
+        // ── Channels ────────────────────────────────────────
+        self.rt_channel_create = Some(self.module.add_function(
+            "rb_channel_create",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_channel_send_int = Some(self.module.add_function(
+            "rb_channel_send_int",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_channel_send_float = Some(self.module.add_function(
+            "rb_channel_send_float",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(f32_t)], false),
+            None,
+        ));
+        self.rt_channel_send_str = Some(self.module.add_function(
+            "rb_channel_send_str",
+            void_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+        self.rt_channel_receive_int = Some(self.module.add_function(
+            "rb_channel_receive_int",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_channel_receive_float = Some(self.module.add_function(
+            "rb_channel_receive_float",
+            f32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_channel_receive_str = Some(self.module.add_function(
+            "rb_channel_receive_str",
+            ptr_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t)], false),
+            None,
+        ));
+        self.rt_channel_select = Some(self.module.add_function(
+            "rb_channel_select",
+            i32_t.fn_type(&[BasicMetadataTypeEnum::from(i32_t), BasicMetadataTypeEnum::from(ptr_t)], false),
+            None,
+        ));
+    }
+
+    fn qb_to_var(qb: &QBType) -> VarType {
+        VarType::from(qb)
+    }
+
+    fn var_llvm_type(&self, vt: VarType) -> BasicTypeEnum<'ctx> {
+        match vt {
+            VarType::Integer => self.i32_type.as_basic_type_enum(),
             VarType::Float => self.f32_type.as_basic_type_enum(),
             VarType::String => self.ptr_type.as_basic_type_enum(),
         }
     }
 
-    // ── DATA globals emission ─────────────────────────────
-
-    fn emit_data_globals(&self) -> Result<()> {
-        use rustybasic_parser::ast::DataItem;
+    // ── Inlinable runtime helpers ─────────────────────────
+
+    /// LLVM type matching the rb_string_t header in rb_runtime.h:
+    /// {refcount, length, capacity, data, parent}.
+    fn string_header_type(&self) -> StructType<'ctx> {
+        self.context.struct_type(
+            &[
+                self.i32_type.into(),
+                self.i32_type.into(),
+                self.i32_type.into(),
+                self.ptr_type.into(),
+                self.ptr_type.into(),
+            ],
+            false,
+        )
+    }
 
-        let items = &self.sema.data_items;
-        let n = items.len();
+    /// Attach `available_externally` bodies to the trivial string helpers
+    /// (LEN, ASC, retain, release). The inliner can fold them into the
+    /// caller, so `LEN(s$)` becomes a load, while calls it leaves alone
+    /// still bind to the out-of-line definitions in the C runtime, which
+    /// these bodies must keep mirroring.
+    fn define_inline_runtime(&mut self) -> Result<()> {
+        let header = self.string_header_type();
+        let b = self.context.create_builder();
+        let slow_mask = self.i32_type.const_int(RB_STRING_RC_SLOW as u64, true);
+        let zero = self.i32_type.const_zero();
 
-        // Build parallel arrays of type tags, ints, floats, and string pointers
-        let mut type_vals = Vec::with_capacity(n);
-        let mut int_vals = Vec::with_capacity(n);
-        let mut float_vals = Vec::with_capacity(n);
-        let mut string_vals = Vec::with_capacity(n);
+        // int32_t rb_fn_len(rb_string_t* s) { return s ? s->length : 0; }
+        let f = self.rt_fn_len.unwrap();
+        f.set_linkage(Linkage::AvailableExternally);
+        let entry = self.context.append_basic_block(f, "entry");
+        let some = self.context.append_basic_block(f, "some");
+        let none = self.context.append_basic_block(f, "none");
+        b.position_at_end(entry);
+        let s = f.get_nth_param(0).unwrap().into_pointer_value();
+        b.build_conditional_branch(b.build_is_null(s, "is_null")?, none, some)?;
+        b.position_at_end(none);
+        b.build_return(Some(&zero))?;
+        b.position_at_end(some);
+        let len_ptr = b.build_struct_gep(header, s, 1, "len_ptr")?;
+        let len = b.build_load(self.i32_type, len_ptr, "len")?;
+        b.build_return(Some(&len))?;
+
+        // int32_t rb_fn_asc(rb_string_t* s)
+        //   { return s && s->length ? (unsigned char)s->data[0] : 0; }
+        let f = self.rt_fn_asc.unwrap();
+        f.set_linkage(Linkage::AvailableExternally);
+        let entry = self.context.append_basic_block(f, "entry");
+        let check_len = self.context.append_basic_block(f, "check_len");
+        let first = self.context.append_basic_block(f, "first");
+        let none = self.context.append_basic_block(f, "none");
+        b.position_at_end(entry);
+        let s = f.get_nth_param(0).unwrap().into_pointer_value();
+        b.build_conditional_branch(b.build_is_null(s, "is_null")?, none, check_len)?;
+        b.position_at_end(check_len);
+        let len_ptr = b.build_struct_gep(header, s, 1, "len_ptr")?;
+        let len = b.build_load(self.i32_type, len_ptr, "len")?.into_int_value();
+        let empty = b.build_int_compare(IntPredicate::EQ, len, zero, "empty")?;
+        b.build_conditional_branch(empty, none, first)?;
+        b.position_at_end(first);
+        let data_field = b.build_struct_gep(header, s, 3, "data_field")?;
+        let data = b
+            .build_load(self.ptr_type, data_field, "data")?
+            .into_pointer_value();
+        let c = b.build_load(self.context.i8_type(), data, "c")?.into_int_value();
+        let code = b.build_int_z_extend(c, self.i32_type, "code")?;
+        b.build_return(Some(&code))?;
+        b.position_at_end(none);
+        b.build_return(Some(&zero))?;
+
+        // void rb_string_retain(rb_string_t* s) {
+        //   if (!s) return;
+        //   if (s->refcount & RB_STRING_RC_SLOW) { rb_string_retain_slow(s); return; }
+        //   s->refcount++;
+        // }
+        // void rb_string_release(rb_string_t* s) {
+        //   if (!s) return;
+        //   if (s->refcount & RB_STRING_RC_SLOW) { rb_string_release_slow(s); return; }
+        //   if (--s->refcount <= 0) rb_string_free(s);
+        // }
+        for (f, slow_fn, delta) in [
+            (self.rt_string_retain.unwrap(), self.rt_string_retain_slow.unwrap(), 1u64),
+            (self.rt_string_release.unwrap(), self.rt_string_release_slow.unwrap(), u64::MAX),
+        ] {
+            f.set_linkage(Linkage::AvailableExternally);
+            let entry = self.context.append_basic_block(f, "entry");
+            let check = self.context.append_basic_block(f, "check");
+            let slow = self.context.append_basic_block(f, "slow");
+            let update = self.context.append_basic_block(f, "update");
+            let done = self.context.append_basic_block(f, "done");
+            b.position_at_end(entry);
+            let s = f.get_nth_param(0).unwrap().into_pointer_value();
+            b.build_conditional_branch(b.build_is_null(s, "is_null")?, done, check)?;
+            b.position_at_end(check);
+            let rc_ptr = b.build_struct_gep(header, s, 0, "rc_ptr")?;
+            let rc = b.build_load(self.i32_type, rc_ptr, "rc")?.into_int_value();
+            let flags = b.build_and(rc, slow_mask, "flags")?;
+            let is_slow = b.build_int_compare(IntPredicate::NE, flags, zero, "is_slow")?;
+            b.build_conditional_branch(is_slow, slow, update)?;
+            b.position_at_end(slow);
+            b.build_call(slow_fn, &[s.into()], "")?;
+            b.build_unconditional_branch(done)?;
+            b.position_at_end(update);
+            let new_rc = b.build_int_add(rc, self.i32_type.const_int(delta, true), "new_rc")?;
+            b.build_store(rc_ptr, new_rc)?;
+            if delta == 1 {
+                b.build_unconditional_branch(done)?;
+            } else {
+                let free_bb = self.context.append_basic_block(f, "free");
+                let dead = b.build_int_compare(IntPredicate::SLE, new_rc, zero, "dead")?;
+                b.build_conditional_branch(dead, free_bb, done)?;
+                b.position_at_end(free_bb);
+                b.build_call(self.rt_string_free.unwrap(), &[s.into()], "")?;
+                b.build_unconditional_branch(done)?;
+            }
+            b.position_at_end(done);
+            b.build_return(None)?;
+        }
+        Ok(())
+    }
 
-        for (i, item) in items.iter().enumerate() {
-            match item {
-                DataItem::Int(v) => {
-                    type_vals.push(self.i32_type.const_int(0, false));
-                    int_vals.push(self.i32_type.const_int(*v as u64, true));
-                    float_vals.push(self.f32_type.const_float(0.0));
-                    string_vals.push(self.ptr_type.const_null());
-                }
-                DataItem::Float(v) => {
-                    type_vals.push(self.i32_type.const_int(1, false));
-                    int_vals.push(self.i32_type.const_zero());
-                    float_vals.push(self.f32_type.const_float(*v as f64));
-                    string_vals.push(self.ptr_type.const_null());
-                }
-                DataItem::Str(s) => {
-                    type_vals.push(self.i32_type.const_int(2, false));
-                    int_vals.push(self.i32_type.const_zero());
-                    float_vals.push(self.f32_type.const_float(0.0));
-                    let gstr = self.module.add_global(
-                        self.context.i8_type().array_type(s.len() as u32 + 1),
-                        None,
-                        &format!("rb_data_str_{i}"),
-                    );
-                    gstr.set_initializer(
-                        &self.context.const_string(s.as_bytes(), true),
-                    );
-                    gstr.set_constant(true);
-                    gstr.set_unnamed_addr(true);
-                    string_vals.push(gstr.as_pointer_value());
+    // ── State machines ──────────────────────────────────────
+
+    /// Number the machine's states (declaration order) and events (first
+    /// use), emit its transitions as a constant states x events table of
+    /// target states (-1 for none), and create it in the runtime.
+    fn compile_machine(&mut self, machine: &MachineDef) -> Result<()> {
+        let mut events: Vec<String> = Vec::new();
+        for state in &machine.states {
+            for Transition::OnEvent { event_name, .. } in &state.transitions {
+                if !events.contains(event_name) {
+                    events.push(event_name.clone());
+                }
+            }
+        }
+        let n_states = machine.states.len();
+        let n_events = events.len();
+        let mut table = vec![-1i64; n_states * n_events];
+        for (from, state) in machine.states.iter().enumerate() {
+            for Transition::OnEvent { event_name, target_state, .. } in &state.transitions {
+                let event = events.iter().position(|e| e == event_name).unwrap();
+                let to = machine.states.iter().position(|s| &s.name == target_state);
+                // The first transition listed for an event wins
+                if let (Some(to), -1) = (to, table[from * n_events + event]) {
+                    table[from * n_events + event] = to as i64;
                 }
             }
         }
 
-        // rb_data_types
-        let types_arr = self.i32_type.const_array(&type_vals);
-        let g_types = self.module.add_global(
-            self.i32_type.array_type(n as u32),
+        let i16_type = self.context.i16_type();
+        let cells: Vec<_> = table.iter().map(|&t| i16_type.const_int(t as u64, true)).collect();
+        let g_table = self.module.add_global(
+            i16_type.array_type(cells.len() as u32),
             None,
-            "rb_data_types",
+            &format!("rb_machine_{}_table", machine.name),
         );
-        g_types.set_initializer(&types_arr);
-        g_types.set_constant(true);
+        g_table.set_initializer(&i16_type.const_array(&cells));
+        g_table.set_constant(true);
+
+        let name_array = |names: Vec<&str>, what: &str| -> Result<_> {
+            let mut ptrs = Vec::new();
+            for n in &names {
+                ptrs.push(self.builder.build_global_string_ptr(n, what)?.as_pointer_value());
+            }
+            let g = self.module.add_global(
+                self.ptr_type.array_type(ptrs.len() as u32),
+                None,
+                &format!("rb_machine_{}_{}s", machine.name, what),
+            );
+            g.set_initializer(&self.ptr_type.const_array(&ptrs));
+            g.set_constant(true);
+            Ok(g.as_pointer_value())
+        };
+        let state_names = name_array(machine.states.iter().map(|s| s.name.as_str()).collect(), "state")?;
+        let event_names = name_array(events.iter().map(|e| e.as_str()).collect(), "event")?;
+
+        let name_str = self.builder.build_global_string_ptr(&machine.name, "machine_name")?;
+        let handle = self.builder.build_call(
+            self.rt_machine_create.unwrap(),
+            &[
+                name_str.as_pointer_value().into(),
+                self.i32_type.const_int(n_states as u64, false).into(),
+                self.i32_type.const_int(n_events as u64, false).into(),
+                g_table.as_pointer_value().into(),
+                state_names.into(),
+                event_names.into(),
+            ],
+            "machine_handle",
+        )?.try_as_basic_value().left().unwrap();
+        let handle_alloca = self.builder.build_alloca(self.i32_type, &format!("{}_handle", machine.name))?;
+        self.builder.build_store(handle_alloca, handle)?;
+        self.variables.insert(format!("{}.HANDLE", machine.name), (handle_alloca, VarType::Integer));
+        self.machine_events.insert(machine.name.clone(), events);
+        Ok(())
+    }
 
-        // rb_data_ints
-        let ints_arr = self.i32_type.const_array(&int_vals);
-        let g_ints = self.module.add_global(
-            self.i32_type.array_type(n as u32),
-            None,
-            "rb_data_ints",
-        );
-        g_ints.set_initializer(&ints_arr);
-        g_ints.set_constant(true);
+    // ── DATA globals emission ─────────────────────────────
 
-        // rb_data_floats
-        let floats_arr = self.f32_type.const_array(&float_vals);
-        let g_floats = self.module.add_global(
-            self.f32_type.array_type(n as u32),
-            None,
-            "rb_data_floats",
-        );
-        g_floats.set_initializer(&floats_arr);
-        g_floats.set_constant(true);
+    /// Pack the DATA pool into the byte stream rb_data.c reads: blocks of
+    /// one kind, each a tag, a LEB128 count and the packed items. A block
+    /// starts at each index in `breaks` (RESTORE labels); returns the byte
+    /// offset of each.
+    fn pack_data(
+        items: &[rustybasic_parser::ast::DataItem],
+        breaks: &[usize],
+    ) -> (Vec<u8>, HashMap<usize, u32>) {
+        use rustybasic_parser::ast::DataItem;
 
-        // rb_data_strings
-        let strings_arr = self.ptr_type.const_array(&string_vals);
-        let g_strings = self.module.add_global(
-            self.ptr_type.array_type(n as u32),
-            None,
-            "rb_data_strings",
-        );
-        g_strings.set_initializer(&strings_arr);
-        g_strings.set_constant(true);
+        const END: u8 = 0;
+        const I8: u8 = 1;
+        const I16: u8 = 2;
+        const I32: u8 = 3;
+        const F32: u8 = 4;
+        const STR: u8 = 5;
+        let int_tag = |v: i32| {
+            if i8::try_from(v).is_ok() {
+                I8
+            } else if i16::try_from(v).is_ok() {
+                I16
+            } else {
+                I32
+            }
+        };
+        let width = |tag: u8| match tag {
+            I8 => 1,
+            I16 => 2,
+            _ => 4,
+        };
+        let leb_len = |mut n: usize| {
+            let mut len = 1;
+            while n >= 0x80 {
+                n >>= 7;
+                len += 1;
+            }
+            len
+        };
+        let int_cost = |tag: u8, count: usize| 1 + leb_len(count) + count * width(tag);
+
+        // Runs of items of one tag, then adjacent integer runs merged at
+        // the wider width wherever that is no bigger than two headers
+        let mut blocks: Vec<(usize, usize, u8)> = Vec::new(); // (first, count, tag)
+        for (i, item) in items.iter().enumerate() {
+            let tag = match item {
+                DataItem::Int(v) => int_tag(*v),
+                DataItem::Float(_) => F32,
+                DataItem::Str(_) => STR,
+            };
+            match blocks.last_mut() {
+                Some((_, count, last)) if *last == tag && !breaks.contains(&i) => *count += 1,
+                _ => blocks.push((i, 1, tag)),
+            }
+        }
+        let mut k = 0;
+        while k + 1 < blocks.len() {
+            let (first, a, ta) = blocks[k];
+            let (next, b, tb) = blocks[k + 1];
+            let ints = ta <= I32 && tb <= I32;
+            let wide = ta.max(tb);
+            if ints
+                && !breaks.contains(&next)
+                && int_cost(wide, a + b) <= int_cost(ta, a) + int_cost(tb, b)
+            {
+                blocks[k] = (first, a + b, wide);
+                blocks.remove(k + 1);
+                k = k.saturating_sub(1);
+            } else {
+                k += 1;
+            }
+        }
+
+        let mut bytes = Vec::new();
+        let mut offsets = HashMap::new();
+        for &(first, count, tag) in &blocks {
+            offsets.insert(first, bytes.len() as u32);
+            bytes.push(tag);
+            let mut n = count;
+            while n >= 0x80 {
+                bytes.push((n as u8 & 0x7f) | 0x80);
+                n >>= 7;
+            }
+            bytes.push(n as u8);
+            for item in &items[first..first + count] {
+                match item {
+                    DataItem::Int(v) => {
+                        bytes.extend_from_slice(&v.to_le_bytes()[..width(tag)]);
+                    }
+                    DataItem::Float(v) => bytes.extend_from_slice(&v.to_le_bytes()),
+                    DataItem::Str(s) => {
+                        bytes.extend_from_slice(s.as_bytes());
+                        bytes.push(0);
+                    }
+                }
+            }
+        }
+        // RESTORE to a label after the last DATA lands on the end
+        offsets.insert(items.len(), bytes.len() as u32);
+        bytes.push(END);
+        (bytes, offsets)
+    }
+
+    fn emit_data_globals(&mut self) -> Result<()> {
+        let mut breaks: Vec<usize> = self.sema.data_labels.values().copied().collect();
+        breaks.sort_unstable();
+        breaks.dedup();
+        let (bytes, offsets) = Self::pack_data(&self.sema.data_items, &breaks);
 
-        // rb_data_count
-        let g_count = self.module.add_global(
-            self.i32_type,
+        let g_stream = self.module.add_global(
+            self.context.i8_type().array_type(bytes.len() as u32),
             None,
-            "rb_data_count",
+            "rb_data_stream",
         );
-        g_count.set_initializer(&self.i32_type.const_int(n as u64, false));
-        g_count.set_constant(true);
+        g_stream.set_initializer(&self.context.const_string(&bytes, false));
+        g_stream.set_constant(true);
 
+        self.data_label_offsets = self
+            .sema
+            .data_labels
+            .iter()
+            .map(|(label, index)| (label.clone(), offsets[index]))
+            .collect();
         Ok(())
     }
 
@@ -1746,6 +3162,19 @@ impl<'ctx> Codegen<'ctx> {
         // Emit DATA pool globals
         self.emit_data_globals()?;
 
+        // Give the optimizer inlinable copies of the trivial runtime helpers
+        self.define_inline_runtime()?;
+
+        // Error checks after statements are only emitted when some TRY
+        // could be waiting for them
+        self.uses_try = Self::body_has_try(&program.body)
+            || program.subs.iter().any(|s| Self::body_has_try(&s.body))
+            || program.functions.iter().any(|f| Self::body_has_try(&f.body))
+            || program.modules.iter().any(|m| {
+                m.subs.iter().any(|s| Self::body_has_try(&s.body))
+                    || m.functions.iter().any(|f| Self::body_has_try(&f.body))
+            });
+
         // Declare LLVM functions for user SUBs and FUNCTIONs
         for sub_def in &program.subs {
             self.declare_user_sub(sub_def)?;
@@ -1762,6 +3191,11 @@ impl<'ctx> Codegen<'ctx> {
             }
             self.enums.insert(enum_def.name.clone(), members);
         }
+        // Machine.STATE_NAME is the state's number, as in sema
+        for machine in &program.machines {
+            let states = machine.states.iter().enumerate().map(|(i, s)| (s.name.clone(), i as i32)).collect();
+            self.enums.insert(machine.name.clone(), states);
+        }
 
         // Declare module SUBs/FUNCTIONs
         for module in &program.modules {
@@ -1781,6 +3215,10 @@ impl<'ctx> Codegen<'ctx> {
         let entry_bb = self.context.append_basic_block(entry_fn, "entry");
         self.builder.position_at_end(entry_bb);
         self.current_function = Some(entry_fn);
+        if self.profile {
+            let on = self.i32_type.const_int(1, false);
+            self.builder.build_call(self.rt_profile_on.unwrap(), &[on.into()], "")?;
+        }
 
         // Allocate all top-level variables
         for (name, info) in &self.sema.variables {
@@ -1811,44 +3249,7 @@ impl<'ctx> Codegen<'ctx> {
 
         // Initialize state machines
         for machine in &program.machines {
-            let name_str = self.builder.build_global_string_ptr(&machine.name, "machine_name")?;
-            let handle = self.builder.build_call(
-                self.rt_machine_create.unwrap(),
-                &[name_str.as_pointer_value().into()],
-                "machine_handle",
-            )?.try_as_basic_value().left().unwrap();
-            let handle_alloca = self.builder.build_alloca(self.i32_type, &format!("{}_handle", machine.name))?;
-            self.builder.build_store(handle_alloca, handle)?;
-            self.variables.insert(format!("{}.HANDLE", machine.name), (handle_alloca, VarType::Integer));
-
-            for state in &machine.states {
-                let state_name = self.builder.build_global_string_ptr(&state.name, "state_name")?;
-                self.builder.build_call(
-                    self.rt_machine_add_state.unwrap(),
-                    &[handle.into(), state_name.as_pointer_value().into()],
-                    "",
-                )?;
-
-                for transition in &state.transitions {
-                    match transition {
-                        rustybasic_parser::ast::Transition::OnEvent { event_name, target_state, .. } => {
-                            let from_str = self.builder.build_global_string_ptr(&state.name, "from_state")?;
-                            let event_str = self.builder.build_global_string_ptr(event_name, "event_name")?;
-                            let to_str = self.builder.build_global_string_ptr(target_state, "to_state")?;
-                            self.builder.build_call(
-                                self.rt_machine_add_transition.unwrap(),
-                                &[
-                                    handle.into(),
-                                    from_str.as_pointer_value().into(),
-                                    event_str.as_pointer_value().into(),
-                                    to_str.as_pointer_value().into(),
-                                ],
-                                "",
-                            )?;
-                        }
-                    }
-                }
-            }
+            self.compile_machine(machine)?;
         }
 
         // GOSUB support
@@ -2010,6 +3411,34 @@ impl<'ctx> Codegen<'ctx> {
 
     // ── SUB/FUNCTION body compilation ───────────────────────
 
+    /// Under `--profile`, call rb_prof_enter for a SUB/FUNCTION body and
+    /// return its profile index for the matching emit_prof_exit.
+    fn emit_prof_enter(&mut self, name: &str) -> Result<Option<i32>> {
+        if !self.profile {
+            return Ok(None);
+        }
+        let next = self.prof_ids.len() as i32;
+        let id = *self.prof_ids.entry(name.to_string()).or_insert(next);
+        let name_ptr = self.builder.build_global_string_ptr(name, "prof_name")?;
+        self.builder.build_call(
+            self.rt_prof_enter.unwrap(),
+            &[self.i32_type.const_int(id as u64, false).into(), name_ptr.as_pointer_value().into()],
+            "",
+        )?;
+        Ok(Some(id))
+    }
+
+    fn emit_prof_exit(&mut self, id: Option<i32>) -> Result<()> {
+        if let Some(id) = id {
+            self.builder.build_call(
+                self.rt_prof_exit.unwrap(),
+                &[self.i32_type.const_int(id as u64, false).into()],
+                "",
+            )?;
+        }
+        Ok(())
+    }
+
     fn compile_sub_body(&mut self, sub_def: &SubDef) -> Result<()> {
         let func = *self.user_functions.get(&sub_def.name).unwrap();
         let entry_bb = self.context.append_basic_block(func, "entry");
@@ -2020,22 +3449,32 @@ impl<'ctx> Codegen<'ctx> {
         let saved_fn = self.current_function;
         let saved_exit = self.current_exit_bb;
         let saved_labels = std::mem::take(&mut self.label_bbs);
+        let saved_error_exit = self.error_exit_fn;
         self.current_function = Some(func);
+        self.error_exit_fn = Some(func);
 
         let exit_bb = self.context.append_basic_block(func, "exit");
         self.current_exit_bb = Some(exit_bb);
+        let prof_id = self.emit_prof_enter(&sub_def.name)?;
+        let saved_may_free = std::mem::replace(&mut self.body_may_free_strings, false);
+        let mut borrowed = Vec::new();
 
         for (i, param) in sub_def.params.iter().enumerate() {
             let vt = Self::qb_to_var(&param.param_type);
             let llvm_type = self.var_llvm_type(vt);
             let alloca = self.builder.build_alloca(llvm_type, &param.name)?;
             let param_val = func.get_nth_param(i as u32).unwrap();
-            self.builder.build_store(alloca, param_val)?;
+            let store = self.builder.build_store(alloca, param_val)?;
+            if vt == VarType::String {
+                let appends = Self::body_appends_to(&sub_def.body, &param.name);
+                borrowed.push((store, param_val, appends));
+            }
             self.variables.insert(param.name.clone(), (alloca, vt));
         }
 
         self.collect_labels(&sub_def.body, func);
         self.compile_body(&sub_def.body)?;
+        self.own_string_params(&borrowed, saved_may_free)?;
 
         if self
             .builder
@@ -2048,6 +3487,7 @@ impl<'ctx> Codegen<'ctx> {
         }
 
         self.builder.position_at_end(exit_bb);
+        self.emit_prof_exit(prof_id)?;
         self.builder.build_return(None)?;
 
         self.variables = saved_vars;
@@ -2055,6 +3495,7 @@ impl<'ctx> Codegen<'ctx> {
         self.current_function = saved_fn;
         self.current_exit_bb = saved_exit;
         self.label_bbs = saved_labels;
+        self.error_exit_fn = saved_error_exit;
         Ok(())
     }
 
@@ -2068,10 +3509,13 @@ impl<'ctx> Codegen<'ctx> {
         let saved_fn = self.current_function;
         let saved_exit = self.current_exit_bb;
         let saved_labels = std::mem::take(&mut self.label_bbs);
+        let saved_error_exit = self.error_exit_fn;
         self.current_function = Some(func);
+        self.error_exit_fn = Some(func);
 
         let exit_bb = self.context.append_basic_block(func, "exit");
         self.current_exit_bb = Some(exit_bb);
+        let prof_id = self.emit_prof_enter(&fn_def.name)?;
 
         // Return value variable (function name = return value in QBASIC)
         let ret_vt = Self::qb_to_var(&fn_def.return_type);
@@ -2093,18 +3537,25 @@ impl<'ctx> Codegen<'ctx> {
         }
         self.variables
             .insert(fn_def.name.clone(), (ret_alloca, ret_vt));
+        let saved_may_free = std::mem::replace(&mut self.body_may_free_strings, false);
+        let mut borrowed = Vec::new();
 
         for (i, param) in fn_def.params.iter().enumerate() {
             let vt = Self::qb_to_var(&param.param_type);
             let llvm_type = self.var_llvm_type(vt);
             let alloca = self.builder.build_alloca(llvm_type, &param.name)?;
             let param_val = func.get_nth_param(i as u32).unwrap();
-            self.builder.build_store(alloca, param_val)?;
+            let store = self.builder.build_store(alloca, param_val)?;
+            if vt == VarType::String {
+                let appends = Self::body_appends_to(&fn_def.body, &param.name);
+                borrowed.push((store, param_val, appends));
+            }
             self.variables.insert(param.name.clone(), (alloca, vt));
         }
 
         self.collect_labels(&fn_def.body, func);
         self.compile_body(&fn_def.body)?;
+        self.own_string_params(&borrowed, saved_may_free)?;
 
         if self
             .builder
@@ -2118,6 +3569,7 @@ impl<'ctx> Codegen<'ctx> {
 
         self.builder.position_at_end(exit_bb);
         let ret_val = self.builder.build_load(ret_type, ret_alloca, "retval")?;
+        self.emit_prof_exit(prof_id)?;
         self.builder.build_return(Some(&ret_val))?;
 
         self.variables = saved_vars;
@@ -2125,6 +3577,7 @@ impl<'ctx> Codegen<'ctx> {
         self.current_function = saved_fn;
         self.current_exit_bb = saved_exit;
         self.label_bbs = saved_labels;
+        self.error_exit_fn = saved_error_exit;
         Ok(())
     }
 
@@ -2148,6 +3601,58 @@ impl<'ctx> Codegen<'ctx> {
                 break;
             }
             self.compile_statement(stmt)?;
+            if !matches!(stmt, Statement::Label { .. }) {
+                self.compile_error_check()?;
+            }
+        }
+        Ok(())
+    }
+
+    /// After a statement inside TRY, branch to the CATCH if it raised an
+    /// error; in a SUB/FUNCTION outside TRY, return so the caller's check
+    /// sees it. IF and loop conditions are checked too, before they branch.
+    /// Nothing is emitted in programs without TRY.
+    fn compile_error_check(&mut self) -> Result<()> {
+        if !self.uses_try || self.builder.get_insert_block().unwrap().get_terminator().is_some() {
+            return Ok(());
+        }
+        let function = self.current_function.unwrap();
+        let target = match self.try_catch_bbs.last() {
+            Some(&(f, catch_bb)) if f == function => catch_bb,
+            _ if self.error_exit_fn == Some(function) => self.current_exit_bb.unwrap(),
+            _ => return Ok(()),
+        };
+        let flag = match self.module.get_global("rb_error_pending") {
+            Some(g) => g,
+            None => {
+                let g = self.module.add_global(self.i32_type, None, "rb_error_pending");
+                // Local-exec: the firmware is one static image with no
+                // __tls_get_addr, which PIC would otherwise call
+                g.set_thread_local_mode(Some(ThreadLocalMode::LocalExecTLSModel));
+                g
+            }
+        };
+        let pending = self.builder.build_load(self.i32_type, flag.as_pointer_value(), "err_pending")?.into_int_value();
+        let raised = self.builder.build_int_compare(
+            IntPredicate::NE, pending, self.i32_type.const_zero(), "err_raised"
+        )?;
+        let cont_bb = self.context.append_basic_block(function, "no_error");
+        self.builder.build_conditional_branch(raised, target, cont_bb)?;
+        self.builder.position_at_end(cont_bb);
+        Ok(())
+    }
+
+    /// Before a jump out of TRY bodies, close each TRY of the current
+    /// function above the first `outer` entries of `try_catch_bbs`, as
+    /// reaching the end of the body would.
+    fn compile_try_unwind(&mut self, outer: usize) -> Result<()> {
+        let function = self.current_function.unwrap();
+        let open = self.try_catch_bbs[outer..]
+            .iter()
+            .filter(|&&(f, _)| f == function)
+            .count();
+        for _ in 0..open {
+            self.builder.build_call(self.rt_try_end.unwrap(), &[], "")?;
         }
         Ok(())
     }
@@ -2208,7 +3713,7 @@ impl<'ctx> Codegen<'ctx> {
                                 self.i32_type.const_int(1, false),
                                 &format!("dim_size_{di}"),
                             )?;
-                            let size_alloca = self.builder.build_alloca(
+                            let size_alloca = self.build_entry_alloca(
                                 self.i32_type.as_basic_type_enum(),
                                 &format!("{name}_dim{di}_size"),
                             )?;
@@ -2243,7 +3748,7 @@ impl<'ctx> Codegen<'ctx> {
                         self.builder.position_at_end(ok_bb);
 
                         // Store total size
-                        let total_alloca = self.builder.build_alloca(
+                        let total_alloca = self.build_entry_alloca(
                             self.i32_type.as_basic_type_enum(),
                             &format!("{name}_total"),
                         )?;
@@ -2263,12 +3768,16 @@ impl<'ctx> Codegen<'ctx> {
                             .unwrap()
                             .into_pointer_value();
 
-                        let data_alloca = self.builder.build_alloca(
+                        let data_alloca = self.build_entry_alloca(
                             self.ptr_type.as_basic_type_enum(),
                             &format!("{name}_ptr"),
                         )?;
                         self.builder.build_store(data_alloca, heap_ptr)?;
 
+                        let const_dims = dimensions
+                            .iter()
+                            .map(|d| self.const_int_value(d).map(|n| n + 1))
+                            .collect::<Option<Vec<i64>>>();
                         self.arrays.insert(
                             name.clone(),
                             ArrayInfo {
@@ -2276,6 +3785,7 @@ impl<'ctx> Codegen<'ctx> {
                                 dim_size_allocas,
                                 total_size_alloca: total_alloca,
                                 element_vt: vt,
+                                const_dims,
                             },
                         );
                     }
@@ -2283,7 +3793,7 @@ impl<'ctx> Codegen<'ctx> {
                     // Scalar DIM
                     let vt = Self::qb_to_var(var_type);
                     let llvm_type = self.var_llvm_type(vt);
-                    let alloca = self.builder.build_alloca(llvm_type, name)?;
+                    let alloca = self.build_var_alloca(llvm_type, name)?;
                     match vt {
                         VarType::Integer => {
                             self.builder
@@ -2303,10 +3813,17 @@ impl<'ctx> Codegen<'ctx> {
             }
             Statement::Const { name, value, .. } => {
                 let vt = self.infer_expr_type(value);
+                if let Some(n) = self.const_int_value(value) {
+                    self.const_ints.insert(name.clone(), n);
+                } else if vt == VarType::Float {
+                    if let Some(x) = self.const_float_value(value) {
+                        self.const_floats.insert(name.clone(), x);
+                    }
+                }
                 let val = self.compile_expr(value, vt)?;
                 if !self.variables.contains_key(name) {
                     let llvm_type = self.var_llvm_type(vt);
-                    let alloca = self.builder.build_alloca(llvm_type, name)?;
+                    let alloca = self.build_var_alloca(llvm_type, name)?;
                     self.variables.insert(name.clone(), (alloca, vt));
                 }
                 if let Some((alloca, _)) = self.variables.get(name) {
@@ -2320,13 +3837,35 @@ impl<'ctx> Codegen<'ctx> {
                 ..
             } => {
                 let vt = Self::qb_to_var(var_type);
+                if let Some((alloca, VarType::String)) = self.variables.get(name).copied() {
+                    if let Some(rhs) = Self::self_append_operand(name, expr) {
+                        // s$ = s$ + x$  →  in-place append on the target
+                        let rhs_val = self.compile_expr(rhs, VarType::String)?;
+                        let cur = self.builder.build_load(self.ptr_type, alloca, "cur_str")?;
+                        let appended = self
+                            .builder
+                            .build_call(
+                                self.rt_string_append.unwrap(),
+                                &[cur.into(), rhs_val.into()],
+                                "appended",
+                            )?
+                            .try_as_basic_value()
+                            .left()
+                            .unwrap();
+                        self.builder.build_store(alloca, appended)?;
+                        return Ok(());
+                    }
+                }
                 if !self.variables.contains_key(name) {
                     let llvm_type = self.var_llvm_type(vt);
-                    let alloca = self.builder.build_alloca(llvm_type, name)?;
+                    let alloca = self.build_var_alloca(llvm_type, name)?;
                     self.variables.insert(name.clone(), (alloca, vt));
                 }
                 let actual_vt = self.variables.get(name).map(|(_, v)| *v).unwrap_or(vt);
                 let val = self.compile_expr(expr, actual_vt)?;
+                if actual_vt == VarType::String {
+                    self.retain_if_aliased(expr, val)?;
+                }
                 if let Some((alloca, _)) = self.variables.get(name) {
                     self.builder.build_store(*alloca, val)?;
                 }
@@ -2341,10 +3880,14 @@ impl<'ctx> Codegen<'ctx> {
                 let vt = self.infer_expr_type(expr);
                 if !self.variables.contains_key(&flat_name) {
                     let llvm_type = self.var_llvm_type(vt);
-                    let alloca = self.builder.build_alloca(llvm_type, &flat_name)?;
+                    let alloca = self.build_var_alloca(llvm_type, &flat_name)?;
                     self.variables.insert(flat_name.clone(), (alloca, vt));
                 }
                 let val = self.compile_expr(expr, vt)?;
+                if vt == VarType::String {
+                    self.body_may_free_strings = true;
+                    self.retain_if_aliased(expr, val)?;
+                }
                 if let Some((alloca, _)) = self.variables.get(&flat_name) {
                     self.builder.build_store(*alloca, val)?;
                 }
@@ -2375,14 +3918,7 @@ impl<'ctx> Codegen<'ctx> {
                                     )?;
                                 }
                                 VarType::String => {
-                                    let val = self.compile_expr(expr, VarType::String)?;
-                                    self.builder.build_call(
-                                        self.rt_print_string.unwrap(),
-                                        &[BasicMetadataValueEnum::from(
-                                            val.into_pointer_value(),
-                                        )],
-                                        "",
-                                    )?;
+                                    self.compile_print_string(expr)?;
                                 }
                             }
                             needs_newline = true;
@@ -2423,7 +3959,7 @@ impl<'ctx> Codegen<'ctx> {
                 };
                 if !self.variables.contains_key(name) {
                     let llvm_type = self.var_llvm_type(vt);
-                    let alloca = self.builder.build_alloca(llvm_type, name)?;
+                    let alloca = self.build_var_alloca(llvm_type, name)?;
                     self.variables.insert(name.clone(), (alloca, vt));
                 }
                 let rt_fn = match vt {
@@ -2456,9 +3992,8 @@ impl<'ctx> Codegen<'ctx> {
                     self.ptr_type.const_null()
                 };
                 if !self.variables.contains_key(name) {
-                    let alloca = self
-                        .builder
-                        .build_alloca(self.ptr_type.as_basic_type_enum(), name)?;
+                    let alloca =
+                        self.build_var_alloca(self.ptr_type.as_basic_type_enum(), name)?;
                     self.variables
                         .insert(name.clone(), (alloca, VarType::String));
                 }
@@ -2484,6 +4019,7 @@ impl<'ctx> Codegen<'ctx> {
                 ..
             } => {
                 let cond_val = self.compile_condition(condition)?;
+                self.compile_error_check()?;
                 let then_bb = self.context.append_basic_block(function, "if.then");
                 let merge_bb = self.context.append_basic_block(function, "if.merge");
 
@@ -2510,6 +4046,7 @@ impl<'ctx> Codegen<'ctx> {
                     if !else_if_clauses.is_empty() {
                         for (ei_idx, clause) in else_if_clauses.iter().enumerate() {
                             let ei_cond = self.compile_condition(&clause.condition)?;
+                            self.compile_error_check()?;
                             let ei_then = self.context.append_basic_block(
                                 function,
                                 &format!("elseif.then.{ei_idx}"),
@@ -2550,12 +4087,16 @@ impl<'ctx> Codegen<'ctx> {
                 self.builder.position_at_end(merge_bb);
             }
             Statement::For {
-                var, from, to, step, body, ..
+                var,
+                from,
+                to,
+                step,
+                body,
+                span,
             } => {
                 if !self.variables.contains_key(var) {
-                    let alloca = self
-                        .builder
-                        .build_alloca(self.f32_type.as_basic_type_enum(), var)?;
+                    let alloca =
+                        self.build_var_alloca(self.f32_type.as_basic_type_enum(), var)?;
                     self.variables
                         .insert(var.clone(), (alloca, VarType::Float));
                 }
@@ -2568,11 +4109,30 @@ impl<'ctx> Codegen<'ctx> {
                 } else {
                     self.f32_type.const_float(1.0).as_basic_value_enum()
                 };
+                // SSA values do not survive an ASYNC suspension, so there the
+                // bounds are kept in frame slots and reloaded each iteration
+                let spilled = if self.in_async_body() {
+                    let f32_ty = self.f32_type.as_basic_type_enum();
+                    let to_slot = self.build_var_alloca(f32_ty, "for_to")?;
+                    let step_slot = self.build_var_alloca(f32_ty, "for_step")?;
+                    self.builder.build_store(to_slot, to_val)?;
+                    self.builder.build_store(step_slot, step_val)?;
+                    Some((to_slot, step_slot))
+                } else {
+                    None
+                };
                 let loop_bb = self.context.append_basic_block(function, "for.loop");
                 let body_bb = self.context.append_basic_block(function, "for.body");
                 let after_bb = self.context.append_basic_block(function, "for.after");
 
-                self.for_exit_stack.push(after_bb);
+                // Inside the body the counter stays within FROM..TO when it is
+                // never written there and the step is a positive constant.
+                let range = self.for_counter_range(var, from, to, step.as_ref(), *span);
+                let has_range = range.is_some();
+                if let Some((lo, hi)) = range {
+                    self.for_ranges.push((var.clone(), lo, hi));
+                }
+                self.for_exit_stack.push((after_bb, self.try_catch_bbs.len()));
                 self.builder.build_unconditional_branch(loop_bb)?;
 
                 self.builder.position_at_end(loop_bb);
@@ -2580,6 +4140,10 @@ impl<'ctx> Codegen<'ctx> {
                     .builder
                     .build_load(self.f32_type, var_alloca, "for_cur")?
                     .into_float_value();
+                let to_val = match spilled {
+                    Some((to_slot, _)) => self.builder.build_load(self.f32_type, to_slot, "for_to")?,
+                    None => to_val,
+                };
                 let cmp = self.builder.build_float_compare(
                     FloatPredicate::OLE,
                     current,
@@ -2591,12 +4155,21 @@ impl<'ctx> Codegen<'ctx> {
 
                 self.builder.position_at_end(body_bb);
                 self.compile_body(body)?;
+                if has_range {
+                    self.for_ranges.pop();
+                }
 
                 if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
                     let current = self
                         .builder
                         .build_load(self.f32_type, var_alloca, "for_cur2")?
                         .into_float_value();
+                    let step_val = match spilled {
+                        Some((_, step_slot)) => {
+                            self.builder.build_load(self.f32_type, step_slot, "for_step")?
+                        }
+                        None => step_val,
+                    };
                     let next_val = self.builder.build_float_add(
                         current,
                         step_val.into_float_value(),
@@ -2618,12 +4191,13 @@ impl<'ctx> Codegen<'ctx> {
                 let body_bb = self.context.append_basic_block(function, "do.body");
                 let after_bb = self.context.append_basic_block(function, "do.after");
 
-                self.do_exit_stack.push(after_bb);
+                self.do_exit_stack.push((after_bb, self.try_catch_bbs.len()));
 
                 if let Some(cond) = pre_condition {
                     self.builder.build_unconditional_branch(cond_bb)?;
                     self.builder.position_at_end(cond_bb);
                     let cond_val = self.compile_condition(&cond.expr)?;
+                    self.compile_error_check()?;
                     if cond.is_while {
                         self.builder
                             .build_conditional_branch(cond_val, body_bb, after_bb)?;
@@ -2641,6 +4215,7 @@ impl<'ctx> Codegen<'ctx> {
                 if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
                     if let Some(cond) = post_condition {
                         let cond_val = self.compile_condition(&cond.expr)?;
+                        self.compile_error_check()?;
                         if cond.is_while {
                             self.builder
                                 .build_conditional_branch(cond_val, body_bb, after_bb)?;
@@ -2666,6 +4241,7 @@ impl<'ctx> Codegen<'ctx> {
                 self.builder.build_unconditional_branch(cond_bb)?;
                 self.builder.position_at_end(cond_bb);
                 let cond_val = self.compile_condition(condition)?;
+                self.compile_error_check()?;
                 self.builder
                     .build_conditional_branch(cond_val, body_bb, after_bb)?;
                 self.builder.position_at_end(body_bb);
@@ -2739,6 +4315,9 @@ impl<'ctx> Codegen<'ctx> {
                 self.builder.position_at_end(merge_bb);
             }
             Statement::Goto { target, .. } => {
+                // Labels are only collected outside TRY bodies, so a GOTO
+                // always leaves every TRY it is in
+                self.compile_try_unwind(0)?;
                 if let Some(&target_bb) = self.label_bbs.get(target) {
                     self.builder.build_unconditional_branch(target_bb)?;
                 } else {
@@ -2780,6 +4359,7 @@ impl<'ctx> Codegen<'ctx> {
             }
             Statement::CallSub { name, args, .. } => {
                 if let Some(&func_val) = self.user_functions.get(name) {
+                    self.body_may_free_strings = true;
                     let mut arg_vals: Vec<BasicMetadataValueEnum> = Vec::new();
                     let param_types = func_val.get_type().get_param_types();
                     for (i, arg) in args.iter().enumerate() {
@@ -2801,25 +4381,29 @@ impl<'ctx> Codegen<'ctx> {
                 }
             }
             Statement::End { .. } => {
+                self.compile_try_unwind(0)?;
                 self.builder.build_unconditional_branch(exit_bb)?;
                 let after = self.context.append_basic_block(function, "after_end");
                 self.builder.position_at_end(after);
             }
             Statement::ExitFor { .. } => {
-                if let Some(&after_bb) = self.for_exit_stack.last() {
+                if let Some(&(after_bb, tries)) = self.for_exit_stack.last() {
+                    self.compile_try_unwind(tries)?;
                     self.builder.build_unconditional_branch(after_bb)?;
                     let cont = self.context.append_basic_block(function, "after_exitfor");
                     self.builder.position_at_end(cont);
                 }
             }
             Statement::ExitDo { .. } => {
-                if let Some(&after_bb) = self.do_exit_stack.last() {
+                if let Some(&(after_bb, tries)) = self.do_exit_stack.last() {
+                    self.compile_try_unwind(tries)?;
                     self.builder.build_unconditional_branch(after_bb)?;
                     let cont = self.context.append_basic_block(function, "after_exitdo");
                     self.builder.position_at_end(cont);
                 }
             }
             Statement::ExitSub { .. } | Statement::ExitFunction { .. } => {
+                self.compile_try_unwind(0)?;
                 self.builder.build_unconditional_branch(exit_bb)?;
                 let cont = self.context.append_basic_block(function, "after_exit");
                 self.builder.position_at_end(cont);
@@ -2838,17 +4422,7 @@ impl<'ctx> Codegen<'ctx> {
                     let data_alloca = arr_info.data_ptr_alloca;
 
                     let linear_idx = self.compile_array_linear_index(name, indices)?;
-
-                    // Bounds check
-                    let total = self
-                        .builder
-                        .build_load(self.i32_type, total_alloca, "total_sz")?
-                        .into_int_value();
-                    self.builder.build_call(
-                        self.rt_array_bounds_check.unwrap(),
-                        &[linear_idx.into(), total.into()],
-                        "",
-                    )?;
+                    self.compile_array_bounds_check(name, indices, linear_idx, total_alloca)?;
 
                     // GEP to element
                     let data_ptr = self
@@ -2865,8 +4439,13 @@ impl<'ctx> Codegen<'ctx> {
                         )?
                     };
 
+                    // Evaluate first: the new value may be built from the old one
+                    let val = self.compile_expr(expr, element_vt)?;
+
                     // For string arrays, release old value
                     if element_vt == VarType::String {
+                        self.body_may_free_strings = true;
+                        self.retain_if_aliased(expr, val)?;
                         let old_val = self
                             .builder
                             .build_load(self.ptr_type, elem_ptr, "old_str")?
@@ -2879,7 +4458,6 @@ impl<'ctx> Codegen<'ctx> {
                     }
 
                     // Store new value
-                    let val = self.compile_expr(expr, element_vt)?;
                     self.builder.build_store(elem_ptr, val)?;
                 }
             }
@@ -3002,9 +4580,77 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::WifiConnect { ssid, password, .. } => {
-                let s = self.compile_expr(ssid, VarType::String)?.into_pointer_value();
-                let p = self
+            Statement::I2cSend { addr, data, .. } => {
+                let a = self.compile_expr_as_i32(addr)?;
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                self.builder
+                    .build_call(self.rt_i2c_send.unwrap(), &[a.into(), d.into()], "")?;
+            }
+            Statement::I2cReadStr {
+                addr, length, target, var_type, ..
+            } => {
+                let a = self.compile_expr_as_i32(addr)?;
+                let l = self.compile_expr_as_i32(length)?;
+                let result = self
+                    .builder
+                    .build_call(self.rt_i2c_read_str.unwrap(), &[a.into(), l.into()], "i2c_buf")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::I2cWriteRead {
+                addr, data, length, target, var_type, ..
+            } => {
+                let a = self.compile_expr_as_i32(addr)?;
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                let l = self.compile_expr_as_i32(length)?;
+                let result = self
+                    .builder
+                    .build_call(
+                        self.rt_i2c_write_read.unwrap(),
+                        &[a.into(), d.into(), l.into()],
+                        "i2c_buf",
+                    )?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::SpiSend { data, .. } => {
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                self.builder.build_call(self.rt_spi_send.unwrap(), &[d.into()], "")?;
+            }
+            Statement::SpiTransferStr {
+                data, target, var_type, ..
+            } => {
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                let result = self
+                    .builder
+                    .build_call(self.rt_spi_transfer_str.unwrap(), &[d.into()], "spi_buf")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::SpiFlush { .. } => {
+                self.builder.build_call(self.rt_spi_flush.unwrap(), &[], "")?;
+            }
+            Statement::WifiConnect { ssid, password, .. } => {
+                let s = self.compile_expr(ssid, VarType::String)?.into_pointer_value();
+                let p = self
                     .compile_expr(password, VarType::String)?
                     .into_pointer_value();
                 self.builder.build_call(
@@ -3052,6 +4698,31 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+            Statement::AdcStream { pin, rate, .. } => {
+                let p = self.compile_expr_as_i32(pin)?;
+                let r = self.compile_expr_as_i32(rate)?;
+                self.builder.build_call(self.rt_adc_stream.unwrap(), &[p.into(), r.into()], "")?;
+            }
+            Statement::AdcBlock { array, count, .. } => {
+                // Samples land straight in the array's storage
+                if let Some(arr_info) = self.arrays.get(array) {
+                    let data_alloca = arr_info.data_ptr_alloca;
+                    let total_alloca = arr_info.total_size_alloca;
+                    let data = self.builder.build_load(self.ptr_type, data_alloca, "adc_buf")?;
+                    let total = self.builder.build_load(self.i32_type, total_alloca, "adc_len")?;
+                    let result = self.builder.build_call(self.rt_adc_block.unwrap(), &[data.into(), total.into()], "adc_n")?
+                        .try_as_basic_value().left().unwrap();
+                    if let Some((target, var_type)) = count {
+                        self.ensure_var(target, Self::qb_to_var(var_type))?;
+                        if let Some((alloca, _)) = self.variables.get(target) {
+                            self.builder.build_store(*alloca, result)?;
+                        }
+                    }
+                }
+            }
+            Statement::AdcStop { .. } => {
+                self.builder.build_call(self.rt_adc_stop.unwrap(), &[], "")?;
+            }
             Statement::PwmSetup {
                 channel, pin, freq, resolution, ..
             } => {
@@ -3072,18 +4743,57 @@ impl<'ctx> Codegen<'ctx> {
                     .build_call(self.rt_pwm_duty.unwrap(), &[ch.into(), d.into()], "")?;
             }
             Statement::UartSetup {
-                port, baud, tx, rx, ..
+                port, baud, tx, rx, rx_buffer, ..
             } => {
                 let p = self.compile_expr_as_i32(port)?;
                 let b = self.compile_expr_as_i32(baud)?;
                 let t = self.compile_expr_as_i32(tx)?;
                 let r = self.compile_expr_as_i32(rx)?;
+                // 0 lets the runtime pick its default RX buffer
+                let n = match rx_buffer {
+                    Some(e) => self.compile_expr_as_i32(e)?,
+                    None => self.i32_type.const_int(0, false),
+                };
                 self.builder.build_call(
                     self.rt_uart_setup.unwrap(),
-                    &[p.into(), b.into(), t.into(), r.into()],
+                    &[p.into(), b.into(), t.into(), r.into(), n.into()],
                     "",
                 )?;
             }
+            Statement::UartSend { port, data, .. } => {
+                let p = self.compile_expr_as_i32(port)?;
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                self.builder
+                    .build_call(self.rt_uart_send.unwrap(), &[p.into(), d.into()], "")?;
+            }
+            Statement::UartReadStr {
+                port, max, target, var_type, ..
+            } => {
+                let p = self.compile_expr_as_i32(port)?;
+                let m = self.compile_expr_as_i32(max)?;
+                let result = self
+                    .builder
+                    .build_call(self.rt_uart_read_str.unwrap(), &[p.into(), m.into()], "uart_buf")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::UartLine { target, var_type, .. } => {
+                let result = self
+                    .builder
+                    .build_call(self.rt_uart_line.unwrap(), &[], "uart_line")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
             Statement::UartWrite { port, data, .. } => {
                 let p = self.compile_expr_as_i32(port)?;
                 let d = self.compile_expr_as_i32(data)?;
@@ -3125,13 +4835,89 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+            Statement::TimerMicros { target, var_type, .. } => {
+                let result = self.builder.build_call(self.rt_timer_micros.unwrap(), &[], "timer_us")?
+                    .try_as_basic_value().left().unwrap();
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::TimerAfter { micros, target, id, .. }
+            | Statement::TimerEvery { micros, target, id, .. } => {
+                // The event dispatcher task calls the SUB when the timer fires
+                let f = if matches!(stmt, Statement::TimerEvery { .. }) {
+                    self.rt_timer_every.unwrap()
+                } else {
+                    self.rt_timer_after.unwrap()
+                };
+                let us = self.compile_expr_as_i32(micros)?;
+                let handler_fn = *self.user_functions.get(target).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                let result = self.builder.build_call(f, &[us.into(), fn_ptr.into()], "timer_id")?
+                    .try_as_basic_value().left().unwrap();
+                if let Some((v, v_type)) = id {
+                    self.ensure_var(v, Self::qb_to_var(v_type))?;
+                    if let Some((alloca, _)) = self.variables.get(v) {
+                        self.builder.build_store(*alloca, result)?;
+                    }
+                }
+            }
+            Statement::TimerCancel { id, .. } => {
+                let v = self.compile_expr_as_i32(id)?;
+                self.builder.build_call(self.rt_timer_cancel.unwrap(), &[v.into()], "")?;
+            }
             Statement::HttpGet {
                 url, target, var_type, ..
             } => {
                 let u = self.compile_expr(url, VarType::String)?.into_pointer_value();
+                let result = if self.can_suspend_for_io() {
+                    self.compile_async_io(RB_ASYNC_OP_HTTP_GET, Some(u), None)?
+                } else {
+                    self.builder
+                        .build_call(self.rt_http_get.unwrap(), &[u.into()], "http_val")?
+                        .try_as_basic_value()
+                        .left()
+                        .unwrap()
+                };
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::HttpPost {
+                url, body, target, var_type, ..
+            } => {
+                let u = self.compile_expr(url, VarType::String)?.into_pointer_value();
+                let b = self.compile_expr(body, VarType::String)?.into_pointer_value();
+                let result = if self.can_suspend_for_io() {
+                    self.compile_async_io(RB_ASYNC_OP_HTTP_POST, Some(u), Some(b))?
+                } else {
+                    self.builder
+                        .build_call(
+                            self.rt_http_post.unwrap(),
+                            &[u.into(), b.into()],
+                            "http_val",
+                        )?
+                        .try_as_basic_value()
+                        .left()
+                        .unwrap()
+                };
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::HttpDownload {
+                url, path, target, var_type, ..
+            } => {
+                let u = self.compile_expr(url, VarType::String)?.into_pointer_value();
+                let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
                 let result = self
                     .builder
-                    .build_call(self.rt_http_get.unwrap(), &[u.into()], "http_val")?
+                    .build_call(self.rt_http_download.unwrap(), &[u.into(), p.into()], "http_bytes")?
                     .try_as_basic_value()
                     .left()
                     .unwrap();
@@ -3141,18 +4927,31 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::HttpPost {
-                url, body, target, var_type, ..
+            Statement::HttpStream {
+                url, handler, target, var_type, ..
             } => {
                 let u = self.compile_expr(url, VarType::String)?.into_pointer_value();
-                let b = self.compile_expr(body, VarType::String)?.into_pointer_value();
+                // The SUB is called directly for each chunk, on this task
+                let handler_fn = *self.user_functions.get(handler).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
                 let result = self
                     .builder
-                    .build_call(
-                        self.rt_http_post.unwrap(),
-                        &[u.into(), b.into()],
-                        "http_val",
-                    )?
+                    .build_call(self.rt_http_stream.unwrap(), &[u.into(), fn_ptr.into()], "http_bytes")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::HttpChunk {
+                target, var_type, ..
+            } => {
+                let result = self
+                    .builder
+                    .build_call(self.rt_http_chunk.unwrap(), &[], "http_chunk")?
                     .try_as_basic_value()
                     .left()
                     .unwrap();
@@ -3164,25 +4963,40 @@ impl<'ctx> Codegen<'ctx> {
             }
             Statement::NvsWrite { key, value, .. } => {
                 let k = self.compile_expr(key, VarType::String)?.into_pointer_value();
-                let v = self.compile_expr_as_i32(value)?;
-                self.builder
-                    .build_call(self.rt_nvs_write.unwrap(), &[k.into(), v.into()], "")?;
+                if self.infer_expr_type(value) == VarType::String {
+                    let v = self.compile_expr(value, VarType::String)?;
+                    self.builder
+                        .build_call(self.rt_nvs_write_str.unwrap(), &[k.into(), v.into()], "")?;
+                } else {
+                    let v = self.compile_expr_as_i32(value)?;
+                    self.builder
+                        .build_call(self.rt_nvs_write.unwrap(), &[k.into(), v.into()], "")?;
+                }
             }
             Statement::NvsRead {
                 key, target, var_type, ..
             } => {
                 let k = self.compile_expr(key, VarType::String)?.into_pointer_value();
+                let (func, from) = if Self::qb_to_var(var_type) == VarType::String {
+                    (self.rt_nvs_read_str.unwrap(), VarType::String)
+                } else {
+                    (self.rt_nvs_read.unwrap(), VarType::Integer)
+                };
                 let result = self
                     .builder
-                    .build_call(self.rt_nvs_read.unwrap(), &[k.into()], "nvs_val")?
+                    .build_call(func, &[k.into()], "nvs_val")?
                     .try_as_basic_value()
                     .left()
                     .unwrap();
-                let vt = Self::qb_to_var(var_type);
-                self.ensure_var(target, vt)?;
-                if let Some((alloca, _)) = self.variables.get(target) {
-                    self.builder.build_store(*alloca, result)?;
-                }
+                self.store_result(target, var_type, result, from)?;
+            }
+            Statement::NvsCommit { .. } => {
+                self.builder.build_call(self.rt_nvs_commit.unwrap(), &[], "")?;
+            }
+            Statement::NvsAutocommit { ms, .. } => {
+                let ms = self.compile_expr_as_i32(ms)?;
+                self.builder
+                    .build_call(self.rt_nvs_autocommit.unwrap(), &[ms.into()], "")?;
             }
             Statement::MqttConnect { broker, port, .. } => {
                 let b = self.compile_expr(broker, VarType::String)?.into_pointer_value();
@@ -3197,15 +5011,40 @@ impl<'ctx> Codegen<'ctx> {
                 self.builder
                     .build_call(self.rt_mqtt_disconnect.unwrap(), &[], "")?;
             }
-            Statement::MqttPublish { topic, message, .. } => {
+            Statement::MqttPublish { topic, message, qos, retain, .. } => {
                 let t = self.compile_expr(topic, VarType::String)?.into_pointer_value();
                 let m = self.compile_expr(message, VarType::String)?.into_pointer_value();
+                let qos_val = match qos {
+                    Some(q) => self.compile_expr_as_i32(q)?,
+                    None => self.i32_type.const_zero(),
+                };
+                let retain_val = match retain {
+                    Some(r) => self.compile_expr_as_i32(r)?,
+                    None => self.i32_type.const_zero(),
+                };
                 self.builder.build_call(
                     self.rt_mqtt_publish.unwrap(),
-                    &[t.into(), m.into()],
+                    &[t.into(), m.into(), qos_val.into(), retain_val.into()],
+                    "",
+                )?;
+            }
+            Statement::MqttCoalesce { topic, mode, n, .. } => {
+                let t = self.compile_expr(topic, VarType::String)?.into_pointer_value();
+                let mode_val = self.compile_expr_as_i32(mode)?;
+                // 0 picks the runtime default for the mode
+                let n_val = match n {
+                    Some(n) => self.compile_expr_as_i32(n)?,
+                    None => self.i32_type.const_zero(),
+                };
+                self.builder.build_call(
+                    self.rt_mqtt_coalesce.unwrap(),
+                    &[t.into(), mode_val.into(), n_val.into()],
                     "",
                 )?;
             }
+            Statement::MqttFlush { .. } => {
+                self.builder.build_call(self.rt_mqtt_flush.unwrap(), &[], "")?;
+            }
             Statement::MqttSubscribe { topic, .. } => {
                 let t = self.compile_expr(topic, VarType::String)?.into_pointer_value();
                 self.builder
@@ -3213,10 +5052,17 @@ impl<'ctx> Codegen<'ctx> {
             }
             Statement::MqttReceive {
                 target, var_type, ..
+            }
+            | Statement::MqttTopic {
+                target, var_type, ..
             } => {
+                let func = match stmt {
+                    Statement::MqttTopic { .. } => self.rt_mqtt_topic,
+                    _ => self.rt_mqtt_receive,
+                };
                 let result = self
                     .builder
-                    .build_call(self.rt_mqtt_receive.unwrap(), &[], "mqtt_val")?
+                    .build_call(func.unwrap(), &[], "mqtt_val")?
                     .try_as_basic_value()
                     .left()
                     .unwrap();
@@ -3274,6 +5120,24 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+            Statement::BleInterval { min_ms, max_ms, .. } => {
+                let lo = self.compile_expr_as_i32(min_ms)?;
+                let hi = match max_ms {
+                    Some(max_ms) => self.compile_expr_as_i32(max_ms)?,
+                    None => lo,
+                };
+                self.builder
+                    .build_call(self.rt_ble_interval.unwrap(), &[lo.into(), hi.into()], "")?;
+            }
+            Statement::BleMtu { target, var_type, .. } => {
+                let mtu = self
+                    .builder
+                    .build_call(self.rt_ble_mtu.unwrap(), &[], "ble_mtu")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                self.store_result(target, var_type, mtu, VarType::Integer)?;
+            }
             Statement::JsonGet {
                 json, key, target, var_type, ..
             } => {
@@ -3337,6 +5201,69 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+            Statement::JsonBegin { handle, key, is_array, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                let k = match key {
+                    Some(key) => self.compile_expr(key, VarType::String)?.into_pointer_value(),
+                    None => self.ptr_type.const_null(),
+                };
+                let arr = self.i32_type.const_int(*is_array as u64, false);
+                self.builder.build_call(self.rt_json_begin.unwrap(), &[h.into(), k.into(), arr.into()], "")?;
+            }
+            Statement::JsonAdd { handle, key, value, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                let k = match key {
+                    Some(key) => self.compile_expr(key, VarType::String)?.into_pointer_value(),
+                    None => self.ptr_type.const_null(),
+                };
+                let (func, v) = match self.infer_expr_type(value) {
+                    VarType::Integer => (self.rt_json_add_int, self.compile_expr(value, VarType::Integer)?),
+                    VarType::Float => (self.rt_json_add_float, self.compile_expr(value, VarType::Float)?),
+                    VarType::String => (self.rt_json_add_str, self.compile_expr(value, VarType::String)?),
+                };
+                self.builder.build_call(func.unwrap(), &[h.into(), k.into(), v.into()], "")?;
+            }
+            Statement::JsonEnd { handle, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                self.builder.build_call(self.rt_json_end.unwrap(), &[BasicMetadataValueEnum::from(h)], "")?;
+            }
+            Statement::JsonExtract { json, fields, .. } => {
+                let j = self.compile_expr(json, VarType::String)?.into_pointer_value();
+                let n = fields.len() as u32;
+                let arr_type = self.ptr_type.array_type(n);
+                let paths_arr = self.builder.build_alloca(arr_type, "json_paths")?;
+                let out_arr = self.builder.build_alloca(arr_type, "json_out")?;
+                for (i, (path, _, _)) in fields.iter().enumerate() {
+                    let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
+                    let idx = self.i32_type.const_int(i as u64, false);
+                    let slot = unsafe {
+                        self.builder.build_gep(self.ptr_type, paths_arr, &[idx], "path_slot")?
+                    };
+                    self.builder.build_store(slot, p)?;
+                }
+                self.builder.build_call(
+                    self.rt_json_extract.unwrap(),
+                    &[
+                        j.into(),
+                        self.i32_type.const_int(n as u64, false).into(),
+                        paths_arr.into(),
+                        out_arr.into(),
+                    ],
+                    "",
+                )?;
+                for (i, (_, target, var_type)) in fields.iter().enumerate() {
+                    let idx = self.i32_type.const_int(i as u64, false);
+                    let slot = unsafe {
+                        self.builder.build_gep(self.ptr_type, out_arr, &[idx], "out_slot")?
+                    };
+                    let result = self.builder.build_load(self.ptr_type, slot, "json_val")?;
+                    let vt = Self::qb_to_var(var_type);
+                    self.ensure_var(target, vt)?;
+                    if let Some((alloca, _)) = self.variables.get(target) {
+                        self.builder.build_store(*alloca, result)?;
+                    }
+                }
+            }
             Statement::LedSetup { pin, count, .. } => {
                 let p = self.compile_expr_as_i32(pin)?;
                 let c = self.compile_expr_as_i32(count)?;
@@ -3357,6 +5284,15 @@ impl<'ctx> Codegen<'ctx> {
                     "",
                 )?;
             }
+            Statement::LedSetAll { array, .. } => {
+                if let Some(arr_info) = self.arrays.get(array) {
+                    let data_alloca = arr_info.data_ptr_alloca;
+                    let total_alloca = arr_info.total_size_alloca;
+                    let data = self.builder.build_load(self.ptr_type, data_alloca, "led_colors")?;
+                    let total = self.builder.build_load(self.i32_type, total_alloca, "led_n")?;
+                    self.builder.build_call(self.rt_led_set_all.unwrap(), &[data.into(), total.into()], "")?;
+                }
+            }
             Statement::LedShow { .. } => {
                 self.builder
                     .build_call(self.rt_led_show.unwrap(), &[], "")?;
@@ -3378,13 +5314,33 @@ impl<'ctx> Codegen<'ctx> {
                     .build_call(self.rt_espnow_init.unwrap(), &[], "")?;
             }
             Statement::EspnowSend { peer, data, .. } => {
-                let p = self.compile_expr(peer, VarType::String)?.into_pointer_value();
-                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
-                self.builder.build_call(
-                    self.rt_espnow_send.unwrap(),
-                    &[p.into(), d.into()],
-                    "",
-                )?;
+                if self.infer_expr_type(peer) == VarType::String {
+                    let p = self.compile_expr(peer, VarType::String)?.into_pointer_value();
+                    let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                    self.builder.build_call(
+                        self.rt_espnow_send.unwrap(),
+                        &[p.into(), d.into()],
+                        "",
+                    )?;
+                } else {
+                    let p = self.compile_expr_as_i32(peer)?;
+                    let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                    self.builder.build_call(
+                        self.rt_espnow_send_to.unwrap(),
+                        &[p.into(), d.into()],
+                        "",
+                    )?;
+                }
+            }
+            Statement::EspnowPeer { mac, target, var_type, .. } => {
+                let m = self.compile_expr(mac, VarType::String)?.into_pointer_value();
+                let handle = self
+                    .builder
+                    .build_call(self.rt_espnow_peer.unwrap(), &[m.into()], "espnow_peer")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                self.store_result(target, var_type, handle, VarType::Integer)?;
             }
             Statement::EspnowReceive {
                 target, var_type, ..
@@ -3436,24 +5392,51 @@ impl<'ctx> Codegen<'ctx> {
                     }
                 }
             }
-            Statement::Restore { .. } => {
+            Statement::ReadArray { array, .. } => {
+                if let Some((data, total, element_vt)) = self.array_data(array)? {
+                    let func = if element_vt == VarType::Float {
+                        self.rt_data_read_floats.unwrap()
+                    } else {
+                        self.rt_data_read_ints.unwrap()
+                    };
+                    self.builder.build_call(func, &[data.into(), total.into()], "")?;
+                }
+            }
+            Statement::Restore { label: None, .. } => {
                 self.builder
                     .build_call(self.rt_data_restore.unwrap(), &[], "")?;
             }
+            Statement::Restore { label: Some(label), .. } => {
+                let offset = self.data_label_offsets.get(label).copied().unwrap_or(0);
+                self.builder.build_call(
+                    self.rt_data_restore_at.unwrap(),
+                    &[self.i32_type.const_int(offset as u64, false).into()],
+                    "",
+                )?;
+            }
 
             // ── Classic BASIC extensions ────────────────────────────
             Statement::OnGoto { expr, targets, .. } => {
                 let val = self.compile_expr_as_i32(expr)?;
                 let after_bb = self.context.append_basic_block(function, "after_on_goto");
-                let cases: Vec<_> = targets
-                    .iter()
-                    .enumerate()
-                    .filter_map(|(i, label)| {
-                        self.label_bbs.get(label).map(|&bb| {
-                            (self.i32_type.const_int((i + 1) as u64, false), bb)
-                        })
-                    })
-                    .collect();
+                let mut cases = Vec::new();
+                for (i, label) in targets.iter().enumerate() {
+                    if let Some(&bb) = self.label_bbs.get(label) {
+                        cases.push((self.i32_type.const_int((i + 1) as u64, false), bb));
+                    }
+                }
+                // Inside TRY, each target goes through a block that closes it
+                if self.try_catch_bbs.iter().any(|&(f, _)| f == function) {
+                    let switch_bb = self.builder.get_insert_block().unwrap();
+                    for (i, case) in cases.iter_mut().enumerate() {
+                        let unwind_bb = self.context.append_basic_block(function, &format!("on_goto_unwind_{i}"));
+                        self.builder.position_at_end(unwind_bb);
+                        self.compile_try_unwind(0)?;
+                        self.builder.build_unconditional_branch(case.1)?;
+                        case.1 = unwind_bb;
+                    }
+                    self.builder.position_at_end(switch_bb);
+                }
                 self.builder.build_switch(val, after_bb, &cases)?;
                 self.builder.position_at_end(after_bb);
             }
@@ -3555,8 +5538,11 @@ impl<'ctx> Codegen<'ctx> {
                     let vt = Self::qb_to_var(ptype);
                     let lt = self.var_llvm_type(vt);
                     let alloca = self.builder.build_alloca(lt, pname)?;
-                    self.builder
-                        .build_store(alloca, fn_val.get_nth_param(i as u32).unwrap())?;
+                    // A lambda body is a single expression and never appends
+                    // to a parameter in place, so borrowing the caller's
+                    // reference is enough
+                    let param_val = fn_val.get_nth_param(i as u32).unwrap();
+                    self.builder.build_store(alloca, param_val)?;
                     self.variables.insert(pname.clone(), (alloca, vt));
                 }
 
@@ -3631,16 +5617,56 @@ impl<'ctx> Codegen<'ctx> {
                 }
             }
             Statement::Randomize { seed, .. } => {
-                let s = self.compile_expr_as_i32(seed)?;
-                self.builder.build_call(
-                    self.rt_randomize.unwrap(),
-                    &[BasicMetadataValueEnum::from(s)],
-                    "",
-                )?;
-            }
-
-            // ── New hardware statements (ESP32 extensions) ─────────
-            Statement::TouchRead {
+                if let Some(seed) = seed {
+                    let s = self.compile_expr_as_i32(seed)?;
+                    self.builder.build_call(
+                        self.rt_randomize.unwrap(),
+                        &[BasicMetadataValueEnum::from(s)],
+                        "",
+                    )?;
+                } else {
+                    self.builder.build_call(self.rt_randomize_hw.unwrap(), &[], "")?;
+                }
+            }
+            Statement::RandomizeArray { array, range, .. } => {
+                // One runtime call fills the array's storage in place
+                if let Some(arr_info) = self.arrays.get(array) {
+                    let data_alloca = arr_info.data_ptr_alloca;
+                    let total_alloca = arr_info.total_size_alloca;
+                    let element_vt = arr_info.element_vt;
+                    let data = self.builder.build_load(self.ptr_type, data_alloca, "rnd_buf")?;
+                    let total = self.builder.build_load(self.i32_type, total_alloca, "rnd_len")?;
+                    if element_vt == VarType::Integer {
+                        // Sema requires a range for INTEGER arrays
+                        let Some((lo, hi)) = range else {
+                            return Ok(());
+                        };
+                        let lo = self.compile_expr_as_i32(lo)?;
+                        let hi = self.compile_expr_as_i32(hi)?;
+                        self.builder.build_call(
+                            self.rt_rnd_fill_int.unwrap(),
+                            &[data.into(), total.into(), lo.into(), hi.into()],
+                            "",
+                        )?;
+                    } else {
+                        let (lo, hi) = match range {
+                            Some((lo, hi)) => (
+                                self.compile_expr(lo, VarType::Float)?.into_float_value(),
+                                self.compile_expr(hi, VarType::Float)?.into_float_value(),
+                            ),
+                            None => (self.f32_type.const_zero(), self.f32_type.const_float(1.0)),
+                        };
+                        self.builder.build_call(
+                            self.rt_rnd_fill_float.unwrap(),
+                            &[data.into(), total.into(), lo.into(), hi.into()],
+                            "",
+                        )?;
+                    }
+                }
+            }
+
+            // ── New hardware statements (ESP32 extensions) ─────────
+            Statement::TouchRead {
                 pin, target, var_type, ..
             } => {
                 let p = self.compile_expr_as_i32(pin)?;
@@ -3864,6 +5890,22 @@ impl<'ctx> Codegen<'ctx> {
 
                 self.builder.position_at_end(ok_bb);
             }
+            Statement::Profile { on, .. } => {
+                let on = self.i32_type.const_int(*on as u64, false);
+                self.builder.build_call(self.rt_profile_on.unwrap(), &[on.into()], "")?;
+            }
+            Statement::ProfileDump { target: None, .. } => {
+                self.builder.build_call(self.rt_profile_dump.unwrap(), &[], "")?;
+            }
+            Statement::ProfileDump { target: Some((name, var_type)), .. } => {
+                let report = self
+                    .builder
+                    .build_call(self.rt_profile_report.unwrap(), &[], "profile")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                self.store_result(name, var_type, report, VarType::String)?;
+            }
             Statement::ForEach { var, var_type, array_name, body, .. } => {
                 let vt = Self::qb_to_var(var_type);
                 self.ensure_var(var, vt)?;
@@ -3873,7 +5915,8 @@ impl<'ctx> Codegen<'ctx> {
                     let data_alloca = arr_info.data_ptr_alloca;
                     let element_vt = arr_info.element_vt;
 
-                    let counter = self.builder.build_alloca(self.i32_type, "foreach_i")?;
+                    let counter =
+                        self.build_var_alloca(self.i32_type.as_basic_type_enum(), "foreach_i")?;
                     self.builder.build_store(counter, self.i32_type.const_zero())?;
 
                     let cond_bb = self.context.append_basic_block(function, "foreach_cond");
@@ -3902,7 +5945,7 @@ impl<'ctx> Codegen<'ctx> {
                         self.builder.build_store(*alloca, coerced)?;
                     }
 
-                    self.for_exit_stack.push(end_bb);
+                    self.for_exit_stack.push((end_bb, self.try_catch_bbs.len()));
                     self.compile_body(body)?;
                     self.for_exit_stack.pop();
 
@@ -3918,22 +5961,17 @@ impl<'ctx> Codegen<'ctx> {
                 }
             }
             Statement::TryCatch { try_body, catch_var, catch_body, .. } => {
-                let result = self.builder.build_call(
-                    self.rt_try_begin.unwrap(), &[], "try_result"
-                )?.try_as_basic_value().left().unwrap().into_int_value();
+                // Nothing is saved on entry: an error sets rb_error_pending,
+                // and the check after each statement of the body (see
+                // compile_error_check) branches to the CATCH
+                self.builder.build_call(self.rt_try_begin.unwrap(), &[], "")?;
 
-                let try_bb = self.context.append_basic_block(function, "try_body");
                 let catch_bb = self.context.append_basic_block(function, "catch_body");
                 let merge_bb = self.context.append_basic_block(function, "try_merge");
 
-                let is_zero = self.builder.build_int_compare(
-                    IntPredicate::EQ, result, self.i32_type.const_zero(), "is_try"
-                )?;
-                self.builder.build_conditional_branch(is_zero, try_bb, catch_bb)?;
-
-                // Try body
-                self.builder.position_at_end(try_bb);
+                self.try_catch_bbs.push((function, catch_bb));
                 self.compile_body(try_body)?;
+                self.try_catch_bbs.pop();
                 if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
                     self.builder.build_call(self.rt_try_end.unwrap(), &[], "")?;
                     self.builder.build_unconditional_branch(merge_bb)?;
@@ -3943,70 +5981,20 @@ impl<'ctx> Codegen<'ctx> {
                 self.builder.position_at_end(catch_bb);
                 self.ensure_var(catch_var, VarType::String)?;
                 let err_msg = self.builder.build_call(
-                    self.rt_get_error_message.unwrap(), &[], "err_msg"
+                    self.rt_try_catch.unwrap(), &[], "err_msg"
                 )?.try_as_basic_value().left().unwrap();
                 if let Some((alloca, _)) = self.variables.get(catch_var) {
                     self.builder.build_store(*alloca, err_msg)?;
                 }
                 self.compile_body(catch_body)?;
                 if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
-                    self.builder.build_call(self.rt_try_end.unwrap(), &[], "")?;
                     self.builder.build_unconditional_branch(merge_bb)?;
                 }
 
                 self.builder.position_at_end(merge_bb);
             }
             Statement::Task { name, stack_size, priority, body, .. } => {
-                let task_id = self.task_counter;
-                self.task_counter += 1;
-
-                // Create task body function
-                let task_fn_name = format!("rb_task_body_{}", task_id);
-                let task_fn_type = self.context.void_type().fn_type(
-                    &[BasicMetadataTypeEnum::from(self.ptr_type)],
-                    false,
-                );
-                let task_fn = self.module.add_function(&task_fn_name, task_fn_type, None);
-                let task_entry_bb = self.context.append_basic_block(task_fn, "entry");
-
-                // Save state
-                let saved_function = self.current_function;
-                let saved_exit_bb = self.current_exit_bb;
-                let saved_vars = self.variables.clone();
-                let saved_labels = self.label_bbs.clone();
-                let saved_for_exit = self.for_exit_stack.clone();
-                let saved_do_exit = self.do_exit_stack.clone();
-
-                self.current_function = Some(task_fn);
-                self.variables = HashMap::new();
-                self.label_bbs = HashMap::new();
-                self.for_exit_stack = Vec::new();
-                self.do_exit_stack = Vec::new();
-
-                self.builder.position_at_end(task_entry_bb);
-                let task_exit_bb = self.context.append_basic_block(task_fn, "exit");
-                self.current_exit_bb = Some(task_exit_bb);
-
-                self.compile_body(body)?;
-
-                if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
-                    self.builder.build_unconditional_branch(task_exit_bb)?;
-                }
-                self.builder.position_at_end(task_exit_bb);
-                self.builder.build_return(None)?;
-
-                // Restore state
-                self.current_function = saved_function;
-                self.current_exit_bb = saved_exit_bb;
-                self.variables = saved_vars;
-                self.label_bbs = saved_labels;
-                self.for_exit_stack = saved_for_exit;
-                self.do_exit_stack = saved_do_exit;
-
-                // Back in main function, call rt_task_create
-                let continue_bb = self.context.append_basic_block(function, "after_task");
-                self.builder.position_at_end(continue_bb);
-
+                let task_fn = self.compile_task_body("rb_task_body", body)?;
                 let name_val = self.compile_expr(name, VarType::String)?.into_pointer_value();
                 let stack_val = self.compile_expr_as_i32(stack_size)?;
                 let prio_val = self.compile_expr_as_i32(priority)?;
@@ -4018,17 +6006,56 @@ impl<'ctx> Codegen<'ctx> {
                     "",
                 )?;
             }
+            Statement::TaskPool { workers, stack_size, priority, core, .. } => {
+                let workers_val = self.compile_expr_as_i32(workers)?;
+                let stack_val = self.compile_expr_as_i32(stack_size)?;
+                let prio_val = self.compile_expr_as_i32(priority)?;
+                let core_val = match core {
+                    Some(core) => self.compile_expr_as_i32(core)?,
+                    None => self.i32_type.const_int(-1i64 as u64, true),
+                };
+                self.builder.build_call(
+                    self.rt_task_pool.unwrap(),
+                    &[workers_val.into(), stack_val.into(), prio_val.into(), core_val.into()],
+                    "",
+                )?;
+            }
+            Statement::Spawn { target, body, .. } => {
+                let job_fn = self.compile_task_body("rb_spawn_body", body)?;
+                let fn_ptr = job_fn.as_global_value().as_pointer_value();
+                let job = self
+                    .builder
+                    .build_call(self.rt_spawn.unwrap(), &[fn_ptr.into()], "job")?
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+                if let Some((name, var_type)) = target {
+                    self.ensure_var(name, Self::qb_to_var(var_type))?;
+                    if let Some((alloca, _)) = self.variables.get(name) {
+                        self.builder.build_store(*alloca, job)?;
+                    }
+                }
+            }
+            Statement::Wait { job, .. } => {
+                let job_val = self.compile_expr_as_i32(job)?;
+                self.builder.build_call(self.rt_wait.unwrap(), &[BasicMetadataValueEnum::from(job_val)], "")?;
+            }
             Statement::OnGpioChange { pin, target, .. } => {
                 let pin_val = self.compile_expr_as_i32(pin)?;
-                if let Some(&_target_bb) = self.label_bbs.get(target) {
+                if self.label_bbs.contains_key(target) || self.user_functions.contains_key(target) {
                     // Create a wrapper function that branches to the target label
                     let wrapper_name = format!("rb_gpio_handler_{}", target);
                     let wrapper_type = self.context.void_type().fn_type(&[], false);
                     let wrapper_fn = self.module.add_function(&wrapper_name, wrapper_type, None);
                     let wrapper_bb = self.context.append_basic_block(wrapper_fn, "entry");
 
+                    // The runtime's event dispatcher task calls the wrapper;
+                    // a SUB handler runs there
                     let saved_pos = self.builder.get_insert_block().unwrap();
                     self.builder.position_at_end(wrapper_bb);
+                    if let Some(&handler) = self.user_functions.get(target) {
+                        self.builder.build_call(handler, &[], "")?;
+                    }
                     self.builder.build_return(None)?;
                     self.builder.position_at_end(saved_pos);
 
@@ -4049,6 +6076,9 @@ impl<'ctx> Codegen<'ctx> {
 
                 let saved_pos = self.builder.get_insert_block().unwrap();
                 self.builder.position_at_end(wrapper_bb);
+                if let Some(&handler) = self.user_functions.get(target) {
+                    self.builder.build_call(handler, &[], "")?;
+                }
                 self.builder.build_return(None)?;
                 self.builder.position_at_end(saved_pos);
 
@@ -4065,8 +6095,13 @@ impl<'ctx> Codegen<'ctx> {
                 let wrapper_fn = self.module.add_function(&wrapper_name, wrapper_type, None);
                 let wrapper_bb = self.context.append_basic_block(wrapper_fn, "entry");
 
+                // The runtime's dispatch task calls the handler SUB once per
+                // message; MQTT.RECEIVE / MQTT.TOPIC inside it read that message
                 let saved_pos = self.builder.get_insert_block().unwrap();
                 self.builder.position_at_end(wrapper_bb);
+                if let Some(&handler) = self.user_functions.get(target) {
+                    self.builder.build_call(handler, &[], "")?;
+                }
                 self.builder.build_return(None)?;
                 self.builder.position_at_end(saved_pos);
 
@@ -4077,16 +6112,74 @@ impl<'ctx> Codegen<'ctx> {
                     "",
                 )?;
             }
+            Statement::OnTcpData { target, .. } => {
+                // The TCP event loop calls the SUB for every chunk a client
+                // sends; TCP.RECEIVE$ / TCP.SEND inside it act on that client
+                let handler_fn = *self.user_functions.get(target).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                self.builder.build_call(self.rt_on_tcp_data.unwrap(), &[fn_ptr.into()], "")?;
+            }
+            Statement::OnUartLine { port, delim, target, .. } => {
+                // The UART event task calls the SUB once per delimited frame
+                let p = self.compile_expr_as_i32(port)?;
+                let d = match delim {
+                    Some(e) => self.compile_expr_as_i32(e)?,
+                    None => self.i32_type.const_int(10, false),
+                };
+                let handler_fn = *self.user_functions.get(target).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                self.builder.build_call(self.rt_on_uart_line.unwrap(), &[p.into(), d.into(), fn_ptr.into()], "")?;
+            }
+            Statement::OnI2sNeed { target, .. } => {
+                // The I2S feeder task calls the SUB whenever its queue runs low
+                let handler_fn = *self.user_functions.get(target).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                self.builder.build_call(self.rt_on_i2s_need.unwrap(), &[fn_ptr.into()], "")?;
+            }
             Statement::MachineEvent { machine_name, event, .. } => {
                 let handle_name = format!("{}.HANDLE", machine_name);
                 if let Some((alloca, _)) = self.variables.get(&handle_name).copied() {
                     let handle = self.builder.build_load(self.i32_type, alloca, "mach_handle")?.into_int_value();
-                    let event_val = self.compile_expr(event, VarType::String)?.into_pointer_value();
-                    self.builder.build_call(
-                        self.rt_machine_event.unwrap(),
-                        &[handle.into(), event_val.into()],
-                        "",
-                    )?;
+                    // A literal event is resolved here to its number; one the
+                    // machine has no transition on is a no-op
+                    if let Expr::StringLiteral { value, .. } = event {
+                        let id = self.machine_events.get(machine_name)
+                            .and_then(|events| events.iter().position(|e| e == value));
+                        if let Some(id) = id {
+                            let id_val = self.i32_type.const_int(id as u64, false);
+                            self.builder.build_call(
+                                self.rt_machine_event_id.unwrap(),
+                                &[handle.into(), id_val.into()],
+                                "",
+                            )?;
+                        }
+                    } else {
+                        let event_val = self.compile_expr(event, VarType::String)?.into_pointer_value();
+                        self.builder.build_call(
+                            self.rt_machine_event.unwrap(),
+                            &[handle.into(), event_val.into()],
+                            "",
+                        )?;
+                    }
+                }
+            }
+            Statement::MachineState { machine_name, target, var_type, .. } => {
+                let handle_name = format!("{}.HANDLE", machine_name);
+                if let Some((alloca, _)) = self.variables.get(&handle_name).copied() {
+                    let handle = self.builder.build_load(self.i32_type, alloca, "mach_handle")?.into_int_value();
+                    let vt = Self::qb_to_var(var_type);
+                    let f = if vt == VarType::String {
+                        self.rt_machine_get_state.unwrap()
+                    } else {
+                        self.rt_machine_state.unwrap()
+                    };
+                    let result = self.builder.build_call(f, &[handle.into()], "mach_state")?
+                        .try_as_basic_value().left().unwrap();
+                    let result = self.coerce_value(result, if vt == VarType::String { VarType::String } else { VarType::Integer }, vt)?;
+                    self.ensure_var(target, vt)?;
+                    if let Some((var, _)) = self.variables.get(target) {
+                        self.builder.build_store(*var, result)?;
+                    }
                 }
             }
             // ── New hardware compile arms (phase 2) ──
@@ -4112,17 +6205,59 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::FileOpen { path, mode, .. } => {
+            Statement::FileOpen { path, mode, handle, .. } => {
                 let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
                 let m = self.compile_expr(mode, VarType::String)?.into_pointer_value();
-                self.builder.build_call(self.rt_file_open.unwrap(), &[p.into(), m.into()], "")?;
+                if let Some((h, h_type)) = handle {
+                    let result = self.builder.build_call(self.rt_file_open_handle.unwrap(), &[p.into(), m.into()], "fh")?
+                        .try_as_basic_value().left().unwrap();
+                    self.ensure_var(h, Self::qb_to_var(h_type))?;
+                    if let Some((alloca, _)) = self.variables.get(h) {
+                        self.builder.build_store(*alloca, result)?;
+                    }
+                } else {
+                    self.builder.build_call(self.rt_file_open.unwrap(), &[p.into(), m.into()], "")?;
+                }
             }
-            Statement::FileWrite { data, .. } => {
+            Statement::FileWrite { data, handle, .. } => {
                 let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
-                self.builder.build_call(self.rt_file_write.unwrap(), &[d.into()], "")?;
+                if let Some(h) = handle {
+                    let h = self.compile_expr_as_i32(h)?;
+                    self.builder.build_call(self.rt_fh_write.unwrap(), &[h.into(), d.into()], "")?;
+                } else {
+                    self.builder.build_call(self.rt_file_write.unwrap(), &[d.into()], "")?;
+                }
             }
-            Statement::FileReadStr { target, var_type, .. } => {
-                let result = self.builder.build_call(self.rt_file_read.unwrap(), &[], "file_val")?
+            Statement::FileReadStr { target, var_type, max, handle, .. } => {
+                let call = if let (Some(m), Some(h)) = (max, handle) {
+                    let m = self.compile_expr_as_i32(m)?;
+                    let h = self.compile_expr_as_i32(h)?;
+                    self.builder.build_call(self.rt_fh_read.unwrap(), &[h.into(), m.into()], "file_val")?
+                } else if let Some(m) = max {
+                    let m = self.compile_expr_as_i32(m)?;
+                    self.builder.build_call(self.rt_file_read_n.unwrap(), &[m.into()], "file_val")?
+                } else {
+                    self.builder.build_call(self.rt_file_read.unwrap(), &[], "file_val")?
+                };
+                let result = call.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::FileReadLine { target, var_type, handle, .. }
+            | Statement::FileEof { target, var_type, handle, .. } => {
+                let h = match handle {
+                    Some(h) => self.compile_expr_as_i32(h)?,
+                    None => self.context.i32_type().const_int(RB_FH_FILE, false),
+                };
+                let func = if matches!(stmt, Statement::FileEof { .. }) {
+                    self.rt_fh_eof.unwrap()
+                } else {
+                    self.rt_fh_readline.unwrap()
+                };
+                let result = self.builder.build_call(func, &[h.into()], "file_val")?
                     .try_as_basic_value().left().unwrap();
                 let vt = Self::qb_to_var(var_type);
                 self.ensure_var(target, vt)?;
@@ -4130,8 +6265,13 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::FileClose { .. } => {
-                self.builder.build_call(self.rt_file_close.unwrap(), &[], "")?;
+            Statement::FileClose { handle, .. } => {
+                if let Some(h) = handle {
+                    let h = self.compile_expr_as_i32(h)?;
+                    self.builder.build_call(self.rt_fh_close.unwrap(), &[h.into()], "")?;
+                } else {
+                    self.builder.build_call(self.rt_file_close.unwrap(), &[], "")?;
+                }
             }
             Statement::FileDelete { path, .. } => {
                 let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
@@ -4180,21 +6320,44 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::TcpSend { data, .. } => {
+            Statement::TcpSend { data, conn, .. } => {
                 let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
-                self.builder.build_call(self.rt_tcp_send.unwrap(), &[d.into()], "")?;
+                if let Some(c) = conn {
+                    let c = self.compile_expr_as_i32(c)?;
+                    self.builder.build_call(self.rt_tcp_send_to.unwrap(), &[c.into(), d.into()], "")?;
+                } else {
+                    self.builder.build_call(self.rt_tcp_send.unwrap(), &[d.into()], "")?;
+                }
             }
             Statement::TcpReceiveStr { target, var_type, .. } => {
-                let result = self.builder.build_call(self.rt_tcp_receive.unwrap(), &[], "tcp_val")?
-                    .try_as_basic_value().left().unwrap();
+                let result = if self.can_suspend_for_io() {
+                    self.compile_async_io(RB_ASYNC_OP_TCP_RECEIVE, None, None)?
+                } else {
+                    self.builder.build_call(self.rt_tcp_receive.unwrap(), &[], "tcp_val")?
+                        .try_as_basic_value().left().unwrap()
+                };
                 let vt = Self::qb_to_var(var_type);
                 self.ensure_var(target, vt)?;
                 if let Some((alloca, _)) = self.variables.get(target) {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::TcpClose { .. } => {
-                self.builder.build_call(self.rt_tcp_close.unwrap(), &[], "")?;
+            Statement::TcpClose { conn, .. } => {
+                if let Some(c) = conn {
+                    let c = self.compile_expr_as_i32(c)?;
+                    self.builder.build_call(self.rt_tcp_close_client.unwrap(), &[c.into()], "")?;
+                } else {
+                    self.builder.build_call(self.rt_tcp_close.unwrap(), &[], "")?;
+                }
+            }
+            Statement::TcpClient { target, var_type, .. } => {
+                let result = self.builder.build_call(self.rt_tcp_client.unwrap(), &[], "tcp_client")?
+                    .try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
             }
             Statement::WdtEnable { timeout_ms, .. } => {
                 let ms = self.compile_expr_as_i32(timeout_ms)?;
@@ -4244,6 +6407,26 @@ impl<'ctx> Codegen<'ctx> {
             Statement::I2sStop { .. } => {
                 self.builder.build_call(self.rt_i2s_stop.unwrap(), &[], "")?;
             }
+            Statement::I2sPins { bclk, ws, dout, din, .. } => {
+                let b = self.compile_expr_as_i32(bclk)?;
+                let w = self.compile_expr_as_i32(ws)?;
+                let o = self.compile_expr_as_i32(dout)?;
+                // No DIN pin: output only
+                let i = match din {
+                    Some(d) => self.compile_expr_as_i32(d)?,
+                    None => self.i32_type.const_int(-1i64 as u64, true),
+                };
+                self.builder.build_call(self.rt_i2s_pins.unwrap(), &[b.into(), w.into(), o.into(), i.into()], "")?;
+            }
+            Statement::I2sRead { length, target, var_type, .. } => {
+                let n = self.compile_expr_as_i32(length)?;
+                let result = self.builder.build_call(self.rt_i2s_read.unwrap(), &[n.into()], "i2s_in")?
+                    .try_as_basic_value().left().unwrap();
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
 
             // ── Web Server ──────────────────────────────────
             Statement::WebStart { port, .. } => {
@@ -4266,31 +6449,72 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
-            Statement::WebReply { status, body, .. } => {
+            Statement::WebReply { status, body, request, .. } => {
                 let s = self.compile_expr_as_i32(status)?;
                 let b = self.compile_expr(body, VarType::String)?.into_pointer_value();
-                self.builder.build_call(self.rt_web_reply.unwrap(), &[s.into(), b.into()], "")?;
+                if let Some(r) = request {
+                    let r = self.compile_expr_as_i32(r)?;
+                    self.builder.build_call(self.rt_web_reply_to.unwrap(), &[r.into(), s.into(), b.into()], "")?;
+                } else {
+                    self.builder.build_call(self.rt_web_reply.unwrap(), &[s.into(), b.into()], "")?;
+                }
             }
             Statement::WebStop { .. } => {
                 self.builder.build_call(self.rt_web_stop.unwrap(), &[], "")?;
             }
+            Statement::WebRoute { method, path, handler, .. } => {
+                let m = self.compile_expr(method, VarType::String)?.into_pointer_value();
+                let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
+                // The SUB runs on a web worker task, once per matching request
+                let handler_fn = *self.user_functions.get(handler).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                self.builder.build_call(self.rt_web_route.unwrap(), &[m.into(), p.into(), fn_ptr.into()], "")?;
+            }
+            Statement::WebServe { prefix, dir, .. } => {
+                let p = self.compile_expr(prefix, VarType::String)?.into_pointer_value();
+                let d = self.compile_expr(dir, VarType::String)?.into_pointer_value();
+                self.builder.build_call(self.rt_web_serve.unwrap(), &[p.into(), d.into()], "")?;
+            }
+            Statement::WebRequest { target, var_type, .. } => {
+                let result = self.builder.build_call(self.rt_web_request.unwrap(), &[], "web_request")?.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
 
             // ── SD Card ─────────────────────────────────────
             Statement::SdInit { cs_pin, .. } => {
                 let p = self.compile_expr_as_i32(cs_pin)?;
                 self.builder.build_call(self.rt_sd_init.unwrap(), &[BasicMetadataValueEnum::from(p)], "")?;
             }
-            Statement::SdOpen { path, mode, .. } => {
+            Statement::SdOpen { path, mode, handle, .. } => {
                 let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
                 let m = self.compile_expr(mode, VarType::String)?.into_pointer_value();
-                self.builder.build_call(self.rt_sd_open.unwrap(), &[p.into(), m.into()], "")?;
+                if let Some((h, h_type)) = handle {
+                    let result = self.builder.build_call(self.rt_sd_open_handle.unwrap(), &[p.into(), m.into()], "fh")?
+                        .try_as_basic_value().left().unwrap();
+                    self.ensure_var(h, Self::qb_to_var(h_type))?;
+                    if let Some((alloca, _)) = self.variables.get(h) {
+                        self.builder.build_store(*alloca, result)?;
+                    }
+                } else {
+                    self.builder.build_call(self.rt_sd_open.unwrap(), &[p.into(), m.into()], "")?;
+                }
             }
             Statement::SdWrite { data, .. } => {
                 let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
                 self.builder.build_call(self.rt_sd_write.unwrap(), &[d.into()], "")?;
             }
-            Statement::SdReadStr { target, var_type, .. } => {
-                let result = self.builder.build_call(self.rt_sd_read.unwrap(), &[], "sd_read")?.try_as_basic_value().left().unwrap();
+            Statement::SdReadStr { target, var_type, max, .. } => {
+                let call = if let Some(m) = max {
+                    let m = self.compile_expr_as_i32(m)?;
+                    self.builder.build_call(self.rt_sd_read_n.unwrap(), &[m.into()], "sd_read")?
+                } else {
+                    self.builder.build_call(self.rt_sd_read.unwrap(), &[], "sd_read")?
+                };
+                let result = call.try_as_basic_value().left().unwrap();
                 let vt = Self::qb_to_var(var_type);
                 self.ensure_var(target, vt)?;
                 if let Some((alloca, _)) = self.variables.get(target) {
@@ -4308,14 +6532,117 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+            Statement::LogOpen { path, max_bytes, keep, .. } => {
+                let p = self.compile_expr(path, VarType::String)?.into_pointer_value();
+                // No rotation unless a size is given; then one old file is kept
+                let m = match max_bytes {
+                    Some(m) => self.compile_expr_as_i32(m)?,
+                    None => self.context.i32_type().const_int(0, false),
+                };
+                let k = match keep {
+                    Some(k) => self.compile_expr_as_i32(k)?,
+                    None => self.context.i32_type().const_int(1, false),
+                };
+                self.builder.build_call(self.rt_log_open.unwrap(), &[p.into(), m.into(), k.into()], "")?;
+            }
+            Statement::LogWrite { data, .. } => {
+                let d = self.compile_expr(data, VarType::String)?.into_pointer_value();
+                self.builder.build_call(self.rt_log_write.unwrap(), &[d.into()], "")?;
+            }
+            Statement::LogFlush { .. } => {
+                self.builder.build_call(self.rt_log_flush.unwrap(), &[], "")?;
+            }
+            Statement::Flush { .. } => {
+                self.builder.build_call(self.rt_console_flush.unwrap(), &[], "")?;
+            }
+            Statement::ConsoleMode { mode, n, .. } => {
+                let mode_val = self.compile_expr_as_i32(mode)?;
+                // 0 picks the runtime default for the mode
+                let n_val = match n {
+                    Some(n) => self.compile_expr_as_i32(n)?,
+                    None => self.i32_type.const_zero(),
+                };
+                self.builder.build_call(self.rt_console_mode.unwrap(), &[mode_val.into(), n_val.into()], "")?;
+            }
+            Statement::LogClose { .. } => {
+                self.builder.build_call(self.rt_log_close.unwrap(), &[], "")?;
+            }
+            Statement::LogDropped { target, var_type, .. } => {
+                let result = self.builder.build_call(self.rt_log_dropped.unwrap(), &[], "log_dropped")?.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::EventCoalesced { target, var_type, .. } | Statement::EventDropped { target, var_type, .. } => {
+                let f = if matches!(stmt, Statement::EventCoalesced { .. }) {
+                    self.rt_event_coalesced.unwrap()
+                } else {
+                    self.rt_event_dropped.unwrap()
+                };
+                let result = self.builder.build_call(f, &[], "event_count")?.try_as_basic_value().left().unwrap();
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
 
             // ── Async ───────────────────────────────────────
             Statement::YieldStmt { .. } => {
-                self.builder.build_call(self.rt_yield.unwrap(), &[], "")?;
+                if self.in_async_body() {
+                    let resume_bb = self.context.append_basic_block(function, "async.resume");
+                    self.build_async_suspend(self.i32_type.const_zero(), resume_bb)?;
+                    self.builder.position_at_end(resume_bb);
+                } else {
+                    self.builder.build_call(self.rt_yield.unwrap(), &[], "")?;
+                }
             }
             Statement::AwaitStmt { ms, .. } => {
                 let m = self.compile_expr_as_i32(ms)?;
-                self.builder.build_call(self.rt_await.unwrap(), &[BasicMetadataValueEnum::from(m)], "")?;
+                if self.in_async_body() {
+                    // A negative wait must not read as RB_ASYNC_DONE
+                    let zero = self.i32_type.const_zero();
+                    let neg = self.builder.build_int_compare(IntPredicate::SLT, m, zero, "await_neg")?;
+                    let wake = self.builder.build_select(neg, zero, m, "await_ms")?.into_int_value();
+                    let resume_bb = self.context.append_basic_block(function, "async.resume");
+                    self.build_async_suspend(wake, resume_bb)?;
+                    self.builder.position_at_end(resume_bb);
+                } else {
+                    self.builder.build_call(self.rt_await.unwrap(), &[BasicMetadataValueEnum::from(m)], "")?;
+                }
+            }
+            Statement::AwaitUntil { condition, .. } => {
+                // Re-test the condition: an ASYNC body hands the event loop
+                // back until the next I/O notification (or poll), any other
+                // code just sleeps between polls
+                let check_bb = self.context.append_basic_block(function, "await.check");
+                let wait_bb = self.context.append_basic_block(function, "await.wait");
+                let ready_bb = self.context.append_basic_block(function, "await.ready");
+                self.builder.build_unconditional_branch(check_bb)?;
+                self.builder.position_at_end(check_bb);
+                let cond = self.compile_condition(condition)?;
+                self.builder.build_conditional_branch(cond, ready_bb, wait_bb)?;
+                self.builder.position_at_end(wait_bb);
+                let poll = self.i32_type.const_int(RB_ASYNC_POLL_MS, false);
+                if self.in_async_body() {
+                    let io = self.i32_type.const_int(RB_ASYNC_IO as u64, true);
+                    self.build_async_suspend(io, check_bb)?;
+                } else {
+                    self.builder.build_call(self.rt_await.unwrap(), &[BasicMetadataValueEnum::from(poll)], "")?;
+                    self.builder.build_unconditional_branch(check_bb)?;
+                }
+                self.builder.position_at_end(ready_bb);
+            }
+            Statement::Async { body, .. } => {
+                let (step_fn, frame_size) = self.compile_async_body(body)?;
+                let fn_ptr = step_fn.as_global_value().as_pointer_value();
+                let size_val = self.i32_type.const_int(frame_size, false);
+                self.builder.build_call(
+                    self.rt_async_start.unwrap(),
+                    &[fn_ptr.into(), size_val.into()],
+                    "",
+                )?;
             }
 
             // ── Cron ────────────────────────────────────────
@@ -4337,8 +6664,154 @@ impl<'ctx> Codegen<'ctx> {
                 let i = self.compile_expr_as_i32(id)?;
                 self.builder.build_call(self.rt_cron_remove.unwrap(), &[BasicMetadataValueEnum::from(i)], "")?;
             }
+            Statement::OnCron { id, target, .. } => {
+                // The event dispatcher task calls the SUB each time the job fires
+                let i = self.compile_expr_as_i32(id)?;
+                let handler_fn = *self.user_functions.get(target).unwrap();
+                let fn_ptr = handler_fn.as_global_value().as_pointer_value();
+                self.builder.build_call(self.rt_on_cron.unwrap(), &[i.into(), fn_ptr.into()], "")?;
+            }
 
             // ── Regex ───────────────────────────────────────
+            Statement::ValNext { text, pos, pos_type, target, var_type, .. } => {
+                let t = self.compile_expr(text, VarType::String)?.into_pointer_value();
+                self.ensure_var(pos, Self::qb_to_var(pos_type))?;
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                let (pos_alloca, pos_vt) = *self.variables.get(pos).unwrap();
+                let (target_alloca, target_vt) = *self.variables.get(target).unwrap();
+                // The runtime moves the position through a pointer; a
+                // non-integer position goes through an i32 slot
+                let pos_ptr = if pos_vt == VarType::Integer {
+                    pos_alloca
+                } else {
+                    let slot = self.build_var_alloca(self.i32_type.as_basic_type_enum(), "val_pos")?;
+                    let p = self.builder.build_load(self.f32_type, pos_alloca, "pos")?;
+                    let p = self.coerce_value(p, VarType::Float, VarType::Integer)?;
+                    self.builder.build_store(slot, p)?;
+                    slot
+                };
+                let f = if target_vt == VarType::Integer {
+                    self.rt_fn_val_next_int.unwrap()
+                } else {
+                    self.rt_fn_val_next.unwrap()
+                };
+                let result = self.builder.build_call(f, &[t.into(), pos_ptr.into()], "val_next")?
+                    .try_as_basic_value().left().unwrap();
+                self.builder.build_store(target_alloca, result)?;
+                if pos_vt != VarType::Integer {
+                    let p = self.builder.build_load(self.i32_type, pos_ptr, "pos")?;
+                    let p = self.coerce_value(p, VarType::Integer, VarType::Float)?;
+                    self.builder.build_store(pos_alloca, p)?;
+                }
+            }
+            Statement::ArrayReduce { op, array, target, var_type, .. } => {
+                if let Some((data, total, elem_vt)) = self.array_data(array)? {
+                    let (f, from) = match (op, elem_vt == VarType::Integer) {
+                        (ArrayReduceOp::Sum, true) => (self.rt_array_sum_int, VarType::Integer),
+                        (ArrayReduceOp::Min, true) => (self.rt_array_min_int, VarType::Integer),
+                        (ArrayReduceOp::Max, true) => (self.rt_array_max_int, VarType::Integer),
+                        (ArrayReduceOp::Sum, false) => (self.rt_array_sum_float, VarType::Float),
+                        (ArrayReduceOp::Min, false) => (self.rt_array_min_float, VarType::Float),
+                        (ArrayReduceOp::Max, false) => (self.rt_array_max_float, VarType::Float),
+                    };
+                    let result = self.builder.build_call(f.unwrap(), &[data.into(), total.into()], "array_reduce")?
+                        .try_as_basic_value().left().unwrap();
+                    self.store_result(target, var_type, result, from)?;
+                }
+            }
+            Statement::ArrayDot { a, b, target, var_type, .. } => {
+                if let (Some((da, na, elem_vt)), Some((db, nb, _))) = (self.array_data(a)?, self.array_data(b)?) {
+                    let (f, from) = if elem_vt == VarType::Integer {
+                        (self.rt_array_dot_int, VarType::Integer)
+                    } else {
+                        (self.rt_array_dot_float, VarType::Float)
+                    };
+                    let result = self.builder.build_call(f.unwrap(), &[da.into(), na.into(), db.into(), nb.into()], "array_dot")?
+                        .try_as_basic_value().left().unwrap();
+                    self.store_result(target, var_type, result, from)?;
+                }
+            }
+            Statement::ArrayFill { array, value, .. } => {
+                if let Some((data, total, elem_vt)) = self.array_data(array)? {
+                    let f = if elem_vt == VarType::Integer {
+                        self.rt_array_fill_int
+                    } else {
+                        self.rt_array_fill_float
+                    };
+                    let v = self.compile_expr(value, elem_vt)?;
+                    self.builder.build_call(f.unwrap(), &[data.into(), total.into(), v.into()], "")?;
+                }
+            }
+            Statement::ArrayCopy { src, dst, .. } => {
+                if let (Some((ds, ns, _)), Some((dd, nd, _))) = (self.array_data(src)?, self.array_data(dst)?) {
+                    self.builder.build_call(
+                        self.rt_array_copy.unwrap(),
+                        &[dd.into(), nd.into(), ds.into(), ns.into()],
+                        "",
+                    )?;
+                }
+            }
+            Statement::ArrayScale { array, factor, offset, .. } => {
+                if let Some((data, total, elem_vt)) = self.array_data(array)? {
+                    let f = if elem_vt == VarType::Integer {
+                        self.rt_array_scale_int
+                    } else {
+                        self.rt_array_scale_float
+                    };
+                    let k = self.compile_expr(factor, VarType::Float)?;
+                    let o = match offset {
+                        Some(offset) => self.compile_expr(offset, VarType::Float)?,
+                        None => self.f32_type.const_zero().as_basic_value_enum(),
+                    };
+                    self.builder.build_call(f.unwrap(), &[data.into(), total.into(), k.into(), o.into()], "")?;
+                }
+            }
+            Statement::DspFir { array, coeffs, state, .. }
+            | Statement::DspBiquad { array, coeffs, state, .. } => {
+                let f = if matches!(stmt, Statement::DspFir { .. }) {
+                    self.rt_dsp_fir
+                } else {
+                    self.rt_dsp_biquad
+                };
+                // Without a state array the runtime starts from silence each call
+                let z = match state {
+                    Some(state) => self.array_data(state)?.map(|(dz, nz, _)| (dz, nz)),
+                    None => Some((
+                        self.ptr_type.const_null().as_basic_value_enum(),
+                        self.i32_type.const_zero().as_basic_value_enum(),
+                    )),
+                };
+                if let (Some((dx, nx, _)), Some((dc, nc, _)), Some((dz, nz))) =
+                    (self.array_data(array)?, self.array_data(coeffs)?, z)
+                {
+                    self.builder.build_call(
+                        f.unwrap(),
+                        &[dx.into(), nx.into(), dc.into(), nc.into(), dz.into(), nz.into()],
+                        "",
+                    )?;
+                }
+            }
+            Statement::DspFft { re, im, .. } | Statement::DspMag { re, im, .. } => {
+                let f = if matches!(stmt, Statement::DspFft { .. }) {
+                    self.rt_dsp_fft
+                } else {
+                    self.rt_dsp_mag
+                };
+                if let (Some((dr, nr, _)), Some((di, ni, _))) = (self.array_data(re)?, self.array_data(im)?) {
+                    self.builder.build_call(f.unwrap(), &[dr.into(), nr.into(), di.into(), ni.into()], "")?;
+                }
+            }
+            Statement::DspLevel { op, array, target, var_type, .. } => {
+                if let Some((data, total, _)) = self.array_data(array)? {
+                    let f = match op {
+                        DspLevelOp::Rms => self.rt_dsp_rms,
+                        DspLevelOp::Peak => self.rt_dsp_peak,
+                    };
+                    let result = self.builder.build_call(f.unwrap(), &[data.into(), total.into()], "dsp_level")?
+                        .try_as_basic_value().left().unwrap();
+                    self.store_result(target, var_type, result, VarType::Integer)?;
+                }
+            }
             Statement::RegexMatch { pattern, text, target, var_type, .. } => {
                 let p = self.compile_expr(pattern, VarType::String)?.into_pointer_value();
                 let t = self.compile_expr(text, VarType::String)?.into_pointer_value();
@@ -4370,42 +6843,614 @@ impl<'ctx> Codegen<'ctx> {
                     self.builder.build_store(*alloca, result)?;
                 }
             }
+
+            // ── String Builder ──────────────────────────────
+            Statement::StringBuilderNew { target, var_type, .. } => {
+                let result = self.builder.build_call(self.rt_sb_new.unwrap(), &[], "sb_new")?.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::SbAppend { handle, value, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                // Numbers are formatted straight into the builder, no temporary string
+                let (func, v) = match self.infer_expr_type(value) {
+                    VarType::Integer => (self.rt_sb_append_int, self.compile_expr(value, VarType::Integer)?),
+                    VarType::Float => (self.rt_sb_append_float, self.compile_expr(value, VarType::Float)?),
+                    VarType::String => (self.rt_sb_append_str, self.compile_expr(value, VarType::String)?),
+                };
+                self.builder.build_call(func.unwrap(), &[h.into(), v.into()], "")?;
+            }
+            Statement::SbToString { handle, target, var_type, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                let result = self.builder.build_call(self.rt_sb_tostring.unwrap(), &[BasicMetadataValueEnum::from(h)], "sb_str")?.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::SbClear { handle, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                self.builder.build_call(self.rt_sb_clear.unwrap(), &[BasicMetadataValueEnum::from(h)], "")?;
+            }
+            Statement::SbFree { handle, .. } => {
+                let h = self.compile_expr_as_i32(handle)?;
+                self.builder.build_call(self.rt_sb_free.unwrap(), &[BasicMetadataValueEnum::from(h)], "")?;
+            }
+
+            // ── Channels ────────────────────────────────────
+            Statement::ChannelNew { id, capacity, .. } => {
+                let id_val = self.compile_expr_as_i32(id)?;
+                let cap = self.compile_expr_as_i32(capacity)?;
+                self.builder.build_call(self.rt_channel_create.unwrap(), &[id_val.into(), cap.into()], "")?;
+            }
+            Statement::ChannelSend { id, value, .. } => {
+                let id_val = self.compile_expr_as_i32(id)?;
+                // The value travels in its own type; RECEIVE converts between numbers
+                let (func, v) = match self.infer_expr_type(value) {
+                    VarType::Integer => (self.rt_channel_send_int, self.compile_expr(value, VarType::Integer)?),
+                    VarType::Float => (self.rt_channel_send_float, self.compile_expr(value, VarType::Float)?),
+                    VarType::String => (self.rt_channel_send_str, self.compile_expr(value, VarType::String)?),
+                };
+                self.builder.build_call(func.unwrap(), &[id_val.into(), v.into()], "")?;
+            }
+            Statement::ChannelReceive { id, target, var_type, .. } => {
+                let id_val = self.compile_expr_as_i32(id)?;
+                self.ensure_var(target, Self::qb_to_var(var_type))?;
+                let vt = self.variables.get(target).map(|(_, v)| *v).unwrap();
+                let func = match vt {
+                    VarType::Integer => self.rt_channel_receive_int,
+                    VarType::Float => self.rt_channel_receive_float,
+                    VarType::String => self.rt_channel_receive_str,
+                };
+                let result = self.builder.build_call(func.unwrap(), &[BasicMetadataValueEnum::from(id_val)], "chan_val")?.try_as_basic_value().left().unwrap();
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+            Statement::ChannelSelect { ids, target, var_type, .. } => {
+                let arr_type = self.i32_type.array_type(ids.len() as u32);
+                let arr = self.build_entry_alloca(arr_type.into(), "select_ids")?;
+                for (i, id) in ids.iter().enumerate() {
+                    let id_val = self.compile_expr_as_i32(id)?;
+                    let idx = self.i32_type.const_int(i as u64, false);
+                    let slot = unsafe {
+                        self.builder.build_gep(self.i32_type, arr, &[idx], "select_id")?
+                    };
+                    self.builder.build_store(slot, id_val)?;
+                }
+                let count = self.i32_type.const_int(ids.len() as u64, false);
+                let result = self.builder.build_call(self.rt_channel_select.unwrap(), &[count.into(), arr.into()], "ready")?.try_as_basic_value().left().unwrap();
+                let vt = Self::qb_to_var(var_type);
+                self.ensure_var(target, vt)?;
+                if let Some((alloca, _)) = self.variables.get(target) {
+                    self.builder.build_store(*alloca, result)?;
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Compile a TASK or SPAWN body into its own `void fn(void*)`. The body
+    /// starts with a fresh variable map, like a SUB; the builder is left
+    /// where it was.
+    fn compile_task_body(&mut self, prefix: &str, body: &[Statement]) -> Result<FunctionValue<'ctx>> {
+        let (task_fn, _) = self.compile_detached_body(prefix, body, false)?;
+        Ok(task_fn)
+    }
+
+    /// Compile an ASYNC body into an `i32 step(ptr frame)` for the event
+    /// loop, returning it with the frame size. Each YIELD or AWAIT stores its
+    /// resume state in the frame and returns; the entry block switches on
+    /// that state to continue where the previous step left off.
+    fn compile_async_body(&mut self, body: &[Statement]) -> Result<(FunctionValue<'ctx>, u64)> {
+        self.compile_detached_body("rb_async_step", body, true)
+    }
+
+    fn compile_detached_body(
+        &mut self,
+        prefix: &str,
+        body: &[Statement],
+        is_async: bool,
+    ) -> Result<(FunctionValue<'ctx>, u64)> {
+        let task_id = self.task_counter;
+        self.task_counter += 1;
+
+        // Create task body function
+        let task_fn_name = format!("{}_{}", prefix, task_id);
+        let param_types = [BasicMetadataTypeEnum::from(self.ptr_type)];
+        let task_fn_type = if is_async {
+            self.i32_type.fn_type(&param_types, false)
+        } else {
+            self.context.void_type().fn_type(&param_types, false)
+        };
+        let task_fn = self.module.add_function(&task_fn_name, task_fn_type, None);
+        let task_entry_bb = self.context.append_basic_block(task_fn, "entry");
+
+        // Save state
+        let saved_block = self.builder.get_insert_block().unwrap();
+        let saved_function = self.current_function;
+        let saved_exit_bb = self.current_exit_bb;
+        let saved_vars = self.variables.clone();
+        let saved_labels = self.label_bbs.clone();
+        let saved_for_exit = self.for_exit_stack.clone();
+        let saved_do_exit = self.do_exit_stack.clone();
+        let saved_arrays = std::mem::take(&mut self.arrays);
+        let saved_for_ranges = std::mem::take(&mut self.for_ranges);
+        let saved_async = self.async_frame.take();
+
+        self.current_function = Some(task_fn);
+        self.variables = HashMap::new();
+        self.label_bbs = HashMap::new();
+        self.for_exit_stack = Vec::new();
+        self.do_exit_stack = Vec::new();
+
+        self.builder.position_at_end(task_entry_bb);
+        let task_exit_bb = self.context.append_basic_block(task_fn, "exit");
+        self.current_exit_bb = Some(task_exit_bb);
+        if is_async {
+            // The entry block only computes frame slots until the body is
+            // done; the body itself starts in its own block
+            let start_bb = self.context.append_basic_block(task_fn, "async.start");
+            self.async_frame = Some(AsyncFrame {
+                function: task_fn,
+                frame: task_fn.get_nth_param(0).unwrap().into_pointer_value(),
+                entry: task_entry_bb,
+                start: start_bb,
+                size: std::cell::Cell::new(8),
+                resume_blocks: Vec::new(),
+            });
+            self.builder.position_at_end(start_bb);
+        }
+
+        self.compile_body(body)?;
+
+        if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
+            self.builder.build_unconditional_branch(task_exit_bb)?;
+        }
+        self.builder.position_at_end(task_exit_bb);
+        let mut frame_size = 0;
+        match std::mem::replace(&mut self.async_frame, saved_async) {
+            Some(af) => {
+                // The loop frees the frame after this step: drop the strings
+                // its variables still hold. Only frame slots are sure to be
+                // reachable here, and every one of them was zeroed at start.
+                let mut strings: Vec<(&String, PointerValue<'ctx>)> = self
+                    .variables
+                    .iter()
+                    .filter(|(_, (slot, vt))| {
+                        *vt == VarType::String
+                            && slot.as_instruction().and_then(|i| i.get_parent()) == Some(af.entry)
+                    })
+                    .map(|(name, (slot, _))| (name, *slot))
+                    .collect();
+                strings.sort_by(|a, b| a.0.cmp(b.0));
+                for (name, slot) in strings {
+                    let val = self.builder.build_load(self.ptr_type, slot, name)?;
+                    self.builder.build_call(self.rt_string_release.unwrap(), &[val.into()], "")?;
+                }
+                let done = self.i32_type.const_int(RB_ASYNC_DONE as u64, true);
+                self.builder.build_return(Some(&done))?;
+
+                self.builder.position_at_end(af.entry);
+                let state = self
+                    .builder
+                    .build_load(self.i32_type, af.frame, "async_state")?
+                    .into_int_value();
+                let cases: Vec<_> = af
+                    .resume_blocks
+                    .iter()
+                    .enumerate()
+                    .map(|(i, bb)| (self.i32_type.const_int(i as u64 + 1, false), *bb))
+                    .collect();
+                self.builder.build_switch(state, af.start, &cases)?;
+                frame_size = af.size.get();
+            }
+            None => {
+                self.builder.build_return(None)?;
+            }
+        }
+
+        // Restore state
+        self.current_function = saved_function;
+        self.current_exit_bb = saved_exit_bb;
+        self.variables = saved_vars;
+        self.label_bbs = saved_labels;
+        self.for_exit_stack = saved_for_exit;
+        self.do_exit_stack = saved_do_exit;
+        self.arrays = saved_arrays;
+        self.for_ranges = saved_for_ranges;
+        self.builder.position_at_end(saved_block);
+
+        Ok((task_fn, frame_size))
+    }
+
+    /// Suspend the ASYNC body being compiled: record `resume` as the block
+    /// the next step continues in and return `wake` (milliseconds until that
+    /// step) to the event loop. The current block is left terminated.
+    fn build_async_suspend(
+        &mut self,
+        wake: IntValue<'ctx>,
+        resume: inkwell::basic_block::BasicBlock<'ctx>,
+    ) -> Result<()> {
+        let af = self.async_frame.as_mut().unwrap();
+        af.resume_blocks.push(resume);
+        let state = self.i32_type.const_int(af.resume_blocks.len() as u64, false);
+        self.builder.build_store(af.frame, state)?;
+        self.builder.build_return(Some(&wake))?;
+        Ok(())
+    }
+
+    /// Run a blocking I/O call (`RB_ASYNC_OP_*`) on the runtime's I/O task and
+    /// suspend the ASYNC body until it completes; returns its result string.
+    fn compile_async_io(
+        &mut self,
+        kind: u64,
+        a: Option<PointerValue<'ctx>>,
+        b: Option<PointerValue<'ctx>>,
+    ) -> Result<BasicValueEnum<'ctx>> {
+        let function = self.current_function.unwrap();
+        let null = self.ptr_type.const_null();
+        let op = self
+            .builder
+            .build_call(
+                self.rt_async_io_begin.unwrap(),
+                &[
+                    self.i32_type.const_int(kind, false).into(),
+                    a.unwrap_or(null).into(),
+                    b.unwrap_or(null).into(),
+                ],
+                "async_op",
+            )?
+            .try_as_basic_value()
+            .left()
+            .unwrap();
+        // The handle has to outlive the suspension, so it lives in the frame
+        let slot = self.build_var_alloca(self.ptr_type.as_basic_type_enum(), "async_op")?;
+        self.builder.build_store(slot, op)?;
+
+        let check_bb = self.context.append_basic_block(function, "io.check");
+        let wait_bb = self.context.append_basic_block(function, "io.wait");
+        let ready_bb = self.context.append_basic_block(function, "io.ready");
+        self.builder.build_unconditional_branch(check_bb)?;
+        self.builder.position_at_end(check_bb);
+        let op = self.builder.build_load(self.ptr_type, slot, "async_op")?;
+        let done = self
+            .builder
+            .build_call(self.rt_async_io_done.unwrap(), &[op.into()], "io_done")?
+            .try_as_basic_value()
+            .left()
+            .unwrap()
+            .into_int_value();
+        let done = self.builder.build_int_compare(IntPredicate::NE, done, self.i32_type.const_zero(), "io_ready")?;
+        self.builder.build_conditional_branch(done, ready_bb, wait_bb)?;
+        self.builder.position_at_end(wait_bb);
+        let io = self.i32_type.const_int(RB_ASYNC_IO as u64, true);
+        self.build_async_suspend(io, check_bb)?;
+
+        self.builder.position_at_end(ready_bb);
+        let op = self.builder.build_load(self.ptr_type, slot, "async_op")?;
+        Ok(self
+            .builder
+            .build_call(self.rt_async_io_take.unwrap(), &[op.into()], "io_val")?
+            .try_as_basic_value()
+            .left()
+            .unwrap())
+    }
+
+    /// Whether a blocking I/O call can suspend instead: inside an ASYNC body
+    /// and outside TRY, which cannot span a suspension.
+    fn can_suspend_for_io(&self) -> bool {
+        let function = self.current_function.unwrap();
+        self.in_async_body() && !self.try_catch_bbs.iter().any(|&(f, _)| f == function)
+    }
+
+    /// Whether statements are being compiled straight into an ASYNC body
+    /// (not into a lambda nested in one).
+    fn in_async_body(&self) -> bool {
+        match (&self.async_frame, self.builder.get_insert_block()) {
+            (Some(af), Some(bb)) => bb.get_parent() == Some(af.function),
+            _ => false,
+        }
+    }
+
+    fn ensure_var(&mut self, name: &str, vt: VarType) -> Result<()> {
+        if !self.variables.contains_key(name) {
+            let llvm_type = self.var_llvm_type(vt);
+            let alloca = self.build_var_alloca(llvm_type, name)?;
+            self.variables.insert(name.to_string(), (alloca, vt));
+        }
+        Ok(())
+    }
+
+    /// Allocate a BASIC variable: a stack slot, or a frame slot while an
+    /// ASYNC body is being compiled.
+    fn build_var_alloca(
+        &self,
+        ty: BasicTypeEnum<'ctx>,
+        name: &str,
+    ) -> Result<PointerValue<'ctx>> {
+        match self.async_frame_slot(ty, name)? {
+            Some(slot) => Ok(slot),
+            None => Ok(self.builder.build_alloca(ty, name)?),
+        }
+    }
+
+    /// Reserve a slot for a scalar in the current ASYNC frame. Returns `None`
+    /// outside an ASYNC body (including lambdas compiled within one) and for
+    /// aggregates, which only ever hold statement-local temporaries.
+    fn async_frame_slot(
+        &self,
+        ty: BasicTypeEnum<'ctx>,
+        name: &str,
+    ) -> Result<Option<PointerValue<'ctx>>> {
+        let Some(af) = self.async_frame.as_ref().filter(|_| self.in_async_body()) else {
+            return Ok(None);
+        };
+        if matches!(ty, BasicTypeEnum::ArrayType(_) | BasicTypeEnum::StructType(_)) {
+            return Ok(None);
+        }
+        // Every scalar gets an 8-byte slot, enough for a pointer on any target
+        let offset = af.size.get();
+        af.size.set(offset + 8);
+        let entry_builder = self.context.create_builder();
+        entry_builder.position_at_end(af.entry);
+        let idx = self.i32_type.const_int(offset, false);
+        let slot = unsafe { entry_builder.build_gep(self.context.i8_type(), af.frame, &[idx], name)? };
+        Ok(Some(slot))
+    }
+
+    // ── Array helpers ────────────────────────────────────────
+
+    fn compile_array_linear_index(
+        &mut self,
+        name: &str,
+        indices: &[Expr],
+    ) -> Result<IntValue<'ctx>> {
+        let (dim_size_allocas, const_dims) = {
+            let arr_info = self.arrays.get(name).unwrap();
+            (arr_info.dim_size_allocas.clone(), arr_info.const_dims.clone())
+        };
+
+        // Row-major linearization: linear = idx[0]; for d in 1..N: linear = linear * dim_sizes[d] + idx[d]
+        let first_idx = self.compile_expr(&indices[0], VarType::Integer)?.into_int_value();
+        let mut linear = first_idx;
+        for d in 1..indices.len() {
+            // Constant DIM bounds fold into the multiply; otherwise the size
+            // lives in an entry-block slot that mem2reg turns into an SSA value
+            let dim_size = match &const_dims {
+                Some(dims) => self.i32_type.const_int(dims[d] as u64, false),
+                None => self
+                    .builder
+                    .build_load(self.i32_type, dim_size_allocas[d], &format!("dsz_{d}"))?
+                    .into_int_value(),
+            };
+            linear = self.builder.build_int_mul(linear, dim_size, "lin_mul")?;
+            let idx_d = self.compile_expr(&indices[d], VarType::Integer)?.into_int_value();
+            linear = self.builder.build_int_add(linear, idx_d, "lin_add")?;
+        }
+        Ok(linear)
+    }
+
+    /// Allocate a stack slot in the current function's entry block, where
+    /// mem2reg can promote it to an SSA value that LLVM is free to hoist.
+    /// Inside an ASYNC body scalars go to the frame instead.
+    fn build_entry_alloca(
+        &self,
+        ty: BasicTypeEnum<'ctx>,
+        name: &str,
+    ) -> Result<PointerValue<'ctx>> {
+        if let Some(slot) = self.async_frame_slot(ty, name)? {
+            return Ok(slot);
+        }
+        let function = self.builder.get_insert_block().unwrap().get_parent().unwrap();
+        let entry = function.get_first_basic_block().unwrap();
+        let entry_builder = self.context.create_builder();
+        match entry.get_first_instruction() {
+            Some(first) => entry_builder.position_before(&first),
+            None => entry_builder.position_at_end(entry),
+        }
+        Ok(entry_builder.build_alloca(ty, name)?)
+    }
+
+    /// Integer value of a compile-time constant expression: literals, CONSTs
+    /// and + - * over them.
+    fn const_int_value(&self, expr: &Expr) -> Option<i64> {
+        match expr {
+            Expr::IntLiteral { value, .. } => Some(*value as i64),
+            Expr::Variable { name, .. } => self.const_ints.get(name).copied(),
+            Expr::UnaryOp {
+                op: UnaryOp::Neg,
+                operand,
+                ..
+            } => self.const_int_value(operand).map(|n| -n),
+            Expr::BinaryOp {
+                op, left, right, ..
+            } => {
+                let (l, r) = (self.const_int_value(left)?, self.const_int_value(right)?);
+                match op {
+                    BinOp::Add => l.checked_add(r),
+                    BinOp::Sub => l.checked_sub(r),
+                    BinOp::Mul => l.checked_mul(r),
+                    _ => None,
+                }
+            }
+            _ => None,
+        }
+    }
+
+    /// SINGLE value of a compile-time constant expression: literals, CONSTs,
+    /// + - * / over them, and the math built-ins of a constant. Folding uses
+    /// the exact functions even under `--fast-math`.
+    fn const_float_value(&self, expr: &Expr) -> Option<f32> {
+        match expr {
+            Expr::FloatLiteral { value, .. } => Some(*value),
+            Expr::IntLiteral { value, .. } => Some(*value as f32),
+            Expr::Variable { name, .. } => self
+                .const_floats
+                .get(name)
+                .copied()
+                .or_else(|| self.const_ints.get(name).map(|&n| n as f32)),
+            Expr::UnaryOp {
+                op: UnaryOp::Neg,
+                operand,
+                ..
+            } => self.const_float_value(operand).map(|x| -x),
+            Expr::BinaryOp {
+                op, left, right, ..
+            } => {
+                // Integer operands would need integer semantics (\, MOD, wrap)
+                if self.infer_expr_type(expr) != VarType::Float {
+                    return None;
+                }
+                let (l, r) = (self.const_float_value(left)?, self.const_float_value(right)?);
+                match op {
+                    BinOp::Add => Some(l + r),
+                    BinOp::Sub => Some(l - r),
+                    BinOp::Mul => Some(l * r),
+                    BinOp::Div => Some(l / r),
+                    _ => None,
+                }
+            }
+            Expr::FnCall { name, args, .. }
+                if args.len() == 1
+                    && !self.arrays.contains_key(name)
+                    && !self.user_functions.contains_key(name) =>
+            {
+                let x = self.const_float_value(&args[0])?;
+                let v = match name.to_uppercase().as_str() {
+                    "SQR" => x.sqrt(),
+                    "ABS" => x.abs(),
+                    "SIN" => x.sin(),
+                    "COS" => x.cos(),
+                    "TAN" => x.tan(),
+                    "ATN" => x.atan(),
+                    "LOG" => x.ln(),
+                    "EXP" => x.exp(),
+                    _ => return None,
+                };
+                Some(v)
+            }
+            _ => None,
         }
-        Ok(())
     }
 
-    fn ensure_var(&mut self, name: &str, vt: VarType) -> Result<()> {
-        if !self.variables.contains_key(name) {
-            let llvm_type = self.var_llvm_type(vt);
-            let alloca = self.builder.build_alloca(llvm_type, name)?;
-            self.variables.insert(name.to_string(), (alloca, vt));
+    /// Inclusive range of values an array index expression can take, if it
+    /// is built from constants and invariant FOR counters with + - *.
+    fn index_range(&self, expr: &Expr) -> Option<(i64, i64)> {
+        if let Some(n) = self.const_int_value(expr) {
+            return Some((n, n));
+        }
+        match expr {
+            Expr::Variable { name, .. } => self
+                .for_ranges
+                .iter()
+                .rev()
+                .find(|(var, _, _)| var == name)
+                .map(|&(_, lo, hi)| (lo, hi)),
+            Expr::BinaryOp {
+                op, left, right, ..
+            } => {
+                let (l, r) = (self.index_range(left)?, self.index_range(right)?);
+                match op {
+                    BinOp::Add => Some((l.0 + r.0, l.1 + r.1)),
+                    BinOp::Sub => Some((l.0 - r.1, l.1 - r.0)),
+                    BinOp::Mul => {
+                        let p = [l.0 * r.0, l.0 * r.1, l.1 * r.0, l.1 * r.1];
+                        Some((*p.iter().min()?, *p.iter().max()?))
+                    }
+                    _ => None,
+                }
+            }
+            _ => None,
         }
-        Ok(())
     }
 
-    // ── Array helpers ────────────────────────────────────────
+    /// Constant range of a FOR counter inside its body, if sema proved the
+    /// counter is not written there. Limited to exactly representable f32
+    /// integers, since the counter is stored as a float.
+    fn for_counter_range(
+        &self,
+        var: &str,
+        from: &Expr,
+        to: &Expr,
+        step: Option<&Expr>,
+        span: Span,
+    ) -> Option<(i64, i64)> {
+        if !self.sema.invariant_for_loops.contains(&span) {
+            return None;
+        }
+        if !matches!(self.variables.get(var), Some((_, VarType::Float))) {
+            return None;
+        }
+        if let Some(step) = step {
+            if self.const_int_value(step)? <= 0 {
+                return None;
+            }
+        }
+        let (lo, hi) = (self.const_int_value(from)?, self.const_int_value(to)?);
+        const EXACT: i64 = 1 << 24;
+        if lo.abs() >= EXACT || hi.abs() >= EXACT {
+            return None;
+        }
+        Some((lo, hi))
+    }
 
-    fn compile_array_linear_index(
+    /// Check `linear_idx` against the array size, unless bounds checks are
+    /// off or every index is provably within its dimension. The check is an
+    /// inline compare that branches to a cold panic block.
+    fn compile_array_bounds_check(
         &mut self,
         name: &str,
         indices: &[Expr],
-    ) -> Result<IntValue<'ctx>> {
-        let dim_size_allocas: Vec<PointerValue<'ctx>> =
-            self.arrays.get(name).unwrap().dim_size_allocas.clone();
+        linear_idx: IntValue<'ctx>,
+        total_alloca: PointerValue<'ctx>,
+    ) -> Result<()> {
+        if !self.bounds_checks {
+            return Ok(());
+        }
+        let const_dims = self.arrays.get(name).and_then(|a| a.const_dims.clone());
+        if let Some(dims) = &const_dims {
+            let proven = dims.len() == indices.len()
+                && indices.iter().zip(dims).all(|(idx, &size)| {
+                    matches!(self.index_range(idx), Some((lo, hi)) if lo >= 0 && hi < size)
+                });
+            if proven {
+                return Ok(());
+            }
+        }
 
-        // Row-major linearization: linear = idx[0]; for d in 1..N: linear = linear * dim_sizes[d] + idx[d]
-        let first_idx = self.compile_expr(&indices[0], VarType::Integer)?.into_int_value();
-        let mut linear = first_idx;
-        for d in 1..indices.len() {
-            let dim_size = self
+        let total = match &const_dims {
+            Some(dims) => self
+                .i32_type
+                .const_int(dims.iter().product::<i64>() as u64, false),
+            None => self
                 .builder
-                .build_load(self.i32_type, dim_size_allocas[d], &format!("dsz_{d}"))?
-                .into_int_value();
-            linear = self.builder.build_int_mul(linear, dim_size, "lin_mul")?;
-            let idx_d = self.compile_expr(&indices[d], VarType::Integer)?.into_int_value();
-            linear = self.builder.build_int_add(linear, idx_d, "lin_add")?;
-        }
-        Ok(linear)
+                .build_load(self.i32_type, total_alloca, "total_sz")?
+                .into_int_value(),
+        };
+        // Unsigned compare also rejects negative indices
+        let in_range =
+            self.builder
+                .build_int_compare(IntPredicate::ULT, linear_idx, total, "in_bounds")?;
+        let function = self.builder.get_insert_block().unwrap().get_parent().unwrap();
+        let oob_bb = self.context.append_basic_block(function, "bounds.fail");
+        let ok_bb = self.context.append_basic_block(function, "bounds.ok");
+        self.builder.build_conditional_branch(in_range, ok_bb, oob_bb)?;
+
+        self.builder.position_at_end(oob_bb);
+        self.builder.build_call(
+            self.rt_array_bounds_check.unwrap(),
+            &[linear_idx.into(), total.into()],
+            "",
+        )?;
+        self.builder.build_unreachable()?;
+
+        self.builder.position_at_end(ok_bb);
+        Ok(())
     }
 
     fn compile_array_read(
@@ -4420,17 +7465,7 @@ impl<'ctx> Codegen<'ctx> {
         };
 
         let linear_idx = self.compile_array_linear_index(name, indices)?;
-
-        // Bounds check
-        let total = self
-            .builder
-            .build_load(self.i32_type, total_alloca, "total_sz")?
-            .into_int_value();
-        self.builder.build_call(
-            self.rt_array_bounds_check.unwrap(),
-            &[linear_idx.into(), total.into()],
-            "",
-        )?;
+        self.compile_array_bounds_check(name, indices, linear_idx, total_alloca)?;
 
         // GEP to element
         let data_ptr = self
@@ -4529,34 +7564,10 @@ impl<'ctx> Codegen<'ctx> {
                     .build_int_z_extend(cmp, self.i32_type, "fcmp_ext")?)
             }
             VarType::String => {
-                let cmp_val = self
-                    .builder
-                    .build_call(
-                        self.rt_string_compare.unwrap(),
-                        &[
-                            BasicMetadataValueEnum::from(lhs.into_pointer_value()),
-                            BasicMetadataValueEnum::from(rhs.into_pointer_value()),
-                        ],
-                        "str_cmp",
-                    )?
-                    .try_as_basic_value()
-                    .left()
-                    .unwrap()
-                    .into_int_value();
-                let pred = match op {
-                    BinOp::Eq => IntPredicate::EQ,
-                    BinOp::Neq => IntPredicate::NE,
-                    BinOp::Lt => IntPredicate::SLT,
-                    BinOp::Gt => IntPredicate::SGT,
-                    BinOp::Le => IntPredicate::SLE,
-                    BinOp::Ge => IntPredicate::SGE,
-                    _ => IntPredicate::EQ,
-                };
-                let result = self.builder.build_int_compare(
-                    pred,
-                    cmp_val,
-                    self.i32_type.const_zero(),
-                    "scmp",
+                let result = self.compile_string_compare(
+                    op,
+                    lhs.into_pointer_value(),
+                    rhs.into_pointer_value(),
                 )?;
                 Ok(self
                     .builder
@@ -4576,6 +7587,255 @@ impl<'ctx> Codegen<'ctx> {
             .build_int_compare(IntPredicate::NE, int_val, zero, "cond")?)
     }
 
+    /// If `expr` is `name + rhs` with `name` as the left operand, return `rhs`.
+    fn self_append_operand<'e>(name: &str, expr: &'e Expr) -> Option<&'e Expr> {
+        match expr {
+            Expr::BinaryOp {
+                op: BinOp::Add,
+                left,
+                right,
+                ..
+            } => match left.as_ref() {
+                Expr::Variable { name: lhs, .. } if lhs == name => Some(right.as_ref()),
+                _ => None,
+            },
+            _ => None,
+        }
+    }
+
+    /// A string parameter borrows the caller's reference unless its body
+    /// appends to it in place, or `body_may_free_strings` shows the body can
+    /// free a string the caller still points at (e.g. `CALL S(A$(i))` where
+    /// S stores into a string array). Those take their own reference, with
+    /// the retain placed before the parameter's store in the prologue.
+    /// Restores the enclosing body's flag.
+    fn own_string_params(
+        &mut self,
+        borrowed: &[(InstructionValue<'ctx>, BasicValueEnum<'ctx>, bool)],
+        saved_may_free: bool,
+    ) -> Result<()> {
+        let may_free = std::mem::replace(&mut self.body_may_free_strings, saved_may_free);
+        let resume = self.builder.get_insert_block();
+        for &(store, val, appends) in borrowed {
+            if may_free || appends {
+                self.builder.position_before(&store);
+                self.retain_string(val)?;
+            }
+        }
+        if let Some(bb) = resume {
+            self.builder.position_at_end(bb);
+        }
+        Ok(())
+    }
+
+    /// Whether `body` contains `name$ = name$ + ...`, the only statement that
+    /// extends a string in place.
+    fn body_appends_to(body: &[Statement], name: &str) -> bool {
+        body.iter().any(|stmt| match stmt {
+            Statement::Let {
+                name: target, expr, ..
+            } => target == name && Self::self_append_operand(name, expr).is_some(),
+            Statement::If {
+                then_body,
+                else_if_clauses,
+                else_body,
+                ..
+            } => {
+                Self::body_appends_to(then_body, name)
+                    || else_if_clauses
+                        .iter()
+                        .any(|c| Self::body_appends_to(&c.body, name))
+                    || Self::body_appends_to(else_body, name)
+            }
+            Statement::SelectCase {
+                cases, else_body, ..
+            } => {
+                cases.iter().any(|c| Self::body_appends_to(&c.body, name))
+                    || Self::body_appends_to(else_body, name)
+            }
+            Statement::TryCatch {
+                try_body,
+                catch_body,
+                ..
+            } => Self::body_appends_to(try_body, name) || Self::body_appends_to(catch_body, name),
+            Statement::For { body, .. }
+            | Statement::DoLoop { body, .. }
+            | Statement::While { body, .. }
+            | Statement::ForEach { body, .. }
+            | Statement::Task { body, .. }
+            | Statement::Spawn { body, .. }
+            | Statement::Async { body, .. } => Self::body_appends_to(body, name),
+            _ => false,
+        })
+    }
+
+    /// Whether a body contains a TRY block at any depth.
+    fn body_has_try(body: &[Statement]) -> bool {
+        body.iter().any(|stmt| match stmt {
+            Statement::TryCatch { .. } => true,
+            Statement::If {
+                then_body,
+                else_if_clauses,
+                else_body,
+                ..
+            } => {
+                Self::body_has_try(then_body)
+                    || else_if_clauses.iter().any(|c| Self::body_has_try(&c.body))
+                    || Self::body_has_try(else_body)
+            }
+            Statement::SelectCase {
+                cases, else_body, ..
+            } => cases.iter().any(|c| Self::body_has_try(&c.body)) || Self::body_has_try(else_body),
+            Statement::For { body, .. }
+            | Statement::DoLoop { body, .. }
+            | Statement::While { body, .. }
+            | Statement::ForEach { body, .. }
+            | Statement::Task { body, .. }
+            | Statement::Spawn { body, .. }
+            | Statement::Async { body, .. } => Self::body_has_try(body),
+            _ => false,
+        })
+    }
+
+    /// PRINT a string expression. A chain of `+` concatenations is printed
+    /// piece by piece, so the temporary concatenated string is never built.
+    fn compile_print_string(&mut self, expr: &Expr) -> Result<()> {
+        if let Expr::BinaryOp {
+            op: BinOp::Add,
+            left,
+            right,
+            ..
+        } = expr
+        {
+            if self.infer_expr_type(left) == VarType::String
+                && self.infer_expr_type(right) == VarType::String
+            {
+                self.compile_print_string(left)?;
+                return self.compile_print_string(right);
+            }
+        }
+        let val = self.compile_expr(expr, VarType::String)?;
+        self.builder.build_call(
+            self.rt_print_string.unwrap(),
+            &[BasicMetadataValueEnum::from(val.into_pointer_value())],
+            "",
+        )?;
+        Ok(())
+    }
+
+    fn retain_string(&mut self, val: BasicValueEnum<'ctx>) -> Result<()> {
+        self.builder.build_call(
+            self.rt_string_retain.unwrap(),
+            &[BasicMetadataValueEnum::from(val.into_pointer_value())],
+            "",
+        )?;
+        Ok(())
+    }
+
+    /// Take a new reference when storing a string that another variable or
+    /// array element still holds, so refcount 1 really means uniquely owned
+    /// and `rb_string_append` may extend it in place.
+    fn retain_if_aliased(&mut self, expr: &Expr, val: BasicValueEnum<'ctx>) -> Result<()> {
+        match expr {
+            Expr::Variable { .. } | Expr::FieldAccess { .. } | Expr::ArrayAccess { .. }
+                if val.is_pointer_value() =>
+            {
+                self.retain_string(val)
+            }
+            _ => Ok(()),
+        }
+    }
+
+    /// Compare two strings for a relational operator, yielding an i1.
+    /// `=` and `<>` use rb_string_equal, which rejects strings of different
+    /// lengths without touching their bytes.
+    fn compile_string_compare(
+        &mut self,
+        op: BinOp,
+        lhs: PointerValue<'ctx>,
+        rhs: PointerValue<'ctx>,
+    ) -> Result<IntValue<'ctx>> {
+        let (func, pred) = match op {
+            BinOp::Neq => (self.rt_string_equal.unwrap(), IntPredicate::EQ),
+            BinOp::Lt => (self.rt_string_compare.unwrap(), IntPredicate::SLT),
+            BinOp::Gt => (self.rt_string_compare.unwrap(), IntPredicate::SGT),
+            BinOp::Le => (self.rt_string_compare.unwrap(), IntPredicate::SLE),
+            BinOp::Ge => (self.rt_string_compare.unwrap(), IntPredicate::SGE),
+            _ => (self.rt_string_equal.unwrap(), IntPredicate::NE),
+        };
+        let cmp = self
+            .builder
+            .build_call(func, &[lhs.into(), rhs.into()], "str_cmp")?
+            .try_as_basic_value()
+            .left()
+            .unwrap()
+            .into_int_value();
+        Ok(self
+            .builder
+            .build_int_compare(pred, cmp, self.i32_type.const_zero(), "scmp")?)
+    }
+
+    /// Return a pointer to an immortal `rb_string_t` for a literal.
+    ///
+    /// The string is emitted once per distinct text as a constant global laid
+    /// out like the runtime struct (`{refcount, length, capacity, data, parent}`
+    /// followed by the bytes) with the `RB_STRING_IMMORTAL` refcount, so it
+    /// lives in rodata and the runtime never retains, releases or frees it.
+    fn string_literal(&mut self, value: &str) -> PointerValue<'ctx> {
+        if let Some(ptr) = self.string_literals.get(value) {
+            return *ptr;
+        }
+        let bytes = value.as_bytes();
+        let data_type = self.context.i8_type().array_type(bytes.len() as u32 + 1);
+        // Mirrors rb_string_t: {refcount, length, capacity, data, parent}
+        // followed by the bytes that `data` points at.
+        let struct_type = self.context.struct_type(
+            &[
+                self.i32_type.into(),
+                self.i32_type.into(),
+                self.i32_type.into(),
+                self.ptr_type.into(),
+                self.ptr_type.into(),
+                data_type.into(),
+            ],
+            false,
+        );
+        let global = self.module.add_global(
+            struct_type,
+            None,
+            &format!("rb_str_lit_{}", self.string_literals.len()),
+        );
+        let ptr = global.as_pointer_value();
+        let data_ptr = unsafe {
+            ptr.const_in_bounds_gep(
+                struct_type,
+                &[
+                    self.i32_type.const_zero(),
+                    self.i32_type.const_int(5, false),
+                ],
+            )
+        };
+        let init = self.context.const_struct(
+            &[
+                self.i32_type
+                    .const_int(RB_STRING_IMMORTAL as u64, true)
+                    .into(),
+                self.i32_type.const_int(bytes.len() as u64, false).into(),
+                self.i32_type.const_int(bytes.len() as u64, false).into(),
+                data_ptr.into(),
+                self.ptr_type.const_null().into(),
+                self.context.const_string(bytes, true).into(),
+            ],
+            false,
+        );
+        global.set_initializer(&init);
+        global.set_constant(true);
+        global.set_unnamed_addr(true);
+        global.set_linkage(Linkage::Private);
+        self.string_literals.insert(value.to_string(), ptr);
+        ptr
+    }
+
     // ── Expression compilation ──────────────────────────────
 
     fn compile_expr(
@@ -4607,21 +7867,7 @@ impl<'ctx> Codegen<'ctx> {
                 }
             }
             Expr::StringLiteral { value, .. } => {
-                let global = self
-                    .builder
-                    .build_global_string_ptr(value, "str_lit")?;
-                let ptr = global.as_pointer_value();
-                let result = self
-                    .builder
-                    .build_call(
-                        self.rt_string_alloc.unwrap(),
-                        &[BasicMetadataValueEnum::from(ptr)],
-                        "str_val",
-                    )?
-                    .try_as_basic_value()
-                    .left()
-                    .unwrap();
-                Ok(result)
+                Ok(self.string_literal(value).as_basic_value_enum())
             }
             Expr::Variable {
                 name, var_type, ..
@@ -4641,6 +7887,11 @@ impl<'ctx> Codegen<'ctx> {
                     let llvm_type = self.var_llvm_type(stored_vt);
                     let val = self.builder.build_load(llvm_type, alloca, name)?;
                     self.coerce_value(val, stored_vt, target_type)
+                } else if let Some(&n) = self.const_ints.get(name) {
+                    // Integer CONSTs stay visible in TASK bodies, which start
+                    // with a fresh variable map
+                    let val = self.i32_type.const_int(n as u64, true);
+                    self.coerce_value(val.as_basic_value_enum(), VarType::Integer, target_type)
                 } else {
                     let vt = Self::qb_to_var(var_type);
                     match vt {
@@ -4698,6 +7949,7 @@ impl<'ctx> Codegen<'ctx> {
                     return self.compile_array_read(name, args, target_type);
                 }
                 if let Some(&func) = self.user_functions.get(name) {
+                    self.body_may_free_strings = true;
                     let mut arg_vals: Vec<BasicMetadataValueEnum> = Vec::new();
                     let param_types = func.get_type().get_param_types();
                     for (i, arg) in args.iter().enumerate() {
@@ -4817,15 +8069,23 @@ impl<'ctx> Codegen<'ctx> {
                         }
                         // Math built-in functions: (f32) -> f32
                         "SQR" | "ABS" | "SIN" | "COS" | "TAN" | "ATN" | "LOG" | "EXP" => {
+                            if let Some(v) = self.const_float_value(expr) {
+                                return Ok(self.f32_type.const_float(v as f64).as_basic_value_enum());
+                            }
                             let x = self.compile_expr(&args[0], VarType::Float)?;
+                            let fast = self.fast_math;
                             let func = match upper.as_str() {
                                 "SQR" => self.rt_fn_sqr.unwrap(),
                                 "ABS" => self.rt_fn_abs.unwrap(),
+                                "SIN" if fast => self.rt_fn_sin_fast.unwrap(),
                                 "SIN" => self.rt_fn_sin.unwrap(),
+                                "COS" if fast => self.rt_fn_cos_fast.unwrap(),
                                 "COS" => self.rt_fn_cos.unwrap(),
                                 "TAN" => self.rt_fn_tan.unwrap(),
                                 "ATN" => self.rt_fn_atn.unwrap(),
+                                "LOG" if fast => self.rt_fn_log_fast.unwrap(),
                                 "LOG" => self.rt_fn_log.unwrap(),
+                                "EXP" if fast => self.rt_fn_exp_fast.unwrap(),
                                 "EXP" => self.rt_fn_exp.unwrap(),
                                 _ => unreachable!(),
                             };
@@ -4998,32 +8258,7 @@ impl<'ctx> Codegen<'ctx> {
                     Ok(result)
                 }
                 BinOp::Eq | BinOp::Neq | BinOp::Lt | BinOp::Gt | BinOp::Le | BinOp::Ge => {
-                    let cmp = self
-                        .builder
-                        .build_call(
-                            self.rt_string_compare.unwrap(),
-                            &[lhs.into(), rhs.into()],
-                            "str_cmp",
-                        )?
-                        .try_as_basic_value()
-                        .left()
-                        .unwrap()
-                        .into_int_value();
-                    let pred = match op {
-                        BinOp::Eq => IntPredicate::EQ,
-                        BinOp::Neq => IntPredicate::NE,
-                        BinOp::Lt => IntPredicate::SLT,
-                        BinOp::Gt => IntPredicate::SGT,
-                        BinOp::Le => IntPredicate::SLE,
-                        BinOp::Ge => IntPredicate::SGE,
-                        _ => unreachable!(),
-                    };
-                    let result = self.builder.build_int_compare(
-                        pred,
-                        cmp,
-                        self.i32_type.const_zero(),
-                        "scmp",
-                    )?;
+                    let result = self.compile_string_compare(op, lhs, rhs)?;
                     Ok(self
                         .builder
                         .build_int_z_extend(result, self.i32_type, "scmp_ext")?
@@ -5159,6 +8394,29 @@ impl<'ctx> Codegen<'ctx> {
         }
     }
 
+    /// A DIM'd array's storage, element count and element type, for the
+    /// statements that hand a whole array to the runtime.
+    fn array_data(&mut self, name: &str) -> Result<Option<(BasicValueEnum<'ctx>, BasicValueEnum<'ctx>, VarType)>> {
+        let Some(arr_info) = self.arrays.get(name) else {
+            return Ok(None);
+        };
+        let data_alloca = arr_info.data_ptr_alloca;
+        let total_alloca = arr_info.total_size_alloca;
+        let element_vt = arr_info.element_vt;
+        let data = self.builder.build_load(self.ptr_type, data_alloca, "array_buf")?;
+        let total = self.builder.build_load(self.i32_type, total_alloca, "array_len")?;
+        Ok(Some((data, total, element_vt)))
+    }
+
+    /// Store a runtime result of type `from` into a target variable.
+    fn store_result(&mut self, target: &str, var_type: &QBType, val: BasicValueEnum<'ctx>, from: VarType) -> Result<()> {
+        self.ensure_var(target, Self::qb_to_var(var_type))?;
+        let (alloca, vt) = *self.variables.get(target).unwrap();
+        let val = self.coerce_value(val, from, vt)?;
+        self.builder.build_store(alloca, val)?;
+        Ok(())
+    }
+
     fn compile_expr_as_i32(&mut self, expr: &Expr) -> Result<IntValue<'ctx>> {
         let val = self.compile_expr(expr, VarType::Integer)?;
         Ok(val.into_int_value())
@@ -5278,29 +8536,89 @@ impl<'ctx> Codegen<'ctx> {
 
     // ── IR and object file output ───────────────────────────
 
+    /// Enable or disable array bounds checks (`--no-bounds-check`).
+    pub fn set_bounds_checks(&mut self, enabled: bool) {
+        self.bounds_checks = enabled;
+    }
+
+    /// Use the table-driven SIN/COS/EXP/LOG (`--fast-math`).
+    pub fn set_fast_math(&mut self, enabled: bool) {
+        self.fast_math = enabled;
+    }
+
+    /// Instrument SUB/FUNCTION entry and exit and start the profiler at
+    /// program start (`--profile`).
+    pub fn set_profile(&mut self, enabled: bool) {
+        self.profile = enabled;
+    }
+
+    /// Select the optimization pipeline run by `optimize` and
+    /// `write_object_file`.
+    pub fn set_opt_level(&mut self, level: OptLevel) {
+        self.opt_level = level;
+    }
+
     pub fn dump_ir(&self) -> String {
         self.module.print_to_string().to_string()
     }
 
     pub fn write_object_file(&self, path: &Path) -> Result<()> {
+        let machine = self.create_target_machine()?;
+        self.run_passes(&machine)?;
+        machine
+            .write_to_file(&self.module, FileType::Object, path)
+            .map_err(|e| anyhow::anyhow!("failed to write object file: {}", e))?;
+        Ok(())
+    }
+
+    /// Optimize and emit the object into memory, as `write_object_file`
+    /// would, and return its size; `bench` times the whole back end this way.
+    pub fn emit_object_in_memory(&self) -> Result<usize> {
+        let machine = self.create_target_machine()?;
+        self.run_passes(&machine)?;
+        let buffer = machine
+            .write_to_memory_buffer(&self.module, FileType::Object)
+            .map_err(|e| anyhow::anyhow!("failed to emit object: {}", e))?;
+        Ok(buffer.get_size())
+    }
+
+    /// Run the selected optimization pipeline on the module in place.
+    pub fn optimize(&self) -> Result<()> {
+        let machine = self.create_target_machine()?;
+        self.run_passes(&machine)
+    }
+
+    fn run_passes(&self, machine: &TargetMachine) -> Result<()> {
+        if self.opt_level == OptLevel::O0 {
+            return Ok(());
+        }
+        let options = PassBuilderOptions::create();
+        let speed = !self.opt_level.optimizes_for_size();
+        options.set_loop_unrolling(speed);
+        options.set_loop_vectorization(speed);
+        options.set_loop_slp_vectorization(speed);
+        options.set_loop_interleaving(speed);
+        options.set_merge_functions(!speed);
+        self.module
+            .run_passes(self.opt_level.pipeline(), machine, options)
+            .map_err(|e| anyhow::anyhow!("optimization pipeline failed: {}", e))
+    }
+
+    fn create_target_machine(&self) -> Result<TargetMachine> {
         self.init_target()?;
         let triple = TargetTriple::create(&self.target_config.triple);
         let target = Target::from_triple(&triple)
             .map_err(|e| anyhow::anyhow!("failed to get target: {}", e))?;
-        let machine = target
+        target
             .create_target_machine(
                 &triple,
                 &self.target_config.cpu,
                 &self.target_config.features,
-                OptimizationLevel::Default,
+                self.opt_level.codegen_level(),
                 RelocMode::PIC,
                 CodeModel::Small,
             )
-            .context("failed to create target machine")?;
-        machine
-            .write_to_file(&self.module, FileType::Object, path)
-            .map_err(|e| anyhow::anyhow!("failed to write object file: {}", e))?;
-        Ok(())
+            .context("failed to create target machine")
     }
 
     fn init_target(&self) -> Result<()> {
@@ -5318,3 +8636,139 @@ impl<'ctx> Codegen<'ctx> {
 pub fn init_all_targets() {
     Target::initialize_all(&InitializationConfig::default());
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use rustybasic_lexer::tokenize;
+    use rustybasic_parser::parse;
+
+    fn compile_str(input: &str) -> String {
+        let tokens = tokenize(input).expect("lex error");
+        let program = parse(tokens).expect("parse error");
+        let sema = rustybasic_sema::analyze(&program);
+        assert!(!sema.has_errors(), "errors: {:?}", sema.errors);
+        let context = LlvmContext::create();
+        let mut codegen = Codegen::new(&context, "test", TargetConfig::esp32c3(), sema);
+        codegen.compile(&program).expect("codegen error");
+        codegen.dump_ir()
+    }
+
+    fn compile_fast_math(input: &str) -> String {
+        let tokens = tokenize(input).expect("lex error");
+        let program = parse(tokens).expect("parse error");
+        let sema = rustybasic_sema::analyze(&program);
+        assert!(!sema.has_errors(), "errors: {:?}", sema.errors);
+        let context = LlvmContext::create();
+        let mut codegen = Codegen::new(&context, "test", TargetConfig::esp32c3(), sema);
+        codegen.set_fast_math(true);
+        codegen.compile(&program).expect("codegen error");
+        codegen.dump_ir()
+    }
+
+    fn function_ir<'a>(ir: &'a str, name: &str) -> &'a str {
+        let signature = format!("@{name}(");
+        let body = ir
+            .split("\ndefine ")
+            .find(|f| f.lines().next().is_some_and(|l| l.contains(&signature)))
+            .expect("function not found");
+        &body[..body.find("\n}\n").unwrap_or(body.len())]
+    }
+
+    // ── TRY/CATCH tests ──────────────────────────────────────
+
+    #[test]
+    fn test_exit_sub_closes_try() {
+        // The TRY left by EXIT SUB must be closed: left open, it would catch
+        // a later rb_throw outside any TRY instead of letting it abort
+        let ir = compile_str("SUB Leave\nTRY\nEXIT SUB\nCATCH e\nEND TRY\nEND SUB\nCALL Leave");
+        let sub = function_ir(&ir, "qb_sub_leave");
+        assert!(sub.contains("call void @rb_try_end()\n  br label %exit"), "{sub}");
+        assert_eq!(sub.matches("call void @rb_try_begin()").count(), 1);
+        assert_eq!(sub.matches("call void @rb_try_end()").count(), 2);
+    }
+
+    #[test]
+    fn test_error_flag_is_local_exec_tls() {
+        let ir = compile_str("TRY\nPRINT 1\nCATCH e\nEND TRY");
+        assert!(
+            ir.contains("@rb_error_pending = external thread_local(localexec) global i32"),
+            "{ir}"
+        );
+    }
+
+    #[test]
+    fn test_loop_condition_checks_error() {
+        // A throw in the condition must reach the CATCH, not spin the loop
+        let ir = compile_str(
+            "FUNCTION F () AS INTEGER\nF = 0\nEND FUNCTION\n\
+             TRY\nDO UNTIL F()\nLOOP\nCATCH e\nEND TRY",
+        );
+        let cond = &ir[ir.find("\ndo.cond:").expect("no do.cond")..];
+        let cond = &cond[..cond.find("\ndo.body:").unwrap_or(cond.len())];
+        assert!(cond.contains("@rb_error_pending"), "{cond}");
+    }
+
+    #[test]
+    fn test_exit_for_closes_inner_try_only() {
+        let ir = compile_str(
+            "TRY\nFOR I = 1 TO 3\nTRY\nEXIT FOR\nCATCH e\nEND TRY\nNEXT I\n\
+             CATCH f\nEND TRY",
+        );
+        assert!(ir.contains("call void @rb_try_end()\n  br label %for.after"), "{ir}");
+        assert!(!ir.contains("call void @rb_try_end()\n  call void @rb_try_end()\n  br label %for.after"));
+    }
+
+    // ── Parameter ownership tests ────────────────────────────
+
+    #[test]
+    fn test_string_param_owned_when_body_stores_array_element() {
+        // S's parameter may be the caller's A$(i); storing into a string
+        // array could free it, so S must hold its own reference
+        let ir = compile_str(
+            "SUB S (p AS STRING)\nDIM b$(2)\nb$(1) = \"x\"\nPRINT p\nEND SUB\n\
+             DIM a$(2)\na$(1) = \"y\"\nCALL S(a$(1))",
+        );
+        let sub = function_ir(&ir, "qb_sub_s");
+        assert!(sub.contains("call void @rb_string_retain("), "{sub}");
+    }
+
+    #[test]
+    fn test_string_param_borrowed_when_body_frees_nothing() {
+        let ir = compile_str("SUB S (p AS STRING)\nPRINT p\nEND SUB\nCALL S(\"y\")");
+        let sub = function_ir(&ir, "qb_sub_s");
+        assert!(!sub.contains("@rb_string_retain("), "{sub}");
+    }
+
+    // ── Math tests ───────────────────────────────────────────
+
+    #[test]
+    fn test_fast_math_folds_constant_calls() {
+        // SIN over a CONST is folded at compile time; only the call on a
+        // variable reaches the table-driven version
+        let ir = compile_fast_math("CONST A = 0.5\nx! = SIN(A)\ny! = SIN(x!)\nPRINT x!, y!");
+        assert_eq!(ir.matches("call float @rb_fn_sin_fast(").count(), 1, "{ir}");
+        let folded = format!("store float {:#X}", f64::from(0.5f32.sin()).to_bits());
+        assert!(ir.contains(&folded), "{folded} not in {ir}");
+    }
+
+    // ── ASYNC tests ──────────────────────────────────────────
+
+    #[test]
+    fn test_async_http_get_suspends() {
+        let ir = compile_str("ASYNC\nHTTP.GET \"http://x\", r$\nPRINT r$\nEND ASYNC\nHTTP.GET \"http://y\", s$");
+        assert!(ir.contains("call ptr @rb_async_io_begin(i32 0"), "{ir}");
+        assert!(ir.contains("ret i32 -2"), "{ir}");
+        // Outside ASYNC the call still blocks the calling task
+        assert_eq!(ir.matches("call ptr @rb_http_get(").count(), 1);
+    }
+
+    #[test]
+    fn test_async_done_releases_frame_strings() {
+        let ir = compile_str("ASYNC\nHTTP.GET \"http://x\", r$\nPRINT r$\nEND ASYNC");
+        let step = function_ir(&ir, "rb_async_step_0");
+        let exit = &step[step.find("\nexit:").expect("no exit block")..];
+        assert!(exit.contains("call void @rb_string_release("), "{exit}");
+        assert!(exit.contains("ret i32 -1"), "{exit}");
+    }
+}
@@ -1,6 +1,9 @@
+use std::collections::hash_map::DefaultHasher;
 use std::collections::HashSet;
+use std::hash::{Hash, Hasher};
 use std::path::{Path, PathBuf};
 use std::process::Command;
+use std::time::{Duration, Instant};
 
 use anyhow::{Context, Result};
 use clap::{Parser, Subcommand};
@@ -8,7 +11,7 @@ use codespan_reporting::files::SimpleFiles;
 use codespan_reporting::term;
 use codespan_reporting::term::termcolor::{ColorChoice, StandardStream};
 
-use rustybasic_codegen::{init_all_targets, Codegen, TargetConfig};
+use rustybasic_codegen::{init_all_targets, Codegen, OptLevel, TargetConfig};
 use rustybasic_lexer::tokenize;
 use rustybasic_parser::parse;
 use rustybasic_sema::analyze;
@@ -21,6 +24,22 @@ struct Cli {
     /// Input .bas source file
     source: PathBuf,
 
+    /// Omit array bounds checks (an out-of-range index is then undefined behavior)
+    #[arg(long, global = true)]
+    no_bounds_check: bool,
+
+    /// Use faster, slightly less accurate SIN, COS, EXP and LOG (about 2-3 ulp)
+    #[arg(long, global = true)]
+    fast_math: bool,
+
+    /// Count calls and CPU cycles per SUB/FUNCTION (see PROFILE.DUMP)
+    #[arg(long, global = true)]
+    profile: bool,
+
+    /// Always compile, without looking in or adding to the object cache
+    #[arg(long, global = true)]
+    no_cache: bool,
+
     #[command(subcommand)]
     command: Commands,
 }
@@ -35,6 +54,10 @@ enum Commands {
         /// Target: "esp32c3" or "host"
         #[arg(long, default_value = "host")]
         target: String,
+
+        /// Optimization level: 0, 1, 2, 3, s or z (IR is dumped unoptimized by default)
+        #[arg(short = 'O', default_value = "0")]
+        opt_level: OptLevel,
     },
 
     /// Compile to object file
@@ -46,6 +69,10 @@ enum Commands {
         /// Target: "esp32c3" or "host"
         #[arg(long, default_value = "esp32c3")]
         target: String,
+
+        /// Optimization level: 0, 1, 2, 3, s (size) or z (smallest size)
+        #[arg(short = 'O', default_value = "2")]
+        opt_level: OptLevel,
     },
 
     /// Build ESP-IDF firmware (requires esp-idf toolchain)
@@ -53,6 +80,25 @@ enum Commands {
         /// ESP-IDF project directory
         #[arg(long, default_value = "esp-project")]
         project_dir: PathBuf,
+
+        /// Optimization level: 0, 1, 2, 3, s (size) or z (smallest size)
+        #[arg(short = 'O', default_value = "2")]
+        opt_level: OptLevel,
+    },
+
+    /// Time each compiler phase on the source and print `BENCH` lines
+    Bench {
+        /// Runs of each phase; the median is reported
+        #[arg(long, default_value = "20")]
+        runs: u32,
+
+        /// Target: "esp32c3" or "host"
+        #[arg(long, default_value = "esp32c3")]
+        target: String,
+
+        /// Optimization level: 0, 1, 2, 3, s (size) or z (smallest size)
+        #[arg(short = 'O', default_value = "2")]
+        opt_level: OptLevel,
     },
 
     /// Flash firmware to device
@@ -73,6 +119,35 @@ fn main() -> Result<()> {
     let source = resolve_includes(&cli.source, &mut HashSet::new())
         .with_context(|| format!("failed to read {}", cli.source.display()))?;
 
+    // An unchanged program (INCLUDEs and all) with the same options has
+    // been compiled before: reuse its object and skip the whole pipeline
+    let cache = match &cli.command {
+        Commands::Build { target, opt_level, .. } => ObjectCache::new(&cli, &source, target, *opt_level),
+        Commands::Firmware { opt_level, .. } => ObjectCache::new(&cli, &source, "esp32c3", *opt_level),
+        _ => None,
+    };
+    if let Some(cached) = cache.as_ref().and_then(ObjectCache::lookup) {
+        match &cli.command {
+            Commands::Build { output, .. } => {
+                let output = output.clone().unwrap_or_else(|| cli.source.with_extension("o"));
+                std::fs::copy(&cached, &output)
+                    .with_context(|| format!("failed to write {}", output.display()))?;
+                println!("Compiled to {} (cached)", output.display());
+            }
+            Commands::Firmware { project_dir, .. } => {
+                let obj_path = project_dir.join("main").join("basic_program.o");
+                let fresh = obj_path.with_extension("o.new");
+                std::fs::copy(&cached, &fresh)
+                    .with_context(|| format!("failed to write {}", fresh.display()))?;
+                let changed = replace_if_changed(&fresh, &obj_path)?;
+                println!("Object file: {} (cached{})", obj_path.display(), if changed { "" } else { ", unchanged" });
+                idf_build(project_dir)?;
+            }
+            _ => unreachable!(),
+        }
+        return Ok(());
+    }
+
     let mut files = SimpleFiles::new();
     let file_id = files.add(cli.source.display().to_string(), source.clone());
 
@@ -128,7 +203,7 @@ fn main() -> Result<()> {
         Commands::Check => {
             println!("OK: {} syntax and types valid", cli.source.display());
         }
-        Commands::DumpIr { target } => {
+        Commands::DumpIr { target, opt_level } => {
             init_all_targets();
             let target_config = parse_target(&target)?;
             let context = inkwell::context::Context::create();
@@ -138,10 +213,19 @@ fn main() -> Result<()> {
                 target_config,
                 sema_result,
             );
+            codegen.set_bounds_checks(!cli.no_bounds_check);
+            codegen.set_fast_math(cli.fast_math);
+            codegen.set_profile(cli.profile);
+            codegen.set_opt_level(opt_level);
             codegen.compile(&program)?;
+            codegen.optimize()?;
             println!("{}", codegen.dump_ir());
         }
-        Commands::Build { output, target } => {
+        Commands::Build {
+            output,
+            target,
+            opt_level,
+        } => {
             init_all_targets();
             let target_config = parse_target(&target)?;
             let output = output.unwrap_or_else(|| cli.source.with_extension("o"));
@@ -152,11 +236,21 @@ fn main() -> Result<()> {
                 target_config,
                 sema_result,
             );
+            codegen.set_bounds_checks(!cli.no_bounds_check);
+            codegen.set_fast_math(cli.fast_math);
+            codegen.set_profile(cli.profile);
+            codegen.set_opt_level(opt_level);
             codegen.compile(&program)?;
             codegen.write_object_file(&output)?;
+            if let Some(cache) = &cache {
+                cache.store(&output);
+            }
             println!("Compiled to {}", output.display());
         }
-        Commands::Firmware { project_dir } => {
+        Commands::Firmware {
+            project_dir,
+            opt_level,
+        } => {
             init_all_targets();
             let target_config = TargetConfig::esp32c3();
             let obj_path = project_dir.join("main").join("basic_program.o");
@@ -168,21 +262,28 @@ fn main() -> Result<()> {
                 target_config,
                 sema_result,
             );
+            codegen.set_bounds_checks(!cli.no_bounds_check);
+            codegen.set_fast_math(cli.fast_math);
+            codegen.set_profile(cli.profile);
+            codegen.set_opt_level(opt_level);
             codegen.compile(&program)?;
-            codegen.write_object_file(&obj_path)?;
-            println!("Object file: {}", obj_path.display());
-
-            // Invoke idf.py build
-            let status = Command::new("idf.py")
-                .current_dir(&project_dir)
-                .args(["build"])
-                .status()
-                .context("failed to run idf.py — is ESP-IDF installed?")?;
-
-            if !status.success() {
-                anyhow::bail!("idf.py build failed");
+            let fresh = obj_path.with_extension("o.new");
+            codegen.write_object_file(&fresh)?;
+            if let Some(cache) = &cache {
+                cache.store(&fresh);
             }
-            println!("Firmware built successfully!");
+            let changed = replace_if_changed(&fresh, &obj_path)?;
+            println!("Object file: {}{}", obj_path.display(), if changed { "" } else { " (unchanged)" });
+            idf_build(&project_dir)?;
+        }
+        Commands::Bench {
+            runs,
+            ref target,
+            opt_level,
+        } => {
+            init_all_targets();
+            let target_config = parse_target(target)?;
+            bench_compile(&cli, &source, target_config, opt_level, runs.max(1))?;
         }
         Commands::Flash { port, project_dir } => {
             let status = Command::new("idf.py")
@@ -201,6 +302,213 @@ fn main() -> Result<()> {
     Ok(())
 }
 
+fn idf_build(project_dir: &Path) -> Result<()> {
+    let status = Command::new("idf.py")
+        .current_dir(project_dir)
+        .args(["build"])
+        .status()
+        .context("failed to run idf.py — is ESP-IDF installed?")?;
+
+    if !status.success() {
+        anyhow::bail!("idf.py build failed");
+    }
+    println!("Firmware built successfully!");
+    Ok(())
+}
+
+/// Move `fresh` over `dest` unless `dest` already has the same bytes, in
+/// which case `dest` (and its timestamp) is left alone, so idf.py sees
+/// nothing new to link. Returns whether `dest` changed.
+fn replace_if_changed(fresh: &Path, dest: &Path) -> Result<bool> {
+    let new_bytes = std::fs::read(fresh).with_context(|| format!("failed to read {}", fresh.display()))?;
+    if std::fs::read(dest).map_or(false, |old| old == new_bytes) {
+        std::fs::remove_file(fresh).ok();
+        return Ok(false);
+    }
+    std::fs::rename(fresh, dest).with_context(|| format!("failed to write {}", dest.display()))?;
+    Ok(true)
+}
+
+/// Objects of earlier builds in `.rustybasic-cache/` next to the source,
+/// keyed by everything that goes into them: the source with its INCLUDEs
+/// resolved, the target, the optimization level and flags, and the compiler
+/// binary itself (version, size and modification time), so a rebuilt
+/// compiler never reuses objects of the old one. Files are named by a hash
+/// of that key material, and the material itself is kept next to each
+/// object and compared on lookup, so a hash collision is a miss rather than
+/// the wrong program. The `CACHE_ENTRIES` most recently used are kept.
+struct ObjectCache {
+    dir: PathBuf,
+    key: String,
+    material: Vec<u8>,
+}
+
+const CACHE_ENTRIES: usize = 32;
+/// Partial files older than this belong to a build that died mid-store
+const CACHE_PARTIAL_AGE: Duration = Duration::from_secs(3600);
+
+impl ObjectCache {
+    fn new(cli: &Cli, source: &str, target: &str, opt_level: OptLevel) -> Option<Self> {
+        if cli.no_cache {
+            return None;
+        }
+        let exe = std::env::current_exe()
+            .and_then(std::fs::metadata)
+            .map(|meta| (meta.len(), meta.modified().ok()))
+            .ok();
+        let header = format!(
+            "rustybasic {} exe={:?} target={} opt={:?} flags={:?}\n",
+            env!("CARGO_PKG_VERSION"),
+            exe,
+            target,
+            opt_level,
+            (cli.no_bounds_check, cli.fast_math, cli.profile),
+        );
+        let mut material = header.into_bytes();
+        material.extend_from_slice(source.as_bytes());
+        let mut hasher = DefaultHasher::new();
+        material.hash(&mut hasher);
+        let dir = cli
+            .source
+            .parent()
+            .unwrap_or_else(|| Path::new("."))
+            .join(".rustybasic-cache");
+        Some(Self {
+            dir,
+            key: format!("{:016x}", hasher.finish()),
+            material,
+        })
+    }
+
+    fn path(&self) -> PathBuf {
+        self.dir.join(format!("{}.o", self.key))
+    }
+
+    fn key_path(&self) -> PathBuf {
+        self.dir.join(format!("{}.key", self.key))
+    }
+
+    fn lookup(&self) -> Option<PathBuf> {
+        let path = self.path();
+        if !path.is_file() || std::fs::read(self.key_path()).ok()? != self.material {
+            return None;
+        }
+        // Mark the entry as used, so prune evicts the least recently used
+        if let Ok(file) = std::fs::File::options().write(true).open(&path) {
+            file.set_modified(std::time::SystemTime::now()).ok();
+        }
+        Some(path)
+    }
+
+    /// Best effort: a cache that can't be written only costs the next build
+    fn store(&self, object: &Path) {
+        if std::fs::create_dir_all(&self.dir).is_err() {
+            return;
+        }
+        // Write under temporary names so a concurrent build never sees half
+        // an entry; the key goes in first, so an object is never matched
+        // against another program's key
+        let pid = std::process::id();
+        let partial_key = self.dir.join(format!("{}.key.{pid}", self.key));
+        let partial = self.dir.join(format!("{}.o.{pid}", self.key));
+        std::fs::remove_file(self.path()).ok();
+        let stored = std::fs::write(&partial_key, &self.material).is_ok()
+            && std::fs::rename(&partial_key, self.key_path()).is_ok()
+            && std::fs::copy(object, &partial).is_ok()
+            && std::fs::rename(&partial, self.path()).is_ok();
+        if !stored {
+            std::fs::remove_file(&partial_key).ok();
+            std::fs::remove_file(&partial).ok();
+            return;
+        }
+        self.prune();
+    }
+
+    fn prune(&self) {
+        let Ok(entries) = std::fs::read_dir(&self.dir) else { return };
+        let now = std::time::SystemTime::now();
+        let mut objects = Vec::new();
+        for entry in entries.filter_map(|e| e.ok()) {
+            let path = entry.path();
+            let Some(modified) = entry.metadata().ok().and_then(|m| m.modified().ok()) else {
+                continue;
+            };
+            let name = entry.file_name().to_string_lossy().into_owned();
+            if name.contains(".o.") || name.contains(".key.") {
+                // "<key>.o.<pid>" left by a build that was killed mid-store
+                if now.duration_since(modified).map_or(false, |age| age > CACHE_PARTIAL_AGE) {
+                    std::fs::remove_file(&path).ok();
+                }
+            } else if path.extension().map_or(false, |x| x == "o") {
+                objects.push((modified, path));
+            }
+        }
+        if objects.len() <= CACHE_ENTRIES {
+            return;
+        }
+        objects.sort();
+        for (_, path) in &objects[..objects.len() - CACHE_ENTRIES] {
+            std::fs::remove_file(path).ok();
+            std::fs::remove_file(path.with_extension("key")).ok();
+        }
+    }
+}
+
+/// Time lexing, parsing, analysis and code generation (through object
+/// emission) of an already-checked source, `runs` times each, and print
+/// the medians in the benchmark line format `BENCH <name> <iterations> <us>`
+/// shared with `bench/runtime.bas`.
+fn bench_compile(
+    cli: &Cli,
+    source: &str,
+    target_config: TargetConfig,
+    opt_level: OptLevel,
+    runs: u32,
+) -> Result<()> {
+    fn median(mut samples: Vec<Duration>) -> u128 {
+        samples.sort();
+        samples[samples.len() / 2].as_micros()
+    }
+    fn timed<T>(samples: &mut Vec<Duration>, f: impl FnOnce() -> T) -> T {
+        let start = Instant::now();
+        let out = f();
+        samples.push(start.elapsed());
+        out
+    }
+
+    let name = cli
+        .source
+        .file_stem()
+        .map(|s| s.to_string_lossy().into_owned())
+        .unwrap_or_else(|| "source".to_string());
+    let (mut lex, mut parse_t, mut sema, mut codegen_t) = (vec![], vec![], vec![], vec![]);
+    let mut object_size = 0;
+    for _ in 0..runs {
+        let tokens = timed(&mut lex, || tokenize(source))
+            .map_err(|e| anyhow::anyhow!("{}", e.message))?;
+        let program = timed(&mut parse_t, || parse(tokens))
+            .map_err(|e| anyhow::anyhow!("{}", e.message))?;
+        let sema_result = timed(&mut sema, || analyze(&program));
+        object_size = timed(&mut codegen_t, || -> Result<usize> {
+            let context = inkwell::context::Context::create();
+            let mut codegen =
+                Codegen::new(&context, &cli.source.display().to_string(), target_config.clone(), sema_result);
+            codegen.set_bounds_checks(!cli.no_bounds_check);
+            codegen.set_fast_math(cli.fast_math);
+            codegen.set_profile(cli.profile);
+            codegen.set_opt_level(opt_level);
+            codegen.compile(&program)?;
+            codegen.emit_object_in_memory()
+        })?;
+    }
+
+    for (phase, samples) in [("lex", lex), ("parse", parse_t), ("sema", sema), ("codegen", codegen_t)] {
+        println!("BENCH compile.{phase}.{name} 1 {}", median(samples));
+    }
+    println!("{}: {} bytes of object code, median of {runs} runs", cli.source.display(), object_size);
+    Ok(())
+}
+
 /// Recursively resolve `INCLUDE "file.bas"` directives by inlining the
 /// included file's contents. Paths are resolved relative to the directory
 /// of the file that contains the directive. Circular includes are detected
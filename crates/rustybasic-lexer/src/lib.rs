@@ -132,10 +132,22 @@ pub enum TokenKind {
     I2cWrite,
     #[regex(r"(?i:I2C\.READ)")]
     I2cRead,
+    #[regex(r"(?i:I2C\.SEND)")]
+    I2cSend,
+    #[regex(r"(?i:I2C\.READ\$)")]
+    I2cReadStr,
+    #[regex(r"(?i:I2C\.WRITEREAD\$)")]
+    I2cWriteRead,
     #[regex(r"(?i:SPI\.SETUP)")]
     SpiSetup,
     #[regex(r"(?i:SPI\.TRANSFER)")]
     SpiTransfer,
+    #[regex(r"(?i:SPI\.TRANSFER\$)")]
+    SpiTransferStr,
+    #[regex(r"(?i:SPI\.SEND)")]
+    SpiSend,
+    #[regex(r"(?i:SPI\.FLUSH)")]
+    SpiFlush,
     #[regex(r"(?i:WIFI\.CONNECT)")]
     WifiConnect,
     #[regex(r"(?i:WIFI\.STATUS)")]
@@ -146,6 +158,12 @@ pub enum TokenKind {
     Delay,
     #[regex(r"(?i:ADC\.READ)")]
     AdcRead,
+    #[regex(r"(?i:ADC\.STREAM)")]
+    AdcStream,
+    #[regex(r"(?i:ADC\.BLOCK)")]
+    AdcBlock,
+    #[regex(r"(?i:ADC\.STOP)")]
+    AdcStop,
     #[regex(r"(?i:PWM\.SETUP)")]
     PwmSetup,
     #[regex(r"(?i:PWM\.DUTY)")]
@@ -156,18 +174,42 @@ pub enum TokenKind {
     UartWrite,
     #[regex(r"(?i:UART\.READ)")]
     UartRead,
+    #[regex(r"(?i:UART\.SEND)")]
+    UartSend,
+    #[regex(r"(?i:UART\.READ\$)")]
+    UartReadStr,
+    #[regex(r"(?i:UART\.LINE\$)")]
+    UartLine,
     #[regex(r"(?i:TIMER\.START)")]
     TimerStart,
     #[regex(r"(?i:TIMER\.ELAPSED)")]
     TimerElapsed,
+    #[regex(r"(?i:TIMER\.MICROS)")]
+    TimerMicros,
+    #[regex(r"(?i:TIMER\.AFTER)")]
+    TimerAfter,
+    #[regex(r"(?i:TIMER\.EVERY)")]
+    TimerEvery,
+    #[regex(r"(?i:TIMER\.CANCEL)")]
+    TimerCancel,
     #[regex(r"(?i:HTTP\.GET)")]
     HttpGet,
     #[regex(r"(?i:HTTP\.POST)")]
     HttpPost,
+    #[regex(r"(?i:HTTP\.DOWNLOAD)")]
+    HttpDownload,
+    #[regex(r"(?i:HTTP\.STREAM)")]
+    HttpStream,
+    #[regex(r"(?i:HTTP\.CHUNK)")]
+    HttpChunk,
     #[regex(r"(?i:NVS\.WRITE)")]
     NvsWrite,
     #[regex(r"(?i:NVS\.READ)")]
     NvsRead,
+    #[regex(r"(?i:NVS\.COMMIT)")]
+    NvsCommit,
+    #[regex(r"(?i:NVS\.AUTOCOMMIT)")]
+    NvsAutocommit,
     #[regex(r"(?i:MQTT\.CONNECT)")]
     MqttConnect,
     #[regex(r"(?i:MQTT\.DISCONNECT)")]
@@ -178,6 +220,12 @@ pub enum TokenKind {
     MqttSubscribe,
     #[regex(r"(?i:MQTT\.RECEIVE)")]
     MqttReceive,
+    #[regex(r"(?i:MQTT\.TOPIC)")]
+    MqttTopic,
+    #[regex(r"(?i:MQTT\.COALESCE)")]
+    MqttCoalesce,
+    #[regex(r"(?i:MQTT\.FLUSH)")]
+    MqttFlush,
     #[regex(r"(?i:BLE\.INIT)")]
     BleInit,
     #[regex(r"(?i:BLE\.ADVERTISE)")]
@@ -188,16 +236,34 @@ pub enum TokenKind {
     BleSend,
     #[regex(r"(?i:BLE\.RECEIVE)")]
     BleReceive,
+    #[regex(r"(?i:BLE\.INTERVAL)")]
+    BleInterval,
+    #[regex(r"(?i:BLE\.MTU)")]
+    BleMtu,
     #[regex(r"(?i:JSON\.GET)")]
     JsonGet,
     #[regex(r"(?i:JSON\.SET)")]
     JsonSet,
     #[regex(r"(?i:JSON\.COUNT)")]
     JsonCount,
+    #[regex(r"(?i:JSON\.EXTRACT)")]
+    JsonExtract,
+    #[regex(r"(?i:JSON\.BEGIN)")]
+    JsonBegin,
+    #[regex(r"(?i:JSON\.BEGINARRAY)")]
+    JsonBeginArray,
+    #[regex(r"(?i:JSON\.ADD)")]
+    JsonAdd,
+    #[regex(r"(?i:JSON\.PUSH)")]
+    JsonPush,
+    #[regex(r"(?i:JSON\.END)")]
+    JsonEnd,
     #[regex(r"(?i:LED\.SETUP)")]
     LedSetup,
     #[regex(r"(?i:LED\.SET)")]
     LedSet,
+    #[regex(r"(?i:LED\.SETALL)")]
+    LedSetAll,
     #[regex(r"(?i:LED\.SHOW)")]
     LedShow,
     #[regex(r"(?i:LED\.CLEAR)")]
@@ -210,6 +276,8 @@ pub enum TokenKind {
     EspnowSend,
     #[regex(r"(?i:ESPNOW\.RECEIVE)")]
     EspnowReceive,
+    #[regex(r"(?i:ESPNOW\.PEER)")]
+    EspnowPeer,
 
     // ── DATA/READ/RESTORE ─────────────────────────────────
     #[regex(r"(?i:DATA)")]
@@ -290,6 +358,10 @@ pub enum TokenKind {
     FileWrite,
     #[regex(r"(?i:FILE\.READ\$)")]
     FileReadStr,
+    #[regex(r"(?i:FILE\.READLINE\$)")]
+    FileReadLine,
+    #[regex(r"(?i:FILE\.EOF)")]
+    FileEof,
     #[regex(r"(?i:FILE\.CLOSE)")]
     FileClose,
     #[regex(r"(?i:FILE\.DELETE)")]
@@ -314,6 +386,8 @@ pub enum TokenKind {
     TcpReceiveStr,
     #[regex(r"(?i:TCP\.CLOSE)")]
     TcpClose,
+    #[regex(r"(?i:TCP\.CLIENT)")]
+    TcpClient,
     #[regex(r"(?i:WDT\.ENABLE)")]
     WdtEnable,
     #[regex(r"(?i:WDT\.FEED)")]
@@ -330,6 +404,10 @@ pub enum TokenKind {
     I2sWrite,
     #[regex(r"(?i:I2S\.STOP)")]
     I2sStop,
+    #[regex(r"(?i:I2S\.PINS)")]
+    I2sPins,
+    #[regex(r"(?i:I2S\.READ\$)")]
+    I2sRead,
 
     // ── Web Server ───────────────────────────────────────
     #[regex(r"(?i:WEB\.START)")]
@@ -342,6 +420,12 @@ pub enum TokenKind {
     WebReply,
     #[regex(r"(?i:WEB\.STOP)")]
     WebStop,
+    #[regex(r"(?i:WEB\.ROUTE)")]
+    WebRoute,
+    #[regex(r"(?i:WEB\.REQUEST)")]
+    WebRequest,
+    #[regex(r"(?i:WEB\.SERVE)")]
+    WebServe,
 
     // ── SD Card ──────────────────────────────────────────
     #[regex(r"(?i:SD\.INIT)")]
@@ -357,11 +441,35 @@ pub enum TokenKind {
     #[regex(r"(?i:SD\.FREE)")]
     SdFree,
 
+    // ── Console ──────────────────────────────────────────
+    #[regex(r"(?i:FLUSH)")]
+    Flush,
+    #[regex(r"(?i:CONSOLE\.MODE)")]
+    ConsoleMode,
+
+    // ── Data logger ──────────────────────────────────────
+    #[regex(r"(?i:LOG\.OPEN)")]
+    LogOpen,
+    #[regex(r"(?i:LOG\.WRITE)")]
+    LogWrite,
+    #[regex(r"(?i:LOG\.FLUSH)")]
+    LogFlush,
+    #[regex(r"(?i:LOG\.CLOSE)")]
+    LogClose,
+    #[regex(r"(?i:LOG\.DROPPED)")]
+    LogDropped,
+    #[regex(r"(?i:EVENT\.COALESCED)")]
+    EventCoalesced,
+    #[regex(r"(?i:EVENT\.DROPPED)")]
+    EventDropped,
+
     // ── Async / Yield ────────────────────────────────────
     #[regex(r"(?i:YIELD)")]
     Yield,
     #[regex(r"(?i:AWAIT)")]
     Await,
+    #[regex(r"(?i:ASYNC)")]
+    Async,
 
     // ── Cron ─────────────────────────────────────────────
     #[regex(r"(?i:CRON\.ADD)")]
@@ -379,6 +487,62 @@ pub enum TokenKind {
     #[regex(r"(?i:REGEX\.REPLACE\$)")]
     RegexReplaceStr,
 
+    // ── Field parsing ────────────────────────────────────
+    #[regex(r"(?i:VAL\.NEXT)")]
+    ValNext,
+
+    // ── Array kernels ────────────────────────────────────
+    #[regex(r"(?i:ARRAY\.SUM)")]
+    ArraySum,
+    #[regex(r"(?i:ARRAY\.MIN)")]
+    ArrayMin,
+    #[regex(r"(?i:ARRAY\.MAX)")]
+    ArrayMax,
+    #[regex(r"(?i:ARRAY\.DOT)")]
+    ArrayDot,
+    #[regex(r"(?i:ARRAY\.FILL)")]
+    ArrayFill,
+    #[regex(r"(?i:ARRAY\.COPY)")]
+    ArrayCopy,
+    #[regex(r"(?i:ARRAY\.SCALE)")]
+    ArrayScale,
+
+    // ── DSP ──────────────────────────────────────────────
+    #[regex(r"(?i:DSP\.FIR)")]
+    DspFir,
+    #[regex(r"(?i:DSP\.BIQUAD)")]
+    DspBiquad,
+    #[regex(r"(?i:DSP\.FFT)")]
+    DspFft,
+    #[regex(r"(?i:DSP\.MAG)")]
+    DspMag,
+    #[regex(r"(?i:DSP\.RMS)")]
+    DspRms,
+    #[regex(r"(?i:DSP\.PEAK)")]
+    DspPeak,
+
+    // ── String Builder ───────────────────────────────────
+    #[regex(r"(?i:STRINGBUILDER)")]
+    StringBuilder,
+    #[regex(r"(?i:SB\.APPEND)")]
+    SbAppend,
+    #[regex(r"(?i:SB\.TOSTRING)")]
+    SbToString,
+    #[regex(r"(?i:SB\.CLEAR)")]
+    SbClear,
+    #[regex(r"(?i:SB\.FREE)")]
+    SbFree,
+
+    // ── Channels ─────────────────────────────────────────
+    #[regex(r"(?i:CHANNEL)")]
+    Channel,
+    #[regex(r"(?i:CHANNEL\.SEND)")]
+    ChannelSend,
+    #[regex(r"(?i:CHANNEL\.RECEIVE)")]
+    ChannelReceive,
+    #[regex(r"(?i:CHANNEL\.SELECT)")]
+    ChannelSelect,
+
     // ── Bitwise shift ────────────────────────────────────
     #[regex(r"(?i:SHL)")]
     Shl,
@@ -388,6 +552,10 @@ pub enum TokenKind {
     // ── New language features ─────────────────────────────
     #[regex(r"(?i:ASSERT)")]
     Assert,
+    #[regex(r"(?i:PROFILE)")]
+    Profile,
+    #[regex(r"(?i:PROFILE\.DUMP)")]
+    ProfileDump,
     #[regex(r"(?i:ENUM)")]
     Enum,
     #[regex(r"(?i:EACH)")]
@@ -402,6 +570,12 @@ pub enum TokenKind {
     Lambda,
     #[regex(r"(?i:TASK)")]
     Task,
+    #[regex(r"(?i:TASK\.POOL)")]
+    TaskPool,
+    #[regex(r"(?i:SPAWN)")]
+    Spawn,
+    #[regex(r"(?i:WAIT)")]
+    Wait,
     #[regex(r"(?i:MACHINE)")]
     Machine,
     // STATE is not a keyword — it's handled as Ident("STATE") inside MACHINE blocks
@@ -553,43 +727,77 @@ impl std::fmt::Display for TokenKind {
             TokenKind::I2cRead => write!(f, "I2C.READ"),
             TokenKind::SpiSetup => write!(f, "SPI.SETUP"),
             TokenKind::SpiTransfer => write!(f, "SPI.TRANSFER"),
+            TokenKind::I2cSend => write!(f, "I2C.SEND"),
+            TokenKind::I2cReadStr => write!(f, "I2C.READ$"),
+            TokenKind::I2cWriteRead => write!(f, "I2C.WRITEREAD$"),
+            TokenKind::SpiTransferStr => write!(f, "SPI.TRANSFER$"),
+            TokenKind::SpiSend => write!(f, "SPI.SEND"),
+            TokenKind::SpiFlush => write!(f, "SPI.FLUSH"),
             TokenKind::WifiConnect => write!(f, "WIFI.CONNECT"),
             TokenKind::WifiStatus => write!(f, "WIFI.STATUS"),
             TokenKind::WifiDisconnect => write!(f, "WIFI.DISCONNECT"),
             TokenKind::Delay => write!(f, "DELAY"),
             TokenKind::AdcRead => write!(f, "ADC.READ"),
+            TokenKind::AdcStream => write!(f, "ADC.STREAM"),
+            TokenKind::AdcBlock => write!(f, "ADC.BLOCK"),
+            TokenKind::AdcStop => write!(f, "ADC.STOP"),
             TokenKind::PwmSetup => write!(f, "PWM.SETUP"),
             TokenKind::PwmDuty => write!(f, "PWM.DUTY"),
             TokenKind::UartSetup => write!(f, "UART.SETUP"),
             TokenKind::UartWrite => write!(f, "UART.WRITE"),
             TokenKind::UartRead => write!(f, "UART.READ"),
+            TokenKind::UartSend => write!(f, "UART.SEND"),
+            TokenKind::UartReadStr => write!(f, "UART.READ$"),
+            TokenKind::UartLine => write!(f, "UART.LINE$"),
             TokenKind::TimerStart => write!(f, "TIMER.START"),
             TokenKind::TimerElapsed => write!(f, "TIMER.ELAPSED"),
+            TokenKind::TimerMicros => write!(f, "TIMER.MICROS"),
+            TokenKind::TimerAfter => write!(f, "TIMER.AFTER"),
+            TokenKind::TimerEvery => write!(f, "TIMER.EVERY"),
+            TokenKind::TimerCancel => write!(f, "TIMER.CANCEL"),
             TokenKind::HttpGet => write!(f, "HTTP.GET"),
             TokenKind::HttpPost => write!(f, "HTTP.POST"),
+            TokenKind::HttpDownload => write!(f, "HTTP.DOWNLOAD"),
+            TokenKind::HttpStream => write!(f, "HTTP.STREAM"),
+            TokenKind::HttpChunk => write!(f, "HTTP.CHUNK"),
             TokenKind::NvsWrite => write!(f, "NVS.WRITE"),
             TokenKind::NvsRead => write!(f, "NVS.READ"),
+            TokenKind::NvsCommit => write!(f, "NVS.COMMIT"),
+            TokenKind::NvsAutocommit => write!(f, "NVS.AUTOCOMMIT"),
             TokenKind::MqttConnect => write!(f, "MQTT.CONNECT"),
             TokenKind::MqttDisconnect => write!(f, "MQTT.DISCONNECT"),
             TokenKind::MqttPublish => write!(f, "MQTT.PUBLISH"),
             TokenKind::MqttSubscribe => write!(f, "MQTT.SUBSCRIBE"),
             TokenKind::MqttReceive => write!(f, "MQTT.RECEIVE"),
+            TokenKind::MqttTopic => write!(f, "MQTT.TOPIC"),
+            TokenKind::MqttCoalesce => write!(f, "MQTT.COALESCE"),
+            TokenKind::MqttFlush => write!(f, "MQTT.FLUSH"),
             TokenKind::BleInit => write!(f, "BLE.INIT"),
             TokenKind::BleAdvertise => write!(f, "BLE.ADVERTISE"),
             TokenKind::BleScan => write!(f, "BLE.SCAN"),
             TokenKind::BleSend => write!(f, "BLE.SEND"),
             TokenKind::BleReceive => write!(f, "BLE.RECEIVE"),
+            TokenKind::BleInterval => write!(f, "BLE.INTERVAL"),
+            TokenKind::BleMtu => write!(f, "BLE.MTU"),
             TokenKind::JsonGet => write!(f, "JSON.GET"),
             TokenKind::JsonSet => write!(f, "JSON.SET"),
             TokenKind::JsonCount => write!(f, "JSON.COUNT"),
+            TokenKind::JsonExtract => write!(f, "JSON.EXTRACT"),
+            TokenKind::JsonBegin => write!(f, "JSON.BEGIN"),
+            TokenKind::JsonBeginArray => write!(f, "JSON.BEGINARRAY"),
+            TokenKind::JsonAdd => write!(f, "JSON.ADD"),
+            TokenKind::JsonPush => write!(f, "JSON.PUSH"),
+            TokenKind::JsonEnd => write!(f, "JSON.END"),
             TokenKind::LedSetup => write!(f, "LED.SETUP"),
             TokenKind::LedSet => write!(f, "LED.SET"),
+            TokenKind::LedSetAll => write!(f, "LED.SETALL"),
             TokenKind::LedShow => write!(f, "LED.SHOW"),
             TokenKind::LedClear => write!(f, "LED.CLEAR"),
             TokenKind::DeepSleep => write!(f, "DEEPSLEEP"),
             TokenKind::EspnowInit => write!(f, "ESPNOW.INIT"),
             TokenKind::EspnowSend => write!(f, "ESPNOW.SEND"),
             TokenKind::EspnowReceive => write!(f, "ESPNOW.RECEIVE"),
+            TokenKind::EspnowPeer => write!(f, "ESPNOW.PEER"),
             TokenKind::Data => write!(f, "DATA"),
             TokenKind::Read => write!(f, "READ"),
             TokenKind::Restore => write!(f, "RESTORE"),
@@ -626,6 +834,8 @@ impl std::fmt::Display for TokenKind {
             TokenKind::FileOpen => write!(f, "FILE.OPEN"),
             TokenKind::FileWrite => write!(f, "FILE.WRITE"),
             TokenKind::FileReadStr => write!(f, "FILE.READ$"),
+            TokenKind::FileReadLine => write!(f, "FILE.READLINE$"),
+            TokenKind::FileEof => write!(f, "FILE.EOF"),
             TokenKind::FileClose => write!(f, "FILE.CLOSE"),
             TokenKind::FileDelete => write!(f, "FILE.DELETE"),
             TokenKind::FileExists => write!(f, "FILE.EXISTS"),
@@ -638,6 +848,7 @@ impl std::fmt::Display for TokenKind {
             TokenKind::TcpSend => write!(f, "TCP.SEND"),
             TokenKind::TcpReceiveStr => write!(f, "TCP.RECEIVE$"),
             TokenKind::TcpClose => write!(f, "TCP.CLOSE"),
+            TokenKind::TcpClient => write!(f, "TCP.CLIENT"),
             TokenKind::WdtEnable => write!(f, "WDT.ENABLE"),
             TokenKind::WdtFeed => write!(f, "WDT.FEED"),
             TokenKind::WdtDisable => write!(f, "WDT.DISABLE"),
@@ -646,28 +857,68 @@ impl std::fmt::Display for TokenKind {
             TokenKind::I2sInit => write!(f, "I2S.INIT"),
             TokenKind::I2sWrite => write!(f, "I2S.WRITE"),
             TokenKind::I2sStop => write!(f, "I2S.STOP"),
+            TokenKind::I2sPins => write!(f, "I2S.PINS"),
+            TokenKind::I2sRead => write!(f, "I2S.READ$"),
             TokenKind::WebStart => write!(f, "WEB.START"),
             TokenKind::WebWaitStr => write!(f, "WEB.WAIT$"),
             TokenKind::WebBodyStr => write!(f, "WEB.BODY$"),
             TokenKind::WebReply => write!(f, "WEB.REPLY"),
             TokenKind::WebStop => write!(f, "WEB.STOP"),
+            TokenKind::WebRoute => write!(f, "WEB.ROUTE"),
+            TokenKind::WebRequest => write!(f, "WEB.REQUEST"),
+            TokenKind::WebServe => write!(f, "WEB.SERVE"),
             TokenKind::SdInit => write!(f, "SD.INIT"),
             TokenKind::SdOpen => write!(f, "SD.OPEN"),
             TokenKind::SdWrite => write!(f, "SD.WRITE"),
             TokenKind::SdReadStr => write!(f, "SD.READ$"),
             TokenKind::SdClose => write!(f, "SD.CLOSE"),
             TokenKind::SdFree => write!(f, "SD.FREE"),
+            TokenKind::Flush => write!(f, "FLUSH"),
+            TokenKind::ConsoleMode => write!(f, "CONSOLE.MODE"),
+            TokenKind::LogOpen => write!(f, "LOG.OPEN"),
+            TokenKind::LogWrite => write!(f, "LOG.WRITE"),
+            TokenKind::LogFlush => write!(f, "LOG.FLUSH"),
+            TokenKind::LogClose => write!(f, "LOG.CLOSE"),
+            TokenKind::LogDropped => write!(f, "LOG.DROPPED"),
+            TokenKind::EventCoalesced => write!(f, "EVENT.COALESCED"),
+            TokenKind::EventDropped => write!(f, "EVENT.DROPPED"),
             TokenKind::Yield => write!(f, "YIELD"),
             TokenKind::Await => write!(f, "AWAIT"),
+            TokenKind::Async => write!(f, "ASYNC"),
             TokenKind::CronAdd => write!(f, "CRON.ADD"),
             TokenKind::CronCheck => write!(f, "CRON.CHECK"),
             TokenKind::CronRemove => write!(f, "CRON.REMOVE"),
             TokenKind::RegexMatch => write!(f, "REGEX.MATCH"),
             TokenKind::RegexFindStr => write!(f, "REGEX.FIND$"),
             TokenKind::RegexReplaceStr => write!(f, "REGEX.REPLACE$"),
+            TokenKind::ValNext => write!(f, "VAL.NEXT"),
+            TokenKind::ArraySum => write!(f, "ARRAY.SUM"),
+            TokenKind::ArrayMin => write!(f, "ARRAY.MIN"),
+            TokenKind::ArrayMax => write!(f, "ARRAY.MAX"),
+            TokenKind::ArrayDot => write!(f, "ARRAY.DOT"),
+            TokenKind::ArrayFill => write!(f, "ARRAY.FILL"),
+            TokenKind::ArrayCopy => write!(f, "ARRAY.COPY"),
+            TokenKind::ArrayScale => write!(f, "ARRAY.SCALE"),
+            TokenKind::DspFir => write!(f, "DSP.FIR"),
+            TokenKind::DspBiquad => write!(f, "DSP.BIQUAD"),
+            TokenKind::DspFft => write!(f, "DSP.FFT"),
+            TokenKind::DspMag => write!(f, "DSP.MAG"),
+            TokenKind::DspRms => write!(f, "DSP.RMS"),
+            TokenKind::DspPeak => write!(f, "DSP.PEAK"),
+            TokenKind::StringBuilder => write!(f, "STRINGBUILDER"),
+            TokenKind::SbAppend => write!(f, "SB.APPEND"),
+            TokenKind::SbToString => write!(f, "SB.TOSTRING"),
+            TokenKind::SbClear => write!(f, "SB.CLEAR"),
+            TokenKind::SbFree => write!(f, "SB.FREE"),
+            TokenKind::Channel => write!(f, "CHANNEL"),
+            TokenKind::ChannelSend => write!(f, "CHANNEL.SEND"),
+            TokenKind::ChannelReceive => write!(f, "CHANNEL.RECEIVE"),
+            TokenKind::ChannelSelect => write!(f, "CHANNEL.SELECT"),
             TokenKind::Shl => write!(f, "SHL"),
             TokenKind::Shr => write!(f, "SHR"),
             TokenKind::Assert => write!(f, "ASSERT"),
+            TokenKind::Profile => write!(f, "PROFILE"),
+            TokenKind::ProfileDump => write!(f, "PROFILE.DUMP"),
             TokenKind::Enum => write!(f, "ENUM"),
             TokenKind::Each => write!(f, "EACH"),
             TokenKind::In => write!(f, "IN"),
@@ -675,6 +926,9 @@ impl std::fmt::Display for TokenKind {
             TokenKind::Catch => write!(f, "CATCH"),
             TokenKind::Lambda => write!(f, "LAMBDA"),
             TokenKind::Task => write!(f, "TASK"),
+            TokenKind::TaskPool => write!(f, "TASK.POOL"),
+            TokenKind::Spawn => write!(f, "SPAWN"),
+            TokenKind::Wait => write!(f, "WAIT"),
             TokenKind::Machine => write!(f, "MACHINE"),
             TokenKind::Module => write!(f, "MODULE"),
             TokenKind::FatArrow => write!(f, "=>"),
@@ -346,6 +346,44 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// I2C.SEND addr, data$
+    I2cSend {
+        addr: Expr,
+        data: Expr,
+        span: Span,
+    },
+    /// I2C.READ$ addr, len, var$
+    I2cReadStr {
+        addr: Expr,
+        length: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    /// I2C.WRITEREAD$ addr, tx$, len, var$
+    I2cWriteRead {
+        addr: Expr,
+        data: Expr,
+        length: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    /// SPI.SEND data$
+    SpiSend {
+        data: Expr,
+        span: Span,
+    },
+    /// SPI.TRANSFER$ tx$, var$
+    SpiTransferStr {
+        data: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    SpiFlush {
+        span: Span,
+    },
     WifiConnect {
         ssid: Expr,
         password: Expr,
@@ -369,6 +407,21 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// ADC.STREAM pin, rate_hz
+    AdcStream {
+        pin: Expr,
+        rate: Expr,
+        span: Span,
+    },
+    /// ADC.BLOCK array%() [, count%]
+    AdcBlock {
+        array: String,
+        count: Option<(String, QBType)>,
+        span: Span,
+    },
+    AdcStop {
+        span: Span,
+    },
     PwmSetup {
         channel: Expr,
         pin: Expr,
@@ -381,11 +434,13 @@ pub enum Statement {
         duty: Expr,
         span: Span,
     },
+    /// UART.SETUP port, baud, tx, rx [, rx_buffer]
     UartSetup {
         port: Expr,
         baud: Expr,
         tx: Expr,
         rx: Expr,
+        rx_buffer: Option<Expr>,
         span: Span,
     },
     UartWrite {
@@ -399,6 +454,26 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// UART.SEND port, data$
+    UartSend {
+        port: Expr,
+        data: Expr,
+        span: Span,
+    },
+    /// UART.READ$ port, max, var$
+    UartReadStr {
+        port: Expr,
+        max: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    /// UART.LINE$ var$ — the line ON UART.LINE is dispatching
+    UartLine {
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
     TimerStart {
         span: Span,
     },
@@ -407,6 +482,30 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// TIMER.MICROS var
+    TimerMicros {
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    /// TIMER.AFTER us, sub [, id%] / TIMER.EVERY us, sub [, id%]
+    TimerAfter {
+        micros: Expr,
+        target: String,
+        id: Option<(String, QBType)>,
+        span: Span,
+    },
+    TimerEvery {
+        micros: Expr,
+        target: String,
+        id: Option<(String, QBType)>,
+        span: Span,
+    },
+    /// TIMER.CANCEL id%
+    TimerCancel {
+        id: Expr,
+        span: Span,
+    },
     HttpGet {
         url: Expr,
         target: String,
@@ -420,6 +519,27 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// HTTP.DOWNLOAD url$, path$, bytes%
+    HttpDownload {
+        url: Expr,
+        path: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    /// HTTP.STREAM url$, sub, bytes%
+    HttpStream {
+        url: Expr,
+        handler: String,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
+    HttpChunk {
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
     NvsWrite {
         key: Expr,
         value: Expr,
@@ -431,6 +551,16 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// NVS.COMMIT — write out every key changed since the last commit
+    NvsCommit {
+        span: Span,
+    },
+    /// NVS.AUTOCOMMIT ms — commit ms after the first uncommitted write
+    /// (0: only at NVS.COMMIT and the end of the program)
+    NvsAutocommit {
+        ms: Expr,
+        span: Span,
+    },
     MqttConnect {
         broker: Expr,
         port: Expr,
@@ -442,6 +572,18 @@ pub enum Statement {
     MqttPublish {
         topic: Expr,
         message: Expr,
+        qos: Option<Expr>,
+        retain: Option<Expr>,
+        span: Span,
+    },
+    /// MQTT.COALESCE topic$, mode [, n]
+    MqttCoalesce {
+        topic: Expr,
+        mode: Expr,
+        n: Option<Expr>,
+        span: Span,
+    },
+    MqttFlush {
         span: Span,
     },
     MqttSubscribe {
@@ -453,6 +595,11 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    MqttTopic {
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
     BleInit {
         name: Expr,
         span: Span,
@@ -475,6 +622,18 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// BLE.INTERVAL min_ms [, max_ms] — request a connection interval
+    BleInterval {
+        min_ms: Expr,
+        max_ms: Option<Expr>,
+        span: Span,
+    },
+    /// BLE.MTU var — the negotiated ATT MTU
+    BleMtu {
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
     JsonGet {
         json: Expr,
         key: Expr,
@@ -496,6 +655,30 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// JSON.EXTRACT json$, path$, var$ [, path$, var$ ...] — one streaming pass
+    JsonExtract {
+        json: Expr,
+        fields: Vec<(Expr, String, QBType)>,
+        span: Span,
+    },
+    /// JSON.BEGIN / JSON.BEGINARRAY sb [, key$] — open a container on a builder
+    JsonBegin {
+        handle: Expr,
+        key: Option<Expr>,
+        is_array: bool,
+        span: Span,
+    },
+    /// JSON.ADD sb, key$, value (objects) / JSON.PUSH sb, value (arrays)
+    JsonAdd {
+        handle: Expr,
+        key: Option<Expr>,
+        value: Expr,
+        span: Span,
+    },
+    JsonEnd {
+        handle: Expr,
+        span: Span,
+    },
     LedSetup {
         pin: Expr,
         count: Expr,
@@ -508,6 +691,11 @@ pub enum Statement {
         b: Expr,
         span: Span,
     },
+    /// LED.SETALL colors%() — one r * 65536 + g * 256 + b value per LED
+    LedSetAll {
+        array: String,
+        span: Span,
+    },
     LedShow {
         span: Span,
     },
@@ -521,6 +709,7 @@ pub enum Statement {
     EspnowInit {
         span: Span,
     },
+    /// ESPNOW.SEND peer, data$ — peer is a MAC string or an ESPNOW.PEER handle
     EspnowSend {
         peer: Expr,
         data: Expr,
@@ -531,6 +720,13 @@ pub enum Statement {
         var_type: QBType,
         span: Span,
     },
+    /// ESPNOW.PEER mac$, var — add a peer once, its handle in var
+    EspnowPeer {
+        mac: Expr,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
 
     /// DATA v1, v2, ... — inline data declaration
     Data {
@@ -542,8 +738,14 @@ pub enum Statement {
         variables: Vec<(String, QBType)>,
         span: Span,
     },
-    /// RESTORE — reset data read pointer
+    /// READ a() — fill a whole numeric array from the data pool
+    ReadArray {
+        array: String,
+        span: Span,
+    },
+    /// RESTORE [label] — reset data read pointer, to the first DATA after label
     Restore {
+        label: Option<String>,
         span: Span,
     },
 
@@ -586,9 +788,15 @@ pub enum Statement {
         target: Option<String>,
         span: Span,
     },
-    /// RANDOMIZE seed
+    /// RANDOMIZE [seed] (no seed: hardware entropy)
     Randomize {
-        seed: Expr,
+        seed: Option<Expr>,
+        span: Span,
+    },
+    /// RANDOMIZE ARRAY a() [, lo, hi]
+    RandomizeArray {
+        array: String,
+        range: Option<(Expr, Expr)>,
         span: Span,
     },
 
@@ -703,10 +911,18 @@ pub enum Statement {
     NtpTime { target: String, var_type: QBType, span: Span },
     NtpEpoch { target: String, var_type: QBType, span: Span },
     // File System
-    FileOpen { path: Expr, mode: Expr, span: Span },
-    FileWrite { data: Expr, span: Span },
-    FileReadStr { target: String, var_type: QBType, span: Span },
-    FileClose { span: Span },
+    /// FILE.OPEN path$, mode$ [, handle%]
+    FileOpen { path: Expr, mode: Expr, handle: Option<(String, QBType)>, span: Span },
+    /// FILE.WRITE data$ [, handle%]
+    FileWrite { data: Expr, handle: Option<Expr>, span: Span },
+    /// FILE.READ$ var$ [, max_bytes [, handle%]]
+    FileReadStr { target: String, var_type: QBType, max: Option<Expr>, handle: Option<Expr>, span: Span },
+    /// FILE.READLINE$ var$ [, handle%]
+    FileReadLine { target: String, var_type: QBType, handle: Option<Expr>, span: Span },
+    /// FILE.EOF var% [, handle%]
+    FileEof { target: String, var_type: QBType, handle: Option<Expr>, span: Span },
+    /// FILE.CLOSE [handle%]
+    FileClose { handle: Option<Expr>, span: Span },
     FileDelete { path: Expr, span: Span },
     FileExists { path: Expr, target: String, var_type: QBType, span: Span },
     // WebSocket
@@ -717,9 +933,12 @@ pub enum Statement {
     // TCP
     TcpListen { port: Expr, span: Span },
     TcpAccept { target: String, var_type: QBType, span: Span },
-    TcpSend { data: Expr, span: Span },
+    /// TCP.SEND data$ [, conn%]
+    TcpSend { data: Expr, conn: Option<Expr>, span: Span },
     TcpReceiveStr { target: String, var_type: QBType, span: Span },
-    TcpClose { span: Span },
+    /// TCP.CLOSE [conn%]
+    TcpClose { conn: Option<Expr>, span: Span },
+    TcpClient { target: String, var_type: QBType, span: Span },
     // Watchdog
     WdtEnable { timeout_ms: Expr, span: Span },
     WdtFeed { span: Span },
@@ -731,25 +950,58 @@ pub enum Statement {
     I2sInit { rate: Expr, bits: Expr, channels: Expr, span: Span },
     I2sWrite { data: Expr, span: Span },
     I2sStop { span: Span },
+    /// I2S.PINS bclk, ws, dout [, din]
+    I2sPins { bclk: Expr, ws: Expr, dout: Expr, din: Option<Expr>, span: Span },
+    /// I2S.READ$ n, var$
+    I2sRead { length: Expr, target: String, var_type: QBType, span: Span },
 
     // ── Web Server ───────────────────────────────────────
     WebStart { port: Expr, span: Span },
     WebWaitStr { target: String, var_type: QBType, span: Span },
     WebBodyStr { target: String, var_type: QBType, span: Span },
-    WebReply { status: Expr, body: Expr, span: Span },
+    /// WEB.REPLY status, body$ [, request%]
+    WebReply { status: Expr, body: Expr, request: Option<Expr>, span: Span },
     WebStop { span: Span },
+    /// WEB.ROUTE method$, path$, sub
+    WebRoute { method: Expr, path: Expr, handler: String, span: Span },
+    WebRequest { target: String, var_type: QBType, span: Span },
+    /// WEB.SERVE prefix$, dir$
+    WebServe { prefix: Expr, dir: Expr, span: Span },
 
     // ── SD Card ──────────────────────────────────────────
     SdInit { cs_pin: Expr, span: Span },
-    SdOpen { path: Expr, mode: Expr, span: Span },
+    /// SD.OPEN path$, mode$ [, handle%]
+    SdOpen { path: Expr, mode: Expr, handle: Option<(String, QBType)>, span: Span },
     SdWrite { data: Expr, span: Span },
-    SdReadStr { target: String, var_type: QBType, span: Span },
+    /// SD.READ$ var$ [, max_bytes]
+    SdReadStr { target: String, var_type: QBType, max: Option<Expr>, span: Span },
     SdClose { span: Span },
     SdFree { target: String, var_type: QBType, span: Span },
 
+    // ── Console ──────────────────────────────────────────
+    /// FLUSH
+    Flush { span: Span },
+    /// CONSOLE.MODE mode [, n]
+    ConsoleMode { mode: Expr, n: Option<Expr>, span: Span },
+
+    // ── Data logger ──────────────────────────────────────
+    /// LOG.OPEN path$ [, max_bytes [, keep]]
+    LogOpen { path: Expr, max_bytes: Option<Expr>, keep: Option<Expr>, span: Span },
+    LogWrite { data: Expr, span: Span },
+    LogFlush { span: Span },
+    LogClose { span: Span },
+    LogDropped { target: String, var_type: QBType, span: Span },
+    /// EVENT.COALESCED var / EVENT.DROPPED var
+    EventCoalesced { target: String, var_type: QBType, span: Span },
+    EventDropped { target: String, var_type: QBType, span: Span },
+
     // ── Async / Yield ────────────────────────────────────
     YieldStmt { span: Span },
     AwaitStmt { ms: Expr, span: Span },
+    /// AWAIT UNTIL condition
+    AwaitUntil { condition: Expr, span: Span },
+    /// ASYNC ... END ASYNC: a coroutine on the event loop task
+    Async { body: Vec<Statement>, span: Span },
 
     // ── Cron ─────────────────────────────────────────────
     CronAdd { id: Expr, expr: Expr, span: Span },
@@ -761,6 +1013,47 @@ pub enum Statement {
     RegexFindStr { pattern: Expr, text: Expr, target: String, var_type: QBType, span: Span },
     RegexReplaceStr { pattern: Expr, text: Expr, replacement: Expr, target: String, var_type: QBType, span: Span },
 
+    // ── Field parsing ────────────────────────────────────
+    /// VAL.NEXT text$, pos, var: the number at `pos` into var; pos moves past it
+    ValNext { text: Expr, pos: String, pos_type: QBType, target: String, var_type: QBType, span: Span },
+
+    // ── Array kernels ────────────────────────────────────
+    /// ARRAY.SUM / ARRAY.MIN / ARRAY.MAX a(), var
+    ArrayReduce { op: ArrayReduceOp, array: String, target: String, var_type: QBType, span: Span },
+    /// ARRAY.DOT a(), b(), var
+    ArrayDot { a: String, b: String, target: String, var_type: QBType, span: Span },
+    /// ARRAY.FILL a(), value
+    ArrayFill { array: String, value: Expr, span: Span },
+    /// ARRAY.COPY src(), dst()
+    ArrayCopy { src: String, dst: String, span: Span },
+    /// ARRAY.SCALE a(), factor [, offset]: a(i) = a(i) * factor + offset
+    ArrayScale { array: String, factor: Expr, offset: Option<Expr>, span: Span },
+
+    // ── DSP (fixed point, INTEGER arrays) ────────────────
+    /// DSP.FIR x%(), h%() [, z%()]: filter x in place with Q15 taps h
+    DspFir { array: String, coeffs: String, state: Option<String>, span: Span },
+    /// DSP.BIQUAD x%(), c%() [, z%()]: cascaded sections of Q14 b0, b1, b2, a1, a2
+    DspBiquad { array: String, coeffs: String, state: Option<String>, span: Span },
+    /// DSP.FFT re%(), im%(): in-place radix-2 FFT, scaled by 1/N
+    DspFft { re: String, im: String, span: Span },
+    /// DSP.MAG re%(), im%(): re(i) = |re(i) + j*im(i)|
+    DspMag { re: String, im: String, span: Span },
+    /// DSP.RMS / DSP.PEAK x%(), var
+    DspLevel { op: DspLevelOp, array: String, target: String, var_type: QBType, span: Span },
+
+    // ── String Builder ───────────────────────────────────
+    StringBuilderNew { target: String, var_type: QBType, span: Span },
+    SbAppend { handle: Expr, value: Expr, span: Span },
+    SbToString { handle: Expr, target: String, var_type: QBType, span: Span },
+    SbClear { handle: Expr, span: Span },
+    SbFree { handle: Expr, span: Span },
+
+    // Channels
+    ChannelNew { id: Expr, capacity: Expr, span: Span },
+    ChannelSend { id: Expr, value: Expr, span: Span },
+    ChannelReceive { id: Expr, target: String, var_type: QBType, span: Span },
+    ChannelSelect { ids: Vec<Expr>, target: String, var_type: QBType, span: Span },
+
     /// Array element assignment: arr(i, j) = expr
     ArrayAssign {
         name: String,
@@ -776,6 +1069,16 @@ pub enum Statement {
         message: Option<Expr>,
         span: Span,
     },
+    /// PROFILE ON | OFF — clear the profile counters and start, or stop
+    Profile {
+        on: bool,
+        span: Span,
+    },
+    /// PROFILE.DUMP [var$] — print the profile report, or store it in var$
+    ProfileDump {
+        target: Option<(String, QBType)>,
+        span: Span,
+    },
     /// FOR EACH var IN array ... NEXT
     ForEach {
         var: String,
@@ -799,6 +1102,25 @@ pub enum Statement {
         body: Vec<Statement>,
         span: Span,
     },
+    /// TASK.POOL workers, stack_size, priority [, core]
+    TaskPool {
+        workers: Expr,
+        stack_size: Expr,
+        priority: Expr,
+        core: Option<Expr>,
+        span: Span,
+    },
+    /// SPAWN [job%] ... END SPAWN
+    Spawn {
+        target: Option<(String, QBType)>,
+        body: Vec<Statement>,
+        span: Span,
+    },
+    /// WAIT job%
+    Wait {
+        job: Expr,
+        span: Span,
+    },
     /// ON GPIO.CHANGE pin GOSUB label
     OnGpioChange {
         pin: Expr,
@@ -816,12 +1138,42 @@ pub enum Statement {
         target: String,
         span: Span,
     },
+    /// ON TCP.DATA GOSUB sub
+    OnTcpData {
+        target: String,
+        span: Span,
+    },
+    /// ON UART.LINE port [, delim] GOSUB sub
+    OnUartLine {
+        port: Expr,
+        delim: Option<Expr>,
+        target: String,
+        span: Span,
+    },
+    /// ON I2S.NEED GOSUB sub
+    OnI2sNeed {
+        target: String,
+        span: Span,
+    },
+    /// ON CRON id GOSUB sub
+    OnCron {
+        id: Expr,
+        target: String,
+        span: Span,
+    },
     /// MachineName.EVENT expr
     MachineEvent {
         machine_name: String,
         event: Expr,
         span: Span,
     },
+    /// MachineName.STATE var — state number into a numeric var, name into a string
+    MachineState {
+        machine_name: String,
+        target: String,
+        var_type: QBType,
+        span: Span,
+    },
 }
 
 // ── DO...LOOP condition ─────────────────────────────────
@@ -944,6 +1296,21 @@ impl Expr {
     }
 }
 
+/// Whole-array reductions that leave one value in a variable
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ArrayReduceOp {
+    Sum,
+    Min,
+    Max,
+}
+
+/// Level detectors over a block of samples
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DspLevelOp {
+    Rms,
+    Peak,
+}
+
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum BinOp {
     Add,
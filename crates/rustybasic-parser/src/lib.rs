@@ -373,43 +373,94 @@ impl Parser {
             Some(TokenKind::I2cRead) => self.parse_i2c_read(),
             Some(TokenKind::SpiSetup) => self.parse_spi_setup(),
             Some(TokenKind::SpiTransfer) => self.parse_spi_transfer(),
+            Some(TokenKind::I2cSend) => self.parse_i2c_send(),
+            Some(TokenKind::I2cReadStr) => self.parse_i2c_read_str(),
+            Some(TokenKind::I2cWriteRead) => self.parse_i2c_write_read(),
+            Some(TokenKind::SpiSend) => self.parse_spi_send(),
+            Some(TokenKind::SpiTransferStr) => self.parse_spi_transfer_str(),
+            Some(TokenKind::SpiFlush) => self.parse_spi_flush(),
             Some(TokenKind::WifiConnect) => self.parse_wifi_connect(),
             Some(TokenKind::WifiStatus) => self.parse_wifi_status(),
             Some(TokenKind::WifiDisconnect) => self.parse_wifi_disconnect(),
             Some(TokenKind::Delay) => self.parse_delay(),
             Some(TokenKind::AdcRead) => self.parse_adc_read(),
+            Some(TokenKind::AdcStream) => self.parse_adc_stream(),
+            Some(TokenKind::AdcBlock) => self.parse_adc_block(),
+            Some(TokenKind::AdcStop) => self.parse_adc_stop(),
             Some(TokenKind::PwmSetup) => self.parse_pwm_setup(),
             Some(TokenKind::PwmDuty) => self.parse_pwm_duty(),
             Some(TokenKind::UartSetup) => self.parse_uart_setup(),
+            Some(TokenKind::UartSend) => self.parse_uart_send(),
+            Some(TokenKind::UartReadStr) => self.parse_uart_read_str(),
+            Some(TokenKind::UartLine) => self.parse_uart_line(),
             Some(TokenKind::UartWrite) => self.parse_uart_write(),
             Some(TokenKind::UartRead) => self.parse_uart_read(),
             Some(TokenKind::TimerStart) => self.parse_timer_start(),
             Some(TokenKind::TimerElapsed) => self.parse_timer_elapsed(),
+            Some(TokenKind::TimerMicros) => self.parse_timer_micros(),
+            Some(TokenKind::TimerAfter) | Some(TokenKind::TimerEvery) => self.parse_timer_schedule(),
+            Some(TokenKind::TimerCancel) => self.parse_timer_cancel(),
             Some(TokenKind::HttpGet) => self.parse_http_get(),
             Some(TokenKind::HttpPost) => self.parse_http_post(),
+            Some(TokenKind::HttpDownload) => self.parse_http_download(),
+            Some(TokenKind::HttpStream) => self.parse_http_stream(),
+            Some(TokenKind::HttpChunk) => self.parse_http_chunk(),
             Some(TokenKind::NvsWrite) => self.parse_nvs_write(),
             Some(TokenKind::NvsRead) => self.parse_nvs_read(),
+            Some(TokenKind::NvsCommit) => {
+                let span = self.current_span();
+                self.advance();
+                Ok(Statement::NvsCommit { span })
+            }
+            Some(TokenKind::NvsAutocommit) => {
+                let start = self.current_span();
+                self.advance();
+                let ms = self.parse_expr()?;
+                Ok(Statement::NvsAutocommit { ms, span: start.merge(self.prev_span()) })
+            }
             Some(TokenKind::MqttConnect) => self.parse_mqtt_connect(),
             Some(TokenKind::MqttDisconnect) => self.parse_mqtt_disconnect(),
             Some(TokenKind::MqttPublish) => self.parse_mqtt_publish(),
             Some(TokenKind::MqttSubscribe) => self.parse_mqtt_subscribe(),
             Some(TokenKind::MqttReceive) => self.parse_mqtt_receive(),
+            Some(TokenKind::MqttTopic) => self.parse_mqtt_topic(),
+            Some(TokenKind::MqttCoalesce) => self.parse_mqtt_coalesce(),
+            Some(TokenKind::MqttFlush) => {
+                let span = self.current_span();
+                self.advance();
+                Ok(Statement::MqttFlush { span })
+            }
             Some(TokenKind::BleInit) => self.parse_ble_init(),
             Some(TokenKind::BleAdvertise) => self.parse_ble_advertise(),
             Some(TokenKind::BleScan) => self.parse_ble_scan(),
             Some(TokenKind::BleSend) => self.parse_ble_send(),
             Some(TokenKind::BleReceive) => self.parse_ble_receive(),
+            Some(TokenKind::BleInterval) => self.parse_ble_interval(),
+            Some(TokenKind::BleMtu) => {
+                let start = self.current_span();
+                self.advance();
+                let (target, var_type) = self.expect_variable()?;
+                Ok(Statement::BleMtu { target, var_type, span: start.merge(self.prev_span()) })
+            }
             Some(TokenKind::JsonGet) => self.parse_json_get(),
             Some(TokenKind::JsonSet) => self.parse_json_set(),
             Some(TokenKind::JsonCount) => self.parse_json_count(),
+            Some(TokenKind::JsonExtract) => self.parse_json_extract(),
+            Some(TokenKind::JsonBegin) => self.parse_json_begin(false),
+            Some(TokenKind::JsonBeginArray) => self.parse_json_begin(true),
+            Some(TokenKind::JsonAdd) => self.parse_json_add(true),
+            Some(TokenKind::JsonPush) => self.parse_json_add(false),
+            Some(TokenKind::JsonEnd) => self.parse_json_end(),
             Some(TokenKind::LedSetup) => self.parse_led_setup(),
             Some(TokenKind::LedSet) => self.parse_led_set(),
+            Some(TokenKind::LedSetAll) => self.parse_led_set_all(),
             Some(TokenKind::LedShow) => self.parse_led_show(),
             Some(TokenKind::LedClear) => self.parse_led_clear(),
             Some(TokenKind::DeepSleep) => self.parse_deepsleep(),
             Some(TokenKind::EspnowInit) => self.parse_espnow_init(),
             Some(TokenKind::EspnowSend) => self.parse_espnow_send(),
             Some(TokenKind::EspnowReceive) => self.parse_espnow_receive(),
+            Some(TokenKind::EspnowPeer) => self.parse_espnow_peer(),
             Some(TokenKind::Data) => self.parse_data(),
             Some(TokenKind::Read) => self.parse_read(),
             Some(TokenKind::Restore) => self.parse_restore(),
@@ -440,14 +491,36 @@ impl Parser {
             Some(TokenKind::UdpSend) => self.parse_udp_send(),
             Some(TokenKind::UdpReceive) => self.parse_udp_receive(),
             Some(TokenKind::Assert) => self.parse_assert(),
+            Some(TokenKind::Profile) => self.parse_profile(),
+            Some(TokenKind::ProfileDump) => {
+                let start = self.current_span();
+                self.advance();
+                let target = match self.peek_kind() {
+                    Some(
+                        TokenKind::Ident(_)
+                        | TokenKind::IntIdent(_)
+                        | TokenKind::StringIdent(_)
+                        | TokenKind::LongIdent(_)
+                        | TokenKind::SingleIdent(_)
+                        | TokenKind::DoubleIdent(_),
+                    ) => Some(self.expect_variable()?),
+                    _ => None,
+                };
+                Ok(Statement::ProfileDump { target, span: start.merge(self.prev_span()) })
+            }
             Some(TokenKind::Try) => self.parse_try_catch(),
             Some(TokenKind::Task) => self.parse_task_stmt(),
+            Some(TokenKind::TaskPool) => self.parse_task_pool(),
+            Some(TokenKind::Spawn) => self.parse_spawn(),
+            Some(TokenKind::Wait) => self.parse_wait(),
             Some(TokenKind::NtpSync) => self.parse_ntp_sync(),
             Some(TokenKind::NtpTime) => self.parse_ntp_time(),
             Some(TokenKind::NtpEpoch) => self.parse_ntp_epoch(),
             Some(TokenKind::FileOpen) => self.parse_file_open(),
             Some(TokenKind::FileWrite) => self.parse_file_write(),
             Some(TokenKind::FileReadStr) => self.parse_file_read_str(),
+            Some(TokenKind::FileReadLine) => self.parse_file_read_line(),
+            Some(TokenKind::FileEof) => self.parse_file_eof(),
             Some(TokenKind::FileClose) => self.parse_file_close(),
             Some(TokenKind::FileDelete) => self.parse_file_delete(),
             Some(TokenKind::FileExists) => self.parse_file_exists(),
@@ -460,6 +533,7 @@ impl Parser {
             Some(TokenKind::TcpSend) => self.parse_tcp_send(),
             Some(TokenKind::TcpReceiveStr) => self.parse_tcp_receive_str(),
             Some(TokenKind::TcpClose) => self.parse_tcp_close(),
+            Some(TokenKind::TcpClient) => self.parse_tcp_client(),
             Some(TokenKind::WdtEnable) => self.parse_wdt_enable(),
             Some(TokenKind::WdtFeed) => self.parse_wdt_feed(),
             Some(TokenKind::WdtDisable) => self.parse_wdt_disable(),
@@ -468,25 +542,61 @@ impl Parser {
             Some(TokenKind::I2sInit) => self.parse_i2s_init(),
             Some(TokenKind::I2sWrite) => self.parse_i2s_write(),
             Some(TokenKind::I2sStop) => self.parse_i2s_stop(),
+            Some(TokenKind::I2sPins) => self.parse_i2s_pins(),
+            Some(TokenKind::I2sRead) => self.parse_i2s_read(),
             Some(TokenKind::WebStart) => self.parse_web_start(),
             Some(TokenKind::WebWaitStr) => self.parse_web_wait_str(),
             Some(TokenKind::WebBodyStr) => self.parse_web_body_str(),
             Some(TokenKind::WebReply) => self.parse_web_reply(),
             Some(TokenKind::WebStop) => self.parse_web_stop(),
+            Some(TokenKind::WebRoute) => self.parse_web_route(),
+            Some(TokenKind::WebRequest) => self.parse_web_request(),
+            Some(TokenKind::WebServe) => self.parse_web_serve(),
             Some(TokenKind::SdInit) => self.parse_sd_init(),
             Some(TokenKind::SdOpen) => self.parse_sd_open(),
             Some(TokenKind::SdWrite) => self.parse_sd_write(),
             Some(TokenKind::SdReadStr) => self.parse_sd_read_str(),
             Some(TokenKind::SdClose) => self.parse_sd_close(),
             Some(TokenKind::SdFree) => self.parse_sd_free(),
+            Some(TokenKind::Flush) => self.parse_flush(),
+            Some(TokenKind::ConsoleMode) => self.parse_console_mode(),
+            Some(TokenKind::LogOpen) => self.parse_log_open(),
+            Some(TokenKind::LogWrite) => self.parse_log_write(),
+            Some(TokenKind::LogFlush) => self.parse_log_flush(),
+            Some(TokenKind::LogClose) => self.parse_log_close(),
+            Some(TokenKind::LogDropped) => self.parse_log_dropped(),
+            Some(TokenKind::EventCoalesced) => self.parse_event_coalesced(),
+            Some(TokenKind::EventDropped) => self.parse_event_dropped(),
             Some(TokenKind::Yield) => self.parse_yield(),
             Some(TokenKind::Await) => self.parse_await(),
+            Some(TokenKind::Async) => self.parse_async(),
             Some(TokenKind::CronAdd) => self.parse_cron_add(),
             Some(TokenKind::CronCheck) => self.parse_cron_check(),
             Some(TokenKind::CronRemove) => self.parse_cron_remove(),
             Some(TokenKind::RegexMatch) => self.parse_regex_match(),
             Some(TokenKind::RegexFindStr) => self.parse_regex_find_str(),
             Some(TokenKind::RegexReplaceStr) => self.parse_regex_replace_str(),
+            Some(TokenKind::ValNext) => self.parse_val_next(),
+            Some(TokenKind::ArraySum) => self.parse_array_reduce(ArrayReduceOp::Sum),
+            Some(TokenKind::ArrayMin) => self.parse_array_reduce(ArrayReduceOp::Min),
+            Some(TokenKind::ArrayMax) => self.parse_array_reduce(ArrayReduceOp::Max),
+            Some(TokenKind::ArrayDot) => self.parse_array_dot(),
+            Some(TokenKind::ArrayFill) => self.parse_array_fill(),
+            Some(TokenKind::ArrayCopy) => self.parse_array_copy(),
+            Some(TokenKind::ArrayScale) => self.parse_array_scale(),
+            Some(TokenKind::DspFir) | Some(TokenKind::DspBiquad) => self.parse_dsp_filter(),
+            Some(TokenKind::DspFft) | Some(TokenKind::DspMag) => self.parse_dsp_complex(),
+            Some(TokenKind::DspRms) => self.parse_dsp_level(DspLevelOp::Rms),
+            Some(TokenKind::DspPeak) => self.parse_dsp_level(DspLevelOp::Peak),
+            Some(TokenKind::StringBuilder) => self.parse_string_builder(),
+            Some(TokenKind::SbAppend) => self.parse_sb_append(),
+            Some(TokenKind::SbToString) => self.parse_sb_tostring(),
+            Some(TokenKind::SbClear) => self.parse_sb_clear(),
+            Some(TokenKind::SbFree) => self.parse_sb_free(),
+            Some(TokenKind::Channel) => self.parse_channel(),
+            Some(TokenKind::ChannelSend) => self.parse_channel_send(),
+            Some(TokenKind::ChannelReceive) => self.parse_channel_receive(),
+            Some(TokenKind::ChannelSelect) => self.parse_channel_select(),
             // Implicit LET or SUB call: identifier ...
             Some(
                 TokenKind::Ident(_)
@@ -584,6 +694,19 @@ impl Parser {
             });
         }
 
+        // MachineName.STATE var (not an assignment to a field called STATE)
+        if name.ends_with(".STATE") && !self.check(TokenKind::Eq) {
+            let machine_name = name[..name.len() - 6].to_string(); // strip ".STATE"
+            let (target, target_type) = self.expect_variable()?;
+            let span = start.merge(self.prev_span());
+            return Ok(Statement::MachineState {
+                machine_name,
+                target,
+                var_type: target_type,
+                span,
+            });
+        }
+
         // Scalar assignment: name = expr
         if self.eat(TokenKind::Eq) {
             let expr = self.parse_expr()?;
@@ -1264,6 +1387,56 @@ impl Parser {
         })
     }
 
+    fn parse_i2c_send(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let addr = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let data = self.parse_expr()?;
+        Ok(Statement::I2cSend {
+            addr,
+            data,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_i2c_read_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let addr = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let length = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::I2cReadStr {
+            addr,
+            length,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_i2c_write_read(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let addr = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let data = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let length = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::I2cWriteRead {
+            addr,
+            data,
+            length,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_spi_setup(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1286,6 +1459,36 @@ impl Parser {
         })
     }
 
+    fn parse_spi_send(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let data = self.parse_expr()?;
+        Ok(Statement::SpiSend {
+            data,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_spi_transfer_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let data = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::SpiTransferStr {
+            data,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_spi_flush(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::SpiFlush { span })
+    }
+
     fn parse_spi_transfer(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1354,6 +1557,44 @@ impl Parser {
         })
     }
 
+    fn parse_adc_stream(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let pin = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let rate = self.parse_expr()?;
+        Ok(Statement::AdcStream {
+            pin,
+            rate,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_adc_block(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (array, _) = self.expect_variable()?;
+        if self.eat(TokenKind::LParen) {
+            self.expect(TokenKind::RParen)?;
+        }
+        let count = if self.eat(TokenKind::Comma) {
+            Some(self.expect_variable()?)
+        } else {
+            None
+        };
+        Ok(Statement::AdcBlock {
+            array,
+            count,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_adc_stop(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::AdcStop { span })
+    }
+
     fn parse_pwm_setup(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1396,11 +1637,58 @@ impl Parser {
         let tx = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
         let rx = self.parse_expr()?;
+        let rx_buffer = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
         Ok(Statement::UartSetup {
             port,
             baud,
             tx,
             rx,
+            rx_buffer,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_uart_send(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let port = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let data = self.parse_expr()?;
+        Ok(Statement::UartSend {
+            port,
+            data,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_uart_read_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let port = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let max = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::UartReadStr {
+            port,
+            max,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_uart_line(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::UartLine {
+            target,
+            var_type,
             span: start.merge(self.prev_span()),
         })
     }
@@ -1449,6 +1737,45 @@ impl Parser {
         })
     }
 
+    fn parse_timer_micros(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::TimerMicros {
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    /// Parse TIMER.AFTER / TIMER.EVERY us, sub [, id%]
+    fn parse_timer_schedule(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        let every = self.peek_kind() == Some(&TokenKind::TimerEvery);
+        self.advance();
+        let micros = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let target = self.expect_label_target()?;
+        let id = if self.eat(TokenKind::Comma) {
+            Some(self.expect_variable()?)
+        } else {
+            None
+        };
+        let span = start.merge(self.prev_span());
+        if every {
+            Ok(Statement::TimerEvery { micros, target, id, span })
+        } else {
+            Ok(Statement::TimerAfter { micros, target, id, span })
+        }
+    }
+
+    fn parse_timer_cancel(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let id = self.parse_expr()?;
+        Ok(Statement::TimerCancel { id, span: start.merge(self.prev_span()) })
+    }
+
     fn parse_http_get(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1463,6 +1790,51 @@ impl Parser {
         })
     }
 
+    fn parse_http_download(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let url = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let path = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::HttpDownload {
+            url,
+            path,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_http_stream(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let url = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let handler = self.expect_ident_name()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::HttpStream {
+            url,
+            handler,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_http_chunk(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::HttpChunk {
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_http_post(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1532,9 +1904,40 @@ impl Parser {
         let topic = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
         let message = self.parse_expr()?;
+        let qos = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        let retain = if qos.is_some() && self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
         Ok(Statement::MqttPublish {
             topic,
             message,
+            qos,
+            retain,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_mqtt_coalesce(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let topic = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let mode = self.parse_expr()?;
+        let n = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::MqttCoalesce {
+            topic,
+            mode,
+            n,
             span: start.merge(self.prev_span()),
         })
     }
@@ -1560,6 +1963,17 @@ impl Parser {
         })
     }
 
+    fn parse_mqtt_topic(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::MqttTopic {
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_ble_init(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1612,16 +2026,32 @@ impl Parser {
         })
     }
 
-    fn parse_json_get(&mut self) -> ParseResult<Statement> {
+    fn parse_ble_interval(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let json = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let key = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::JsonGet {
-            json,
+        let min_ms = self.parse_expr()?;
+        let max_ms = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::BleInterval {
+            min_ms,
+            max_ms,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_json_get(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let json = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let key = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::JsonGet {
+            json,
             key,
             target,
             var_type,
@@ -1663,6 +2093,81 @@ impl Parser {
         })
     }
 
+    fn parse_json_extract(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let json = self.parse_expr()?;
+        let mut fields = Vec::new();
+        while self.check(TokenKind::Comma) {
+            self.advance();
+            let path = self.parse_expr()?;
+            self.expect(TokenKind::Comma)?;
+            let (target, var_type) = self.expect_variable()?;
+            fields.push((path, target, var_type));
+        }
+        if fields.is_empty() {
+            return Err(self.error("JSON.EXTRACT needs at least one path, variable pair"));
+        }
+        // Matches RB_JSON_MAX_PATHS in the runtime
+        if fields.len() > 16 {
+            return Err(self.error("JSON.EXTRACT supports at most 16 paths"));
+        }
+        Ok(Statement::JsonExtract {
+            json,
+            fields,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_json_begin(&mut self, is_array: bool) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let handle = self.parse_expr()?;
+        let key = if self.check(TokenKind::Comma) {
+            self.advance();
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::JsonBegin {
+            handle,
+            key,
+            is_array,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_json_add(&mut self, keyed: bool) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let handle = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let key = if keyed {
+            let key = self.parse_expr()?;
+            self.expect(TokenKind::Comma)?;
+            Some(key)
+        } else {
+            None
+        };
+        let value = self.parse_expr()?;
+        Ok(Statement::JsonAdd {
+            handle,
+            key,
+            value,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
+    fn parse_json_end(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let handle = self.parse_expr()?;
+        Ok(Statement::JsonEnd {
+            handle,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_led_setup(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
@@ -1695,6 +2200,19 @@ impl Parser {
         })
     }
 
+    fn parse_led_set_all(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (array, _) = self.expect_variable()?;
+        if self.eat(TokenKind::LParen) {
+            self.expect(TokenKind::RParen)?;
+        }
+        Ok(Statement::LedSetAll {
+            array,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_led_show(&mut self) -> ParseResult<Statement> {
         let span = self.current_span();
         self.advance();
@@ -1747,6 +2265,20 @@ impl Parser {
         })
     }
 
+    fn parse_espnow_peer(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let mac = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::EspnowPeer {
+            mac,
+            target,
+            var_type,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     // ── DATA/READ/RESTORE ────────────────────────────────────
 
     fn parse_data(&mut self) -> ParseResult<Statement> {
@@ -1788,6 +2320,13 @@ impl Parser {
         self.advance(); // READ
         let mut variables = Vec::new();
         let (name, var_type) = self.expect_variable()?;
+        if self.eat(TokenKind::LParen) {
+            self.expect(TokenKind::RParen)?;
+            return Ok(Statement::ReadArray {
+                array: name,
+                span: start.merge(self.prev_span()),
+            });
+        }
         variables.push((name, var_type));
         while self.eat(TokenKind::Comma) {
             let (name, var_type) = self.expect_variable()?;
@@ -1800,14 +2339,21 @@ impl Parser {
     }
 
     fn parse_restore(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
+        let start = self.current_span();
         self.advance(); // RESTORE
-        Ok(Statement::Restore { span })
+        let label = match self.peek_kind() {
+            Some(TokenKind::IntLiteral(_)) | Some(TokenKind::Ident(_)) => Some(self.expect_label_target()?),
+            _ => None,
+        };
+        Ok(Statement::Restore {
+            label,
+            span: start.merge(self.prev_span()),
+        })
     }
 
     // ── Classic BASIC extensions ──────────────────────────────
 
-    /// Parse ON ... GOTO / ON ... GOSUB / ON ERROR GOTO / ON GPIO.CHANGE / ON TIMER / ON MQTT.MESSAGE
+    /// Parse ON ... GOTO / ON ... GOSUB / ON ERROR GOTO / ON GPIO.CHANGE / ON TIMER / ON MQTT.MESSAGE / ON TCP.DATA / ON UART.LINE / ON I2S.NEED / ON CRON
     fn parse_on(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance(); // ON
@@ -1838,7 +2384,7 @@ impl Parser {
             });
         }
 
-        // ON MQTT.MESSAGE GOSUB label
+        // ON MQTT.MESSAGE GOSUB sub
         if self.check_ident("MQTT.MESSAGE") {
             self.advance(); // MQTT.MESSAGE
             self.expect(TokenKind::Gosub)?;
@@ -1849,6 +2395,60 @@ impl Parser {
             });
         }
 
+        // ON TCP.DATA GOSUB sub
+        if self.check_ident("TCP.DATA") {
+            self.advance(); // TCP.DATA
+            self.expect(TokenKind::Gosub)?;
+            let target = self.expect_label_target()?;
+            return Ok(Statement::OnTcpData {
+                target,
+                span: start.merge(self.prev_span()),
+            });
+        }
+
+        // ON UART.LINE port [, delim] GOSUB sub
+        if self.check_ident("UART.LINE") {
+            self.advance(); // UART.LINE
+            let port = self.parse_expr()?;
+            let delim = if self.eat(TokenKind::Comma) {
+                Some(self.parse_expr()?)
+            } else {
+                None
+            };
+            self.expect(TokenKind::Gosub)?;
+            let target = self.expect_label_target()?;
+            return Ok(Statement::OnUartLine {
+                port,
+                delim,
+                target,
+                span: start.merge(self.prev_span()),
+            });
+        }
+
+        // ON I2S.NEED GOSUB sub
+        if self.check_ident("I2S.NEED") {
+            self.advance(); // I2S.NEED
+            self.expect(TokenKind::Gosub)?;
+            let target = self.expect_label_target()?;
+            return Ok(Statement::OnI2sNeed {
+                target,
+                span: start.merge(self.prev_span()),
+            });
+        }
+
+        // ON CRON id GOSUB sub
+        if self.check_ident("CRON") {
+            self.advance(); // CRON
+            let id = self.parse_expr()?;
+            self.expect(TokenKind::Gosub)?;
+            let target = self.expect_label_target()?;
+            return Ok(Statement::OnCron {
+                id,
+                target,
+                span: start.merge(self.prev_span()),
+            });
+        }
+
         // ON ERROR GOTO label
         if self.eat(TokenKind::Error) {
             self.expect(TokenKind::Goto)?;
@@ -1940,7 +2540,30 @@ impl Parser {
     fn parse_randomize(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance(); // RANDOMIZE
-        let seed = self.parse_expr()?;
+        if self.check_ident("ARRAY") {
+            self.advance();
+            let (array, _) = self.expect_variable()?;
+            if self.eat(TokenKind::LParen) {
+                self.expect(TokenKind::RParen)?;
+            }
+            let range = if self.eat(TokenKind::Comma) {
+                let lo = self.parse_expr()?;
+                self.expect(TokenKind::Comma)?;
+                Some((lo, self.parse_expr()?))
+            } else {
+                None
+            };
+            return Ok(Statement::RandomizeArray {
+                array,
+                range,
+                span: start.merge(self.prev_span()),
+            });
+        }
+        let seed = if self.at_newline() || self.check(TokenKind::Colon) {
+            None
+        } else {
+            Some(self.parse_expr()?)
+        };
         Ok(Statement::Randomize {
             seed,
             span: start.merge(self.prev_span()),
@@ -2236,27 +2859,80 @@ impl Parser {
         let path = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
         let mode = self.parse_expr()?;
-        Ok(Statement::FileOpen { path, mode, span: start.merge(self.prev_span()) })
+        let handle = if self.eat(TokenKind::Comma) {
+            Some(self.expect_variable()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileOpen { path, mode, handle, span: start.merge(self.prev_span()) })
     }
 
     fn parse_file_write(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let data = self.parse_expr()?;
-        Ok(Statement::FileWrite { data, span: start.merge(self.prev_span()) })
+        let handle = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileWrite { data, handle, span: start.merge(self.prev_span()) })
     }
 
     fn parse_file_read_str(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::FileReadStr { target, var_type, span: start.merge(self.prev_span()) })
+        let max = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        let handle = if max.is_some() && self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileReadStr { target, var_type, max, handle, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_file_read_line(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        let handle = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileReadLine { target, var_type, handle, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_file_eof(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        let handle = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileEof { target, var_type, handle, span: start.merge(self.prev_span()) })
     }
 
     fn parse_file_close(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
+        let start = self.current_span();
         self.advance();
-        Ok(Statement::FileClose { span })
+        let handle = if !self.at_newline()
+            && !self.at_end()
+            && !self.check(TokenKind::Colon)
+            && !self.check(TokenKind::Else)
+        {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::FileClose { handle, span: start.merge(self.prev_span()) })
     }
 
     fn parse_file_delete(&mut self) -> ParseResult<Statement> {
@@ -2320,7 +2996,12 @@ impl Parser {
         let start = self.current_span();
         self.advance();
         let data = self.parse_expr()?;
-        Ok(Statement::TcpSend { data, span: start.merge(self.prev_span()) })
+        let conn = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::TcpSend { data, conn, span: start.merge(self.prev_span()) })
     }
 
     fn parse_tcp_receive_str(&mut self) -> ParseResult<Statement> {
@@ -2331,9 +3012,25 @@ impl Parser {
     }
 
     fn parse_tcp_close(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
+        let start = self.current_span();
         self.advance();
-        Ok(Statement::TcpClose { span })
+        let conn = if !self.at_newline()
+            && !self.at_end()
+            && !self.check(TokenKind::Colon)
+            && !self.check(TokenKind::Else)
+        {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::TcpClose { conn, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_tcp_client(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::TcpClient { target, var_type, span: start.merge(self.prev_span()) })
     }
 
     fn parse_wdt_enable(&mut self) -> ParseResult<Statement> {
@@ -2399,6 +3096,27 @@ impl Parser {
         Ok(Statement::I2sStop { span })
     }
 
+    fn parse_i2s_pins(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let bclk = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let ws = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let dout = self.parse_expr()?;
+        let din = if self.eat(TokenKind::Comma) { Some(self.parse_expr()?) } else { None };
+        Ok(Statement::I2sPins { bclk, ws, dout, din, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_i2s_read(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let length = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::I2sRead { length, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
     // ── Web Server ──────────────────────────────────────
     fn parse_web_start(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
@@ -2414,146 +3132,490 @@ impl Parser {
         Ok(Statement::WebWaitStr { target, var_type, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_web_body_str(&mut self) -> ParseResult<Statement> {
+    fn parse_web_body_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::WebBodyStr { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_web_reply(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let status = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let body = self.parse_expr()?;
+        let request = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::WebReply { status, body, request, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_web_stop(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::WebStop { span })
+    }
+
+    fn parse_web_route(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let method = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let path = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let handler = self.expect_ident_name()?;
+        Ok(Statement::WebRoute { method, path, handler, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_web_request(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::WebRequest { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_web_serve(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let prefix = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let dir = self.parse_expr()?;
+        Ok(Statement::WebServe { prefix, dir, span: start.merge(self.prev_span()) })
+    }
+
+    // ── SD Card ─────────────────────────────────────────
+    fn parse_sd_init(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let cs_pin = self.parse_expr()?;
+        Ok(Statement::SdInit { cs_pin, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_sd_open(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let path = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let mode = self.parse_expr()?;
+        let handle = if self.eat(TokenKind::Comma) {
+            Some(self.expect_variable()?)
+        } else {
+            None
+        };
+        Ok(Statement::SdOpen { path, mode, handle, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_sd_write(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let data = self.parse_expr()?;
+        Ok(Statement::SdWrite { data, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_sd_read_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        let max = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::SdReadStr { target, var_type, max, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_sd_close(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::SdClose { span })
+    }
+
+    fn parse_sd_free(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::SdFree { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_flush(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::Flush { span })
+    }
+
+    fn parse_console_mode(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let mode = self.parse_expr()?;
+        let n = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::ConsoleMode { mode, n, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_log_open(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let path = self.parse_expr()?;
+        let max_bytes = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        let keep = if max_bytes.is_some() && self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::LogOpen { path, max_bytes, keep, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_log_write(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let data = self.parse_expr()?;
+        Ok(Statement::LogWrite { data, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_log_flush(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::LogFlush { span })
+    }
+
+    fn parse_log_close(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::LogClose { span })
+    }
+
+    fn parse_log_dropped(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::LogDropped { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_event_coalesced(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::EventCoalesced { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_event_dropped(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::EventDropped { target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    // ── Async / Yield ───────────────────────────────────
+    fn parse_yield(&mut self) -> ParseResult<Statement> {
+        let span = self.current_span();
+        self.advance();
+        Ok(Statement::YieldStmt { span })
+    }
+
+    fn parse_await(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        if self.eat(TokenKind::Until) {
+            let condition = self.parse_expr()?;
+            return Ok(Statement::AwaitUntil { condition, span: start.merge(self.prev_span()) });
+        }
+        let ms = self.parse_expr()?;
+        Ok(Statement::AwaitStmt { ms, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_async(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance(); // ASYNC
+        self.eat_newline();
+
+        // Parse body until END ASYNC
+        let mut body = Vec::new();
+        loop {
+            self.skip_blank_lines();
+            if self.at_end() || self.check_end_keyword_ahead(TokenKind::Async) {
+                break;
+            }
+            let stmt = self.parse_statement()?;
+            body.push(stmt);
+            self.eat_newline();
+        }
+
+        self.expect_end_keyword(TokenKind::Async, "END ASYNC")?;
+
+        Ok(Statement::Async { body, span: start.merge(self.prev_span()) })
+    }
+
+    // ── Cron ────────────────────────────────────────────
+    fn parse_cron_add(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let id = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let expr = self.parse_expr()?;
+        Ok(Statement::CronAdd { id, expr, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_cron_check(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let id = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::CronCheck { id, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_cron_remove(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let id = self.parse_expr()?;
+        Ok(Statement::CronRemove { id, span: start.merge(self.prev_span()) })
+    }
+
+    // ── Regex ───────────────────────────────────────────
+    fn parse_regex_match(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let pattern = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let text = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::RegexMatch { pattern, text, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_regex_find_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let pattern = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let text = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::RegexFindStr { pattern, text, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_regex_replace_str(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let pattern = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let text = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let replacement = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::RegexReplaceStr { pattern, text, replacement, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_val_next(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let text = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let (pos, pos_type) = self.expect_variable()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::ValNext { text, pos, pos_type, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    // ── Array kernels ───────────────────────────────────
+
+    /// A whole-array argument: `a()` or just `a`
+    fn parse_array_arg(&mut self) -> ParseResult<String> {
+        let (array, _) = self.expect_variable()?;
+        if self.eat(TokenKind::LParen) {
+            self.expect(TokenKind::RParen)?;
+        }
+        Ok(array)
+    }
+
+    fn parse_array_reduce(&mut self, op: ArrayReduceOp) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let array = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::ArrayReduce { op, array, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_array_dot(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let a = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let b = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::ArrayDot { a, b, target, var_type, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_array_fill(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance();
+        let array = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let value = self.parse_expr()?;
+        Ok(Statement::ArrayFill { array, value, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_array_copy(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::WebBodyStr { target, var_type, span: start.merge(self.prev_span()) })
+        let src = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let dst = self.parse_array_arg()?;
+        Ok(Statement::ArrayCopy { src, dst, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_web_reply(&mut self) -> ParseResult<Statement> {
+    fn parse_array_scale(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let status = self.parse_expr()?;
+        let array = self.parse_array_arg()?;
         self.expect(TokenKind::Comma)?;
-        let body = self.parse_expr()?;
-        Ok(Statement::WebReply { status, body, span: start.merge(self.prev_span()) })
+        let factor = self.parse_expr()?;
+        let offset = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::ArrayScale { array, factor, offset, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_web_stop(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
-        self.advance();
-        Ok(Statement::WebStop { span })
-    }
+    // ── DSP ─────────────────────────────────────────────
 
-    // ── SD Card ─────────────────────────────────────────
-    fn parse_sd_init(&mut self) -> ParseResult<Statement> {
+    fn parse_dsp_filter(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
+        let fir = self.check(TokenKind::DspFir);
         self.advance();
-        let cs_pin = self.parse_expr()?;
-        Ok(Statement::SdInit { cs_pin, span: start.merge(self.prev_span()) })
+        let array = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let coeffs = self.parse_array_arg()?;
+        let state = if self.eat(TokenKind::Comma) {
+            Some(self.parse_array_arg()?)
+        } else {
+            None
+        };
+        let span = start.merge(self.prev_span());
+        if fir {
+            Ok(Statement::DspFir { array, coeffs, state, span })
+        } else {
+            Ok(Statement::DspBiquad { array, coeffs, state, span })
+        }
     }
 
-    fn parse_sd_open(&mut self) -> ParseResult<Statement> {
+    fn parse_dsp_complex(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
+        let fft = self.check(TokenKind::DspFft);
         self.advance();
-        let path = self.parse_expr()?;
+        let re = self.parse_array_arg()?;
         self.expect(TokenKind::Comma)?;
-        let mode = self.parse_expr()?;
-        Ok(Statement::SdOpen { path, mode, span: start.merge(self.prev_span()) })
+        let im = self.parse_array_arg()?;
+        let span = start.merge(self.prev_span());
+        if fft {
+            Ok(Statement::DspFft { re, im, span })
+        } else {
+            Ok(Statement::DspMag { re, im, span })
+        }
     }
 
-    fn parse_sd_write(&mut self) -> ParseResult<Statement> {
+    fn parse_dsp_level(&mut self, op: DspLevelOp) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let data = self.parse_expr()?;
-        Ok(Statement::SdWrite { data, span: start.merge(self.prev_span()) })
+        let array = self.parse_array_arg()?;
+        self.expect(TokenKind::Comma)?;
+        let (target, var_type) = self.expect_variable()?;
+        Ok(Statement::DspLevel { op, array, target, var_type, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_sd_read_str(&mut self) -> ParseResult<Statement> {
+    // ── String Builder ──────────────────────────────────
+    fn parse_string_builder(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::SdReadStr { target, var_type, span: start.merge(self.prev_span()) })
+        Ok(Statement::StringBuilderNew { target, var_type, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_sd_close(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
+    fn parse_sb_append(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
         self.advance();
-        Ok(Statement::SdClose { span })
+        let handle = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let value = self.parse_expr()?;
+        Ok(Statement::SbAppend { handle, value, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_sd_free(&mut self) -> ParseResult<Statement> {
+    fn parse_sb_tostring(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
+        let handle = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
         let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::SdFree { target, var_type, span: start.merge(self.prev_span()) })
+        Ok(Statement::SbToString { handle, target, var_type, span: start.merge(self.prev_span()) })
     }
 
-    // ── Async / Yield ───────────────────────────────────
-    fn parse_yield(&mut self) -> ParseResult<Statement> {
-        let span = self.current_span();
+    fn parse_sb_clear(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
         self.advance();
-        Ok(Statement::YieldStmt { span })
+        let handle = self.parse_expr()?;
+        Ok(Statement::SbClear { handle, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_await(&mut self) -> ParseResult<Statement> {
+    fn parse_sb_free(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let ms = self.parse_expr()?;
-        Ok(Statement::AwaitStmt { ms, span: start.merge(self.prev_span()) })
+        let handle = self.parse_expr()?;
+        Ok(Statement::SbFree { handle, span: start.merge(self.prev_span()) })
     }
 
-    // ── Cron ────────────────────────────────────────────
-    fn parse_cron_add(&mut self) -> ParseResult<Statement> {
+    // ── Channels ────────────────────────────────────────
+    fn parse_channel(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let id = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
-        let expr = self.parse_expr()?;
-        Ok(Statement::CronAdd { id, expr, span: start.merge(self.prev_span()) })
+        let capacity = self.parse_expr()?;
+        Ok(Statement::ChannelNew { id, capacity, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_cron_check(&mut self) -> ParseResult<Statement> {
+    fn parse_channel_send(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let id = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
-        let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::CronCheck { id, target, var_type, span: start.merge(self.prev_span()) })
+        let value = self.parse_expr()?;
+        Ok(Statement::ChannelSend { id, value, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_cron_remove(&mut self) -> ParseResult<Statement> {
+    fn parse_channel_receive(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
         let id = self.parse_expr()?;
-        Ok(Statement::CronRemove { id, span: start.merge(self.prev_span()) })
-    }
-
-    // ── Regex ───────────────────────────────────────────
-    fn parse_regex_match(&mut self) -> ParseResult<Statement> {
-        let start = self.current_span();
-        self.advance();
-        let pattern = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let text = self.parse_expr()?;
         self.expect(TokenKind::Comma)?;
         let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::RegexMatch { pattern, text, target, var_type, span: start.merge(self.prev_span()) })
+        Ok(Statement::ChannelReceive { id, target, var_type, span: start.merge(self.prev_span()) })
     }
 
-    fn parse_regex_find_str(&mut self) -> ParseResult<Statement> {
+    fn parse_channel_select(&mut self) -> ParseResult<Statement> {
         let start = self.current_span();
         self.advance();
-        let pattern = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let text = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
         let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::RegexFindStr { pattern, text, target, var_type, span: start.merge(self.prev_span()) })
-    }
-
-    fn parse_regex_replace_str(&mut self) -> ParseResult<Statement> {
-        let start = self.current_span();
-        self.advance();
-        let pattern = self.parse_expr()?;
+        let mut ids = Vec::new();
         self.expect(TokenKind::Comma)?;
-        let text = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let replacement = self.parse_expr()?;
-        self.expect(TokenKind::Comma)?;
-        let (target, var_type) = self.expect_variable()?;
-        Ok(Statement::RegexReplaceStr { pattern, text, replacement, target, var_type, span: start.merge(self.prev_span()) })
+        ids.push(self.parse_expr()?);
+        while self.eat(TokenKind::Comma) {
+            ids.push(self.parse_expr()?);
+        }
+        Ok(Statement::ChannelSelect { ids, target, var_type, span: start.merge(self.prev_span()) })
     }
 
     // ── New language features ──────────────────────────────
@@ -2574,6 +3636,23 @@ impl Parser {
         })
     }
 
+    fn parse_profile(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance(); // PROFILE
+        let on = if self.eat(TokenKind::On) {
+            true
+        } else if self.check_ident("OFF") {
+            self.advance();
+            false
+        } else {
+            return Err(self.error("expected ON or OFF after PROFILE"));
+        };
+        Ok(Statement::Profile {
+            on,
+            span: start.merge(self.prev_span()),
+        })
+    }
+
     fn parse_for_each(&mut self, start: Span) -> ParseResult<Statement> {
         let (var, var_type) = self.expect_variable()?;
         self.expect(TokenKind::In)?;
@@ -2671,6 +3750,56 @@ impl Parser {
         })
     }
 
+    fn parse_task_pool(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance(); // TASK.POOL
+        let workers = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let stack_size = self.parse_expr()?;
+        self.expect(TokenKind::Comma)?;
+        let priority = self.parse_expr()?;
+        let core = if self.eat(TokenKind::Comma) {
+            Some(self.parse_expr()?)
+        } else {
+            None
+        };
+        Ok(Statement::TaskPool { workers, stack_size, priority, core, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_spawn(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance(); // SPAWN
+        let target = if self.at_newline() {
+            None
+        } else {
+            Some(self.expect_variable()?)
+        };
+        self.eat_newline();
+
+        // Parse body until END SPAWN
+        let mut body = Vec::new();
+        loop {
+            self.skip_blank_lines();
+            if self.at_end() || self.check_end_keyword_ahead(TokenKind::Spawn) {
+                break;
+            }
+            let stmt = self.parse_statement()?;
+            body.push(stmt);
+            self.eat_newline();
+        }
+
+        self.expect_end_keyword(TokenKind::Spawn, "END SPAWN")?;
+
+        Ok(Statement::Spawn { target, body, span: start.merge(self.prev_span()) })
+    }
+
+    fn parse_wait(&mut self) -> ParseResult<Statement> {
+        let start = self.current_span();
+        self.advance(); // WAIT
+        let job = self.parse_expr()?;
+        Ok(Statement::Wait { job, span: start.merge(self.prev_span()) })
+    }
+
     fn parse_enum_def(&mut self) -> ParseResult<EnumDef> {
         let start = self.current_span();
         self.advance(); // ENUM
@@ -3536,4 +4665,361 @@ mod tests {
             assert_eq!(indices.len(), 2);
         }
     }
+
+    #[test]
+    fn test_json_extract_fields() {
+        let prog = parse_str("JSON.EXTRACT j$, \"a.b\", x$, \"c.0\", y$").unwrap();
+        if let Statement::JsonExtract { fields, .. } = &prog.body[0] {
+            assert_eq!(fields.len(), 2);
+            assert_eq!(fields[1].1, "Y$");
+        } else {
+            panic!("expected JsonExtract");
+        }
+        assert!(parse_str("JSON.EXTRACT j$").is_err());
+    }
+
+    #[test]
+    fn test_json_writer() {
+        let prog = parse_str("JSON.BEGIN sb%\nJSON.BEGINARRAY sb%, \"vals\"\nJSON.PUSH sb%, 1\nJSON.END sb%\nJSON.ADD sb%, \"t\", 2.5\nJSON.END sb%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::JsonBegin { key: None, is_array: false, .. }));
+        assert!(matches!(&prog.body[1], Statement::JsonBegin { key: Some(_), is_array: true, .. }));
+        assert!(matches!(&prog.body[2], Statement::JsonAdd { key: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::JsonEnd { .. }));
+        assert!(matches!(&prog.body[4], Statement::JsonAdd { key: Some(_), .. }));
+    }
+
+    #[test]
+    fn test_string_builder() {
+        let prog = parse_str("STRINGBUILDER sb%\nSB.APPEND sb%, \"t=\"\nSB.APPEND sb%, 21.5\nSB.TOSTRING sb%, msg$\nSB.FREE sb%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::StringBuilderNew { .. }));
+        assert!(matches!(&prog.body[1], Statement::SbAppend { .. }));
+        assert!(matches!(&prog.body[2], Statement::SbAppend { value: Expr::FloatLiteral { .. }, .. }));
+        if let Statement::SbToString { target, .. } = &prog.body[3] {
+            assert_eq!(target, "MSG$");
+        } else {
+            panic!("expected SbToString");
+        }
+        assert!(matches!(&prog.body[4], Statement::SbFree { .. }));
+    }
+
+    #[test]
+    fn test_spawn_wait() {
+        let prog = parse_str("TASK.POOL 2, 4096, 1\nSPAWN job%\n    PRINT 1\nEND SPAWN\nSPAWN\nEND SPAWN\nWAIT job%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::TaskPool { core: None, .. }));
+        if let Statement::Spawn { target: Some((name, _)), body, .. } = &prog.body[1] {
+            assert_eq!(name, "JOB%");
+            assert_eq!(body.len(), 1);
+        } else {
+            panic!("expected Spawn with a target");
+        }
+        assert!(matches!(&prog.body[2], Statement::Spawn { target: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::Wait { .. }));
+    }
+
+    #[test]
+    fn test_async_block() {
+        let prog = parse_str("ASYNC\n    YIELD\n    AWAIT 100\n    AWAIT UNTIL x > 3\nEND ASYNC").unwrap();
+        if let Statement::Async { body, .. } = &prog.body[0] {
+            assert!(matches!(&body[0], Statement::YieldStmt { .. }));
+            assert!(matches!(&body[1], Statement::AwaitStmt { .. }));
+            assert!(matches!(&body[2], Statement::AwaitUntil { .. }));
+        } else {
+            panic!("expected Async");
+        }
+    }
+
+    #[test]
+    fn test_channels() {
+        let prog = parse_str("CHANNEL 1, 8\nCHANNEL.SEND 1, t$ + \"C\"\nCHANNEL.RECEIVE 1, msg$\nCHANNEL.SELECT ready%, 1, 2, 3").unwrap();
+        assert!(matches!(&prog.body[0], Statement::ChannelNew { .. }));
+        assert!(matches!(&prog.body[1], Statement::ChannelSend { value: Expr::BinaryOp { .. }, .. }));
+        if let Statement::ChannelReceive { target, .. } = &prog.body[2] {
+            assert_eq!(target, "MSG$");
+        } else {
+            panic!("expected ChannelReceive");
+        }
+        if let Statement::ChannelSelect { ids, target, .. } = &prog.body[3] {
+            assert_eq!(ids.len(), 3);
+            assert_eq!(target, "READY%");
+        } else {
+            panic!("expected ChannelSelect");
+        }
+    }
+
+    #[test]
+    fn test_mqtt_outbox() {
+        let prog = parse_str("MQTT.PUBLISH \"a\", m$\nMQTT.PUBLISH \"a\", m$, 1, 1\nMQTT.COALESCE \"a\", 2, 10\nMQTT.FLUSH").unwrap();
+        assert!(matches!(&prog.body[0], Statement::MqttPublish { qos: None, retain: None, .. }));
+        assert!(matches!(&prog.body[1], Statement::MqttPublish { qos: Some(_), retain: Some(_), .. }));
+        assert!(matches!(&prog.body[2], Statement::MqttCoalesce { n: Some(_), .. }));
+        assert!(matches!(&prog.body[3], Statement::MqttFlush { .. }));
+    }
+
+    #[test]
+    fn test_http_streaming() {
+        let prog = parse_str("HTTP.DOWNLOAD u$, \"fw.bin\", n%\nHTTP.STREAM u$, OnChunk, n%\nHTTP.CHUNK c$").unwrap();
+        assert!(matches!(&prog.body[0], Statement::HttpDownload { .. }));
+        if let Statement::HttpStream { handler, target, .. } = &prog.body[1] {
+            assert_eq!(handler, "ONCHUNK");
+            assert_eq!(target, "N%");
+        } else {
+            panic!("expected HttpStream");
+        }
+        assert!(matches!(&prog.body[2], Statement::HttpChunk { .. }));
+    }
+
+    #[test]
+    fn test_web_routes() {
+        let prog = parse_str("WEB.ROUTE \"GET\", \"/api/*\", OnApi\nWEB.REQUEST r%\nWEB.REPLY 200, \"ok\", r%\nWEB.REPLY 404, \"\"").unwrap();
+        if let Statement::WebRoute { handler, .. } = &prog.body[0] {
+            assert_eq!(handler, "ONAPI");
+        } else {
+            panic!("expected WebRoute");
+        }
+        assert!(matches!(&prog.body[1], Statement::WebRequest { .. }));
+        assert!(matches!(&prog.body[2], Statement::WebReply { request: Some(_), .. }));
+        assert!(matches!(&prog.body[3], Statement::WebReply { request: None, .. }));
+    }
+
+    #[test]
+    fn test_web_serve() {
+        let prog = parse_str("WEB.SERVE \"/\", \"www\"").unwrap();
+        assert!(matches!(&prog.body[0], Statement::WebServe { .. }));
+        assert!(parse_str("WEB.SERVE \"/\"").is_err());
+    }
+
+    #[test]
+    fn test_tcp_connections() {
+        let prog = parse_str("ON TCP.DATA GOSUB OnData\nTCP.CLIENT c%\nTCP.SEND \"hi\", c%\nTCP.CLOSE c%\nTCP.CLOSE").unwrap();
+        if let Statement::OnTcpData { target, .. } = &prog.body[0] {
+            assert_eq!(target, "ONDATA");
+        } else {
+            panic!("expected OnTcpData");
+        }
+        assert!(matches!(&prog.body[1], Statement::TcpClient { .. }));
+        assert!(matches!(&prog.body[2], Statement::TcpSend { conn: Some(_), .. }));
+        assert!(matches!(&prog.body[3], Statement::TcpClose { conn: Some(_), .. }));
+        assert!(matches!(&prog.body[4], Statement::TcpClose { conn: None, .. }));
+    }
+
+    #[test]
+    fn test_read_byte_count() {
+        let prog = parse_str("FILE.READ$ a$\nFILE.READ$ b$, 4096\nSD.READ$ c$, n%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::FileReadStr { max: None, .. }));
+        assert!(matches!(&prog.body[1], Statement::FileReadStr { max: Some(_), .. }));
+        assert!(matches!(&prog.body[2], Statement::SdReadStr { max: Some(_), .. }));
+    }
+
+    #[test]
+    fn test_file_handles() {
+        let src = "FILE.OPEN \"log.csv\", \"r\", f%\nSD.OPEN \"a.txt\", \"w\", s%\n\
+                   FILE.READLINE$ l$, f%\nFILE.EOF e%, f%\nFILE.READ$ b$, 64, f%\n\
+                   FILE.WRITE \"x\", s%\nFILE.CLOSE f%\nFILE.CLOSE\nFILE.READLINE$ l$";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::FileOpen { handle: Some((_, QBType::Integer)), .. }));
+        assert!(matches!(&prog.body[1], Statement::SdOpen { handle: Some(_), .. }));
+        assert!(matches!(&prog.body[2], Statement::FileReadLine { handle: Some(_), .. }));
+        assert!(matches!(&prog.body[3], Statement::FileEof { handle: Some(_), .. }));
+        assert!(matches!(&prog.body[4], Statement::FileReadStr { max: Some(_), handle: Some(_), .. }));
+        assert!(matches!(&prog.body[5], Statement::FileWrite { handle: Some(_), .. }));
+        assert!(matches!(&prog.body[6], Statement::FileClose { handle: Some(_), .. }));
+        assert!(matches!(&prog.body[7], Statement::FileClose { handle: None, .. }));
+        assert!(matches!(&prog.body[8], Statement::FileReadLine { handle: None, .. }));
+    }
+
+    #[test]
+    fn test_log() {
+        let src = "LOG.OPEN \"/sdcard/log.csv\", 1048576, 3\nLOG.OPEN \"a.csv\"\n\
+                   LOG.WRITE STR$(t) + \",\" + STR$(v) + CHR$(10)\nLOG.FLUSH\nLOG.DROPPED d%\nLOG.CLOSE";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::LogOpen { max_bytes: Some(_), keep: Some(_), .. }));
+        assert!(matches!(&prog.body[1], Statement::LogOpen { max_bytes: None, keep: None, .. }));
+        assert!(matches!(&prog.body[2], Statement::LogWrite { .. }));
+        assert!(matches!(&prog.body[3], Statement::LogFlush { .. }));
+        assert!(matches!(&prog.body[4], Statement::LogDropped { .. }));
+        assert!(matches!(&prog.body[5], Statement::LogClose { .. }));
+    }
+
+    #[test]
+    fn test_adc_stream() {
+        let src = "ADC.STREAM 0, 20000\nADC.BLOCK buf%(), n%\nADC.BLOCK buf%\nADC.STOP";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::AdcStream { .. }));
+        assert!(matches!(&prog.body[1], Statement::AdcBlock { count: Some(_), .. }));
+        assert!(matches!(&prog.body[2], Statement::AdcBlock { count: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::AdcStop { .. }));
+    }
+
+    #[test]
+    fn test_bulk_bus_transfers() {
+        let src = "I2C.SEND 60, frame$\nI2C.READ$ 104, 6, raw$\nI2C.WRITEREAD$ 104, CHR$(59), 6, raw$\n\
+                   SPI.SEND frame$\nSPI.TRANSFER$ cmd$, reply$\nSPI.FLUSH\nI2C.READ 104, 1, v";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::I2cSend { .. }));
+        assert!(matches!(&prog.body[1], Statement::I2cReadStr { .. }));
+        assert!(matches!(&prog.body[2], Statement::I2cWriteRead { .. }));
+        assert!(matches!(&prog.body[3], Statement::SpiSend { .. }));
+        assert!(matches!(&prog.body[4], Statement::SpiTransferStr { .. }));
+        assert!(matches!(&prog.body[5], Statement::SpiFlush { .. }));
+        assert!(matches!(&prog.body[6], Statement::I2cRead { .. }));
+    }
+
+    #[test]
+    fn test_led_set_all() {
+        let prog = parse_str("LED.SETALL frame%()
+LED.SETALL frame%
+LED.SET 0, 255, 0, 0").unwrap();
+        assert!(matches!(&prog.body[0], Statement::LedSetAll { array, .. } if array == "FRAME%"));
+        assert!(matches!(&prog.body[1], Statement::LedSetAll { .. }));
+        assert!(matches!(&prog.body[2], Statement::LedSet { .. }));
+    }
+
+    #[test]
+    fn test_i2s_stream() {
+        let src = "I2S.PINS 4, 5, 6\nI2S.PINS 4, 5, 6, 7\nI2S.INIT 16000, 16, 1\n\
+                   ON I2S.NEED GOSUB Refill\nI2S.READ$ 512, mic$";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::I2sPins { din: None, .. }));
+        assert!(matches!(&prog.body[1], Statement::I2sPins { din: Some(_), .. }));
+        assert!(matches!(&prog.body[3], Statement::OnI2sNeed { target, .. } if target == "REFILL"));
+        assert!(matches!(&prog.body[4], Statement::I2sRead { var_type: QBType::String, .. }));
+    }
+
+    #[test]
+    fn test_uart_block_and_lines() {
+        let src = "UART.SETUP 1, 115200, 4, 5, 4096\nUART.SEND 1, cmd$\nUART.READ$ 1, 256, rx$\n\
+                   ON UART.LINE 1 GOSUB OnNmea\nON UART.LINE 1, 13 GOSUB OnNmea\nUART.LINE$ l$\nUART.READ 1, b";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::UartSetup { rx_buffer: Some(_), .. }));
+        assert!(matches!(&prog.body[1], Statement::UartSend { .. }));
+        assert!(matches!(&prog.body[2], Statement::UartReadStr { .. }));
+        assert!(matches!(&prog.body[3], Statement::OnUartLine { delim: None, .. }));
+        assert!(matches!(&prog.body[4], Statement::OnUartLine { delim: Some(_), target, .. } if target == "ONNMEA"));
+        assert!(matches!(&prog.body[5], Statement::UartLine { .. }));
+        assert!(matches!(&prog.body[6], Statement::UartRead { .. }));
+    }
+
+    #[test]
+    fn test_event_counters() {
+        let prog = parse_str("ON GPIO.CHANGE 9 GOSUB OnButton\nEVENT.COALESCED c%\nEVENT.DROPPED d%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::OnGpioChange { .. }));
+        assert!(matches!(&prog.body[1], Statement::EventCoalesced { .. }));
+        assert!(matches!(&prog.body[2], Statement::EventDropped { .. }));
+    }
+
+    #[test]
+    fn test_timer_scheduler() {
+        let src = "TIMER.AFTER 250, Pulse\nTIMER.EVERY 1000, Sample, t%\nTIMER.MICROS us&\nTIMER.CANCEL t%";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::TimerAfter { target, id: None, .. } if target == "PULSE"));
+        assert!(matches!(&prog.body[1], Statement::TimerEvery { target, id: Some(_), .. } if target == "SAMPLE"));
+        assert!(matches!(&prog.body[2], Statement::TimerMicros { var_type: QBType::Long, .. }));
+        assert!(matches!(&prog.body[3], Statement::TimerCancel { .. }));
+    }
+
+    #[test]
+    fn test_machine_state() {
+        let src = "MACHINE Door\n    STATE SHUT\n        ON PUSH GOTO OPEN\n    END STATE\n    STATE OPEN\n        ON PUSH GOTO SHUT\n    END STATE\nEND MACHINE\nDoor.EVENT \"PUSH\"\nDoor.STATE s%\nDoor.STATE s$";
+        let prog = parse_str(src).unwrap();
+        assert_eq!(prog.machines[0].states.len(), 2);
+        assert!(matches!(&prog.body[1], Statement::MachineState { machine_name, var_type: QBType::Integer, .. } if machine_name == "DOOR"));
+        assert!(matches!(&prog.body[2], Statement::MachineState { var_type: QBType::String, .. }));
+    }
+
+    #[test]
+    fn test_on_cron() {
+        let prog = parse_str("CRON.ADD 1, \"30 8 * * 1-5\"\nON CRON 1 GOSUB Wake\nCRON.CHECK 1, f%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::CronAdd { .. }));
+        assert!(matches!(&prog.body[1], Statement::OnCron { target, .. } if target == "WAKE"));
+        assert!(matches!(&prog.body[2], Statement::CronCheck { .. }));
+    }
+
+    #[test]
+    fn test_console_flush() {
+        let prog = parse_str("CONSOLE.MODE 3, 50\nCONSOLE.MODE 1\nPRINT \"x\";\nFLUSH").unwrap();
+        assert!(matches!(&prog.body[0], Statement::ConsoleMode { n: Some(_), .. }));
+        assert!(matches!(&prog.body[1], Statement::ConsoleMode { n: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::Flush { .. }));
+    }
+
+    #[test]
+    fn test_val_next() {
+        let prog = parse_str("VAL.NEXT line$, p%, v!").unwrap();
+        assert!(matches!(&prog.body[0], Statement::ValNext { pos, pos_type: QBType::Integer, var_type: QBType::Single, .. } if pos == "P%"));
+    }
+
+    #[test]
+    fn test_randomize_forms() {
+        let prog = parse_str("RANDOMIZE 42\nRANDOMIZE\nRANDOMIZE ARRAY noise!()\nRANDOMIZE ARRAY leds%(), 0, 256").unwrap();
+        assert!(matches!(&prog.body[0], Statement::Randomize { seed: Some(_), .. }));
+        assert!(matches!(&prog.body[1], Statement::Randomize { seed: None, .. }));
+        assert!(matches!(&prog.body[2], Statement::RandomizeArray { range: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::RandomizeArray { array, range: Some(_), .. } if array == "LEDS%"));
+    }
+
+    #[test]
+    fn test_array_kernels() {
+        let src = "ARRAY.SUM buf%(), total&\nARRAY.MAX buf%, peak%\nARRAY.DOT x!(), w!(), y!\nARRAY.FILL buf%(), 0\nARRAY.COPY x!(), w!()\nARRAY.SCALE x!(), 3.3 / 4095, -1.65";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::ArrayReduce { op: ArrayReduceOp::Sum, array, var_type: QBType::Long, .. } if array == "BUF%"));
+        assert!(matches!(&prog.body[1], Statement::ArrayReduce { op: ArrayReduceOp::Max, .. }));
+        assert!(matches!(&prog.body[2], Statement::ArrayDot { a, b, .. } if a == "X!" && b == "W!"));
+        assert!(matches!(&prog.body[3], Statement::ArrayFill { .. }));
+        assert!(matches!(&prog.body[4], Statement::ArrayCopy { src, dst, .. } if src == "X!" && dst == "W!"));
+        assert!(matches!(&prog.body[5], Statement::ArrayScale { offset: Some(_), .. }));
+    }
+
+    #[test]
+    fn test_dsp_statements() {
+        let src = "DSP.FIR x%(), h%(), z%()\nDSP.BIQUAD x%(), c%()\nDSP.FFT re%(), im%()\nDSP.MAG re%(), im%()\nDSP.RMS x%(), level%";
+        let prog = parse_str(src).unwrap();
+        assert!(matches!(&prog.body[0], Statement::DspFir { state: Some(z), .. } if z == "Z%"));
+        assert!(matches!(&prog.body[1], Statement::DspBiquad { state: None, .. }));
+        assert!(matches!(&prog.body[2], Statement::DspFft { re, im, .. } if re == "RE%" && im == "IM%"));
+        assert!(matches!(&prog.body[3], Statement::DspMag { .. }));
+        assert!(matches!(&prog.body[4], Statement::DspLevel { op: DspLevelOp::Rms, .. }));
+    }
+
+    #[test]
+    fn test_read_array_and_restore_label() {
+        let prog = parse_str("READ a%()\nREAD x, y$\nRESTORE Table\nRESTORE 100\nRESTORE").unwrap();
+        assert!(matches!(&prog.body[0], Statement::ReadArray { array, .. } if array == "A%"));
+        assert!(matches!(&prog.body[1], Statement::Read { variables, .. } if variables.len() == 2));
+        assert!(matches!(&prog.body[2], Statement::Restore { label: Some(l), .. } if l == "TABLE"));
+        assert!(matches!(&prog.body[3], Statement::Restore { label: Some(l), .. } if l == "100"));
+        assert!(matches!(&prog.body[4], Statement::Restore { label: None, .. }));
+    }
+
+    #[test]
+    fn test_nvs_cache_statements() {
+        let prog = parse_str("NVS.AUTOCOMMIT 5000\nNVS.WRITE \"ssid\", name$\nNVS.READ \"ssid\", name$\nNVS.COMMIT").unwrap();
+        assert!(matches!(&prog.body[0], Statement::NvsAutocommit { .. }));
+        assert!(matches!(&prog.body[2], Statement::NvsRead { var_type: QBType::String, .. }));
+        assert!(matches!(&prog.body[3], Statement::NvsCommit { .. }));
+    }
+
+    #[test]
+    fn test_espnow_peer_handle() {
+        let prog = parse_str("ESPNOW.PEER \"24:0a:c4:12:34:56\", hub%\nESPNOW.SEND hub%, frame$").unwrap();
+        assert!(matches!(&prog.body[0], Statement::EspnowPeer { target, .. } if target == "HUB%"));
+        assert!(matches!(&prog.body[1], Statement::EspnowSend { .. }));
+    }
+
+    #[test]
+    fn test_ble_throughput_statements() {
+        let prog = parse_str("BLE.INTERVAL 15\nBLE.INTERVAL 15, 30\nBLE.MTU m%").unwrap();
+        assert!(matches!(&prog.body[0], Statement::BleInterval { max_ms: None, .. }));
+        assert!(matches!(&prog.body[1], Statement::BleInterval { max_ms: Some(_), .. }));
+        assert!(matches!(&prog.body[2], Statement::BleMtu { target, .. } if target == "M%"));
+    }
+
+    #[test]
+    fn test_profile_statements() {
+        let prog = parse_str("PROFILE ON\nPROFILE OFF\nPROFILE.DUMP\nPROFILE.DUMP r$").unwrap();
+        assert!(matches!(&prog.body[0], Statement::Profile { on: true, .. }));
+        assert!(matches!(&prog.body[1], Statement::Profile { on: false, .. }));
+        assert!(matches!(&prog.body[2], Statement::ProfileDump { target: None, .. }));
+        assert!(matches!(&prog.body[3], Statement::ProfileDump { target: Some((name, _)), .. } if name == "R$"));
+        assert!(parse_str("PROFILE 1").is_err());
+    }
 }
@@ -55,7 +55,15 @@ pub struct SemaResult {
     pub types: HashMap<String, TypeInfo>,
     pub constants: HashSet<String>,
     pub data_items: Vec<DataItem>,
+    /// Index into `data_items` of the first DATA item after each label,
+    /// for RESTORE label.
+    pub data_labels: HashMap<String, usize>,
     pub enums: HashMap<String, HashMap<String, i32>>,
+    /// Spans of FOR loops whose counter is never written inside the body
+    /// (no assignment, INPUT, nested FOR, GOSUB or label), so within the
+    /// body it only ranges over FROM..TO. Codegen uses this to drop array
+    /// bounds checks.
+    pub invariant_for_loops: HashSet<Span>,
     pub errors: Vec<SemaError>,
 }
 
@@ -87,6 +95,8 @@ enum ScopeKind {
     DoLoop,
     Sub,
     Function,
+    Async,
+    Try,
 }
 
 pub struct SemanticAnalyzer {
@@ -100,8 +110,12 @@ pub struct SemanticAnalyzer {
     types: HashMap<String, TypeInfo>,
     constants: HashSet<String>,
     data_items: Vec<DataItem>,
+    data_labels: HashMap<String, usize>,
     enums: HashMap<String, HashMap<String, i32>>,
     scope_stack: Vec<ScopeKind>,
+    /// Counters of the FOR loops being checked, and whether each was written
+    for_counters: Vec<(String, bool)>,
+    invariant_for_loops: HashSet<Span>,
     errors: Vec<SemaError>,
 }
 
@@ -118,8 +132,11 @@ impl SemanticAnalyzer {
             types: HashMap::new(),
             constants: HashSet::new(),
             data_items: Vec::new(),
+            data_labels: HashMap::new(),
             enums: HashMap::new(),
             scope_stack: vec![ScopeKind::TopLevel],
+            for_counters: Vec::new(),
+            invariant_for_loops: HashSet::new(),
             errors: Vec::new(),
         }
     }
@@ -134,13 +151,37 @@ impl SemanticAnalyzer {
         self.validate_type_field_references();
 
         // Collect enums
+        let mut enum_kinds: HashMap<String, &str> = HashMap::new();
         for e in &program.enums {
+            if let Some(kind) = enum_kinds.insert(e.name.clone(), "ENUM") {
+                self.errors.push(SemaError {
+                    span: e.span,
+                    message: format!("duplicate ENUM: {} is already defined as an {}", e.name, kind),
+                });
+                continue;
+            }
             let mut members = HashMap::new();
             for m in &e.members {
                 members.insert(m.name.clone(), m.value);
             }
             self.enums.insert(e.name.clone(), members);
         }
+        // A machine's states are constants too: Machine.STATE_NAME is the
+        // number Machine.STATE reports for it. They share the ENUM namespace,
+        // so a MACHINE may not reuse an ENUM's name or another MACHINE's.
+        for m in &program.machines {
+            if let Some(kind) = enum_kinds.get(&m.name) {
+                let article = if *kind == "ENUM" { "an" } else { "a" };
+                self.errors.push(SemaError {
+                    span: m.span,
+                    message: format!("duplicate MACHINE: {} is already defined as {} {}", m.name, article, kind),
+                });
+                continue;
+            }
+            enum_kinds.insert(m.name.clone(), "MACHINE");
+            let states = m.states.iter().enumerate().map(|(i, s)| (s.name.clone(), i as i32)).collect();
+            self.enums.insert(m.name.clone(), states);
+        }
 
         // Pass 3: Collect SUB/FUNCTION signatures
         for sub_def in &program.subs {
@@ -230,7 +271,9 @@ impl SemanticAnalyzer {
             types: self.types,
             constants: self.constants,
             data_items: self.data_items,
+            data_labels: self.data_labels,
             enums: self.enums,
+            invariant_for_loops: self.invariant_for_loops,
             errors: self.errors,
         }
     }
@@ -603,9 +646,15 @@ impl SemanticAnalyzer {
                     self.check_expr(s);
                 }
                 self.scope_stack.push(ScopeKind::ForLoop);
+                self.for_counters.push((var.clone(), false));
                 for s in body {
                     self.check_statement(s);
                 }
+                if let Some((_, written)) = self.for_counters.pop() {
+                    if !written {
+                        self.invariant_for_loops.insert(*span);
+                    }
+                }
                 self.scope_stack.pop();
             }
             Statement::DoLoop {
@@ -675,6 +724,8 @@ impl SemanticAnalyzer {
                 self.goto_targets.push((target.clone(), *span));
             }
             Statement::Gosub { target, span } => {
+                // The routine shares this scope and may change any counter
+                self.invalidate_for_counters(None);
                 self.has_gosub = true;
                 self.gosub_targets.insert(target.clone());
                 self.goto_targets.push((target.clone(), *span));
@@ -699,8 +750,11 @@ impl SemanticAnalyzer {
                 }
                 // If SUB is not found, it might be a built-in or forward-declared; no error
             }
-            Statement::Label { .. } => {
-                // Labels are collected in pass 4; nothing else to check
+            Statement::Label { name, .. } => {
+                // Labels are collected in pass 4. A GOTO can enter the loop
+                // here with its counter out of range.
+                self.invalidate_for_counters(None);
+                self.data_labels.insert(name.clone(), self.data_items.len());
             }
             Statement::Return { .. } => {
                 // RETURN is valid inside any GOSUB routine
@@ -806,6 +860,47 @@ impl SemanticAnalyzer {
                 self.check_expr(data);
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::I2cSend { addr, data, .. } => {
+                self.check_expr(addr);
+                self.check_expr(data);
+            }
+            Statement::I2cReadStr {
+                addr,
+                length,
+                target,
+                var_type,
+                span,
+            } => {
+                self.check_expr(addr);
+                self.check_expr(length);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::I2cWriteRead {
+                addr,
+                data,
+                length,
+                target,
+                var_type,
+                span,
+            } => {
+                self.check_expr(addr);
+                self.check_expr(data);
+                self.check_expr(length);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::SpiSend { data, .. } => {
+                self.check_expr(data);
+            }
+            Statement::SpiTransferStr {
+                data,
+                target,
+                var_type,
+                span,
+            } => {
+                self.check_expr(data);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::SpiFlush { .. } => {}
             Statement::WifiConnect { ssid, password, .. } => {
                 self.check_expr(ssid);
                 self.check_expr(password);
@@ -827,6 +922,17 @@ impl SemanticAnalyzer {
                 self.check_expr(pin);
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::AdcStream { pin, rate, .. } => {
+                self.check_expr(pin);
+                self.check_expr(rate);
+            }
+            Statement::AdcBlock { array, count, span } => {
+                self.check_int_array("ADC.BLOCK", array, *span);
+                if let Some((target, var_type)) = count {
+                    self.declare_or_check_var(target, var_type, *span);
+                }
+            }
+            Statement::AdcStop { .. } => {}
             Statement::PwmSetup {
                 channel, pin, freq, resolution, ..
             } => {
@@ -840,12 +946,31 @@ impl SemanticAnalyzer {
                 self.check_expr(duty);
             }
             Statement::UartSetup {
-                port, baud, tx, rx, ..
+                port, baud, tx, rx, rx_buffer, ..
             } => {
                 self.check_expr(port);
                 self.check_expr(baud);
                 self.check_expr(tx);
                 self.check_expr(rx);
+                if let Some(n) = rx_buffer {
+                    self.check_expr(n);
+                }
+            }
+            Statement::UartSend { port, data, .. } => {
+                self.check_expr(port);
+                self.check_expr(data);
+            }
+            Statement::UartReadStr {
+                port, max, target, var_type, span,
+            } => {
+                self.check_expr(port);
+                self.check_expr(max);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::UartLine {
+                target, var_type, span,
+            } => {
+                self.declare_or_check_var(target, var_type, *span);
             }
             Statement::UartWrite { port, data, .. } => {
                 self.check_expr(port);
@@ -863,6 +988,22 @@ impl SemanticAnalyzer {
             } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::TimerMicros { target, var_type, span } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::TimerAfter { micros, target, id, span }
+            | Statement::TimerEvery { micros, target, id, span } => {
+                self.check_expr(micros);
+                // Run by the event dispatcher task, which can only call a SUB
+                let what = if matches!(stmt, Statement::TimerEvery { .. }) { "TIMER.EVERY" } else { "TIMER.AFTER" };
+                self.check_handler_sub(what, target, *span);
+                if let Some((v, v_type)) = id {
+                    self.declare_or_check_var(v, v_type, *span);
+                }
+            }
+            Statement::TimerCancel { id, .. } => {
+                self.check_expr(id);
+            }
             Statement::HttpGet {
                 url, target, var_type, span,
             } => {
@@ -876,6 +1017,25 @@ impl SemanticAnalyzer {
                 self.check_expr(body);
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::HttpDownload {
+                url, path, target, var_type, span,
+            } => {
+                self.check_expr(url);
+                self.check_expr(path);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::HttpStream {
+                url, handler, target, var_type, span,
+            } => {
+                self.check_expr(url);
+                self.check_handler_sub("HTTP.STREAM", handler, *span);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::HttpChunk {
+                target, var_type, span,
+            } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
             Statement::NvsWrite { key, value, .. } => {
                 self.check_expr(key);
                 self.check_expr(value);
@@ -886,20 +1046,38 @@ impl SemanticAnalyzer {
                 self.check_expr(key);
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::NvsCommit { .. } => {}
+            Statement::NvsAutocommit { ms, .. } => {
+                self.check_expr(ms);
+            }
             Statement::MqttConnect { broker, port, .. } => {
                 self.check_expr(broker);
                 self.check_expr(port);
             }
             Statement::MqttDisconnect { .. } => {}
-            Statement::MqttPublish { topic, message, .. } => {
+            Statement::MqttPublish { topic, message, qos, retain, .. } => {
                 self.check_expr(topic);
                 self.check_expr(message);
+                for e in qos.iter().chain(retain.iter()) {
+                    self.check_expr(e);
+                }
             }
+            Statement::MqttCoalesce { topic, mode, n, .. } => {
+                self.check_expr(topic);
+                self.check_expr(mode);
+                if let Some(n) = n {
+                    self.check_expr(n);
+                }
+            }
+            Statement::MqttFlush { .. } => {}
             Statement::MqttSubscribe { topic, .. } => {
                 self.check_expr(topic);
             }
             Statement::MqttReceive {
                 target, var_type, span,
+            }
+            | Statement::MqttTopic {
+                target, var_type, span,
             } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
@@ -922,6 +1100,15 @@ impl SemanticAnalyzer {
             } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::BleInterval { min_ms, max_ms, .. } => {
+                self.check_expr(min_ms);
+                if let Some(max_ms) = max_ms {
+                    self.check_expr(max_ms);
+                }
+            }
+            Statement::BleMtu { target, var_type, span } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
             Statement::JsonGet {
                 json, key, target, var_type, span,
             } => {
@@ -943,6 +1130,40 @@ impl SemanticAnalyzer {
                 self.check_expr(json);
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::JsonBegin { handle, key, .. } => {
+                self.check_expr(handle);
+                if let Some(key) = key {
+                    self.check_expr(key);
+                }
+            }
+            Statement::JsonAdd { handle, key, value, .. } => {
+                self.check_expr(handle);
+                if let Some(key) = key {
+                    self.check_expr(key);
+                }
+                self.check_expr(value);
+            }
+            Statement::JsonEnd { handle, .. } => {
+                self.check_expr(handle);
+            }
+            Statement::JsonExtract { json, fields, span } => {
+                self.check_expr(json);
+                for (path, target, var_type) in fields {
+                    self.check_expr(path);
+                    // Values come back as strings; convert with VAL
+                    let declared = match var_type {
+                        QBType::Inferred => self.variables.get(target).map(|v| v.qb_type.clone()),
+                        _ => Some(var_type.clone()),
+                    };
+                    if declared != Some(QBType::String) {
+                        self.errors.push(SemaError {
+                            span: *span,
+                            message: format!("JSON.EXTRACT needs a string variable, {target} is not one"),
+                        });
+                    }
+                    self.declare_or_check_var(target, var_type, *span);
+                }
+            }
             Statement::LedSetup { pin, count, .. } => {
                 self.check_expr(pin);
                 self.check_expr(count);
@@ -953,6 +1174,20 @@ impl SemanticAnalyzer {
                 self.check_expr(g);
                 self.check_expr(b);
             }
+            Statement::LedSetAll { array, span } => {
+                match self.variables.get(array) {
+                    Some(info) if info.is_array
+                        && matches!(info.qb_type, QBType::Integer | QBType::Long) => {}
+                    Some(_) => self.errors.push(SemaError {
+                        span: *span,
+                        message: format!("LED.SETALL needs an INTEGER array, {array} is not one"),
+                    }),
+                    None => self.errors.push(SemaError {
+                        span: *span,
+                        message: format!("undeclared array '{}'", array),
+                    }),
+                }
+            }
             Statement::LedShow { .. } => {}
             Statement::LedClear { .. } => {}
             Statement::DeepSleep { ms, .. } => {
@@ -968,6 +1203,12 @@ impl SemanticAnalyzer {
             } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::EspnowPeer {
+                mac, target, var_type, span,
+            } => {
+                self.check_expr(mac);
+                self.declare_or_check_var(target, var_type, *span);
+            }
             Statement::Data { items, .. } => {
                 self.data_items.extend(items.iter().cloned());
             }
@@ -976,7 +1217,14 @@ impl SemanticAnalyzer {
                     self.declare_or_check_var(name, var_type, *span);
                 }
             }
-            Statement::Restore { .. } => {}
+            Statement::ReadArray { array, span } => {
+                self.check_numeric_array("READ", array, *span);
+            }
+            Statement::Restore { label, span } => {
+                if let Some(label) = label {
+                    self.goto_targets.push((label.clone(), *span));
+                }
+            }
             Statement::OnGoto { expr, targets, span } => {
                 self.check_expr(expr);
                 for target in targets {
@@ -1033,7 +1281,23 @@ impl SemanticAnalyzer {
                 }
             }
             Statement::Randomize { seed, .. } => {
-                self.check_expr(seed);
+                if let Some(seed) = seed {
+                    self.check_expr(seed);
+                }
+            }
+            Statement::RandomizeArray { array, range, span } => {
+                let is_int = self.check_numeric_array("RANDOMIZE ARRAY", array, *span);
+                if is_int == Some(true) && range.is_none() {
+                    // [0, 1) holds no whole number but 0
+                    self.errors.push(SemaError {
+                        span: *span,
+                        message: format!("RANDOMIZE ARRAY on INTEGER array {array} needs lo, hi"),
+                    });
+                }
+                if let Some((lo, hi)) = range {
+                    self.check_expr(lo);
+                    self.check_expr(hi);
+                }
             }
             Statement::TouchRead {
                 pin, target, var_type, span,
@@ -1159,6 +1423,18 @@ impl SemanticAnalyzer {
                     self.check_expr(msg);
                 }
             }
+            Statement::Profile { .. } => {}
+            Statement::ProfileDump { target, span } => {
+                if let Some((name, var_type)) = target {
+                    if *var_type != QBType::String {
+                        self.errors.push(SemaError {
+                            span: *span,
+                            message: format!("PROFILE.DUMP needs a string variable, {name} is not one"),
+                        });
+                    }
+                    self.declare_or_check_var(name, var_type, *span);
+                }
+            }
             Statement::ForEach { var, var_type, array_name, body, span } => {
                 self.scope_stack.push(ScopeKind::ForLoop);
                 self.register_var(var, var_type);
@@ -1175,9 +1451,11 @@ impl SemanticAnalyzer {
                 self.scope_stack.pop();
             }
             Statement::TryCatch { try_body, catch_var, catch_body, .. } => {
+                self.scope_stack.push(ScopeKind::Try);
                 for s in try_body {
                     self.check_statement(s);
                 }
+                self.scope_stack.pop();
                 self.register_var(catch_var, &QBType::String);
                 for s in catch_body {
                     self.check_statement(s);
@@ -1191,16 +1469,63 @@ impl SemanticAnalyzer {
                     self.check_statement(s);
                 }
             }
+            Statement::TaskPool { workers, stack_size, priority, core, .. } => {
+                self.check_expr(workers);
+                self.check_expr(stack_size);
+                self.check_expr(priority);
+                if let Some(core) = core {
+                    self.check_expr(core);
+                }
+            }
+            Statement::Spawn { target, body, span } => {
+                if let Some((name, var_type)) = target {
+                    self.declare_or_check_var(name, var_type, *span);
+                }
+                for s in body {
+                    self.check_statement(s);
+                }
+            }
+            Statement::Wait { job, .. } => {
+                self.check_expr(job);
+            }
             Statement::OnGpioChange { pin, .. } => {
                 self.check_expr(pin);
             }
             Statement::OnTimerEvent { interval_ms, .. } => {
                 self.check_expr(interval_ms);
             }
-            Statement::OnMqttMessage { .. } => {}
+            Statement::OnMqttMessage { target, span } => {
+                // Messages are dispatched on their own task, which can only
+                // call a SUB; a GOSUB label lives in the main program
+                self.check_handler_sub("ON MQTT.MESSAGE", target, *span);
+            }
+            Statement::OnTcpData { target, span } => {
+                // Runs on the TCP event loop task, like ON MQTT.MESSAGE
+                self.check_handler_sub("ON TCP.DATA", target, *span);
+            }
+            Statement::OnUartLine { port, delim, target, span } => {
+                self.check_expr(port);
+                if let Some(d) = delim {
+                    self.check_expr(d);
+                }
+                // Lines are dispatched from the UART event task
+                self.check_handler_sub("ON UART.LINE", target, *span);
+            }
+            Statement::OnI2sNeed { target, span } => {
+                // Called from the I2S feeder task
+                self.check_handler_sub("ON I2S.NEED", target, *span);
+            }
+            Statement::OnCron { id, target, span } => {
+                self.check_expr(id);
+                // Run by the event dispatcher task when the job fires
+                self.check_handler_sub("ON CRON", target, *span);
+            }
             Statement::MachineEvent { event, .. } => {
                 self.check_expr(event);
             }
+            Statement::MachineState { target, var_type, span, .. } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
             // ── New hardware statements (phase 2) ──
             Statement::NtpSync { server, .. } => {
                 self.check_expr(server);
@@ -1211,17 +1536,40 @@ impl SemanticAnalyzer {
             Statement::NtpEpoch { target, var_type, span, .. } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::FileOpen { path, mode, .. } => {
+            Statement::FileOpen { path, mode, handle, span } => {
                 self.check_expr(path);
                 self.check_expr(mode);
+                if let Some((h, h_type)) = handle {
+                    self.declare_or_check_var(h, h_type, *span);
+                }
             }
-            Statement::FileWrite { data, .. } => {
+            Statement::FileWrite { data, handle, .. } => {
                 self.check_expr(data);
+                if let Some(h) = handle {
+                    self.check_expr(h);
+                }
+            }
+            Statement::FileReadStr { target, var_type, max, handle, span } => {
+                if let Some(m) = max {
+                    self.check_expr(m);
+                }
+                if let Some(h) = handle {
+                    self.check_expr(h);
+                }
+                self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::FileReadStr { target, var_type, span, .. } => {
+            Statement::FileReadLine { target, var_type, handle, span }
+            | Statement::FileEof { target, var_type, handle, span } => {
+                if let Some(h) = handle {
+                    self.check_expr(h);
+                }
                 self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::FileClose { .. } => {}
+            Statement::FileClose { handle, .. } => {
+                if let Some(h) = handle {
+                    self.check_expr(h);
+                }
+            }
             Statement::FileDelete { path, .. } => {
                 self.check_expr(path);
             }
@@ -1245,13 +1593,23 @@ impl SemanticAnalyzer {
             Statement::TcpAccept { target, var_type, span, .. } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::TcpSend { data, .. } => {
+            Statement::TcpSend { data, conn, .. } => {
                 self.check_expr(data);
+                if let Some(c) = conn {
+                    self.check_expr(c);
+                }
             }
             Statement::TcpReceiveStr { target, var_type, span, .. } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::TcpClose { .. } => {}
+            Statement::TcpClose { conn, .. } => {
+                if let Some(c) = conn {
+                    self.check_expr(c);
+                }
+            }
+            Statement::TcpClient { target, var_type, span, .. } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
             Statement::WdtEnable { timeout_ms, .. } => {
                 self.check_expr(timeout_ms);
             }
@@ -1275,6 +1633,18 @@ impl SemanticAnalyzer {
                 self.check_expr(data);
             }
             Statement::I2sStop { .. } => {}
+            Statement::I2sPins { bclk, ws, dout, din, .. } => {
+                self.check_expr(bclk);
+                self.check_expr(ws);
+                self.check_expr(dout);
+                if let Some(d) = din {
+                    self.check_expr(d);
+                }
+            }
+            Statement::I2sRead { length, target, var_type, span } => {
+                self.check_expr(length);
+                self.declare_or_check_var(target, var_type, *span);
+            }
 
             // ── Web Server ───────────────────────────────────
             Statement::WebStart { port, .. } => {
@@ -1286,35 +1656,96 @@ impl SemanticAnalyzer {
             Statement::WebBodyStr { target, var_type, span, .. } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
-            Statement::WebReply { status, body, .. } => {
+            Statement::WebReply { status, body, request, .. } => {
                 self.check_expr(status);
                 self.check_expr(body);
+                if let Some(r) = request {
+                    self.check_expr(r);
+                }
             }
             Statement::WebStop { .. } => {}
+            Statement::WebRoute { method, path, handler, span } => {
+                self.check_expr(method);
+                self.check_expr(path);
+                self.check_handler_sub("WEB.ROUTE", handler, *span);
+            }
+            Statement::WebRequest { target, var_type, span, .. } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::WebServe { prefix, dir, .. } => {
+                self.check_expr(prefix);
+                self.check_expr(dir);
+            }
 
             // ── SD Card ──────────────────────────────────────
             Statement::SdInit { cs_pin, .. } => {
                 self.check_expr(cs_pin);
             }
-            Statement::SdOpen { path, mode, .. } => {
+            Statement::SdOpen { path, mode, handle, span } => {
                 self.check_expr(path);
                 self.check_expr(mode);
+                if let Some((h, h_type)) = handle {
+                    self.declare_or_check_var(h, h_type, *span);
+                }
             }
             Statement::SdWrite { data, .. } => {
                 self.check_expr(data);
             }
-            Statement::SdReadStr { target, var_type, span, .. } => {
+            Statement::SdReadStr { target, var_type, max, span } => {
+                if let Some(m) = max {
+                    self.check_expr(m);
+                }
                 self.declare_or_check_var(target, var_type, *span);
             }
             Statement::SdClose { .. } => {}
             Statement::SdFree { target, var_type, span, .. } => {
                 self.declare_or_check_var(target, var_type, *span);
             }
+            Statement::LogOpen { path, max_bytes, keep, .. } => {
+                self.check_expr(path);
+                if let Some(m) = max_bytes {
+                    self.check_expr(m);
+                }
+                if let Some(k) = keep {
+                    self.check_expr(k);
+                }
+            }
+            Statement::LogWrite { data, .. } => {
+                self.check_expr(data);
+            }
+            Statement::LogFlush { .. } | Statement::LogClose { .. } => {}
+            Statement::Flush { .. } => {}
+            Statement::ConsoleMode { mode, n, .. } => {
+                self.check_expr(mode);
+                if let Some(n) = n {
+                    self.check_expr(n);
+                }
+            }
+            Statement::LogDropped { target, var_type, span }
+            | Statement::EventCoalesced { target, var_type, span }
+            | Statement::EventDropped { target, var_type, span } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
 
             // ── Async / Yield ────────────────────────────────
-            Statement::YieldStmt { .. } => {}
-            Statement::AwaitStmt { ms, .. } => {
+            Statement::YieldStmt { span } => {
+                self.check_suspend_point(*span);
+            }
+            Statement::AwaitStmt { ms, span } => {
                 self.check_expr(ms);
+                self.check_suspend_point(*span);
+            }
+            Statement::AwaitUntil { condition, span } => {
+                self.check_expr(condition);
+                self.check_suspend_point(*span);
+            }
+            Statement::Async { body, .. } => {
+                self.invalidate_for_counters(None);
+                self.scope_stack.push(ScopeKind::Async);
+                for s in body {
+                    self.check_statement(s);
+                }
+                self.scope_stack.pop();
             }
 
             // ── Cron ─────────────────────────────────────────
@@ -1331,6 +1762,64 @@ impl SemanticAnalyzer {
             }
 
             // ── Regex ────────────────────────────────────────
+            Statement::ValNext { text, pos, pos_type, target, var_type, span } => {
+                self.check_expr(text);
+                if *pos_type == QBType::String || *var_type == QBType::String {
+                    self.errors.push(SemaError {
+                        span: *span,
+                        message: "VAL.NEXT needs a numeric position and target".to_string(),
+                    });
+                }
+                self.declare_or_check_var(pos, pos_type, *span);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+
+            // ── Array kernels ────────────────────────────────
+            Statement::ArrayReduce { array, target, var_type, span, .. } => {
+                self.check_numeric_array("ARRAY.SUM/MIN/MAX", array, *span);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::ArrayDot { a, b, target, var_type, span } => {
+                self.check_same_arrays("ARRAY.DOT", a, b, *span);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::ArrayFill { array, value, span } => {
+                self.check_numeric_array("ARRAY.FILL", array, *span);
+                self.check_expr(value);
+            }
+            Statement::ArrayCopy { src, dst, span } => {
+                self.check_same_arrays("ARRAY.COPY", src, dst, *span);
+            }
+            Statement::ArrayScale { array, factor, offset, span } => {
+                self.check_numeric_array("ARRAY.SCALE", array, *span);
+                self.check_expr(factor);
+                if let Some(offset) = offset {
+                    self.check_expr(offset);
+                }
+            }
+
+            // ── DSP ──────────────────────────────────────────
+            Statement::DspFir { array, coeffs, state, span }
+            | Statement::DspBiquad { array, coeffs, state, span } => {
+                let what = if matches!(stmt, Statement::DspFir { .. }) { "DSP.FIR" } else { "DSP.BIQUAD" };
+                self.check_int_array(what, array, *span);
+                self.check_int_array(what, coeffs, *span);
+                if let Some(state) = state {
+                    self.check_int_array(what, state, *span);
+                }
+            }
+            Statement::DspFft { re, im, span } => {
+                self.check_int_array("DSP.FFT", re, *span);
+                self.check_int_array("DSP.FFT", im, *span);
+            }
+            Statement::DspMag { re, im, span } => {
+                self.check_int_array("DSP.MAG", re, *span);
+                self.check_int_array("DSP.MAG", im, *span);
+            }
+            Statement::DspLevel { array, target, var_type, span, .. } => {
+                self.check_int_array("DSP.RMS/PEAK", array, *span);
+                self.declare_or_check_var(target, var_type, *span);
+            }
             Statement::RegexMatch { pattern, text, target, var_type, span } => {
                 self.check_expr(pattern);
                 self.check_expr(text);
@@ -1347,6 +1836,75 @@ impl SemanticAnalyzer {
                 self.check_expr(replacement);
                 self.declare_or_check_var(target, var_type, *span);
             }
+
+            // ── String Builder ───────────────────────────────
+            Statement::StringBuilderNew { target, var_type, span } => {
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::SbAppend { handle, value, .. } => {
+                self.check_expr(handle);
+                self.check_expr(value);
+            }
+            Statement::SbToString { handle, target, var_type, span } => {
+                self.check_expr(handle);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::SbClear { handle, .. } | Statement::SbFree { handle, .. } => {
+                self.check_expr(handle);
+            }
+
+            // ── Channels ─────────────────────────────────────
+            Statement::ChannelNew { id, capacity, .. } => {
+                self.check_expr(id);
+                self.check_expr(capacity);
+            }
+            Statement::ChannelSend { id, value, .. } => {
+                self.check_expr(id);
+                self.check_expr(value);
+            }
+            Statement::ChannelReceive { id, target, var_type, span } => {
+                self.check_expr(id);
+                self.declare_or_check_var(target, var_type, *span);
+            }
+            Statement::ChannelSelect { ids, target, var_type, span } => {
+                for id in ids {
+                    self.check_expr(id);
+                }
+                self.declare_or_check_var(target, var_type, *span);
+            }
+        }
+    }
+
+    /// Runtime callbacks are plain `void fn(void)`: the handler must be a
+    /// SUB without parameters.
+    fn check_handler_sub(&mut self, what: &str, name: &str, span: Span) {
+        match self.subs.get(name) {
+            Some(info) if info.params.is_empty() => {}
+            Some(_) => self.errors.push(SemaError {
+                span,
+                message: format!("{} handler SUB '{}' must take no parameters", what, name),
+            }),
+            None => self.errors.push(SemaError {
+                span,
+                message: format!("{} handler '{}' must be a SUB", what, name),
+            }),
+        }
+    }
+
+    /// YIELD and AWAIT suspend an ASYNC body by returning from it, which
+    /// would skip the unwinding of an enclosing TRY block.
+    fn check_suspend_point(&mut self, span: Span) {
+        let in_try = self
+            .scope_stack
+            .iter()
+            .rev()
+            .take_while(|k| **k != ScopeKind::Async)
+            .any(|k| *k == ScopeKind::Try);
+        if in_try && self.scope_stack.contains(&ScopeKind::Async) {
+            self.errors.push(SemaError {
+                span,
+                message: "YIELD/AWAIT inside TRY cannot suspend an ASYNC block".to_string(),
+            });
         }
     }
 
@@ -1641,8 +2199,19 @@ impl SemanticAnalyzer {
 
     // ── Variable tracking ────────────────────────────────────
 
+    /// Mark the enclosing FOR counters named `name` (all of them for
+    /// `None`) as written inside their loop body.
+    fn invalidate_for_counters(&mut self, name: Option<&str>) {
+        for (var, written) in &mut self.for_counters {
+            if name.map_or(true, |n| n == var) {
+                *written = true;
+            }
+        }
+    }
+
     /// Register a variable without type checking (e.g., parameters).
     fn register_var(&mut self, name: &str, qb_type: &QBType) {
+        self.invalidate_for_counters(Some(name));
         if !self.variables.contains_key(name) {
             self.variables.insert(
                 name.to_string(),
@@ -1655,8 +2224,13 @@ impl SemanticAnalyzer {
         }
     }
 
-    /// Declare a variable or check type consistency with previous declaration.
+    /// Declare or type-check a variable that is being written.
     fn declare_or_check_var(&mut self, name: &str, qb_type: &QBType, span: Span) {
+        self.invalidate_for_counters(Some(name));
+        self.check_var(name, qb_type, span);
+    }
+
+    fn check_var(&mut self, name: &str, qb_type: &QBType, span: Span) {
         if let Some(existing) = self.variables.get(name) {
             // If the existing type or the new type is Inferred, skip mismatch check
             if existing.qb_type != QBType::Inferred
@@ -1689,9 +2263,75 @@ impl SemanticAnalyzer {
         }
     }
 
+    /// Check that `array` is a DIM'd numeric array for a whole-array
+    /// statement; returns whether its elements are integers.
+    fn check_numeric_array(&mut self, what: &str, array: &str, span: Span) -> Option<bool> {
+        match self.variables.get(array) {
+            // An array DIM'd without a type is SINGLE; TYPE records and
+            // function pointers are not numbers, whatever their size
+            Some(info)
+                if info.is_array
+                    && matches!(
+                        info.qb_type,
+                        QBType::Integer
+                            | QBType::Long
+                            | QBType::Single
+                            | QBType::Double
+                            | QBType::Inferred
+                    ) =>
+            {
+                Some(matches!(info.qb_type, QBType::Integer | QBType::Long))
+            }
+            Some(_) => {
+                self.errors.push(SemaError {
+                    span,
+                    message: format!("{what} needs a numeric array, {array} is not one"),
+                });
+                None
+            }
+            None => {
+                self.errors.push(SemaError {
+                    span,
+                    message: format!("undeclared array '{}'", array),
+                });
+                None
+            }
+        }
+    }
+
+    /// Check that `array` is a DIM'd INTEGER (or LONG) array.
+    fn check_int_array(&mut self, what: &str, array: &str, span: Span) {
+        match self.variables.get(array) {
+            Some(info) if info.is_array
+                && matches!(info.qb_type, QBType::Integer | QBType::Long) => {}
+            Some(_) => self.errors.push(SemaError {
+                span,
+                message: format!("{what} needs an INTEGER array, {array} is not one"),
+            }),
+            None => self.errors.push(SemaError {
+                span,
+                message: format!("undeclared array '{}'", array),
+            }),
+        }
+    }
+
+    /// Two numeric arrays with the same element kind (integer or float).
+    fn check_same_arrays(&mut self, what: &str, a: &str, b: &str, span: Span) {
+        let ka = self.check_numeric_array(what, a, span);
+        let kb = self.check_numeric_array(what, b, span);
+        if let (Some(ka), Some(kb)) = (ka, kb) {
+            if ka != kb {
+                self.errors.push(SemaError {
+                    span,
+                    message: format!("{what} needs two INTEGER or two floating-point arrays, {a} and {b} differ"),
+                });
+            }
+        }
+    }
+
     /// Reference a variable (auto-declare on first use per BASIC semantics).
     fn reference_var(&mut self, name: &str, qb_type: &QBType, span: Span) {
-        self.declare_or_check_var(name, qb_type, span);
+        self.check_var(name, qb_type, span);
     }
 }
 
@@ -1856,6 +2496,26 @@ mod tests {
         assert!(result.errors[0].message.contains("duplicate SUB"));
     }
 
+    #[test]
+    fn test_machine_named_like_enum() {
+        let result = analyze_str(
+            "ENUM Door\nSHUT\nOPEN\nEND ENUM\nMACHINE Door\nSTATE SHUT\nON PUSH GOTO SHUT\nEND STATE\nEND MACHINE",
+        );
+        assert!(result.has_errors());
+        assert!(
+            result.errors[0].message.contains("duplicate MACHINE: DOOR is already defined as an ENUM"),
+            "errors: {:?}",
+            result.errors
+        );
+    }
+
+    #[test]
+    fn test_duplicate_enum() {
+        let result = analyze_str("ENUM Color\nRED\nEND ENUM\nENUM Color\nBLUE\nEND ENUM");
+        assert!(result.has_errors());
+        assert!(result.errors[0].message.contains("duplicate ENUM"));
+    }
+
     #[test]
     fn test_sub_arg_count_mismatch() {
         let result =
@@ -1958,6 +2618,25 @@ mod tests {
         assert!(!result.has_errors(), "errors: {:?}", result.errors);
     }
 
+    #[test]
+    fn test_for_counter_invariant() {
+        let result = analyze_str("FOR i = 0 TO 9\nPRINT i\nNEXT i");
+        assert_eq!(result.invariant_for_loops.len(), 1);
+    }
+
+    #[test]
+    fn test_for_counter_written_in_body() {
+        let result = analyze_str("FOR i = 0 TO 9\nIF i = 3 THEN\ni = 8\nEND IF\nNEXT i");
+        assert!(!result.has_errors(), "errors: {:?}", result.errors);
+        assert!(result.invariant_for_loops.is_empty());
+
+        let result = analyze_str("FOR i = 0 TO 9\nFOR j = 0 TO 9\nINPUT i\nNEXT j\nNEXT i");
+        assert_eq!(result.invariant_for_loops.len(), 1);
+
+        let result = analyze_str("FOR i = 0 TO 9\nGOSUB Tick\nNEXT i\nEND\nTick:\nRETURN");
+        assert!(result.invariant_for_loops.is_empty());
+    }
+
     #[test]
     fn test_do_while_loop() {
         let result = analyze_str("DO WHILE x > 0\nx = x - 1\nLOOP");
@@ -2019,6 +2698,22 @@ mod tests {
         assert!(!result.has_errors(), "errors: {:?}", result.errors);
     }
 
+    #[test]
+    fn test_async_suspend_inside_try() {
+        let ok = analyze_str("ASYNC\n  x = 1\n  AWAIT UNTIL x > 0\n  YIELD\nEND ASYNC");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("ASYNC\n  TRY\n    AWAIT 10\n  CATCH e\n  END TRY\nEND ASYNC");
+        assert!(result.errors.iter().any(|e| e.message.contains("cannot suspend an ASYNC")));
+    }
+
+    #[test]
+    fn test_on_mqtt_message_needs_sub() {
+        let ok = analyze_str("SUB OnMessage\n  MQTT.RECEIVE m$\n  MQTT.TOPIC t$\nEND SUB\nON MQTT.MESSAGE GOSUB OnMessage");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("ON MQTT.MESSAGE GOSUB handler\nEND\nhandler:\nRETURN");
+        assert!(result.errors.iter().any(|e| e.message.contains("must be a SUB")));
+    }
+
     // ── Array tests ─────────────────────────────────────────
 
     #[test]
@@ -2055,4 +2750,71 @@ mod tests {
         // ArrayAccess path would error. This tests that no crash occurs.
         assert!(!result.has_errors() || result.errors.iter().any(|e| e.message.contains("undeclared")));
     }
+
+    #[test]
+    fn test_adc_block_needs_integer_array() {
+        let ok = analyze_str("DIM buf%(255)\nADC.STREAM 0, 20000\nADC.BLOCK buf%(), n%");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("DIM buf!(255)\nADC.BLOCK buf!()");
+        assert!(result.errors.iter().any(|e| e.message.contains("INTEGER array")));
+    }
+
+    #[test]
+    fn test_randomize_array_needs_numeric_array() {
+        let ok = analyze_str("DIM a!(9)\nDIM b%(9)\nRANDOMIZE ARRAY a!()\nRANDOMIZE ARRAY b%(), 1, 7");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("DIM s$(9)\nRANDOMIZE ARRAY s$()");
+        assert!(result.errors.iter().any(|e| e.message.contains("numeric array")));
+        let no_range = analyze_str("DIM b%(9)\nRANDOMIZE ARRAY b%()");
+        assert!(no_range.errors.iter().any(|e| e.message.contains("needs lo, hi")));
+    }
+
+    #[test]
+    fn test_array_kernels_check_types() {
+        let ok = analyze_str("DIM a!(9)\nDIM b!(9)\nDIM n%(9)\nARRAY.DOT a!(), b!(), y!\nARRAY.COPY a!(), b!()\nARRAY.SUM n%(), t&\nARRAY.SCALE n%(), 2");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let mixed = analyze_str("DIM a!(9)\nDIM n%(9)\nARRAY.COPY a!(), n%()");
+        assert!(mixed.errors.iter().any(|e| e.message.contains("differ")));
+        let scalar = analyze_str("x! = 1\nARRAY.FILL x!, 0");
+        assert!(scalar.errors.iter().any(|e| e.message.contains("numeric array")));
+        let records = analyze_str("TYPE Point\nx AS SINGLE\nEND TYPE\nDIM p(9) AS Point\nARRAY.FILL p(), 0");
+        assert!(records.errors.iter().any(|e| e.message.contains("numeric array")), "{:?}", records.errors);
+    }
+
+    #[test]
+    fn test_dsp_needs_integer_arrays() {
+        let ok = analyze_str("DIM x%(255)\nDIM h%(15)\nDIM z%(15)\nDIM im%(255)\nDSP.FIR x%(), h%(), z%()\nDSP.FFT x%(), im%()\nDSP.PEAK x%(), p%");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("DIM x!(255)\nDIM h%(15)\nDSP.FIR x!(), h%()");
+        assert!(result.errors.iter().any(|e| e.message.contains("DSP.FIR needs an INTEGER array")));
+    }
+
+    #[test]
+    fn test_restore_label_and_read_array() {
+        let ok = analyze_str("DIM t%(3)\nDATA 9\nTable:\nDATA 1, 2, 3, 4\nRESTORE Table\nREAD t%()");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        assert_eq!(ok.data_labels.get("TABLE"), Some(&1));
+        let missing = analyze_str("RESTORE Nowhere");
+        assert!(missing.has_errors());
+        let strings = analyze_str("DIM s$(3)\nREAD s$()");
+        assert!(strings.errors.iter().any(|e| e.message.contains("numeric array")));
+    }
+
+    #[test]
+    fn test_profile_dump_needs_string() {
+        let ok = analyze_str("PROFILE ON\nPROFILE.DUMP r$\nPROFILE OFF\nPROFILE.DUMP");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("PROFILE.DUMP n%");
+        assert!(result.errors.iter().any(|e| e.message.contains("PROFILE.DUMP needs a string variable")));
+    }
+
+    #[test]
+    fn test_json_extract_needs_string_targets() {
+        let ok = analyze_str("DIM n AS STRING\nJSON.EXTRACT j$, \"name\", n, \"id\", id$");
+        assert!(!ok.has_errors(), "errors: {:?}", ok.errors);
+        let result = analyze_str("JSON.EXTRACT j$, \"name\", n$, \"id\", id%");
+        assert!(result.errors.iter().any(|e| e.message.contains("JSON.EXTRACT needs a string variable")));
+        let inferred = analyze_str("JSON.EXTRACT j$, \"temp\", t");
+        assert!(inferred.has_errors());
+    }
 }
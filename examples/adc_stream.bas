@@ -0,0 +1,15 @@
+' ADC streaming example: sample a vibration sensor at 20 kHz by DMA
+' and report the peak-to-peak amplitude of every 1024-sample block.
+DIM buf(1023) AS INTEGER
+
+ADC.STREAM 0, 20000
+DO
+    ADC.BLOCK buf()
+    lo% = 4095
+    hi% = 0
+    FOR EACH s% IN buf
+        IF s% < lo% THEN lo% = s%
+        IF s% > hi% THEN hi% = s%
+    NEXT
+    PRINT "peak-to-peak: "; hi% - lo%
+LOOP
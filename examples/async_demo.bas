@@ -1,5 +1,41 @@
 ' Async / cooperative multitasking example
+' Each ASYNC block is a coroutine on the shared event loop: AWAIT and YIELD
+' suspend only that block, so the blink and button flows run side by side
+' without a task (or a stack) of their own.
+
+CONST BUTTON_PIN = 9
+CONST LED_PIN = 2
+
+FUNCTION ButtonDown% ()
+    GPIO.READ BUTTON_PIN, state%
+    ButtonDown% = (state% = 0)
+END FUNCTION
+
+GPIO.MODE BUTTON_PIN, 0
+GPIO.MODE LED_PIN, 1
+
 PRINT "Starting async demo"
+
+ASYNC
+    FOR i = 1 TO 10
+        GPIO.SET LED_PIN, i MOD 2
+        AWAIT 500
+    NEXT i
+    PRINT "Blink done"
+END ASYNC
+
+ASYNC
+    presses% = 0
+    DO WHILE presses% < 3
+        AWAIT UNTIL ButtonDown%()
+        presses% = presses% + 1
+        PRINT "Button press "; presses%
+        AWAIT 300
+    LOOP
+    PRINT "Button done"
+END ASYNC
+
+' Plain YIELD / AWAIT outside ASYNC still yield and sleep the calling task
 FOR i = 1 TO 5
     PRINT "Working... "; i
     YIELD
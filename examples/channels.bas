@@ -0,0 +1,27 @@
+' Channel example: a sensor task feeds readings to the main task
+CONST READINGS = 1
+CONST CONTROL = 2
+CHANNEL READINGS, 8
+CHANNEL CONTROL, 1
+
+TASK "sensor", 4096, 1
+    FOR i = 1 TO 5
+        TEMP.READ t
+        CHANNEL.SEND READINGS, "temp=" + STR$(t)
+        DELAY 200
+    NEXT i
+    CHANNEL.SEND CONTROL, 0
+END TASK
+
+running% = 1
+WHILE running%
+    CHANNEL.SELECT ready%, READINGS, CONTROL
+    IF ready% = READINGS THEN
+        CHANNEL.RECEIVE READINGS, msg$
+        PRINT "Got "; msg$
+    ELSE
+        CHANNEL.RECEIVE CONTROL, running%
+    END IF
+WEND
+PRINT "Sensor finished"
+END
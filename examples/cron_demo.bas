@@ -1,7 +1,19 @@
 ' Cron scheduling example
-CRON.ADD 1, "*/5"
-PRINT "Cron job added (every 5 minutes)"
-CRON.CHECK 1, fired%
-PRINT "Should fire: "; fired%
+SUB Minute
+    PRINT "A new minute has started"
+END SUB
+
+CRON.ADD 1, "* * * * *"
+ON CRON 1 GOSUB Minute
+PRINT "Cron job 1 added (every minute)"
+
+CRON.ADD 2, "*/5"
+PRINT "Cron job 2 added (every 5 minutes)"
+
+DELAY 120000
+CRON.CHECK 2, fired%
+PRINT "Job 2 fired: "; fired%
+
 CRON.REMOVE 1
-PRINT "Cron job removed"
+CRON.REMOVE 2
+PRINT "Cron jobs removed"
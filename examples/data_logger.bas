@@ -0,0 +1,16 @@
+' Data logger example: sample an ADC pin at 100 Hz into a CSV on the SD card.
+' LOG.WRITE only queues the line in RAM; a background task writes whole
+' clusters to the card, so the sampling loop never waits on it.
+SD.INIT 5
+LOG.OPEN "/sdcard/adc.csv", 1048576, 3
+TIMER.START
+FOR i = 1 TO 6000
+    ADC.READ 0, reading
+    TIMER.ELAPSED t
+    LOG.WRITE STR$(t) + "," + STR$(reading) + CHR$(10)
+    DELAY 10
+NEXT i
+LOG.FLUSH
+LOG.DROPPED lost%
+PRINT "Samples dropped: "; lost%
+LOG.CLOSE
@@ -2,10 +2,19 @@
 DIM count AS INTEGER
 count = 0
 
+' Runs on the event dispatcher task, not in the GPIO interrupt
+SUB OnButton
+    PRINT "Button changed"
+END SUB
+
 ON TIMER 1000 GOSUB tick
+ON GPIO.CHANGE 9 GOSUB OnButton
 PRINT "Timer event registered"
 DELAY 5000
 PRINT "Count: "; count
+EVENT.COALESCED merged%
+EVENT.DROPPED lost%
+PRINT "Merged: "; merged%; " lost: "; lost%
 END
 
 tick:
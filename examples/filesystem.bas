@@ -9,3 +9,30 @@ FILE.READ$ content$
 FILE.CLOSE
 PRINT "Read: "; content$
 FILE.DELETE "test.txt"
+
+' Copy a binary file in 4 KB blocks; zero bytes survive the round trip
+FILE.OPEN "dump.bin", "rb"
+total% = 0
+DO
+    FILE.READ$ block$, 4096
+    total% = total% + LEN(block$)
+LOOP UNTIL block$ = ""
+FILE.CLOSE
+PRINT "dump.bin: "; total%; " bytes"
+
+' Copy the alarm rows of a CSV log to the SD card, one line at a time
+FILE.OPEN "log.csv", "r", src%
+SD.OPEN "alarms.csv", "a", dst%
+alarms% = 0
+FILE.EOF done%, src%
+DO WHILE NOT done%
+    FILE.READLINE$ row$, src%
+    IF INSTR(row$, "ALARM") > 0 THEN
+        FILE.WRITE row$ + CHR$(10), dst%
+        alarms% = alarms% + 1
+    END IF
+    FILE.EOF done%, src%
+LOOP
+FILE.CLOSE src%
+FILE.CLOSE dst%
+PRINT "alarms copied: "; alarms%
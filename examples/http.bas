@@ -5,6 +5,13 @@ DIM ssid AS STRING
 DIM pass AS STRING
 DIM status AS INTEGER
 DIM response$ AS STRING
+DIM bytes AS INTEGER
+
+' Called for each chunk of a streamed response
+SUB OnChunk
+    HTTP.CHUNK chunk$
+    PRINT "chunk: "; LEN(chunk$); " bytes"
+END SUB
 
 ssid = "MyNetwork"
 pass = "MyPassword"
@@ -18,6 +25,26 @@ IF status = 1 THEN
     PRINT "Connected! Making HTTP GET request..."
     HTTP.GET "http://httpbin.org/get", response$
     PRINT "Response: "; response$
+
+    ' Bodies larger than free heap: straight to flash, or chunk by chunk
+    HTTP.DOWNLOAD "http://httpbin.org/bytes/65536", "download.bin", bytes
+    PRINT "Downloaded "; bytes; " bytes"
+    HTTP.STREAM "http://httpbin.org/stream/20", OnChunk, bytes
+    PRINT "Streamed "; bytes; " bytes"
+
+    ' Inside ASYNC the request runs off the event loop; other coroutines
+    ' keep running until the response arrives
+    ASYNC
+        HTTP.GET "http://httpbin.org/delay/2", slow$
+        PRINT "Slow response: "; LEN(slow$); " bytes"
+    END ASYNC
+    ASYNC
+        FOR i = 1 TO 4
+            PRINT "Still responsive "; i
+            AWAIT 500
+        NEXT i
+    END ASYNC
+    DELAY 3000
 ELSE
     PRINT "WiFi connection failed."
 END IF
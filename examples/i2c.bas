@@ -28,6 +28,11 @@ IF chipId = 88 THEN
     I2C.WRITE BMP280_ADDR, REG_TEMP_MSB
     I2C.READ BMP280_ADDR, 1, rawTemp
     PRINT "Raw temp MSB:"; rawTemp
+
+    ' Read all three temperature bytes in one register transaction
+    I2C.WRITEREAD$ BMP280_ADDR, CHR$(REG_TEMP_MSB), 3, raw$
+    rawTemp = ASC(MID$(raw$, 1, 1)) * 4096 + ASC(MID$(raw$, 2, 1)) * 16 + ASC(MID$(raw$, 3, 1)) \ 16
+    PRINT "Raw temp:"; rawTemp
 ELSE
     PRINT "Unknown device"
 END IF
@@ -1,7 +1,30 @@
 ' I2S audio output example
-I2S.INIT 44100, 16, 2
-PRINT "I2S initialized at 44100 Hz, 16-bit, stereo"
-I2S.WRITE "audio data placeholder"
-DELAY 1000
+' A MAX98357A amplifier on BCLK 4, LRCLK 5, DIN 6 and an
+' INMP441 microphone on SD 7
+
+I2S.PINS 4, 5, 6, 7
+I2S.INIT 16000, 16, 1
+PRINT "I2S initialized at 16000 Hz, 16-bit, mono"
+
+' The feeder task calls Refill whenever its queue runs low,
+' so playback continues while the main loop records.
+' Each call queues 100 ms of a 200 Hz square wave
+' (one 16-bit sample = 2 bytes)
+SUB Refill
+    tone$ = ""
+    FOR i = 0 TO 19
+        tone$ = tone$ + STRING$(80, 0) + STRING$(80, 64)
+    NEXT i
+    I2S.WRITE tone$
+END SUB
+ON I2S.NEED GOSUB Refill
+
+total = 0
+FOR block = 1 TO 20
+    I2S.READ$ 1024, mic$
+    total = total + LEN(mic$)
+NEXT block
+PRINT "Captured"; total; "bytes"
+
 I2S.STOP
 PRINT "I2S stopped"
@@ -22,4 +22,23 @@ PRINT "Key count: "; count
 JSON.SET json$, "author", "ESP32", updated$
 PRINT "Updated: "; updated$
 
+' Pull several fields out in one pass without building a parse tree
+JSON.EXTRACT updated$, "name", n$, "author", a$
+PRINT "Name: "; n$; ", author: "; a$
+
+' Serialize telemetry in one pass with the JSON writer
+STRINGBUILDER sb%
+JSON.BEGIN sb%
+JSON.ADD sb%, "device", "probe"
+JSON.ADD sb%, "temp", 21.5
+JSON.BEGINARRAY sb%, "samples"
+FOR i = 1 TO 3
+    JSON.PUSH sb%, i * 10
+NEXT i
+JSON.END sb%
+JSON.END sb%
+SB.TOSTRING sb%, telemetry$
+PRINT "Telemetry: "; telemetry$
+SB.FREE sb%
+
 END
@@ -1,6 +1,12 @@
 ' MQTT pub/sub example for ESP32-C3
 DIM status AS INTEGER
-DIM msg$ AS STRING
+
+' Runs on the MQTT dispatch task for every message that arrives
+SUB OnMessage
+    MQTT.TOPIC topic$
+    MQTT.RECEIVE msg$
+    PRINT "Received on "; topic$; ": "; msg$
+END SUB
 
 WIFI.CONNECT "MyNetwork", "MyPassword"
 DELAY 3000
@@ -8,11 +14,19 @@ WIFI.STATUS status
 
 IF status = 1 THEN
     MQTT.CONNECT "mqtt://broker.hivemq.com", 1883
+    ON MQTT.MESSAGE GOSUB OnMessage
     MQTT.SUBSCRIBE "rustybasic/test"
-    MQTT.PUBLISH "rustybasic/test", "Hello from RustyBASIC!"
-    DELAY 2000
-    MQTT.RECEIVE msg$
-    PRINT "Received: "; msg$
+    MQTT.PUBLISH "rustybasic/test", "Hello from RustyBASIC!", 1
+
+    ' Pack 10 readings into each payload; PUBLISH returns at once
+    MQTT.COALESCE "rustybasic/temp", 2, 10
+    FOR i = 1 TO 50
+        TEMP.READ t!
+        MQTT.PUBLISH "rustybasic/temp", STR$(t!)
+        DELAY 100
+    NEXT i
+    MQTT.FLUSH
+    DELAY 5000
     MQTT.DISCONNECT
 END IF
 
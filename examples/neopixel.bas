@@ -18,5 +18,18 @@ FOR cycle = 0 TO 2
     DELAY 500
 NEXT cycle
 
+' Whole frames: fill an array and hand it over in one call.
+' LED.SHOW returns while the frame goes out, so the next one
+' is computed during the transfer.
+DIM frame(NUM_LEDS - 1) AS INTEGER
+FOR t = 0 TO 255
+    FOR i = 0 TO NUM_LEDS - 1
+        frame(i) = ((i * 32 + t) MOD 256) * 65536 + (t MOD 256) * 256 + 64
+    NEXT i
+    LED.SETALL frame
+    LED.SHOW
+    DELAY 16
+NEXT t
+
 LED.CLEAR
 PRINT "Rainbow complete!"
@@ -1,6 +1,7 @@
 ' OLED Display Example
 ' SSD1306 128x64 OLED via I2C
 
+I2C.SETUP 0, 4, 5, 400000
 OLED.INIT 128, 64
 OLED.CLEAR
 OLED.PRINT 0, 0, "Hello OLED!"
@@ -8,3 +9,10 @@ OLED.PRINT 0, 16, "RustyBASIC"
 OLED.PIXEL 64, 32, 1
 OLED.LINE 0, 63, 127, 63, 1
 OLED.SHOW
+
+' Only the changed digits go over the bus on each SHOW
+FOR i = 0 TO 9
+    OLED.PRINT 0, 32, "Count: " + STR$(i)
+    OLED.SHOW
+    DELAY 200
+NEXT i
@@ -0,0 +1,24 @@
+' Worker pool example: fan short jobs out to SPAWN workers
+CONST RESULTS = 1
+TASK.POOL 2, 4096, 1
+
+FOR i = 1 TO 4
+    SPAWN
+        total = 0
+        FOR k = 1 TO 1000
+            total = total + k
+        NEXT k
+        CHANNEL.SEND RESULTS, total
+    END SPAWN
+NEXT i
+
+SPAWN last%
+    PRINT "Last job running"
+END SPAWN
+WAIT last%
+
+FOR i = 1 TO 4
+    CHANNEL.RECEIVE RESULTS, total
+    PRINT "Job result: "; total
+NEXT i
+END
@@ -14,4 +14,12 @@ END MACHINE
 PRINT "Traffic light created"
 TrafficLight.EVENT "TIMER"
 PRINT "After first event"
+
+TrafficLight.STATE s%
+IF s% = TrafficLight.GREEN THEN PRINT "Light is green"
+
+ev$ = "TIMER"
+TrafficLight.EVENT ev$
+TrafficLight.STATE name$
+PRINT "Now: "; name$
 END
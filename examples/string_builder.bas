@@ -0,0 +1,12 @@
+' String builder example: format telemetry without temporary strings
+STRINGBUILDER sb%
+FOR i = 1 TO 3
+    SB.APPEND sb%, "sensor="
+    SB.APPEND sb%, i
+    SB.APPEND sb%, " temp="
+    SB.APPEND sb%, 21.5 + i
+    SB.TOSTRING sb%, line$
+    PRINT line$
+    SB.CLEAR sb%
+NEXT i
+SB.FREE sb%
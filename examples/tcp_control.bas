@@ -0,0 +1,28 @@
+' Telnet-style control port: several operators at once on one task
+SUB OnCommand
+    TCP.RECEIVE$ cmd$
+    TCP.CLIENT who%
+    IF cmd$ = "" THEN
+        PRINT "Operator "; who%; " left"
+        EXIT SUB
+    END IF
+    IF LEFT$(cmd$, 4) = "quit" THEN
+        TCP.SEND "bye" + CHR$(10)
+        TCP.CLOSE
+    ELSEIF LEFT$(cmd$, 3) = "led" THEN
+        GPIO.WRITE 2, 1
+        TCP.SEND "led on" + CHR$(10)
+    ELSE
+        TCP.SEND "unknown: " + cmd$
+    END IF
+END SUB
+
+WIFI.CONNECT "MySSID", "MyPassword"
+DELAY 3000
+GPIO.MODE 2, 1
+TCP.LISTEN 2323
+ON TCP.DATA GOSUB OnCommand
+PRINT "Control port on 2323"
+DO
+    DELAY 1000
+LOOP
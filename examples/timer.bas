@@ -1,14 +1,28 @@
 ' Timer stopwatch example (QBASIC style)
-' Measures elapsed time in milliseconds
+' Measures elapsed time in milliseconds and microseconds,
+' and schedules SUBs on the microsecond timer
 
 DIM elapsed AS INTEGER
 
+SUB Pulse
+    PRINT "One-shot timer fired"
+END SUB
+
+SUB Tick
+    PRINT "Tick"
+END SUB
+
 TIMER.START
 
+TIMER.AFTER 250000, Pulse
+TIMER.EVERY 100000, Tick, ticker%
+
 PRINT "Working..."
 DELAY 1500
+TIMER.CANCEL ticker%
 
 TIMER.ELAPSED elapsed
-PRINT "Elapsed time: "; elapsed; " ms"
+TIMER.MICROS us&
+PRINT "Elapsed time: "; elapsed; " ms ("; us&; " us)"
 
 END
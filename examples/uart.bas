@@ -1,21 +1,22 @@
 ' UART serial communication example for ESP32-C3 (QBASIC style)
-' Sets up UART port 1 and echoes received bytes
+' Sets up UART port 1 and echoes each received line
 
 CONST PORT = 1
 CONST BAUD = 9600
 CONST TX_PIN = 4
 CONST RX_PIN = 5
 
-DIM received AS INTEGER
+' Runs on the UART event task once per line; the main loop stays free
+SUB OnLine
+    UART.LINE$ text$
+    UART.SEND 1, "> " + text$ + CHR$(13) + CHR$(10)
+    PRINT "Echo: "; text$
+END SUB
 
-UART.SETUP PORT, BAUD, TX_PIN, RX_PIN
-PRINT "UART ready. Echoing data..."
+UART.SETUP PORT, BAUD, TX_PIN, RX_PIN, 1024
+PRINT "UART ready. Echoing lines..."
+ON UART.LINE PORT GOSUB OnLine
 
 DO
-    UART.READ PORT, received
-    IF received >= 0 THEN
-        UART.WRITE PORT, received
-        PRINT "Echo: "; received
-    END IF
-    DELAY 10
+    DELAY 1000
 LOOP
@@ -1,8 +1,22 @@
 ' Web server example
+SUB OnStatus
+    WEB.REPLY 200, "running"
+END SUB
+
+SUB OnEcho
+    WEB.BODY$ b$
+    WEB.REPLY 200, b$
+END SUB
+
 WIFI.CONNECT "MySSID", "MyPassword"
 DELAY 3000
 WEB.START 80
 PRINT "Web server started on port 80"
+' Routes are served on worker tasks, concurrently with the loop below
+WEB.ROUTE "GET", "/api/status", OnStatus
+WEB.ROUTE "POST", "/api/echo", OnEcho
+' Everything else under / comes from /littlefs/www
+WEB.SERVE "/", "www"
 WEB.WAIT$ path$
 PRINT "Request for: "; path$
 WEB.BODY$ body$
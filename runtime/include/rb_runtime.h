@@ -8,19 +8,102 @@
 extern "C" {
 #endif
 
+/* Per-task storage for runtime state (string pools, the current HTTP chunk) */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define RB_THREAD_LOCAL _Thread_local
+#else
+#define RB_THREAD_LOCAL __thread
+#endif
+
 /* ── String type (refcounted) ─────────────────────────── */
 
 typedef struct rb_string {
     int32_t refcount;
     int32_t length;
-    char data[];  /* flexible array member */
+    int32_t capacity;  /* bytes available at data, excluding the NUL; 0 for views */
+    char* data;        /* inline storage after the header, or a window into parent */
+    struct rb_string* parent;  /* retained owner of data for views, else NULL */
 } rb_string_t;
 
+/* Views (substrings sharing their parent's bytes) are not NUL-terminated
+ * in general: code that only needs the bytes should use data/length, and
+ * code that hands the text to a C API should go through rb_string_cstr(). */
+#define RB_STRING_IS_VIEW(s) ((s)->parent != NULL)
+
+/* Refcount sentinel for immortal strings (literals emitted by codegen as
+ * constant globals in rodata). retain/release are no-ops on them, and they
+ * are never freed or written to. */
+#define RB_STRING_IMMORTAL INT32_MIN
+#define RB_STRING_IS_IMMORTAL(s) ((s)->refcount == RB_STRING_IMMORTAL)
+
+/* Refcount flag for strings reachable from more than one task. Their
+ * retain/release use atomics; everything else, including a string that
+ * never leaves the task that built it, keeps plain increments. */
+#define RB_STRING_SHARED 0x40000000
+#define RB_STRING_IS_SHARED(s) (((s)->refcount & RB_STRING_SHARED) != 0)
+/* Either flag sends retain/release down the out-of-line slow path */
+#define RB_STRING_RC_SLOW (RB_STRING_IMMORTAL | RB_STRING_SHARED)
+
 rb_string_t* rb_string_alloc(const char* cstr);
+/* Copy of `len` bytes at `data`, which may contain NULs */
+rb_string_t* rb_string_from_bytes(const char* data, int32_t len);
+/* Trim `s`, a fresh rb_string_new buffer that was read into, to the
+ * `length` bytes actually filled. Consumes `s`; returns the result. */
+rb_string_t* rb_string_fit(rb_string_t* s, int32_t length);
 rb_string_t* rb_string_concat(rb_string_t* a, rb_string_t* b);
 int32_t rb_string_compare(rb_string_t* a, rb_string_t* b);
+int32_t rb_string_equal(rb_string_t* a, rb_string_t* b);  /* 1 if equal, else 0 */
 void rb_string_retain(rb_string_t* s);
 void rb_string_release(rb_string_t* s);
+void rb_string_retain_slow(rb_string_t* s);
+void rb_string_release_slow(rb_string_t* s);
+
+/* Mark `s` as shared before handing it to another task (channels, runtime
+ * caches). Must be called by the task that currently owns `s`. */
+void rb_string_share(rb_string_t* s);
+
+/* Append `src` to `dst`, consuming the caller's reference to `dst`.
+ * A uniquely owned `dst` with spare capacity is extended in place;
+ * otherwise it is copied into a buffer with geometric headroom. */
+rb_string_t* rb_string_append(rb_string_t* dst, rb_string_t* src);
+rb_string_t* rb_string_append_bytes(rb_string_t* dst, const char* data, int32_t len);
+
+/* Substring of `s` starting at byte `start`, `length` bytes long (both
+ * already clamped by the caller). Long substrings share the parent's
+ * storage instead of copying it. */
+rb_string_t* rb_string_slice(rb_string_t* s, int32_t start, int32_t length);
+
+/* NUL-terminated contents of `s` ("" for NULL). A view that does not end
+ * where its parent does is copied once, on first use, and stays cheap
+ * afterwards. */
+const char* rb_string_cstr(rb_string_t* s);
+
+/* ── String allocator (size-class pool) ───────────────── */
+
+#define RB_STRING_POOL_CLASSES 5
+
+typedef struct rb_string_pool_stats {
+    uint32_t block_size[RB_STRING_POOL_CLASSES];
+    uint32_t hits[RB_STRING_POOL_CLASSES];    /* served from the freelist */
+    uint32_t misses[RB_STRING_POOL_CLASSES];  /* freelist empty, slab refill */
+    uint32_t slabs[RB_STRING_POOL_CLASSES];   /* slabs carved so far */
+    uint32_t oversize;                        /* larger than any class, malloc'd */
+    int32_t live;                             /* allocated minus freed by this task */
+    uint32_t allocs;                          /* strings allocated by this task */
+    uint32_t frees;                           /* strings freed by this task */
+} rb_string_pool_stats_t;
+
+/* Allocate a string with room for `length` bytes; data[length] is NUL, refcount 1. */
+rb_string_t* rb_string_new(int32_t length);
+/* As rb_string_new, but reserve at least `capacity` bytes of data. */
+rb_string_t* rb_string_new_with_capacity(int32_t length, int32_t capacity);
+void rb_string_free(rb_string_t* s);
+void rb_string_pool_stats(rb_string_pool_stats_t* out);
+void rb_string_pool_reset_stats(void);
+void rb_string_pool_print_stats(void);
+/* Hand the calling task's free blocks back for other tasks to reuse;
+ * called as a task exits. */
+void rb_string_pool_release_task(void);
 
 /* ── Print ────────────────────────────────────────────── */
 
@@ -29,6 +112,49 @@ void rb_print_float(float value);
 void rb_print_string(rb_string_t* s);
 void rb_print_newline(void);
 
+/* ── Console ──────────────────────────────────────────── */
+
+/* CONSOLE.MODE policies: when buffered PRINT output is written out */
+#define RB_CONSOLE_SYNC 0   /* straight through, flushed at each newline */
+#define RB_CONSOLE_LINE 1   /* drain task woken at each newline */
+#define RB_CONSOLE_SIZE 2   /* ... once n bytes are pending */
+#define RB_CONSOLE_IDLE 3   /* ... after n ms without output */
+
+void rb_console_write(const char* data, int32_t len);
+/* Wait until everything written so far has reached the console */
+void rb_console_flush(void);
+void rb_console_mode(int32_t mode, int32_t n);
+/* Write out whatever is still queued without the console lock or the drain
+ * task, for crash paths about to restart or abort */
+void rb_print_drain_now(void);
+
+/* ── Number formatting ────────────────────────────────── */
+
+/* Buffer sizes that hold any result of the formatter of that name */
+#define RB_FMT_INT_MAX 12
+#define RB_FMT_FLOAT_MAX 16
+#define RB_FMT_FIXED_MAX 80
+
+/* Each writes into buf and returns the length; buf is not NUL-terminated. */
+int rb_fmt_uint(char* buf, uint32_t value);
+int rb_fmt_int(char* buf, int32_t value);
+/* Shortest digits that read back as value, laid out like %g */
+int rb_fmt_float(char* buf, float value);
+/* value with exactly `decimals` digits after the point, halves away from zero */
+int rb_fmt_fixed(char* buf, float value, int32_t decimals);
+
+/* ── Number parsing ───────────────────────────────────── */
+
+/* Parse the number at the start of data[0..len) after any blanks: sign,
+ * digits, fraction, exponent (the int form stops at anything but digits).
+ * *end (if not NULL) gets the bytes consumed, 0 if there was no number,
+ * in which case the result is 0. Nothing needs to be NUL-terminated. */
+float rb_scan_float(const char* data, int32_t len, int32_t* end);
+int32_t rb_scan_int(const char* data, int32_t len, int32_t* end);
+/* VAL.NEXT: the number at 1-based *pos; *pos moves past it and its separator */
+float rb_fn_val_next(rb_string_t* s, int32_t* pos);
+int32_t rb_fn_val_next_int(rb_string_t* s, int32_t* pos);
+
 /* ── Input ────────────────────────────────────────────── */
 
 int32_t rb_input_int(const char* prompt);
@@ -39,6 +165,17 @@ rb_string_t* rb_input_string(const char* prompt);
 
 void rb_panic(const char* message) __attribute__((noreturn));
 
+/* ── Profiling ────────────────────────────────────────── */
+
+/* Emitted around each SUB/FUNCTION body by --profile */
+void rb_prof_enter(int32_t id, const char* name);
+void rb_prof_exit(int32_t id);
+/* PROFILE ON (clear and start) / PROFILE OFF */
+void rb_profile_on(int32_t on);
+void rb_profile_dump(void);
+rb_string_t* rb_profile_report(void);
+void rb_profile_panic_dump(void);
+
 /* ── GPIO ─────────────────────────────────────────────── */
 
 void rb_gpio_mode(int32_t pin, int32_t mode);
@@ -54,11 +191,23 @@ void rb_delay(int32_t ms);
 void rb_i2c_setup(int32_t bus, int32_t sda, int32_t scl, int32_t freq);
 void rb_i2c_write(int32_t addr, int32_t data);
 int32_t rb_i2c_read(int32_t addr, int32_t length);
+/* Buffer transfers; a string is the byte buffer */
+void rb_i2c_send(int32_t addr, rb_string_t* data);
+rb_string_t* rb_i2c_read_str(int32_t addr, int32_t n);
+/* Write `tx`, then read `n` bytes after a repeated START */
+rb_string_t* rb_i2c_write_read(int32_t addr, rb_string_t* tx, int32_t n);
+/* Raw write for drivers on the I2C bus (OLED); 0 on success */
+int rb_i2c_write_bytes(int32_t addr, const uint8_t* data, size_t len);
 
 /* ── SPI ──────────────────────────────────────────────── */
 
 void rb_spi_setup(int32_t bus, int32_t clk, int32_t mosi, int32_t miso, int32_t freq);
 int32_t rb_spi_transfer(int32_t data);
+/* Queue `data` for DMA and return; SPI.FLUSH waits for the queue */
+void rb_spi_send(rb_string_t* data);
+/* Full-duplex: the bytes clocked in while sending `data` */
+rb_string_t* rb_spi_transfer_str(rb_string_t* data);
+void rb_spi_flush(void);
 
 /* ── WiFi ─────────────────────────────────────────────── */
 
@@ -69,6 +218,11 @@ void rb_wifi_disconnect(void);
 /* ── ADC ──────────────────────────────────────────────── */
 
 int32_t rb_adc_read(int32_t pin);
+/* Sample `pin` continuously by DMA at `rate_hz` */
+void rb_adc_stream(int32_t pin, int32_t rate_hz);
+/* Fill `out` with the next `max` streamed samples; returns the count */
+int32_t rb_adc_block(int32_t* out, int32_t max);
+void rb_adc_stop(void);
 
 /* ── PWM ──────────────────────────────────────────────── */
 
@@ -77,32 +231,87 @@ void rb_pwm_duty(int32_t channel, int32_t duty);
 
 /* ── UART ─────────────────────────────────────────────── */
 
-void rb_uart_setup(int32_t port, int32_t baud, int32_t tx, int32_t rx);
+/* rx_buffer 0 picks the default RX ring size */
+void rb_uart_setup(int32_t port, int32_t baud, int32_t tx, int32_t rx, int32_t rx_buffer);
 void rb_uart_write(int32_t port, int32_t data);
 int32_t rb_uart_read(int32_t port);
+void rb_uart_send(int32_t port, rb_string_t* data);
+/* Up to `max` received bytes, waiting briefly only if none are buffered */
+rb_string_t* rb_uart_read_str(int32_t port, int32_t max);
+/* ON UART.LINE: call `handler` on the port's event task for every frame
+ * ending in `delim`; UART.LINE$ (rb_uart_line) returns that frame */
+void rb_on_uart_line(int32_t port, int32_t delim, void (*handler)(void));
+rb_string_t* rb_uart_line(void);
 
 /* ── Timer ────────────────────────────────────────────── */
 
 void rb_timer_start(void);
+/* Milliseconds since TIMER.START; wraps after about 24.8 days */
 int32_t rb_timer_elapsed(void);
+/* Microseconds since TIMER.START; wraps to negative after about 35.8
+ * minutes (2^31 us), so compare readings by their difference */
+int32_t rb_timer_micros(void);
+
+/* All runtime timers share one clock (rb_timer.c). `fn(arg)` runs on the
+ * clock's task after `delay_us`, then every `period_us` if it is nonzero,
+ * and must return quickly. Returns an id for rb_sched_cancel, -1 when all
+ * RB_TIMER_MAX slots are taken; cancel returns the timer's `arg`, or -1 if
+ * it is no longer scheduled. */
+#define RB_TIMER_MAX 64
+int32_t rb_sched_add(int64_t delay_us, int64_t period_us, void (*fn)(int32_t), int32_t arg);
+int32_t rb_sched_cancel(int32_t id);
+
+/* TIMER.AFTER / TIMER.EVERY: run `handler` once / every `us` microseconds
+ * on the event dispatcher task; the id is for TIMER.CANCEL */
+int32_t rb_timer_after(int32_t us, void (*handler)(void));
+int32_t rb_timer_every(int32_t us, void (*handler)(void));
+void rb_timer_cancel(int32_t id);
 
 /* ── HTTP ─────────────────────────────────────────────── */
 
 rb_string_t* rb_http_get(rb_string_t* url);
 rb_string_t* rb_http_post(rb_string_t* url, rb_string_t* body);
+/* Device side of HTTP.* and HTTPS.*: a GET (content_type NULL) or POST over a
+ * pooled keep-alive connection per scheme://host:port, returning the full
+ * body ("" on failure). */
+rb_string_t* rb_http_request(rb_string_t* url, rb_string_t* body,
+                             const char* content_type, int32_t tls);
+/* Stream a GET response at constant memory, chunk by chunk: into a file
+ * (relative paths on LittleFS), or through `on_chunk`, which reads each
+ * chunk with rb_http_chunk. Both return the byte count, or -1 on failure. */
+int32_t rb_http_download(rb_string_t* url, rb_string_t* path);
+int32_t rb_http_stream(rb_string_t* url, void (*on_chunk)(void));
+rb_string_t* rb_http_chunk(void);
 
 /* ── NVS (Non-Volatile Storage) ───────────────────────── */
 
 void rb_nvs_write(rb_string_t* key, int32_t value);
 int32_t rb_nvs_read(rb_string_t* key);
+void rb_nvs_write_str(rb_string_t* key, rb_string_t* value);
+rb_string_t* rb_nvs_read_str(rb_string_t* key);
+/* Write out every key changed since the last commit */
+void rb_nvs_commit(void);
+/* Commit ms after the first uncommitted write; 0 for NVS.COMMIT only */
+void rb_nvs_autocommit(int32_t ms);
 
 /* ── MQTT ─────────────────────────────────────────────── */
 
 void rb_mqtt_connect(rb_string_t* broker, int32_t port);
 void rb_mqtt_disconnect(void);
-void rb_mqtt_publish(rb_string_t* topic, rb_string_t* message);
+/* Queue a message for the MQTT task (QoS 0-2, retain 0/1); never waits
+ * for the network */
+void rb_mqtt_publish(rb_string_t* topic, rb_string_t* message, int32_t qos, int32_t retain);
+/* Batch PUBLISHes to `topic`: mode 0 sends each one, 1 keeps only the
+ * latest and sends it every `n` ms, 2 packs `n` messages into one
+ * newline-separated payload. rb_mqtt_flush sends anything held back. */
+void rb_mqtt_coalesce(rb_string_t* topic, int32_t mode, int32_t n);
+void rb_mqtt_flush(void);
 void rb_mqtt_subscribe(rb_string_t* topic);
+/* Next received payload (full length, waits up to 5 s). Inside an
+ * ON MQTT.MESSAGE handler: the message being dispatched, at once. */
 rb_string_t* rb_mqtt_receive(void);
+/* Topic of the message rb_mqtt_receive returned (or being dispatched) */
+rb_string_t* rb_mqtt_topic(void);
 
 /* ── BLE ──────────────────────────────────────────────── */
 
@@ -111,17 +320,37 @@ void rb_ble_advertise(int32_t mode);
 rb_string_t* rb_ble_scan(void);
 void rb_ble_send(rb_string_t* data);
 rb_string_t* rb_ble_receive(void);
+void rb_ble_interval(int32_t min_ms, int32_t max_ms);
+int32_t rb_ble_mtu(void);
 
 /* ── JSON ─────────────────────────────────────────────── */
 
 rb_string_t* rb_json_get(rb_string_t* json, rb_string_t* key);
 rb_string_t* rb_json_set(rb_string_t* json, rb_string_t* key, rb_string_t* value);
 int32_t rb_json_count(rb_string_t* json);
+/* Drop the calling task's parse cache; called as a task exits. */
+void rb_json_release_task(void);
+
+/* Streaming extraction: one pass over the text, no tree, no heap. Each
+ * out[i] is set to the raw text of the value at paths[i] (strings keep
+ * their quotes), or ptr = NULL if absent. Returns the number found. */
+#define RB_JSON_MAX_PATHS 16
+typedef struct rb_json_slice {
+    const char* ptr;
+    int32_t len;
+} rb_json_slice_t;
+int32_t rb_json_extract(const char* text, int32_t len, const char* const* paths,
+                        int32_t npaths, rb_json_slice_t* out);
+/* JSON.EXTRACT: decode each path's value into a new string in out[]. */
+void rb_json_extract_multi(rb_string_t* json, int32_t n, rb_string_t** paths, rb_string_t** out);
 
 /* ── NeoPixel (WS2812) ────────────────────────────────── */
 
 void rb_led_setup(int32_t pin, int32_t count);
 void rb_led_set(int32_t index, int32_t r, int32_t g, int32_t b);
+/* Whole frame from `n` colors packed r * 65536 + g * 256 + b (LED.SETALL) */
+void rb_led_set_all(const int32_t* colors, int32_t n);
+/* Starts sending the frame and returns; the next SET draws into the other buffer */
 void rb_led_show(void);
 void rb_led_clear(void);
 
@@ -133,6 +362,9 @@ void rb_deepsleep(int32_t ms);
 
 void rb_espnow_init(void);
 void rb_espnow_send(rb_string_t* peer, rb_string_t* data);
+/* Handle (1-based) of a peer MAC, added on first use; 0 if invalid */
+int32_t rb_espnow_peer(rb_string_t* peer);
+void rb_espnow_send_to(int32_t peer, rb_string_t* data);
 rb_string_t* rb_espnow_receive(void);
 
 /* ── DATA/READ/RESTORE ───────────────────────────────── */
@@ -141,10 +373,19 @@ int32_t rb_data_read_int(void);
 float rb_data_read_float(void);
 rb_string_t* rb_data_read_string(void);
 void rb_data_restore(void);
+void rb_data_restore_at(int32_t offset);
+/* READ a(): fill a whole INTEGER or SINGLE array */
+void rb_data_read_ints(int32_t* dst, int32_t n);
+void rb_data_read_floats(float* dst, int32_t n);
 
 /* ── Classic BASIC extensions ────────────────────────── */
 
 void rb_randomize(int32_t seed);
+/* RANDOMIZE with no seed: reseed from hardware entropy */
+void rb_randomize_hw(void);
+/* RANDOMIZE ARRAY: n values with lo <= x < hi */
+void rb_rnd_fill_float(float* data, int32_t n, float lo, float hi);
+void rb_rnd_fill_int(int32_t* data, int32_t n, int32_t lo, int32_t hi);
 void rb_print_using_int(rb_string_t* fmt, int32_t value);
 void rb_print_using_float(rb_string_t* fmt, float value);
 void rb_print_using_string(rb_string_t* fmt, rb_string_t* value);
@@ -207,6 +448,30 @@ void* rb_array_alloc(int32_t element_size, int32_t total_elements);
 void rb_array_free(void* ptr);
 void rb_array_bounds_check(int32_t index, int32_t size);
 
+/* Whole-array kernels: ARRAY.SUM/MIN/MAX/DOT/FILL/COPY/SCALE */
+int32_t rb_array_sum_int(const int32_t* data, int32_t n);
+float rb_array_sum_float(const float* data, int32_t n);
+int32_t rb_array_min_int(const int32_t* data, int32_t n);
+int32_t rb_array_max_int(const int32_t* data, int32_t n);
+float rb_array_min_float(const float* data, int32_t n);
+float rb_array_max_float(const float* data, int32_t n);
+int32_t rb_array_dot_int(const int32_t* a, int32_t na, const int32_t* b, int32_t nb);
+float rb_array_dot_float(const float* a, int32_t na, const float* b, int32_t nb);
+void rb_array_fill_int(int32_t* data, int32_t n, int32_t value);
+void rb_array_fill_float(float* data, int32_t n, float value);
+void rb_array_copy(void* dst, int32_t dst_n, const void* src, int32_t src_n);
+void rb_array_scale_int(int32_t* data, int32_t n, float factor, float offset);
+void rb_array_scale_float(float* data, int32_t n, float factor, float offset);
+
+/* ── DSP (fixed point, INTEGER arrays) ───────────────── */
+
+void rb_dsp_fir(int32_t* x, int32_t n, const int32_t* h, int32_t taps, int32_t* z, int32_t nz);
+void rb_dsp_biquad(int32_t* x, int32_t n, const int32_t* c, int32_t nc, int32_t* z, int32_t nz);
+void rb_dsp_fft(int32_t* re, int32_t nre, int32_t* im, int32_t nim);
+void rb_dsp_mag(int32_t* re, int32_t nre, const int32_t* im, int32_t nim);
+int32_t rb_dsp_rms(const int32_t* x, int32_t n);
+int32_t rb_dsp_peak(const int32_t* x, int32_t n);
+
 /* ── String built-ins ─────────────────────────────────── */
 
 int32_t rb_fn_len(rb_string_t* s);
@@ -232,6 +497,11 @@ float rb_fn_tan(float x);
 float rb_fn_atn(float x);
 float rb_fn_log(float x);
 float rb_fn_exp(float x);
+/* --fast-math versions of SIN, COS, EXP and LOG (rb_fastmath.c) */
+float rb_fn_sin_fast(float x);
+float rb_fn_cos_fast(float x);
+float rb_fn_exp_fast(float x);
+float rb_fn_log_fast(float x);
 int32_t rb_fn_int(float x);
 int32_t rb_fn_fix(float x);
 int32_t rb_fn_sgn(float x);
@@ -243,27 +513,56 @@ void rb_assert_fail(rb_string_t* message, int32_t offset) __attribute__((noretur
 
 /* ── TRY/CATCH ───────────────────────────────────────── */
 
-int32_t rb_try_begin(void);
+/* Nonzero while an error raised inside TRY is unwinding; codegen tests it
+ * after statements (see rb_try.c) */
+extern __thread int32_t rb_error_pending;
+void rb_try_begin(void);
 void rb_try_end(void);
+rb_string_t* rb_try_catch(void);
+/* Inside TRY this returns after recording the error, so the caller must
+ * still return normally; outside TRY it aborts */
 void rb_throw(rb_string_t* message);
 rb_string_t* rb_get_error_message(void);
 
 /* ── TASK (FreeRTOS / pthreads) ──────────────────────── */
 
 void rb_task_create(void (*fn)(void*), rb_string_t* name, int32_t stack_size, int32_t priority);
+/* Worker pool behind SPAWN: configure before the first SPAWN (core -1 lets
+ * the scheduler pick). rb_spawn queues `fn` and returns a job id for
+ * rb_wait, which blocks until that job has finished. */
+void rb_task_pool(int32_t workers, int32_t stack_size, int32_t priority, int32_t core);
+int32_t rb_spawn(void (*fn)(void*));
+void rb_wait(int32_t job);
 
 /* ── EVENT system ────────────────────────────────────── */
 
+/* ON GPIO.CHANGE / ON TIMER handlers run on the event dispatcher task,
+ * never in the ISR or esp_timer task that raised the event */
 void rb_on_gpio_change(int32_t pin, void (*handler)(void));
 void rb_on_timer(int32_t interval_ms, void (*handler)(void));
+/* Events merged into one already queued for the same source / lost to a full ring */
+int32_t rb_event_coalesced(void);
+int32_t rb_event_dropped(void);
+/* Event sources for timers: rb_event_raise(id), called from the timer
+ * clock's task, queues `handler` for the dispatcher. A one-shot source is
+ * freed once its handler has run. */
+int32_t rb_event_source_alloc(void (*handler)(void), int32_t oneshot);
+void rb_event_source_free(int32_t id);
+void rb_event_raise(int32_t id);
+/* Run `handler` on a dispatch task for every received MQTT message */
 void rb_on_mqtt_message(void (*handler)(void));
 
 /* ── State Machine ───────────────────────────────────── */
 
-int32_t rb_machine_create(const char* name);
-void rb_machine_add_state(int32_t handle, const char* state_name);
-void rb_machine_add_transition(int32_t handle, const char* from_state, const char* event_name, const char* to_state);
+/* `table[state * num_events + event]` is the state `event` leads to from
+ * `state`, -1 for none. The table and name arrays are not copied and must
+ * outlive the machine (codegen emits them as constants). */
+int32_t rb_machine_create(const char* name, int32_t num_states, int32_t num_events, const int16_t* table,
+                          const char* const* state_names, const char* const* event_names);
+void rb_machine_event_id(int32_t handle, int32_t event);
 void rb_machine_event(int32_t handle, rb_string_t* event);
+/* Current state number, in declaration order */
+int32_t rb_machine_state(int32_t handle);
 rb_string_t* rb_machine_get_state(int32_t handle);
 
 /* ── NTP/Clock ───────────────────────────────────────── */
@@ -277,10 +576,32 @@ int32_t rb_ntp_epoch(void);
 void rb_file_open(rb_string_t* path, rb_string_t* mode);
 void rb_file_write(rb_string_t* data);
 rb_string_t* rb_file_read(void);
+/* Up to `max` bytes, binary-safe; "" at end of file */
+rb_string_t* rb_file_read_n(int32_t max);
 void rb_file_close(void);
 void rb_file_delete(rb_string_t* path);
 int32_t rb_file_exists(rb_string_t* path);
 
+/* File handles, shared by FILE and SD. Handle 0 is FILE.OPEN's file and
+ * RB_FH_SD is SD.OPEN's; opening with a handle variable takes a free slot
+ * from RB_FH_FIRST_FREE up. */
+#define RB_FH_MAX 10
+#define RB_FH_FILE 0
+#define RB_FH_SD 1
+#define RB_FH_FIRST_FREE 2
+
+/* Open `fullpath` into slot `h`, closing what it held, or into a free slot
+ * when `h` is -1. Returns the handle, or -1. */
+int32_t rb_fh_open(int32_t h, const char* fullpath, const char* mode);
+int32_t rb_file_open_handle(rb_string_t* path, rb_string_t* mode);
+void rb_fh_write(int32_t h, rb_string_t* data);
+rb_string_t* rb_fh_read(int32_t h, int32_t max);
+/* Next line without its line ending; "" at end of file */
+rb_string_t* rb_fh_readline(int32_t h);
+/* -1 when nothing is left to read, else 0 */
+int32_t rb_fh_eof(int32_t h);
+void rb_fh_close(int32_t h);
+
 /* ── WebSocket ───────────────────────────────────────── */
 
 void rb_ws_connect(rb_string_t* url);
@@ -295,6 +616,13 @@ int32_t rb_tcp_accept(void);
 void rb_tcp_send(rb_string_t* data);
 rb_string_t* rb_tcp_receive(void);
 void rb_tcp_close(void);
+/* ON TCP.DATA: serve every client from one event loop task, calling
+ * `handler` whenever a client sends data (an empty read means it hung up) */
+void rb_on_tcp_data(void (*handler)(void));
+/* Handle of the connection the handler is running for */
+int32_t rb_tcp_client(void);
+void rb_tcp_send_to(int32_t conn, rb_string_t* data);
+void rb_tcp_close_client(int32_t conn);
 
 /* ── Watchdog Timer ──────────────────────────────────── */
 
@@ -309,8 +637,15 @@ rb_string_t* rb_https_post(rb_string_t* url, rb_string_t* body);
 
 /* ── I2S Audio ───────────────────────────────────────── */
 
+/* Pins for the next I2S.INIT; din -1 leaves capture off */
+void rb_i2s_pins(int32_t bclk, int32_t ws, int32_t dout, int32_t din);
 void rb_i2s_init(int32_t rate, int32_t bits, int32_t channels);
+/* Queues the samples for the feeder task; blocks only while the queue is full */
 void rb_i2s_write(rb_string_t* data);
+/* `n` bytes of captured samples (needs a DIN pin) */
+rb_string_t* rb_i2s_read(int32_t n);
+/* ON I2S.NEED: `handler` runs on the feeder task when the queue is below half */
+void rb_on_i2s_need(void (*handler)(void));
 void rb_i2s_stop(void);
 
 /* ── Web Server ──────────────────────────────────────── */
@@ -318,6 +653,15 @@ void rb_web_start(int32_t port);
 rb_string_t* rb_web_wait(void);
 rb_string_t* rb_web_body(void);
 void rb_web_reply(int32_t status, rb_string_t* body);
+/* Requests matching `method` ("GET", "POST", ..., "ANY") and `path` (a
+ * trailing * matches any suffix) run `handler` on a web worker task */
+void rb_web_route(rb_string_t* method, rb_string_t* path, void (*handler)(void));
+/* Handle of the current request, for replying later or from another task */
+int32_t rb_web_request(void);
+void rb_web_reply_to(int32_t request, int32_t status, rb_string_t* body);
+/* GETs under `prefix` are answered from files in `dir` (LittleFS-relative,
+ * or absolute such as "/sdcard/www"), preferring a precompressed .gz */
+void rb_web_serve(rb_string_t* prefix, rb_string_t* dir);
 void rb_web_stop(void);
 
 /* ── SD Card ─────────────────────────────────────────── */
@@ -325,22 +669,96 @@ void rb_sd_init(int32_t cs_pin);
 void rb_sd_open(rb_string_t* path, rb_string_t* mode);
 void rb_sd_write(rb_string_t* data);
 rb_string_t* rb_sd_read(void);
+rb_string_t* rb_sd_read_n(int32_t max);
+int32_t rb_sd_open_handle(rb_string_t* path, rb_string_t* mode);
 void rb_sd_close(void);
 int32_t rb_sd_free(void);
 
+/* ── Data logger ─────────────────────────────────────── */
+/* Log to `path` (LittleFS, or "/sdcard/..."), rotating each `max_bytes`
+ * (0 = never) and keeping `keep` old files as path.1, path.2, ... */
+void rb_log_open(rb_string_t* path, int32_t max_bytes, int32_t keep);
+/* Queue `data` for the logger task; never blocks on the filesystem */
+void rb_log_write(rb_string_t* data);
+/* Block until everything queued is written and synced */
+void rb_log_flush(void);
+void rb_log_close(void);
+/* Records dropped because the buffer was full */
+int32_t rb_log_dropped(void);
+
 /* ── Async / Yield ───────────────────────────────────── */
 void rb_yield(void);
 void rb_await(int32_t ms);
 
+/* Run an ASYNC body on the event loop. `step` resumes the body from its
+ * frame (`frame_size` bytes, zeroed) and returns RB_ASYNC_DONE, RB_ASYNC_IO
+ * or the milliseconds to sleep before the next step. */
+#define RB_ASYNC_DONE (-1)
+/* Step again after the next rb_async_notify, or RB_ASYNC_POLL_MS at most */
+#define RB_ASYNC_IO (-2)
+#define RB_ASYNC_POLL_MS 10
+void rb_async_start(int32_t (*step)(void*), int32_t frame_size);
+/* I/O readiness: wake coroutines waiting with RB_ASYNC_IO. Called by the
+ * socket, MQTT and HTTP layers when data arrives or a request completes. */
+void rb_async_notify(void);
+
+/* A blocking I/O call run on the rb_async_io task, so an ASYNC body can
+ * suspend until it completes instead of blocking the event loop. Begin
+ * takes its own references to `a` and `b`; take returns the result string
+ * and frees the operation. */
+#define RB_ASYNC_OP_HTTP_GET 0     /* a = url */
+#define RB_ASYNC_OP_HTTP_POST 1    /* a = url, b = body */
+#define RB_ASYNC_OP_TCP_RECEIVE 2
+typedef struct rb_async_op rb_async_op_t;
+rb_async_op_t* rb_async_io_begin(int32_t kind, rb_string_t* a, rb_string_t* b);
+int32_t rb_async_io_done(rb_async_op_t* op);
+rb_string_t* rb_async_io_take(rb_async_op_t* op);
+
 /* ── Cron ────────────────────────────────────────────── */
+/* `expr` is "minute hour day month weekday" or @hourly, @daily, ... */
 void rb_cron_add(int32_t id, rb_string_t* expr);
 int32_t rb_cron_check(int32_t id);
 void rb_cron_remove(int32_t id);
+/* ON CRON id GOSUB sub: run `handler` on the event dispatcher each time job `id` fires */
+void rb_on_cron(int32_t id, void (*handler)(void));
 
 /* ── Regex ───────────────────────────────────────────── */
 int32_t rb_regex_match(rb_string_t* pattern, rb_string_t* text);
 rb_string_t* rb_regex_find(rb_string_t* pattern, rb_string_t* text);
 rb_string_t* rb_regex_replace(rb_string_t* pattern, rb_string_t* text, rb_string_t* replacement);
+/* Free the calling task's compiled pattern cache; called as a task exits. */
+void rb_regex_release_task(void);
+
+/* ── Channels ────────────────────────────────────────── */
+/* Bounded multi-producer/multi-consumer queues between tasks, named by id
+ * (0..15). Any call on an unused id creates the channel; SEND blocks while
+ * it is full and RECEIVE while it is empty. */
+void rb_channel_create(int32_t id, int32_t capacity);
+void rb_channel_send_int(int32_t id, int32_t value);
+void rb_channel_send_float(int32_t id, float value);
+void rb_channel_send_str(int32_t id, rb_string_t* s);
+int32_t rb_channel_receive_int(int32_t id);
+float rb_channel_receive_float(int32_t id);
+rb_string_t* rb_channel_receive_str(int32_t id);
+/* Block until one of `ids` has an item and return that id (-1 on error) */
+int32_t rb_channel_select(int32_t count, const int32_t* ids);
+
+/* ── String Builder ──────────────────────────────────── */
+int32_t rb_sb_new(void);
+void rb_sb_append_int(int32_t handle, int32_t value);
+void rb_sb_append_float(int32_t handle, float value);
+void rb_sb_append_str(int32_t handle, rb_string_t* s);
+rb_string_t* rb_sb_tostring(int32_t handle);
+void rb_sb_clear(int32_t handle);
+void rb_sb_free(int32_t handle);
+
+/* JSON writer on a string builder; `key` is ignored (and may be NULL)
+ * for members of an array */
+void rb_json_begin(int32_t handle, rb_string_t* key, int32_t is_array);
+void rb_json_end(int32_t handle);
+void rb_json_add_int(int32_t handle, rb_string_t* key, int32_t value);
+void rb_json_add_float(int32_t handle, rb_string_t* key, float value);
+void rb_json_add_str(int32_t handle, rb_string_t* key, rb_string_t* value);
 
 /* ── Entry point (generated by compiler) ──────────────── */
 
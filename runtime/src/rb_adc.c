@@ -3,8 +3,11 @@
 
 #ifdef ESP_PLATFORM
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 
 static adc_oneshot_unit_handle_t adc_handle = NULL;
+/* Channels already configured on adc_handle */
+static uint32_t adc_configured = 0;
 
 static void ensure_adc_init(void) {
     if (!adc_handle) {
@@ -12,18 +15,66 @@ static void ensure_adc_init(void) {
             .unit_id = ADC_UNIT_1,
         };
         adc_oneshot_new_unit(&cfg, &adc_handle);
+        adc_configured = 0;
     }
 }
+
+/* ── Continuous sampling ──────────────────────────────────
+ *
+ * ADC.STREAM hands ADC1 to the adc_continuous driver, which samples one
+ * channel at a fixed rate by DMA into a pool of ADC_STREAM_FRAMES frames;
+ * ADC.BLOCK copies whole frames out of it into an integer array. The pool
+ * absorbs the time BASIC spends between blocks, so nothing is lost as long
+ * as blocks are read at the sampling rate on average; if the pool does
+ * fill, the lost frames are counted and reported on the next ADC.BLOCK.
+ * The oneshot driver cannot share the unit, so while a stream runs ADC.READ
+ * of the streamed channel returns its newest sample.
+ */
+
+#define ADC_STREAM_FRAME 256    /* samples per DMA frame */
+#define ADC_STREAM_FRAMES 16
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define ADC_STREAM_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define ADC_STREAM_CHANNEL(p) ((p)->type1.channel)
+#define ADC_STREAM_DATA(p) ((p)->type1.data)
+#else
+#define ADC_STREAM_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define ADC_STREAM_CHANNEL(p) ((p)->type2.channel)
+#define ADC_STREAM_DATA(p) ((p)->type2.data)
+#endif
+
+static adc_continuous_handle_t adc_stream = NULL;
+static adc_channel_t adc_stream_channel;
+static int32_t adc_stream_last = 0;
+static volatile uint32_t adc_stream_overruns = 0;
+static uint32_t adc_stream_reported = 0;
+
+static bool IRAM_ATTR adc_stream_overflow(adc_continuous_handle_t handle,
+                                          const adc_continuous_evt_data_t* edata,
+                                          void* user_data) {
+    (void)handle;
+    (void)edata;
+    (void)user_data;
+    adc_stream_overruns++;
+    return false;
+}
 #endif
 
 int32_t rb_adc_read(int32_t pin) {
 #ifdef ESP_PLATFORM
+    if (adc_stream) {
+        return (adc_channel_t)pin == adc_stream_channel ? adc_stream_last : 0;
+    }
     ensure_adc_init();
-    adc_oneshot_chan_cfg_t chan_cfg = {
-        .atten = ADC_ATTEN_DB_12,
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
-    };
-    adc_oneshot_config_channel(adc_handle, (adc_channel_t)pin, &chan_cfg);
+    if (pin < 0 || pin >= 32 || !(adc_configured & (1u << pin))) {
+        adc_oneshot_chan_cfg_t chan_cfg = {
+            .atten = ADC_ATTEN_DB_12,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        adc_oneshot_config_channel(adc_handle, (adc_channel_t)pin, &chan_cfg);
+        if (pin >= 0 && pin < 32) adc_configured |= 1u << pin;
+    }
     int value = 0;
     adc_oneshot_read(adc_handle, (adc_channel_t)pin, &value);
     return (int32_t)value;
@@ -32,3 +83,95 @@ int32_t rb_adc_read(int32_t pin) {
     return 0;
 #endif
 }
+
+void rb_adc_stop(void) {
+#ifdef ESP_PLATFORM
+    if (!adc_stream) return;
+    adc_continuous_stop(adc_stream);
+    adc_continuous_deinit(adc_stream);
+    adc_stream = NULL;
+#else
+    printf("[ADC] stream stopped\n");
+#endif
+}
+
+void rb_adc_stream(int32_t pin, int32_t rate_hz) {
+#ifdef ESP_PLATFORM
+    rb_adc_stop();
+    if (adc_handle) {
+        adc_oneshot_del_unit(adc_handle);
+        adc_handle = NULL;
+    }
+    if (rate_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW) rate_hz = SOC_ADC_SAMPLE_FREQ_THRES_LOW;
+    if (rate_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) rate_hz = SOC_ADC_SAMPLE_FREQ_THRES_HIGH;
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = ADC_STREAM_FRAMES * ADC_STREAM_FRAME * SOC_ADC_DIGI_RESULT_BYTES,
+        .conv_frame_size = ADC_STREAM_FRAME * SOC_ADC_DIGI_RESULT_BYTES,
+    };
+    adc_continuous_handle_t h = NULL;
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &h);
+    if (err != ESP_OK) {
+        printf("[ADC] stream failed: %s\n", esp_err_to_name(err));
+        return;
+    }
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_12,
+        .channel = (uint8_t)pin,
+        .unit = ADC_UNIT_1,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_continuous_config_t cfg = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = (uint32_t)rate_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_STREAM_FORMAT,
+    };
+    adc_continuous_evt_cbs_t cbs = {
+        .on_pool_ovf = adc_stream_overflow,
+    };
+    err = adc_continuous_config(h, &cfg);
+    if (err == ESP_OK) err = adc_continuous_register_event_callbacks(h, &cbs, NULL);
+    if (err == ESP_OK) err = adc_continuous_start(h);
+    if (err != ESP_OK) {
+        printf("[ADC] stream failed: %s\n", esp_err_to_name(err));
+        adc_continuous_deinit(h);
+        return;
+    }
+    adc_stream_channel = (adc_channel_t)pin;
+    adc_stream_overruns = adc_stream_reported = 0;
+    adc_stream = h;
+#else
+    printf("[ADC] stream: pin=%d, rate=%d Hz\n", (int)pin, (int)rate_hz);
+#endif
+}
+
+int32_t rb_adc_block(int32_t* out, int32_t max) {
+#ifdef ESP_PLATFORM
+    if (!adc_stream || !out || max <= 0) return 0;
+    uint8_t raw[ADC_STREAM_FRAME * SOC_ADC_DIGI_RESULT_BYTES];
+    int32_t n = 0;
+    while (n < max) {
+        uint32_t want = (uint32_t)(max - n) * SOC_ADC_DIGI_RESULT_BYTES;
+        if (want > sizeof(raw)) want = sizeof(raw);
+        uint32_t got = 0;
+        if (adc_continuous_read(adc_stream, raw, want, &got, ADC_MAX_DELAY) != ESP_OK) break;
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= got; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            adc_digi_output_data_t* p = (adc_digi_output_data_t*)&raw[i];
+            if (ADC_STREAM_CHANNEL(p) == adc_stream_channel) out[n++] = (int32_t)ADC_STREAM_DATA(p);
+        }
+    }
+    if (n > 0) adc_stream_last = out[n - 1];
+    uint32_t overruns = adc_stream_overruns;
+    if (overruns != adc_stream_reported) {
+        printf("[ADC] stream overrun: %u frames lost\n", (unsigned)(overruns - adc_stream_reported));
+        adc_stream_reported = overruns;
+    }
+    return n;
+#else
+    for (int32_t i = 0; i < max; i++) out[i] = 0;
+    printf("[ADC] block: %d samples\n", (int)max);
+    return max > 0 ? max : 0;
+#endif
+}
@@ -46,3 +46,121 @@ void rb_array_bounds_check(int32_t index, int32_t size) {
         rb_panic("array index out of bounds");
     }
 }
+
+/* ── Whole-array kernels ──────────────────────────────────
+ *
+ * ARRAY.SUM, ARRAY.MIN, ARRAY.MAX, ARRAY.DOT, ARRAY.FILL, ARRAY.COPY and
+ * ARRAY.SCALE hand a DIM'd array's storage and element count to one of
+ * these, instead of a BASIC loop with a bounds check per element. The
+ * loops are kept simple enough for the compiler to vectorize on the host
+ * and to pipeline on the device: no calls, restrict on the in-place
+ * scale loops (whose float factor and offset must not be reloaded after each
+ * store) and, for the float sums, RB_ARRAY_LANES independent accumulators (the order of
+ * a float sum is fixed, so a single accumulator cannot be split). Integer
+ * sums are carried in 64 bits and saturate at the int32 range.
+ */
+
+#define RB_ARRAY_LANES 8
+
+static int32_t array_saturate(int64_t v) {
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return (int32_t)v;
+}
+
+int32_t rb_array_sum_int(const int32_t* data, int32_t n) {
+    int64_t sum = 0;
+    for (int32_t i = 0; i < n; i++) sum += data[i];
+    return array_saturate(sum);
+}
+
+float rb_array_sum_float(const float* data, int32_t n) {
+    float lane[RB_ARRAY_LANES] = {0};
+    int32_t i = 0;
+    for (; i + RB_ARRAY_LANES <= n; i += RB_ARRAY_LANES) {
+        for (int k = 0; k < RB_ARRAY_LANES; k++) lane[k] += data[i + k];
+    }
+    float sum = 0.0f;
+    for (int k = 0; k < RB_ARRAY_LANES; k++) sum += lane[k];
+    for (; i < n; i++) sum += data[i];
+    return sum;
+}
+
+int32_t rb_array_min_int(const int32_t* data, int32_t n) {
+    if (n <= 0) return 0;
+    int32_t m = data[0];
+    for (int32_t i = 1; i < n; i++) m = data[i] < m ? data[i] : m;
+    return m;
+}
+
+int32_t rb_array_max_int(const int32_t* data, int32_t n) {
+    if (n <= 0) return 0;
+    int32_t m = data[0];
+    for (int32_t i = 1; i < n; i++) m = data[i] > m ? data[i] : m;
+    return m;
+}
+
+float rb_array_min_float(const float* data, int32_t n) {
+    if (n <= 0) return 0.0f;
+    float m = data[0];
+    for (int32_t i = 1; i < n; i++) m = data[i] < m ? data[i] : m;
+    return m;
+}
+
+float rb_array_max_float(const float* data, int32_t n) {
+    if (n <= 0) return 0.0f;
+    float m = data[0];
+    for (int32_t i = 1; i < n; i++) m = data[i] > m ? data[i] : m;
+    return m;
+}
+
+/* Over the length of the shorter array */
+int32_t rb_array_dot_int(const int32_t* a, int32_t na, const int32_t* b, int32_t nb) {
+    int32_t n = na < nb ? na : nb;
+    int64_t sum = 0;
+    for (int32_t i = 0; i < n; i++) sum += (int64_t)a[i] * b[i];
+    return array_saturate(sum);
+}
+
+float rb_array_dot_float(const float* a, int32_t na, const float* b, int32_t nb) {
+    int32_t n = na < nb ? na : nb;
+    float lane[RB_ARRAY_LANES] = {0};
+    int32_t i = 0;
+    for (; i + RB_ARRAY_LANES <= n; i += RB_ARRAY_LANES) {
+        for (int k = 0; k < RB_ARRAY_LANES; k++) lane[k] += a[i + k] * b[i + k];
+    }
+    float sum = 0.0f;
+    for (int k = 0; k < RB_ARRAY_LANES; k++) sum += lane[k];
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+void rb_array_fill_int(int32_t* data, int32_t n, int32_t value) {
+    for (int32_t i = 0; i < n; i++) data[i] = value;
+}
+
+void rb_array_fill_float(float* data, int32_t n, float value) {
+    for (int32_t i = 0; i < n; i++) data[i] = value;
+}
+
+/* Elements are four bytes whatever the type; copies as many as the
+ * shorter array holds. The same array on both sides is allowed. */
+void rb_array_copy(void* dst, int32_t dst_n, const void* src, int32_t src_n) {
+    int32_t n = dst_n < src_n ? dst_n : src_n;
+    if (n > 0 && dst != src) memmove(dst, src, (size_t)n * 4);
+}
+
+/* x * factor + offset, rounded half away from zero and clamped */
+void rb_array_scale_int(int32_t* restrict data, int32_t n, float factor, float offset) {
+    for (int32_t i = 0; i < n; i++) {
+        float x = (float)data[i] * factor + offset;
+        x += x < 0.0f ? -0.5f : 0.5f;
+        x = x > 2147483520.0f ? 2147483520.0f : x;
+        x = x < -2147483648.0f ? -2147483648.0f : x;
+        data[i] = (int32_t)x;
+    }
+}
+
+void rb_array_scale_float(float* restrict data, int32_t n, float factor, float offset) {
+    for (int32_t i = 0; i < n; i++) data[i] = data[i] * factor + offset;
+}
@@ -3,8 +3,9 @@
 #include <stdlib.h>
 
 void rb_assert_fail(rb_string_t* message, int32_t offset) {
+    rb_print_drain_now();
     if (message && message->length > 0) {
-        fprintf(stderr, "ASSERT FAILED: %s\n", message->data);
+        fprintf(stderr, "ASSERT FAILED: %s\n", rb_string_cstr(message));
     } else {
         fprintf(stderr, "ASSERT FAILED at offset %d\n", offset);
     }
@@ -1,9 +1,12 @@
 #include "rb_runtime.h"
+#include <stdlib.h>
 #include <stdio.h>
 
 #ifdef ESP_PLATFORM
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 
 void rb_yield(void) {
     taskYIELD();
@@ -15,14 +18,426 @@ void rb_await(int32_t ms) {
 
 #else
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
 void rb_yield(void) {
-    printf("[ASYNC] Yield (stub)\n");
+    sched_yield();
 }
 
 void rb_await(int32_t ms) {
-    printf("[ASYNC] Await %d ms (stub)\n", ms);
-    usleep(ms * 1000);
+    if (ms > 0) usleep((useconds_t)ms * 1000);
 }
 
 #endif
+
+/* ── Event loop ───────────────────────────────────────────
+ *
+ * ASYNC bodies are compiled to stackless step functions: all of their
+ * variables live in a heap frame, and each call runs the body from its last
+ * suspension point up to the next one. Every coroutine runs on one event
+ * loop task, so a coroutine costs its frame rather than a stack.
+ *
+ * A step returns RB_ASYNC_DONE when the body has finished, or the number of
+ * milliseconds to sleep before it is stepped again (0 after a plain YIELD).
+ * Coroutines started from other tasks are pushed onto a lock-free list that
+ * the loop adopts on its next pass.
+ *
+ * A step that waits on I/O (AWAIT UNTIL, or an HTTP/TCP call inside ASYNC)
+ * returns RB_ASYNC_IO instead. rb_async_notify, called by the socket, MQTT
+ * and HTTP layers, wakes the loop and makes every such coroutine due at
+ * once; conditions nothing notifies about (a GPIO pin) are still re-tested
+ * every RB_ASYNC_POLL_MS. Blocking calls made from ASYNC bodies run on a
+ * small pool of rb_async_io workers, started as calls queue up, and notify
+ * when they complete. A TCP.RECEIVE$ waiting on an idle peer holds one
+ * worker; calls queue only once all RB_ASYNC_IO_WORKERS are blocked.
+ */
+
+#define RB_ASYNC_STACK 8192
+#define RB_ASYNC_PRIORITY 1
+/* The I/O workers run esp_http_client, which needs the larger stack */
+#define RB_ASYNC_IO_STACK 8192
+#define RB_ASYNC_IO_PRIORITY 2
+#define RB_ASYNC_IO_WORKERS 4
+/* Longest sleep with no coroutine due; new coroutines wake the loop early */
+#define RB_ASYNC_IDLE_MS 1000
+
+typedef struct rb_coroutine {
+    struct rb_coroutine* next;
+    int32_t (*step)(void*);
+    void* frame;
+    int64_t wake_at;
+    uint8_t on_io;  /* last step returned RB_ASYNC_IO */
+} rb_coroutine_t;
+
+struct rb_async_op {
+    struct rb_async_op* next;
+    int32_t kind;
+    rb_string_t* a;
+    rb_string_t* b;
+    rb_string_t* result;
+    int32_t done;
+};
+
+enum { ASYNC_IDLE, ASYNC_STARTING, ASYNC_RUNNING };
+
+static rb_coroutine_t* async_incoming;
+static uint8_t async_state;
+static uint32_t async_io_generation;  /* bumped by rb_async_notify */
+
+/* Pending I/O, oldest first, and the worker pool; under the I/O lock */
+static rb_async_op_t* async_io_head;
+static rb_async_op_t* async_io_tail;
+static int32_t async_io_queued;
+static int32_t async_io_workers;
+static int32_t async_io_idle;
+static uint8_t async_io_state;
+
+static void async_loop(void);
+static void async_io_loop(void);
+
+#ifdef ESP_PLATFORM
+
+static TaskHandle_t async_task;
+
+static int64_t async_now(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+static void async_task_main(void* arg) {
+    (void)arg;
+    async_loop();
+}
+
+static void async_platform_start(void) {
+    if (xTaskCreate(async_task_main, "rb_async", RB_ASYNC_STACK, NULL,
+                    RB_ASYNC_PRIORITY, &async_task) != pdPASS) {
+        rb_panic("ASYNC event loop could not be created");
+    }
+}
+
+static void async_pause(void) {
+    vTaskDelay(1);
+}
+
+static void async_sleep(int64_t ms) {
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    if (ticks == 0) ticks = 1;
+    ulTaskNotifyTake(pdTRUE, ticks);
+}
+
+static void async_wake(void) {
+    /* The loop task never exits, so its handle stays valid */
+    xTaskNotifyGive(async_task);
+}
+
+static portMUX_TYPE async_io_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t async_io_ready;    /* one give per queued op */
+
+static void async_io_lock(void) { taskENTER_CRITICAL(&async_io_mux); }
+static void async_io_unlock(void) { taskEXIT_CRITICAL(&async_io_mux); }
+
+static void async_io_task_main(void* arg) {
+    (void)arg;
+    async_io_loop();
+}
+
+static void async_io_platform_start(void) {
+    async_io_ready = xSemaphoreCreateCounting(0x7fff, 0);
+    if (!async_io_ready) rb_panic("ASYNC I/O queue could not be created");
+}
+
+/* Returns 0 if the worker could not be started */
+static int async_io_spawn(void) {
+    return xTaskCreate(async_io_task_main, "rb_async_io", RB_ASYNC_IO_STACK, NULL,
+                       RB_ASYNC_IO_PRIORITY, NULL) == pdPASS;
+}
+
+/* Called with the lock held; returns with it held */
+static void async_io_wait(void) {
+    async_io_unlock();
+    xSemaphoreTake(async_io_ready, portMAX_DELAY);
+    async_io_lock();
+}
+
+static void async_io_wake(void) {
+    xSemaphoreGive(async_io_ready);
+}
+
+#else
+
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t async_generation;
+
+static int64_t async_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void* async_thread_main(void* arg) {
+    (void)arg;
+    async_loop();
+    return NULL;
+}
+
+static void async_platform_start(void) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, async_thread_main, NULL) != 0) {
+        rb_panic("ASYNC event loop could not be created");
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void async_pause(void) {
+    sched_yield();
+}
+
+static void async_sleep(int64_t ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&async_mutex);
+    uint32_t epoch = async_generation;
+    while (async_generation == epoch && __atomic_load_n(&async_incoming, __ATOMIC_ACQUIRE) == NULL) {
+        if (pthread_cond_timedwait(&async_cond, &async_mutex, &deadline) != 0) break;
+    }
+    pthread_mutex_unlock(&async_mutex);
+}
+
+static void async_wake(void) {
+    pthread_mutex_lock(&async_mutex);
+    async_generation++;
+    pthread_cond_signal(&async_cond);
+    pthread_mutex_unlock(&async_mutex);
+}
+
+static pthread_mutex_t async_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_io_cond = PTHREAD_COND_INITIALIZER;
+
+static void* async_io_thread_main(void* arg) {
+    (void)arg;
+    async_io_loop();
+    return NULL;
+}
+
+static void async_io_platform_start(void) {}
+static void async_io_lock(void) { pthread_mutex_lock(&async_io_mutex); }
+static void async_io_unlock(void) { pthread_mutex_unlock(&async_io_mutex); }
+
+/* Returns 0 if the worker could not be started */
+static int async_io_spawn(void) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ok = pthread_create(&thread, &attr, async_io_thread_main, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    return ok;
+}
+
+/* Called with the lock held; returns with it held */
+static void async_io_wait(void) {
+    pthread_cond_wait(&async_io_cond, &async_io_mutex);
+}
+
+static void async_io_wake(void) {
+    pthread_mutex_lock(&async_io_mutex);
+    pthread_cond_signal(&async_io_cond);
+    pthread_mutex_unlock(&async_io_mutex);
+}
+
+#endif
+
+static void async_loop(void) {
+    rb_coroutine_t* list = NULL;
+    uint32_t io_seen = __atomic_load_n(&async_io_generation, __ATOMIC_ACQUIRE);
+    for (;;) {
+        /* Read before stepping, so a notify during this pass is seen on the next */
+        uint32_t io_now = __atomic_load_n(&async_io_generation, __ATOMIC_ACQUIRE);
+        int io_ready = io_now != io_seen;
+        io_seen = io_now;
+
+        /* Adopt coroutines started since the last pass */
+        rb_coroutine_t* fresh = __atomic_exchange_n(&async_incoming, NULL, __ATOMIC_ACQUIRE);
+        while (fresh) {
+            rb_coroutine_t* c = fresh;
+            fresh = fresh->next;
+            c->next = list;
+            list = c;
+        }
+
+        int64_t now = async_now();
+        int64_t next_wake = now + RB_ASYNC_IDLE_MS;
+        rb_coroutine_t** link = &list;
+        while (*link) {
+            rb_coroutine_t* c = *link;
+            if (c->wake_at <= now || (c->on_io && io_ready)) {
+                int32_t wake = c->step(c->frame);
+                if (wake == RB_ASYNC_DONE) {
+                    *link = c->next;
+                    free(c->frame);
+                    free(c);
+                    continue;
+                }
+                c->on_io = wake == RB_ASYNC_IO;
+                c->wake_at = async_now() + (c->on_io ? RB_ASYNC_POLL_MS : wake);
+            }
+            if (c->wake_at < next_wake) next_wake = c->wake_at;
+            link = &c->next;
+        }
+
+        int64_t delay = next_wake - async_now();
+        if (delay > 0) {
+            async_sleep(delay);
+        } else {
+            async_pause();
+        }
+    }
+}
+
+/* Start a task once, however many callers race to start it */
+static void async_start_once(uint8_t* state, void (*platform_start)(void)) {
+    if (__atomic_load_n(state, __ATOMIC_ACQUIRE) == ASYNC_RUNNING) return;
+    uint8_t expected = ASYNC_IDLE;
+    if (__atomic_compare_exchange_n(state, &expected, ASYNC_STARTING, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        platform_start();
+        __atomic_store_n(state, ASYNC_RUNNING, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != ASYNC_RUNNING) async_pause();
+}
+
+static void async_start(void) {
+    async_start_once(&async_state, async_platform_start);
+}
+
+void rb_async_start(int32_t (*step)(void*), int32_t frame_size) {
+    rb_coroutine_t* c = (rb_coroutine_t*)malloc(sizeof(rb_coroutine_t));
+    /* A zeroed frame starts the body at its top with every variable 0 / "" */
+    void* frame = calloc(1, frame_size > 0 ? (size_t)frame_size : 1);
+    if (!c || !frame) rb_panic("out of memory in ASYNC");
+    c->step = step;
+    c->frame = frame;
+    c->wake_at = 0;
+    c->on_io = 0;
+
+    async_start();
+    c->next = __atomic_load_n(&async_incoming, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&async_incoming, &c->next, c, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    async_wake();
+}
+
+void rb_async_notify(void) {
+    __atomic_add_fetch(&async_io_generation, 1, __ATOMIC_RELEASE);
+    /* Nothing can be waiting before the loop exists */
+    if (__atomic_load_n(&async_state, __ATOMIC_ACQUIRE) == ASYNC_RUNNING) async_wake();
+}
+
+/* ── Blocking I/O off the loop ────────────────────────── */
+
+static void async_io_run(rb_async_op_t* op) {
+    switch (op->kind) {
+        case RB_ASYNC_OP_HTTP_GET:
+            op->result = rb_http_get(op->a);
+            break;
+        case RB_ASYNC_OP_HTTP_POST:
+            op->result = rb_http_post(op->a, op->b);
+            break;
+        case RB_ASYNC_OP_TCP_RECEIVE:
+            op->result = rb_tcp_receive();
+            break;
+        default:
+            op->result = rb_string_alloc("");
+            break;
+    }
+    rb_string_release(op->a);
+    rb_string_release(op->b);
+    /* The result is released by the coroutine, on the loop task */
+    rb_string_share(op->result);
+    __atomic_store_n(&op->done, 1, __ATOMIC_RELEASE);
+    rb_async_notify();
+}
+
+static void async_io_loop(void) {
+    async_io_lock();
+    for (;;) {
+        rb_async_op_t* op = async_io_head;
+        if (!op) {
+            async_io_idle++;
+            async_io_wait();
+            async_io_idle--;
+            continue;
+        }
+        async_io_head = op->next;
+        if (!async_io_head) async_io_tail = NULL;
+        async_io_queued--;
+        async_io_unlock();
+        async_io_run(op);
+        async_io_lock();
+    }
+}
+
+rb_async_op_t* rb_async_io_begin(int32_t kind, rb_string_t* a, rb_string_t* b) {
+    rb_async_op_t* op = (rb_async_op_t*)calloc(1, sizeof(rb_async_op_t));
+    if (!op) rb_panic("out of memory in ASYNC");
+    op->kind = kind;
+    if (a) {
+        rb_string_share(a);
+        rb_string_retain(a);
+    }
+    if (b) {
+        rb_string_share(b);
+        rb_string_retain(b);
+    }
+    op->a = a;
+    op->b = b;
+
+    async_start_once(&async_io_state, async_io_platform_start);
+    /* Start another worker when every running one is busy, so one call
+     * that blocks for long does not hold up the others */
+    async_io_lock();
+    if (async_io_tail) {
+        async_io_tail->next = op;
+    } else {
+        async_io_head = op;
+    }
+    async_io_tail = op;
+    async_io_queued++;
+    int spawn = async_io_queued > async_io_idle && async_io_workers < RB_ASYNC_IO_WORKERS;
+    if (spawn) async_io_workers++;
+    int running = async_io_workers;
+    async_io_unlock();
+    if (spawn && !async_io_spawn()) {
+        async_io_lock();
+        async_io_workers--;
+        running = async_io_workers;
+        async_io_unlock();
+        if (running == 0) rb_panic("ASYNC I/O task could not be created");
+    }
+    async_io_wake();
+    return op;
+}
+
+int32_t rb_async_io_done(rb_async_op_t* op) {
+    return __atomic_load_n(&op->done, __ATOMIC_ACQUIRE);
+}
+
+rb_string_t* rb_async_io_take(rb_async_op_t* op) {
+    rb_string_t* result = op->result;
+    free(op);
+    return result;
+}
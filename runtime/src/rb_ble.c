@@ -3,6 +3,20 @@
 #include <string.h>
 #include <stdlib.h>
 
+/* ── BLE notify path ──────────────────────────────────────
+ *
+ * On connect the link asks for a large ATT MTU and, if BLE.INTERVAL was
+ * given, a connection interval. BLE.SEND splits a payload into MTU - 3
+ * byte notifications, so anything up to the string's length goes out
+ * instead of being cut at 256 bytes, in as few packets as the link
+ * allows. Notifications are paced by TX credits: at most BLE_TX_CREDITS
+ * are queued in the stack at once, each returned by its NOTIFY_TX event,
+ * and a send that finds NimBLE out of buffers waits and retries rather
+ * than dropping the rest of the payload.
+ */
+
+#define BLE_MTU_DEFAULT 23
+
 #ifdef ESP_PLATFORM
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
@@ -11,20 +25,25 @@
 #include "services/gatt/ble_svc_gatt.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 
-#define BLE_RECV_QUEUE_SIZE 8
-#define BLE_RECV_MSG_MAX    256
+#define BLE_RECV_QUEUE_SIZE 16
 #define BLE_RECV_TIMEOUT_MS 5000
+#define BLE_MTU_PREFERRED 517
+#define BLE_TX_CREDITS 8
+#define BLE_TX_TIMEOUT_MS 200
+#define BLE_TX_RETRY_MS 5
+#define BLE_TX_RETRIES 200
 
+/* Received writes, as rb_string_t* the receiver takes over */
 static QueueHandle_t ble_recv_queue = NULL;
-static uint16_t ble_conn_handle = 0;
+static SemaphoreHandle_t ble_tx_credits = NULL;
+static volatile uint16_t ble_conn_handle = 0;
 static uint16_t ble_attr_handle = 0;
-static bool ble_connected = false;
-
-typedef struct {
-    char data[BLE_RECV_MSG_MAX];
-    int len;
-} ble_msg_t;
+static volatile bool ble_connected = false;
+static volatile uint16_t ble_mtu = BLE_MTU_DEFAULT;
+static uint16_t ble_itvl_min = 0, ble_itvl_max = 0;   /* 1.25 ms units; 0 = no request */
 
 /* GATT characteristic UUID: 0000ff01-0000-1000-8000-00805f9b34fb */
 static const ble_uuid128_t gatt_chr_uuid =
@@ -40,13 +59,10 @@ static int ble_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                            struct ble_gatt_access_ctxt *ctxt, void *arg) {
     if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
         if (ble_recv_queue && ctxt->om) {
-            ble_msg_t msg;
             uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
-            int copy_len = om_len < BLE_RECV_MSG_MAX - 1 ? om_len : BLE_RECV_MSG_MAX - 1;
-            ble_hs_mbuf_to_flat(ctxt->om, msg.data, copy_len, NULL);
-            msg.data[copy_len] = '\0';
-            msg.len = copy_len;
-            xQueueSend(ble_recv_queue, &msg, 0);
+            rb_string_t* msg = rb_string_new(om_len);
+            ble_hs_mbuf_to_flat(ctxt->om, msg->data, om_len, NULL);
+            if (xQueueSend(ble_recv_queue, &msg, 0) != pdTRUE) rb_string_release(msg);
         }
         return 0;
     }
@@ -77,16 +93,40 @@ static void nimble_host_task(void *param) {
     nimble_port_run();
 }
 
+static void ble_request_interval(void) {
+    if (!ble_connected || !ble_itvl_min) return;
+    struct ble_gap_upd_params params = {
+        .itvl_min = ble_itvl_min,
+        .itvl_max = ble_itvl_max,
+        .latency = 0,
+        .supervision_timeout = 400,     /* 4 s */
+    };
+    ble_gap_update_params(ble_conn_handle, &params);
+}
+
 static int ble_gap_event(struct ble_gap_event *event, void *arg) {
     switch (event->type) {
         case BLE_GAP_EVENT_CONNECT:
             if (event->connect.status == 0) {
                 ble_conn_handle = event->connect.conn_handle;
+                ble_mtu = BLE_MTU_DEFAULT;
                 ble_connected = true;
+                ble_gattc_exchange_mtu(ble_conn_handle, NULL, NULL);
+                ble_request_interval();
             }
             break;
         case BLE_GAP_EVENT_DISCONNECT:
             ble_connected = false;
+            ble_mtu = BLE_MTU_DEFAULT;
+            /* Notifications still queued are gone with the link */
+            while (uxSemaphoreGetCount(ble_tx_credits) < BLE_TX_CREDITS)
+                xSemaphoreGive(ble_tx_credits);
+            break;
+        case BLE_GAP_EVENT_MTU:
+            ble_mtu = event->mtu.value;
+            break;
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            if (!event->notify_tx.indication) xSemaphoreGive(ble_tx_credits);
             break;
         default:
             break;
@@ -98,17 +138,20 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
 void rb_ble_init(rb_string_t* name) {
 #ifdef ESP_PLATFORM
     if (!ble_recv_queue) {
-        ble_recv_queue = xQueueCreate(BLE_RECV_QUEUE_SIZE, sizeof(ble_msg_t));
+        ble_recv_queue = xQueueCreate(BLE_RECV_QUEUE_SIZE, sizeof(rb_string_t*));
+        ble_tx_credits = xSemaphoreCreateCounting(BLE_TX_CREDITS, BLE_TX_CREDITS);
+        if (!ble_recv_queue || !ble_tx_credits) rb_panic("BLE queues could not be created");
     }
     nimble_port_init();
-    ble_svc_gap_device_name_set(name ? name->data : "RustyBASIC");
+    ble_att_set_preferred_mtu(BLE_MTU_PREFERRED);
+    ble_svc_gap_device_name_set(name ? rb_string_cstr(name) : "RustyBASIC");
     ble_svc_gap_init();
     ble_svc_gatt_init();
     ble_gatts_count_cfg(ble_svcs);
     ble_gatts_add_svcs(ble_svcs);
     nimble_port_freertos_init(nimble_host_task);
 #else
-    printf("[BLE] init: name=%s\n", name ? name->data : "(null)");
+    printf("[BLE] init: name=%s\n", name ? rb_string_cstr(name) : "(null)");
 #endif
 }
 
@@ -140,24 +183,72 @@ rb_string_t* rb_ble_scan(void) {
 }
 
 void rb_ble_send(rb_string_t* data) {
+    const char* bytes = data ? data->data : "";
+    int32_t len = data ? data->length : 0;
 #ifdef ESP_PLATFORM
-    if (ble_connected && ble_attr_handle) {
-        struct os_mbuf *om = ble_hs_mbuf_from_flat(
-            data ? data->data : "", data ? data->length : 0);
-        ble_gatts_notify_custom(ble_conn_handle, ble_attr_handle, om);
+    if (!ble_connected || !ble_attr_handle) return;
+    int32_t at = 0;
+    int retries = 0;
+    do {
+        int32_t room = ble_mtu - 3;
+        int32_t n = len - at < room ? len - at : room;
+        /* After the timeout (a lost NOTIFY_TX) send anyway */
+        int took = xSemaphoreTake(ble_tx_credits, pdMS_TO_TICKS(BLE_TX_TIMEOUT_MS)) == pdTRUE;
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(bytes + at, (uint16_t)n);
+        int rc = om ? ble_gatts_notify_custom(ble_conn_handle, ble_attr_handle, om) : BLE_HS_ENOMEM;
+        if (rc == 0) {
+            at += n;
+            retries = 0;
+            continue;
+        }
+        if (took) xSemaphoreGive(ble_tx_credits);
+        if (rc != BLE_HS_ENOMEM || !ble_connected) return;
+        if (++retries > BLE_TX_RETRIES) {
+            printf("[BLE] send: out of buffers, %d bytes dropped\n", (int)(len - at));
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BLE_TX_RETRY_MS) + 1);
+    } while (at < len);
+#else
+    printf("[BLE] send: data=%.*s\n", (int)len, bytes);
+#endif
+}
+
+/* Ask for a connection interval of min_ms to max_ms, now and on each
+ * connect; 0 withdraws the request */
+void rb_ble_interval(int32_t min_ms, int32_t max_ms) {
+    if (max_ms < min_ms) max_ms = min_ms;
+#ifdef ESP_PLATFORM
+    /* 7.5 ms to 4 s, in 1.25 ms units */
+    int32_t lo = min_ms * 4 / 5, hi = max_ms * 4 / 5;
+    if (min_ms <= 0) {
+        ble_itvl_min = ble_itvl_max = 0;
+        return;
     }
+    ble_itvl_min = (uint16_t)(lo < 6 ? 6 : lo > 3200 ? 3200 : lo);
+    ble_itvl_max = (uint16_t)(hi < ble_itvl_min ? ble_itvl_min : hi > 3200 ? 3200 : hi);
+    ble_request_interval();
+#else
+    printf("[BLE] interval: %d-%d ms\n", (int)min_ms, (int)max_ms);
+#endif
+}
+
+/* The negotiated ATT MTU; BLE.SEND packs MTU - 3 bytes a notification */
+int32_t rb_ble_mtu(void) {
+#ifdef ESP_PLATFORM
+    return ble_mtu;
 #else
-    printf("[BLE] send: data=%s\n", data ? data->data : "(null)");
+    return BLE_MTU_DEFAULT;
 #endif
 }
 
 rb_string_t* rb_ble_receive(void) {
 #ifdef ESP_PLATFORM
     if (ble_recv_queue) {
-        ble_msg_t msg;
+        rb_string_t* msg;
         if (xQueueReceive(ble_recv_queue, &msg,
                           pdMS_TO_TICKS(BLE_RECV_TIMEOUT_MS)) == pdTRUE) {
-            return rb_string_alloc(msg.data);
+            return msg;
         }
     }
     return rb_string_alloc("");
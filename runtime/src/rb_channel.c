@@ -0,0 +1,372 @@
+#include "rb_runtime.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+/* ── Channels ─────────────────────────────────────────────
+ *
+ * A channel is a bounded ring of tagged values that any number of tasks may
+ * send to and receive from (Vyukov's MPMC queue: every slot carries a
+ * sequence number, so producers and consumers only contend on their own
+ * index with a single CAS). Channels are named by a small integer id rather
+ * than a handle, because TASK bodies do not see the creating function's
+ * variables; the first use of an id creates the channel.
+ *
+ * SEND and RECEIVE never lock on the fast path. Only a task that finds the
+ * channel full or empty parks: on ESP32 on a FreeRTOS event group bit, on the
+ * host on a condition variable. A sender or receiver only signals when
+ * somebody is parked.
+ */
+
+#define RB_MAX_CHANNELS 16
+#define RB_CHANNEL_DEFAULT_CAPACITY 16
+#define RB_CHANNEL_MAX_CAPACITY 1024
+
+/* Parked tasks re-check at least this often, which covers the rare wakeup
+ * consumed by another task waiting on the same bit. */
+#define RB_CHANNEL_POLL_MS 50
+
+enum { CHAN_INT, CHAN_FLOAT, CHAN_STR };
+enum { CHAN_NONE, CHAN_INIT, CHAN_READY };
+
+typedef struct {
+    uint32_t seq;
+    uint8_t tag;
+    union {
+        int32_t i;
+        float f;
+        rb_string_t* s;
+    } v;
+} chan_slot_t;
+
+typedef struct {
+    uint8_t state;
+    chan_slot_t* slots;
+    uint32_t mask;
+    uint32_t head;        /* next position to send to */
+    uint32_t tail;        /* next position to receive from */
+    int32_t rx_waiters;   /* tasks parked until an item arrives */
+    int32_t tx_waiters;   /* tasks parked until a slot frees up */
+} rb_channel_t;
+
+static rb_channel_t channels[RB_MAX_CHANNELS];
+
+/* ── Parking ──────────────────────────────────────────── */
+
+#define CHAN_RX_BIT(id) (1u << (id))
+#define CHAN_TX_BIT (1u << RB_MAX_CHANNELS)
+
+#ifdef ESP_PLATFORM
+
+static EventGroupHandle_t chan_events;
+static uint8_t chan_events_state;
+
+static void chan_pause(void) {
+    vTaskDelay(1);
+}
+
+static void chan_events_init(void) {
+    uint8_t expected = CHAN_NONE;
+    if (__atomic_compare_exchange_n(&chan_events_state, &expected, CHAN_INIT, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        chan_events = xEventGroupCreate();
+        if (!chan_events) rb_panic("out of memory in CHANNEL");
+        __atomic_store_n(&chan_events_state, CHAN_READY, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(&chan_events_state, __ATOMIC_ACQUIRE) != CHAN_READY) chan_pause();
+}
+
+/* Event group bits stay set until a waiter consumes them, so a signal sent
+ * between the waiter's last check and its wait is not lost. */
+typedef uint32_t chan_epoch_t;
+
+static chan_epoch_t chan_wait_begin(void) {
+    return 0;
+}
+
+static void chan_wait_end(chan_epoch_t epoch, uint32_t bits) {
+    (void)epoch;
+    xEventGroupWaitBits(chan_events, bits, pdTRUE, pdFALSE, pdMS_TO_TICKS(RB_CHANNEL_POLL_MS));
+}
+
+static void chan_notify(uint32_t bits) {
+    xEventGroupSetBits(chan_events, bits);
+}
+
+#else
+
+static pthread_mutex_t chan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t chan_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t chan_generation;
+
+static void chan_pause(void) {
+    sched_yield();
+}
+
+static void chan_events_init(void) {
+}
+
+/* The generation is read before the waiter's last check: a signal sent
+ * after that bumps it, and the wait returns at once. */
+typedef uint32_t chan_epoch_t;
+
+static chan_epoch_t chan_wait_begin(void) {
+    pthread_mutex_lock(&chan_mutex);
+    chan_epoch_t epoch = chan_generation;
+    pthread_mutex_unlock(&chan_mutex);
+    return epoch;
+}
+
+static void chan_wait_end(chan_epoch_t epoch, uint32_t bits) {
+    (void)bits;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += RB_CHANNEL_POLL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&chan_mutex);
+    while (chan_generation == epoch) {
+        if (pthread_cond_timedwait(&chan_cond, &chan_mutex, &deadline) != 0) break;
+    }
+    pthread_mutex_unlock(&chan_mutex);
+}
+
+static void chan_notify(uint32_t bits) {
+    (void)bits;
+    pthread_mutex_lock(&chan_mutex);
+    chan_generation++;
+    pthread_cond_broadcast(&chan_cond);
+    pthread_mutex_unlock(&chan_mutex);
+}
+
+#endif
+
+/* Signal `bits` if any task is parked on `waiters`. The fence pairs with
+ * the one in chan_park: either the waiter sees our update, or we see it. */
+static void chan_wake(int32_t* waiters, uint32_t bits) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_RELAXED) > 0) chan_notify(bits);
+}
+
+/* ── Ring buffer ──────────────────────────────────────── */
+
+static rb_channel_t* chan_get(int32_t id, int32_t capacity) {
+    if (id < 0 || id >= RB_MAX_CHANNELS) {
+        fprintf(stderr, "Invalid channel %d\n", (int)id);
+        return NULL;
+    }
+    rb_channel_t* c = &channels[id];
+    if (__atomic_load_n(&c->state, __ATOMIC_ACQUIRE) == CHAN_READY) return c;
+
+    uint8_t expected = CHAN_NONE;
+    if (!__atomic_compare_exchange_n(&c->state, &expected, CHAN_INIT, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Another task is creating it */
+        while (__atomic_load_n(&c->state, __ATOMIC_ACQUIRE) != CHAN_READY) chan_pause();
+        return c;
+    }
+
+    chan_events_init();
+    if (capacity > RB_CHANNEL_MAX_CAPACITY) capacity = RB_CHANNEL_MAX_CAPACITY;
+    /* Power of two for the index mask; the sequence scheme needs two slots */
+    uint32_t size = 2;
+    while (size < (uint32_t)capacity) size <<= 1;
+    c->slots = (chan_slot_t*)malloc(size * sizeof(chan_slot_t));
+    if (!c->slots) rb_panic("out of memory in CHANNEL");
+    for (uint32_t i = 0; i < size; i++) {
+        c->slots[i].seq = i;
+    }
+    c->mask = size - 1;
+    c->head = 0;
+    c->tail = 0;
+    __atomic_store_n(&c->state, CHAN_READY, __ATOMIC_RELEASE);
+    return c;
+}
+
+static int chan_try_push(rb_channel_t* c, const chan_slot_t* item) {
+    uint32_t pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+    for (;;) {
+        chan_slot_t* slot = &c->slots[pos & c->mask];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->tag = item->tag;
+                slot->v = item->v;
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;  /* full */
+        } else {
+            pos = __atomic_load_n(&c->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int chan_try_pop(rb_channel_t* c, chan_slot_t* out) {
+    uint32_t pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        chan_slot_t* slot = &c->slots[pos & c->mask];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                out->tag = slot->tag;
+                out->v = slot->v;
+                __atomic_store_n(&slot->seq, pos + c->mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;  /* empty */
+        } else {
+            pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int chan_has_item(rb_channel_t* c) {
+    uint32_t pos = __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+    uint32_t seq = __atomic_load_n(&c->slots[pos & c->mask].seq, __ATOMIC_ACQUIRE);
+    return seq == pos + 1;
+}
+
+static void chan_park(int32_t* waiters) {
+    __atomic_fetch_add(waiters, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void chan_unpark(int32_t* waiters) {
+    __atomic_fetch_sub(waiters, 1, __ATOMIC_RELAXED);
+}
+
+static void chan_push(int32_t id, const chan_slot_t* item) {
+    rb_channel_t* c = chan_get(id, RB_CHANNEL_DEFAULT_CAPACITY);
+    if (!c) return;
+    while (!chan_try_push(c, item)) {
+        chan_park(&c->tx_waiters);
+        chan_epoch_t epoch = chan_wait_begin();
+        int sent = chan_try_push(c, item);
+        if (!sent) chan_wait_end(epoch, CHAN_TX_BIT);
+        chan_unpark(&c->tx_waiters);
+        if (sent) break;
+    }
+    chan_wake(&c->rx_waiters, CHAN_RX_BIT(id));
+}
+
+static int chan_pop(int32_t id, chan_slot_t* out) {
+    rb_channel_t* c = chan_get(id, RB_CHANNEL_DEFAULT_CAPACITY);
+    if (!c) return 0;
+    while (!chan_try_pop(c, out)) {
+        chan_park(&c->rx_waiters);
+        chan_epoch_t epoch = chan_wait_begin();
+        int got = chan_try_pop(c, out);
+        if (!got) chan_wait_end(epoch, CHAN_RX_BIT(id));
+        chan_unpark(&c->rx_waiters);
+        if (got) break;
+    }
+    chan_wake(&c->tx_waiters, CHAN_TX_BIT);
+    return 1;
+}
+
+/* ── BASIC interface ──────────────────────────────────── */
+
+void rb_channel_create(int32_t id, int32_t capacity) {
+    /* An existing channel keeps its capacity */
+    chan_get(id, capacity);
+}
+
+void rb_channel_send_int(int32_t id, int32_t value) {
+    chan_slot_t item = { .tag = CHAN_INT, .v.i = value };
+    chan_push(id, &item);
+}
+
+void rb_channel_send_float(int32_t id, float value) {
+    chan_slot_t item = { .tag = CHAN_FLOAT, .v.f = value };
+    chan_push(id, &item);
+}
+
+void rb_channel_send_str(int32_t id, rb_string_t* s) {
+    /* The channel holds its own reference, handed over to the receiver */
+    rb_string_share(s);
+    rb_string_retain(s);
+    chan_slot_t item = { .tag = CHAN_STR, .v.s = s };
+    chan_push(id, &item);
+}
+
+static void chan_type_mismatch(int32_t id, chan_slot_t* item) {
+    fprintf(stderr, "CHANNEL %d: received value of the wrong type\n", (int)id);
+    if (item->tag == CHAN_STR) rb_string_release(item->v.s);
+}
+
+int32_t rb_channel_receive_int(int32_t id) {
+    chan_slot_t item;
+    if (!chan_pop(id, &item)) return 0;
+    switch (item.tag) {
+        case CHAN_INT: return item.v.i;
+        case CHAN_FLOAT: return (int32_t)item.v.f;
+        default: chan_type_mismatch(id, &item); return 0;
+    }
+}
+
+float rb_channel_receive_float(int32_t id) {
+    chan_slot_t item;
+    if (!chan_pop(id, &item)) return 0.0f;
+    switch (item.tag) {
+        case CHAN_INT: return (float)item.v.i;
+        case CHAN_FLOAT: return item.v.f;
+        default: chan_type_mismatch(id, &item); return 0.0f;
+    }
+}
+
+rb_string_t* rb_channel_receive_str(int32_t id) {
+    chan_slot_t item;
+    if (!chan_pop(id, &item)) return rb_string_alloc("");
+    if (item.tag != CHAN_STR) {
+        chan_type_mismatch(id, &item);
+        return rb_string_alloc("");
+    }
+    return item.v.s ? item.v.s : rb_string_alloc("");
+}
+
+int32_t rb_channel_select(int32_t count, const int32_t* ids) {
+    rb_channel_t* chans[RB_MAX_CHANNELS];
+    uint32_t bits = 0;
+    if (count > RB_MAX_CHANNELS) count = RB_MAX_CHANNELS;
+    for (int32_t i = 0; i < count; i++) {
+        chans[i] = chan_get(ids[i], RB_CHANNEL_DEFAULT_CAPACITY);
+        if (!chans[i]) return -1;
+        bits |= CHAN_RX_BIT(ids[i]);
+    }
+    if (count <= 0) return -1;
+
+    /* Channels listed first win when several are ready */
+    for (;;) {
+        for (int32_t i = 0; i < count; i++) {
+            if (chan_has_item(chans[i])) return ids[i];
+        }
+        for (int32_t i = 0; i < count; i++) chan_park(&chans[i]->rx_waiters);
+        chan_epoch_t epoch = chan_wait_begin();
+        int32_t ready = -1;
+        for (int32_t i = 0; i < count && ready < 0; i++) {
+            if (chan_has_item(chans[i])) ready = ids[i];
+        }
+        if (ready < 0) chan_wait_end(epoch, bits);
+        for (int32_t i = 0; i < count; i++) chan_unpark(&chans[i]->rx_waiters);
+        if (ready >= 0) return ready;
+    }
+}
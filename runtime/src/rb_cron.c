@@ -1,52 +1,340 @@
 #include "rb_runtime.h"
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 #include <time.h>
 
+/* ── Cron ─────────────────────────────────────────────────
+ *
+ * CRON.ADD parses a five-field expression (minute hour day month weekday,
+ * each "*", "n", "a-b", "*\/s", "a-b/s" or a comma list of those; missing
+ * trailing fields are "*") into one bitmask per field, and computes the
+ * job's next fire time once. Every job then waits in the timer scheduler
+ * (rb_timer.c) for that moment, so nothing scans the job table or calls
+ * localtime while no job is due. When a job fires, its next time is
+ * computed from the masks and it is scheduled again.
+ *
+ * A fire sets the flag CRON.CHECK reads and clears, and runs the ON CRON
+ * SUB on the event dispatcher. Waits are split into CRON_RECHECK_US steps
+ * and the next time is recomputed at each, so setting the clock (NTP.SYNC)
+ * moves pending jobs with it; a job more than CRON_LATE_S overdue after
+ * such a jump is skipped rather than fired late.
+ */
+
 #define MAX_CRON_JOBS 16
+#define CRON_RECHECK_US (60LL * 1000000)
+#define CRON_LATE_S 60
+
+typedef struct {
+    uint64_t minutes;   /* bit n: minute n */
+    uint32_t hours;
+    uint32_t days;      /* bit n: day of month n, 1-31 */
+    uint16_t months;    /* bit n: month n, 1-12 */
+    uint8_t weekdays;   /* bit n: weekday n, 0 = Sunday */
+    uint8_t any_day;    /* day field is "*" */
+    uint8_t any_weekday;
+} cron_spec_t;
 
 typedef struct {
     int32_t id;
-    char expr[64];
-    int active;
+    int used;
+    int active;         /* has a schedule (CRON.ADD) */
+    cron_spec_t spec;
+    time_t next;        /* -1 if the expression never matches */
+    int32_t sched;      /* scheduler id, -1 if none */
+    uint8_t gen;
+    int fired;
+    int32_t source;     /* event source for ON CRON, -1 if none */
 } cron_job_t;
 
 static cron_job_t jobs[MAX_CRON_JOBS];
-static int job_count = 0;
 
-void rb_cron_add(int32_t id, rb_string_t* expr) {
-    if (job_count < MAX_CRON_JOBS) {
-        jobs[job_count].id = id;
-        snprintf(jobs[job_count].expr, sizeof(jobs[job_count].expr), "%.*s", expr->len, expr->data);
-        jobs[job_count].active = 1;
-        job_count++;
+#ifdef ESP_PLATFORM
+#include <sys/lock.h>
+static _lock_t cron_lock_handle;
+static void cron_lock(void) { _lock_acquire(&cron_lock_handle); }
+static void cron_unlock(void) { _lock_release(&cron_lock_handle); }
+#else
+#include <pthread.h>
+static pthread_mutex_t cron_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void cron_lock(void) { pthread_mutex_lock(&cron_mutex); }
+static void cron_unlock(void) { pthread_mutex_unlock(&cron_mutex); }
+#endif
+
+/* ── Expression parsing ── */
+
+static int cron_number(const char** p, int32_t* out) {
+    if (**p < '0' || **p > '9') return 0;
+    int32_t n = 0;
+    while (**p >= '0' && **p <= '9') n = n * 10 + (*(*p)++ - '0');
+    *out = n;
+    return 1;
+}
+
+/* One field, up to the next space, into `mask`; 0 if malformed */
+static int cron_field(const char** p, int32_t lo, int32_t hi, uint64_t* mask, int* any) {
+    *mask = 0;
+    *any = 0;
+    for (;;) {
+        int32_t a = lo, b = hi, step = 1;
+        if (**p == '*') {
+            (*p)++;
+            if (**p != '/') *any = 1;
+        } else {
+            if (!cron_number(p, &a)) return 0;
+            b = a;
+            if (**p == '-') {
+                (*p)++;
+                if (!cron_number(p, &b)) return 0;
+            }
+        }
+        if (**p == '/') {
+            (*p)++;
+            if (!cron_number(p, &step) || step <= 0) return 0;
+            /* "n/s" runs from n to the end of the range */
+            if (a == b && b != hi) b = hi;
+        }
+        if (a < lo || b > hi || a > b) return 0;
+        for (int32_t v = a; v <= b; v += step) *mask |= 1ULL << v;
+        if (**p != ',') break;
+        (*p)++;
+        *any = 0;
     }
-    printf("[CRON] Added job %d: %.*s\n", id, expr->len, expr->data);
+    return **p == '\0' || **p == ' ' || **p == '\t';
 }
 
-/* Simple cron check — matches minute-based expressions */
-int32_t rb_cron_check(int32_t id) {
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    for (int i = 0; i < job_count; i++) {
-        if (jobs[i].id == id && jobs[i].active) {
-            /* Simple: if expr is "*" always fires, otherwise match minute */
-            if (jobs[i].expr[0] == '*') return 1;
-            int minute = 0;
-            if (sscanf(jobs[i].expr, "%d", &minute) == 1) {
-                return (t->tm_min == minute) ? 1 : 0;
+static int cron_parse(const char* s, cron_spec_t* spec) {
+    static const struct { const char* name; const char* expr; } macros[] = {
+        { "@yearly", "0 0 1 1 *" },
+        { "@annually", "0 0 1 1 *" },
+        { "@monthly", "0 0 1 * *" },
+        { "@weekly", "0 0 * * 0" },
+        { "@daily", "0 0 * * *" },
+        { "@midnight", "0 0 * * *" },
+        { "@hourly", "0 * * * *" },
+    };
+    while (*s == ' ' || *s == '\t') s++;
+    for (size_t i = 0; i < sizeof(macros) / sizeof(macros[0]); i++) {
+        if (strcmp(s, macros[i].name) == 0) {
+            s = macros[i].expr;
+            break;
+        }
+    }
+
+    static const int32_t lo[5] = { 0, 0, 1, 1, 0 };
+    static const int32_t hi[5] = { 59, 23, 31, 12, 7 };
+    uint64_t masks[5];
+    int any[5];
+    for (int f = 0; f < 5; f++) {
+        while (*s == ' ' || *s == '\t') s++;
+        if (*s == '\0') {
+            masks[f] = 0;
+            for (int32_t v = lo[f]; v <= hi[f]; v++) masks[f] |= 1ULL << v;
+            any[f] = 1;
+        } else if (!cron_field(&s, lo[f], hi[f], &masks[f], &any[f])) {
+            return 0;
+        }
+    }
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s != '\0') return 0;
+
+    spec->minutes = masks[0];
+    spec->hours = (uint32_t)masks[1];
+    spec->days = (uint32_t)masks[2];
+    spec->months = (uint16_t)masks[3];
+    /* Weekday 7 is Sunday too */
+    spec->weekdays = (uint8_t)((masks[4] | (masks[4] >> 7)) & 0x7F);
+    spec->any_day = (uint8_t)any[2];
+    spec->any_weekday = (uint8_t)any[4];
+    return 1;
+}
+
+/* ── Next fire time ── */
+
+static int cron_day_matches(const cron_spec_t* spec, const struct tm* t) {
+    int day = (spec->days >> t->tm_mday) & 1;
+    int weekday = (spec->weekdays >> t->tm_wday) & 1;
+    /* As in cron: with both fields restricted, either one matching will do */
+    if (!spec->any_day && !spec->any_weekday) return day || weekday;
+    return day && weekday;
+}
+
+static void cron_normalize(struct tm* t) {
+    t->tm_isdst = -1;
+    mktime(t);
+}
+
+/* The first matching minute after `after`, or -1 if there is none within
+ * a few years (e.g. "0 0 31 2 *") */
+static time_t cron_next(const cron_spec_t* spec, time_t after) {
+    struct tm t;
+    localtime_r(&after, &t);
+    t.tm_sec = 0;
+    t.tm_min++;
+    cron_normalize(&t);
+    /* Each step moves at least to the next minute, hour, day or month */
+    for (int guard = 0; guard < 5000; guard++) {
+        if (!((spec->months >> (t.tm_mon + 1)) & 1)) {
+            t.tm_mon++;
+            t.tm_mday = 1;
+            t.tm_hour = 0;
+            t.tm_min = 0;
+        } else if (!cron_day_matches(spec, &t)) {
+            t.tm_mday++;
+            t.tm_hour = 0;
+            t.tm_min = 0;
+        } else if (!((spec->hours >> t.tm_hour) & 1)) {
+            t.tm_hour++;
+            t.tm_min = 0;
+        } else if (!((spec->minutes >> t.tm_min) & 1)) {
+            uint64_t later = spec->minutes >> t.tm_min;
+            if (later == 0) {
+                t.tm_hour++;
+                t.tm_min = 0;
+            } else {
+                t.tm_min += __builtin_ctzll(later);
             }
+        } else {
+            t.tm_isdst = -1;
+            return mktime(&t);
         }
+        cron_normalize(&t);
     }
-    return 0;
+    return -1;
 }
 
-void rb_cron_remove(int32_t id) {
-    for (int i = 0; i < job_count; i++) {
-        if (jobs[i].id == id) {
-            jobs[i].active = 0;
-            printf("[CRON] Removed job %d\n", id);
-            return;
+/* ── Scheduling, with the lock held ── */
+
+static int64_t cron_now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void cron_fire(int32_t arg);
+
+static void cron_arm(int32_t slot) {
+    cron_job_t* job = &jobs[slot];
+    job->sched = -1;
+    if (job->next < 0) return;
+    int64_t wait = (int64_t)job->next * 1000000LL - cron_now_us();
+    if (wait > CRON_RECHECK_US) wait = CRON_RECHECK_US;
+    job->sched = rb_sched_add(wait, 0, cron_fire, slot | (int32_t)job->gen << 8);
+    if (job->sched < 0) printf("[CRON] job %d: no free timer\n", (int)job->id);
+}
+
+static void cron_disarm(cron_job_t* job) {
+    if (job->sched >= 0) rb_sched_cancel(job->sched);
+    job->sched = -1;
+    job->gen++;     /* a fire already on its way is ignored */
+}
+
+static void cron_fire(int32_t arg) {
+    int32_t slot = arg & 0xFF;
+    int32_t source = -1;
+    cron_lock();
+    cron_job_t* job = &jobs[slot];
+    if (!job->active || job->gen != (uint8_t)(arg >> 8)) {
+        cron_unlock();
+        return;
+    }
+    time_t now = time(NULL);
+    if (job->next >= 0 && now >= job->next) {
+        if (now - job->next < CRON_LATE_S) {
+            job->fired = 1;
+            source = job->source;
         }
     }
+    job->next = cron_next(&job->spec, now);
+    cron_arm(slot);
+    cron_unlock();
+    if (source >= 0) rb_event_raise(source);
+}
+
+static int32_t cron_find(int32_t id, int create) {
+    int32_t free_slot = -1;
+    for (int32_t i = 0; i < MAX_CRON_JOBS; i++) {
+        if (jobs[i].used && jobs[i].id == id) return i;
+        if (!jobs[i].used && free_slot < 0) free_slot = i;
+    }
+    if (!create || free_slot < 0) return -1;
+    cron_job_t* job = &jobs[free_slot];
+    uint8_t gen = job->gen;
+    memset(job, 0, sizeof(*job));
+    job->gen = gen;
+    job->id = id;
+    job->used = 1;
+    job->sched = -1;
+    job->source = -1;
+    return free_slot;
+}
+
+void rb_cron_add(int32_t id, rb_string_t* expr) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*s", expr ? (int)expr->length : 0, expr ? expr->data : "");
+    cron_spec_t spec;
+    if (!cron_parse(text, &spec)) {
+        printf("[CRON] job %d: invalid expression \"%s\"\n", (int)id, text);
+        return;
+    }
+    cron_lock();
+    int32_t slot = cron_find(id, 1);
+    if (slot < 0) {
+        cron_unlock();
+        printf("[CRON] at most %d jobs\n", MAX_CRON_JOBS);
+        return;
+    }
+    cron_job_t* job = &jobs[slot];
+    cron_disarm(job);
+    job->spec = spec;
+    job->active = 1;
+    job->fired = 0;
+    job->next = cron_next(&spec, time(NULL));
+    cron_arm(slot);
+    cron_unlock();
+    printf("[CRON] Added job %d: %s\n", (int)id, text);
+}
+
+/* 1 if the job has fired since the last CRON.CHECK of it */
+int32_t rb_cron_check(int32_t id) {
+    int32_t fired = 0;
+    cron_lock();
+    int32_t slot = cron_find(id, 0);
+    if (slot >= 0) {
+        fired = jobs[slot].fired;
+        jobs[slot].fired = 0;
+    }
+    cron_unlock();
+    return fired;
+}
+
+void rb_on_cron(int32_t id, void (*handler)(void)) {
+    cron_lock();
+    int32_t slot = cron_find(id, 1);
+    if (slot < 0) {
+        cron_unlock();
+        printf("[CRON] at most %d jobs\n", MAX_CRON_JOBS);
+        return;
+    }
+    cron_job_t* job = &jobs[slot];
+    if (job->source >= 0) rb_event_source_free(job->source);
+    job->source = rb_event_source_alloc(handler, 0);
+    cron_unlock();
+}
+
+void rb_cron_remove(int32_t id) {
+    cron_lock();
+    int32_t slot = cron_find(id, 0);
+    if (slot < 0) {
+        cron_unlock();
+        return;
+    }
+    cron_job_t* job = &jobs[slot];
+    cron_disarm(job);
+    if (job->source >= 0) rb_event_source_free(job->source);
+    job->source = -1;
+    job->active = 0;
+    job->used = 0;
+    cron_unlock();
+    printf("[CRON] Removed job %d\n", (int)id);
 }
@@ -1,47 +1,177 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
 
-extern const int32_t rb_data_types[];
-extern const int32_t rb_data_ints[];
-extern const float rb_data_floats[];
-extern const char* rb_data_strings[];
-extern const int32_t rb_data_count;
+/* ── DATA / READ / RESTORE ────────────────────────────────
+ *
+ * The compiler packs every DATA item of the program, in order, into one
+ * byte stream in flash. Runs of items of one kind form a block:
+ *
+ *   tag (1 byte)   RB_DATA_I8 / I16 / I32 / F32 / STR, or RB_DATA_END
+ *   count          LEB128, 7 bits per byte
+ *   payload        count little-endian items of the tag's width, or
+ *                  count NUL-terminated strings
+ *
+ * so a table of small integers costs one or two bytes an entry. A
+ * RESTORE label starts a block, and the compiler passes its byte offset:
+ * RESTORE is O(1) wherever the label is. READ walks the stream with a
+ * cursor; READ a() copies a whole block run at a time.
+ */
 
-static int32_t rb_data_index = 0;
+enum {
+    RB_DATA_END = 0,
+    RB_DATA_I8 = 1,
+    RB_DATA_I16 = 2,
+    RB_DATA_I32 = 3,
+    RB_DATA_F32 = 4,
+    RB_DATA_STR = 5,
+};
 
-int32_t rb_data_read_int(void) {
-    if (rb_data_index >= rb_data_count)
+extern const uint8_t rb_data_stream[];
+
+static struct {
+    uint32_t at;        /* offset of the next item */
+    uint32_t left;      /* items left in the current block */
+    uint8_t kind;
+} data_cursor;
+
+static void data_next_block(void) {
+    uint32_t at = data_cursor.at;
+    uint8_t tag = rb_data_stream[at++];
+    if (tag == RB_DATA_END)
         rb_panic("Out of DATA");
-    int32_t i = rb_data_index++;
-    switch (rb_data_types[i]) {
-        case 0: return rb_data_ints[i];
-        case 1: return (int32_t)rb_data_floats[i];
-        default: rb_panic("Type mismatch in READ: expected number, got string");
+    uint32_t count = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+        b = rb_data_stream[at++];
+        count |= (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    data_cursor.at = at;
+    data_cursor.left = count;
+    data_cursor.kind = tag;
+}
+
+static int32_t data_int_at(uint8_t kind, const uint8_t* p) {
+    switch (kind) {
+        case RB_DATA_I8: return (int8_t)p[0];
+        case RB_DATA_I16: { int16_t v; memcpy(&v, p, sizeof v); return v; }
+        default: { int32_t v; memcpy(&v, p, sizeof v); return v; }
     }
 }
 
-float rb_data_read_float(void) {
-    if (rb_data_index >= rb_data_count)
-        rb_panic("Out of DATA");
-    int32_t i = rb_data_index++;
-    switch (rb_data_types[i]) {
-        case 0: return (float)rb_data_ints[i];
-        case 1: return rb_data_floats[i];
-        default: rb_panic("Type mismatch in READ: expected number, got string");
+static float data_float_at(const uint8_t* p) {
+    float v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t data_width(uint8_t kind) {
+    switch (kind) {
+        case RB_DATA_I8: return 1;
+        case RB_DATA_I16: return 2;
+        default: return 4;
     }
 }
 
+/* The next item's kind; the cursor is left on its payload */
+static uint8_t data_peek(void) {
+    if (data_cursor.left == 0)
+        data_next_block();
+    return data_cursor.kind;
+}
+
+static const uint8_t* data_take(void) {
+    const uint8_t* p = rb_data_stream + data_cursor.at;
+    if (data_cursor.kind == RB_DATA_STR)
+        data_cursor.at += (uint32_t)strlen((const char*)p) + 1;
+    else
+        data_cursor.at += data_width(data_cursor.kind);
+    data_cursor.left--;
+    return p;
+}
+
+int32_t rb_data_read_int(void) {
+    uint8_t kind = data_peek();
+    if (kind == RB_DATA_STR)
+        rb_panic("Type mismatch in READ: expected number, got string");
+    const uint8_t* p = data_take();
+    return kind == RB_DATA_F32 ? (int32_t)data_float_at(p) : data_int_at(kind, p);
+}
+
+float rb_data_read_float(void) {
+    uint8_t kind = data_peek();
+    if (kind == RB_DATA_STR)
+        rb_panic("Type mismatch in READ: expected number, got string");
+    const uint8_t* p = data_take();
+    return kind == RB_DATA_F32 ? data_float_at(p) : (float)data_int_at(kind, p);
+}
+
 rb_string_t* rb_data_read_string(void) {
-    if (rb_data_index >= rb_data_count)
-        rb_panic("Out of DATA");
-    int32_t i = rb_data_index++;
-    switch (rb_data_types[i]) {
-        case 0: return rb_fn_str_s((float)rb_data_ints[i]);
-        case 1: return rb_fn_str_s(rb_data_floats[i]);
-        default: return rb_string_alloc(rb_data_strings[i]);
+    uint8_t kind = data_peek();
+    const uint8_t* p = data_take();
+    if (kind == RB_DATA_STR)
+        return rb_string_alloc((const char*)p);
+    if (kind == RB_DATA_F32)
+        return rb_fn_str_s(data_float_at(p));
+    /* Integers are formatted as integers, not through a float */
+    char buf[RB_FMT_INT_MAX];
+    return rb_string_from_bytes(buf, rb_fmt_int(buf, data_int_at(kind, p)));
+}
+
+/* ── READ a() ── */
+
+void rb_data_read_ints(int32_t* dst, int32_t n) {
+    while (n > 0) {
+        uint8_t kind = data_peek();
+        if (kind == RB_DATA_STR)
+            rb_panic("Type mismatch in READ: expected number, got string");
+        uint32_t take = data_cursor.left < (uint32_t)n ? data_cursor.left : (uint32_t)n;
+        const uint8_t* p = rb_data_stream + data_cursor.at;
+        if (kind == RB_DATA_I32) {
+            memcpy(dst, p, (size_t)take * 4);
+        } else if (kind == RB_DATA_F32) {
+            for (uint32_t k = 0; k < take; k++) dst[k] = (int32_t)data_float_at(p + 4 * k);
+        } else {
+            uint32_t w = data_width(kind);
+            for (uint32_t k = 0; k < take; k++) dst[k] = data_int_at(kind, p + w * k);
+        }
+        data_cursor.at += take * data_width(kind);
+        data_cursor.left -= take;
+        dst += take;
+        n -= (int32_t)take;
+    }
+}
+
+void rb_data_read_floats(float* dst, int32_t n) {
+    while (n > 0) {
+        uint8_t kind = data_peek();
+        if (kind == RB_DATA_STR)
+            rb_panic("Type mismatch in READ: expected number, got string");
+        uint32_t take = data_cursor.left < (uint32_t)n ? data_cursor.left : (uint32_t)n;
+        const uint8_t* p = rb_data_stream + data_cursor.at;
+        if (kind == RB_DATA_F32) {
+            memcpy(dst, p, (size_t)take * 4);
+        } else {
+            uint32_t w = data_width(kind);
+            for (uint32_t k = 0; k < take; k++) dst[k] = (float)data_int_at(kind, p + w * k);
+        }
+        data_cursor.at += take * data_width(kind);
+        data_cursor.left -= take;
+        dst += take;
+        n -= (int32_t)take;
     }
 }
 
+/* ── RESTORE [label] ── */
+
 void rb_data_restore(void) {
-    rb_data_index = 0;
+    rb_data_restore_at(0);
+}
+
+/* `offset` is the start of a block, from the compiler */
+void rb_data_restore_at(int32_t offset) {
+    data_cursor.at = (uint32_t)offset;
+    data_cursor.left = 0;
 }
@@ -7,6 +7,8 @@
 #endif
 
 void rb_deepsleep(int32_t ms) {
+    rb_nvs_commit();
+    rb_console_flush();
 #ifdef ESP_PLATFORM
     uint64_t us = (uint64_t)ms * 1000ULL;
     esp_deep_sleep(us);
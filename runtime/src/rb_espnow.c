@@ -3,37 +3,75 @@
 #include <string.h>
 #include <stdlib.h>
 
+/* ── ESP-NOW ──────────────────────────────────────────────
+ *
+ * Peers live in a table: a MAC string is parsed and added with
+ * esp_now_add_peer the first time it is used, and ESPNOW.PEER returns its
+ * index (+1) so hot loops can send by number and skip even the string
+ * compare. Payloads are sent with their length, so binary strings work.
+ *
+ * Sends are flow-controlled by the send-done callback: at most
+ * ESPNOW_TX_WINDOW frames are in flight, and a send beyond that waits for
+ * one to complete instead of overflowing the Wi-Fi TX queue.
+ *
+ * Received frames are copied by the Wi-Fi task into a pool of slots; only
+ * the slot index goes through the queues, and ESPNOW.RECEIVE copies the
+ * payload straight into its string and returns the slot.
+ */
+
+#define ESPNOW_PEER_MAX 20              /* ESP_NOW_MAX_TOTAL_PEER_NUM */
+#define ESPNOW_MAC_TEXT 17              /* "aa:bb:cc:dd:ee:ff" */
+
 #ifdef ESP_PLATFORM
 #include "esp_now.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <sys/lock.h>
 
-#define ESPNOW_RECV_QUEUE_SIZE 8
-#define ESPNOW_RECV_MSG_MAX   250
+#define ESPNOW_RX_SLOTS 32
 #define ESPNOW_RECV_TIMEOUT_MS 5000
+#define ESPNOW_TX_WINDOW 4
+#define ESPNOW_TX_TIMEOUT_MS 100
 
-static QueueHandle_t espnow_recv_queue = NULL;
-static bool espnow_inited = false;
+typedef struct {
+    uint8_t mac[6];
+    char text[ESPNOW_MAC_TEXT];
+    uint8_t text_len;
+} espnow_peer_t;
 
 typedef struct {
-    char data[ESPNOW_RECV_MSG_MAX];
-    int len;
-} espnow_msg_t;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+    uint8_t len;
+} espnow_slot_t;
+
+static espnow_peer_t espnow_peers[ESPNOW_PEER_MAX];
+static int32_t espnow_peer_count = 0;
+static _lock_t espnow_peer_lock;
+
+static espnow_slot_t espnow_slots[ESPNOW_RX_SLOTS];
+static QueueHandle_t espnow_free_queue = NULL;      /* free slot indices */
+static QueueHandle_t espnow_recv_queue = NULL;      /* filled slot indices */
+static SemaphoreHandle_t espnow_tx_window = NULL;
+static bool espnow_inited = false;
+
+static void espnow_send_cb(const uint8_t* mac, esp_now_send_status_t status) {
+    (void)mac;
+    (void)status;
+    xSemaphoreGive(espnow_tx_window);
+}
 
 static void espnow_recv_cb(const esp_now_recv_info_t *info,
                             const uint8_t *data, int data_len) {
-    if (espnow_recv_queue && data_len > 0) {
-        espnow_msg_t msg;
-        int copy_len = data_len;
-        if (copy_len >= ESPNOW_RECV_MSG_MAX) {
-            copy_len = ESPNOW_RECV_MSG_MAX - 1;
-        }
-        memcpy(msg.data, data, copy_len);
-        msg.data[copy_len] = '\0';
-        msg.len = copy_len;
-        xQueueSend(espnow_recv_queue, &msg, 0);
-    }
+    (void)info;
+    uint8_t slot;
+    if (data_len <= 0 || xQueueReceive(espnow_free_queue, &slot, 0) != pdTRUE)
+        return;     /* pool exhausted: the frame is dropped */
+    if (data_len > ESP_NOW_MAX_DATA_LEN) data_len = ESP_NOW_MAX_DATA_LEN;
+    memcpy(espnow_slots[slot].data, data, (size_t)data_len);
+    espnow_slots[slot].len = (uint8_t)data_len;
+    xQueueSend(espnow_recv_queue, &slot, 0);
 }
 
 static int parse_mac(const char *str, uint8_t mac[6]) {
@@ -45,56 +83,122 @@ static int parse_mac(const char *str, uint8_t mac[6]) {
     for (int i = 0; i < 6; i++) mac[i] = (uint8_t)m[i];
     return 0;
 }
+
+/* The handle of a peer MAC string, adding it on first use; 0 if invalid */
+static int32_t espnow_peer_handle(rb_string_t* peer) {
+    const char* text = rb_string_cstr(peer);
+    int32_t len = peer ? peer->length : 0;
+    int32_t handle = 0;
+    _lock_acquire(&espnow_peer_lock);
+    for (int32_t i = 0; i < espnow_peer_count; i++) {
+        if (espnow_peers[i].text_len == len && memcmp(espnow_peers[i].text, text, (size_t)len) == 0) {
+            handle = i + 1;
+            break;
+        }
+    }
+    if (!handle) {
+        uint8_t mac[6];
+        if (len > ESPNOW_MAC_TEXT || parse_mac(text, mac) != 0) {
+            printf("[ESPNOW] invalid MAC: %s\n", text);
+        } else if (espnow_peer_count == ESPNOW_PEER_MAX) {
+            printf("[ESPNOW] more than %d peers\n", ESPNOW_PEER_MAX);
+        } else {
+            esp_now_peer_info_t info = {0};
+            memcpy(info.peer_addr, mac, 6);
+            info.channel = 0;
+            info.encrypt = false;
+            esp_err_t err = esp_now_add_peer(&info);
+            if (err == ESP_OK || err == ESP_ERR_ESPNOW_EXIST) {
+                espnow_peer_t* p = &espnow_peers[espnow_peer_count++];
+                memcpy(p->mac, mac, 6);
+                memcpy(p->text, text, (size_t)len);
+                p->text_len = (uint8_t)len;
+                handle = espnow_peer_count;
+            } else {
+                printf("[ESPNOW] could not add peer %s\n", text);
+            }
+        }
+    }
+    _lock_release(&espnow_peer_lock);
+    return handle;
+}
 #endif
 
 void rb_espnow_init(void) {
 #ifdef ESP_PLATFORM
     if (espnow_inited) return;
     if (!espnow_recv_queue) {
-        espnow_recv_queue = xQueueCreate(ESPNOW_RECV_QUEUE_SIZE,
-                                          sizeof(espnow_msg_t));
+        espnow_recv_queue = xQueueCreate(ESPNOW_RX_SLOTS, sizeof(uint8_t));
+        espnow_free_queue = xQueueCreate(ESPNOW_RX_SLOTS, sizeof(uint8_t));
+        espnow_tx_window = xSemaphoreCreateCounting(ESPNOW_TX_WINDOW, ESPNOW_TX_WINDOW);
+        if (!espnow_recv_queue || !espnow_free_queue || !espnow_tx_window)
+            rb_panic("ESP-NOW queues could not be created");
+        for (uint8_t i = 0; i < ESPNOW_RX_SLOTS; i++)
+            xQueueSend(espnow_free_queue, &i, 0);
     }
     esp_now_init();
     esp_now_register_recv_cb(espnow_recv_cb);
+    esp_now_register_send_cb(espnow_send_cb);
     espnow_inited = true;
 #else
     printf("[ESPNOW] init\n");
 #endif
 }
 
-void rb_espnow_send(rb_string_t* peer, rb_string_t* data) {
+int32_t rb_espnow_peer(rb_string_t* peer) {
+#ifdef ESP_PLATFORM
+    if (!espnow_inited) return 0;
+    return espnow_peer_handle(peer);
+#else
+    printf("[ESPNOW] peer: %s\n", peer ? rb_string_cstr(peer) : "(null)");
+    return 1;
+#endif
+}
+
+void rb_espnow_send_to(int32_t peer, rb_string_t* data) {
+    int32_t len = data ? data->length : 0;
 #ifdef ESP_PLATFORM
     if (!espnow_inited) return;
-    uint8_t mac[6];
-    const char *peer_str = peer ? peer->data : "";
-    if (parse_mac(peer_str, mac) != 0) {
-        printf("[ESPNOW] invalid MAC: %s\n", peer_str);
+    if (peer < 1 || peer > espnow_peer_count) {
+        printf("[ESPNOW] invalid peer handle %d\n", (int)peer);
         return;
     }
-    /* Auto-add peer if not already added */
-    esp_now_peer_info_t info = {0};
-    memcpy(info.peer_addr, mac, 6);
-    info.channel = 0;
-    info.encrypt = false;
-    if (!esp_now_is_peer_exist(mac)) {
-        esp_now_add_peer(&info);
+    if (len > ESP_NOW_MAX_DATA_LEN) {
+        printf("[ESPNOW] %d-byte payload exceeds %d bytes\n", (int)len, ESP_NOW_MAX_DATA_LEN);
+        return;
     }
-    const char *msg = data ? data->data : "";
-    esp_now_send(mac, (const uint8_t *)msg, strlen(msg));
+    /* Wait for a free place in the TX window; after the timeout (a lost
+     * send-done) send anyway rather than stall for good */
+    int took = xSemaphoreTake(espnow_tx_window, pdMS_TO_TICKS(ESPNOW_TX_TIMEOUT_MS)) == pdTRUE;
+    if (esp_now_send(espnow_peers[peer - 1].mac, (const uint8_t*)(data ? data->data : ""), (size_t)len) != ESP_OK && took)
+        xSemaphoreGive(espnow_tx_window);
+#else
+    printf("[ESPNOW] send: peer=%d, data=%.*s\n", (int)peer, (int)len, data ? data->data : "");
+#endif
+}
+
+void rb_espnow_send(rb_string_t* peer, rb_string_t* data) {
+#ifdef ESP_PLATFORM
+    if (!espnow_inited) return;
+    int32_t handle = espnow_peer_handle(peer);
+    if (handle) rb_espnow_send_to(handle, data);
 #else
-    printf("[ESPNOW] send: peer=%s, data=%s\n",
-           peer ? peer->data : "(null)",
-           data ? data->data : "(null)");
+    printf("[ESPNOW] send: peer=%s, data=%.*s\n",
+           peer ? rb_string_cstr(peer) : "(null)",
+           data ? (int)data->length : 6, data ? data->data : "(null)");
 #endif
 }
 
 rb_string_t* rb_espnow_receive(void) {
 #ifdef ESP_PLATFORM
     if (espnow_recv_queue) {
-        espnow_msg_t msg;
-        if (xQueueReceive(espnow_recv_queue, &msg,
+        uint8_t slot;
+        if (xQueueReceive(espnow_recv_queue, &slot,
                           pdMS_TO_TICKS(ESPNOW_RECV_TIMEOUT_MS)) == pdTRUE) {
-            return rb_string_alloc(msg.data);
+            rb_string_t* s = rb_string_from_bytes((const char*)espnow_slots[slot].data,
+                                                  espnow_slots[slot].len);
+            xQueueSend(espnow_free_queue, &slot, 0);
+            return s;
         }
     }
     return rb_string_alloc("");
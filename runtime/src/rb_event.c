@@ -1,48 +1,162 @@
 #include "rb_runtime.h"
 #include <stdio.h>
 
+/* ── Event dispatch ───────────────────────────────────────
+ *
+ * Interrupt sources never run BASIC code themselves. The GPIO ISR and the
+ * timer scheduler (rb_timer.c) only push the one-byte id of their source
+ * into a ring and wake a high-priority dispatcher task, which runs the
+ * handlers; a handler that prints, allocates or blocks delays the next
+ * handler, not the interrupt. Each ring has a single producer (the GPIO
+ * ISR, the esp_timer task) and the dispatcher as its only consumer, so
+ * pushing is lock-free and takes a few instructions.
+ *
+ * Events coalesce: while a source is already queued, further events from
+ * it are counted instead of queued, so a bouncing button gives one handler
+ * call per dispatch rather than a burst. That also bounds the rings at one
+ * entry per source; the overflow counter only moves if that is exceeded.
+ */
+
+#define EVENT_GPIO_MAX 40
+#define EVENT_TIMER_MAX RB_TIMER_MAX
+/* Source ids: GPIO pins first, then timers */
+#define EVENT_SOURCES (EVENT_GPIO_MAX + EVENT_TIMER_MAX)
+#define EVENT_RING_SIZE 128 /* power of two, at least EVENT_SOURCES */
+
+static uint32_t event_coalesced = 0;
+static uint32_t event_dropped = 0;
+
+int32_t rb_event_coalesced(void) {
+    return (int32_t)__atomic_load_n(&event_coalesced, __ATOMIC_RELAXED);
+}
+
+int32_t rb_event_dropped(void) {
+    return (int32_t)__atomic_load_n(&event_dropped, __ATOMIC_RELAXED);
+}
+
 #ifdef ESP_PLATFORM
 #include "driver/gpio.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <sys/lock.h>
+
+#define EVENT_TASK_STACK 4096
+#define EVENT_TASK_PRIORITY 10
 
-static void (*gpio_handlers[40])(void) = {0};
+typedef struct {
+    uint8_t ids[EVENT_RING_SIZE];
+    volatile uint32_t head;     /* written by the producer */
+    volatile uint32_t tail;     /* written by the dispatcher */
+} event_ring_t;
+
+static event_ring_t gpio_ring;
+static event_ring_t timer_ring;
+/* One bit per source that is sitting in a ring */
+static uint32_t event_pending[(EVENT_SOURCES + 31) / 32];
+static void (*volatile event_handlers[EVENT_SOURCES])(void);
+/* Timer sources released once their handler has run (one-shot timers) */
+static uint8_t event_oneshot[EVENT_SOURCES];
+static _lock_t event_alloc_lock;
+static TaskHandle_t event_task = NULL;
+
+/* Queue source `id`; returns nonzero if the dispatcher needs waking */
+static inline int IRAM_ATTR event_push(event_ring_t* ring, uint8_t id) {
+    uint32_t bit = 1u << (id & 31);
+    if (__atomic_fetch_or(&event_pending[id >> 5], bit, __ATOMIC_ACQ_REL) & bit) {
+        __atomic_fetch_add(&event_coalesced, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    uint32_t head = ring->head;
+    if (head - ring->tail >= EVENT_RING_SIZE) {
+        __atomic_fetch_and(&event_pending[id >> 5], ~bit, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&event_dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    ring->ids[head & (EVENT_RING_SIZE - 1)] = id;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Run the handlers for everything queued in `ring` */
+static void event_drain(event_ring_t* ring) {
+    uint32_t tail = ring->tail;
+    while (tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+        uint8_t id = ring->ids[tail & (EVENT_RING_SIZE - 1)];
+        __atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+        /* Cleared before the handler runs, so an event that arrives
+         * during it is queued again rather than lost */
+        __atomic_fetch_and(&event_pending[id >> 5], ~(1u << (id & 31)), __ATOMIC_ACQ_REL);
+        void (*handler)(void) = event_handlers[id];
+        if (handler) handler();
+        if (event_oneshot[id]) rb_event_source_free(id);
+    }
+}
+
+static void event_task_main(void* arg) {
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        event_drain(&gpio_ring);
+        event_drain(&timer_ring);
+    }
+}
+
+static void event_start(void) {
+    if (event_task) return;
+    if (xTaskCreate(event_task_main, "rb_events", EVENT_TASK_STACK, NULL,
+                    EVENT_TASK_PRIORITY, &event_task) != pdPASS) {
+        rb_panic("event dispatcher task could not be created");
+    }
+}
 
 static void IRAM_ATTR gpio_isr_handler(void* arg) {
-    int pin = (int)(intptr_t)arg;
-    if (pin >= 0 && pin < 40 && gpio_handlers[pin]) {
-        gpio_handlers[pin]();
+    uint8_t id = (uint8_t)(intptr_t)arg;
+    if (event_push(&gpio_ring, id)) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(event_task, &woken);
+        portYIELD_FROM_ISR(woken);
     }
 }
 
 void rb_on_gpio_change(int32_t pin, void (*handler)(void)) {
-    if (pin >= 0 && pin < 40) {
-        gpio_handlers[pin] = handler;
+    if (pin >= 0 && pin < EVENT_GPIO_MAX) {
+        event_start();
+        event_handlers[pin] = handler;
         gpio_install_isr_service(0);
         gpio_isr_handler_add((gpio_num_t)pin, gpio_isr_handler, (void*)(intptr_t)pin);
         gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_ANYEDGE);
     }
 }
 
-static void timer_callback(void* arg) {
-    void (*handler)(void) = (void (*)(void))arg;
-    if (handler) handler();
+int32_t rb_event_source_alloc(void (*handler)(void), int32_t oneshot) {
+    if (!handler) return -1;
+    event_start();
+    int32_t id = -1;
+    _lock_acquire(&event_alloc_lock);
+    for (int32_t i = EVENT_GPIO_MAX; i < EVENT_SOURCES && id < 0; i++) {
+        if (!event_handlers[i]) id = i;
+    }
+    if (id >= 0) {
+        event_oneshot[id] = oneshot != 0;
+        event_handlers[id] = handler;
+    }
+    _lock_release(&event_alloc_lock);
+    return id;
 }
 
-void rb_on_timer(int32_t interval_ms, void (*handler)(void)) {
-    esp_timer_create_args_t timer_args = {
-        .callback = timer_callback,
-        .arg = (void*)handler,
-        .name = "rb_timer"
-    };
-    esp_timer_handle_t timer;
-    esp_timer_create(&timer_args, &timer);
-    esp_timer_start_periodic(timer, (uint64_t)interval_ms * 1000);
+void rb_event_source_free(int32_t id) {
+    if (id < EVENT_GPIO_MAX || id >= EVENT_SOURCES) return;
+    _lock_acquire(&event_alloc_lock);
+    event_handlers[id] = NULL;
+    event_oneshot[id] = 0;
+    _lock_release(&event_alloc_lock);
 }
 
-void rb_on_mqtt_message(void (*handler)(void)) {
-    /* Registered in MQTT event loop — stub for now */
-    (void)handler;
-    printf("[EVENT] MQTT message handler registered\n");
+/* Only ever called from the esp_timer task, the timer ring's one producer */
+void rb_event_raise(int32_t id) {
+    if (id < EVENT_GPIO_MAX || id >= EVENT_SOURCES) return;
+    if (event_push(&timer_ring, (uint8_t)id)) xTaskNotifyGive(event_task);
 }
 
 #else
@@ -53,15 +167,33 @@ void rb_on_gpio_change(int32_t pin, void (*handler)(void)) {
     printf("[HOST STUB] ON GPIO.CHANGE %d registered\n", pin);
 }
 
-void rb_on_timer(int32_t interval_ms, void (*handler)(void)) {
-    (void)interval_ms;
-    (void)handler;
-    printf("[HOST STUB] ON TIMER %d ms registered\n", interval_ms);
+/* Without interrupts or an esp_timer task there is nothing to defer:
+ * host timer sources run their handler as soon as they fire */
+static void (*event_handlers[EVENT_SOURCES])(void);
+static uint8_t event_oneshot[EVENT_SOURCES];
+
+int32_t rb_event_source_alloc(void (*handler)(void), int32_t oneshot) {
+    if (!handler) return -1;
+    for (int32_t i = EVENT_GPIO_MAX; i < EVENT_SOURCES; i++) {
+        if (!event_handlers[i]) {
+            event_handlers[i] = handler;
+            event_oneshot[i] = oneshot != 0;
+            return i;
+        }
+    }
+    return -1;
 }
 
-void rb_on_mqtt_message(void (*handler)(void)) {
-    (void)handler;
-    printf("[HOST STUB] ON MQTT.MESSAGE registered\n");
+void rb_event_source_free(int32_t id) {
+    if (id < EVENT_GPIO_MAX || id >= EVENT_SOURCES) return;
+    event_handlers[id] = NULL;
+    event_oneshot[id] = 0;
+}
+
+void rb_event_raise(int32_t id) {
+    if (id < EVENT_GPIO_MAX || id >= EVENT_SOURCES || !event_handlers[id]) return;
+    event_handlers[id]();
+    if (event_oneshot[id]) rb_event_source_free(id);
 }
 
 #endif
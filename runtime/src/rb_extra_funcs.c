@@ -4,22 +4,12 @@
 #include <stdio.h>
 #include <time.h>
 
-/* ── RANDOMIZE seed ──────────────────────────────────── */
-
-void rb_randomize(int32_t seed) {
-    srand((unsigned int)seed);
-}
-
 /* ── STRING$(n, code) → ptr ──────────────────────────── */
 
 rb_string_t* rb_fn_string_s(int32_t n, int32_t char_code) {
     if (n <= 0) return rb_string_alloc("");
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + n + 1);
-    if (!result) rb_panic("out of memory in STRING$");
-    result->refcount = 1;
-    result->length = n;
+    rb_string_t* result = rb_string_new(n);
     memset(result->data, (char)(unsigned char)char_code, n);
-    result->data[n] = '\0';
     return result;
 }
 
@@ -32,7 +22,7 @@ rb_string_t* rb_fn_space_s(int32_t n) {
 /* ── PRINT USING format$, value ──────────────────────── */
 
 void rb_print_using_float(rb_string_t* fmt, float value) {
-    if (!fmt) { printf("%g", (double)value); return; }
+    if (!fmt) { rb_print_float(value); return; }
 
     /* Count # and . in format to determine width and decimals */
     int32_t total_hashes = 0;
@@ -54,11 +44,10 @@ void rb_print_using_float(rb_string_t* fmt, float value) {
     }
 
     int32_t width = total_hashes + (dot_pos >= 0 ? 1 : 0);
-    if (decimals >= 0) {
-        printf("%*.*f", (int)width, (int)decimals, (double)value);
-    } else {
-        printf("%*g", (int)width, (double)value);
-    }
+    char buf[RB_FMT_FIXED_MAX];
+    int n = decimals >= 0 ? rb_fmt_fixed(buf, value, decimals) : rb_fmt_float(buf, value);
+    for (int32_t i = n; i < width; i++) rb_console_write(" ", 1);
+    rb_console_write(buf, n);
 }
 
 void rb_print_using_int(rb_string_t* fmt, int32_t value) {
@@ -72,14 +61,12 @@ void rb_print_using_string(rb_string_t* fmt, rb_string_t* value) {
     int32_t width = fmt->length;
     if (value->length >= width) {
         /* Truncate to width */
-        for (int32_t i = 0; i < width; i++) {
-            putchar(value->data[i]);
-        }
+        rb_console_write(value->data, width);
     } else {
         /* Pad with spaces */
-        printf("%s", value->data);
+        rb_console_write(value->data, value->length);
         for (int32_t i = value->length; i < width; i++) {
-            putchar(' ');
+            rb_console_write(" ", 1);
         }
     }
 }
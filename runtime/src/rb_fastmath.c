@@ -0,0 +1,168 @@
+#include "rb_runtime.h"
+#include <math.h>
+#include <string.h>
+
+/* ── Fast SIN, COS, EXP, LOG (--fast-math) ───────────────
+ *
+ * The C3 has no FPU: each float add or multiply is a soft-float call, and
+ * newlib's sinf/expf/logf spend many of them on careful range reduction
+ * and long polynomials. With --fast-math the compiler calls these instead.
+ * Each splits its argument into one of 64 table points plus a small
+ * remainder, which a polynomial of degree 2 to 4 covers.
+ *
+ * Largest error against the exact result, measured over every float in the
+ * fast range (runtime/test/test_fastmath.c checks them on a sweep):
+ *   SIN, COS  |x| <= 4096       1.41e-7 absolute
+ *   EXP       -87 < x < 88      1.91e-7 relative
+ *   LOG       normal x > 0      1.52e-7 relative
+ * That is 2-3 ulp, where newlib stays within 1. Other arguments (and NaN,
+ * infinities, denormals, zero and negatives for LOG) go to newlib.
+ */
+
+/* sin(2*pi*i/64); cos is the same table a quarter turn on */
+static const float fm_sin[64] = {
+    0.0f, 0.09801714f, 0.19509032f, 0.29028466f, 0.38268343f, 0.47139674f,
+    0.55557024f, 0.6343933f, 0.70710677f, 0.77301043f, 0.8314696f, 0.8819213f,
+    0.9238795f, 0.95694035f, 0.98078525f, 0.9951847f, 1.0f, 0.9951847f,
+    0.98078525f, 0.95694035f, 0.9238795f, 0.8819213f, 0.8314696f, 0.77301043f,
+    0.70710677f, 0.6343933f, 0.55557024f, 0.47139674f, 0.38268343f, 0.29028466f,
+    0.19509032f, 0.09801714f, 0.0f, -0.09801714f, -0.19509032f, -0.29028466f,
+    -0.38268343f, -0.47139674f, -0.55557024f, -0.6343933f, -0.70710677f, -0.77301043f,
+    -0.8314696f, -0.8819213f, -0.9238795f, -0.95694035f, -0.98078525f, -0.9951847f,
+    -1.0f, -0.9951847f, -0.98078525f, -0.95694035f, -0.9238795f, -0.8819213f,
+    -0.8314696f, -0.77301043f, -0.70710677f, -0.6343933f, -0.55557024f, -0.47139674f,
+    -0.38268343f, -0.29028466f, -0.19509032f, -0.09801714f,
+};
+
+/* 2^(i/64) */
+static const float fm_exp2[64] = {
+    1.0f, 1.0108893f, 1.0218972f, 1.0330249f, 1.0442737f, 1.0556452f,
+    1.0671405f, 1.0787607f, 1.0905077f, 1.1023825f, 1.1143868f, 1.1265216f,
+    1.1387886f, 1.1511892f, 1.1637249f, 1.176397f, 1.1892071f, 1.2021568f,
+    1.2152474f, 1.2284806f, 1.2418578f, 1.2553807f, 1.269051f, 1.28287f,
+    1.2968396f, 1.3109612f, 1.3252367f, 1.3396676f, 1.3542556f, 1.3690025f,
+    1.38391f, 1.3989797f, 1.4142135f, 1.4296134f, 1.4451808f, 1.4609178f,
+    1.4768262f, 1.4929078f, 1.5091645f, 1.5255982f, 1.5422108f, 1.5590044f,
+    1.5759809f, 1.5931422f, 1.6104903f, 1.6280274f, 1.6457555f, 1.6636766f,
+    1.6817929f, 1.7001064f, 1.7186193f, 1.7373339f, 1.7562522f, 1.7753764f,
+    1.7947091f, 1.8142521f, 1.8340081f, 1.8539791f, 1.8741677f, 1.894576f,
+    1.9152066f, 1.9360617f, 1.9571441f, 1.978456f,
+};
+
+/* For c = 1 + (i + 0.5)/64: 1/c, and log(c) as a float plus the part
+ * rounded off it (below 1 the result is log(c) - ln2, which cancels) */
+static const float fm_invc[64] = {
+    0.99224806f, 0.97709924f, 0.96240604f, 0.94814813f, 0.93430656f, 0.92086333f,
+    0.9078014f, 0.8951049f, 0.8827586f, 0.8707483f, 0.8590604f, 0.8476821f,
+    0.8366013f, 0.82580644f, 0.81528664f, 0.8050314f, 0.7950311f, 0.78527606f,
+    0.77575755f, 0.7664671f, 0.75739646f, 0.748538f, 0.7398844f, 0.73142856f,
+    0.72316384f, 0.7150838f, 0.70718235f, 0.69945353f, 0.6918919f, 0.684492f,
+    0.67724866f, 0.6701571f, 0.6632124f, 0.6564103f, 0.6497462f, 0.6432161f,
+    0.6368159f, 0.63054186f, 0.62439024f, 0.6183575f, 0.61244017f, 0.6066351f,
+    0.600939f, 0.59534883f, 0.58986175f, 0.58447486f, 0.57918555f, 0.57399106f,
+    0.5688889f, 0.5638766f, 0.558952f, 0.55411255f, 0.5493562f, 0.54468083f,
+    0.54008436f, 0.53556484f, 0.53112036f, 0.52674896f, 0.52244896f, 0.51821864f,
+    0.5140562f, 0.5099602f, 0.5059289f, 0.5019608f,
+};
+
+static const float fm_logc[64] = {
+    0.0077821403f, 0.023167059f, 0.038318865f, 0.053244516f, 0.06795066f, 0.08244367f,
+    0.09672963f, 0.11081436f, 0.12470348f, 0.13840233f, 0.15191604f, 0.16524957f,
+    0.17840765f, 0.19139485f, 0.20421554f, 0.21687394f, 0.2293741f, 0.24171993f,
+    0.25391522f, 0.26596355f, 0.27786845f, 0.2896333f, 0.30126134f, 0.3127557f,
+    0.32411948f, 0.33535555f, 0.34646678f, 0.35745588f, 0.36832556f, 0.37907836f,
+    0.38971674f, 0.40024316f, 0.41065994f, 0.4209693f, 0.43117347f, 0.44127455f,
+    0.45127463f, 0.4611757f, 0.47097972f, 0.48068854f, 0.490304f, 0.49982786f,
+    0.5092619f, 0.51860774f, 0.5278671f, 0.5370415f, 0.54613245f, 0.5551415f,
+    0.56407017f, 0.5729197f, 0.58169174f, 0.59038746f, 0.5990082f, 0.60755527f,
+    0.61602986f, 0.6244333f, 0.63276666f, 0.6410312f, 0.6492279f, 0.65735805f,
+    0.6654226f, 0.6734227f, 0.68135923f, 0.6892333f,
+};
+
+static const float fm_logc_lo[64] = {
+    1.6100356e-10f, 4.560415e-10f, -6.9906503e-10f, -1.7346591e-09f, 3.4083132e-09f, -2.2728754e-10f,
+    -2.28319e-09f, 3.5759316e-09f, -3.2924463e-09f, -5.0360454e-09f, 5.5588978e-11f, 1.6911217e-09f,
+    3.3065968e-09f, 2.3879427e-09f, -5.3280852e-11f, -5.5050804e-09f, 5.267307e-09f, 5.5230855e-09f,
+    -1.0518075e-08f, -5.885186e-09f, 1.3154986e-09f, -1.1297649e-08f, -5.0331814e-09f, 6.0778103e-09f,
+    -9.809915e-09f, -8.129597e-09f, -1.2362654e-08f, 9.471959e-09f, -1.263113e-10f, -5.4768194e-09f,
+    6.7171126e-09f, 1.0181871e-09f, -1.4065406e-08f, -1.2778508e-08f, -8.778201e-09f, 7.2675066e-09f,
+    1.0731866e-08f, 5.1593254e-09f, -5.135289e-09f, -1.2781857e-08f, -5.1799036e-09f, 7.770561e-09f,
+    -4.3571955e-09f, 2.8574195e-08f, 1.0839715e-08f, -1.9412717e-08f, -7.737253e-09f, -1.0387525e-09f,
+    -2.6872515e-08f, 2.7190021e-08f, -2.3087368e-09f, -1.6967466e-08f, -1.2906712e-08f, -1.9970466e-08f,
+    1.8626341e-08f, 8.974418e-09f, 5.54287e-09f, -2.6233213e-08f, 2.9430744e-08f, 2.2361986e-08f,
+    1.4155961e-08f, -1.899407e-08f, -6.6641124e-09f, -2.1831259e-08f,
+};
+
+static int32_t fm_round(float t) {
+    return (int32_t)(t + (t >= 0.0f ? 0.5f : -0.5f));
+}
+
+/* x = k*2pi/64 + b with |b| <= pi/64. 2pi/64 is split so that k times the
+ * first part is exact for the k the fast range allows. */
+static float fm_reduce(float x, int32_t* k) {
+    *k = fm_round(x * 10.185916f);
+    float kf = (float)*k;
+    return (x - kf * 0.09814453f) - kf * 3.0239175e-05f;
+}
+
+float rb_fn_sin_fast(float x) {
+    if (!(fabsf(x) <= 4096.0f)) return sinf(x);
+    int32_t k;
+    float b = fm_reduce(x, &k);
+    float b2 = b * b;
+    float sb = b - b * b2 * (1.0f / 6.0f);
+    float cb = 1.0f - b2 * (0.5f - b2 * (1.0f / 24.0f));
+    /* sin(a + b) = sin a cos b + cos a sin b */
+    return fm_sin[k & 63] * cb + fm_sin[(k + 16) & 63] * sb;
+}
+
+float rb_fn_cos_fast(float x) {
+    if (!(fabsf(x) <= 4096.0f)) return cosf(x);
+    int32_t k;
+    float b = fm_reduce(x, &k);
+    float b2 = b * b;
+    float sb = b - b * b2 * (1.0f / 6.0f);
+    float cb = 1.0f - b2 * (0.5f - b2 * (1.0f / 24.0f));
+    /* cos(a + b) = cos a cos b - sin a sin b */
+    return fm_sin[(k + 16) & 63] * cb - fm_sin[k & 63] * sb;
+}
+
+float rb_fn_exp_fast(float x) {
+    /* Also keeps the result a normal float */
+    if (!(x > -87.0f && x < 88.0f)) return expf(x);
+    /* x = k*ln2/64 + r, |r| <= ln2/128; e^x = 2^(k/64) * e^r */
+    int32_t k = fm_round(x * 92.33248f);
+    float kf = (float)k;
+    float r = (x - kf * 0.01083374f) + kf * 3.3155382e-06f;
+    float m = fm_exp2[k & 63] * (1.0f + r * (1.0f + r * 0.5f));
+    /* Multiply by 2^(k/64 rounded down) through the exponent field */
+    uint32_t u;
+    memcpy(&u, &m, sizeof u);
+    u += (uint32_t)(k >> 6) << 23;
+    memcpy(&m, &u, sizeof m);
+    return m;
+}
+
+float rb_fn_log_fast(float x) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof u);
+    /* Not a positive normal float: zero, negative, denormal, inf, NaN */
+    if (u - 0x00800000u >= 0x7f000000u) return logf(x);
+    float d = x - 1.0f;
+    if (fabsf(d) < 0.015625f) {
+        /* Near 1 the result is tiny; log1p(d) directly keeps it accurate */
+        return d * (1.0f - d * (0.5f - d * (1.0f / 3.0f - d * 0.25f)));
+    }
+    /* x = 2^e * m, m in [1, 2); m = c * (1 + z) with c from the table */
+    int32_t e = (int32_t)(u >> 23) - 127;
+    uint32_t i = (u >> 17) & 63;
+    uint32_t mu = (u & 0x007fffffu) | 0x3f800000u;
+    float m;
+    memcpy(&m, &mu, sizeof m);
+    float c = 1.0f + ((float)i + 0.5f) * (1.0f / 64.0f);
+    float z = (m - c) * fm_invc[i];
+    float p = z * (1.0f - z * (0.5f - z * (1.0f / 3.0f)));
+    /* ln2 split so that e times the first part is exact */
+    float ef = (float)e;
+    return (ef * 0.69314575f + fm_logc[i]) + (p + (fm_logc_lo[i] + ef * 1.4286068e-06f));
+}
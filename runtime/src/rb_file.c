@@ -1,5 +1,6 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -10,48 +11,180 @@
 #define FS_PREFIX "./data"
 #endif
 
-static FILE* current_file = NULL;
+/* FILE.READ$ without a byte count reads up to this much */
+#define FILE_READ_DEFAULT 1024
+/* Per-handle read buffer, allocated on the first buffered read */
+#define FILE_BUF_SIZE 1024
 
-void rb_file_open(rb_string_t* path, rb_string_t* mode) {
-    if (current_file) fclose(current_file);
-    char fullpath[256];
-    snprintf(fullpath, sizeof(fullpath), "%s/%s", FS_PREFIX, path->data);
-    current_file = fopen(fullpath, mode->data);
-    if (!current_file) {
+/* ── File handles ─────────────────────────────────────────
+ *
+ * Handle 0 is the file FILE.OPEN opens without a handle variable and
+ * RB_FH_SD the one SD.OPEN does; statements without a handle act on
+ * those, as before. FILE.OPEN / SD.OPEN with a handle variable take any
+ * free slot, so several files can be open at once.
+ *
+ * FILE.READLINE$ and FILE.EOF read through a buffer of their own, so
+ * scanning a log costs one fread per FILE_BUF_SIZE bytes however short the
+ * lines are. Plain reads drain that buffer first, and a write discards it
+ * (seeking back over what was buffered but not consumed).
+ */
+
+typedef struct {
+    FILE* f;
+    char* buf;
+    int32_t pos;    /* next unread byte in buf */
+    int32_t len;    /* bytes in buf */
+} rb_fh_t;
+
+static rb_fh_t file_handles[RB_FH_MAX];
+
+static rb_fh_t* fh_get(int32_t h) {
+    if (h < 0 || h >= RB_FH_MAX || !file_handles[h].f) return NULL;
+    return &file_handles[h];
+}
+
+void rb_fh_close(int32_t h) {
+    rb_fh_t* fh = fh_get(h);
+    if (!fh) return;
+    fclose(fh->f);
+    free(fh->buf);
+    memset(fh, 0, sizeof(*fh));
+}
+
+int32_t rb_fh_open(int32_t h, const char* fullpath, const char* mode) {
+    if (h < 0) {
+        for (int32_t i = RB_FH_FIRST_FREE; i < RB_FH_MAX && h < 0; i++) {
+            if (!file_handles[i].f) h = i;
+        }
+        if (h < 0) {
+            fprintf(stderr, "[FILE] %d files already open, cannot open %s\n",
+                    RB_FH_MAX - RB_FH_FIRST_FREE, fullpath);
+            return -1;
+        }
+    } else {
+        rb_fh_close(h);
+    }
+    FILE* f = fopen(fullpath, mode);
+    if (!f) {
         printf("[FILE] failed to open %s\n", fullpath);
+        return -1;
     }
+    file_handles[h].f = f;
+    return h;
 }
 
-void rb_file_write(rb_string_t* data) {
-    if (current_file) {
-        fwrite(data->data, 1, data->length, current_file);
+/* Drop unread buffered bytes so the stream position matches what the
+ * program has consumed */
+static void fh_unbuffer(rb_fh_t* fh) {
+    if (fh->len > fh->pos) fseek(fh->f, -(long)(fh->len - fh->pos), SEEK_CUR);
+    fh->pos = fh->len = 0;
+}
+
+static int fh_fill(rb_fh_t* fh) {
+    if (!fh->buf) {
+        fh->buf = (char*)malloc(FILE_BUF_SIZE);
+        if (!fh->buf) rb_panic("out of memory in FILE.READLINE$");
+    }
+    fh->pos = 0;
+    fh->len = (int32_t)fread(fh->buf, 1, FILE_BUF_SIZE, fh->f);
+    return fh->len > 0;
+}
+
+void rb_fh_write(int32_t h, rb_string_t* data) {
+    rb_fh_t* fh = fh_get(h);
+    if (!fh || !data) return;
+    fh_unbuffer(fh);
+    fwrite(data->data, 1, data->length, fh->f);
+}
+
+/* Reads go straight into the result, so binary data survives intact */
+rb_string_t* rb_fh_read(int32_t h, int32_t max) {
+    rb_fh_t* fh = fh_get(h);
+    if (!fh || max <= 0) return rb_string_alloc("");
+    rb_string_t* s = rb_string_new(max);
+    int32_t n = fh->len - fh->pos;
+    if (n > max) n = max;
+    if (n > 0) {
+        memcpy(s->data, fh->buf + fh->pos, (size_t)n);
+        fh->pos += n;
     }
+    if (n < max) n += (int32_t)fread(s->data + n, 1, (size_t)(max - n), fh->f);
+    return rb_string_fit(s, n);
+}
+
+rb_string_t* rb_fh_readline(int32_t h) {
+    rb_fh_t* fh = fh_get(h);
+    if (!fh) return rb_string_alloc("");
+    rb_string_t* line = NULL;
+    for (;;) {
+        if (fh->pos >= fh->len && !fh_fill(fh)) break;
+        const char* start = fh->buf + fh->pos;
+        const char* nl = memchr(start, '\n', (size_t)(fh->len - fh->pos));
+        int32_t n = nl ? (int32_t)(nl - start) : fh->len - fh->pos;
+        line = rb_string_append_bytes(line, start, n);
+        fh->pos += n;
+        if (nl) {
+            fh->pos++;
+            break;
+        }
+    }
+    if (!line) return rb_string_alloc("");
+    /* CRLF line endings */
+    if (line->length > 0 && line->data[line->length - 1] == '\r') {
+        line->length--;
+        line->data[line->length] = '\0';
+    }
+    return line;
+}
+
+int32_t rb_fh_eof(int32_t h) {
+    rb_fh_t* fh = fh_get(h);
+    if (!fh) return -1;
+    if (fh->pos < fh->len) return 0;
+    return fh_fill(fh) ? 0 : -1;
+}
+
+static void file_full_path(rb_string_t* path, char* out, size_t size) {
+    snprintf(out, size, "%s/%s", FS_PREFIX, rb_string_cstr(path));
+}
+
+int32_t rb_file_open_handle(rb_string_t* path, rb_string_t* mode) {
+    char fullpath[256];
+    file_full_path(path, fullpath, sizeof(fullpath));
+    return rb_fh_open(-1, fullpath, rb_string_cstr(mode));
+}
+
+void rb_file_open(rb_string_t* path, rb_string_t* mode) {
+    char fullpath[256];
+    file_full_path(path, fullpath, sizeof(fullpath));
+    rb_fh_open(RB_FH_FILE, fullpath, rb_string_cstr(mode));
+}
+
+void rb_file_write(rb_string_t* data) {
+    rb_fh_write(RB_FH_FILE, data);
+}
+
+rb_string_t* rb_file_read_n(int32_t max) {
+    return rb_fh_read(RB_FH_FILE, max);
 }
 
 rb_string_t* rb_file_read(void) {
-    if (!current_file) return rb_string_alloc("");
-    char buf[1024];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, current_file);
-    buf[n] = '\0';
-    return rb_string_alloc(buf);
+    return rb_fh_read(RB_FH_FILE, FILE_READ_DEFAULT);
 }
 
 void rb_file_close(void) {
-    if (current_file) {
-        fclose(current_file);
-        current_file = NULL;
-    }
+    rb_fh_close(RB_FH_FILE);
 }
 
 void rb_file_delete(rb_string_t* path) {
     char fullpath[256];
-    snprintf(fullpath, sizeof(fullpath), "%s/%s", FS_PREFIX, path->data);
+    file_full_path(path, fullpath, sizeof(fullpath));
     remove(fullpath);
 }
 
 int32_t rb_file_exists(rb_string_t* path) {
     char fullpath[256];
-    snprintf(fullpath, sizeof(fullpath), "%s/%s", FS_PREFIX, path->data);
+    file_full_path(path, fullpath, sizeof(fullpath));
     struct stat st;
     return (stat(fullpath, &st) == 0) ? -1 : 0;
 }
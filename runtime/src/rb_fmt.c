@@ -0,0 +1,358 @@
+#include "rb_runtime.h"
+#include <stdio.h>
+#include <string.h>
+
+/* ── Number formatting ────────────────────────────────────
+ *
+ * PRINT, STR$, SB.APPEND and JSON format numbers here instead of through
+ * printf: newlib's vfprintf is slow, needs well over a kilobyte of stack,
+ * and a telemetry loop can spend most of its time in it. Each formatter
+ * writes into a caller's buffer and returns the length; nothing is
+ * NUL-terminated.
+ *
+ * Integers go two digits at a time through a table. Floats are printed
+ * with the fewest digits that read back as the same float (Ryu, specialised
+ * for 32-bit floats: the exact decimal interval of the value is computed
+ * with 64-bit multiplies by precomputed powers of five, and digits are
+ * dropped while the interval still determines the float). The layout
+ * follows %g: plain digits from 1e-4 up to 1e9, exponent form outside that.
+ */
+
+static const char FMT_DIGITS[200] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+/* v as exactly `len` digits, zero-padded, into buf[0..len) */
+static void fmt_digits(char* buf, int len, uint32_t v) {
+    char* p = buf + len;
+    while (v >= 100) {
+        uint32_t r = (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        memcpy(p, FMT_DIGITS + r, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, FMT_DIGITS + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    while (p > buf) *--p = '0';
+}
+
+static int fmt_digit_count(uint32_t v) {
+    int n = 1;
+    while (v >= 100) { v /= 100; n += 2; }
+    return n + (v >= 10);
+}
+
+int rb_fmt_uint(char* buf, uint32_t value) {
+    int n = fmt_digit_count(value);
+    fmt_digits(buf, n, value);
+    return n;
+}
+
+int rb_fmt_int(char* buf, int32_t value) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + rb_fmt_uint(buf + 1, 0u - (uint32_t)value);
+    }
+    return rb_fmt_uint(buf, (uint32_t)value);
+}
+
+/* ── Shortest float digits ── */
+
+#define FMT_MANTISSA_BITS 23
+#define FMT_BIAS 127
+#define FMT_POW5_INV_BITCOUNT 59
+#define FMT_POW5_BITCOUNT 61
+
+/* floor(2^(pow5bits(i) - 1 + 59) / 5^i) + 1 */
+static const uint64_t FMT_POW5_INV_SPLIT[31] = {
+    576460752303423489u, 461168601842738791u, 368934881474191033u,
+    295147905179352826u, 472236648286964522u, 377789318629571618u,
+    302231454903657294u, 483570327845851670u, 386856262276681336u,
+    309485009821345069u, 495176015714152110u, 396140812571321688u,
+    316912650057057351u, 507060240091291761u, 405648192073033409u,
+    324518553658426727u, 519229685853482763u, 415383748682786211u,
+    332306998946228969u, 531691198313966350u, 425352958651173080u,
+    340282366920938464u, 544451787073501542u, 435561429658801234u,
+    348449143727040987u, 557518629963265579u, 446014903970612463u,
+    356811923176489971u, 570899077082383953u, 456719261665907162u,
+    365375409332725730u,
+};
+
+/* 5^i scaled to 61 significant bits */
+static const uint64_t FMT_POW5_SPLIT[47] = {
+    1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+    2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+    2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+    2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+    2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+    2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+    2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+    1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+    1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+    1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+    1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+    1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+    1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+    1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+    1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+    1615587133892632177u, 2019483917365790221u,
+};
+
+/* ceil(log2(5^e)), or 1 for e = 0 */
+static int32_t fmt_pow5bits(int32_t e) {
+    return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) and floor(log10(5^e)) */
+static uint32_t fmt_log10_pow2(int32_t e) {
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+static uint32_t fmt_log10_pow5(int32_t e) {
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+static int fmt_multiple_of_pow5(uint32_t v, uint32_t p) {
+    uint32_t count = 0;
+    while (v % 5 == 0) {
+        v /= 5;
+        count++;
+    }
+    return count >= p;
+}
+
+static int fmt_multiple_of_pow2(uint32_t v, uint32_t p) {
+    return (v & ((1u << p) - 1)) == 0;
+}
+
+static uint32_t fmt_mul_shift(uint32_t m, uint64_t factor, int32_t shift) {
+    uint64_t lo = (uint64_t)m * (uint32_t)factor;
+    uint64_t hi = (uint64_t)m * (uint32_t)(factor >> 32);
+    return (uint32_t)(((lo >> 32) + hi) >> (shift - 32));
+}
+
+/* Finite nonzero float with these fields -> shortest digits * 10^exp */
+static void fmt_shortest(uint32_t ieee_mantissa, uint32_t ieee_exponent, uint32_t* digits, int32_t* exp) {
+    int32_t e2;
+    uint32_t m2;
+    if (ieee_exponent == 0) {
+        e2 = 1 - FMT_BIAS - FMT_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int32_t)ieee_exponent - FMT_BIAS - FMT_MANTISSA_BITS - 2;
+        m2 = (1u << FMT_MANTISSA_BITS) | ieee_mantissa;
+    }
+    /* Round-to-even: an even mantissa owns the ends of its interval */
+    int accept_bounds = (m2 & 1) == 0;
+
+    /* The value and the midpoints to its neighbours, times 4 */
+    uint32_t mv = 4 * m2;
+    uint32_t mp = 4 * m2 + 2;
+    uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+    uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+    uint32_t vr, vp, vm;
+    int32_t e10;
+    int vm_trailing_zeros = 0;
+    int vr_trailing_zeros = 0;
+    uint32_t last_removed = 0;
+    if (e2 >= 0) {
+        uint32_t q = fmt_log10_pow2(e2);
+        e10 = (int32_t)q;
+        int32_t k = FMT_POW5_INV_BITCOUNT + fmt_pow5bits((int32_t)q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        vr = fmt_mul_shift(mv, FMT_POW5_INV_SPLIT[q], i);
+        vp = fmt_mul_shift(mp, FMT_POW5_INV_SPLIT[q], i);
+        vm = fmt_mul_shift(mm, FMT_POW5_INV_SPLIT[q], i);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            int32_t l = FMT_POW5_INV_BITCOUNT + fmt_pow5bits((int32_t)q - 1) - 1;
+            last_removed = fmt_mul_shift(mv, FMT_POW5_INV_SPLIT[q - 1], -e2 + (int32_t)q - 1 + l) % 10;
+        }
+        if (q <= 9) {
+            if (mv % 5 == 0) {
+                vr_trailing_zeros = fmt_multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = fmt_multiple_of_pow5(mm, q);
+            } else {
+                vp -= (uint32_t)fmt_multiple_of_pow5(mp, q);
+            }
+        }
+    } else {
+        uint32_t q = fmt_log10_pow5(-e2);
+        e10 = (int32_t)q + e2;
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = fmt_pow5bits(i) - FMT_POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        vr = fmt_mul_shift(mv, FMT_POW5_SPLIT[i], j);
+        vp = fmt_mul_shift(mp, FMT_POW5_SPLIT[i], j);
+        vm = fmt_mul_shift(mm, FMT_POW5_SPLIT[i], j);
+        if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+            j = (int32_t)q - 1 - (fmt_pow5bits(i + 1) - FMT_POW5_BITCOUNT);
+            last_removed = fmt_mul_shift(mv, FMT_POW5_SPLIT[i + 1], j) % 10;
+        }
+        if (q <= 1) {
+            vr_trailing_zeros = 1;
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 31) {
+            vr_trailing_zeros = fmt_multiple_of_pow2(mv, q - 1);
+        }
+    }
+
+    /* Drop digits while the interval still pins down the float */
+    int32_t removed = 0;
+    uint32_t output;
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        /* An exact tie rounds to even */
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) last_removed = 4;
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        while (vp / 10 > vm / 10) {
+            last_removed = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || last_removed >= 5);
+    }
+    *digits = output;
+    *exp = e10 + removed;
+}
+
+int rb_fmt_float(char* buf, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t ieee_mantissa = bits & ((1u << FMT_MANTISSA_BITS) - 1);
+    uint32_t ieee_exponent = (bits >> FMT_MANTISSA_BITS) & 0xFF;
+    int len = 0;
+
+    if (ieee_exponent == 0xFF && ieee_mantissa != 0) {
+        memcpy(buf, "nan", 3);
+        return 3;
+    }
+    if (bits >> 31) buf[len++] = '-';
+    if (ieee_exponent == 0xFF) {
+        memcpy(buf + len, "inf", 3);
+        return len + 3;
+    }
+    if (ieee_exponent == 0 && ieee_mantissa == 0) {
+        buf[len++] = '0';
+        return len;
+    }
+
+    uint32_t digits;
+    int32_t exp;
+    fmt_shortest(ieee_mantissa, ieee_exponent, &digits, &exp);
+    int n = fmt_digit_count(digits);
+    int32_t point = exp + n;        /* digits before the decimal point */
+    char* p = buf + len;
+
+    if (point > 9 || point < -3) {
+        /* d.ddde+XX */
+        fmt_digits(p + 1, n, digits);
+        p[0] = p[1];
+        int used = 1;
+        if (n > 1) {
+            p[1] = '.';
+            used = n + 1;
+        }
+        int32_t x = point - 1;
+        p[used++] = 'e';
+        p[used++] = x < 0 ? '-' : '+';
+        if (x < 0) x = -x;
+        if (x < 10) p[used++] = '0';
+        used += rb_fmt_uint(p + used, (uint32_t)x);
+        return len + used;
+    }
+    if (point <= 0) {
+        /* 0.000ddd */
+        p[0] = '0';
+        p[1] = '.';
+        memset(p + 2, '0', (size_t)-point);
+        fmt_digits(p + 2 - point, n, digits);
+        return len + 2 - point + n;
+    }
+    if (point >= n) {
+        /* ddd000 */
+        fmt_digits(p, n, digits);
+        memset(p + n, '0', (size_t)(point - n));
+        return len + point;
+    }
+    /* ddd.ddd */
+    fmt_digits(p + 1, n, digits);
+    memmove(p, p + 1, (size_t)point);
+    p[point] = '.';
+    return len + n + 1;
+}
+
+/* ── Fixed decimals (PRINT USING) ── */
+
+int rb_fmt_fixed(char* buf, float value, int32_t decimals) {
+    static const double scale[10] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    double v = (double)value;
+    double a = v < 0 ? -v : v;
+    if (decimals < 0) decimals = 0;
+    /* Beyond what a uint64 holds (or NaN and infinities) printf it is */
+    if (decimals > 9 || !(a * scale[decimals] < 1.8e19)) {
+        return snprintf(buf, RB_FMT_FIXED_MAX, "%.*f", (int)(decimals < 30 ? decimals : 30), v);
+    }
+    /* Halves round away from zero, as BASIC's PRINT USING does */
+    uint64_t scaled = (uint64_t)(a * scale[decimals] + 0.5);
+    uint64_t ipart = scaled, frac = 0;
+    if (decimals > 0) {
+        uint64_t s = (uint64_t)scale[decimals];
+        ipart = scaled / s;
+        frac = scaled % s;
+    }
+
+    int len = 0;
+    if (value < 0 && scaled != 0) buf[len++] = '-';
+    /* The integer part may need more than 32 bits */
+    char tmp[20];
+    int tn = 0;
+    while (ipart >= 1000000000u) {
+        uint32_t low = (uint32_t)(ipart % 1000000000u);
+        ipart /= 1000000000u;
+        fmt_digits(tmp + sizeof(tmp) - tn - 9, 9, low);
+        tn += 9;
+    }
+    int head = rb_fmt_uint(buf + len, (uint32_t)ipart);
+    len += head;
+    memcpy(buf + len, tmp + sizeof(tmp) - tn, (size_t)tn);
+    len += tn;
+    if (decimals > 0) {
+        buf[len++] = '.';
+        fmt_digits(buf + len, decimals, (uint32_t)frac);
+        len += decimals;
+    }
+    return len;
+}
@@ -5,58 +5,270 @@
 
 #ifdef ESP_PLATFORM
 #include "esp_http_client.h"
+#include <sys/lock.h>
 
-static rb_string_t* http_perform(const char* url, const char* method,
-                                  const char* post_data, int post_len) {
+/* ── Connection pool ──────────────────────────────────────
+ *
+ * Requests to the same scheme://host:port reuse one esp_http_client with
+ * keep-alive, so a polling loop pays the TCP connect (and, for HTTPS, the
+ * TLS handshake) once instead of on every request. When the server closes
+ * the connection the client reconnects on the next perform — with a saved
+ * TLS session where the IDF supports it, so the handshake is abbreviated.
+ */
+
+#define HTTP_POOL_SIZE 2
+#define HTTP_HOST_MAX 96
+
+typedef struct {
+    char host[HTTP_HOST_MAX];
+    esp_http_client_handle_t client;
+    int busy;
+    uint32_t last_used;
+} http_conn_t;
+
+static http_conn_t http_pool[HTTP_POOL_SIZE];
+static uint32_t http_clock;
+static _lock_t http_pool_lock;
+
+/* scheme://host[:port] of `url`, the key connections are pooled under */
+static void http_host_key(const char* url, char* out) {
+    const char* p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    while (*p && *p != '/' && *p != '?' && *p != '#') p++;
+    size_t n = (size_t)(p - url);
+    if (n >= HTTP_HOST_MAX) n = HTTP_HOST_MAX - 1;
+    memcpy(out, url, n);
+    out[n] = '\0';
+}
+
+/* Where a response body goes as it streams in, chunked or not: one of a
+ * growing string, a file, or a per-chunk SUB. Files and chunks only take
+ * a 2xx body; an error page fails the request instead. */
+typedef struct {
+    rb_string_t* body;
+    FILE* file;
+    void (*on_chunk)(void);
+    int32_t bytes;
+    int failed;
+} http_sink_t;
+
+static int http_status_ok(int status) {
+    return status >= 200 && status < 300;
+}
+
+static RB_THREAD_LOCAL rb_string_t* http_chunk;
+
+static esp_err_t http_event_handler(esp_http_client_event_t* evt) {
+    http_sink_t* sink = (http_sink_t*)evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_DATA || !sink || sink->failed) return ESP_OK;
+    if ((sink->file || sink->on_chunk) && !http_status_ok(esp_http_client_get_status_code(evt->client))) {
+        sink->failed = 1;
+        return ESP_OK;
+    }
+    const char* data = (const char*)evt->data;
+    int len = evt->data_len;
+    sink->bytes += len;
+    if (sink->file) {
+        if (fwrite(data, 1, (size_t)len, sink->file) != (size_t)len) sink->failed = 1;
+    } else if (sink->on_chunk) {
+        http_chunk = rb_string_new(len);
+        memcpy(http_chunk->data, data, (size_t)len);
+        sink->on_chunk();
+        rb_string_release(http_chunk);
+        http_chunk = NULL;
+    } else {
+        sink->body = rb_string_append_bytes(sink->body, data, len);
+    }
+    return ESP_OK;
+}
+
+static esp_http_client_handle_t http_client_new(const char* url, int tls) {
     esp_http_client_config_t config = {
         .url = url,
-        .method = (strcmp(method, "POST") == 0) ? HTTP_METHOD_POST : HTTP_METHOD_GET,
+        .event_handler = http_event_handler,
+        .keep_alive_enable = true,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    if (post_data && post_len > 0) {
-        esp_http_client_set_post_field(client, post_data, post_len);
-        esp_http_client_set_header(client, "Content-Type", "application/x-www-form-urlencoded");
+    if (tls) {
+        config.transport_type = HTTP_TRANSPORT_OVER_SSL;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        config.save_client_session = true;
+#endif
     }
+    return esp_http_client_init(&config);
+}
 
-    esp_err_t err = esp_http_client_perform(client);
-    rb_string_t* result;
-    if (err == ESP_OK) {
-        int len = esp_http_client_get_content_length(client);
-        if (len <= 0) len = 0;
-        char* buf = (char*)malloc(len + 1);
-        if (buf) {
-            esp_http_client_read(client, buf, len);
-            buf[len] = '\0';
-            result = rb_string_alloc(buf);
-            free(buf);
-        } else {
-            result = rb_string_alloc("");
+/* Check out a client for `url`, pooled when possible. `*slot` is the pool
+ * entry to return it to, or -1 for a one-off client. */
+static esp_http_client_handle_t http_checkout(const char* url, int tls, int* slot) {
+    char host[HTTP_HOST_MAX];
+    http_host_key(url, host);
+    esp_http_client_handle_t stale = NULL;
+    esp_http_client_handle_t client = NULL;
+
+    _lock_acquire(&http_pool_lock);
+    *slot = -1;
+    int match = -1;
+    for (int i = 0; i < HTTP_POOL_SIZE && match < 0; i++) {
+        if (http_pool[i].client && strcmp(http_pool[i].host, host) == 0) match = i;
+    }
+    if (match >= 0 && !http_pool[match].busy) {
+        http_pool[match].busy = 1;
+        client = http_pool[match].client;
+        *slot = match;
+    } else if (match < 0) {
+        /* Take a free entry, else evict the least recently used idle one */
+        for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+            http_conn_t* c = &http_pool[i];
+            if (c->busy) continue;
+            if (*slot < 0 || !c->client ||
+                (http_pool[*slot].client && c->last_used < http_pool[*slot].last_used)) {
+                *slot = i;
+            }
         }
+        if (*slot >= 0) {
+            http_conn_t* c = &http_pool[*slot];
+            stale = c->client;
+            c->client = NULL;
+            c->busy = 1;
+            strcpy(c->host, host);
+        }
+    }
+    /* Otherwise this host's connection is in use by another task: the
+     * request gets a one-off client */
+    _lock_release(&http_pool_lock);
+
+    if (stale) esp_http_client_cleanup(stale);
+    if (client) {
+        esp_http_client_set_url(client, url);
+        return client;
+    }
+    client = http_client_new(url, tls);
+    if (*slot >= 0) {
+        _lock_acquire(&http_pool_lock);
+        http_pool[*slot].client = client;
+        if (!client) http_pool[*slot].busy = 0;
+        _lock_release(&http_pool_lock);
+    }
+    return client;
+}
+
+/* Return a client; one whose request failed is closed rather than reused */
+static void http_checkin(esp_http_client_handle_t client, int slot, int ok) {
+    if (slot < 0) {
+        esp_http_client_cleanup(client);
+        return;
+    }
+    _lock_acquire(&http_pool_lock);
+    http_conn_t* c = &http_pool[slot];
+    c->busy = 0;
+    c->last_used = ++http_clock;
+    if (!ok) c->client = NULL;
+    _lock_release(&http_pool_lock);
+    if (!ok) esp_http_client_cleanup(client);
+}
+
+static int http_perform(rb_string_t* url, rb_string_t* body, const char* content_type,
+                        int32_t tls, http_sink_t* sink) {
+    int slot;
+    esp_http_client_handle_t client = http_checkout(rb_string_cstr(url), tls, &slot);
+    if (!client) return 0;
+
+    esp_http_client_set_user_data(client, sink);
+    if (content_type) {
+        esp_http_client_set_method(client, HTTP_METHOD_POST);
+        esp_http_client_set_post_field(client, body ? body->data : "", body ? body->length : 0);
+        esp_http_client_set_header(client, "Content-Type", content_type);
     } else {
-        result = rb_string_alloc("");
+        esp_http_client_set_method(client, HTTP_METHOD_GET);
+        esp_http_client_set_post_field(client, NULL, 0);
+        esp_http_client_delete_header(client, "Content-Type");
+    }
+
+    esp_err_t err = esp_http_client_perform(client);
+    esp_http_client_set_user_data(client, NULL);
+    int status = esp_http_client_get_status_code(client);
+    if (err == ESP_OK && (sink->file || sink->on_chunk) && !http_status_ok(status)) {
+        /* Also catches an error status with an empty body */
+        fprintf(stderr, "HTTP: %s returned status %d\n", rb_string_cstr(url), status);
+        sink->failed = 1;
     }
-    esp_http_client_cleanup(client);
-    return result;
+    /* A sink that stopped early leaves the rest of the body unread */
+    int ok = err == ESP_OK && !sink->failed;
+    http_checkin(client, slot, ok);
+    return ok;
+}
+
+rb_string_t* rb_http_request(rb_string_t* url, rb_string_t* body,
+                             const char* content_type, int32_t tls) {
+    http_sink_t sink = { .body = rb_string_new(0) };
+    if (!http_perform(url, body, content_type, tls, &sink)) {
+        rb_string_release(sink.body);
+        return rb_string_alloc("");
+    }
+    return sink.body;
 }
 #endif
 
 rb_string_t* rb_http_get(rb_string_t* url) {
 #ifdef ESP_PLATFORM
-    return http_perform(url ? url->data : "", "GET", NULL, 0);
+    return rb_http_request(url, NULL, NULL, 0);
 #else
-    printf("[HTTP] GET: url=%s\n", url ? url->data : "(null)");
+    printf("[HTTP] GET: url=%s\n", url ? rb_string_cstr(url) : "(null)");
     return rb_string_alloc("");
 #endif
 }
 
 rb_string_t* rb_http_post(rb_string_t* url, rb_string_t* body) {
 #ifdef ESP_PLATFORM
-    return http_perform(url ? url->data : "", "POST",
-                        body ? body->data : "", body ? body->length : 0);
+    return rb_http_request(url, body, "application/x-www-form-urlencoded", 0);
 #else
     printf("[HTTP] POST: url=%s, body=%s\n",
-           url ? url->data : "(null)", body ? body->data : "(null)");
+           url ? rb_string_cstr(url) : "(null)", body ? rb_string_cstr(body) : "(null)");
     return rb_string_alloc("");
 #endif
 }
+
+int32_t rb_http_download(rb_string_t* url, rb_string_t* path) {
+#ifdef ESP_PLATFORM
+    /* Relative paths land on LittleFS, like FILE.OPEN; "/sdcard/..." works too */
+    const char* p = rb_string_cstr(path);
+    char full[256];
+    snprintf(full, sizeof(full), p[0] == '/' ? "%s" : "/littlefs/%s", p);
+    FILE* f = fopen(full, "wb");
+    if (!f) {
+        fprintf(stderr, "HTTP.DOWNLOAD: cannot open %s\n", full);
+        return -1;
+    }
+    http_sink_t sink = { .file = f };
+    int ok = http_perform(url, NULL, NULL, 0, &sink);
+    if (fclose(f) != 0) ok = 0;
+    /* Leave no error page or partial body behind under the target name */
+    if (!ok) remove(full);
+    return ok ? sink.bytes : -1;
+#else
+    printf("[HTTP] DOWNLOAD: url=%s, path=%s\n",
+           url ? rb_string_cstr(url) : "(null)", path ? rb_string_cstr(path) : "(null)");
+    return 0;
+#endif
+}
+
+int32_t rb_http_stream(rb_string_t* url, void (*on_chunk)(void)) {
+#ifdef ESP_PLATFORM
+    http_sink_t sink = { .on_chunk = on_chunk };
+    return http_perform(url, NULL, NULL, 0, &sink) ? sink.bytes : -1;
+#else
+    (void)on_chunk;
+    printf("[HTTP] STREAM: url=%s\n", url ? rb_string_cstr(url) : "(null)");
+    return 0;
+#endif
+}
+
+rb_string_t* rb_http_chunk(void) {
+#ifdef ESP_PLATFORM
+    if (http_chunk) {
+        rb_string_retain(http_chunk);
+        return http_chunk;
+    }
+#endif
+    return rb_string_alloc("");
+}
@@ -1,8 +1,14 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
 
 #ifdef ESP_PLATFORM
 #include "driver/i2c.h"
+
+#define I2C_TIMEOUT_MS 1000
+
+/* Bus set up by I2C.SETUP */
+static i2c_port_t i2c_port = I2C_NUM_0;
 #endif
 
 void rb_i2c_setup(int32_t bus, int32_t sda, int32_t scl, int32_t freq) {
@@ -15,8 +21,9 @@ void rb_i2c_setup(int32_t bus, int32_t sda, int32_t scl, int32_t freq) {
         .scl_pullup_en = GPIO_PULLUP_ENABLE,
         .master.clk_speed = freq,
     };
-    i2c_param_config((i2c_port_t)bus, &conf);
-    i2c_driver_install((i2c_port_t)bus, conf.mode, 0, 0, 0);
+    i2c_port = (i2c_port_t)bus;
+    i2c_param_config(i2c_port, &conf);
+    i2c_driver_install(i2c_port, conf.mode, 0, 0, 0);
 #else
     printf("[I2C] setup: bus=%d, sda=%d, scl=%d, freq=%d\n",
            (int)bus, (int)sda, (int)scl, (int)freq);
@@ -26,8 +33,8 @@ void rb_i2c_setup(int32_t bus, int32_t sda, int32_t scl, int32_t freq) {
 void rb_i2c_write(int32_t addr, int32_t data) {
 #ifdef ESP_PLATFORM
     uint8_t buf[1] = { (uint8_t)data };
-    i2c_master_write_to_device(I2C_NUM_0, (uint8_t)addr, buf, 1,
-                                1000 / portTICK_PERIOD_MS);
+    i2c_master_write_to_device(i2c_port, (uint8_t)addr, buf, 1,
+                                I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
 #else
     printf("[I2C] write: addr=0x%02x, data=0x%02x\n", (int)addr, (int)data);
 #endif
@@ -36,12 +43,65 @@ void rb_i2c_write(int32_t addr, int32_t data) {
 int32_t rb_i2c_read(int32_t addr, int32_t length) {
 #ifdef ESP_PLATFORM
     uint8_t buf[1] = {0};
-    i2c_master_read_from_device(I2C_NUM_0, (uint8_t)addr, buf,
+    i2c_master_read_from_device(i2c_port, (uint8_t)addr, buf,
                                  (length > 0) ? 1 : 0,
-                                 1000 / portTICK_PERIOD_MS);
+                                 I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
     return (int32_t)buf[0];
 #else
     printf("[I2C] read: addr=0x%02x, length=%d\n", (int)addr, (int)length);
     return 0;
 #endif
 }
+
+/* ── Multi-byte transfers: one START ... STOP for the whole buffer ── */
+
+void rb_i2c_send(int32_t addr, rb_string_t* data) {
+    if (!data || data->length == 0) return;
+#ifdef ESP_PLATFORM
+    i2c_master_write_to_device(i2c_port, (uint8_t)addr, (const uint8_t*)data->data,
+                               (size_t)data->length, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+#else
+    printf("[I2C] send: addr=0x%02x, %d bytes\n", (int)addr, (int)data->length);
+#endif
+}
+
+int rb_i2c_write_bytes(int32_t addr, const uint8_t* data, size_t len) {
+#ifdef ESP_PLATFORM
+    return i2c_master_write_to_device(i2c_port, (uint8_t)addr, data, len,
+                                      I2C_TIMEOUT_MS / portTICK_PERIOD_MS) == ESP_OK ? 0 : -1;
+#else
+    (void)addr;
+    (void)data;
+    (void)len;
+    return 0;
+#endif
+}
+
+/* Read `n` bytes, after writing `tx` with a repeated START when it is not
+ * empty (register-addressed access). "" if the device does not answer. */
+rb_string_t* rb_i2c_write_read(int32_t addr, rb_string_t* tx, int32_t n) {
+    if (n <= 0) return rb_string_alloc("");
+    rb_string_t* rx = rb_string_new(n);
+#ifdef ESP_PLATFORM
+    esp_err_t err;
+    if (tx && tx->length > 0) {
+        err = i2c_master_write_read_device(i2c_port, (uint8_t)addr,
+                                           (const uint8_t*)tx->data, (size_t)tx->length,
+                                           (uint8_t*)rx->data, (size_t)n,
+                                           I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+    } else {
+        err = i2c_master_read_from_device(i2c_port, (uint8_t)addr, (uint8_t*)rx->data,
+                                          (size_t)n, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+    }
+    if (err != ESP_OK) return rb_string_fit(rx, 0);
+#else
+    memset(rx->data, 0, (size_t)n);
+    printf("[I2C] read: addr=0x%02x, write %d bytes, read %d bytes\n",
+           (int)addr, tx ? (int)tx->length : 0, (int)n);
+#endif
+    return rx;
+}
+
+rb_string_t* rb_i2c_read_str(int32_t addr, int32_t n) {
+    return rb_i2c_write_read(addr, NULL, n);
+}
@@ -2,40 +2,191 @@
 #include <stdio.h>
 #include <string.h>
 
+/* ── I2S streams ──────────────────────────────────────────
+ *
+ * I2S.WRITE does not wait for the DAC: it copies into a queue that a feeder
+ * task drains into the driver's DMA descriptor pool, so playback carries on
+ * while BASIC does other work and I2S.WRITE only blocks once the queue is
+ * full. ON I2S.NEED GOSUB sub has the feeder call the SUB whenever the
+ * queue drops below half, so a player can produce audio on demand instead
+ * of polling. If the queue runs dry the DMA plays silence rather than
+ * repeating the last buffer.
+ *
+ * With a DIN pin (I2S.PINS) the same port also captures: the RX channel
+ * fills its own DMA pool continuously, and I2S.READ$ takes samples out of
+ * it, waiting only until the requested number have arrived.
+ */
+
 #ifdef ESP_PLATFORM
 #include "driver/i2s_std.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
+#include <sys/lock.h>
+
+#define I2S_DMA_DESCS 6
+#define I2S_DMA_FRAMES 240
+#define I2S_QUEUE_SIZE 8192
+#define I2S_CHUNK 1024
+/* How long the feeder sleeps on an empty queue before asking again */
+#define I2S_IDLE_MS 20
+#define I2S_FEEDER_STACK 4096
+#define I2S_FEEDER_PRIORITY 6
+
+#if CONFIG_IDF_TARGET_ESP32
+static int32_t i2s_pin_bclk = 26, i2s_pin_ws = 25, i2s_pin_dout = 22;
+#else
+static int32_t i2s_pin_bclk = 4, i2s_pin_ws = 5, i2s_pin_dout = 6;
+#endif
+static int32_t i2s_pin_din = -1;
 
 static i2s_chan_handle_t i2s_tx_handle = NULL;
+static i2s_chan_handle_t i2s_rx_handle = NULL;
+static StreamBufferHandle_t i2s_queue = NULL;
+static volatile TaskHandle_t i2s_feeder = NULL;
+static volatile int i2s_stopping = 0;
+static void (*volatile i2s_need_handler)(void) = NULL;
+static _lock_t i2s_write_lock;
+/* Only the feeder task touches this */
+static uint8_t i2s_chunk[I2S_CHUNK];
+
+/* Move one chunk from the queue to the DMA pool; bytes moved */
+static size_t i2s_feed(TickType_t wait) {
+    size_t n = xStreamBufferReceive(i2s_queue, i2s_chunk, sizeof(i2s_chunk), wait);
+    if (n > 0) {
+        size_t written = 0;
+        i2s_channel_write(i2s_tx_handle, i2s_chunk, n, &written, portMAX_DELAY);
+    }
+    return n;
+}
+
+static void i2s_feeder_main(void* arg) {
+    (void)arg;
+    while (!i2s_stopping) {
+        void (*handler)(void) = i2s_need_handler;
+        if (handler && xStreamBufferBytesAvailable(i2s_queue) < I2S_QUEUE_SIZE / 2) handler();
+        i2s_feed(pdMS_TO_TICKS(I2S_IDLE_MS));
+    }
+    rb_json_release_task();
+    rb_regex_release_task();
+    rb_string_pool_release_task();
+    i2s_feeder = NULL;
+    vTaskDelete(NULL);
+}
+
+void rb_i2s_pins(int32_t bclk, int32_t ws, int32_t dout, int32_t din) {
+    i2s_pin_bclk = bclk;
+    i2s_pin_ws = ws;
+    i2s_pin_dout = dout;
+    i2s_pin_din = din;
+}
 
 void rb_i2s_init(int32_t rate, int32_t bits, int32_t channels) {
+    rb_i2s_stop();
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
-    i2s_new_channel(&chan_cfg, &i2s_tx_handle, NULL);
+    chan_cfg.dma_desc_num = I2S_DMA_DESCS;
+    chan_cfg.dma_frame_num = I2S_DMA_FRAMES;
+    chan_cfg.auto_clear = true;
+    esp_err_t err = i2s_new_channel(&chan_cfg, &i2s_tx_handle, i2s_pin_din >= 0 ? &i2s_rx_handle : NULL);
+    if (err != ESP_OK) {
+        printf("[I2S] init failed: %s\n", esp_err_to_name(err));
+        i2s_tx_handle = i2s_rx_handle = NULL;
+        return;
+    }
     i2s_std_config_t std_cfg = {
         .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate),
         .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits, channels == 1 ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO),
-        .gpio_cfg = { .mclk = I2S_GPIO_UNUSED, .bclk = GPIO_NUM_26, .ws = GPIO_NUM_25, .dout = GPIO_NUM_22, .din = I2S_GPIO_UNUSED },
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = (gpio_num_t)i2s_pin_bclk,
+            .ws = (gpio_num_t)i2s_pin_ws,
+            .dout = i2s_pin_dout >= 0 ? (gpio_num_t)i2s_pin_dout : I2S_GPIO_UNUSED,
+            .din = i2s_pin_din >= 0 ? (gpio_num_t)i2s_pin_din : I2S_GPIO_UNUSED,
+        },
     };
     i2s_channel_init_std_mode(i2s_tx_handle, &std_cfg);
     i2s_channel_enable(i2s_tx_handle);
+    if (i2s_rx_handle) {
+        i2s_channel_init_std_mode(i2s_rx_handle, &std_cfg);
+        i2s_channel_enable(i2s_rx_handle);
+    }
+
+    i2s_queue = xStreamBufferCreate(I2S_QUEUE_SIZE, 1);
+    i2s_stopping = 0;
+    TaskHandle_t task = NULL;
+    if (!i2s_queue || xTaskCreate(i2s_feeder_main, "rb_i2s", I2S_FEEDER_STACK, NULL,
+                                  I2S_FEEDER_PRIORITY, &task) != pdPASS) {
+        rb_panic("I2S feeder task could not be created");
+    }
+    i2s_feeder = task;
 }
 
 void rb_i2s_write(rb_string_t* data) {
-    if (i2s_tx_handle) {
-        size_t written = 0;
-        i2s_channel_write(i2s_tx_handle, data->data, data->length, &written, portMAX_DELAY);
+    if (!i2s_tx_handle || !data || data->length <= 0) return;
+    const uint8_t* p = (const uint8_t*)data->data;
+    size_t left = (size_t)data->length;
+    /* A stream buffer takes one writer at a time, and the ON I2S.NEED
+     * handler on the feeder writes too: every send is made under the lock
+     * without blocking, so the lock is never held while waiting for room */
+    int feeder = xTaskGetCurrentTaskHandle() == i2s_feeder;
+    _lock_acquire(&i2s_write_lock);
+    while (left > 0) {
+        size_t n = xStreamBufferSend(i2s_queue, p, left, 0);
+        p += n;
+        left -= n;
+        if (left == 0) break;
+        if (feeder) {
+            /* The feeder is the one draining the queue: make room by
+             * feeding the DMA instead of waiting */
+            i2s_feed(0);
+        } else {
+            _lock_release(&i2s_write_lock);
+            vTaskDelay(1);
+            _lock_acquire(&i2s_write_lock);
+        }
     }
+    _lock_release(&i2s_write_lock);
+}
+
+rb_string_t* rb_i2s_read(int32_t n) {
+    if (n <= 0 || !i2s_rx_handle) return rb_string_alloc("");
+    rb_string_t* s = rb_string_new(n);
+    size_t got = 0;
+    i2s_channel_read(i2s_rx_handle, s->data, (size_t)n, &got, portMAX_DELAY);
+    return rb_string_fit(s, (int32_t)got);
+}
+
+void rb_on_i2s_need(void (*handler)(void)) {
+    i2s_need_handler = handler;
 }
 
 void rb_i2s_stop(void) {
+    if (i2s_feeder) {
+        i2s_stopping = 1;
+        while (i2s_feeder) rb_delay(10);
+    }
+    if (i2s_queue) {
+        vStreamBufferDelete(i2s_queue);
+        i2s_queue = NULL;
+    }
     if (i2s_tx_handle) {
         i2s_channel_disable(i2s_tx_handle);
         i2s_del_channel(i2s_tx_handle);
         i2s_tx_handle = NULL;
     }
+    if (i2s_rx_handle) {
+        i2s_channel_disable(i2s_rx_handle);
+        i2s_del_channel(i2s_rx_handle);
+        i2s_rx_handle = NULL;
+    }
 }
 
 #else
 
+void rb_i2s_pins(int32_t bclk, int32_t ws, int32_t dout, int32_t din) {
+    printf("[I2S] pins bclk=%d ws=%d dout=%d din=%d\n", bclk, ws, dout, din);
+}
+
 void rb_i2s_init(int32_t rate, int32_t bits, int32_t channels) {
     printf("[I2S] init rate=%d bits=%d channels=%d\n", rate, bits, channels);
 }
@@ -44,6 +195,19 @@ void rb_i2s_write(rb_string_t* data) {
     printf("[I2S] write %d bytes\n", data->length);
 }
 
+rb_string_t* rb_i2s_read(int32_t n) {
+    if (n <= 0) return rb_string_alloc("");
+    rb_string_t* s = rb_string_new(n);
+    memset(s->data, 0, (size_t)n);
+    printf("[I2S] read %d bytes\n", n);
+    return s;
+}
+
+void rb_on_i2s_need(void (*handler)(void)) {
+    (void)handler;
+    printf("[I2S] ON I2S.NEED registered\n");
+}
+
 void rb_i2s_stop(void) {
     printf("[I2S] stop\n");
 }
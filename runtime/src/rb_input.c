@@ -2,45 +2,36 @@
 #include <stdio.h>
 #include <string.h>
 
-int32_t rb_input_int(const char* prompt) {
-    if (prompt) {
-        printf("%s", prompt);
-    } else {
-        printf("? ");
+/* Prompt, then read one line without its newline; returns its length */
+static int32_t input_line(const char* prompt, char* buf, int32_t size) {
+    const char* text = prompt ? prompt : "? ";
+    rb_console_write(text, (int32_t)strlen(text));
+    rb_console_flush();
+    if (!fgets(buf, size, stdin)) {
+        buf[0] = '\0';
+        return 0;
+    }
+    int32_t len = (int32_t)strlen(buf);
+    if (len > 0 && buf[len - 1] == '\n') {
+        buf[--len] = '\0';
     }
-    fflush(stdout);
-    int value = 0;
-    scanf("%d", &value);
-    return (int32_t)value;
+    return len;
+}
+
+int32_t rb_input_int(const char* prompt) {
+    char buf[64];
+    int32_t len = input_line(prompt, buf, sizeof(buf));
+    return rb_scan_int(buf, len, NULL);
 }
 
 float rb_input_float(const char* prompt) {
-    if (prompt) {
-        printf("%s", prompt);
-    } else {
-        printf("? ");
-    }
-    fflush(stdout);
-    float value = 0.0f;
-    scanf("%f", &value);
-    return value;
+    char buf[64];
+    int32_t len = input_line(prompt, buf, sizeof(buf));
+    return rb_scan_float(buf, len, NULL);
 }
 
 rb_string_t* rb_input_string(const char* prompt) {
-    if (prompt) {
-        printf("%s", prompt);
-    } else {
-        printf("? ");
-    }
-    fflush(stdout);
     char buf[256];
-    if (fgets(buf, sizeof(buf), stdin)) {
-        /* Strip trailing newline */
-        size_t len = strlen(buf);
-        if (len > 0 && buf[len - 1] == '\n') {
-            buf[len - 1] = '\0';
-        }
-        return rb_string_alloc(buf);
-    }
-    return rb_string_alloc("");
+    input_line(prompt, buf, sizeof(buf));
+    return rb_string_alloc(buf);
 }
@@ -3,6 +3,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef RB_JSON_DOM_MAX
+#define RB_JSON_DOM_MAX 4096  /* larger documents bypass cJSON in JSON.GET */
+#endif
+
 #ifdef ESP_PLATFORM
 #include "cJSON.h"
 
@@ -18,7 +22,8 @@ static cJSON* json_get_by_path(cJSON* root, const char* path) {
     buf[sizeof(buf) - 1] = '\0';
 
     cJSON* cur = root;
-    char* token = strtok(buf, ".");
+    char* save;
+    char* token = strtok_r(buf, ".", &save);
     while (token && cur) {
         if (cJSON_IsArray(cur)) {
             char* end;
@@ -31,19 +36,338 @@ static cJSON* json_get_by_path(cJSON* root, const char* path) {
         } else {
             cur = cJSON_GetObjectItemCaseSensitive(cur, token);
         }
-        token = strtok(NULL, ".");
+        token = strtok_r(NULL, ".", &save);
     }
     return cur;
 }
+
+/*
+ * One-entry parse cache keyed on the rb_string_t pointer, so reading
+ * several fields out of one payload only parses it once.
+ *
+ * The cache holds a reference to the source string. That keeps the block
+ * from being freed and reused for different text, and (refcount > 1) stops
+ * rb_string_append from modifying it in place, so pointer equality implies
+ * the text is unchanged.
+ *
+ * The cache is per task, so a tree is only ever walked and deleted by the
+ * task that parsed it; TASK bodies and WEB workers reading JSON at the same
+ * time each keep their own. The source may still be referenced from other
+ * tasks, so it is marked shared. A task drops its entry as it exits.
+ */
+static RB_THREAD_LOCAL rb_string_t* cached_src = NULL;
+static RB_THREAD_LOCAL cJSON* cached_root = NULL;
+
+static cJSON* json_parse_cached(rb_string_t* json) {
+    if (json == cached_src && cached_root) return cached_root;
+
+    cJSON* root = cJSON_Parse(rb_string_cstr(json));
+    if (!root) return NULL;
+
+    if (cached_root) cJSON_Delete(cached_root);
+    rb_string_release(cached_src);
+    rb_string_share(json);
+    rb_string_retain(json);
+    cached_src = json;
+    cached_root = root;
+    return root;
+}
 #endif
 
+void rb_json_release_task(void) {
+#ifdef ESP_PLATFORM
+    if (cached_root) cJSON_Delete(cached_root);
+    rb_string_release(cached_src);
+    cached_root = NULL;
+    cached_src = NULL;
+#endif
+}
+
+/* ── Streaming path extractor ─────────────────────────────
+ *
+ * Walks the JSON text once and records where each requested dot-path
+ * value lives, without building a tree or allocating. Subtrees that no
+ * requested path reaches are skipped by bracket counting, and recursion
+ * only follows live paths, so stack use is bounded by RB_JSON_MAX_DEPTH.
+ */
+
+#define RB_JSON_MAX_DEPTH 16
+
+typedef struct {
+    const char* ptr;
+    int32_t len;
+} json_seg_t;
+
+typedef struct {
+    const char* p;
+    const char* end;
+    int32_t npaths;
+    json_seg_t segs[RB_JSON_MAX_PATHS][RB_JSON_MAX_DEPTH];
+    int32_t nsegs[RB_JSON_MAX_PATHS];
+    rb_json_slice_t* out;
+    uint32_t pending;  /* bit i set while path i is still unmatched */
+} json_scan_t;
+
+static void scan_ws(json_scan_t* st) {
+    while (st->p < st->end &&
+           (*st->p == ' ' || *st->p == '\t' || *st->p == '\n' || *st->p == '\r')) {
+        st->p++;
+    }
+}
+
+/* At an opening quote: step past the closing one. */
+static int scan_string(json_scan_t* st) {
+    st->p++;
+    while (st->p < st->end) {
+        char c = *st->p++;
+        if (c == '\\') {
+            if (st->p >= st->end) return 0;
+            st->p++;
+        } else if (c == '"') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int scan_skip_value(json_scan_t* st) {
+    scan_ws(st);
+    if (st->p >= st->end) return 0;
+    char c = *st->p;
+    if (c == '"') return scan_string(st);
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (st->p < st->end) {
+            c = *st->p;
+            if (c == '"') {
+                if (!scan_string(st)) return 0;
+                continue;
+            }
+            if (c == '{' || c == '[') depth++;
+            else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    st->p++;
+                    return 1;
+                }
+            }
+            st->p++;
+        }
+        return 0;
+    }
+    /* number, true, false, null */
+    while (st->p < st->end && *st->p != ',' && *st->p != '}' && *st->p != ']' &&
+           *st->p != ' ' && *st->p != '\t' && *st->p != '\n' && *st->p != '\r') {
+        st->p++;
+    }
+    return 1;
+}
+
+static int seg_is_index(const json_seg_t* seg, int32_t idx) {
+    if (seg->len == 0) return 0;
+    int32_t v = 0;
+    for (int32_t i = 0; i < seg->len; i++) {
+        char c = seg->ptr[i];
+        if (c < '0' || c > '9') return 0;
+        v = v * 10 + (c - '0');
+    }
+    return v == idx;
+}
+
+/* Scan one value reached by every path in `live` after `depth` segments. */
+static int scan_value(json_scan_t* st, uint32_t live, int32_t depth) {
+    scan_ws(st);
+    if (st->p >= st->end) return 0;
+    const char* start = st->p;
+
+    uint32_t deeper = 0;
+    for (int32_t i = 0; i < st->npaths; i++) {
+        if (!(live & (1u << i))) continue;
+        if (st->nsegs[i] > depth) deeper |= 1u << i;
+    }
+
+    char c = *st->p;
+    if (deeper && (c == '{' || c == '[')) {
+        st->p++;
+        int32_t index = 0;
+        for (;;) {
+            scan_ws(st);
+            if (st->p >= st->end) return 0;
+            if (*st->p == '}' || *st->p == ']') {
+                st->p++;
+                break;
+            }
+            uint32_t child = 0;
+            if (c == '{') {
+                if (*st->p != '"') return 0;
+                const char* key = st->p + 1;
+                if (!scan_string(st)) return 0;
+                int32_t key_len = (int32_t)(st->p - 1 - key);
+                for (int32_t i = 0; i < st->npaths; i++) {
+                    if (!(deeper & (1u << i))) continue;
+                    const json_seg_t* seg = &st->segs[i][depth];
+                    if (seg->len == key_len && memcmp(seg->ptr, key, key_len) == 0) {
+                        child |= 1u << i;
+                    }
+                }
+                scan_ws(st);
+                if (st->p >= st->end || *st->p != ':') return 0;
+                st->p++;
+            } else {
+                for (int32_t i = 0; i < st->npaths; i++) {
+                    if ((deeper & (1u << i)) && seg_is_index(&st->segs[i][depth], index)) {
+                        child |= 1u << i;
+                    }
+                }
+            }
+            if (!(child ? scan_value(st, child, depth + 1) : scan_skip_value(st))) return 0;
+            if (!st->pending) return 1;
+            index++;
+            scan_ws(st);
+            if (st->p < st->end && *st->p == ',') st->p++;
+        }
+    } else if (!scan_skip_value(st)) {
+        return 0;
+    }
+
+    for (int32_t i = 0; i < st->npaths; i++) {
+        if ((live & (1u << i)) && st->nsegs[i] == depth) {
+            st->out[i].ptr = start;
+            st->out[i].len = (int32_t)(st->p - start);
+            st->pending &= ~(1u << i);
+        }
+    }
+    return 1;
+}
+
+int32_t rb_json_extract(const char* text, int32_t len, const char* const* paths,
+                        int32_t npaths, rb_json_slice_t* out) {
+    if (npaths > RB_JSON_MAX_PATHS) npaths = RB_JSON_MAX_PATHS;
+    json_scan_t st;
+    st.p = text;
+    st.end = text + len;
+    st.npaths = npaths;
+    st.out = out;
+    st.pending = 0;
+    for (int32_t i = 0; i < npaths; i++) {
+        out[i].ptr = NULL;
+        out[i].len = 0;
+        const char* p = paths[i] ? paths[i] : "";
+        int32_t n = 0;
+        while (n < RB_JSON_MAX_DEPTH) {
+            const char* dot = strchr(p, '.');
+            int32_t seg_len = dot ? (int32_t)(dot - p) : (int32_t)strlen(p);
+            if (seg_len > 0) {
+                st.segs[i][n].ptr = p;
+                st.segs[i][n].len = seg_len;
+                n++;
+            }
+            if (!dot) break;
+            p = dot + 1;
+        }
+        st.nsegs[i] = n;
+        st.pending |= 1u << i;
+    }
+    if (npaths > 0) scan_value(&st, st.pending, 0);
+
+    int32_t found = 0;
+    for (int32_t i = 0; i < npaths; i++) {
+        if (out[i].ptr) found++;
+    }
+    return found;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Copy a slice into a new string, decoding it if it is a JSON string. */
+static rb_string_t* json_slice_to_string(const rb_json_slice_t* slice) {
+    if (!slice->ptr) return rb_string_alloc("");
+    if (slice->len < 2 || slice->ptr[0] != '"') {
+        rb_string_t* s = rb_string_new(slice->len);
+        memcpy(s->data, slice->ptr, slice->len);
+        return s;
+    }
+    const char* p = slice->ptr + 1;
+    const char* end = slice->ptr + slice->len - 1;
+    rb_string_t* s = rb_string_new((int32_t)(end - p));  /* decoding only shrinks */
+    char* o = s->data;
+    while (p < end) {
+        char c = *p++;
+        if (c != '\\' || p >= end) {
+            *o++ = c;
+            continue;
+        }
+        c = *p++;
+        switch (c) {
+            case 'n': *o++ = '\n'; break;
+            case 't': *o++ = '\t'; break;
+            case 'r': *o++ = '\r'; break;
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'u': {
+                uint32_t cp = 0;
+                int ok = end - p >= 4;
+                for (int i = 0; ok && i < 4; i++) {
+                    int h = hex_digit(p[i]);
+                    if (h < 0) ok = 0;
+                    cp = cp * 16 + (uint32_t)h;
+                }
+                if (!ok) { *o++ = 'u'; break; }
+                p += 4;
+                if (cp < 0x80) {
+                    *o++ = (char)cp;
+                } else if (cp < 0x800) {
+                    *o++ = (char)(0xC0 | (cp >> 6));
+                    *o++ = (char)(0x80 | (cp & 0x3F));
+                } else {
+                    *o++ = (char)(0xE0 | (cp >> 12));
+                    *o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    *o++ = (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default: *o++ = c; break;
+        }
+    }
+    s->length = (int32_t)(o - s->data);
+    s->data[s->length] = '\0';
+    return s;
+}
+
+void rb_json_extract_multi(rb_string_t* json, int32_t n, rb_string_t** paths, rb_string_t** out) {
+    if (n > RB_JSON_MAX_PATHS) n = RB_JSON_MAX_PATHS;
+    const char* cpaths[RB_JSON_MAX_PATHS];
+    rb_json_slice_t slices[RB_JSON_MAX_PATHS];
+    for (int32_t i = 0; i < n; i++) {
+        cpaths[i] = rb_string_cstr(paths[i]);
+    }
+    if (json) {
+        rb_json_extract(json->data, json->length, cpaths, n, slices);
+    } else {
+        for (int32_t i = 0; i < n; i++) slices[i].ptr = NULL;
+    }
+    for (int32_t i = 0; i < n; i++) {
+        out[i] = json_slice_to_string(&slices[i]);
+    }
+}
+
 rb_string_t* rb_json_get(rb_string_t* json, rb_string_t* key) {
 #ifdef ESP_PLATFORM
     if (!json || !key) return rb_string_alloc("");
-    cJSON* root = cJSON_Parse(json->data);
+    if (json->length > RB_JSON_DOM_MAX) {
+        /* Too big to build a cJSON tree for on this heap: stream it */
+        rb_string_t* result;
+        rb_json_extract_multi(json, 1, &key, &result);
+        return result;
+    }
+    cJSON* root = json_parse_cached(json);
     if (!root) return rb_string_alloc("");
 
-    cJSON* item = json_get_by_path(root, key->data);
+    cJSON* item = json_get_by_path(root, rb_string_cstr(key));
     rb_string_t* result;
     if (!item) {
         result = rb_string_alloc("");
@@ -54,12 +378,11 @@ rb_string_t* rb_json_get(rb_string_t* json, rb_string_t* key) {
         result = rb_string_alloc(printed ? printed : "");
         if (printed) free(printed);
     }
-    cJSON_Delete(root);
     return result;
 #else
     printf("[JSON] get: json=%s, key=%s\n",
-           json ? json->data : "(null)",
-           key ? key->data : "(null)");
+           json ? rb_string_cstr(json) : "(null)",
+           key ? rb_string_cstr(key) : "(null)");
     return rb_string_alloc("");
 #endif
 }
@@ -68,17 +391,17 @@ rb_string_t* rb_json_set(rb_string_t* json, rb_string_t* key, rb_string_t* value
 #ifdef ESP_PLATFORM
     if (!json || !key || !value) return rb_string_alloc("{}");
 
-    cJSON* root = cJSON_Parse(json->data);
+    cJSON* root = cJSON_Parse(rb_string_cstr(json));
     if (!root) root = cJSON_CreateObject();
 
     /* Try parsing value as JSON first (for numbers, objects, arrays) */
-    cJSON* val_json = cJSON_Parse(value->data);
+    cJSON* val_json = cJSON_Parse(rb_string_cstr(value));
     if (val_json) {
-        cJSON_DeleteItemFromObjectCaseSensitive(root, key->data);
-        cJSON_AddItemToObject(root, key->data, val_json);
+        cJSON_DeleteItemFromObjectCaseSensitive(root, rb_string_cstr(key));
+        cJSON_AddItemToObject(root, rb_string_cstr(key), val_json);
     } else {
-        cJSON_DeleteItemFromObjectCaseSensitive(root, key->data);
-        cJSON_AddStringToObject(root, key->data, value->data);
+        cJSON_DeleteItemFromObjectCaseSensitive(root, rb_string_cstr(key));
+        cJSON_AddStringToObject(root, rb_string_cstr(key), rb_string_cstr(value));
     }
 
     char* printed = cJSON_PrintUnformatted(root);
@@ -88,9 +411,9 @@ rb_string_t* rb_json_set(rb_string_t* json, rb_string_t* key, rb_string_t* value
     return result;
 #else
     printf("[JSON] set: json=%s, key=%s, value=%s\n",
-           json ? json->data : "(null)",
-           key ? key->data : "(null)",
-           value ? value->data : "(null)");
+           json ? rb_string_cstr(json) : "(null)",
+           key ? rb_string_cstr(key) : "(null)",
+           value ? rb_string_cstr(value) : "(null)");
     return rb_string_alloc("{}");
 #endif
 }
@@ -98,7 +421,7 @@ rb_string_t* rb_json_set(rb_string_t* json, rb_string_t* key, rb_string_t* value
 int32_t rb_json_count(rb_string_t* json) {
 #ifdef ESP_PLATFORM
     if (!json) return 0;
-    cJSON* root = cJSON_Parse(json->data);
+    cJSON* root = json_parse_cached(json);
     if (!root) return 0;
 
     int32_t count = 0;
@@ -111,10 +434,9 @@ int32_t rb_json_count(rb_string_t* json) {
             child = child->next;
         }
     }
-    cJSON_Delete(root);
     return count;
 #else
-    printf("[JSON] count: json=%s\n", json ? json->data : "(null)");
+    printf("[JSON] count: json=%s\n", json ? rb_string_cstr(json) : "(null)");
     return 0;
 #endif
 }
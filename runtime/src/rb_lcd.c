@@ -13,7 +13,7 @@ void rb_lcd_print(rb_string_t* text) {
 #ifdef ESP_PLATFORM
     (void)text;
 #else
-    fprintf(stderr, "[stub] LCD.PRINT \"%s\"\n", text ? text->data : "");
+    fprintf(stderr, "[stub] LCD.PRINT \"%s\"\n", rb_string_cstr(text));
 #endif
 }
 
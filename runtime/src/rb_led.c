@@ -3,53 +3,157 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* ── WS2812 strip ─────────────────────────────────────────
+ *
+ * Pixels live in two GRB frames. LED.SET / LED.SETALL draw into the back
+ * frame; LED.SHOW starts sending it and returns at once, and the next frame
+ * is drawn into the other buffer while this one goes out (seeded with the
+ * frame being sent, so setting a few pixels between shows still works).
+ * Only a LED.SHOW that comes before the previous frame has finished and
+ * latched waits. The RMT channel streams from the frame by DMA where the
+ * chip has it (ESP32-S3) and from its ping-pong memory otherwise, so
+ * either way the CPU is free during the transfer.
+ */
+
 #ifdef ESP_PLATFORM
-#include "led_strip.h"
+#include "driver/rmt_tx.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+
+#define LED_RESOLUTION_HZ (10 * 1000 * 1000)   /* 0.1 us ticks */
+/* Low time that latches a frame; newer WS2812B parts need 280 us */
+#define LED_RESET_US 300
 
-static led_strip_handle_t led_strip = NULL;
-static int led_count = 0;
+static rmt_channel_handle_t led_channel = NULL;
+static rmt_encoder_handle_t led_encoder = NULL;
+static uint8_t* led_frames[2];
+static int led_back = 0;
+static volatile int64_t led_sent_at = 0;    /* when the last frame finished */
 #endif
 
-void rb_led_setup(int32_t pin, int32_t count) {
+static int32_t led_count = 0;
+
 #ifdef ESP_PLATFORM
-    if (led_strip) {
-        led_strip_del(led_strip);
-        led_strip = NULL;
+static bool IRAM_ATTR led_tx_done(rmt_channel_handle_t channel,
+                                  const rmt_tx_done_event_data_t* edata,
+                                  void* user_data) {
+    (void)channel;
+    (void)edata;
+    (void)user_data;
+    led_sent_at = esp_timer_get_time();
+    return false;
+}
+
+static void led_release(void) {
+    if (led_channel) {
+        rmt_tx_wait_all_done(led_channel, -1);
+        rmt_disable(led_channel);
+        rmt_del_channel(led_channel);
+        led_channel = NULL;
     }
-    led_count = count;
-    led_strip_config_t strip_config = {
-        .strip_gpio_num = pin,
-        .max_leds = count,
-        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
-        .led_model = LED_MODEL_WS2812,
+    if (led_encoder) {
+        rmt_del_encoder(led_encoder);
+        led_encoder = NULL;
+    }
+    free(led_frames[0]);
+    free(led_frames[1]);
+    led_frames[0] = led_frames[1] = NULL;
+    led_count = 0;
+}
+#endif
+
+void rb_led_setup(int32_t pin, int32_t count) {
+#ifdef ESP_PLATFORM
+    led_release();
+    if (count <= 0) return;
+    led_frames[0] = (uint8_t*)calloc((size_t)count, 3);
+    led_frames[1] = (uint8_t*)calloc((size_t)count, 3);
+    if (!led_frames[0] || !led_frames[1]) rb_panic("out of memory in LED.SETUP");
+    led_back = 0;
+
+    rmt_tx_channel_config_t chan_cfg = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = LED_RESOLUTION_HZ,
+#if SOC_RMT_SUPPORT_DMA
+        .mem_block_symbols = 1024,
+        .flags.with_dma = true,
+#else
+        .mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL,
+#endif
+        .trans_queue_depth = 2,
+    };
+    /* WS2812 bit timing: 0 = 0.3 us high, 0.9 us low; 1 = 0.9 us high, 0.3 us low */
+    rmt_bytes_encoder_config_t enc_cfg = {
+        .bit0 = { .level0 = 1, .duration0 = 3, .level1 = 0, .duration1 = 9 },
+        .bit1 = { .level0 = 1, .duration0 = 9, .level1 = 0, .duration1 = 3 },
+        .flags.msb_first = 1,
     };
-    led_strip_rmt_config_t rmt_config = {
-        .resolution_hz = 10 * 1000 * 1000, /* 10 MHz */
-        .flags.with_dma = false,
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = led_tx_done,
     };
-    led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip);
-    led_strip_clear(led_strip);
+    esp_err_t err = rmt_new_tx_channel(&chan_cfg, &led_channel);
+    if (err == ESP_OK) err = rmt_new_bytes_encoder(&enc_cfg, &led_encoder);
+    if (err == ESP_OK) err = rmt_tx_register_event_callbacks(led_channel, &cbs, NULL);
+    if (err == ESP_OK) err = rmt_enable(led_channel);
+    if (err != ESP_OK) {
+        printf("[LED] setup failed: %s\n", esp_err_to_name(err));
+        led_release();
+        return;
+    }
+    led_count = count;
+    rb_led_show();
 #else
+    led_count = count > 0 ? count : 0;
     printf("[LED] setup: pin=%d, count=%d\n", (int)pin, (int)count);
 #endif
 }
 
 void rb_led_set(int32_t index, int32_t r, int32_t g, int32_t b) {
 #ifdef ESP_PLATFORM
-    if (led_strip) {
-        led_strip_set_pixel(led_strip, index, r, g, b);
-    }
+    if (index < 0 || index >= led_count) return;
+    uint8_t* px = led_frames[led_back] + 3 * index;
+    px[0] = (uint8_t)g;
+    px[1] = (uint8_t)r;
+    px[2] = (uint8_t)b;
 #else
     printf("[LED] set: index=%d, r=%d, g=%d, b=%d\n",
            (int)index, (int)r, (int)g, (int)b);
 #endif
 }
 
-void rb_led_show(void) {
+/* A whole frame of colors packed r * 65536 + g * 256 + b, one per LED from index 0 */
+void rb_led_set_all(const int32_t* colors, int32_t n) {
+    if (!colors || n <= 0) return;
+    if (n > led_count) n = led_count;
 #ifdef ESP_PLATFORM
-    if (led_strip) {
-        led_strip_refresh(led_strip);
+    uint8_t* px = led_frames[led_back];
+    for (int32_t i = 0; i < n; i++, px += 3) {
+        uint32_t c = (uint32_t)colors[i];
+        px[0] = (uint8_t)(c >> 8);
+        px[1] = (uint8_t)(c >> 16);
+        px[2] = (uint8_t)c;
     }
+#else
+    printf("[LED] set all: %d pixels\n", (int)n);
+#endif
+}
+
+void rb_led_show(void) {
+#ifdef ESP_PLATFORM
+    if (!led_channel) return;
+    /* The frame before must be out and latched before this one starts */
+    rmt_tx_wait_all_done(led_channel, -1);
+    int64_t idle = esp_timer_get_time() - led_sent_at;
+    if (idle < LED_RESET_US) esp_rom_delay_us((uint32_t)(LED_RESET_US - idle));
+
+    uint8_t* frame = led_frames[led_back];
+    size_t size = (size_t)led_count * 3;
+    rmt_transmit_config_t tx_cfg = { .loop_count = 0 };
+    rmt_transmit(led_channel, led_encoder, frame, size, &tx_cfg);
+    led_back ^= 1;
+    memcpy(led_frames[led_back], frame, size);
 #else
     printf("[LED] show\n");
 #endif
@@ -57,10 +161,9 @@ void rb_led_show(void) {
 
 void rb_led_clear(void) {
 #ifdef ESP_PLATFORM
-    if (led_strip) {
-        led_strip_clear(led_strip);
-        led_strip_refresh(led_strip);
-    }
+    if (!led_channel) return;
+    memset(led_frames[led_back], 0, (size_t)led_count * 3);
+    rb_led_show();
 #else
     printf("[LED] clear\n");
 #endif
@@ -0,0 +1,376 @@
+#include "rb_runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <sys/lock.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+/* ── Data logger ──────────────────────────────────────────
+ *
+ * LOG.WRITE copies a record into a RAM ring and returns; it never touches
+ * the filesystem, so acquisition cannot stall on the card. A record that
+ * does not fit in the ring is dropped and counted (LOG.DROPPED) instead.
+ *
+ * A background task drains the ring. While data keeps coming it writes
+ * only whole LOG_CLUSTER blocks aligned to the file offset, so FAT sees one
+ * cluster-sized write per cluster instead of a small write per sample;
+ * after LOG_FLUSH_MS without a full cluster it writes what is pending and
+ * syncs, so a slow logger still reaches the card.
+ *
+ * Each file is preallocated to its rotation size when created, so flushes
+ * do not grow the cluster chain, and trimmed to its real length when it is
+ * rotated or closed. Once a file reaches the size limit (cutting at a line
+ * end, so no line is split across files) it becomes path.1, path.1 becomes
+ * path.2 and so on up to the number of files kept, and a fresh file starts.
+ *
+ * Only the task touches the open file once LOG.OPEN returns; LOG.FLUSH and
+ * LOG.CLOSE are requests it carries out.
+ */
+
+#define LOG_RING_SIZE 16384     /* power of two */
+#define LOG_CLUSTER 4096
+#define LOG_FLUSH_MS 1000
+#define LOG_PATH_MAX 128
+#define LOG_KEEP_MAX 9
+#define LOG_TASK_STACK 4096
+#define LOG_TASK_PRIORITY 3
+
+enum { LOG_REQ_NONE, LOG_REQ_FLUSH, LOG_REQ_CLOSE };
+
+static char log_path[LOG_PATH_MAX];
+static FILE* log_file = NULL;
+static long log_pos;            /* bytes written to the current file */
+static long log_max;            /* rotation size */
+static int32_t log_keep;        /* rotated files kept */
+static char* log_ring = NULL;
+static uint32_t log_head, log_tail;     /* free-running; head - tail pending */
+static int32_t log_dropped;
+static int log_request = LOG_REQ_NONE;
+static int log_task_started = 0;
+
+static void log_task(void);
+
+#ifdef ESP_PLATFORM
+
+#define LOG_FS_PREFIX "/littlefs"
+
+static _lock_t log_lock_handle;
+static SemaphoreHandle_t log_wake_sem;
+static void log_lock(void) { _lock_acquire(&log_lock_handle); }
+static void log_unlock(void) { _lock_release(&log_lock_handle); }
+static void log_wake(void) { xSemaphoreGive(log_wake_sem); }
+
+/* Sleep until woken or `ms` pass; nonzero if woken */
+static int log_wait(int32_t ms) {
+    return xSemaphoreTake(log_wake_sem, pdMS_TO_TICKS(ms)) == pdTRUE;
+}
+
+static void log_task_main(void* arg) {
+    (void)arg;
+    log_task();
+}
+
+static void log_platform_start(void) {
+    log_wake_sem = xSemaphoreCreateBinary();
+    if (!log_wake_sem || xTaskCreate(log_task_main, "rb_log", LOG_TASK_STACK, NULL,
+                                     LOG_TASK_PRIORITY, NULL) != pdPASS) {
+        rb_panic("logger task could not be created");
+    }
+}
+
+#else
+
+#define LOG_FS_PREFIX "./data"
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static int log_woken = 0;
+static void log_lock(void) { pthread_mutex_lock(&log_mutex); }
+static void log_unlock(void) { pthread_mutex_unlock(&log_mutex); }
+
+/* Call with the lock held */
+static void log_wake(void) {
+    log_woken = 1;
+    pthread_cond_signal(&log_cond);
+}
+
+static int log_wait(int32_t ms) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ms / 1000;
+    until.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&log_mutex);
+    int rc = 0;
+    while (!log_woken && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&log_cond, &log_mutex, &until);
+    }
+    int woken = log_woken;
+    log_woken = 0;
+    pthread_mutex_unlock(&log_mutex);
+    return woken;
+}
+
+static void* log_task_main(void* arg) {
+    (void)arg;
+    log_task();
+    return NULL;
+}
+
+static void log_platform_start(void) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, log_task_main, NULL) != 0) {
+        rb_panic("logger task could not be created");
+    }
+    pthread_attr_destroy(&attr);
+}
+
+#endif
+
+/* ── File side (logger task, or LOG.OPEN before the file is handed over) */
+
+/* Create the current file and preallocate its clusters */
+static FILE* log_create(void) {
+    FILE* f = fopen(log_path, "wb");
+    if (!f) {
+        fprintf(stderr, "[LOG] cannot create %s\n", log_path);
+        return NULL;
+    }
+    /* The ring already batches writes into clusters */
+    setvbuf(f, NULL, _IONBF, 0);
+    if (log_max < LONG_MAX && ftruncate(fileno(f), log_max) != 0) {
+        /* Not supported here: the file just grows as it is written */
+    }
+    log_pos = 0;
+    return f;
+}
+
+/* Reopen an existing log for appending. A file that was not closed cleanly
+ * still has its preallocated length; step back over the zero padding. */
+static FILE* log_reopen(void) {
+    FILE* f = fopen(log_path, "r+b");
+    if (!f) return NULL;
+    setvbuf(f, NULL, _IONBF, 0);
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    char block[256];
+    while (end > 0) {
+        long n = end < (long)sizeof(block) ? end : (long)sizeof(block);
+        fseek(f, end - n, SEEK_SET);
+        if (fread(block, 1, (size_t)n, f) != (size_t)n) break;
+        long i = n;
+        while (i > 0 && block[i - 1] == '\0') i--;
+        end -= n - i;
+        if (i > 0) break;
+    }
+    fseek(f, end, SEEK_SET);
+    log_pos = end;
+    return f;
+}
+
+/* Cut the preallocated tail and close */
+static void log_finish(FILE* f) {
+    fflush(f);
+    if (ftruncate(fileno(f), log_pos) != 0) {
+        fprintf(stderr, "[LOG] cannot trim %s\n", log_path);
+    }
+    fclose(f);
+}
+
+static void log_numbered(char* out, int32_t n) {
+    snprintf(out, LOG_PATH_MAX + 4, "%s.%d", log_path, (int)n);
+}
+
+static FILE* log_rotate(FILE* f) {
+    log_finish(f);
+    char from[LOG_PATH_MAX + 4], to[LOG_PATH_MAX + 4];
+    if (log_keep <= 0) {
+        remove(log_path);
+    } else {
+        log_numbered(to, log_keep);
+        remove(to);
+        for (int32_t i = log_keep - 1; i >= 1; i--) {
+            log_numbered(from, i);
+            log_numbered(to, i + 1);
+            rename(from, to);
+        }
+        log_numbered(to, 1);
+        rename(log_path, to);
+    }
+    return log_create();
+}
+
+/* Write `n` bytes, rotating at a line end when the size limit is reached */
+static FILE* log_emit(FILE* f, const char* p, size_t n) {
+    while (f && n > 0) {
+        size_t room = log_pos < log_max ? (size_t)(log_max - log_pos) : 0;
+        size_t take = n;
+        int rotate = 0;
+        if (n > room) {
+            size_t cut = room;
+            while (cut > 0 && p[cut - 1] != '\n') cut--;
+            if (cut == 0) {
+                const char* nl = memchr(p + room, '\n', n - room);
+                if (nl) cut = (size_t)(nl - p) + 1;
+            }
+            if (cut > 0) {
+                take = cut;
+                rotate = 1;
+            }
+        }
+        if (fwrite(p, 1, take, f) != take) fprintf(stderr, "[LOG] write to %s failed\n", log_path);
+        log_pos += (long)take;
+        p += take;
+        n -= take;
+        if (rotate) f = log_rotate(f);
+    }
+    return f;
+}
+
+static void log_task(void) {
+    for (;;) {
+        int woken = log_wait(LOG_FLUSH_MS);
+        log_lock();
+        FILE* f = log_file;
+        uint32_t tail = log_tail;
+        uint32_t pending = log_head - tail;
+        int request = log_request;
+        log_unlock();
+        /* Between logs; LOG.OPEN owns the state until it hands a file over */
+        int had_file = f != NULL;
+
+        uint32_t n = pending;
+        if (woken && request == LOG_REQ_NONE) {
+            /* Only whole clusters while data keeps coming */
+            long end = (log_pos + (long)pending) / LOG_CLUSTER * LOG_CLUSTER;
+            n = end > log_pos ? (uint32_t)(end - log_pos) : 0;
+            if (n > pending) n = pending;
+        }
+        if (f && n > 0) {
+            uint32_t at = tail & (LOG_RING_SIZE - 1);
+            uint32_t first = n < LOG_RING_SIZE - at ? n : LOG_RING_SIZE - at;
+            f = log_emit(f, log_ring + at, first);
+            f = log_emit(f, log_ring, n - first);
+        }
+        if (f && (!woken || request != LOG_REQ_NONE) && n > 0) {
+            fflush(f);
+            fsync(fileno(f));
+        }
+        if (f && request == LOG_REQ_CLOSE) {
+            log_finish(f);
+            f = NULL;
+        }
+
+        if (!had_file) continue;
+        log_lock();
+        log_tail = tail + n;
+        log_file = f;
+        /* A request is done once everything written before it is out */
+        if (request != LOG_REQ_NONE && n == pending) log_request = LOG_REQ_NONE;
+        log_unlock();
+    }
+}
+
+/* ── BASIC side ───────────────────────────────────────── */
+
+static void log_request_and_wait(int request) {
+    log_lock();
+    int open = log_file != NULL;
+    if (open) {
+        log_request = request;
+        log_wake();
+    }
+    log_unlock();
+    while (open) {
+        rb_delay(10);
+        log_lock();
+        open = log_request != LOG_REQ_NONE;
+        /* Keep it raised in case the task woke before it was set */
+        if (open) log_wake();
+        log_unlock();
+    }
+}
+
+void rb_log_close(void) {
+    log_request_and_wait(LOG_REQ_CLOSE);
+}
+
+void rb_log_flush(void) {
+    log_request_and_wait(LOG_REQ_FLUSH);
+}
+
+void rb_log_open(rb_string_t* path, int32_t max_bytes, int32_t keep) {
+    rb_log_close();
+    const char* p = rb_string_cstr(path);
+#ifdef ESP_PLATFORM
+    /* Relative paths land on LittleFS, like FILE.OPEN; "/sdcard/..." works too */
+    snprintf(log_path, sizeof(log_path), p[0] == '/' ? "%s" : LOG_FS_PREFIX "/%s", p);
+#else
+    /* ./data stands in for both LittleFS and the card */
+    const char* slash = p[0] == '/' ? strchr(p + 1, '/') : NULL;
+    snprintf(log_path, sizeof(log_path), LOG_FS_PREFIX "/%s", slash ? slash + 1 : p);
+#endif
+    log_max = max_bytes > 0 ? max_bytes : LONG_MAX;
+    log_keep = keep < 0 ? 0 : keep > LOG_KEEP_MAX ? LOG_KEEP_MAX : keep;
+
+    FILE* f = log_reopen();
+    if (f && log_pos >= log_max) f = log_rotate(f);
+    if (!f) f = log_create();
+    if (!f) return;
+
+    if (!log_ring) {
+        log_ring = (char*)malloc(LOG_RING_SIZE);
+        if (!log_ring) rb_panic("out of memory in LOG.OPEN");
+    }
+    log_lock();
+    log_head = log_tail = 0;
+    log_dropped = 0;
+    log_file = f;
+    log_unlock();
+    if (!log_task_started) {
+        log_task_started = 1;
+        log_platform_start();
+    }
+}
+
+void rb_log_write(rb_string_t* data) {
+    if (!data || data->length == 0) return;
+    uint32_t len = (uint32_t)data->length;
+    log_lock();
+    if (!log_file || LOG_RING_SIZE - (log_head - log_tail) < len) {
+        log_dropped++;
+        log_unlock();
+        return;
+    }
+    uint32_t at = log_head & (LOG_RING_SIZE - 1);
+    uint32_t first = len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at;
+    memcpy(log_ring + at, data->data, first);
+    memcpy(log_ring, data->data + first, len - first);
+    log_head += len;
+    if (log_head - log_tail >= LOG_CLUSTER) log_wake();
+    log_unlock();
+}
+
+int32_t rb_log_dropped(void) {
+    log_lock();
+    int32_t n = log_dropped;
+    log_unlock();
+    return n;
+}
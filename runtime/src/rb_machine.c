@@ -3,86 +3,106 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_MACHINES 8
-#define MAX_STATES 16
-#define MAX_TRANSITIONS 64
+/* ── State machines ───────────────────────────────────────
+ *
+ * The compiler numbers a MACHINE's states (in declaration order) and its
+ * events, and emits the transitions as a constant num_states x num_events
+ * table of target states. Nothing is copied at startup: the machine points
+ * at that table and at the name arrays, and an event is one table load.
+ * Codegen passes the event number directly when the event is a literal;
+ * an event given as a string at run time is looked up through a small
+ * hash of the event names first.
+ */
 
-typedef struct {
-    char from_state[32];
-    char event_name[32];
-    char to_state[32];
-} rb_transition_t;
+#define MAX_MACHINES 8
 
 typedef struct {
-    char name[32];
-    char states[MAX_STATES][32];
-    int num_states;
-    rb_transition_t transitions[MAX_TRANSITIONS];
-    int num_transitions;
-    int current_state;  /* index into states[] */
+    const char* name;
+    int32_t num_states;
+    int32_t num_events;
+    const int16_t* table;           /* [state * num_events + event] -> state, -1 = none */
+    const char* const* state_names;
+    const char* const* event_names;
+    uint16_t* event_slots;          /* open addressing: event + 1, 0 = empty */
+    uint32_t slot_mask;
+    int32_t current;
 } rb_machine_t;
 
 static rb_machine_t machines[MAX_MACHINES];
 static int num_machines = 0;
 
-int32_t rb_machine_create(const char* name) {
+static uint32_t machine_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+int32_t rb_machine_create(const char* name, int32_t num_states, int32_t num_events, const int16_t* table,
+                          const char* const* state_names, const char* const* event_names) {
     if (num_machines >= MAX_MACHINES) {
         fprintf(stderr, "Too many state machines\n");
         return -1;
     }
     int handle = num_machines++;
-    memset(&machines[handle], 0, sizeof(rb_machine_t));
-    strncpy(machines[handle].name, name, 31);
-    machines[handle].current_state = 0;
-    return handle;
-}
-
-void rb_machine_add_state(int32_t handle, const char* state_name) {
-    if (handle < 0 || handle >= num_machines) return;
     rb_machine_t* m = &machines[handle];
-    if (m->num_states >= MAX_STATES) return;
-    strncpy(m->states[m->num_states], state_name, 31);
-    m->num_states++;
+    memset(m, 0, sizeof(rb_machine_t));
+    m->name = name;
+    m->num_states = num_states;
+    m->num_events = num_events;
+    m->table = table;
+    m->state_names = state_names;
+    m->event_names = event_names;
+    m->current = 0;
+
+    if (num_events > 0) {
+        uint32_t size = 8;
+        while (size < (uint32_t)num_events * 2) size <<= 1;
+        m->event_slots = (uint16_t*)calloc(size, sizeof(uint16_t));
+        if (!m->event_slots) rb_panic("out of memory creating state machine");
+        m->slot_mask = size - 1;
+        for (int32_t e = 0; e < num_events; e++) {
+            uint32_t i = machine_hash(event_names[e], strlen(event_names[e])) & m->slot_mask;
+            while (m->event_slots[i]) i = (i + 1) & m->slot_mask;
+            m->event_slots[i] = (uint16_t)(e + 1);
+        }
+    }
+    return handle;
 }
 
-void rb_machine_add_transition(int32_t handle, const char* from_state, const char* event_name, const char* to_state) {
+void rb_machine_event_id(int32_t handle, int32_t event) {
     if (handle < 0 || handle >= num_machines) return;
     rb_machine_t* m = &machines[handle];
-    if (m->num_transitions >= MAX_TRANSITIONS) return;
-    rb_transition_t* t = &m->transitions[m->num_transitions++];
-    strncpy(t->from_state, from_state, 31);
-    strncpy(t->event_name, event_name, 31);
-    strncpy(t->to_state, to_state, 31);
-}
-
-static int find_state_index(rb_machine_t* m, const char* name) {
-    for (int i = 0; i < m->num_states; i++) {
-        if (strcmp(m->states[i], name) == 0) return i;
-    }
-    return -1;
+    if (event < 0 || event >= m->num_events || m->num_states == 0) return;
+    int16_t next = m->table[m->current * m->num_events + event];
+    if (next >= 0) m->current = next;
 }
 
 void rb_machine_event(int32_t handle, rb_string_t* event) {
     if (handle < 0 || handle >= num_machines) return;
     if (!event || event->length == 0) return;
     rb_machine_t* m = &machines[handle];
-    const char* current = m->states[m->current_state];
-
-    for (int i = 0; i < m->num_transitions; i++) {
-        rb_transition_t* t = &m->transitions[i];
-        if (strcmp(t->from_state, current) == 0 && strcmp(t->event_name, event->data) == 0) {
-            int new_state = find_state_index(m, t->to_state);
-            if (new_state >= 0) {
-                m->current_state = new_state;
-                return;
-            }
+    if (!m->event_slots) return;
+    size_t len = (size_t)event->length;
+    uint32_t i = machine_hash(event->data, len) & m->slot_mask;
+    while (m->event_slots[i]) {
+        int32_t e = m->event_slots[i] - 1;
+        const char* name = m->event_names[e];
+        if (strncmp(name, event->data, len) == 0 && name[len] == '\0') {
+            rb_machine_event_id(handle, e);
+            return;
         }
+        i = (i + 1) & m->slot_mask;
     }
 }
 
+int32_t rb_machine_state(int32_t handle) {
+    if (handle < 0 || handle >= num_machines) return -1;
+    return machines[handle].current;
+}
+
 rb_string_t* rb_machine_get_state(int32_t handle) {
-    if (handle < 0 || handle >= num_machines) {
+    if (handle < 0 || handle >= num_machines || machines[handle].num_states == 0) {
         return rb_string_alloc("UNKNOWN");
     }
-    return rb_string_alloc(machines[handle].states[machines[handle].current_state]);
+    return rb_string_alloc(machines[handle].state_names[machines[handle].current]);
 }
@@ -10,6 +10,8 @@ static const char* TAG = "RustyBASIC";
 void app_main(void) {
     ESP_LOGI(TAG, "RustyBASIC program starting...");
     basic_program_entry();
+    rb_nvs_commit();
+    rb_console_flush();
     ESP_LOGI(TAG, "RustyBASIC program finished.");
 }
 
@@ -17,6 +19,8 @@ void app_main(void) {
 /* Host/testing builds */
 int main(void) {
     basic_program_entry();
+    rb_nvs_commit();
+    rb_console_flush();
     return 0;
 }
 #endif
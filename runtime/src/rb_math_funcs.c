@@ -73,11 +73,93 @@ int32_t rb_fn_sgn(float x) {
 
 /* ── RND -> f32  (random in [0, 1)) ─────────────────── */
 
+/* PCG32 (O'Neill): a 64-bit LCG whose output is permuted down to 32 bits.
+ * Each task has its own generator, so TASK bodies calling RND neither share
+ * a sequence nor contend on a lock, and RANDOMIZE seeds only the calling
+ * task's. A generator nobody seeded starts from hardware entropy. */
+
+typedef struct {
+    uint64_t state;
+    uint64_t inc;
+    int seeded;
+} rnd_state_t;
+
+static RB_THREAD_LOCAL rnd_state_t rnd;
+
+static uint32_t rnd_next(void) {
+    uint64_t old = rnd.state;
+    rnd.state = old * 6364136223846793005ULL + rnd.inc;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+}
+
+static void rnd_seed(uint64_t seed, uint64_t stream) {
+    rnd.state = 0;
+    rnd.inc = (stream << 1) | 1;
+    rnd_next();
+    rnd.state += seed;
+    rnd_next();
+    rnd.seeded = 1;
+}
+
+#ifdef ESP_PLATFORM
+#include "esp_random.h"
+
+static uint64_t rnd_entropy(void) {
+    return ((uint64_t)esp_random() << 32) | esp_random();
+}
+#else
+static uint64_t rnd_entropy(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t local = (uint64_t)(uintptr_t)&ts;     /* differs per thread */
+    return ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ (local << 16) ^ (uint64_t)time(NULL);
+}
+#endif
+
+static inline void rnd_ready(void) {
+    if (!rnd.seeded) rnd_seed(rnd_entropy(), rnd_entropy());
+}
+
 float rb_fn_rnd(void) {
-    static int seeded = 0;
-    if (!seeded) {
-        srand((unsigned int)time(NULL));
-        seeded = 1;
+    rnd_ready();
+    /* The top 24 bits: every float in [0, 1) this yields is exact */
+    return (float)(rnd_next() >> 8) * (1.0f / 16777216.0f);
+}
+
+/* ── RANDOMIZE [seed] ────────────────────────────────── */
+
+void rb_randomize(int32_t seed) {
+    /* A given seed gives the same sequence in every task and on every run */
+    rnd_seed((uint64_t)(uint32_t)seed, 0x5851F42D4C957F2DULL);
+}
+
+void rb_randomize_hw(void) {
+    rnd_seed(rnd_entropy(), rnd_entropy());
+}
+
+/* ── RANDOMIZE ARRAY a() [, lo, hi] ──────────────────── */
+
+void rb_rnd_fill_float(float* data, int32_t n, float lo, float hi) {
+    if (!data) return;
+    rnd_ready();
+    float scale = (hi - lo) * (1.0f / 16777216.0f);
+    /* lo + x * scale can round up to hi; the largest float below it is
+     * the closest value the half-open range allows */
+    float top = hi > lo ? nextafterf(hi, lo) : lo;
+    for (int32_t i = 0; i < n; i++) {
+        float v = lo + (float)(rnd_next() >> 8) * scale;
+        data[i] = v < top ? v : top;
+    }
+}
+
+void rb_rnd_fill_int(int32_t* data, int32_t n, int32_t lo, int32_t hi) {
+    if (!data) return;
+    rnd_ready();
+    /* lo <= x < hi; the 32x32 -> 64 multiply maps the draw onto the span */
+    uint32_t span = hi > lo ? (uint32_t)((int64_t)hi - lo) : 0;
+    for (int32_t i = 0; i < n; i++) {
+        data[i] = (int32_t)((int64_t)lo + (int64_t)(((uint64_t)rnd_next() * span) >> 32));
     }
-    return ((float)rand()) / ((float)RAND_MAX + 1.0f);
 }
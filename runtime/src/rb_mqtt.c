@@ -7,32 +7,95 @@
 #include "mqtt_client.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
 
-#define MQTT_RECV_QUEUE_SIZE 8
-#define MQTT_RECV_MSG_MAX   256
+#define MQTT_RECV_QUEUE_SIZE 16
 #define MQTT_RECV_TIMEOUT_MS 5000
+/* How long the MQTT task waits for room in a full queue before dropping */
+#define MQTT_ENQUEUE_WAIT_MS 100
+#define MQTT_DISPATCH_STACK 4096
+#define MQTT_DISPATCH_PRIORITY 2
 
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 static QueueHandle_t mqtt_recv_queue = NULL;
 
+/* A received message. Both strings are shared: they are built on the MQTT
+ * task and released by whichever task consumes them. */
 typedef struct {
-    char data[MQTT_RECV_MSG_MAX];
-    int len;
+    rb_string_t* topic;
+    rb_string_t* payload;
 } mqtt_msg_t;
 
+/* Message being reassembled from MQTT_EVENT_DATA fragments (MQTT task only) */
+static mqtt_msg_t mqtt_partial;
+
+/* ON MQTT.MESSAGE handler and the task that runs it */
+static void (*mqtt_handler)(void) = NULL;
+static TaskHandle_t mqtt_dispatch_task = NULL;
+/* Message the handler is running for (dispatch task only) */
+static mqtt_msg_t mqtt_current;
+
+/* Topic of the last message taken by MQTT.RECEIVE outside the handler */
+static rb_string_t* mqtt_last_topic = NULL;
+static portMUX_TYPE mqtt_topic_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void mqtt_ensure_queue(void) {
+    if (!mqtt_recv_queue) {
+        mqtt_recv_queue = xQueueCreate(MQTT_RECV_QUEUE_SIZE, sizeof(mqtt_msg_t));
+        if (!mqtt_recv_queue) rb_panic("MQTT receive queue could not be created");
+    }
+}
+
+static void mqtt_msg_release(mqtt_msg_t* msg) {
+    rb_string_release(msg->topic);
+    rb_string_release(msg->payload);
+    msg->topic = NULL;
+    msg->payload = NULL;
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                                 int32_t event_id, void *event_data) {
+    (void)handler_args;
+    (void)base;
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
-    if (event_id == MQTT_EVENT_DATA && mqtt_recv_queue) {
+    if (event_id != MQTT_EVENT_DATA || !mqtt_recv_queue) return;
+
+    /* Large payloads arrive in several DATA events; only the first carries
+     * the topic. Each fragment is copied once, straight into the payload. */
+    if (event->current_data_offset == 0) {
+        mqtt_msg_release(&mqtt_partial);
+        mqtt_partial.topic = rb_string_new(event->topic_len);
+        memcpy(mqtt_partial.topic->data, event->topic, event->topic_len);
+        mqtt_partial.payload = rb_string_new(event->total_data_len);
+    }
+    if (!mqtt_partial.payload) return;
+    int end = event->current_data_offset + event->data_len;
+    if (end > mqtt_partial.payload->length) return;
+    memcpy(mqtt_partial.payload->data + event->current_data_offset, event->data, event->data_len);
+    if (end < mqtt_partial.payload->length) return;
+
+    rb_string_share(mqtt_partial.topic);
+    rb_string_share(mqtt_partial.payload);
+    if (xQueueSend(mqtt_recv_queue, &mqtt_partial, pdMS_TO_TICKS(MQTT_ENQUEUE_WAIT_MS)) != pdTRUE) {
+        fprintf(stderr, "MQTT: receive queue full, dropped message on %s\n",
+                mqtt_partial.topic->data);
+        mqtt_msg_release(&mqtt_partial);
+    } else {
+        rb_async_notify();
+    }
+    mqtt_partial.topic = NULL;
+    mqtt_partial.payload = NULL;
+}
+
+static void mqtt_dispatch_main(void* arg) {
+    (void)arg;
+    for (;;) {
         mqtt_msg_t msg;
-        int copy_len = event->data_len;
-        if (copy_len >= MQTT_RECV_MSG_MAX) {
-            copy_len = MQTT_RECV_MSG_MAX - 1;
-        }
-        memcpy(msg.data, event->data, copy_len);
-        msg.data[copy_len] = '\0';
-        msg.len = copy_len;
-        xQueueSend(mqtt_recv_queue, &msg, 0);
+        if (xQueueReceive(mqtt_recv_queue, &msg, portMAX_DELAY) != pdTRUE) continue;
+        mqtt_msg_release(&mqtt_current);
+        mqtt_current = msg;
+        void (*handler)(void) = __atomic_load_n(&mqtt_handler, __ATOMIC_ACQUIRE);
+        if (handler) handler();
     }
 }
 #endif
@@ -44,11 +107,9 @@ void rb_mqtt_connect(rb_string_t* broker, int32_t port) {
         esp_mqtt_client_destroy(mqtt_client);
         mqtt_client = NULL;
     }
-    if (!mqtt_recv_queue) {
-        mqtt_recv_queue = xQueueCreate(MQTT_RECV_QUEUE_SIZE, sizeof(mqtt_msg_t));
-    }
+    mqtt_ensure_queue();
     esp_mqtt_client_config_t config = {
-        .broker.address.uri = broker ? broker->data : "",
+        .broker.address.uri = rb_string_cstr(broker),
         .broker.address.port = (uint32_t)port,
     };
     mqtt_client = esp_mqtt_client_init(&config);
@@ -57,7 +118,7 @@ void rb_mqtt_connect(rb_string_t* broker, int32_t port) {
     esp_mqtt_client_start(mqtt_client);
 #else
     printf("[MQTT] connect: broker=%s, port=%d\n",
-           broker ? broker->data : "(null)", (int)port);
+           broker ? rb_string_cstr(broker) : "(null)", (int)port);
 #endif
 }
 
@@ -73,42 +134,273 @@ void rb_mqtt_disconnect(void) {
 #endif
 }
 
-void rb_mqtt_publish(rb_string_t* topic, rb_string_t* message) {
+/* ── Outbox ───────────────────────────────────────────────
+ *
+ * PUBLISH never waits for the network: on the device messages go through
+ * esp_mqtt_client_enqueue and the MQTT task sends them. Topics set up with
+ * MQTT.COALESCE are held back here first — either only the latest value is
+ * kept and sent once per interval, or N samples are packed into one
+ * newline-separated payload.
+ */
+
+#define MQTT_COALESCE_MAX 8
+/* How often the device checks for last-value topics that are due */
+#define MQTT_COALESCE_TICK_MS 20
+/* Last-value interval when MQTT.COALESCE gives none */
+#define MQTT_COALESCE_DEFAULT_MS 100
+
+enum { MQTT_COALESCE_OFF, MQTT_COALESCE_LAST, MQTT_COALESCE_PACK };
+
+typedef struct {
+    char* topic;        /* NULL for a free slot */
+    int32_t mode;
+    int32_t n;          /* LAST: interval in ms, PACK: samples per payload */
+    int32_t qos;
+    int32_t retain;
+    char* data;         /* pending payload, NULL when nothing is held */
+    int32_t len;
+    int32_t cap;
+    int32_t samples;
+    int64_t due;        /* LAST: when the held value is sent */
+} mqtt_coalesce_t;
+
+static mqtt_coalesce_t mqtt_coalesce[MQTT_COALESCE_MAX];
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include <sys/lock.h>
+
+/* A newlib lock (a mutex, created on first use): the outbox allocates
+ * while holding it, which a spinlock would not allow */
+static _lock_t mqtt_outbox_lock;
+static esp_timer_handle_t mqtt_coalesce_timer = NULL;
+#define OUTBOX_LOCK() _lock_acquire(&mqtt_outbox_lock)
+#define OUTBOX_UNLOCK() _lock_release(&mqtt_outbox_lock)
+
+static int64_t mqtt_now_ms(void) {
+    return esp_timer_get_time() / 1000;
+}
+#else
+#include <pthread.h>
+#include <time.h>
+
+static pthread_mutex_t mqtt_outbox_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define OUTBOX_LOCK() pthread_mutex_lock(&mqtt_outbox_mutex)
+#define OUTBOX_UNLOCK() pthread_mutex_unlock(&mqtt_outbox_mutex)
+
+static int64_t mqtt_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif
+
+static void mqtt_send(const char* topic, const char* data, int32_t len,
+                      int32_t qos, int32_t retain) {
 #ifdef ESP_PLATFORM
     if (mqtt_client) {
-        esp_mqtt_client_publish(mqtt_client,
-                                topic ? topic->data : "",
-                                message ? message->data : "",
-                                message ? message->length : 0,
-                                0, 0);
+        if (esp_mqtt_client_enqueue(mqtt_client, topic, data, len, qos, retain, true) < 0) {
+            fprintf(stderr, "MQTT: outbox full, dropped message on %s\n", topic);
+        }
     }
 #else
-    printf("[MQTT] publish: topic=%s, message=%s\n",
-           topic ? topic->data : "(null)",
-           message ? message->data : "(null)");
+    if (qos || retain) {
+        printf("[MQTT] publish: topic=%s, message=%.*s (qos=%d, retain=%d)\n",
+               topic, (int)len, data, (int)qos, (int)retain);
+    } else {
+        printf("[MQTT] publish: topic=%s, message=%.*s\n", topic, (int)len, data);
+    }
 #endif
 }
 
+/* Take the payload held by `c` (lock held); the caller sends and frees it */
+static int mqtt_coalesce_take(mqtt_coalesce_t* c, mqtt_coalesce_t* out) {
+    if (!c->data) return 0;
+    *out = *c;
+    out->topic = strdup(c->topic);
+    if (!out->topic) rb_panic("out of memory in MQTT outbox");
+    c->data = NULL;
+    c->len = c->cap = c->samples = 0;
+    return 1;
+}
+
+static void mqtt_send_taken(mqtt_coalesce_t* taken) {
+    mqtt_send(taken->topic, taken->data, taken->len, taken->qos, taken->retain);
+    free(taken->topic);
+    free(taken->data);
+}
+
+/* Send every held payload, or only last-value ones that are due when
+ * `due_only` is set */
+static void mqtt_coalesce_flush(int due_only) {
+    int64_t now = mqtt_now_ms();
+    for (int i = 0; i < MQTT_COALESCE_MAX; i++) {
+        mqtt_coalesce_t taken;
+        OUTBOX_LOCK();
+        mqtt_coalesce_t* c = &mqtt_coalesce[i];
+        int have = c->topic &&
+                   (!due_only || (c->mode == MQTT_COALESCE_LAST && c->due <= now)) &&
+                   mqtt_coalesce_take(c, &taken);
+        OUTBOX_UNLOCK();
+        if (have) mqtt_send_taken(&taken);
+    }
+}
+
+#ifdef ESP_PLATFORM
+static void mqtt_coalesce_tick(void* arg) {
+    (void)arg;
+    mqtt_coalesce_flush(1);
+}
+#endif
+
+void rb_mqtt_coalesce(rb_string_t* topic, int32_t mode, int32_t n) {
+    const char* name = rb_string_cstr(topic);
+    if (mode < MQTT_COALESCE_OFF || mode > MQTT_COALESCE_PACK) {
+        fprintf(stderr, "MQTT.COALESCE: unknown mode %d\n", (int)mode);
+        return;
+    }
+    if (n < 1) n = mode == MQTT_COALESCE_LAST ? MQTT_COALESCE_DEFAULT_MS : 1;
+
+    mqtt_coalesce_t taken;
+    int have = 0;
+    OUTBOX_LOCK();
+    mqtt_coalesce_t* slot = NULL;
+    for (int i = 0; i < MQTT_COALESCE_MAX; i++) {
+        mqtt_coalesce_t* c = &mqtt_coalesce[i];
+        if (c->topic && strcmp(c->topic, name) == 0) {
+            slot = c;
+            break;
+        }
+        if (!c->topic && !slot) slot = c;
+    }
+    if (slot && slot->topic) {
+        /* Changing a topic's mode sends whatever it was holding */
+        have = mqtt_coalesce_take(slot, &taken);
+        if (mode == MQTT_COALESCE_OFF) {
+            free(slot->topic);
+            slot->topic = NULL;
+        }
+    } else if (slot && mode != MQTT_COALESCE_OFF) {
+        slot->topic = strdup(name);
+        if (!slot->topic) rb_panic("out of memory in MQTT outbox");
+    }
+    if (slot && slot->topic) {
+        slot->mode = mode;
+        slot->n = n;
+    }
+    OUTBOX_UNLOCK();
+    if (have) mqtt_send_taken(&taken);
+    if (!slot && mode != MQTT_COALESCE_OFF) {
+        fprintf(stderr, "MQTT.COALESCE: more than %d topics\n", MQTT_COALESCE_MAX);
+        return;
+    }
+
+#ifdef ESP_PLATFORM
+    OUTBOX_LOCK();
+    if (mode == MQTT_COALESCE_LAST && !mqtt_coalesce_timer) {
+        esp_timer_create_args_t args = {
+            .callback = mqtt_coalesce_tick,
+            .name = "rb_mqtt_coalesce",
+        };
+        if (esp_timer_create(&args, &mqtt_coalesce_timer) == ESP_OK) {
+            esp_timer_start_periodic(mqtt_coalesce_timer, MQTT_COALESCE_TICK_MS * 1000);
+        }
+    }
+    OUTBOX_UNLOCK();
+#endif
+}
+
+void rb_mqtt_publish(rb_string_t* topic, rb_string_t* message, int32_t qos, int32_t retain) {
+    const char* name = rb_string_cstr(topic);
+    const char* data = rb_string_cstr(message);
+    int32_t len = message ? message->length : 0;
+    if (qos < 0) qos = 0;
+    if (qos > 2) qos = 2;
+    retain = retain != 0;
+
+    mqtt_coalesce_t taken;
+    int have = 0;
+    OUTBOX_LOCK();
+    mqtt_coalesce_t* c = NULL;
+    for (int i = 0; i < MQTT_COALESCE_MAX; i++) {
+        if (mqtt_coalesce[i].topic && strcmp(mqtt_coalesce[i].topic, name) == 0) {
+            c = &mqtt_coalesce[i];
+            break;
+        }
+    }
+    if (c) {
+        int64_t now = mqtt_now_ms();
+        int32_t need = c->mode == MQTT_COALESCE_PACK && c->len > 0 ? c->len + 1 + len : len;
+        if (c->mode == MQTT_COALESCE_LAST) {
+            if (!c->data) c->due = now + c->n;
+            c->len = 0;
+        }
+        if (need + 1 > c->cap) {
+            int32_t cap = c->cap ? c->cap * 2 : 64;
+            while (cap < need + 1) cap *= 2;
+            char* grown = (char*)realloc(c->data, (size_t)cap);
+            if (!grown) rb_panic("out of memory in MQTT outbox");
+            c->data = grown;
+            c->cap = cap;
+        }
+        if (c->mode == MQTT_COALESCE_PACK && c->len > 0) c->data[c->len++] = '\n';
+        memcpy(c->data + c->len, data, (size_t)len);
+        c->len += len;
+        c->data[c->len] = '\0';
+        c->samples++;
+        c->qos = qos;
+        c->retain = retain;
+        /* A full pack goes out now; the host has no timer, so a due
+         * last value goes out on the next PUBLISH */
+        if (c->mode == MQTT_COALESCE_PACK ? c->samples >= c->n : c->due <= now) {
+            have = mqtt_coalesce_take(c, &taken);
+        }
+    }
+    OUTBOX_UNLOCK();
+
+    if (!c) {
+        mqtt_send(name, data, len, qos, retain);
+    } else if (have) {
+        mqtt_send_taken(&taken);
+    }
+}
+
+void rb_mqtt_flush(void) {
+    mqtt_coalesce_flush(0);
+}
+
 void rb_mqtt_subscribe(rb_string_t* topic) {
 #ifdef ESP_PLATFORM
     if (mqtt_client) {
         esp_mqtt_client_subscribe(mqtt_client,
-                                   topic ? topic->data : "",
+                                   rb_string_cstr(topic),
                                    0);
     }
 #else
     printf("[MQTT] subscribe: topic=%s\n",
-           topic ? topic->data : "(null)");
+           topic ? rb_string_cstr(topic) : "(null)");
 #endif
 }
 
 rb_string_t* rb_mqtt_receive(void) {
 #ifdef ESP_PLATFORM
+    /* Inside the handler: the message being dispatched, without waiting */
+    if (mqtt_dispatch_task && xTaskGetCurrentTaskHandle() == mqtt_dispatch_task) {
+        if (!mqtt_current.payload) return rb_string_alloc("");
+        rb_string_retain(mqtt_current.payload);
+        return mqtt_current.payload;
+    }
     if (mqtt_recv_queue) {
         mqtt_msg_t msg;
         if (xQueueReceive(mqtt_recv_queue, &msg,
                           pdMS_TO_TICKS(MQTT_RECV_TIMEOUT_MS)) == pdTRUE) {
-            return rb_string_alloc(msg.data);
+            taskENTER_CRITICAL(&mqtt_topic_lock);
+            rb_string_t* old_topic = mqtt_last_topic;
+            mqtt_last_topic = msg.topic;
+            taskEXIT_CRITICAL(&mqtt_topic_lock);
+            rb_string_release(old_topic);
+            /* The queue's reference becomes the caller's */
+            return msg.payload;
         }
     }
     return rb_string_alloc("");
@@ -117,3 +409,36 @@ rb_string_t* rb_mqtt_receive(void) {
     return rb_string_alloc("");
 #endif
 }
+
+rb_string_t* rb_mqtt_topic(void) {
+#ifdef ESP_PLATFORM
+    rb_string_t* topic;
+    if (mqtt_dispatch_task && xTaskGetCurrentTaskHandle() == mqtt_dispatch_task) {
+        topic = mqtt_current.topic;
+        if (topic) rb_string_retain(topic);
+    } else {
+        taskENTER_CRITICAL(&mqtt_topic_lock);
+        topic = mqtt_last_topic;
+        if (topic) rb_string_retain(topic);
+        taskEXIT_CRITICAL(&mqtt_topic_lock);
+    }
+    return topic ? topic : rb_string_alloc("");
+#else
+    return rb_string_alloc("");
+#endif
+}
+
+void rb_on_mqtt_message(void (*handler)(void)) {
+#ifdef ESP_PLATFORM
+    mqtt_ensure_queue();
+    __atomic_store_n(&mqtt_handler, handler, __ATOMIC_RELEASE);
+    if (!mqtt_dispatch_task &&
+        xTaskCreate(mqtt_dispatch_main, "rb_mqtt_dispatch", MQTT_DISPATCH_STACK, NULL,
+                    MQTT_DISPATCH_PRIORITY, &mqtt_dispatch_task) != pdPASS) {
+        rb_panic("MQTT dispatch task could not be created");
+    }
+#else
+    (void)handler;
+    printf("[HOST STUB] ON MQTT.MESSAGE registered\n");
+#endif
+}
@@ -14,7 +14,7 @@ static void ntp_sync_cb(struct timeval *tv) {
 
 void rb_ntp_sync(rb_string_t* server) {
     esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    esp_sntp_setservername(0, server->data);
+    esp_sntp_setservername(0, rb_string_cstr(server));
     sntp_set_time_sync_notification_cb(ntp_sync_cb);
     esp_sntp_init();
     int retry = 0;
@@ -41,7 +41,7 @@ int32_t rb_ntp_epoch(void) {
 #else /* Host stubs */
 
 void rb_ntp_sync(rb_string_t* server) {
-    printf("[NTP] sync with %s\n", server->data);
+    printf("[NTP] sync with %s\n", rb_string_cstr(server));
 }
 
 rb_string_t* rb_ntp_time(void) {
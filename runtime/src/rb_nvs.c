@@ -1,47 +1,288 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ── NVS (Non-Volatile Storage) ───────────────────────────
+ *
+ * NVS.READ and NVS.WRITE go through a RAM cache of the keys the program
+ * has used, over one handle that stays open. A key is read from flash
+ * once; after that reads are served from RAM. Writes only update the
+ * cache and mark the key dirty (writing the value it already has is
+ * free), and one nvs_commit writes out every dirty key: at NVS.COMMIT,
+ * a batch window after the first uncommitted write (NVS.AUTOCOMMIT ms,
+ * 0 for NVS.COMMIT only), at the end of the program and before DEEPSLEEP
+ * or an OTA restart. A counter saved every 100 ms costs one flash commit
+ * a window instead of ten a second. A key whose write fails stays dirty
+ * and the window is armed again, so the write is retried.
+ *
+ * The window's esp_timer callback does not write flash itself, which would
+ * hold up every other esp_timer (the TIMER scheduler among them): it
+ * raises an event, and the commit runs on the event dispatcher task.
+ *
+ * Strings are stored as blobs, so they may hold any bytes. On the host
+ * there is no flash: the cache lasts for the run and commits are printed.
+ */
+
+#define NVS_KEY_MAX 15                  /* NVS_KEY_NAME_MAX_SIZE - 1 */
+#define NVS_WINDOW_DEFAULT_MS 1000
+
+enum { NVS_NONE, NVS_INT, NVS_STR };
+/* NVS_WRITTEN: set in flash during a commit, not yet committed */
+enum { NVS_CLEAN, NVS_DIRTY, NVS_WRITTEN };
+
+typedef struct {
+    char key[NVS_KEY_MAX + 1];
+    uint8_t kind;           /* value in the cache */
+    uint8_t flash_kind;     /* value in flash, as far as we know */
+    uint8_t dirty;          /* NVS_CLEAN, NVS_DIRTY or NVS_WRITTEN */
+    int32_t value;
+    char* data;             /* NVS_STR */
+    int32_t len;
+} nvs_entry_t;
+
+static nvs_entry_t* nvs_cache = NULL;
+static int32_t nvs_count = 0;
+static int32_t nvs_capacity = 0;
+static int32_t nvs_window_ms = NVS_WINDOW_DEFAULT_MS;
 
 #ifdef ESP_PLATFORM
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include <sys/lock.h>
 
-static int nvs_initialized = 0;
+static _lock_t nvs_lock_handle;
+static nvs_handle_t nvs_handle;
+static int nvs_open_state = 0;          /* 0 not tried, 1 open, -1 failed */
+static esp_timer_handle_t nvs_timer = NULL;
+static int nvs_timer_armed = 0;
+static int32_t nvs_event = -1;          /* event source the window raises */
+#define NVS_LOCK() _lock_acquire(&nvs_lock_handle)
+#define NVS_UNLOCK() _lock_release(&nvs_lock_handle)
 
-static void ensure_nvs_init(void) {
-    if (!nvs_initialized) {
-        nvs_flash_init();
-        nvs_initialized = 1;
+/* Called with the lock held */
+static int nvs_ensure_open(void) {
+    if (nvs_open_state == 0) {
+        esp_err_t err = nvs_flash_init();
+        if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+            nvs_flash_erase();
+            nvs_flash_init();
+        }
+        nvs_open_state = nvs_open("rb_storage", NVS_READWRITE, &nvs_handle) == ESP_OK ? 1 : -1;
+        if (nvs_open_state < 0) printf("[NVS] storage could not be opened\n");
     }
+    return nvs_open_state > 0;
 }
-#endif
 
-void rb_nvs_write(rb_string_t* key, int32_t value) {
-#ifdef ESP_PLATFORM
-    ensure_nvs_init();
-    nvs_handle_t handle;
-    if (nvs_open("rb_storage", NVS_READWRITE, &handle) == ESP_OK) {
-        nvs_set_i32(handle, key ? key->data : "", value);
-        nvs_commit(handle);
-        nvs_close(handle);
+static void nvs_load(nvs_entry_t* e) {
+    if (!nvs_ensure_open()) return;
+    int32_t v;
+    size_t len = 0;
+    if (nvs_get_i32(nvs_handle, e->key, &v) == ESP_OK) {
+        e->kind = NVS_INT;
+        e->value = v;
+    } else if (nvs_get_blob(nvs_handle, e->key, NULL, &len) == ESP_OK) {
+        e->data = (char*)malloc(len ? len : 1);
+        if (!e->data) rb_panic("out of memory in NVS.READ");
+        nvs_get_blob(nvs_handle, e->key, e->data, &len);
+        e->kind = NVS_STR;
+        e->len = (int32_t)len;
     }
+    e->flash_kind = e->kind;
+}
+
+static int nvs_store(nvs_entry_t* e) {
+    if (!nvs_ensure_open()) return 0;
+    if (e->flash_kind != NVS_NONE && e->flash_kind != e->kind)
+        nvs_erase_key(nvs_handle, e->key);
+    esp_err_t err = e->kind == NVS_INT
+        ? nvs_set_i32(nvs_handle, e->key, e->value)
+        : nvs_set_blob(nvs_handle, e->key, e->data, (size_t)e->len);
+    if (err != ESP_OK) {
+        printf("[NVS] write of %s failed: %s\n", e->key, esp_err_to_name(err));
+        return 0;
+    }
+    return 1;
+}
+
+/* Returns 0 if the keys written since the last commit did not reach flash */
+static int nvs_store_done(int wrote) {
+    nvs_timer_armed = 0;
+    if (nvs_timer) esp_timer_stop(nvs_timer);
+    if (wrote && nvs_commit(nvs_handle) != ESP_OK) {
+        printf("[NVS] commit failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+static void nvs_commit_event(void) {
+    rb_nvs_commit();
+}
+
+/* Runs on the esp_timer task */
+static void nvs_timer_cb(void* arg) {
+    (void)arg;
+    if (nvs_event >= 0) {
+        rb_event_raise(nvs_event);
+    } else {
+        rb_nvs_commit();    /* no event source was free */
+    }
+}
+
+/* Called with the lock held, after a key turned dirty */
+static void nvs_schedule(void) {
+    if (nvs_window_ms <= 0 || nvs_timer_armed) return;
+    if (!nvs_timer) {
+        esp_timer_create_args_t args = {
+            .callback = nvs_timer_cb,
+            .name = "rb_nvs_commit",
+        };
+        if (esp_timer_create(&args, &nvs_timer) != ESP_OK) return;
+        nvs_event = rb_event_source_alloc(nvs_commit_event, 0);
+    }
+    if (esp_timer_start_once(nvs_timer, (uint64_t)nvs_window_ms * 1000) == ESP_OK)
+        nvs_timer_armed = 1;
+}
+
 #else
-    printf("[NVS] write: key=%s, value=%d\n",
-           key ? key->data : "(null)", (int)value);
+#include <pthread.h>
+
+static pthread_mutex_t nvs_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define NVS_LOCK() pthread_mutex_lock(&nvs_mutex)
+#define NVS_UNLOCK() pthread_mutex_unlock(&nvs_mutex)
+
+static void nvs_load(nvs_entry_t* e) {
+    printf("[NVS] read: key=%s\n", e->key);
+}
+
+static int nvs_store(nvs_entry_t* e) {
+    if (e->kind == NVS_INT)
+        printf("[NVS] write: key=%s, value=%d\n", e->key, (int)e->value);
+    else
+        printf("[NVS] write: key=%s, value=\"%.*s\"\n", e->key, (int)e->len, e->data);
+    return 1;
+}
+
+static int nvs_store_done(int wrote) {
+    (void)wrote;
+    return 1;
+}
+
+static void nvs_schedule(void) {}
 #endif
+
+/* The cache entry for a key, loaded from flash on first use; NULL if the
+ * key is not one NVS can store. Called with the lock held. */
+static nvs_entry_t* nvs_entry(rb_string_t* key) {
+    const char* name = rb_string_cstr(key);
+    size_t n = strlen(name);
+    if (n == 0 || n > NVS_KEY_MAX) {
+        printf("[NVS] key \"%s\" must be 1 to %d characters\n", name, NVS_KEY_MAX);
+        return NULL;
+    }
+    for (int32_t i = 0; i < nvs_count; i++) {
+        if (strcmp(nvs_cache[i].key, name) == 0) return &nvs_cache[i];
+    }
+    if (nvs_count == nvs_capacity) {
+        int32_t cap = nvs_capacity ? nvs_capacity * 2 : 16;
+        nvs_entry_t* grown = (nvs_entry_t*)realloc(nvs_cache, (size_t)cap * sizeof(nvs_entry_t));
+        if (!grown) rb_panic("out of memory in NVS");
+        nvs_cache = grown;
+        nvs_capacity = cap;
+    }
+    nvs_entry_t* e = &nvs_cache[nvs_count++];
+    memset(e, 0, sizeof *e);
+    memcpy(e->key, name, n + 1);
+    nvs_load(e);
+    return e;
 }
 
-int32_t rb_nvs_read(rb_string_t* key) {
-#ifdef ESP_PLATFORM
-    ensure_nvs_init();
-    nvs_handle_t handle;
-    int32_t value = 0;
-    if (nvs_open("rb_storage", NVS_READONLY, &handle) == ESP_OK) {
-        nvs_get_i32(handle, key ? key->data : "", &value);
-        nvs_close(handle);
+static void nvs_set_kind(nvs_entry_t* e, uint8_t kind) {
+    if (e->kind == NVS_STR && kind != NVS_STR) {
+        free(e->data);
+        e->data = NULL;
+        e->len = 0;
     }
+    e->kind = kind;
+    e->dirty = NVS_DIRTY;
+    nvs_schedule();
+}
+
+void rb_nvs_write(rb_string_t* key, int32_t value) {
+    NVS_LOCK();
+    nvs_entry_t* e = nvs_entry(key);
+    if (e && !(e->kind == NVS_INT && e->value == value)) {
+        nvs_set_kind(e, NVS_INT);
+        e->value = value;
+    }
+    NVS_UNLOCK();
+}
+
+void rb_nvs_write_str(rb_string_t* key, rb_string_t* value) {
+    const char* data = value ? value->data : "";
+    int32_t len = value ? value->length : 0;
+    NVS_LOCK();
+    nvs_entry_t* e = nvs_entry(key);
+    if (e && !(e->kind == NVS_STR && e->len == len && memcmp(e->data, data, (size_t)len) == 0)) {
+        char* copy = (char*)malloc(len ? (size_t)len : 1);
+        if (!copy) rb_panic("out of memory in NVS.WRITE");
+        memcpy(copy, data, (size_t)len);
+        nvs_set_kind(e, NVS_STR);
+        free(e->data);
+        e->data = copy;
+        e->len = len;
+    }
+    NVS_UNLOCK();
+}
+
+/* A key that holds a string reads as 0, and one that holds a number as "" */
+int32_t rb_nvs_read(rb_string_t* key) {
+    NVS_LOCK();
+    nvs_entry_t* e = nvs_entry(key);
+    int32_t value = e && e->kind == NVS_INT ? e->value : 0;
+    NVS_UNLOCK();
     return value;
-#else
-    printf("[NVS] read: key=%s\n", key ? key->data : "(null)");
-    return 0;
-#endif
+}
+
+rb_string_t* rb_nvs_read_str(rb_string_t* key) {
+    NVS_LOCK();
+    nvs_entry_t* e = nvs_entry(key);
+    rb_string_t* s = e && e->kind == NVS_STR
+        ? rb_string_from_bytes(e->data, e->len)
+        : rb_string_alloc("");
+    NVS_UNLOCK();
+    return s;
+}
+
+void rb_nvs_commit(void) {
+    NVS_LOCK();
+    int wrote = 0;
+    int failed = 0;
+    for (int32_t i = 0; i < nvs_count; i++) {
+        nvs_entry_t* e = &nvs_cache[i];
+        if (e->dirty != NVS_DIRTY) continue;
+        if (nvs_store(e)) {
+            e->flash_kind = e->kind;
+            e->dirty = NVS_WRITTEN;
+            wrote = 1;
+        } else {
+            failed = 1;
+        }
+    }
+    int committed = nvs_store_done(wrote);
+    for (int32_t i = 0; i < nvs_count; i++) {
+        nvs_entry_t* e = &nvs_cache[i];
+        if (e->dirty == NVS_WRITTEN) e->dirty = committed ? NVS_CLEAN : NVS_DIRTY;
+    }
+    /* Whatever is still dirty is tried again a window from now */
+    if (failed || !committed) nvs_schedule();
+    NVS_UNLOCK();
+}
+
+void rb_nvs_autocommit(int32_t ms) {
+    NVS_LOCK();
+    nvs_window_ms = ms > 0 ? ms : 0;
+    NVS_UNLOCK();
 }
@@ -1,51 +1,230 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
+
+/* ── SSD1306 over I2C ─────────────────────────────────────
+ *
+ * Drawing only touches a 1-bit RAM framebuffer laid out like the panel's
+ * own memory: one byte per column per 8-row page, LSB on top. Each page
+ * remembers the column span drawn into since the last OLED.SHOW, and
+ * OLED.SHOW sends just those spans: consecutive dirty pages go out as one
+ * window (the union of their spans) in a single I2C transaction, so a
+ * dashboard that changes one number costs a few dozen bytes instead of the
+ * whole 1 KB screen. The display sits on the bus set up by I2C.SETUP.
+ */
+
+#define OLED_ADDR 0x3C
+#define OLED_MAX_W 128
+#define OLED_MAX_H 64
+#define OLED_PAGES (OLED_MAX_H / 8)
+
+/* I2C control bytes: what follows is commands / display data */
+#define OLED_CMD 0x00
+#define OLED_DATA 0x40
+
+static uint8_t oled_fb[OLED_PAGES][OLED_MAX_W];
+static int32_t oled_w = OLED_MAX_W;
+static int32_t oled_h = OLED_MAX_H;
+/* Dirty column span per page; x0 > x1 when the page is clean */
+static int16_t oled_dirty_x0[OLED_PAGES];
+static int16_t oled_dirty_x1[OLED_PAGES];
+static int oled_ready = 0;
+
+/* Classic 5x7 font, printable ASCII from ' ', one byte per column */
+static const uint8_t oled_font[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00},
+    {0x14,0x7F,0x14,0x7F,0x14}, {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, {0x00,0x1C,0x22,0x41,0x00},
+    {0x00,0x41,0x22,0x1C,0x00}, {0x08,0x2A,0x1C,0x2A,0x08}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00},
+    {0x20,0x10,0x08,0x04,0x02}, {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00},
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, {0x18,0x14,0x12,0x7F,0x10},
+    {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00},
+    {0x00,0x56,0x36,0x00,0x00}, {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, {0x32,0x49,0x79,0x41,0x3E},
+    {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x01,0x01},
+    {0x3E,0x41,0x41,0x51,0x32}, {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00},
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, {0x7F,0x40,0x40,0x40,0x40},
+    {0x7F,0x02,0x04,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46},
+    {0x46,0x49,0x49,0x49,0x31}, {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F},
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x7F,0x20,0x18,0x20,0x7F}, {0x63,0x14,0x08,0x14,0x63},
+    {0x03,0x04,0x78,0x04,0x03}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04},
+    {0x40,0x40,0x40,0x40,0x40}, {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78},
+    {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, {0x38,0x44,0x44,0x48,0x7F},
+    {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x08,0x14,0x54,0x54,0x3C},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00},
+    {0x00,0x7F,0x10,0x28,0x44}, {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78},
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, {0x7C,0x14,0x14,0x14,0x08},
+    {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C},
+    {0x3C,0x40,0x30,0x40,0x3C}, {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C},
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, {0x00,0x00,0x7F,0x00,0x00},
+    {0x00,0x41,0x36,0x08,0x00}, {0x02,0x01,0x02,0x04,0x02},
+};
+
+static void oled_mark(int32_t page, int32_t x0, int32_t x1) {
+    if (x0 < oled_dirty_x0[page]) oled_dirty_x0[page] = (int16_t)x0;
+    if (x1 > oled_dirty_x1[page]) oled_dirty_x1[page] = (int16_t)x1;
+}
+
+static void oled_mark_all(void) {
+    int32_t pages = (oled_h + 7) / 8;
+    for (int32_t p = 0; p < pages; p++) {
+        oled_dirty_x0[p] = 0;
+        oled_dirty_x1[p] = (int16_t)(oled_w - 1);
+    }
+}
+
+static void oled_set(int32_t x, int32_t y, int on) {
+    if (x < 0 || y < 0 || x >= oled_w || y >= oled_h) return;
+    uint8_t* b = &oled_fb[y >> 3][x];
+    uint8_t bit = (uint8_t)(1u << (y & 7));
+    uint8_t v = on ? (uint8_t)(*b | bit) : (uint8_t)(*b & ~bit);
+    if (v == *b) return;
+    *b = v;
+    oled_mark(y >> 3, x, x);
+}
+
+static int oled_command(const uint8_t* cmds, size_t n) {
+    uint8_t buf[1 + 32];
+    buf[0] = OLED_CMD;
+    memcpy(buf + 1, cmds, n);
+    return rb_i2c_write_bytes(OLED_ADDR, buf, n + 1);
+}
 
 void rb_oled_init(int32_t width, int32_t height) {
-#ifdef ESP_PLATFORM
-    /* SSD1306 I2C initialization would go here */
-    (void)width; (void)height;
-#else
+    oled_w = width > 0 && width <= OLED_MAX_W ? width : OLED_MAX_W;
+    oled_h = height > 0 && height <= OLED_MAX_H ? (height + 7) / 8 * 8 : OLED_MAX_H;
+    memset(oled_fb, 0, sizeof(oled_fb));
+    for (int32_t p = 0; p < OLED_PAGES; p++) {
+        oled_dirty_x0[p] = OLED_MAX_W;
+        oled_dirty_x1[p] = -1;
+    }
+    /* The panel's RAM is garbage at power-up */
+    oled_mark_all();
+    const uint8_t init[] = {
+        0xAE,                           /* display off */
+        0xD5, 0x80,                     /* clock divide */
+        0xA8, (uint8_t)(oled_h - 1),    /* multiplex ratio */
+        0xD3, 0x00,                     /* display offset */
+        0x40,                           /* start line 0 */
+        0x8D, 0x14,                     /* charge pump on */
+        0x20, 0x00,                     /* horizontal addressing */
+        0xA1,                           /* column 127 is SEG0 */
+        0xC8,                           /* scan COM from the bottom */
+        0xDA, (uint8_t)(oled_h == 64 ? 0x12 : 0x02),  /* COM pins */
+        0x81, 0xCF,                     /* contrast */
+        0xD9, 0xF1,                     /* precharge */
+        0xDB, 0x40,                     /* VCOMH level */
+        0xA4,                           /* show RAM contents */
+        0xA6,                           /* not inverted */
+        0xAF,                           /* display on */
+    };
+    oled_ready = oled_command(init, sizeof(init)) == 0;
+    if (!oled_ready) fprintf(stderr, "OLED.INIT: no SSD1306 at 0x%02X (I2C.SETUP first)\n", OLED_ADDR);
+#ifndef ESP_PLATFORM
     fprintf(stderr, "[stub] OLED.INIT %dx%d\n", (int)width, (int)height);
 #endif
 }
 
 void rb_oled_print(int32_t x, int32_t y, rb_string_t* text) {
-#ifdef ESP_PLATFORM
-    (void)x; (void)y; (void)text;
-#else
-    fprintf(stderr, "[stub] OLED.PRINT %d,%d \"%s\"\n", (int)x, (int)y, text ? text->data : "");
+    if (!text) return;
+    /* Each character fills its 6x8 cell, so overprinting a value erases the old one */
+    for (int32_t i = 0; i < text->length; i++) {
+        int32_t cx = x + 6 * i;
+        uint8_t c = (uint8_t)text->data[i];
+        const uint8_t* glyph = oled_font[(c >= 32 && c < 127 ? c : '?') - 32];
+        for (int32_t col = 0; col < 6; col++) {
+            uint8_t bits = col < 5 ? glyph[col] : 0;
+            for (int32_t row = 0; row < 8; row++) oled_set(cx + col, y + row, (bits >> row) & 1);
+        }
+    }
+#ifndef ESP_PLATFORM
+    fprintf(stderr, "[stub] OLED.PRINT %d,%d \"%s\"\n", (int)x, (int)y, rb_string_cstr(text));
 #endif
 }
 
 void rb_oled_pixel(int32_t x, int32_t y, int32_t color) {
-#ifdef ESP_PLATFORM
-    (void)x; (void)y; (void)color;
-#else
-    fprintf(stderr, "[stub] OLED.PIXEL %d,%d color=%d\n", (int)x, (int)y, (int)color);
-#endif
+    oled_set(x, y, color != 0);
 }
 
 void rb_oled_line(int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t color) {
-#ifdef ESP_PLATFORM
-    (void)x1; (void)y1; (void)x2; (void)y2; (void)color;
-#else
-    fprintf(stderr, "[stub] OLED.LINE (%d,%d)-(%d,%d) color=%d\n", (int)x1, (int)y1, (int)x2, (int)y2, (int)color);
-#endif
+    int32_t dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int32_t dy = y2 > y1 ? y1 - y2 : y2 - y1;
+    int32_t sx = x1 < x2 ? 1 : -1;
+    int32_t sy = y1 < y2 ? 1 : -1;
+    int32_t err = dx + dy;
+    for (;;) {
+        oled_set(x1, y1, color != 0);
+        if (x1 == x2 && y1 == y2) break;
+        int32_t e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
 }
 
 void rb_oled_clear(void) {
-#ifdef ESP_PLATFORM
-    /* clear OLED framebuffer */
-#else
-    fprintf(stderr, "[stub] OLED.CLEAR\n");
-#endif
+    int32_t pages = (oled_h + 7) / 8;
+    for (int32_t p = 0; p < pages; p++) {
+        for (int32_t x = 0; x < oled_w; x++) {
+            if (oled_fb[p][x]) {
+                oled_fb[p][x] = 0;
+                oled_mark(p, x, x);
+            }
+        }
+    }
 }
 
 void rb_oled_show(void) {
-#ifdef ESP_PLATFORM
-    /* flush framebuffer to display */
+    static uint8_t tx[1 + OLED_PAGES * OLED_MAX_W];
+    int32_t pages = (oled_h + 7) / 8;
+    int32_t sent = 0;
+    for (int32_t p = 0; p < pages;) {
+        if (oled_dirty_x0[p] > oled_dirty_x1[p]) {
+            p++;
+            continue;
+        }
+        /* A run of dirty pages goes out as one window */
+        int32_t first = p;
+        int32_t x0 = oled_dirty_x0[p];
+        int32_t x1 = oled_dirty_x1[p];
+        while (p < pages && oled_dirty_x0[p] <= oled_dirty_x1[p]) {
+            if (oled_dirty_x0[p] < x0) x0 = oled_dirty_x0[p];
+            if (oled_dirty_x1[p] > x1) x1 = oled_dirty_x1[p];
+            oled_dirty_x0[p] = OLED_MAX_W;
+            oled_dirty_x1[p] = -1;
+            p++;
+        }
+        int32_t last = p - 1;
+        const uint8_t window[] = {
+            0x21, (uint8_t)x0, (uint8_t)x1,         /* column range */
+            0x22, (uint8_t)first, (uint8_t)last,    /* page range */
+        };
+        size_t n = 1;
+        tx[0] = OLED_DATA;
+        for (int32_t q = first; q <= last; q++) {
+            memcpy(tx + n, &oled_fb[q][x0], (size_t)(x1 - x0 + 1));
+            n += (size_t)(x1 - x0 + 1);
+        }
+        if (oled_ready) {
+            oled_command(window, sizeof(window));
+            rb_i2c_write_bytes(OLED_ADDR, tx, n);
+        }
+        sent += (int32_t)n - 1;
+    }
+#ifndef ESP_PLATFORM
+    fprintf(stderr, "[stub] OLED.SHOW %d bytes\n", (int)sent);
 #else
-    fprintf(stderr, "[stub] OLED.SHOW\n");
+    (void)sent;
 #endif
 }
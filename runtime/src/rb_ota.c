@@ -10,16 +10,18 @@
 void rb_ota_update(rb_string_t* url) {
 #ifdef ESP_PLATFORM
     esp_http_client_config_t http_config = {
-        .url = url ? url->data : "",
+        .url = rb_string_cstr(url),
     };
     esp_https_ota_config_t ota_config = {
         .http_config = &http_config,
     };
     esp_err_t ret = esp_https_ota(&ota_config);
     if (ret == ESP_OK) {
+        rb_nvs_commit();
+        rb_console_flush();
         esp_restart();
     }
 #else
-    if (url) fprintf(stderr, "[stub] OTA.UPDATE %s\n", url->data);
+    if (url) fprintf(stderr, "[stub] OTA.UPDATE %s\n", rb_string_cstr(url));
 #endif
 }
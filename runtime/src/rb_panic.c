@@ -8,11 +8,15 @@
 #endif
 
 void rb_panic(const char* message) {
+    /* The PRINT output leading up to the error comes out first */
+    rb_print_drain_now();
 #ifdef ESP_PLATFORM
     ESP_LOGE("RustyBASIC", "RUNTIME ERROR: %s", message);
+    rb_profile_panic_dump();
     esp_restart();
 #else
     fprintf(stderr, "RUNTIME ERROR: %s\n", message);
+    rb_profile_panic_dump();
     exit(1);
 #endif
     /* unreachable, but satisfy noreturn */
@@ -1,23 +1,228 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ── Console output ───────────────────────────────────────
+ *
+ * PRINT does not write to the console itself. On the device its text is
+ * copied into a RAM ring and a drain task writes it to stdout, so a PRINT
+ * costs a memcpy instead of a synchronous UART / USB-JTAG write; it only
+ * waits when the ring is full. CONSOLE.MODE picks when the task is woken:
+ * at each newline (the default), once a number of bytes are pending, or
+ * after a number of ms without output. Mode 0 writes straight through as
+ * PRINT always used to. FLUSH, INPUT and the end of the program drain the
+ * ring and wait until it is out; panics, failed ASSERTs and unhandled
+ * errors write out what is left with rb_print_drain_now before they stop.
+ *
+ * Runtime diagnostics ("[TIMER] ...") still go to stdout directly, so in
+ * the buffered modes they can show up ahead of PRINT output queued before
+ * them. On the host, stdio's own buffer stands in for the ring.
+ */
+
+#define CONSOLE_SIZE_DEFAULT 512
+#define CONSOLE_IDLE_DEFAULT_MS 20
+
+static int32_t console_mode = RB_CONSOLE_LINE;
+static int32_t console_arg = 0;    /* bytes (SIZE) or ms (IDLE) */
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <sys/lock.h>
+
+#define CONSOLE_RING_SIZE 2048     /* power of two */
+#define CONSOLE_TASK_STACK 3072
+#define CONSOLE_TASK_PRIORITY 2
+
+static char console_ring[CONSOLE_RING_SIZE];
+static uint32_t console_head, console_tail;     /* free-running; head - tail pending */
+static int console_urgent = 0;      /* FLUSH or a full ring: drain whatever the mode */
+static int64_t console_last_write = 0;
+static _lock_t console_lock_handle;
+static SemaphoreHandle_t console_wake_sem;
+static SemaphoreHandle_t console_drained_sem;
+static TaskHandle_t console_task = NULL;
+
+static void console_lock(void) { _lock_acquire(&console_lock_handle); }
+static void console_unlock(void) { _lock_release(&console_lock_handle); }
+
+static void console_task_main(void* arg) {
+    (void)arg;
+    for (;;) {
+        console_lock();
+        TickType_t wait = portMAX_DELAY;
+        if (console_mode == RB_CONSOLE_IDLE && console_head != console_tail) {
+            wait = pdMS_TO_TICKS(console_arg);
+            if (wait == 0) wait = 1;
+        }
+        console_unlock();
+        xSemaphoreTake(console_wake_sem, wait);
+
+        console_lock();
+        uint32_t tail = console_tail;
+        uint32_t n = console_head - tail;
+        if (!console_urgent && console_mode == RB_CONSOLE_IDLE &&
+            esp_timer_get_time() - console_last_write < (int64_t)console_arg * 1000) {
+            n = 0;  /* still busy; wait for a pause */
+        }
+        if (n > 0) console_urgent = 0;
+        console_unlock();
+        if (n == 0) continue;
+
+        uint32_t at = tail & (CONSOLE_RING_SIZE - 1);
+        uint32_t first = n < CONSOLE_RING_SIZE - at ? n : CONSOLE_RING_SIZE - at;
+        fwrite(console_ring + at, 1, first, stdout);
+        fwrite(console_ring, 1, n - first, stdout);
+        fflush(stdout);
+
+        console_lock();
+        console_tail = tail + n;
+        console_unlock();
+        xSemaphoreGive(console_drained_sem);
+    }
+}
+
+/* Called with the lock held */
+static void console_start(void) {
+    if (console_task) return;
+    console_wake_sem = xSemaphoreCreateBinary();
+    console_drained_sem = xSemaphoreCreateBinary();
+    if (!console_wake_sem || !console_drained_sem ||
+        xTaskCreate(console_task_main, "rb_console", CONSOLE_TASK_STACK, NULL,
+                    CONSOLE_TASK_PRIORITY, &console_task) != pdPASS) {
+        rb_panic("console task could not be created");
+    }
+}
+
+void rb_console_write(const char* data, int32_t len) {
+    if (!data || len <= 0) return;
+    if (console_mode == RB_CONSOLE_SYNC) {
+        fwrite(data, 1, (size_t)len, stdout);
+        if (memchr(data, '\n', (size_t)len)) fflush(stdout);
+        return;
+    }
+    int wake = 0;
+    console_lock();
+    console_start();
+    if (console_head == console_tail) wake = 1;     /* starts the idle clock */
+    while (len > 0) {
+        uint32_t room = CONSOLE_RING_SIZE - (console_head - console_tail);
+        if (room == 0) {
+            /* Full: hand what is there to the task and wait for room */
+            console_urgent = 1;
+            console_unlock();
+            xSemaphoreGive(console_wake_sem);
+            xSemaphoreTake(console_drained_sem, pdMS_TO_TICKS(100));
+            console_lock();
+            continue;
+        }
+        uint32_t n = (uint32_t)len < room ? (uint32_t)len : room;
+        uint32_t at = console_head & (CONSOLE_RING_SIZE - 1);
+        uint32_t first = n < CONSOLE_RING_SIZE - at ? n : CONSOLE_RING_SIZE - at;
+        memcpy(console_ring + at, data, first);
+        memcpy(console_ring, data + first, n - first);
+        if (console_mode == RB_CONSOLE_LINE && memchr(data, '\n', n)) wake = 1;
+        console_head += n;
+        data += n;
+        len -= (int32_t)n;
+    }
+    if (console_mode == RB_CONSOLE_SIZE && console_head - console_tail >= (uint32_t)console_arg) wake = 1;
+    console_last_write = esp_timer_get_time();
+    console_unlock();
+    if (wake) xSemaphoreGive(console_wake_sem);
+}
+
+void rb_console_flush(void) {
+    if (!console_task) {
+        fflush(stdout);
+        return;
+    }
+    console_lock();
+    uint32_t target = console_head;
+    int done = console_tail == target;
+    if (!done) console_urgent = 1;
+    console_unlock();
+    if (!done) xSemaphoreGive(console_wake_sem);
+    while (!done) {
+        xSemaphoreTake(console_drained_sem, pdMS_TO_TICKS(100));
+        console_lock();
+        done = (int32_t)(console_tail - target) >= 0;
+        console_unlock();
+    }
+    fflush(stdout);
+}
+
+/* A panic may come while another task holds the console lock or is halfway
+ * through a drain, so this reads the indices unlocked and writes with
+ * write(), past stdout's own lock. Text the task was writing at that moment
+ * can come out twice; none is lost. */
+void rb_print_drain_now(void) {
+    uint32_t tail = __atomic_load_n(&console_tail, __ATOMIC_ACQUIRE);
+    uint32_t head = __atomic_load_n(&console_head, __ATOMIC_ACQUIRE);
+    uint32_t n = head - tail;
+    if (n == 0 || n > CONSOLE_RING_SIZE) return;
+    uint32_t at = tail & (CONSOLE_RING_SIZE - 1);
+    uint32_t first = n < CONSOLE_RING_SIZE - at ? n : CONSOLE_RING_SIZE - at;
+    write(STDOUT_FILENO, console_ring + at, first);
+    if (n > first) write(STDOUT_FILENO, console_ring, n - first);
+    __atomic_store_n(&console_tail, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+void rb_console_write(const char* data, int32_t len) {
+    if (!data || len <= 0) return;
+    fwrite(data, 1, (size_t)len, stdout);
+    if (console_mode == RB_CONSOLE_SYNC && memchr(data, '\n', (size_t)len)) fflush(stdout);
+}
+
+void rb_console_flush(void) {
+    fflush(stdout);
+}
+
+/* stdio's buffer is the ring here, and abort() does not flush it */
+void rb_print_drain_now(void) {
+    fflush(stdout);
+}
+
+#endif
+
+void rb_console_mode(int32_t mode, int32_t n) {
+    if (mode < RB_CONSOLE_SYNC || mode > RB_CONSOLE_IDLE) {
+        printf("[CONSOLE] invalid mode %d\n", (int)mode);
+        return;
+    }
+    /* Whatever was queued under the old mode goes out first */
+    rb_console_flush();
+    if (n <= 0) n = mode == RB_CONSOLE_SIZE ? CONSOLE_SIZE_DEFAULT : CONSOLE_IDLE_DEFAULT_MS;
+#ifdef ESP_PLATFORM
+    if (mode == RB_CONSOLE_SIZE && n > CONSOLE_RING_SIZE) n = CONSOLE_RING_SIZE;
+#endif
+    console_arg = n;
+    console_mode = mode;
+}
+
+/* ── PRINT ────────────────────────────────────────────── */
 
 void rb_print_int(int32_t value) {
-    printf("%d", (int)value);
+    char buf[RB_FMT_INT_MAX];
+    rb_console_write(buf, rb_fmt_int(buf, value));
 }
 
 void rb_print_float(float value) {
-    printf("%g", (double)value);
+    char buf[RB_FMT_FLOAT_MAX];
+    rb_console_write(buf, rb_fmt_float(buf, value));
 }
 
 void rb_print_string(rb_string_t* s) {
     if (s) {
-        printf("%s", s->data);
+        rb_console_write(s->data, s->length);
     }
 }
 
 void rb_print_newline(void) {
-    printf("\n");
-#ifdef ESP_PLATFORM
-    fflush(stdout);
-#endif
+    rb_console_write("\n", 1);
 }
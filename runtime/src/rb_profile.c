@@ -0,0 +1,217 @@
+#include "rb_runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ── Profiling ────────────────────────────────────────────
+ *
+ * Built with --profile, every SUB and FUNCTION calls rb_prof_enter on
+ * entry and rb_prof_exit on its way out, with the index the compiler gave
+ * it. Each task keeps a small stack of the calls it is inside, so a call
+ * is charged its total cycles and its self cycles (total minus the calls
+ * it made). PROFILE ON clears the counters and starts counting (--profile
+ * does this at startup), PROFILE OFF stops; PROFILE.DUMP prints the
+ * table, busiest SUB first, and a runtime error prints it too.
+ *
+ * Cycles come from the CPU cycle counter (esp_cpu_get_cycle_count); a
+ * single call longer than 2^32 cycles (about 26 s at 160 MHz) wraps. On
+ * the host the unit is nanoseconds. String counts are those of the task
+ * asking for the report.
+ */
+
+#define PROF_MAX_SUBS 256
+#define PROF_DEPTH 16
+#define PROF_LINE_MAX 96
+
+typedef struct {
+    const char* name;
+    uint32_t calls;
+    uint64_t total;
+    uint64_t self;
+} prof_entry_t;
+
+typedef struct {
+    int32_t id;
+    uint32_t start;
+    uint32_t child;     /* cycles spent in calls made from this one */
+} prof_frame_t;
+
+static prof_entry_t prof_entries[PROF_MAX_SUBS];
+static volatile int prof_enabled = 0;
+static int64_t prof_started_us;
+static rb_string_pool_stats_t prof_strings_base;
+
+/* Calls deeper than PROF_DEPTH are counted in the depth only */
+static __thread prof_frame_t prof_stack[PROF_DEPTH];
+static __thread int32_t prof_depth = 0;
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+
+#include "esp_timer.h"
+
+static portMUX_TYPE prof_lock = portMUX_INITIALIZER_UNLOCKED;
+#define PROF_LOCK() portENTER_CRITICAL(&prof_lock)
+#define PROF_UNLOCK() portEXIT_CRITICAL(&prof_lock)
+
+static inline uint32_t prof_now(void) {
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
+
+static int64_t prof_now_us(void) {
+    return esp_timer_get_time();
+}
+
+#define PROF_UNIT "cycles"
+#else
+#include <pthread.h>
+#include <time.h>
+
+static pthread_mutex_t prof_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define PROF_LOCK() pthread_mutex_lock(&prof_mutex)
+#define PROF_UNLOCK() pthread_mutex_unlock(&prof_mutex)
+
+static inline uint32_t prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+static int64_t prof_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#define PROF_UNIT "ns"
+#endif
+
+void rb_prof_enter(int32_t id, const char* name) {
+    int32_t d = prof_depth++;
+    if (d >= PROF_DEPTH) return;
+    if (id >= 0 && id < PROF_MAX_SUBS && !prof_entries[id].name)
+        prof_entries[id].name = name;
+    prof_stack[d].id = id;
+    prof_stack[d].child = 0;
+    prof_stack[d].start = prof_now();
+}
+
+void rb_prof_exit(int32_t id) {
+    uint32_t now = prof_now();
+    int32_t d = --prof_depth;
+    if (d < 0) {
+        prof_depth = 0;
+        return;
+    }
+    if (d >= PROF_DEPTH) return;
+    prof_frame_t* f = &prof_stack[d];
+    uint32_t total = now - f->start;
+    if (d > 0) prof_stack[d - 1].child += total;
+    if (!prof_enabled || id != f->id || id < 0 || id >= PROF_MAX_SUBS) return;
+    PROF_LOCK();
+    prof_entries[id].calls++;
+    prof_entries[id].total += total;
+    prof_entries[id].self += total - f->child;
+    PROF_UNLOCK();
+}
+
+void rb_profile_on(int32_t on) {
+    if (!on) {
+        prof_enabled = 0;
+        return;
+    }
+    PROF_LOCK();
+    for (int32_t i = 0; i < PROF_MAX_SUBS; i++) {
+        prof_entries[i].calls = 0;
+        prof_entries[i].total = 0;
+        prof_entries[i].self = 0;
+    }
+    prof_started_us = prof_now_us();
+    PROF_UNLOCK();
+    rb_string_pool_stats(&prof_strings_base);
+    prof_enabled = 1;
+}
+
+/* The report as text, `*len` bytes; NULL if it can't be allocated */
+static char* prof_report(int32_t* len) {
+    prof_entry_t* snap = (prof_entry_t*)malloc(sizeof prof_entries);
+    if (!snap) return NULL;
+    PROF_LOCK();
+    int64_t elapsed_ms = (prof_now_us() - prof_started_us) / 1000;
+    memcpy(snap, prof_entries, sizeof prof_entries);
+    PROF_UNLOCK();
+
+    /* Keep the SUBs that were called, busiest (most self cycles) first */
+    int32_t n = 0;
+    for (int32_t i = 0; i < PROF_MAX_SUBS; i++) {
+        if (!snap[i].calls) continue;
+        prof_entry_t e = snap[i];
+        int32_t k = n++;
+        while (k > 0 && snap[k - 1].self < e.self) {
+            snap[k] = snap[k - 1];
+            k--;
+        }
+        snap[k] = e;
+    }
+
+    rb_string_pool_stats_t strings;
+    rb_string_pool_stats(&strings);
+    size_t cap = (size_t)(n + 2) * PROF_LINE_MAX;
+    char* out = (char*)malloc(cap);
+    if (!out) {
+        free(snap);
+        return NULL;
+    }
+    size_t at = 0;
+    at += (size_t)snprintf(out + at, cap - at,
+        "[PROFILE] %lld ms%s, times in %s; strings: %u allocated, %u freed\n",
+        (long long)elapsed_ms, prof_enabled ? "" : " (stopped)", PROF_UNIT,
+        (unsigned)(strings.allocs - prof_strings_base.allocs),
+        (unsigned)(strings.frees - prof_strings_base.frees));
+    at += (size_t)snprintf(out + at, cap - at,
+        "[PROFILE] %-24s %8s %12s %12s %10s\n", "SUB", "calls", "total", "self", "avg");
+    for (int32_t k = 0; k < n; k++) {
+        const prof_entry_t* e = &snap[k];
+        at += (size_t)snprintf(out + at, cap - at,
+            "[PROFILE] %-24.24s %8u %12llu %12llu %10llu\n",
+            e->name ? e->name : "?", (unsigned)e->calls,
+            (unsigned long long)e->total, (unsigned long long)e->self,
+            (unsigned long long)(e->total / e->calls));
+    }
+    free(snap);
+    *len = (int32_t)at;
+    return out;
+}
+
+/* Through the console ring, so the report comes after PRINT output still
+ * queued under CONSOLE.MODE LINE/SIZE/IDLE */
+void rb_profile_dump(void) {
+    int32_t len = 0;
+    char* text = prof_report(&len);
+    if (!text) return;
+    rb_console_write(text, len);
+    rb_console_flush();
+    free(text);
+}
+
+rb_string_t* rb_profile_report(void) {
+    int32_t len = 0;
+    char* text = prof_report(&len);
+    if (!text) return rb_string_alloc("");
+    rb_string_t* s = rb_string_from_bytes(text, len);
+    free(text);
+    return s;
+}
+
+/* From rb_panic: the counters as they are, if profiling was on. The ring
+ * has just been drained and its lock may be held, so this writes directly. */
+void rb_profile_panic_dump(void) {
+    if (!prof_enabled) return;
+    int32_t len = 0;
+    char* text = prof_report(&len);
+    if (!text) return;
+    fwrite(text, 1, (size_t)len, stdout);
+    fflush(stdout);
+    free(text);
+}
@@ -1,53 +1,745 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <regex.h>
+
+/*
+ * Small POSIX-ERE-style regex engine working directly on rb_string_t
+ * data/length (no NUL-terminated copies, no truncation).
+ *
+ * Patterns compile to a Pike VM program that is simulated breadth-first:
+ * matching is O(text × program) and never backtracks. The program is
+ * heap-allocated and grows with the pattern up to RB_REGEX_MAX_INSTS;
+ * identical character classes share one entry. Search scratch is sized
+ * by the program, on the stack (at most RB_REGEX_STACK_SCRATCH bytes)
+ * when it fits and on the heap otherwise, so stack use is bounded
+ * regardless of input length. Like regexec(), a search returns the
+ * leftmost-longest match.
+ *
+ * A pattern that does not compile raises an error (catchable with TRY)
+ * rather than reading as "no match".
+ *
+ * Supported: literals, ".", "[...]" / "[^...]" with ranges and
+ * [:alpha:]-style classes, \d \w \s \D \W \S, "^", "$", "*", "+", "?",
+ * "{m}", "{m,}", "{m,n}", "|" and "( )" grouping.
+ */
+
+#ifndef RB_REGEX_MAX_INSTS
+#define RB_REGEX_MAX_INSTS 1024
+#endif
+#ifndef RB_REGEX_STACK_SCRATCH
+#define RB_REGEX_STACK_SCRATCH 1024
+#endif
+#define RB_REGEX_MAX_CLASSES 255
+#define RB_REGEX_MAX_DEPTH 8
+#define RB_REGEX_MAX_REPEAT 16
+#define RE_NO_TARGET 0xFFFF
+
+#if RB_REGEX_MAX_INSTS > 0xFFFE
+#error "RB_REGEX_MAX_INSTS must fit in a uint16_t target"
+#endif
+
+typedef uint16_t re_pc_t;
+
+enum {
+    RE_CHAR,   /* arg: byte */
+    RE_ANY,
+    RE_CLASS,  /* arg: class index */
+    RE_SPLIT,  /* x, y */
+    RE_JMP,    /* x */
+    RE_BOL,
+    RE_EOL,
+    RE_MATCH,
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t arg;
+    re_pc_t x;
+    re_pc_t y;
+} re_inst_t;
+
+typedef struct {
+    re_inst_t* insts;
+    int32_t n;
+    int32_t cap;
+    uint8_t (*classes)[32];  /* 256-bit byte sets */
+    int32_t nclasses;
+} re_prog_t;
+
+static void re_prog_free(re_prog_t* prog) {
+    free(prog->insts);
+    free(prog->classes);
+    memset(prog, 0, sizeof(*prog));
+}
+
+/* ── Compiler ─────────────────────────────────────────── */
+
+typedef struct {
+    const char* p;
+    const char* end;
+    re_prog_t* prog;
+    int ok;
+    int too_big;  /* failed on a size limit rather than on syntax */
+} re_compiler_t;
+
+/* Make room for `extra` more instructions, growing the program as needed. */
+static int re_reserve(re_compiler_t* c, int extra) {
+    re_prog_t* p = c->prog;
+    if (p->n + extra <= p->cap) return 1;
+    if (p->n + extra > RB_REGEX_MAX_INSTS) {
+        c->ok = 0;
+        c->too_big = 1;
+        return 0;
+    }
+    int32_t cap = p->cap * 2;
+    if (cap < p->n + extra) cap = p->n + extra;
+    if (cap > RB_REGEX_MAX_INSTS) cap = RB_REGEX_MAX_INSTS;
+    re_inst_t* insts = (re_inst_t*)realloc(p->insts, (size_t)cap * sizeof(re_inst_t));
+    if (!insts) rb_panic("out of memory in REGEX");
+    p->insts = insts;
+    p->cap = cap;
+    return 1;
+}
+
+static int re_emit(re_compiler_t* c, uint8_t op, uint8_t arg, re_pc_t x, re_pc_t y) {
+    if (!re_reserve(c, 1)) return 0;
+    re_inst_t* i = &c->prog->insts[c->prog->n];
+    i->op = op;
+    i->arg = arg;
+    i->x = x;
+    i->y = y;
+    return c->prog->n++;
+}
+
+static int re_has_target(uint8_t op) {
+    return op == RE_SPLIT || op == RE_JMP;
+}
+
+/* Shift [at, n) up by one and put a SPLIT at `at`. Jumps inside the moved
+ * block that land in [at, n] move with it; code before `at` only ever
+ * targets positions <= at, which stay valid as the new entry point. */
+static void re_insert_split(re_compiler_t* c, int at, re_pc_t x, re_pc_t y) {
+    re_prog_t* p = c->prog;
+    if (!re_reserve(c, 1)) return;
+    memmove(&p->insts[at + 1], &p->insts[at], (size_t)(p->n - at) * sizeof(re_inst_t));
+    p->n++;
+    for (int i = at + 1; i < p->n; i++) {
+        re_inst_t* in = &p->insts[i];
+        if (!re_has_target(in->op)) continue;
+        if (in->x != RE_NO_TARGET && in->x >= at) in->x++;
+        if (in->op == RE_SPLIT && in->y != RE_NO_TARGET && in->y >= at) in->y++;
+    }
+    p->insts[at].op = RE_SPLIT;
+    p->insts[at].arg = 0;
+    p->insts[at].x = x;
+    p->insts[at].y = y;
+}
+
+/* Append a copy of template block `t` (compiled at `origin`) at the end. */
+static int re_emit_block(re_compiler_t* c, const re_inst_t* t, int len, int origin) {
+    int at = c->prog->n;
+    if (!re_reserve(c, len)) return at;
+    for (int i = 0; i < len; i++) {
+        re_inst_t in = t[i];
+        if (re_has_target(in.op)) {
+            in.x = (re_pc_t)(in.x - origin + at);
+            if (in.op == RE_SPLIT) in.y = (re_pc_t)(in.y - origin + at);
+        }
+        c->prog->insts[at + i] = in;
+    }
+    c->prog->n += len;
+    return at;
+}
+
+/* Rewrite the atom compiled at [start, n) as atom{min,max}; max < 0 is unbounded. */
+static void re_repeat(re_compiler_t* c, int start, int min, int max) {
+    re_prog_t* p = c->prog;
+    int len = p->n - start;
+    if (len == 0) return;
+    re_inst_t* t = (re_inst_t*)malloc((size_t)len * sizeof(re_inst_t));
+    if (!t) rb_panic("out of memory in REGEX");
+    memcpy(t, &p->insts[start], (size_t)len * sizeof(re_inst_t));
+    p->n = start;
+
+    int last = -1;
+    for (int i = 0; i < min && c->ok; i++) {
+        last = re_emit_block(c, t, len, start);
+    }
+    if (max < 0) {
+        if (last >= 0) {
+            /* x+ : loop back over the last copy */
+            int here = p->n;
+            re_emit(c, RE_SPLIT, 0, (re_pc_t)last, (re_pc_t)(here + 1));
+        } else {
+            /* x* */
+            int split = re_emit(c, RE_SPLIT, 0, 0, 0);
+            re_emit_block(c, t, len, start);
+            re_emit(c, RE_JMP, 0, (re_pc_t)split, 0);
+            if (c->ok) {
+                p->insts[split].x = (re_pc_t)(split + 1);
+                p->insts[split].y = (re_pc_t)p->n;
+            }
+        }
+        free(t);
+        return;
+    }
+    for (int i = min; i < max && c->ok; i++) {
+        /* x? */
+        int split = re_emit(c, RE_SPLIT, 0, 0, 0);
+        re_emit_block(c, t, len, start);
+        if (c->ok) {
+            p->insts[split].x = (re_pc_t)(split + 1);
+            p->insts[split].y = (re_pc_t)p->n;
+        }
+    }
+    free(t);
+}
+
+/* Emit a CLASS for `set`, reusing an identical class already in the program. */
+static void re_emit_class(re_compiler_t* c, const uint8_t* set) {
+    re_prog_t* p = c->prog;
+    int idx = 0;
+    while (idx < p->nclasses && memcmp(p->classes[idx], set, 32) != 0) idx++;
+    if (idx == p->nclasses) {
+        if (p->nclasses >= RB_REGEX_MAX_CLASSES) {
+            c->ok = 0;
+            c->too_big = 1;
+            return;
+        }
+        uint8_t (*classes)[32] = realloc(p->classes, (size_t)(p->nclasses + 1) * 32);
+        if (!classes) rb_panic("out of memory in REGEX");
+        p->classes = classes;
+        memcpy(p->classes[p->nclasses++], set, 32);
+    }
+    re_emit(c, RE_CLASS, (uint8_t)idx, 0, 0);
+}
+
+static void re_set(uint8_t* set, int ch) {
+    set[(uint8_t)ch >> 3] |= (uint8_t)(1u << (ch & 7));
+}
+
+static void re_set_range(uint8_t* set, int lo, int hi) {
+    for (int ch = lo; ch <= hi; ch++) re_set(set, ch);
+}
+
+/* Add a named class (\d, [:alpha:], ...) to `set`; returns 0 if unknown. */
+static int re_named_class(uint8_t* set, const char* name, int len) {
+    #define RE_IS(s) (len == (int)sizeof(s) - 1 && memcmp(name, s, len) == 0)
+    if (RE_IS("digit") || RE_IS("d")) {
+        re_set_range(set, '0', '9');
+    } else if (RE_IS("alpha")) {
+        re_set_range(set, 'a', 'z');
+        re_set_range(set, 'A', 'Z');
+    } else if (RE_IS("alnum")) {
+        re_set_range(set, 'a', 'z');
+        re_set_range(set, 'A', 'Z');
+        re_set_range(set, '0', '9');
+    } else if (RE_IS("w")) {
+        re_set_range(set, 'a', 'z');
+        re_set_range(set, 'A', 'Z');
+        re_set_range(set, '0', '9');
+        re_set(set, '_');
+    } else if (RE_IS("space") || RE_IS("s")) {
+        re_set(set, ' ');
+        re_set_range(set, '\t', '\r');
+    } else if (RE_IS("upper")) {
+        re_set_range(set, 'A', 'Z');
+    } else if (RE_IS("lower")) {
+        re_set_range(set, 'a', 'z');
+    } else if (RE_IS("xdigit")) {
+        re_set_range(set, '0', '9');
+        re_set_range(set, 'a', 'f');
+        re_set_range(set, 'A', 'F');
+    } else if (RE_IS("punct")) {
+        re_set_range(set, '!', '/');
+        re_set_range(set, ':', '@');
+        re_set_range(set, '[', '`');
+        re_set_range(set, '{', '~');
+    } else {
+        return 0;
+    }
+    #undef RE_IS
+    return 1;
+}
+
+static void re_invert(uint8_t* set) {
+    for (int i = 0; i < 32; i++) set[i] = (uint8_t)~set[i];
+}
+
+static int re_escape_char(char e) {
+    switch (e) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        default: return (uint8_t)e;
+    }
+}
+
+static void re_parse_bracket(re_compiler_t* c) {
+    uint8_t set[32] = {0};
+    int negate = 0;
+    if (c->p < c->end && *c->p == '^') {
+        negate = 1;
+        c->p++;
+    }
+    int first = 1;
+    while (c->p < c->end && (*c->p != ']' || first)) {
+        first = 0;
+        int lo;
+        if (c->p + 1 < c->end && c->p[0] == '[' && c->p[1] == ':') {
+            const char* name = c->p + 2;
+            const char* q = name;
+            while (q + 1 < c->end && !(q[0] == ':' && q[1] == ']')) q++;
+            if (q + 1 >= c->end || !re_named_class(set, name, (int)(q - name))) {
+                c->ok = 0;
+                return;
+            }
+            c->p = q + 2;
+            continue;
+        }
+        if (*c->p == '\\' && c->p + 1 < c->end) {
+            char e = c->p[1];
+            c->p += 2;
+            if (e == 'd' || e == 'w' || e == 's') {
+                re_named_class(set, &e, 1);
+                continue;
+            }
+            lo = re_escape_char(e);
+        } else {
+            lo = (uint8_t)*c->p++;
+        }
+        int hi = lo;
+        if (c->p + 1 < c->end && c->p[0] == '-' && c->p[1] != ']') {
+            c->p++;
+            if (*c->p == '\\' && c->p + 1 < c->end) {
+                hi = re_escape_char(c->p[1]);
+                c->p += 2;
+            } else {
+                hi = (uint8_t)*c->p++;
+            }
+        }
+        if (hi < lo) {
+            c->ok = 0;
+            return;
+        }
+        re_set_range(set, lo, hi);
+    }
+    if (c->p >= c->end) {
+        c->ok = 0;
+        return;
+    }
+    c->p++;  /* ']' */
+    if (negate) re_invert(set);
+    re_emit_class(c, set);
+}
+
+static int re_parse_int(re_compiler_t* c, int* out) {
+    int v = 0, digits = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        v = v * 10 + (*c->p++ - '0');
+        if (v > RB_REGEX_MAX_REPEAT) v = RB_REGEX_MAX_REPEAT + 1;
+        digits++;
+    }
+    *out = v;
+    return digits > 0;
+}
+
+static void re_parse_alt(re_compiler_t* c, int depth);
+
+static void re_parse_atom(re_compiler_t* c, int depth) {
+    char ch = *c->p++;
+    switch (ch) {
+        case '(':
+            if (depth >= RB_REGEX_MAX_DEPTH) {
+                c->ok = 0;
+                c->too_big = 1;
+                return;
+            }
+            re_parse_alt(c, depth + 1);
+            if (c->p >= c->end || *c->p != ')') {
+                c->ok = 0;
+                return;
+            }
+            c->p++;
+            break;
+        case '.':
+            re_emit(c, RE_ANY, 0, 0, 0);
+            break;
+        case '[':
+            re_parse_bracket(c);
+            break;
+        case '^':
+            re_emit(c, RE_BOL, 0, 0, 0);
+            break;
+        case '$':
+            re_emit(c, RE_EOL, 0, 0, 0);
+            break;
+        case '\\': {
+            if (c->p >= c->end) {
+                c->ok = 0;
+                return;
+            }
+            char e = *c->p++;
+            char lower = (char)(e | 0x20);
+            if (lower == 'd' || lower == 'w' || lower == 's') {
+                uint8_t set[32] = {0};
+                re_named_class(set, &lower, 1);
+                if (e != lower) re_invert(set);
+                re_emit_class(c, set);
+            } else {
+                re_emit(c, RE_CHAR, (uint8_t)re_escape_char(e), 0, 0);
+            }
+            break;
+        }
+        case '*':
+        case '+':
+        case '?':
+            c->ok = 0;  /* quantifier with nothing to repeat */
+            break;
+        default:
+            re_emit(c, RE_CHAR, (uint8_t)ch, 0, 0);
+            break;
+    }
+}
+
+/* Parse a quantifier after an atom; returns 0 if there is none. */
+static int re_parse_quantifier(re_compiler_t* c, int* min, int* max) {
+    if (c->p >= c->end) return 0;
+    switch (*c->p) {
+        case '*': c->p++; *min = 0; *max = -1; return 1;
+        case '+': c->p++; *min = 1; *max = -1; return 1;
+        case '?': c->p++; *min = 0; *max = 1; return 1;
+        case '{': {
+            const char* save = c->p;
+            c->p++;
+            if (!re_parse_int(c, min)) {
+                c->p = save;  /* a literal '{' */
+                return 0;
+            }
+            *max = *min;
+            if (c->p < c->end && *c->p == ',') {
+                c->p++;
+                if (!re_parse_int(c, max)) *max = -1;
+            }
+            if (c->p >= c->end || *c->p != '}' || (*max >= 0 && *max < *min)) {
+                c->ok = 0;
+                return 0;
+            }
+            if (*min > RB_REGEX_MAX_REPEAT || *max > RB_REGEX_MAX_REPEAT) {
+                c->ok = 0;
+                c->too_big = 1;
+                return 0;
+            }
+            c->p++;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+static void re_parse_alt(re_compiler_t* c, int depth) {
+    int branch = c->prog->n;
+    /* Pending "JMP end" instructions are chained through their x field */
+    int last_jump = RE_NO_TARGET;
+    for (;;) {
+        while (c->ok && c->p < c->end && *c->p != '|' && *c->p != ')') {
+            int start = c->prog->n;
+            if (*c->p == '{') {
+                re_emit(c, RE_CHAR, (uint8_t)*c->p++, 0, 0);
+            } else {
+                re_parse_atom(c, depth);
+            }
+            int min, max;
+            while (c->ok && re_parse_quantifier(c, &min, &max)) {
+                re_repeat(c, start, min, max);
+            }
+        }
+        if (!c->ok || c->p >= c->end || *c->p != '|') break;
+        c->p++;
+        /* branch | rest  →  SPLIT branch, rest; branch; JMP end; rest */
+        re_insert_split(c, branch, (re_pc_t)(branch + 1), RE_NO_TARGET);
+        int j = re_emit(c, RE_JMP, 0, (re_pc_t)last_jump, 0);
+        if (!c->ok) break;
+        last_jump = j;
+        c->prog->insts[branch].y = (re_pc_t)c->prog->n;
+        branch = c->prog->n;
+    }
+    if (!c->ok) return;
+    while (last_jump != RE_NO_TARGET) {
+        re_inst_t* in = &c->prog->insts[last_jump];
+        last_jump = in->x;
+        in->x = (re_pc_t)c->prog->n;
+    }
+}
+
+/* Compile into `prog` (freeing what it held); returns NULL or an error message. */
+static const char* re_compile(re_prog_t* prog, const char* pattern, int32_t len) {
+    re_compiler_t c = { pattern, pattern + len, prog, 1, 0 };
+    re_prog_free(prog);
+    /* One instruction per pattern byte plus MATCH covers most patterns */
+    re_reserve(&c, len < RB_REGEX_MAX_INSTS ? len + 1 : RB_REGEX_MAX_INSTS);
+    re_parse_alt(&c, 0);
+    if (c.p < c.end) c.ok = 0;  /* unbalanced ')' */
+    re_emit(&c, RE_MATCH, 0, 0, 0);
+    if (c.ok) return NULL;
+    re_prog_free(prog);
+    return c.too_big ? "regex pattern too complex" : "invalid regex pattern";
+}
+
+/* ── Pike VM ──────────────────────────────────────────── */
+
+typedef struct {
+    int32_t n;
+    int32_t* start;
+    re_pc_t* pc;
+} re_threads_t;
+
+/* Add the thread at `pc` and everything reachable through SPLIT / JMP /
+ * zero-width assertions. `mark` dedups per position; the first thread to
+ * reach a pc wins, which keeps the list ordered by start offset. */
+static void re_add_thread(const re_prog_t* prog, re_threads_t* list, int32_t* mark,
+                          re_pc_t* stack, int32_t gen, re_pc_t pc0, int32_t start,
+                          int32_t pos, int32_t len) {
+    int sp = 0;  /* `stack` holds 2n + 1: each pc pushes at most twice */
+    stack[sp++] = pc0;
+    while (sp > 0) {
+        re_pc_t pc = stack[--sp];
+        if (mark[pc] == gen) continue;
+        mark[pc] = gen;
+        const re_inst_t* in = &prog->insts[pc];
+        switch (in->op) {
+            case RE_JMP:
+                stack[sp++] = in->x;
+                break;
+            case RE_SPLIT:
+                /* Push y first so x is explored first */
+                stack[sp++] = in->y;
+                stack[sp++] = in->x;
+                break;
+            case RE_BOL:
+                if (pos == 0) stack[sp++] = (re_pc_t)(pc + 1);
+                break;
+            case RE_EOL:
+                if (pos == len) stack[sp++] = (re_pc_t)(pc + 1);
+                break;
+            default:
+                list->pc[list->n] = pc;
+                list->start[list->n] = start;
+                list->n++;
+                break;
+        }
+    }
+}
+
+/* Find the leftmost-longest match in text[from..len). */
+static int re_search(const re_prog_t* prog, const char* text, int32_t len, int32_t from,
+                     int32_t* match_start, int32_t* match_end) {
+    /* Scratch per instruction: mark, two thread lists and the add stack */
+    int32_t n = prog->n;
+    size_t need = (size_t)n * 3 * sizeof(int32_t) + (size_t)(4 * n + 1) * sizeof(re_pc_t);
+    int32_t local[RB_REGEX_STACK_SCRATCH / sizeof(int32_t)];
+    int32_t* scratch = need <= sizeof(local) ? local : (int32_t*)malloc(need);
+    if (!scratch) rb_panic("out of memory in REGEX");
+    re_threads_t lists[2];
+    int32_t* mark = scratch;
+    lists[0].start = mark + n;
+    lists[1].start = lists[0].start + n;
+    lists[0].pc = (re_pc_t*)(lists[1].start + n);
+    lists[1].pc = lists[0].pc + n;
+    re_pc_t* stack = lists[1].pc + n;
+    for (int i = 0; i < n; i++) mark[i] = -1;
+    re_threads_t* clist = &lists[0];
+    re_threads_t* nlist = &lists[1];
+    clist->n = 0;
+    int32_t best_s = -1, best_e = -1;
+
+    for (int32_t pos = from; ; pos++) {
+        /* Seed a new attempt at this offset until something has matched */
+        if (best_s < 0) re_add_thread(prog, clist, mark, stack, pos, 0, pos, pos, len);
+        else if (clist->n == 0) break;
+
+        int c = pos < len ? (uint8_t)text[pos] : -1;
+        nlist->n = 0;
+        for (int i = 0; i < clist->n; i++) {
+            const re_inst_t* in = &prog->insts[clist->pc[i]];
+            int32_t start = clist->start[i];
+            if (best_s >= 0 && start > best_s) continue;
+            int step = 0;
+            switch (in->op) {
+                case RE_MATCH:
+                    if (best_s < 0 || start < best_s || (start == best_s && pos > best_e)) {
+                        best_s = start;
+                        best_e = pos;
+                    }
+                    break;
+                case RE_CHAR:
+                    step = c == in->arg;
+                    break;
+                case RE_ANY:
+                    step = c >= 0;
+                    break;
+                case RE_CLASS:
+                    step = c >= 0 && (prog->classes[in->arg][c >> 3] & (1u << (c & 7)));
+                    break;
+            }
+            if (step) {
+                re_add_thread(prog, nlist, mark, stack, pos + 1, (re_pc_t)(clist->pc[i] + 1),
+                              start, pos + 1, len);
+            }
+        }
+        re_threads_t* tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+        if (pos >= len) break;
+    }
+
+    if (scratch != local) free(scratch);
+    if (best_s < 0) return 0;
+    *match_start = best_s;
+    *match_end = best_e;
+    return 1;
+}
+
+/* ── Compiled pattern cache ──────────────────────────────
+ *
+ * Programs tend to apply the same handful of patterns to every incoming
+ * line, so compiled programs are kept in a small LRU keyed by the pattern
+ * text instead of being rebuilt on every call. Patterns longer than
+ * RB_REGEX_MAX_PATTERN are recompiled on every call into a spare slot.
+ * A pattern that fails to compile raises the error and yields NULL.
+ *
+ * Each task has its own cache, allocated on its first REGEX call and
+ * freed by rb_regex_release_task(), so tasks never evict or recompile a
+ * program another task is still searching, and no lock is needed.
+ */
+
+#ifndef RB_REGEX_CACHE_SIZE
+#define RB_REGEX_CACHE_SIZE 4
+#endif
+#define RB_REGEX_MAX_PATTERN 128
+
+typedef struct {
+    int valid;
+    uint32_t last_used;
+    int32_t pattern_len;
+    char pattern[RB_REGEX_MAX_PATTERN];
+    re_prog_t prog;
+} regex_cache_entry_t;
+
+typedef struct {
+    regex_cache_entry_t entries[RB_REGEX_CACHE_SIZE];
+    uint32_t tick;
+    re_prog_t uncached;
+} regex_cache_t;
+
+static RB_THREAD_LOCAL regex_cache_t* regex_cache = NULL;
+
+void rb_regex_release_task(void) {
+    if (!regex_cache) return;
+    for (int i = 0; i < RB_REGEX_CACHE_SIZE; i++) re_prog_free(&regex_cache->entries[i].prog);
+    re_prog_free(&regex_cache->uncached);
+    free(regex_cache);
+    regex_cache = NULL;
+}
+
+static const re_prog_t* regex_failed(const char* error) {
+    rb_string_t* message = rb_string_alloc(error);
+    rb_throw(message);
+    rb_string_release(message);
+    return NULL;
+}
+
+static const re_prog_t* regex_lookup(rb_string_t* pattern) {
+    if (!pattern) return NULL;
+    regex_cache_t* cache = regex_cache;
+    if (!cache) {
+        cache = (regex_cache_t*)calloc(1, sizeof(regex_cache_t));
+        if (!cache) rb_panic("out of memory in REGEX");
+        regex_cache = cache;
+    }
+    int32_t len = pattern->length;
+    const char* error;
+    if (len > RB_REGEX_MAX_PATTERN) {
+        error = re_compile(&cache->uncached, pattern->data, len);
+        return error ? regex_failed(error) : &cache->uncached;
+    }
+
+    regex_cache_entry_t* victim = &cache->entries[0];
+    for (int i = 0; i < RB_REGEX_CACHE_SIZE; i++) {
+        regex_cache_entry_t* e = &cache->entries[i];
+        if (e->valid && e->pattern_len == len && memcmp(e->pattern, pattern->data, len) == 0) {
+            e->last_used = ++cache->tick;
+            return &e->prog;
+        }
+        if (!e->valid || (victim->valid && e->last_used < victim->last_used)) {
+            victim = e;
+        }
+    }
+
+    /* Miss: compile into the least recently used slot */
+    victim->valid = 0;
+    error = re_compile(&victim->prog, pattern->data, len);
+    if (error) return regex_failed(error);
+    memcpy(victim->pattern, pattern->data, len);
+    victim->pattern_len = len;
+    victim->valid = 1;
+    victim->last_used = ++cache->tick;
+    return &victim->prog;
+}
+
+/* ── REGEX.MATCH / FIND$ / REPLACE$ ───────────────────── */
 
 int32_t rb_regex_match(rb_string_t* pattern, rb_string_t* text) {
-    char pat[256], txt[4096];
-    snprintf(pat, sizeof(pat), "%.*s", pattern->len, pattern->data);
-    snprintf(txt, sizeof(txt), "%.*s", text->len, text->data);
-    regex_t re;
-    if (regcomp(&re, pat, REG_EXTENDED | REG_NOSUB) != 0) return 0;
-    int result = (regexec(&re, txt, 0, NULL, 0) == 0) ? 1 : 0;
-    regfree(&re);
-    return result;
+    const re_prog_t* prog = regex_lookup(pattern);
+    if (!prog || !text) return 0;
+    int32_t s, e;
+    return re_search(prog, text->data, text->length, 0, &s, &e);
 }
 
 rb_string_t* rb_regex_find(rb_string_t* pattern, rb_string_t* text) {
-    char pat[256], txt[4096];
-    snprintf(pat, sizeof(pat), "%.*s", pattern->len, pattern->data);
-    snprintf(txt, sizeof(txt), "%.*s", text->len, text->data);
-    regex_t re;
-    regmatch_t match;
-    if (regcomp(&re, pat, REG_EXTENDED) != 0) return rb_string_from_cstr("");
-    if (regexec(&re, txt, 1, &match, 0) == 0) {
-        int len = match.rm_eo - match.rm_so;
-        char buf[4096];
-        snprintf(buf, sizeof(buf), "%.*s", len, txt + match.rm_so);
-        regfree(&re);
-        return rb_string_from_cstr(buf);
-    }
-    regfree(&re);
-    return rb_string_from_cstr("");
+    const re_prog_t* prog = regex_lookup(pattern);
+    int32_t s, e;
+    if (!prog || !text || !re_search(prog, text->data, text->length, 0, &s, &e)) {
+        return rb_string_alloc("");
+    }
+    return rb_string_slice(text, s, e - s);
 }
 
 rb_string_t* rb_regex_replace(rb_string_t* pattern, rb_string_t* text, rb_string_t* replacement) {
-    char pat[256], txt[4096], rep[4096];
-    snprintf(pat, sizeof(pat), "%.*s", pattern->len, pattern->data);
-    snprintf(txt, sizeof(txt), "%.*s", text->len, text->data);
-    snprintf(rep, sizeof(rep), "%.*s", replacement->len, replacement->data);
-    regex_t re;
-    regmatch_t match;
-    if (regcomp(&re, pat, REG_EXTENDED) != 0) return rb_string_from_cstr(txt);
-    char result[8192] = "";
-    char *pos = txt;
-    while (regexec(&re, pos, 1, &match, 0) == 0) {
-        strncat(result, pos, match.rm_so);
-        strcat(result, rep);
-        pos += match.rm_eo;
-    }
-    strcat(result, pos);
-    regfree(&re);
-    return rb_string_from_cstr(result);
+    if (!text) return rb_string_alloc("");
+    const re_prog_t* prog = regex_lookup(pattern);
+    if (!prog) {
+        rb_string_retain(text);
+        return text;
+    }
+    const char* rep = replacement ? replacement->data : "";
+    int32_t rep_len = replacement ? replacement->length : 0;
+
+    rb_string_t* result = NULL;
+    int32_t copied = 0;  /* text[0..copied) is already in result */
+    int32_t pos = 0;
+    int32_t s, e;
+    while (pos <= text->length && re_search(prog, text->data, text->length, pos, &s, &e)) {
+        if (!result) result = rb_string_new_with_capacity(0, text->length + rep_len);
+        result = rb_string_append_bytes(result, text->data + copied, s - copied);
+        result = rb_string_append_bytes(result, rep, rep_len);
+        copied = e;
+        /* An empty match must still make progress */
+        pos = (e > s) ? e : e + 1;
+        if (e == s && s < text->length) {
+            result = rb_string_append_bytes(result, text->data + s, 1);
+            copied = s + 1;
+        }
+    }
+    if (!result) {
+        /* No match: hand back the input itself */
+        rb_string_retain(text);
+        return text;
+    }
+    if (copied < text->length) {
+        result = rb_string_append_bytes(result, text->data + copied, text->length - copied);
+    }
+    return result;
 }
@@ -0,0 +1,196 @@
+#include "rb_runtime.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_STRING_BUILDERS 8
+#define SB_INITIAL_CAPACITY 64
+#define SB_JSON_MAX_DEPTH 32
+
+typedef struct {
+    int in_use;
+    rb_string_t* buf;   /* accumulated text; NULL until the first append */
+    int32_t reserve;    /* capacity to start from after SB.CLEAR */
+    /* JSON writer state, one bit per open container */
+    int32_t json_depth;
+    uint32_t json_is_array;
+    uint32_t json_has_items;
+} rb_sb_t;
+
+static rb_sb_t builders[MAX_STRING_BUILDERS];
+
+static rb_sb_t* sb_get(int32_t handle) {
+    if (handle < 0 || handle >= MAX_STRING_BUILDERS) return NULL;
+    if (!builders[handle].in_use) return NULL;
+    return &builders[handle];
+}
+
+static void sb_append(rb_sb_t* sb, const char* data, int32_t len) {
+    if (!sb->buf) {
+        sb->buf = rb_string_new_with_capacity(0, sb->reserve);
+    }
+    /* A builder whose text was handed out by SB.TOSTRING is shared, so
+     * rb_string_append_bytes copies it before writing (copy-on-write). */
+    sb->buf = rb_string_append_bytes(sb->buf, data, len);
+}
+
+int32_t rb_sb_new(void) {
+    for (int i = 0; i < MAX_STRING_BUILDERS; i++) {
+        if (!builders[i].in_use) {
+            builders[i].in_use = 1;
+            builders[i].buf = NULL;
+            builders[i].reserve = SB_INITIAL_CAPACITY;
+            builders[i].json_depth = 0;
+            return i;
+        }
+    }
+    fprintf(stderr, "Too many string builders\n");
+    return -1;
+}
+
+void rb_sb_append_int(int32_t handle, int32_t value) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    char tmp[RB_FMT_INT_MAX];
+    sb_append(sb, tmp, rb_fmt_int(tmp, value));
+}
+
+void rb_sb_append_float(int32_t handle, float value) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    char tmp[RB_FMT_FLOAT_MAX];
+    sb_append(sb, tmp, rb_fmt_float(tmp, value));
+}
+
+void rb_sb_append_str(int32_t handle, rb_string_t* s) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb || !s) return;
+    sb_append(sb, s->data, s->length);
+}
+
+rb_string_t* rb_sb_tostring(int32_t handle) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb || !sb->buf) return rb_string_alloc("");
+    /* Share the buffer instead of copying it */
+    rb_string_retain(sb->buf);
+    return sb->buf;
+}
+
+void rb_sb_clear(int32_t handle) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    if (sb->buf) {
+        if (sb->buf->capacity > sb->reserve) sb->reserve = sb->buf->capacity;
+        rb_string_release(sb->buf);
+        sb->buf = NULL;
+    }
+    sb->json_depth = 0;
+}
+
+void rb_sb_free(int32_t handle) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    rb_string_release(sb->buf);
+    sb->buf = NULL;
+    sb->in_use = 0;
+}
+
+/* ── JSON writer ─────────────────────────────────────────
+ *
+ * Serializes straight into a builder's buffer in one pass: the writer only
+ * tracks, per open container, whether it is an array and whether it needs a
+ * comma before the next member.
+ */
+
+static void sb_json_escaped(rb_sb_t* sb, const char* s, int32_t len) {
+    static const char hex[] = "0123456789abcdef";
+    sb_append(sb, "\"", 1);
+    int32_t run = 0;  /* start of the pending unescaped run */
+    for (int32_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        sb_append(sb, s + run, i - run);
+        run = i + 1;
+        char esc[6] = { '\\', 0 };
+        int n = 2;
+        switch (c) {
+            case '"': esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+                esc[4] = hex[c >> 4]; esc[5] = hex[c & 0xF];
+                n = 6;
+                break;
+        }
+        sb_append(sb, esc, n);
+    }
+    sb_append(sb, s + run, len - run);
+    sb_append(sb, "\"", 1);
+}
+
+/* Emit the separator and, inside an object, the key for the next member. */
+static void sb_json_member(rb_sb_t* sb, rb_string_t* key) {
+    if (sb->json_depth > 0) {
+        uint32_t bit = 1u << (sb->json_depth - 1);
+        if (sb->json_has_items & bit) sb_append(sb, ",", 1);
+        sb->json_has_items |= bit;
+        if (!(sb->json_is_array & bit)) {
+            sb_json_escaped(sb, key ? key->data : "", key ? key->length : 0);
+            sb_append(sb, ":", 1);
+        }
+    }
+}
+
+void rb_json_begin(int32_t handle, rb_string_t* key, int32_t is_array) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    if (sb->json_depth >= SB_JSON_MAX_DEPTH) {
+        fprintf(stderr, "JSON writer nested too deeply\n");
+        return;
+    }
+    sb_json_member(sb, key);
+    uint32_t bit = 1u << sb->json_depth;
+    if (is_array) sb->json_is_array |= bit;
+    else sb->json_is_array &= ~bit;
+    sb->json_has_items &= ~bit;
+    sb->json_depth++;
+    sb_append(sb, is_array ? "[" : "{", 1);
+}
+
+void rb_json_end(int32_t handle) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb || sb->json_depth == 0) return;
+    sb->json_depth--;
+    sb_append(sb, (sb->json_is_array & (1u << sb->json_depth)) ? "]" : "}", 1);
+}
+
+void rb_json_add_int(int32_t handle, rb_string_t* key, int32_t value) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    sb_json_member(sb, key);
+    char tmp[RB_FMT_INT_MAX];
+    sb_append(sb, tmp, rb_fmt_int(tmp, value));
+}
+
+void rb_json_add_float(int32_t handle, rb_string_t* key, float value) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    sb_json_member(sb, key);
+    if (!isfinite(value)) {
+        /* NaN and infinities have no JSON representation */
+        sb_append(sb, "null", 4);
+        return;
+    }
+    char tmp[RB_FMT_FLOAT_MAX];
+    sb_append(sb, tmp, rb_fmt_float(tmp, value));
+}
+
+void rb_json_add_str(int32_t handle, rb_string_t* key, rb_string_t* value) {
+    rb_sb_t* sb = sb_get(handle);
+    if (!sb) return;
+    sb_json_member(sb, key);
+    sb_json_escaped(sb, value ? value->data : "", value ? value->length : 0);
+}
@@ -0,0 +1,200 @@
+#include "rb_runtime.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ── Number parsing ───────────────────────────────────────
+ *
+ * VAL, VAL.NEXT and INPUT parse numbers here rather than through atof:
+ * strtod is locale-aware, works in double and, on newlib, allocates big
+ * integers for every call. These read the bytes of a string in place (no
+ * NUL terminator needed) and report how much they consumed.
+ *
+ * Digits are accumulated into a 64-bit integer. With at most 7 digits and
+ * an exponent within +-10, one float multiply or divide by an exact power
+ * of ten gives the correctly rounded result; up to 15 digits and +-22, the
+ * same in double, checked for the rare case where rounding again to float
+ * is ambiguous. Anything else (very long or extreme literals) goes to
+ * strtof.
+ */
+
+#define SCAN_COPY_MAX 64
+
+static int scan_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int scan_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const float scan_pow10f[11] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+static const double scan_pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* m * 10^e10 rounded to float, or 0 in *ok if that needs strtof */
+static float scan_fast(uint64_t m, int32_t e10, int* ok) {
+    *ok = 1;
+    if (m == 0) return 0.0f;
+    if (m <= (1u << 24) && e10 >= -10 && e10 <= 10) {
+        float f = (float)m;
+        return e10 >= 0 ? f * scan_pow10f[e10] : f / scan_pow10f[-e10];
+    }
+    if (m <= (1ULL << 53) && e10 >= -22 && e10 <= 22) {
+        double d = (double)m;
+        d = e10 >= 0 ? d * scan_pow10[e10] : d / scan_pow10[-e10];
+        float f = (float)d;
+        if ((double)f != d) {
+            /* d is rounded already; rounding it to float again is only
+             * wrong if it landed exactly halfway between two floats */
+            float g = d > (double)f ? nextafterf(f, INFINITY) : nextafterf(f, 0.0f);
+            if (((double)f + (double)g) / 2 == d) *ok = 0;
+        }
+        return f;
+    }
+    *ok = 0;
+    return 0.0f;
+}
+
+float rb_scan_float(const char* data, int32_t len, int32_t* end) {
+    int32_t i = 0;
+    while (i < len && scan_blank(data[i])) i++;
+    int32_t start = i;
+    int neg = 0;
+    if (i < len && (data[i] == '+' || data[i] == '-')) neg = data[i++] == '-';
+
+    uint64_t m = 0;
+    int32_t digits = 0;     /* significant digits in m */
+    int32_t e10 = 0;
+    int any = 0;
+    int exact = 1;          /* no nonzero digit was dropped */
+    for (; i < len && scan_digit(data[i]); i++) {
+        any = 1;
+        if (digits < 19) {
+            m = m * 10 + (uint64_t)(data[i] - '0');
+            if (m) digits++;
+        } else {
+            e10++;
+            if (data[i] != '0') exact = 0;
+        }
+    }
+    if (i < len && data[i] == '.') {
+        i++;
+        for (; i < len && scan_digit(data[i]); i++) {
+            any = 1;
+            if (digits < 19) {
+                m = m * 10 + (uint64_t)(data[i] - '0');
+                if (m) digits++;
+                e10--;
+            } else if (data[i] != '0') {
+                exact = 0;
+            }
+        }
+    }
+    if (!any) {
+        if (end) *end = 0;
+        return 0.0f;
+    }
+    if (i < len && (data[i] == 'e' || data[i] == 'E')) {
+        int32_t j = i + 1;
+        int eneg = 0;
+        if (j < len && (data[j] == '+' || data[j] == '-')) eneg = data[j++] == '-';
+        if (j < len && scan_digit(data[j])) {
+            int32_t x = 0;
+            for (; j < len && scan_digit(data[j]); j++) {
+                if (x < 10000) x = x * 10 + (data[j] - '0');
+            }
+            e10 += eneg ? -x : x;
+            i = j;
+        }
+    }
+    if (end) *end = i;
+
+    int ok = 0;
+    float f = exact ? scan_fast(m, e10, &ok) : 0.0f;
+    if (!ok) {
+        char copy[SCAN_COPY_MAX];
+        int32_t n = i - start;
+        if (n < SCAN_COPY_MAX) {
+            memcpy(copy, data + start, (size_t)n);
+            copy[n] = '\0';
+            return strtof(copy, NULL);
+        }
+        char* heap = (char*)malloc((size_t)n + 1);
+        if (!heap) return 0.0f;
+        memcpy(heap, data + start, (size_t)n);
+        heap[n] = '\0';
+        f = strtof(heap, NULL);
+        free(heap);
+        return f;
+    }
+    return neg ? -f : f;
+}
+
+int32_t rb_scan_int(const char* data, int32_t len, int32_t* end) {
+    int32_t i = 0;
+    while (i < len && scan_blank(data[i])) i++;
+    int neg = 0;
+    if (i < len && (data[i] == '+' || data[i] == '-')) neg = data[i++] == '-';
+    if (i >= len || !scan_digit(data[i])) {
+        if (end) *end = 0;
+        return 0;
+    }
+    /* Saturates at the int32 range */
+    int64_t v = 0;
+    for (; i < len && scan_digit(data[i]); i++) {
+        if (v <= INT32_MAX) v = v * 10 + (data[i] - '0');
+    }
+    if (end) *end = i;
+    if (neg) v = -v;
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < INT32_MIN) return INT32_MIN;
+    return (int32_t)v;
+}
+
+/* ── VAL.NEXT ── */
+
+/* Past the rest of a field after its number is read: anything up to a
+ * blank, ',' or ';', the blanks, and one ',' or ';' */
+static int32_t scan_field_end(const char* data, int32_t len, int32_t i) {
+    while (i < len && !scan_blank(data[i]) && data[i] != ',' && data[i] != ';') i++;
+    while (i < len && scan_blank(data[i])) i++;
+    if (i < len && (data[i] == ',' || data[i] == ';')) i++;
+    return i;
+}
+
+/* *pos is 1-based, as in MID$ */
+static int32_t scan_field_start(rb_string_t* s, int32_t* pos) {
+    int32_t at = *pos > 0 ? *pos - 1 : 0;
+    while (s && at < s->length && scan_blank(s->data[at])) at++;
+    return at;
+}
+
+float rb_fn_val_next(rb_string_t* s, int32_t* pos) {
+    int32_t at = scan_field_start(s, pos);
+    if (!s || at >= s->length) {
+        *pos = (s ? s->length : 0) + 1;
+        return 0.0f;
+    }
+    int32_t used = 0;
+    float value = rb_scan_float(s->data + at, s->length - at, &used);
+    *pos = scan_field_end(s->data, s->length, at + used) + 1;
+    return value;
+}
+
+int32_t rb_fn_val_next_int(rb_string_t* s, int32_t* pos) {
+    int32_t at = scan_field_start(s, pos);
+    if (!s || at >= s->length) {
+        *pos = (s ? s->length : 0) + 1;
+        return 0;
+    }
+    int32_t used = 0;
+    int32_t value = rb_scan_int(s->data + at, s->length - at, &used);
+    *pos = scan_field_end(s->data, s->length, at + used) + 1;
+    return value;
+}
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 
+/* SD.READ$ without a byte count reads up to this much */
+#define SD_READ_DEFAULT 4096
+
 #ifdef ESP_PLATFORM
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
@@ -9,7 +12,6 @@
 #include "sdmmc_cmd.h"
 
 static const char *mount_point = "/sdcard";
-static FILE *current_file = NULL;
 
 void rb_sd_init(int32_t cs_pin) {
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
@@ -24,28 +26,20 @@ void rb_sd_init(int32_t cs_pin) {
     printf("[SD] Initialized with CS pin %d\n", cs_pin);
 }
 
-void rb_sd_open(rb_string_t* path, rb_string_t* mode) {
+static int32_t sd_open(int32_t h, rb_string_t* path, rb_string_t* mode) {
     char full[320];
-    snprintf(full, sizeof(full), "%s/%.*s", mount_point, path->len, path->data);
+    snprintf(full, sizeof(full), "%s/%.*s", mount_point, path->length, path->data);
     char m[8];
-    snprintf(m, sizeof(m), "%.*s", mode->len, mode->data);
-    current_file = fopen(full, m);
+    snprintf(m, sizeof(m), "%.*s", mode->length, mode->data);
+    return rb_fh_open(h, full, m);
 }
 
 void rb_sd_write(rb_string_t* data) {
-    if (current_file) fwrite(data->data, 1, data->len, current_file);
-}
-
-rb_string_t* rb_sd_read(void) {
-    if (!current_file) return rb_string_from_cstr("");
-    char buf[4096];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, current_file);
-    buf[n] = '\0';
-    return rb_string_from_cstr(buf);
+    rb_fh_write(RB_FH_SD, data);
 }
 
 void rb_sd_close(void) {
-    if (current_file) { fclose(current_file); current_file = NULL; }
+    rb_fh_close(RB_FH_SD);
 }
 
 int32_t rb_sd_free(void) {
@@ -57,35 +51,25 @@ int32_t rb_sd_free(void) {
 
 #else
 
-static FILE *current_file = NULL;
-
 void rb_sd_init(int32_t cs_pin) {
     printf("[SD] Initialized with CS pin %d (stub)\n", cs_pin);
 }
 
-void rb_sd_open(rb_string_t* path, rb_string_t* mode) {
+static int32_t sd_open(int32_t h, rb_string_t* path, rb_string_t* mode) {
     char p[256], m[8];
-    snprintf(p, sizeof(p), "./data/%.*s", path->len, path->data);
-    snprintf(m, sizeof(m), "%.*s", mode->len, mode->data);
-    current_file = fopen(p, m);
+    snprintf(p, sizeof(p), "./data/%.*s", path->length, path->data);
+    snprintf(m, sizeof(m), "%.*s", mode->length, mode->data);
     printf("[SD] Open %s mode %s (stub)\n", p, m);
+    return rb_fh_open(h, p, m);
 }
 
 void rb_sd_write(rb_string_t* data) {
-    if (current_file) fwrite(data->data, 1, data->len, current_file);
-    printf("[SD] Write %d bytes (stub)\n", data->len);
-}
-
-rb_string_t* rb_sd_read(void) {
-    if (!current_file) return rb_string_from_cstr("");
-    char buf[4096];
-    size_t n = fread(buf, 1, sizeof(buf) - 1, current_file);
-    buf[n] = '\0';
-    return rb_string_from_cstr(buf);
+    rb_fh_write(RB_FH_SD, data);
+    printf("[SD] Write %d bytes (stub)\n", data->length);
 }
 
 void rb_sd_close(void) {
-    if (current_file) { fclose(current_file); current_file = NULL; }
+    rb_fh_close(RB_FH_SD);
     printf("[SD] File closed (stub)\n");
 }
 
@@ -95,3 +79,20 @@ int32_t rb_sd_free(void) {
 }
 
 #endif
+
+/* Files on the card share FILE's handle table */
+void rb_sd_open(rb_string_t* path, rb_string_t* mode) {
+    sd_open(RB_FH_SD, path, mode);
+}
+
+int32_t rb_sd_open_handle(rb_string_t* path, rb_string_t* mode) {
+    return sd_open(-1, path, mode);
+}
+
+rb_string_t* rb_sd_read_n(int32_t max) {
+    return rb_fh_read(RB_FH_SD, max);
+}
+
+rb_string_t* rb_sd_read(void) {
+    return rb_fh_read(RB_FH_SD, SD_READ_DEFAULT);
+}
@@ -1,9 +1,38 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
 
 #ifdef ESP_PLATFORM
 #include "driver/spi_master.h"
 static spi_device_handle_t spi_handle = NULL;
+
+/* ── Bulk transfers ───────────────────────────────────────
+ *
+ * SPI.SEND queues the whole string as DMA transactions of up to
+ * SPI_MAX_TRANSFER bytes and returns; the string is held until its
+ * transactions complete, so a display frame goes out while BASIC renders
+ * the next one. Everything else (SPI.TRANSFER, SPI.TRANSFER$, SPI.FLUSH)
+ * first waits for the queue to drain, since transactions complete in order
+ * and a blocking transmit must not overtake queued ones.
+ */
+
+#define SPI_QUEUE_DEPTH 4
+#define SPI_MAX_TRANSFER 4096
+
+static spi_transaction_t spi_queue[SPI_QUEUE_DEPTH];
+static rb_string_t* spi_queue_data[SPI_QUEUE_DEPTH];
+static int spi_queue_next = 0;
+static int spi_in_flight = 0;
+
+/* Wait for the oldest queued transaction and drop its string */
+static void spi_reap(void) {
+    spi_transaction_t* done = NULL;
+    if (spi_device_get_trans_result(spi_handle, &done, portMAX_DELAY) != ESP_OK) return;
+    int i = (int)(done - spi_queue);
+    rb_string_release(spi_queue_data[i]);
+    spi_queue_data[i] = NULL;
+    spi_in_flight--;
+}
 #endif
 
 void rb_spi_setup(int32_t bus, int32_t clk, int32_t mosi, int32_t miso, int32_t freq) {
@@ -14,6 +43,7 @@ void rb_spi_setup(int32_t bus, int32_t clk, int32_t mosi, int32_t miso, int32_t
         .sclk_io_num = clk,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
+        .max_transfer_sz = SPI_MAX_TRANSFER,
     };
     spi_bus_initialize((spi_host_device_t)bus, &buscfg, SPI_DMA_CH_AUTO);
 
@@ -21,7 +51,7 @@ void rb_spi_setup(int32_t bus, int32_t clk, int32_t mosi, int32_t miso, int32_t
         .clock_speed_hz = freq,
         .mode = 0,
         .spics_io_num = -1,
-        .queue_size = 1,
+        .queue_size = SPI_QUEUE_DEPTH,
     };
     spi_bus_add_device((spi_host_device_t)bus, &devcfg, &spi_handle);
 #else
@@ -30,6 +60,12 @@ void rb_spi_setup(int32_t bus, int32_t clk, int32_t mosi, int32_t miso, int32_t
 #endif
 }
 
+void rb_spi_flush(void) {
+#ifdef ESP_PLATFORM
+    while (spi_in_flight > 0) spi_reap();
+#endif
+}
+
 int32_t rb_spi_transfer(int32_t data) {
 #ifdef ESP_PLATFORM
     uint8_t tx = (uint8_t)data;
@@ -40,6 +76,7 @@ int32_t rb_spi_transfer(int32_t data) {
         .rx_buffer = &rx,
     };
     if (spi_handle) {
+        rb_spi_flush();
         spi_device_transmit(spi_handle, &t);
     }
     return (int32_t)rx;
@@ -48,3 +85,63 @@ int32_t rb_spi_transfer(int32_t data) {
     return 0;
 #endif
 }
+
+void rb_spi_send(rb_string_t* data) {
+#ifdef ESP_PLATFORM
+    if (!spi_handle || !data) return;
+    /* The transactions read data->data after we return: settle a view
+     * first, since rb_string_cstr would otherwise re-point it later and
+     * drop the parent the DMA is reading from */
+    const char* bytes = rb_string_cstr(data);
+    for (int32_t off = 0; off < data->length; off += SPI_MAX_TRANSFER) {
+        int32_t n = data->length - off;
+        if (n > SPI_MAX_TRANSFER) n = SPI_MAX_TRANSFER;
+        /* Transactions finish in order, so the next slot is free once the
+         * queue is below its depth */
+        if (spi_in_flight == SPI_QUEUE_DEPTH) spi_reap();
+        spi_transaction_t* t = &spi_queue[spi_queue_next];
+        memset(t, 0, sizeof(*t));
+        t->length = (size_t)n * 8;
+        t->tx_buffer = bytes + off;
+        rb_string_retain(data);
+        if (spi_device_queue_trans(spi_handle, t, portMAX_DELAY) != ESP_OK) {
+            rb_string_release(data);
+            break;
+        }
+        spi_queue_data[spi_queue_next] = data;
+        spi_queue_next = (spi_queue_next + 1) % SPI_QUEUE_DEPTH;
+        spi_in_flight++;
+    }
+#else
+    printf("[SPI] send: %d bytes\n", data ? (int)data->length : 0);
+#endif
+}
+
+rb_string_t* rb_spi_transfer_str(rb_string_t* data) {
+    int32_t len = data ? data->length : 0;
+    rb_string_t* rx = rb_string_new(len);
+#ifdef ESP_PLATFORM
+    if (!spi_handle) {
+        memset(rx->data, 0, (size_t)len);
+        return rx;
+    }
+    rb_spi_flush();
+    for (int32_t off = 0; off < len; off += SPI_MAX_TRANSFER) {
+        int32_t n = len - off;
+        if (n > SPI_MAX_TRANSFER) n = SPI_MAX_TRANSFER;
+        spi_transaction_t t = {
+            .length = (size_t)n * 8,
+            .tx_buffer = data->data + off,
+            .rx_buffer = rx->data + off,
+        };
+        if (spi_device_transmit(spi_handle, &t) != ESP_OK) {
+            memset(rx->data + off, 0, (size_t)(len - off));
+            break;
+        }
+    }
+#else
+    memset(rx->data, 0, (size_t)len);
+    printf("[SPI] transfer: %d bytes\n", (int)len);
+#endif
+    return rx;
+}
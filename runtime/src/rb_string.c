@@ -3,16 +3,202 @@
 #include <string.h>
 #include <stdio.h>
 
+/* ── Size-class pool ──────────────────────────────────────
+ *
+ * Every rb_string_t block (header + data + NUL) is rounded up to one of
+ * RB_STRING_POOL_CLASSES fixed block sizes and served from a per-class
+ * freelist. Freelists are refilled one slab at a time; slabs are never
+ * returned to the system heap, so steady-state string churn does not
+ * fragment it. Blocks larger than the biggest class go straight to malloc.
+ *
+ * Freelists and stats are per task (thread-local), so allocation never
+ * takes a lock. A block freed by another task simply joins that task's
+ * freelist. When a task exits its freelists move to a global orphan list,
+ * which the next refill in any task adopts whole before carving a slab.
+ */
+
+#ifndef RB_STRING_POOL_SLAB_BYTES
+#define RB_STRING_POOL_SLAB_BYTES 1024
+#endif
+
+static const uint16_t pool_block_size[RB_STRING_POOL_CLASSES] = {
+    24, 32, 64, 128, 256
+};
+
+typedef struct pool_block {
+    struct pool_block* next;
+} pool_block_t;
+
+static RB_THREAD_LOCAL pool_block_t* pool_freelist[RB_STRING_POOL_CLASSES];
+static RB_THREAD_LOCAL rb_string_pool_stats_t pool_stats;
+static pool_block_t* pool_orphans[RB_STRING_POOL_CLASSES];
+
+static int pool_class_for(size_t bytes) {
+    for (int i = 0; i < RB_STRING_POOL_CLASSES; i++) {
+        if (bytes <= pool_block_size[i]) return i;
+    }
+    return -1;
+}
+
+static void pool_refill(int cls) {
+    /* Taking the whole orphan list at once sidesteps ABA */
+    pool_block_t* adopted = __atomic_exchange_n(&pool_orphans[cls], NULL, __ATOMIC_ACQUIRE);
+    if (adopted) {
+        pool_freelist[cls] = adopted;
+        return;
+    }
+    size_t block = pool_block_size[cls];
+    size_t count = RB_STRING_POOL_SLAB_BYTES / block;
+    if (count == 0) count = 1;
+    char* slab = (char*)malloc(block * count);
+    if (!slab) return;
+    for (size_t i = 0; i < count; i++) {
+        pool_block_t* b = (pool_block_t*)(slab + i * block);
+        b->next = pool_freelist[cls];
+        pool_freelist[cls] = b;
+    }
+    pool_stats.slabs[cls]++;
+}
+
+/* Allocate a header block with room for `*capacity` inline bytes plus the
+ * NUL; on return `*capacity` includes any headroom left in the block. */
+static rb_string_t* string_block_alloc(int32_t* capacity) {
+    size_t bytes = sizeof(rb_string_t) + (size_t)*capacity + 1;
+    int cls = pool_class_for(bytes);
+    rb_string_t* s;
+    if (cls >= 0) {
+        if (pool_freelist[cls]) {
+            pool_stats.hits[cls]++;
+        } else {
+            pool_stats.misses[cls]++;
+            pool_refill(cls);
+        }
+        pool_block_t* b = pool_freelist[cls];
+        if (b) pool_freelist[cls] = b->next;
+        s = (rb_string_t*)b;
+        /* The rest of the block is free headroom for in-place appends */
+        *capacity = (int32_t)(pool_block_size[cls] - sizeof(rb_string_t) - 1);
+    } else {
+        pool_stats.oversize++;
+        s = (rb_string_t*)malloc(bytes);
+    }
+    if (!s) {
+        rb_panic("out of memory in rb_string_new");
+    }
+    pool_stats.live++;
+    pool_stats.allocs++;
+    s->refcount = 1;
+    return s;
+}
+
+rb_string_t* rb_string_new_with_capacity(int32_t length, int32_t capacity) {
+    if (length < 0) length = 0;
+    if (capacity < length) capacity = length;
+    rb_string_t* s = string_block_alloc(&capacity);
+    s->length = length;
+    s->capacity = capacity;
+    s->data = (char*)(s + 1);
+    s->parent = NULL;
+    s->data[length] = '\0';
+    return s;
+}
+
+rb_string_t* rb_string_new(int32_t length) {
+    return rb_string_new_with_capacity(length, length);
+}
+
+void rb_string_free(rb_string_t* s) {
+    if (!s || RB_STRING_IS_IMMORTAL(s)) return;
+    if (s->parent) {
+        rb_string_release(s->parent);
+    }
+    pool_stats.live--;
+    pool_stats.frees++;
+    int cls = pool_class_for(sizeof(rb_string_t) + (size_t)s->capacity + 1);
+    if (cls < 0) {
+        free(s);
+        return;
+    }
+    pool_block_t* b = (pool_block_t*)s;
+    b->next = pool_freelist[cls];
+    pool_freelist[cls] = b;
+}
+
+void rb_string_pool_release_task(void) {
+    for (int i = 0; i < RB_STRING_POOL_CLASSES; i++) {
+        pool_block_t* head = pool_freelist[i];
+        if (!head) continue;
+        pool_block_t* tail = head;
+        while (tail->next) tail = tail->next;
+        tail->next = __atomic_load_n(&pool_orphans[i], __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&pool_orphans[i], &tail->next, head, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        pool_freelist[i] = NULL;
+    }
+}
+
+void rb_string_pool_stats(rb_string_pool_stats_t* out) {
+    if (!out) return;
+    *out = pool_stats;
+    for (int i = 0; i < RB_STRING_POOL_CLASSES; i++) {
+        out->block_size[i] = pool_block_size[i];
+    }
+}
+
+void rb_string_pool_reset_stats(void) {
+    for (int i = 0; i < RB_STRING_POOL_CLASSES; i++) {
+        pool_stats.hits[i] = 0;
+        pool_stats.misses[i] = 0;
+    }
+    pool_stats.oversize = 0;
+}
+
+void rb_string_pool_print_stats(void) {
+    printf("[STRPOOL] live=%d oversize=%u\n",
+           (int)pool_stats.live, (unsigned)pool_stats.oversize);
+    for (int i = 0; i < RB_STRING_POOL_CLASSES; i++) {
+        printf("[STRPOOL] %3u B: hits=%u misses=%u slabs=%u\n",
+               (unsigned)pool_block_size[i],
+               (unsigned)pool_stats.hits[i],
+               (unsigned)pool_stats.misses[i],
+               (unsigned)pool_stats.slabs[i]);
+    }
+}
+
+/* ── Core string operations ───────────────────────────── */
+
 rb_string_t* rb_string_alloc(const char* cstr) {
     if (!cstr) return NULL;
     size_t len = strlen(cstr);
-    rb_string_t* s = (rb_string_t*)malloc(sizeof(rb_string_t) + len + 1);
-    if (!s) {
-        rb_panic("out of memory in rb_string_alloc");
+    rb_string_t* s = rb_string_new((int32_t)len);
+    memcpy(s->data, cstr, len);
+    return s;
+}
+
+rb_string_t* rb_string_from_bytes(const char* data, int32_t len) {
+    if (len < 0) len = 0;
+    rb_string_t* s = rb_string_new(len);
+    if (len > 0) memcpy(s->data, data, (size_t)len);
+    return s;
+}
+
+/* A read buffer filled to less than 1/RB_STRING_FIT_SLACK of its capacity
+ * is copied down rather than pinning a mostly empty block */
+#ifndef RB_STRING_FIT_SLACK
+#define RB_STRING_FIT_SLACK 4
+#endif
+
+rb_string_t* rb_string_fit(rb_string_t* s, int32_t length) {
+    if (length < 0) length = 0;
+    if (length > s->length) length = s->length;
+    if (length < s->capacity / RB_STRING_FIT_SLACK) {
+        rb_string_t* copy = rb_string_from_bytes(s->data, length);
+        rb_string_release(s);
+        return copy;
     }
-    s->refcount = 1;
-    s->length = (int32_t)len;
-    memcpy(s->data, cstr, len + 1);
+    s->length = length;
+    s->data[length] = '\0';
     return s;
 }
 
@@ -23,35 +209,159 @@ rb_string_t* rb_string_concat(rb_string_t* a, rb_string_t* b) {
     int32_t b_len = b ? b->length : 0;
     int32_t total = a_len + b_len;
 
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + total + 1);
-    if (!result) {
-        rb_panic("out of memory in rb_string_concat");
-    }
-    result->refcount = 1;
-    result->length = total;
+    rb_string_t* result = rb_string_new(total);
     memcpy(result->data, a_data, a_len);
     memcpy(result->data + a_len, b_data, b_len);
-    result->data[total] = '\0';
     return result;
 }
 
+rb_string_t* rb_string_append_bytes(rb_string_t* dst, const char* data, int32_t len) {
+    if (len < 0) len = 0;
+    if (!dst) {
+        rb_string_t* s = rb_string_new(len);
+        memcpy(s->data, data, len);
+        return s;
+    }
+    int32_t total = dst->length + len;
+
+    /* Views have no capacity of their own, so they always take the copy */
+    if (dst->refcount == 1 && total <= dst->capacity) {
+        memcpy(dst->data + dst->length, data, len);
+        dst->length = total;
+        dst->data[total] = '\0';
+        return dst;
+    }
+
+    /* Grow geometrically so repeated appends stay amortized O(1) */
+    int32_t capacity = dst->capacity * 2;
+    if (capacity < total) capacity = total;
+    rb_string_t* result = rb_string_new_with_capacity(total, capacity);
+    memcpy(result->data, dst->data, dst->length);
+    memcpy(result->data + dst->length, data, len);
+    rb_string_release(dst);
+    return result;
+}
+
+rb_string_t* rb_string_append(rb_string_t* dst, rb_string_t* src) {
+    return rb_string_append_bytes(dst, src ? src->data : "", src ? src->length : 0);
+}
+
+/* ── Substring views ──────────────────────────────────── */
+
+/* Below this many bytes a copy fits in the smallest pool block anyway, so
+ * it is cheaper than pinning the parent. */
+#ifndef RB_STRING_VIEW_MIN
+#define RB_STRING_VIEW_MIN 16
+#endif
+
+rb_string_t* rb_string_slice(rb_string_t* s, int32_t start, int32_t length) {
+    if (!s || length <= 0) return rb_string_new(0);
+    if (start == 0 && length == s->length) {
+        rb_string_retain(s);
+        return s;
+    }
+    if (length < RB_STRING_VIEW_MIN) {
+        rb_string_t* r = rb_string_new(length);
+        memcpy(r->data, s->data + start, length);
+        return r;
+    }
+    /* Always point at the owner of the bytes so views never chain */
+    rb_string_t* owner = s->parent ? s->parent : s;
+    int32_t capacity = 0;
+    rb_string_t* v = string_block_alloc(&capacity);
+    v->length = length;
+    v->capacity = 0;
+    v->data = s->data + start;
+    v->parent = owner;
+    rb_string_retain(owner);
+    return v;
+}
+
+const char* rb_string_cstr(rb_string_t* s) {
+    if (!s) return "";
+    /* data[length] is always readable: it is at most the parent's NUL */
+    if (s->data[s->length] == '\0') return s->data;
+    rb_string_t* copy = rb_string_new(s->length);
+    memcpy(copy->data, s->data, s->length);
+    /* Re-point the view at its private copy; its contents are unchanged,
+     * so other holders of the view are unaffected. */
+    rb_string_release(s->parent);
+    s->parent = copy;
+    s->data = copy->data;
+    return s->data;
+}
+
 int32_t rb_string_compare(rb_string_t* a, rb_string_t* b) {
     const char* a_data = a ? a->data : "";
     const char* b_data = b ? b->data : "";
-    return (int32_t)strcmp(a_data, b_data);
+    int32_t a_len = a ? a->length : 0;
+    int32_t b_len = b ? b->length : 0;
+    int r = memcmp(a_data, b_data, (size_t)(a_len < b_len ? a_len : b_len));
+    if (r != 0) return (int32_t)r;
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+int32_t rb_string_equal(rb_string_t* a, rb_string_t* b) {
+    int32_t a_len = a ? a->length : 0;
+    int32_t b_len = b ? b->length : 0;
+    if (a_len != b_len) return 0;
+    if (a_len == 0 || a->data == b->data) return 1;
+    return memcmp(a->data, b->data, (size_t)a_len) == 0;
+}
+
+/* retain/release, like LEN and ASC, are also emitted as inlinable IR by
+ * codegen (define_inline_runtime); keep the two in sync. Only the fast
+ * path is inlined: immortal and shared strings go to the _slow variants. */
+
+/* The flag test is a relaxed load so that it may race the atomic updates
+ * of other tasks; it compiles to a plain load. */
+static inline int32_t string_rc(rb_string_t* s) {
+    return __atomic_load_n(&s->refcount, __ATOMIC_RELAXED);
 }
 
 void rb_string_retain(rb_string_t* s) {
-    if (s) {
-        s->refcount++;
+    if (!s) return;
+    int32_t rc = string_rc(s);
+    if (rc & RB_STRING_RC_SLOW) {
+        rb_string_retain_slow(s);
+        return;
     }
+    s->refcount = rc + 1;
 }
 
 void rb_string_release(rb_string_t* s) {
-    if (s) {
-        s->refcount--;
-        if (s->refcount <= 0) {
-            free(s);
-        }
+    if (!s) return;
+    int32_t rc = string_rc(s);
+    if (rc & RB_STRING_RC_SLOW) {
+        rb_string_release_slow(s);
+        return;
+    }
+    s->refcount = --rc;
+    if (rc <= 0) {
+        rb_string_free(s);
+    }
+}
+
+void rb_string_retain_slow(rb_string_t* s) {
+    if (string_rc(s) == RB_STRING_IMMORTAL) return;
+    __atomic_fetch_add(&s->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void rb_string_release_slow(rb_string_t* s) {
+    if (string_rc(s) == RB_STRING_IMMORTAL) return;
+    int32_t rc = __atomic_sub_fetch(&s->refcount, 1, __ATOMIC_ACQ_REL);
+    if ((rc & ~RB_STRING_SHARED) <= 0) {
+        rb_string_free(s);
+    }
+}
+
+void rb_string_share(rb_string_t* s) {
+    if (!s || RB_STRING_IS_IMMORTAL(s) || RB_STRING_IS_SHARED(s)) return;
+    if (s->parent) {
+        /* rb_string_cstr re-points a view on first use, which is not safe
+         * once other tasks can see it: settle that now, while still owned */
+        rb_string_cstr(s);
+        rb_string_share(s->parent);
     }
+    s->refcount |= RB_STRING_SHARED;
 }
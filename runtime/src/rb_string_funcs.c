@@ -4,6 +4,89 @@
 #include <stdio.h>
 #include <ctype.h>
 
+/* ── Byte kernels ─────────────────────────────────────
+ *
+ * INSTR and UCASE$/LCASE$ work from the stored length, so embedded NULs and
+ * unterminated views are handled, and process a machine word per step.
+ */
+
+typedef uintptr_t rb_word_t;
+#define WORD_ONES ((rb_word_t)-1 / 0xFF)  /* 0x0101...01 */
+#define WORD_HIGH (WORD_ONES * 0x80)      /* 0x8080...80 */
+
+/* Needles at least this long use Horspool; shorter ones let memchr find
+ * first-byte candidates, which libc already does a word (or vector) at a
+ * time. */
+#ifndef RB_INSTR_HORSPOOL_MIN
+#define RB_INSTR_HORSPOOL_MIN 8
+#endif
+
+static inline rb_word_t load_word(const char* p) {
+    rb_word_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static inline void store_word(char* p, rb_word_t w) {
+    memcpy(p, &w, sizeof(w));
+}
+
+/* Copy `len` bytes, flipping the ASCII case bit of bytes in [lo, hi].
+ * Per byte, with the high bit masked off, adding (0x80 - lo) sets bit 7 iff
+ * the byte is >= lo and adding (0x7F - hi) sets it iff the byte is > hi; no
+ * addition can carry into the next byte. Bytes >= 0x80 are left alone. */
+static void case_map(char* dst, const char* src, int32_t len,
+                     unsigned char lo, unsigned char hi) {
+    const rb_word_t ge_lo = WORD_ONES * (rb_word_t)(0x80 - lo);
+    const rb_word_t gt_hi = WORD_ONES * (rb_word_t)(0x7F - hi);
+    int32_t i = 0;
+    for (; i + (int32_t)sizeof(rb_word_t) <= len; i += (int32_t)sizeof(rb_word_t)) {
+        rb_word_t w = load_word(src + i);
+        rb_word_t low7 = w & ~WORD_HIGH;
+        rb_word_t in_range = (low7 + ge_lo) & ~(low7 + gt_hi) & ~w & WORD_HIGH;
+        store_word(dst + i, w ^ (in_range >> 2));
+    }
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)src[i];
+        dst[i] = (char)((c >= lo && c <= hi) ? (c ^ 0x20) : c);
+    }
+}
+
+/* Offset of the first occurrence of needle in hay, or -1. */
+static int32_t find_bytes(const char* hay, int32_t n, const char* needle, int32_t m) {
+    if (m == 0) return 0;
+    if (m > n) return -1;
+
+    if (m < RB_INSTR_HORSPOOL_MIN) {
+        const char* p = hay;
+        const char* last = hay + (n - m);
+        while (p <= last) {
+            p = (const char*)memchr(p, needle[0], (size_t)(last - p + 1));
+            if (!p) return -1;
+            if (memcmp(p + 1, needle + 1, (size_t)(m - 1)) == 0) return (int32_t)(p - hay);
+            p++;
+        }
+        return -1;
+    }
+
+    /* Horspool: shift by the distance from the last occurrence of the
+     * window's final byte to the end of the needle. Shifts are clamped to
+     * 255, which only ever makes them more conservative. */
+    uint8_t skip[256];
+    memset(skip, m < 255 ? m : 255, sizeof(skip));
+    for (int32_t i = 0; i < m - 1; i++) {
+        int32_t d = m - 1 - i;
+        skip[(unsigned char)needle[i]] = (uint8_t)(d < 255 ? d : 255);
+    }
+    const char last_byte = needle[m - 1];
+    for (int32_t pos = 0; pos <= n - m; ) {
+        char c = hay[pos + m - 1];
+        if (c == last_byte && memcmp(hay + pos, needle, (size_t)(m - 1)) == 0) return pos;
+        pos += skip[(unsigned char)c];
+    }
+    return -1;
+}
+
 /* ── LEN(s$) → i32 ──────────────────────────────────── */
 
 int32_t rb_fn_len(rb_string_t* s) {
@@ -32,14 +115,7 @@ rb_string_t* rb_fn_chr_s(int32_t code) {
 rb_string_t* rb_fn_left_s(rb_string_t* s, int32_t n) {
     if (!s || n <= 0) return rb_string_alloc("");
     if (n > s->length) n = s->length;
-
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + n + 1);
-    if (!result) rb_panic("out of memory in rb_fn_left_s");
-    result->refcount = 1;
-    result->length = n;
-    memcpy(result->data, s->data, n);
-    result->data[n] = '\0';
-    return result;
+    return rb_string_slice(s, 0, n);
 }
 
 /* ── RIGHT$(s$, n) → ptr ────────────────────────────── */
@@ -47,15 +123,7 @@ rb_string_t* rb_fn_left_s(rb_string_t* s, int32_t n) {
 rb_string_t* rb_fn_right_s(rb_string_t* s, int32_t n) {
     if (!s || n <= 0) return rb_string_alloc("");
     if (n > s->length) n = s->length;
-    int32_t start = s->length - n;
-
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + n + 1);
-    if (!result) rb_panic("out of memory in rb_fn_right_s");
-    result->refcount = 1;
-    result->length = n;
-    memcpy(result->data, s->data + start, n);
-    result->data[n] = '\0';
-    return result;
+    return rb_string_slice(s, s->length - n, n);
 }
 
 /* ── MID$(s$, start, len) → ptr  (1-based start) ──── */
@@ -64,15 +132,8 @@ rb_string_t* rb_fn_mid_s(rb_string_t* s, int32_t start, int32_t len) {
     if (!s || start < 1 || len <= 0) return rb_string_alloc("");
     int32_t idx = start - 1;  /* convert to 0-based */
     if (idx >= s->length) return rb_string_alloc("");
-    if (idx + len > s->length) len = s->length - idx;
-
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + len + 1);
-    if (!result) rb_panic("out of memory in rb_fn_mid_s");
-    result->refcount = 1;
-    result->length = len;
-    memcpy(result->data, s->data + idx, len);
-    result->data[len] = '\0';
-    return result;
+    if (len > s->length - idx) len = s->length - idx;
+    return rb_string_slice(s, idx, len);
 }
 
 /* ── INSTR(s$, find$) → i32  (1-based, 0 if not found) */
@@ -82,38 +143,32 @@ int32_t rb_fn_instr(rb_string_t* s, rb_string_t* find) {
     if (find->length == 0) return 1;
     if (s->length == 0) return 0;
 
-    const char* p = strstr(s->data, find->data);
-    if (!p) return 0;
-    return (int32_t)(p - s->data) + 1;
+    return find_bytes(s->data, s->length, find->data, find->length) + 1;
 }
 
 /* ── STR$(n) → ptr ──────────────────────────────────── */
 
 rb_string_t* rb_fn_str_s(float value) {
-    char buf[64];
-    snprintf(buf, sizeof(buf), "%g", (double)value);
-    return rb_string_alloc(buf);
+    char buf[RB_FMT_FLOAT_MAX];
+    int n = rb_fmt_float(buf, value);
+    rb_string_t* s = rb_string_new(n);
+    memcpy(s->data, buf, (size_t)n);
+    return s;
 }
 
 /* ── VAL(s$) → f32 ──────────────────────────────────── */
 
 float rb_fn_val(rb_string_t* s) {
     if (!s || s->length == 0) return 0.0f;
-    return (float)atof(s->data);
+    return rb_scan_float(s->data, s->length, NULL);
 }
 
 /* ── UCASE$(s$) → ptr ───────────────────────────────── */
 
 rb_string_t* rb_fn_ucase_s(rb_string_t* s) {
     if (!s) return rb_string_alloc("");
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + s->length + 1);
-    if (!result) rb_panic("out of memory in rb_fn_ucase_s");
-    result->refcount = 1;
-    result->length = s->length;
-    for (int32_t i = 0; i < s->length; i++) {
-        result->data[i] = (char)toupper((unsigned char)s->data[i]);
-    }
-    result->data[s->length] = '\0';
+    rb_string_t* result = rb_string_new(s->length);
+    case_map(result->data, s->data, s->length, 'a', 'z');
     return result;
 }
 
@@ -121,14 +176,8 @@ rb_string_t* rb_fn_ucase_s(rb_string_t* s) {
 
 rb_string_t* rb_fn_lcase_s(rb_string_t* s) {
     if (!s) return rb_string_alloc("");
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + s->length + 1);
-    if (!result) rb_panic("out of memory in rb_fn_lcase_s");
-    result->refcount = 1;
-    result->length = s->length;
-    for (int32_t i = 0; i < s->length; i++) {
-        result->data[i] = (char)tolower((unsigned char)s->data[i]);
-    }
-    result->data[s->length] = '\0';
+    rb_string_t* result = rb_string_new(s->length);
+    case_map(result->data, s->data, s->length, 'A', 'Z');
     return result;
 }
 
@@ -145,12 +194,5 @@ rb_string_t* rb_fn_trim_s(rb_string_t* s) {
 
     int32_t len = (int32_t)(end - start + 1);
     if (len <= 0) return rb_string_alloc("");
-
-    rb_string_t* result = (rb_string_t*)malloc(sizeof(rb_string_t) + len + 1);
-    if (!result) rb_panic("out of memory in rb_fn_trim_s");
-    result->refcount = 1;
-    result->length = len;
-    memcpy(result->data, start, len);
-    result->data[len] = '\0';
-    return result;
+    return rb_string_slice(s, (int32_t)(start - s->data), len);
 }
@@ -1,29 +1,58 @@
 #include "rb_runtime.h"
+#include <stdlib.h>
 #include <stdio.h>
 
 #ifdef ESP_PLATFORM
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-
-void rb_task_create(void (*fn)(void*), rb_string_t* name, int32_t stack_size, int32_t priority) {
-    const char* task_name = (name && name->length > 0) ? name->data : "rb_task";
-    xTaskCreate(fn, task_name, (uint32_t)stack_size, NULL, (UBaseType_t)priority, NULL);
-}
-
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
 #else
 #include <pthread.h>
+#include <sched.h>
+#endif
 
 typedef struct {
     void (*fn)(void*);
 } task_arg_t;
 
+/* Runs a TASK body, then returns its string pool blocks for reuse. A
+ * FreeRTOS task must not return from its entry function, so it deletes
+ * itself instead. */
+#ifdef ESP_PLATFORM
+static void task_wrapper(void* arg) {
+#else
 static void* task_wrapper(void* arg) {
+#endif
     task_arg_t* ta = (task_arg_t*)arg;
     ta->fn(NULL);
     free(ta);
+    rb_json_release_task();
+    rb_regex_release_task();
+    rb_string_pool_release_task();
+#ifdef ESP_PLATFORM
+    vTaskDelete(NULL);
+#else
     return NULL;
+#endif
 }
 
+#ifdef ESP_PLATFORM
+
+void rb_task_create(void (*fn)(void*), rb_string_t* name, int32_t stack_size, int32_t priority) {
+    const char* task_name = (name && name->length > 0) ? rb_string_cstr(name) : "rb_task";
+    task_arg_t* ta = (task_arg_t*)malloc(sizeof(task_arg_t));
+    if (!ta) rb_panic("out of memory in TASK");
+    ta->fn = fn;
+    if (xTaskCreate(task_wrapper, task_name, (uint32_t)stack_size, ta,
+                    (UBaseType_t)priority, NULL) != pdPASS) {
+        free(ta);
+        rb_panic("TASK could not be created");
+    }
+}
+
+#else
+
 void rb_task_create(void (*fn)(void*), rb_string_t* name, int32_t stack_size, int32_t priority) {
     (void)name;
     (void)stack_size;
@@ -39,3 +68,244 @@ void rb_task_create(void (*fn)(void*), rb_string_t* name, int32_t stack_size, in
 }
 
 #endif
+
+/* ── Worker pool ──────────────────────────────────────────
+ *
+ * SPAWN hands a job to a fixed set of long-lived workers instead of creating
+ * a task, so a short job costs a queue push rather than a stack allocation.
+ * Jobs live in a fixed table; a job id is its slot plus the slot's
+ * generation, which is bumped when the job finishes, so WAIT on a stale id
+ * returns at once. When every slot is busy SPAWN waits for one to free up,
+ * which bounds the memory a burst of jobs can take.
+ */
+
+#define RB_POOL_MAX_JOBS 32
+#define RB_POOL_MAX_WORKERS 8
+#define RB_POOL_DEFAULT_WORKERS 2
+#define RB_POOL_DEFAULT_STACK 4096
+#define RB_POOL_DEFAULT_PRIORITY 1
+#define RB_POOL_POLL_MS 50
+
+enum { POOL_IDLE, POOL_STARTING, POOL_RUNNING };
+enum { JOB_FREE, JOB_CLAIMED };
+
+typedef struct {
+    void (*fn)(void*);
+    uint32_t gen;
+    uint8_t state;
+} pool_job_t;
+
+static pool_job_t pool_jobs[RB_POOL_MAX_JOBS];
+static uint8_t pool_state;
+static int32_t pool_workers = RB_POOL_DEFAULT_WORKERS;
+static int32_t pool_stack = RB_POOL_DEFAULT_STACK;
+static int32_t pool_priority = RB_POOL_DEFAULT_PRIORITY;
+static int32_t pool_core = -1;
+
+#define JOB_ID(slot, gen) ((int32_t)((((gen) & 0x7FFFFFu) << 8) | (uint32_t)(slot)))
+
+static void pool_run_job(int slot);
+
+#ifdef ESP_PLATFORM
+
+static QueueHandle_t pool_queue;
+static EventGroupHandle_t pool_events;
+#define POOL_DONE_BIT 1u
+
+static void pool_pause(void) {
+    vTaskDelay(1);
+}
+
+static void pool_worker(void* arg) {
+    (void)arg;
+    for (;;) {
+        uint8_t slot;
+        if (xQueueReceive(pool_queue, &slot, portMAX_DELAY) == pdTRUE) {
+            pool_run_job(slot);
+        }
+    }
+}
+
+static void pool_platform_start(void) {
+    pool_queue = xQueueCreate(RB_POOL_MAX_JOBS, sizeof(uint8_t));
+    pool_events = xEventGroupCreate();
+    if (!pool_queue || !pool_events) rb_panic("out of memory in SPAWN");
+    BaseType_t core = pool_core < 0 ? tskNO_AFFINITY : (BaseType_t)pool_core;
+    for (int32_t i = 0; i < pool_workers; i++) {
+        if (xTaskCreatePinnedToCore(pool_worker, "rb_worker", (uint32_t)pool_stack, NULL,
+                                    (UBaseType_t)pool_priority, NULL, core) != pdPASS) {
+            rb_panic("SPAWN worker could not be created");
+        }
+    }
+}
+
+static void pool_push(int slot) {
+    uint8_t s = (uint8_t)slot;
+    /* Never full: the queue has room for every job slot */
+    xQueueSend(pool_queue, &s, portMAX_DELAY);
+}
+
+/* Event group bits persist until a waiter clears them, so a completion
+ * between the waiter's check and its wait is not lost. */
+typedef uint32_t pool_epoch_t;
+
+static pool_epoch_t pool_wait_begin(void) {
+    return 0;
+}
+
+static void pool_wait_end(pool_epoch_t epoch) {
+    (void)epoch;
+    xEventGroupWaitBits(pool_events, POOL_DONE_BIT, pdTRUE, pdFALSE, pdMS_TO_TICKS(RB_POOL_POLL_MS));
+}
+
+static void pool_notify_done(void) {
+    xEventGroupSetBits(pool_events, POOL_DONE_BIT);
+}
+
+#else
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+static uint8_t pool_queue[RB_POOL_MAX_JOBS];
+static uint32_t pool_queue_head, pool_queue_tail;
+static uint32_t pool_done_generation;
+
+static void pool_pause(void) {
+    sched_yield();
+}
+
+static void* pool_worker(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool_mutex);
+        while (pool_queue_head == pool_queue_tail) {
+            pthread_cond_wait(&pool_queue_cond, &pool_mutex);
+        }
+        int slot = pool_queue[pool_queue_tail++ % RB_POOL_MAX_JOBS];
+        pthread_mutex_unlock(&pool_mutex);
+        pool_run_job(slot);
+    }
+    return NULL;
+}
+
+static void pool_platform_start(void) {
+    for (int32_t i = 0; i < pool_workers; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, pool_worker, NULL) != 0) {
+            rb_panic("SPAWN worker could not be created");
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+static void pool_push(int slot) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_queue[pool_queue_head++ % RB_POOL_MAX_JOBS] = (uint8_t)slot;
+    pthread_cond_signal(&pool_queue_cond);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+typedef uint32_t pool_epoch_t;
+
+static pool_epoch_t pool_wait_begin(void) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_epoch_t epoch = pool_done_generation;
+    pthread_mutex_unlock(&pool_mutex);
+    return epoch;
+}
+
+static void pool_wait_end(pool_epoch_t epoch) {
+    pthread_mutex_lock(&pool_mutex);
+    while (pool_done_generation == epoch) {
+        pthread_cond_wait(&pool_done_cond, &pool_mutex);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+static void pool_notify_done(void) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_done_generation++;
+    pthread_cond_broadcast(&pool_done_cond);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+#endif
+
+static void pool_start(void) {
+    if (__atomic_load_n(&pool_state, __ATOMIC_ACQUIRE) == POOL_RUNNING) return;
+    uint8_t expected = POOL_IDLE;
+    if (__atomic_compare_exchange_n(&pool_state, &expected, POOL_STARTING, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        pool_platform_start();
+        __atomic_store_n(&pool_state, POOL_RUNNING, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(&pool_state, __ATOMIC_ACQUIRE) != POOL_RUNNING) pool_pause();
+}
+
+static void pool_run_job(int slot) {
+    pool_job_t* job = &pool_jobs[slot];
+    job->fn(NULL);
+    /* Bump the generation before freeing the slot, so a WAIT on this job
+     * can never mistake the slot's next job for it */
+    __atomic_fetch_add(&job->gen, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&job->state, JOB_FREE, __ATOMIC_RELEASE);
+    pool_notify_done();
+}
+
+static int pool_try_claim(void) {
+    for (int i = 0; i < RB_POOL_MAX_JOBS; i++) {
+        uint8_t expected = JOB_FREE;
+        if (__atomic_compare_exchange_n(&pool_jobs[i].state, &expected, JOB_CLAIMED, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void rb_task_pool(int32_t workers, int32_t stack_size, int32_t priority, int32_t core) {
+    if (__atomic_load_n(&pool_state, __ATOMIC_ACQUIRE) != POOL_IDLE) {
+        fprintf(stderr, "TASK.POOL must come before the first SPAWN\n");
+        return;
+    }
+    if (workers < 1) workers = 1;
+    if (workers > RB_POOL_MAX_WORKERS) workers = RB_POOL_MAX_WORKERS;
+    pool_workers = workers;
+    pool_stack = stack_size;
+    pool_priority = priority;
+    pool_core = core;
+}
+
+int32_t rb_spawn(void (*fn)(void*)) {
+    pool_start();
+    int slot;
+    while ((slot = pool_try_claim()) < 0) {
+        pool_epoch_t epoch = pool_wait_begin();
+        if ((slot = pool_try_claim()) >= 0) break;
+        pool_wait_end(epoch);
+    }
+    pool_jobs[slot].fn = fn;
+    int32_t id = JOB_ID(slot, __atomic_load_n(&pool_jobs[slot].gen, __ATOMIC_RELAXED));
+    pool_push(slot);
+    return id;
+}
+
+static int pool_job_done(int32_t id) {
+    int slot = id & 0xFF;
+    uint32_t gen = __atomic_load_n(&pool_jobs[slot].gen, __ATOMIC_ACQUIRE);
+    return JOB_ID(slot, gen) != id;
+}
+
+void rb_wait(int32_t id) {
+    if (id < 0 || (id & 0xFF) >= RB_POOL_MAX_JOBS) return;
+    while (!pool_job_done(id)) {
+        pool_epoch_t epoch = pool_wait_begin();
+        if (pool_job_done(id)) break;
+        pool_wait_end(epoch);
+    }
+}
@@ -4,88 +4,360 @@
 
 #ifdef ESP_PLATFORM
 #include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <sys/lock.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* ── Connections ──────────────────────────────────────────
+ *
+ * Without ON TCP.DATA the server is the classic single connection:
+ * TCP.ACCEPT blocks for a client and TCP.RECEIVE$ blocks for its data.
+ *
+ * ON TCP.DATA starts an event loop task that select()s on the listening
+ * socket and every client at once, accepting new clients and calling the
+ * handler SUB each time one sends data, so a slow client never holds up
+ * the others. Connections are handles (slot index plus a generation count,
+ * so a handle to a closed connection never reaches a newer one). Sockets
+ * are only ever closed by the loop: TCP.CLOSE from any task marks a
+ * connection, and the loop closes it once no task is mid-send on it.
+ */
+
+#define TCP_MAX_CLIENTS 8
+#define TCP_BACKLOG 4
+#define TCP_RECV_CHUNK 1024
+/* Longest the loop sleeps in select(); bounds how late a close is applied */
+#define TCP_POLL_MS 50
+/* A client that stops reading this long is disconnected */
+#define TCP_SEND_TIMEOUT_MS 1000
+#define TCP_LOOP_STACK 6144
+#define TCP_LOOP_PRIORITY 2
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+    int fd;
+    uint16_t gen;
+    uint8_t used;
+    uint8_t closing;
+    int32_t senders;    /* tasks currently in send() on fd */
+} tcp_conn_t;
 
 static int tcp_server_fd = -1;
-static int tcp_client_fd = -1;
+static int tcp_client_fd = -1;   /* TCP.ACCEPT's connection */
+static int tcp_server_stale = -1;  /* closed server socket the loop still owns */
 
-void rb_tcp_listen(int32_t port) {
-    tcp_server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = INADDR_ANY };
-    int opt = 1;
-    setsockopt(tcp_server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    bind(tcp_server_fd, (struct sockaddr*)&addr, sizeof(addr));
-    listen(tcp_server_fd, 1);
+static tcp_conn_t tcp_conns[TCP_MAX_CLIENTS];
+static void (*tcp_handler)(void) = NULL;
+static int tcp_loop_running = 0;
+
+/* Connection and data the handler runs for (loop task only) */
+static RB_THREAD_LOCAL int tcp_in_handler = 0;
+static RB_THREAD_LOCAL int32_t tcp_current = 0;
+static RB_THREAD_LOCAL rb_string_t* tcp_current_data = NULL;
+
+static void tcp_loop(void);
+
+#ifdef ESP_PLATFORM
+
+static _lock_t tcp_lock_handle;
+static void tcp_lock(void) { _lock_acquire(&tcp_lock_handle); }
+static void tcp_unlock(void) { _lock_release(&tcp_lock_handle); }
+
+static void tcp_loop_main(void* arg) {
+    (void)arg;
+    tcp_loop();
 }
 
-int32_t rb_tcp_accept(void) {
-    if (tcp_server_fd < 0) return -1;
-    tcp_client_fd = accept(tcp_server_fd, NULL, NULL);
-    return tcp_client_fd;
+static void tcp_platform_start(void) {
+    if (xTaskCreate(tcp_loop_main, "rb_tcp_loop", TCP_LOOP_STACK, NULL,
+                    TCP_LOOP_PRIORITY, NULL) != pdPASS) {
+        rb_panic("TCP event loop could not be created");
+    }
 }
 
-void rb_tcp_send(rb_string_t* data) {
-    if (tcp_client_fd >= 0) send(tcp_client_fd, data->data, data->length, 0);
+#else
+
+static pthread_mutex_t tcp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void tcp_lock(void) { pthread_mutex_lock(&tcp_mutex); }
+static void tcp_unlock(void) { pthread_mutex_unlock(&tcp_mutex); }
+
+static void* tcp_loop_main(void* arg) {
+    (void)arg;
+    tcp_loop();
+    return NULL;
 }
 
-rb_string_t* rb_tcp_receive(void) {
-    char buf[1024];
-    if (tcp_client_fd < 0) return rb_string_alloc("");
-    int n = recv(tcp_client_fd, buf, sizeof(buf) - 1, 0);
-    if (n <= 0) return rb_string_alloc("");
-    buf[n] = '\0';
-    return rb_string_alloc(buf);
+static void tcp_platform_start(void) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, tcp_loop_main, NULL) != 0) {
+        rb_panic("TCP event loop could not be created");
+    }
+    pthread_attr_destroy(&attr);
 }
 
-void rb_tcp_close(void) {
-    if (tcp_client_fd >= 0) { close(tcp_client_fd); tcp_client_fd = -1; }
-    if (tcp_server_fd >= 0) { close(tcp_server_fd); tcp_server_fd = -1; }
+#endif
+
+/* Slot of a live handle, or NULL. Call with the lock held. */
+static tcp_conn_t* tcp_lookup(int32_t id) {
+    if (id <= 0) return NULL;
+    tcp_conn_t* c = &tcp_conns[id % TCP_MAX_CLIENTS];
+    if (!c->used || (int32_t)c->gen != id / TCP_MAX_CLIENTS) return NULL;
+    return c;
 }
 
-#else
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
+static int32_t tcp_conn_id(int slot) {
+    return (int32_t)tcp_conns[slot].gen * TCP_MAX_CLIENTS + slot;
+}
 
-static int tcp_server_fd = -1;
-static int tcp_client_fd = -1;
+static void tcp_add_client(int fd) {
+    /* Sends block (up to the timeout) even though the listener does not */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+    struct timeval tv = { TCP_SEND_TIMEOUT_MS / 1000, (TCP_SEND_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    tcp_lock();
+    for (int i = 0; i < TCP_MAX_CLIENTS; i++) {
+        tcp_conn_t* c = &tcp_conns[i];
+        if (c->used) continue;
+        if (++c->gen == 0) c->gen = 1;
+        c->fd = fd;
+        c->used = 1;
+        c->closing = 0;
+        c->senders = 0;
+        tcp_unlock();
+        return;
+    }
+    tcp_unlock();
+    fprintf(stderr, "TCP: %d clients connected, refusing another\n", TCP_MAX_CLIENTS);
+    close(fd);
+}
+
+static void tcp_dispatch(int32_t id, rb_string_t* data) {
+    tcp_current = id;
+    tcp_current_data = data;
+    tcp_in_handler = 1;
+    tcp_handler();
+    tcp_in_handler = 0;
+    tcp_current_data = NULL;
+    tcp_current = 0;
+    rb_string_release(data);
+}
+
+static void tcp_loop(void) {
+    int nonblocking_fd = -1;
+    for (;;) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        int max_fd = -1;
+        int server = -1;
+        int fds[TCP_MAX_CLIENTS];
+        int32_t ids[TCP_MAX_CLIENTS];
+        int count = 0;
+
+        /* Apply pending closes and take a snapshot to wait on */
+        tcp_lock();
+        if (tcp_server_stale >= 0) {
+            close(tcp_server_stale);
+            tcp_server_stale = -1;
+        }
+        server = tcp_server_fd;
+        for (int i = 0; i < TCP_MAX_CLIENTS; i++) {
+            tcp_conn_t* c = &tcp_conns[i];
+            if (!c->used) continue;
+            if (c->closing) {
+                if (c->senders == 0) {
+                    close(c->fd);
+                    c->used = 0;
+                }
+                continue;
+            }
+            fds[count] = c->fd;
+            ids[count] = tcp_conn_id(i);
+            count++;
+        }
+        tcp_unlock();
+
+        if (server >= 0) {
+            /* A client that resets between select() and accept() must not
+             * block the loop */
+            if (server != nonblocking_fd) {
+                fcntl(server, F_SETFL, fcntl(server, F_GETFL, 0) | O_NONBLOCK);
+                nonblocking_fd = server;
+            }
+            FD_SET(server, &readable);
+            max_fd = server;
+        }
+        for (int i = 0; i < count; i++) {
+            FD_SET(fds[i], &readable);
+            if (fds[i] > max_fd) max_fd = fds[i];
+        }
+
+        struct timeval tv = { 0, TCP_POLL_MS * 1000 };
+        int ready = select(max_fd + 1, &readable, NULL, NULL, &tv);
+        if (ready <= 0) continue;
+
+        if (server >= 0 && FD_ISSET(server, &readable)) {
+            int fd;
+            while ((fd = accept(server, NULL, NULL)) >= 0) tcp_add_client(fd);
+        }
+        for (int i = 0; i < count; i++) {
+            if (!FD_ISSET(fds[i], &readable)) continue;
+            rb_string_t* data = rb_string_new(TCP_RECV_CHUNK);
+            int n = (int)recv(fds[i], data->data, TCP_RECV_CHUNK, 0);
+            tcp_dispatch(ids[i], rb_string_fit(data, n));
+            /* Hang-up: the handler has seen it as an empty read, and the
+             * connection goes away */
+            if (n <= 0) rb_tcp_close_client(ids[i]);
+        }
+        /* Wake ASYNC bodies waiting on anything the handler changed */
+        rb_async_notify();
+    }
+}
 
 void rb_tcp_listen(int32_t port) {
-    tcp_server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "TCP.LISTEN: cannot create socket\n");
+        return;
+    }
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
     int opt = 1;
-    setsockopt(tcp_server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    bind(tcp_server_fd, (struct sockaddr*)&addr, sizeof(addr));
-    listen(tcp_server_fd, 1);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, TCP_BACKLOG) != 0) {
+        fprintf(stderr, "TCP.LISTEN: cannot listen on port %d\n", (int)port);
+        close(fd);
+        return;
+    }
+    tcp_lock();
+    tcp_server_fd = fd;
+    tcp_unlock();
+#ifndef ESP_PLATFORM
     printf("[TCP] listening on port %d\n", port);
+#endif
+}
+
+void rb_on_tcp_data(void (*handler)(void)) {
+    __atomic_store_n(&tcp_handler, handler, __ATOMIC_RELEASE);
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&tcp_loop_running, &expected, 1, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        tcp_platform_start();
+    }
 }
 
 int32_t rb_tcp_accept(void) {
-    if (tcp_server_fd < 0) return -1;
-    tcp_client_fd = accept(tcp_server_fd, NULL, NULL);
+    int server;
+    tcp_lock();
+    server = tcp_server_fd;
+    tcp_unlock();
+    if (server < 0) return -1;
+    tcp_client_fd = accept(server, NULL, NULL);
+#ifndef ESP_PLATFORM
     printf("[TCP] accepted client fd=%d\n", tcp_client_fd);
+#endif
     return tcp_client_fd;
 }
 
+int32_t rb_tcp_client(void) {
+    return tcp_in_handler ? tcp_current : 0;
+}
+
+static void tcp_send_all(int fd, const char* data, int32_t len, int* ok) {
+    while (len > 0) {
+        int n = (int)send(fd, data, (size_t)len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            *ok = 0;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void rb_tcp_send_to(int32_t conn, rb_string_t* data) {
+    if (!data) return;
+    tcp_lock();
+    tcp_conn_t* c = tcp_lookup(conn);
+    int fd = -1;
+    if (c && !c->closing) {
+        c->senders++;
+        fd = c->fd;
+    }
+    tcp_unlock();
+    if (fd < 0) return;
+
+    int ok = 1;
+    tcp_send_all(fd, data->data, data->length, &ok);
+
+    tcp_lock();
+    c->senders--;
+    if (!ok) c->closing = 1;
+    tcp_unlock();
+}
+
 void rb_tcp_send(rb_string_t* data) {
-    if (tcp_client_fd >= 0) send(tcp_client_fd, data->data, data->length, 0);
+    if (tcp_in_handler) {
+        rb_tcp_send_to(tcp_current, data);
+        return;
+    }
+    if (tcp_client_fd >= 0 && data) {
+        int ok = 1;
+        tcp_send_all(tcp_client_fd, data->data, data->length, &ok);
+    }
 }
 
 rb_string_t* rb_tcp_receive(void) {
-    char buf[1024];
+    if (tcp_in_handler) {
+        rb_string_retain(tcp_current_data);
+        return tcp_current_data;
+    }
     if (tcp_client_fd < 0) return rb_string_alloc("");
-    ssize_t n = recv(tcp_client_fd, buf, sizeof(buf) - 1, 0);
-    if (n <= 0) return rb_string_alloc("");
-    buf[n] = '\0';
-    return rb_string_alloc(buf);
+    rb_string_t* s = rb_string_new(TCP_RECV_CHUNK);
+    int n = (int)recv(tcp_client_fd, s->data, TCP_RECV_CHUNK, 0);
+    return rb_string_fit(s, n);
+}
+
+void rb_tcp_close_client(int32_t conn) {
+    tcp_lock();
+    tcp_conn_t* c = tcp_lookup(conn);
+    if (c) c->closing = 1;
+    tcp_unlock();
 }
 
 void rb_tcp_close(void) {
+    if (tcp_in_handler) {
+        rb_tcp_close_client(tcp_current);
+        return;
+    }
     if (tcp_client_fd >= 0) { close(tcp_client_fd); tcp_client_fd = -1; }
-    if (tcp_server_fd >= 0) { close(tcp_server_fd); tcp_server_fd = -1; }
+    tcp_lock();
+    if (__atomic_load_n(&tcp_loop_running, __ATOMIC_ACQUIRE)) {
+        /* The loop may be waiting on these sockets; it closes them */
+        if (tcp_server_fd >= 0) tcp_server_stale = tcp_server_fd;
+        tcp_server_fd = -1;
+        for (int i = 0; i < TCP_MAX_CLIENTS; i++) {
+            if (tcp_conns[i].used) tcp_conns[i].closing = 1;
+        }
+    } else if (tcp_server_fd >= 0) {
+        close(tcp_server_fd);
+        tcp_server_fd = -1;
+    }
+    tcp_unlock();
 }
-
-#endif
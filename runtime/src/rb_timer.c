@@ -1,34 +1,317 @@
 #include "rb_runtime.h"
 #include <stdio.h>
 
+/* ── Timer scheduler ──────────────────────────────────────
+ *
+ * Every runtime timer (ON TIMER, TIMER.AFTER / TIMER.EVERY, cron) is an
+ * entry in one min-heap ordered by deadline, and a single one-shot clock
+ * (an esp_timer on the device, a thread on the host) is armed for the
+ * earliest of them. Adding, firing or cancelling a timer is O(log n) and no
+ * timer owns a kernel object. Deadlines are in microseconds; a periodic
+ * timer is rescheduled from its previous deadline, so it does not drift,
+ * and skips periods it missed instead of firing a burst to catch up.
+ *
+ * Callbacks run on the clock's task and must be quick; BASIC handlers are
+ * handed to the event dispatcher (rb_event.c) rather than run here.
+ */
+
+#define SCHED_MAX RB_TIMER_MAX
+/* An id is slot + SCHED_MAX * generation, so a stale id cancels nothing */
+#define SCHED_ID(slot) ((int32_t)(slot) + SCHED_MAX * (int32_t)sched_timers[slot].gen)
+
+typedef struct {
+    int64_t due;            /* absolute deadline, us */
+    int64_t period;         /* 0 for one-shot */
+    void (*fn)(int32_t);
+    int32_t arg;
+    int16_t heap_pos;       /* -1 when not scheduled */
+    uint16_t gen;
+} sched_timer_t;
+
+static sched_timer_t sched_timers[SCHED_MAX];
+static int16_t sched_heap[SCHED_MAX];
+static int32_t sched_len = 0;
+static int sched_init_done = 0;
+
+static int64_t sched_now(void);
+static void sched_lock(void);
+static void sched_unlock(void);
+static void sched_arm(int64_t due);
+static void sched_platform_start(void);
+
 #ifdef ESP_PLATFORM
 #include "esp_timer.h"
-static int64_t timer_start_us = 0;
+#include <sys/lock.h>
+
+static esp_timer_handle_t sched_clock = NULL;
+static _lock_t sched_lock_handle;
+
+static int64_t sched_now(void) { return esp_timer_get_time(); }
+static void sched_lock(void) { _lock_acquire(&sched_lock_handle); }
+static void sched_unlock(void) { _lock_release(&sched_lock_handle); }
+
+static void sched_fire(void* arg);
+
+static void sched_arm(int64_t due) {
+    esp_timer_stop(sched_clock);
+    if (due < 0) return;
+    int64_t wait = due - sched_now();
+    esp_timer_start_once(sched_clock, wait > 0 ? (uint64_t)wait : 1);
+}
+
+static void sched_platform_start(void) {
+    esp_timer_create_args_t args = {
+        .callback = sched_fire,
+        .name = "rb_sched",
+    };
+    if (esp_timer_create(&args, &sched_clock) != ESP_OK) {
+        rb_panic("timer scheduler could not be created");
+    }
+}
+
 #else
-#include <sys/time.h>
-static long long timer_start_us = 0;
+#include <pthread.h>
+#include <time.h>
+
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;
+static int64_t sched_armed = -1;
+
+static int64_t sched_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sched_lock(void) { pthread_mutex_lock(&sched_mutex); }
+static void sched_unlock(void) { pthread_mutex_unlock(&sched_mutex); }
+
+/* Called with the lock held */
+static void sched_arm(int64_t due) {
+    sched_armed = due;
+    pthread_cond_signal(&sched_cond);
+}
 
-static long long get_time_us(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (long long)tv.tv_sec * 1000000LL + (long long)tv.tv_usec;
+static void sched_fire(void* arg);
+
+static void* sched_thread_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&sched_mutex);
+    for (;;) {
+        if (sched_armed < 0) {
+            pthread_cond_wait(&sched_cond, &sched_mutex);
+            continue;
+        }
+        int64_t wait = sched_armed - sched_now();
+        if (wait > 0) {
+            /* pthread_cond_timedwait takes a CLOCK_REALTIME deadline */
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            int64_t ns = until.tv_nsec + (wait % 1000000) * 1000;
+            until.tv_sec += (time_t)(wait / 1000000 + ns / 1000000000);
+            until.tv_nsec = (long)(ns % 1000000000);
+            pthread_cond_timedwait(&sched_cond, &sched_mutex, &until);
+            continue;
+        }
+        sched_armed = -1;
+        pthread_mutex_unlock(&sched_mutex);
+        sched_fire(NULL);
+        pthread_mutex_lock(&sched_mutex);
+    }
+    return NULL;
+}
+
+static void sched_platform_start(void) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, sched_thread_main, NULL) != 0) {
+        rb_panic("timer scheduler could not be created");
+    }
+    pthread_attr_destroy(&attr);
 }
+
 #endif
 
+/* ── Heap, all called with the lock held ── */
+
+static int sched_before(int16_t a, int16_t b) {
+    return sched_timers[a].due < sched_timers[b].due;
+}
+
+static void sched_place(int32_t pos, int16_t slot) {
+    sched_heap[pos] = slot;
+    sched_timers[slot].heap_pos = (int16_t)pos;
+}
+
+static void sched_sift_up(int32_t pos) {
+    int16_t slot = sched_heap[pos];
+    while (pos > 0) {
+        int32_t parent = (pos - 1) / 2;
+        if (!sched_before(slot, sched_heap[parent])) break;
+        sched_place(pos, sched_heap[parent]);
+        pos = parent;
+    }
+    sched_place(pos, slot);
+}
+
+static void sched_sift_down(int32_t pos) {
+    int16_t slot = sched_heap[pos];
+    for (;;) {
+        int32_t child = 2 * pos + 1;
+        if (child >= sched_len) break;
+        if (child + 1 < sched_len && sched_before(sched_heap[child + 1], sched_heap[child])) child++;
+        if (!sched_before(sched_heap[child], slot)) break;
+        sched_place(pos, sched_heap[child]);
+        pos = child;
+    }
+    sched_place(pos, slot);
+}
+
+static void sched_remove_at(int32_t pos) {
+    int16_t slot = sched_heap[pos];
+    sched_timers[slot].heap_pos = -1;
+    sched_len--;
+    if (pos == sched_len) return;
+    int16_t moved = sched_heap[sched_len];
+    sched_place(pos, moved);
+    sched_sift_down(pos);
+    sched_sift_up(sched_timers[moved].heap_pos);
+}
+
+static int64_t sched_next_due(void) {
+    return sched_len > 0 ? sched_timers[sched_heap[0]].due : -1;
+}
+
+static void sched_fire(void* arg) {
+    (void)arg;
+    /* Collected under the lock and called after it, so a callback may
+     * schedule or cancel timers itself */
+    void (*fns[SCHED_MAX])(int32_t);
+    int32_t args[SCHED_MAX];
+    int32_t n = 0;
+    sched_lock();
+    int64_t now = sched_now();
+    while (sched_len > 0 && sched_timers[sched_heap[0]].due <= now) {
+        int16_t slot = sched_heap[0];
+        sched_timer_t* t = &sched_timers[slot];
+        fns[n] = t->fn;
+        args[n] = t->arg;
+        n++;
+        if (t->period > 0) {
+            t->due += t->period;
+            if (t->due <= now) t->due += ((now - t->due) / t->period + 1) * t->period;
+            sched_sift_down(0);
+        } else {
+            sched_remove_at(0);
+            t->fn = NULL;
+            t->gen++;
+        }
+    }
+    sched_arm(sched_next_due());
+    sched_unlock();
+    for (int32_t i = 0; i < n; i++) fns[i](args[i]);
+}
+
+int32_t rb_sched_add(int64_t delay_us, int64_t period_us, void (*fn)(int32_t), int32_t arg) {
+    if (!fn) return -1;
+    if (delay_us < 0) delay_us = 0;
+    if (period_us < 0) period_us = 0;
+    sched_lock();
+    /* Under the lock: two tasks adding the first timers start one clock */
+    if (!sched_init_done) {
+        sched_init_done = 1;
+        for (int32_t i = 0; i < SCHED_MAX; i++) sched_timers[i].heap_pos = -1;
+        sched_platform_start();
+    }
+    int32_t slot = -1;
+    for (int32_t i = 0; i < SCHED_MAX && slot < 0; i++) {
+        if (!sched_timers[i].fn) slot = i;
+    }
+    if (slot < 0) {
+        sched_unlock();
+        return -1;
+    }
+    sched_timer_t* t = &sched_timers[slot];
+    t->due = sched_now() + delay_us;
+    t->period = period_us;
+    t->fn = fn;
+    t->arg = arg;
+    sched_place(sched_len++, (int16_t)slot);
+    sched_sift_up(t->heap_pos);
+    if (t->heap_pos == 0) sched_arm(t->due);
+    int32_t id = SCHED_ID(slot);
+    sched_unlock();
+    return id;
+}
+
+int32_t rb_sched_cancel(int32_t id) {
+    if (id < 0) return -1;
+    int32_t slot = id % SCHED_MAX;
+    int32_t arg = -1;
+    sched_lock();
+    sched_timer_t* t = &sched_timers[slot];
+    if (t->fn && SCHED_ID(slot) == id) {
+        int was_first = t->heap_pos == 0;
+        if (t->heap_pos >= 0) sched_remove_at(t->heap_pos);
+        arg = t->arg;
+        t->fn = NULL;
+        t->gen++;
+        if (was_first) sched_arm(sched_next_due());
+    }
+    sched_unlock();
+    return arg;
+}
+
+/* ── BASIC timers ──────────────────────────────────────── */
+
+static int64_t timer_start_us = 0;
+
 void rb_timer_start(void) {
-#ifdef ESP_PLATFORM
-    timer_start_us = esp_timer_get_time();
-#else
-    timer_start_us = get_time_us();
-#endif
+    timer_start_us = sched_now();
 }
 
+/* Both readings wrap modulo 2^32 instead of saturating: the difference
+ * of two readings taken less than a wrap apart is still right */
 int32_t rb_timer_elapsed(void) {
-#ifdef ESP_PLATFORM
-    int64_t now = esp_timer_get_time();
-    return (int32_t)((now - timer_start_us) / 1000);
-#else
-    long long now = get_time_us();
-    return (int32_t)((now - timer_start_us) / 1000);
-#endif
+    return (int32_t)(uint32_t)((sched_now() - timer_start_us) / 1000);
+}
+
+int32_t rb_timer_micros(void) {
+    return (int32_t)(uint32_t)(sched_now() - timer_start_us);
+}
+
+/* Timer ids handed to BASIC are scheduler ids; the event source that runs
+ * the handler rides along as the callback argument */
+static int32_t timer_add(int64_t delay_us, int64_t period_us, void (*handler)(void)) {
+    int32_t source = rb_event_source_alloc(handler, period_us == 0);
+    if (source < 0) {
+        printf("[TIMER] at most %d timers\n", RB_TIMER_MAX);
+        return -1;
+    }
+    int32_t id = rb_sched_add(delay_us, period_us, rb_event_raise, source);
+    if (id < 0) {
+        rb_event_source_free(source);
+        printf("[TIMER] at most %d timers\n", RB_TIMER_MAX);
+    }
+    return id;
+}
+
+void rb_on_timer(int32_t interval_ms, void (*handler)(void)) {
+    int64_t us = (int64_t)interval_ms * 1000;
+    timer_add(us, us, handler);
+}
+
+int32_t rb_timer_after(int32_t us, void (*handler)(void)) {
+    return timer_add(us, 0, handler);
+}
+
+int32_t rb_timer_every(int32_t us, void (*handler)(void)) {
+    return timer_add(us, us > 0 ? us : 1, handler);
+}
+
+void rb_timer_cancel(int32_t id) {
+    int32_t source = rb_sched_cancel(id);
+    if (source >= 0) rb_event_source_free(source);
 }
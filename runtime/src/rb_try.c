@@ -1,26 +1,25 @@
 #include "rb_runtime.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <setjmp.h>
 #include <string.h>
 
-#define MAX_TRY_DEPTH 16
+/* ── TRY/CATCH ────────────────────────────────────────────
+ *
+ * No context is saved on entry to a TRY block: rb_throw records the error
+ * in rb_error_pending and returns. Inside TRY, and in the SUBs and
+ * FUNCTIONs of a program that uses TRY, the compiler tests that flag after
+ * each statement: inside TRY it branches to the CATCH body, and in a
+ * procedure it returns, so the error unwinds caller by caller to the
+ * nearest TRY. A TRY that nothing throws in costs a depth count and one
+ * load and branch per statement. The state is per task.
+ */
 
-static jmp_buf try_stack[MAX_TRY_DEPTH];
-static int try_depth = 0;
-static char error_message[256] = {0};
+__thread int32_t rb_error_pending = 0;
+static __thread int32_t try_depth = 0;
+static __thread char error_message[256] = {0};
 
-int32_t rb_try_begin(void) {
-    if (try_depth >= MAX_TRY_DEPTH) {
-        fprintf(stderr, "TRY/CATCH nested too deep\n");
-        abort();
-    }
-    int result = setjmp(try_stack[try_depth]);
-    if (result == 0) {
-        try_depth++;
-        return 0;  /* entering try block */
-    }
-    return 1;  /* caught an error */
+void rb_try_begin(void) {
+    try_depth++;
 }
 
 void rb_try_end(void) {
@@ -29,20 +28,29 @@ void rb_try_end(void) {
     }
 }
 
+/* Entering CATCH: the error is handled; returns its message */
+rb_string_t* rb_try_catch(void) {
+    rb_try_end();
+    rb_error_pending = 0;
+    return rb_string_alloc(error_message);
+}
+
 void rb_throw(rb_string_t* message) {
     if (try_depth > 0) {
-        try_depth--;
+        /* A second error while unwinding from the first keeps the first */
+        if (rb_error_pending) return;
         if (message && message->length > 0) {
-            strncpy(error_message, message->data, sizeof(error_message) - 1);
+            strncpy(error_message, rb_string_cstr(message), sizeof(error_message) - 1);
             error_message[sizeof(error_message) - 1] = '\0';
         } else {
             strcpy(error_message, "Unknown error");
         }
-        longjmp(try_stack[try_depth], 1);
+        rb_error_pending = 1;
     } else {
         /* No try block active, treat as fatal */
+        rb_print_drain_now();
         if (message && message->length > 0) {
-            fprintf(stderr, "Unhandled error: %s\n", message->data);
+            fprintf(stderr, "Unhandled error: %s\n", rb_string_cstr(message));
         }
         abort();
     }
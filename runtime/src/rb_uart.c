@@ -1,11 +1,52 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
+
+/* ── UART ─────────────────────────────────────────────────
+ *
+ * The driver buffers in both directions: received bytes collect in an RX
+ * ring (UART_RX_DEFAULT unless UART.SETUP gives a size) by interrupt, and
+ * writes return once they are copied into the TX ring. UART.SEND and
+ * UART.READ$ move whole strings through those rings.
+ *
+ * ON UART.LINE arms the UART's pattern detector for a delimiter byte,
+ * checked in the RX interrupt, and starts an event task for the port.
+ * Each detected delimiter gives one handler call with the complete frame
+ * (delimiter and a trailing CR stripped) in UART.LINE$, so an NMEA or
+ * line-based protocol costs one dispatch per sentence, not per byte.
+ */
+
+#define UART_RX_DEFAULT 2048
+#define UART_TX_BUFFER 1024
+/* UART.READ / UART.READ$ wait this long for the first byte */
+#define UART_READ_TIMEOUT_MS 100
 
 #ifdef ESP_PLATFORM
 #include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <sys/lock.h>
+
+#define UART_EVENT_QUEUE 20
+#define UART_PATTERN_QUEUE 16
+#define UART_EVENT_STACK 4096
+#define UART_EVENT_PRIORITY 3
+
+static QueueHandle_t uart_events[UART_NUM_MAX];
+static TaskHandle_t uart_tasks[UART_NUM_MAX];
+static void (*uart_line_handlers[UART_NUM_MAX])(void);
+/* One line handler runs at a time, so UART.LINE$ has a single current line */
+static _lock_t uart_dispatch_lock;
+static rb_string_t* uart_current_line = NULL;
+
+static int uart_valid(int32_t port) {
+    return port >= 0 && port < UART_NUM_MAX && uart_is_driver_installed((uart_port_t)port);
+}
 #endif
 
-void rb_uart_setup(int32_t port, int32_t baud, int32_t tx, int32_t rx) {
+void rb_uart_setup(int32_t port, int32_t baud, int32_t tx, int32_t rx, int32_t rx_buffer) {
+    if (rx_buffer <= 0) rx_buffer = UART_RX_DEFAULT;
 #ifdef ESP_PLATFORM
     uart_config_t uart_config = {
         .baud_rate = baud,
@@ -16,10 +57,17 @@ void rb_uart_setup(int32_t port, int32_t baud, int32_t tx, int32_t rx) {
     };
     uart_param_config((uart_port_t)port, &uart_config);
     uart_set_pin((uart_port_t)port, tx, rx, -1, -1);
-    uart_driver_install((uart_port_t)port, 256, 0, 0, NULL, 0);
+    /* A second SETUP only changes baud and pins: an event task may be
+     * waiting on this port's queue */
+    if (!uart_is_driver_installed((uart_port_t)port)) {
+        /* The ring must be larger than the hardware FIFO */
+        if (rx_buffer <= UART_HW_FIFO_LEN(port)) rx_buffer = UART_HW_FIFO_LEN(port) * 2;
+        uart_driver_install((uart_port_t)port, rx_buffer, UART_TX_BUFFER, UART_EVENT_QUEUE,
+                            &uart_events[port], 0);
+    }
 #else
-    printf("[UART] setup: port=%d, baud=%d, tx=%d, rx=%d\n",
-           (int)port, (int)baud, (int)tx, (int)rx);
+    printf("[UART] setup: port=%d, baud=%d, tx=%d, rx=%d, rx buffer=%d\n",
+           (int)port, (int)baud, (int)tx, (int)rx, (int)rx_buffer);
 #endif
 }
 
@@ -35,7 +83,7 @@ void rb_uart_write(int32_t port, int32_t data) {
 int32_t rb_uart_read(int32_t port) {
 #ifdef ESP_PLATFORM
     uint8_t byte = 0;
-    int len = uart_read_bytes((uart_port_t)port, &byte, 1, 100 / portTICK_PERIOD_MS);
+    int len = uart_read_bytes((uart_port_t)port, &byte, 1, UART_READ_TIMEOUT_MS / portTICK_PERIOD_MS);
     if (len > 0) return (int32_t)byte;
     return -1;
 #else
@@ -43,3 +91,131 @@ int32_t rb_uart_read(int32_t port) {
     return 0;
 #endif
 }
+
+void rb_uart_send(int32_t port, rb_string_t* data) {
+    if (!data || data->length <= 0) return;
+#ifdef ESP_PLATFORM
+    if (!uart_valid(port)) return;
+    uart_write_bytes((uart_port_t)port, data->data, (size_t)data->length);
+#else
+    printf("[UART] send: port=%d, %d bytes\n", (int)port, (int)data->length);
+#endif
+}
+
+/* Everything already received, up to `max` bytes; when nothing is, waits
+ * up to UART_READ_TIMEOUT_MS for the first byte. "" on timeout. */
+rb_string_t* rb_uart_read_str(int32_t port, int32_t max) {
+    if (max <= 0) return rb_string_alloc("");
+#ifdef ESP_PLATFORM
+    if (!uart_valid(port)) return rb_string_alloc("");
+    rb_string_t* s = rb_string_new(max);
+    int32_t n = 0;
+    size_t buffered = 0;
+    uart_get_buffered_data_len((uart_port_t)port, &buffered);
+    if (buffered == 0) {
+        int got = uart_read_bytes((uart_port_t)port, s->data, 1, UART_READ_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (got <= 0) return rb_string_fit(s, 0);
+        n = 1;
+        uart_get_buffered_data_len((uart_port_t)port, &buffered);
+    }
+    if (buffered > (size_t)(max - n)) buffered = (size_t)(max - n);
+    if (buffered > 0) {
+        int got = uart_read_bytes((uart_port_t)port, s->data + n, (uint32_t)buffered, 0);
+        if (got > 0) n += got;
+    }
+    return rb_string_fit(s, n);
+#else
+    printf("[UART] read$: port=%d, max=%d\n", (int)port, (int)max);
+    return rb_string_alloc("");
+#endif
+}
+
+rb_string_t* rb_uart_line(void) {
+#ifdef ESP_PLATFORM
+    if (uart_current_line) {
+        rb_string_retain(uart_current_line);
+        return uart_current_line;
+    }
+#endif
+    return rb_string_alloc("");
+}
+
+#ifdef ESP_PLATFORM
+static void uart_dispatch_line(uart_port_t port, char delim) {
+    int pos = uart_pattern_pop_pos(port);
+    if (pos < 0) {
+        /* More delimiters arrived than the position queue holds; the
+         * frame boundaries are lost, so start over from fresh input */
+        uart_flush_input(port);
+        uart_pattern_queue_reset(port, UART_PATTERN_QUEUE);
+        printf("[UART] port %d: line queue overflow, input dropped\n", (int)port);
+        return;
+    }
+    rb_string_t* line = rb_string_new(pos + 1);
+    int got = uart_read_bytes(port, line->data, (uint32_t)(pos + 1), 0);
+    int32_t n = got > 0 ? got : 0;
+    if (n > 0 && line->data[n - 1] == delim) n--;
+    if (n > 0 && line->data[n - 1] == '\r') n--;
+    line = rb_string_fit(line, n);
+
+    void (*handler)(void) = uart_line_handlers[port];
+    _lock_acquire(&uart_dispatch_lock);
+    uart_current_line = line;
+    if (handler) handler();
+    uart_current_line = NULL;
+    _lock_release(&uart_dispatch_lock);
+    rb_string_release(line);
+}
+
+typedef struct {
+    uart_port_t port;
+    char delim;
+} uart_task_arg_t;
+
+static uart_task_arg_t uart_task_args[UART_NUM_MAX];
+
+static void uart_event_main(void* arg) {
+    uart_task_arg_t* a = (uart_task_arg_t*)arg;
+    uart_event_t ev;
+    for (;;) {
+        if (xQueueReceive(uart_events[a->port], &ev, portMAX_DELAY) != pdTRUE) continue;
+        switch (ev.type) {
+        case UART_PATTERN_DET:
+            uart_dispatch_line(a->port, a->delim);
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            uart_flush_input(a->port);
+            xQueueReset(uart_events[a->port]);
+            uart_pattern_queue_reset(a->port, UART_PATTERN_QUEUE);
+            printf("[UART] port %d: RX overflow, input dropped\n", (int)a->port);
+            break;
+        default:
+            break;
+        }
+    }
+}
+#endif
+
+void rb_on_uart_line(int32_t port, int32_t delim, void (*handler)(void)) {
+#ifdef ESP_PLATFORM
+    if (!uart_valid(port) || !uart_events[port]) {
+        printf("[UART] ON UART.LINE: port %d is not set up\n", (int)port);
+        return;
+    }
+    uart_line_handlers[port] = handler;
+    uart_task_args[port].port = (uart_port_t)port;
+    uart_task_args[port].delim = (char)delim;
+    uart_disable_pattern_det_intr((uart_port_t)port);
+    uart_enable_pattern_det_baud_intr((uart_port_t)port, (char)delim, 1, 9, 0, 0);
+    uart_pattern_queue_reset((uart_port_t)port, UART_PATTERN_QUEUE);
+    if (!uart_tasks[port] &&
+        xTaskCreate(uart_event_main, "rb_uart", UART_EVENT_STACK, &uart_task_args[port],
+                    UART_EVENT_PRIORITY, &uart_tasks[port]) != pdPASS) {
+        rb_panic("UART event task could not be created");
+    }
+#else
+    (void)handler;
+    printf("[UART] ON UART.LINE port=%d delim=%d registered\n", (int)port, (int)delim);
+#endif
+}
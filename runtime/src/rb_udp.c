@@ -3,6 +3,8 @@
 
 #ifdef ESP_PLATFORM
 #include "lwip/sockets.h"
+/* Largest datagram that crosses Ethernet/Wi-Fi without fragmenting */
+#define UDP_RECV_MAX 1472
 static int rb_udp_sock = -1;
 #endif
 
@@ -22,22 +24,20 @@ void rb_udp_send(rb_string_t* host, int32_t port, rb_string_t* data) {
 #ifdef ESP_PLATFORM
     if (rb_udp_sock < 0) rb_udp_init(0);
     struct sockaddr_in dest = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
-    inet_aton(host->data, &dest.sin_addr);
+    inet_aton(rb_string_cstr(host), &dest.sin_addr);
     sendto(rb_udp_sock, data->data, data->length, 0, (struct sockaddr*)&dest, sizeof(dest));
 #else
-    fprintf(stderr, "[stub] UDP.SEND %s:%d \"%s\"\n", host ? host->data : "", (int)port, data ? data->data : "");
+    fprintf(stderr, "[stub] UDP.SEND %s:%d \"%s\"\n", rb_string_cstr(host), (int)port, rb_string_cstr(data));
 #endif
 }
 
 rb_string_t* rb_udp_receive(void) {
 #ifdef ESP_PLATFORM
-    char buf[1024];
     struct sockaddr_in src;
     socklen_t slen = sizeof(src);
-    int n = recvfrom(rb_udp_sock, buf, sizeof(buf)-1, 0, (struct sockaddr*)&src, &slen);
-    if (n <= 0) return rb_string_alloc("");
-    buf[n] = '\0';
-    return rb_string_alloc(buf);
+    rb_string_t* s = rb_string_new(UDP_RECV_MAX);
+    int n = recvfrom(rb_udp_sock, s->data, UDP_RECV_MAX, 0, (struct sockaddr*)&src, &slen);
+    return rb_string_fit(s, n > 0 ? n : 0);
 #else
     fprintf(stderr, "[stub] UDP.RECEIVE not supported on host\n");
     return rb_string_alloc("");
@@ -1,57 +1,510 @@
 #include "rb_runtime.h"
 #include <stdio.h>
+#include <string.h>
 
 #ifdef ESP_PLATFORM
+#include <strings.h>
+#include <sys/stat.h>
 #include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+/* ── Requests as handles ──────────────────────────────────
+ *
+ * Every request is detached from the httpd task with
+ * httpd_req_async_handler_begin and parked in a slot until it is answered,
+ * so httpd keeps accepting and reading other sockets while BASIC code
+ * builds a reply. A request handle is the slot index plus a generation
+ * count: a stale handle (already answered) is ignored rather than
+ * answering whichever request reused the slot.
+ *
+ * Requests matching a WEB.ROUTE run the route's SUB on one of a few worker
+ * tasks, WEB.SERVE routes are answered from files on the same workers, and
+ * everything else goes to the queue WEB.WAIT$ reads.
+ */
+
+#define WEB_MAX_REQUESTS 8
+#define WEB_MAX_ROUTES 16
+#define WEB_MAX_PATH 64
+#define WEB_MAX_BODY 16384
+#define WEB_WORKERS 2
+#define WEB_WORKER_STACK 6144
+#define WEB_WORKER_PRIORITY 2
+/* Files are sent in chunks of this size from a buffer on the worker stack */
+#define WEB_FILE_CHUNK 1024
+
+typedef struct {
+    httpd_req_t* req;       /* async copy, owned until the reply */
+    rb_string_t* uri;
+    rb_string_t* body;
+    uint16_t gen;
+    uint8_t used;
+    uint8_t taken;          /* WEB.REQUEST handed the handle to BASIC code */
+} web_request_t;
+
+typedef struct {
+    char path[WEB_MAX_PATH];
+    httpd_method_t method;
+    void (*handler)(void);
+    /* WEB.SERVE: directory the route's files come from, and how much of
+     * the URI is the mount prefix */
+    char dir[WEB_MAX_PATH];
+    uint8_t prefix_len;
+} web_route_t;
+
+typedef struct {
+    int32_t id;
+    const web_route_t* route;   /* NULL for WEB.WAIT$ */
+} web_job_t;
 
 static httpd_handle_t server = NULL;
-static char last_uri[256] = "";
-static char last_body[4096] = "";
-static httpd_req_t* pending_req = NULL;
-
-static esp_err_t handler(httpd_req_t *req) {
-    strncpy(last_uri, req->uri, sizeof(last_uri) - 1);
-    int len = req->content_len;
-    if (len > 0 && len < (int)sizeof(last_body)) {
-        httpd_req_recv(req, last_body, len);
-        last_body[len] = '\0';
-    } else {
-        last_body[0] = '\0';
-    }
-    pending_req = req;
+static web_request_t web_requests[WEB_MAX_REQUESTS];
+static portMUX_TYPE web_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static web_route_t web_routes[WEB_MAX_ROUTES];
+static int web_route_count = 0;
+static int web_catch_all = 0;
+
+static QueueHandle_t web_jobs = NULL;     /* routed requests, for the workers */
+static QueueHandle_t web_waiting = NULL;  /* everything else, for WEB.WAIT$ */
+
+/* Request the calling task is working on: set by WEB.WAIT$, or for the
+ * duration of a route SUB on a worker */
+static RB_THREAD_LOCAL int32_t web_current = 0;
+static RB_THREAD_LOCAL int web_in_route = 0;
+
+static int32_t web_claim(void) {
+    int32_t id = 0;
+    taskENTER_CRITICAL(&web_lock);
+    for (int i = 0; i < WEB_MAX_REQUESTS; i++) {
+        web_request_t* r = &web_requests[i];
+        if (r->used) continue;
+        if (++r->gen == 0) r->gen = 1;
+        r->used = 1;
+        r->taken = 0;
+        id = (int32_t)r->gen * WEB_MAX_REQUESTS + i;
+        break;
+    }
+    taskEXIT_CRITICAL(&web_lock);
+    return id;
+}
+
+/* Slot of a live handle, or NULL. Call with web_lock held. */
+static web_request_t* web_lookup(int32_t id) {
+    if (id <= 0) return NULL;
+    web_request_t* r = &web_requests[id % WEB_MAX_REQUESTS];
+    if (!r->used || (int32_t)r->gen != id / WEB_MAX_REQUESTS) return NULL;
+    return r;
+}
+
+/* Detach request `id` from its slot so exactly one caller answers it;
+ * returns 0 for a stale handle */
+static int web_take(int32_t id, web_request_t* out) {
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* slot = web_lookup(id);
+    if (slot) {
+        *out = *slot;
+        slot->used = 0;
+        slot->req = NULL;
+        slot->uri = NULL;
+        slot->body = NULL;
+    }
+    taskEXIT_CRITICAL(&web_lock);
+    return slot != NULL;
+}
+
+/* Hand a taken request, answered or not, back to httpd */
+static void web_done(web_request_t* r) {
+    if (r->req) httpd_req_async_handler_complete(r->req);
+    rb_string_release(r->uri);
+    rb_string_release(r->body);
+}
+
+/* Answer request `id` and free its slot. Only the first answer to a
+ * handle is sent; returns 0 for a stale one. */
+static int web_finish(int32_t id, int32_t status, const char* data, int32_t len) {
+    web_request_t r;
+    if (!web_take(id, &r)) return 0;
+    if (r.req) {
+        char stat[16];
+        snprintf(stat, sizeof(stat), "%d", (int)status);
+        httpd_resp_set_status(r.req, stat);
+        httpd_resp_send(r.req, data, len);
+    }
+    web_done(&r);
+    return 1;
+}
+
+/* ── Static files ─────────────────────────────────────────
+ *
+ * WEB.SERVE answers GETs from a directory without holding a file in RAM:
+ * it is streamed with httpd_resp_send_chunk from a fixed buffer. A
+ * precompressed "name.gz" next to the file is sent instead when the client
+ * accepts gzip. The ETag is built from size and modification time, so a
+ * revalidation with a matching If-None-Match costs one stat and no reads
+ * of the file itself.
+ */
+
+static const char* web_mime_type(const char* path) {
+    static const struct { const char* ext; const char* type; } types[] = {
+        { ".html", "text/html" }, { ".htm", "text/html" }, { ".css", "text/css" },
+        { ".js", "application/javascript" }, { ".json", "application/json" },
+        { ".png", "image/png" }, { ".jpg", "image/jpeg" }, { ".jpeg", "image/jpeg" },
+        { ".gif", "image/gif" }, { ".svg", "image/svg+xml" }, { ".ico", "image/x-icon" },
+        { ".txt", "text/plain" }, { ".wasm", "application/wasm" },
+    };
+    const char* ext = strrchr(path, '.');
+    if (ext) {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if (strcasecmp(ext, types[i].ext) == 0) return types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+/* Whether header `name` of `req` contains `token` */
+static int web_header_has(httpd_req_t* req, const char* name, const char* token) {
+    char value[96];
+    if (httpd_req_get_hdr_value_str(req, name, value, sizeof(value)) != ESP_OK) return 0;
+    return strstr(value, token) != NULL;
+}
+
+static void web_send_file(httpd_req_t* req, const web_route_t* route, const char* uri) {
+    /* File path: the route's directory plus the URI after the mount
+     * prefix, without query or fragment */
+    const char* rel = uri + route->prefix_len;
+    int rel_len = (int)strcspn(rel, "?#");
+    char path[256];
+    int n = snprintf(path, sizeof(path), "%s%.*s", route->dir, rel_len, rel);
+    /* Leave room for "/index.html" and ".gz" */
+    if (n <= 0 || n >= (int)sizeof(path) - 16 || strstr(path, "..")) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+        return;
+    }
+    if (rel_len == 0) path[n++] = '/';
+    if (path[n - 1] == '/') n += sprintf(path + n, "index.html");
+
+    const char* type = web_mime_type(path);
+    struct stat st;
+    int gzip = 0;
+    if (web_header_has(req, "Accept-Encoding", "gzip")) {
+        strcpy(path + n, ".gz");
+        gzip = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+        if (!gzip) path[n] = '\0';
+    }
+    if (!gzip && (stat(path, &st) != 0 || !S_ISREG(st.st_mode))) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+        return;
+    }
+
+    char etag[40];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx%s\"",
+             (unsigned long)st.st_size, (unsigned long)st.st_mtime, gzip ? "-gz" : "");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (web_header_has(req, "If-None-Match", etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return;
+    }
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+        return;
+    }
+    httpd_resp_set_type(req, type);
+    if (gzip) httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    char buf[WEB_FILE_CHUNK];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (httpd_resp_send_chunk(req, buf, (ssize_t)got) != ESP_OK) break;
+    }
+    fclose(f);
+    httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static void web_serve_request(int32_t id, const web_route_t* route) {
+    web_request_t r;
+    if (!web_take(id, &r)) return;
+    if (r.req) web_send_file(r.req, route, rb_string_cstr(r.uri));
+    web_done(&r);
+}
+
+/* A request nobody replied to or took a handle for still gets an answer */
+static void web_settle(int32_t id) {
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* r = web_lookup(id);
+    int orphaned = r && !r->taken;
+    taskEXIT_CRITICAL(&web_lock);
+    if (orphaned) web_finish(id, 204, NULL, 0);
+}
+
+static esp_err_t web_accept(httpd_req_t* req, const web_route_t* route) {
+    if (req->content_len > WEB_MAX_BODY) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+        return ESP_FAIL;
+    }
+
+    /* Read the whole body here: the async copy must not race httpd for
+     * the socket */
+    int len = (int)req->content_len;
+    rb_string_t* body = rb_string_new(len);
+    int got = 0;
+    while (got < len) {
+        int n = httpd_req_recv(req, body->data + got, len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            rb_string_release(body);
+            return ESP_FAIL;
+        }
+        got += n;
+    }
+
+    int32_t id = web_claim();
+    httpd_req_t* async_req = NULL;
+    if (id == 0 || httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        if (id) web_finish(id, 0, NULL, 0);
+        rb_string_release(body);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Busy", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    rb_string_t* uri = rb_string_alloc(req->uri);
+    rb_string_share(uri);
+    rb_string_share(body);
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* r = &web_requests[id % WEB_MAX_REQUESTS];
+    r->req = async_req;
+    r->uri = uri;
+    r->body = body;
+    taskEXIT_CRITICAL(&web_lock);
+
+    web_job_t job = { .id = id, .route = route };
+    BaseType_t queued = route ? xQueueSend(web_jobs, &job, 0)
+                              : xQueueSend(web_waiting, &id, 0);
+    if (queued != pdTRUE) {
+        static const char busy[] = "Busy";
+        web_finish(id, 503, busy, sizeof(busy) - 1);
+    }
     return ESP_OK;
 }
 
+static esp_err_t web_route_handler(httpd_req_t* req) {
+    return web_accept(req, (const web_route_t*)req->user_ctx);
+}
+
+static esp_err_t web_wait_handler(httpd_req_t* req) {
+    return web_accept(req, NULL);
+}
+
+static void web_worker_main(void* arg) {
+    (void)arg;
+    web_job_t job;
+    for (;;) {
+        if (xQueueReceive(web_jobs, &job, portMAX_DELAY) != pdTRUE) continue;
+        if (!job.route->handler) {
+            web_serve_request(job.id, job.route);
+            continue;
+        }
+        web_current = job.id;
+        web_in_route = 1;
+        job.route->handler();
+        web_in_route = 0;
+        web_settle(job.id);
+        web_current = 0;
+    }
+}
+
+static void web_register(const web_route_t* route) {
+    httpd_uri_t uri = {
+        .uri = route->path,
+        .method = route->method,
+        .handler = web_route_handler,
+        .user_ctx = (void*)route,
+    };
+    if (httpd_register_uri_handler(server, &uri) != ESP_OK) {
+        fprintf(stderr, "WEB.ROUTE: could not register %s\n", route->path);
+    }
+}
+
+static int web_parse_method(const char* m, httpd_method_t* out) {
+    static const struct { const char* name; httpd_method_t method; } methods[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+        { "DELETE", HTTP_DELETE }, { "PATCH", HTTP_PATCH }, { "HEAD", HTTP_HEAD },
+        { "ANY", HTTP_ANY },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strcasecmp(m, methods[i].name) == 0) {
+            *out = methods[i].method;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void rb_web_start(int32_t port) {
+    if (!web_waiting) {
+        web_waiting = xQueueCreate(WEB_MAX_REQUESTS, sizeof(int32_t));
+        if (!web_waiting) rb_panic("WEB request queue could not be created");
+    }
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = port;
-    httpd_start(&server, &config);
-    httpd_uri_t uri = { .uri = "/*", .method = HTTP_GET, .handler = handler };
-    httpd_register_uri_handler(server, &uri);
-    printf("[WEB] Server started on port %d\n", port);
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = WEB_MAX_ROUTES + 1;
+    if (httpd_start(&server, &config) != ESP_OK) {
+        fprintf(stderr, "WEB.START: could not start server on port %d\n", (int)port);
+        server = NULL;
+        return;
+    }
+    /* Routes declared before WEB.START */
+    for (int i = 0; i < web_route_count; i++) web_register(&web_routes[i]);
+    printf("[WEB] Server started on port %d\n", (int)port);
+}
+
+/* Add a route to the table, and to httpd if it is already running */
+static void web_add_route(const web_route_t* route, const char* what) {
+    if (web_route_count >= WEB_MAX_ROUTES) {
+        fprintf(stderr, "%s: too many routes, %s ignored\n", what, route->path);
+        return;
+    }
+    if (web_catch_all) {
+        /* httpd matches in registration order, so WEB.WAIT$'s catch-all
+         * would shadow this route */
+        fprintf(stderr, "%s: %s declared after WEB.WAIT$ is never matched\n", what, route->path);
+    }
+
+    if (!web_jobs) {
+        web_jobs = xQueueCreate(WEB_MAX_REQUESTS, sizeof(web_job_t));
+        if (!web_jobs) rb_panic("WEB job queue could not be created");
+        for (int i = 0; i < WEB_WORKERS; i++) {
+            if (xTaskCreate(web_worker_main, "rb_web_worker", WEB_WORKER_STACK, NULL,
+                            WEB_WORKER_PRIORITY, NULL) != pdPASS) {
+                rb_panic("WEB worker task could not be created");
+            }
+        }
+    }
+
+    /* Entries are never moved, so httpd can keep a pointer as user_ctx */
+    web_route_t* slot = &web_routes[web_route_count++];
+    *slot = *route;
+    if (server) web_register(slot);
+}
+
+void rb_web_route(rb_string_t* method, rb_string_t* path, void (*handler)(void)) {
+    const char* m = rb_string_cstr(method);
+    const char* p = rb_string_cstr(path);
+    web_route_t route = { .handler = handler };
+    if (!web_parse_method(m, &route.method)) {
+        fprintf(stderr, "WEB.ROUTE: unknown method %s\n", m);
+        return;
+    }
+    if (strlen(p) >= WEB_MAX_PATH) {
+        fprintf(stderr, "WEB.ROUTE: path too long: %s\n", p);
+        return;
+    }
+    strcpy(route.path, p);
+    web_add_route(&route, "WEB.ROUTE");
+}
+
+void rb_web_serve(rb_string_t* prefix, rb_string_t* dir) {
+    const char* p = rb_string_cstr(prefix);
+    const char* d = rb_string_cstr(dir);
+    web_route_t route = { .method = HTTP_GET };
+
+    /* "/ui/" and "/ui" both mount files under "/ui/"; relative directories
+     * are on LittleFS, like FILE.OPEN, and "/sdcard/..." works too */
+    size_t plen = strlen(p);
+    while (plen > 0 && p[plen - 1] == '/') plen--;
+    size_t dlen = strlen(d);
+    while (dlen > 0 && d[dlen - 1] == '/') dlen--;
+    int pn = snprintf(route.path, sizeof(route.path), "%.*s/*", (int)plen, p);
+    int dn = d[0] == '/'
+        ? snprintf(route.dir, sizeof(route.dir), "%.*s", (int)dlen, d)
+        : snprintf(route.dir, sizeof(route.dir), "/littlefs/%.*s", (int)dlen, d);
+    if (pn >= (int)sizeof(route.path) || dn >= (int)sizeof(route.dir)) {
+        fprintf(stderr, "WEB.SERVE: path too long: %s\n", p);
+        return;
+    }
+    if (dn > 1 && route.dir[dn - 1] == '/') route.dir[dn - 1] = '\0';
+    route.prefix_len = (uint8_t)plen;
+    web_add_route(&route, "WEB.SERVE");
 }
 
 rb_string_t* rb_web_wait(void) {
-    while (pending_req == NULL) { vTaskDelay(pdMS_TO_TICKS(10)); }
-    return rb_string_from_cstr(last_uri);
+    rb_string_t* uri = NULL;
+    if (!web_in_route) {
+        if (!server) return rb_string_alloc("");
+        if (!web_catch_all) {
+            httpd_uri_t any = { .uri = "/*", .method = HTTP_ANY, .handler = web_wait_handler };
+            httpd_register_uri_handler(server, &any);
+            web_catch_all = 1;
+        }
+        web_settle(web_current);
+        int32_t id = 0;
+        xQueueReceive(web_waiting, &id, portMAX_DELAY);
+        web_current = id;
+    }
+    /* Inside a route SUB this is the path that was matched */
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* r = web_lookup(web_current);
+    if (r && r->uri) {
+        uri = r->uri;
+        rb_string_retain(uri);
+    }
+    taskEXIT_CRITICAL(&web_lock);
+    return uri ? uri : rb_string_alloc("");
 }
 
 rb_string_t* rb_web_body(void) {
-    return rb_string_from_cstr(last_body);
+    rb_string_t* body = NULL;
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* r = web_lookup(web_current);
+    if (r && r->body) {
+        body = r->body;
+        rb_string_retain(body);
+    }
+    taskEXIT_CRITICAL(&web_lock);
+    return body ? body : rb_string_alloc("");
+}
+
+int32_t rb_web_request(void) {
+    taskENTER_CRITICAL(&web_lock);
+    web_request_t* r = web_lookup(web_current);
+    if (r) r->taken = 1;
+    taskEXIT_CRITICAL(&web_lock);
+    return r ? web_current : 0;
+}
+
+void rb_web_reply_to(int32_t request, int32_t status, rb_string_t* body) {
+    web_finish(request, status, body ? body->data : "", body ? body->length : 0);
 }
 
 void rb_web_reply(int32_t status, rb_string_t* body) {
-    if (pending_req) {
-        char stat[16];
-        snprintf(stat, sizeof(stat), "%d", status);
-        httpd_resp_set_status(pending_req, stat);
-        httpd_resp_send(pending_req, body->data, body->len);
-        pending_req = NULL;
-    }
+    rb_web_reply_to(web_current, status, body);
 }
 
 void rb_web_stop(void) {
+    /* Queued requests are not picked up any more; every request still
+     * parked (queued, in a route SUB, or held by WEB.REQUEST) gets a 503
+     * and goes back to httpd before httpd_stop frees the server. A late
+     * reply to one of them is a stale handle and is ignored. */
+    if (web_waiting) xQueueReset(web_waiting);
+    if (web_jobs) xQueueReset(web_jobs);
+    static const char stopping[] = "Server stopping";
+    for (int i = 0; i < WEB_MAX_REQUESTS; i++) {
+        taskENTER_CRITICAL(&web_lock);
+        web_request_t* r = &web_requests[i];
+        int32_t id = r->used ? (int32_t)r->gen * WEB_MAX_REQUESTS + i : 0;
+        taskEXIT_CRITICAL(&web_lock);
+        if (id) web_finish(id, 503, stopping, sizeof(stopping) - 1);
+    }
     if (server) { httpd_stop(server); server = NULL; }
+    web_catch_all = 0;
+    web_current = 0;
     printf("[WEB] Server stopped\n");
 }
 
@@ -61,18 +514,39 @@ void rb_web_start(int32_t port) {
     printf("[WEB] Server started on port %d (stub)\n", port);
 }
 
+void rb_web_route(rb_string_t* method, rb_string_t* path, void (*handler)(void)) {
+    (void)handler;
+    printf("[WEB] Route %s %s (stub)\n",
+           method ? rb_string_cstr(method) : "(null)", path ? rb_string_cstr(path) : "(null)");
+}
+
 rb_string_t* rb_web_wait(void) {
     printf("[WEB] Waiting for request (stub)\n");
-    return rb_string_from_cstr("/index.html");
+    return rb_string_alloc("/index.html");
 }
 
 rb_string_t* rb_web_body(void) {
     printf("[WEB] Get body (stub)\n");
-    return rb_string_from_cstr("");
+    return rb_string_alloc("");
+}
+
+void rb_web_serve(rb_string_t* prefix, rb_string_t* dir) {
+    printf("[WEB] Serve %s from %s (stub)\n",
+           prefix ? rb_string_cstr(prefix) : "(null)", dir ? rb_string_cstr(dir) : "(null)");
+}
+
+int32_t rb_web_request(void) {
+    return 0;
+}
+
+void rb_web_reply_to(int32_t request, int32_t status, rb_string_t* body) {
+    printf("[WEB] Reply #%d %d: %.*s (stub)\n", request, status,
+           body ? body->length : 0, body ? body->data : "");
 }
 
 void rb_web_reply(int32_t status, rb_string_t* body) {
-    printf("[WEB] Reply %d: %.*s (stub)\n", status, body->len, body->data);
+    printf("[WEB] Reply %d: %.*s (stub)\n", status,
+           body ? body->length : 0, body ? body->data : "");
 }
 
 void rb_web_stop(void) {
@@ -18,7 +18,7 @@ static void ws_event_handler(void *arg, esp_event_base_t base, int32_t id, void
 }
 
 void rb_ws_connect(rb_string_t* url) {
-    esp_websocket_client_config_t cfg = { .uri = url->data };
+    esp_websocket_client_config_t cfg = { .uri = rb_string_cstr(url) };
     ws_client = esp_websocket_client_init(&cfg);
     esp_websocket_register_events(ws_client, WEBSOCKET_EVENT_ANY, ws_event_handler, NULL);
     esp_websocket_client_start(ws_client);
@@ -39,8 +39,8 @@ void rb_ws_close(void) {
 
 #else
 
-void rb_ws_connect(rb_string_t* url) { printf("[WS] connect %s\n", url->data); }
-void rb_ws_send(rb_string_t* data) { printf("[WS] send: %s\n", data->data); }
+void rb_ws_connect(rb_string_t* url) { printf("[WS] connect %s\n", rb_string_cstr(url)); }
+void rb_ws_send(rb_string_t* data) { printf("[WS] send: %s\n", rb_string_cstr(data)); }
 rb_string_t* rb_ws_receive(void) { printf("[WS] receive\n"); return rb_string_alloc(""); }
 void rb_ws_close(void) { printf("[WS] close\n"); }
 
@@ -37,7 +37,7 @@ void rb_wifi_connect(rb_string_t* ssid, rb_string_t* password) {
     esp_wifi_start();
     esp_wifi_connect();
 #else
-    printf("[WiFi] connect: ssid=%s\n", ssid ? ssid->data : "(null)");
+    printf("[WiFi] connect: ssid=%s\n", ssid ? rb_string_cstr(ssid) : "(null)");
 #endif
 }
 
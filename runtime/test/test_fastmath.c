@@ -0,0 +1,90 @@
+/* Host check of the --fast-math error bounds stated in rb_fastmath.c:
+ *
+ *   cc -O2 -Iruntime/include runtime/test/test_fastmath.c \
+ *      runtime/src/rb_fastmath.c -lm && ./a.out
+ *
+ * Each function is swept over its fast range and compared with the double
+ * precision libm result; the run fails if any error is over the bound.
+ */
+#include "rb_runtime.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SAMPLES 4000000
+#define SIN_COS_BOUND 1.41e-7   /* absolute */
+#define EXP_BOUND 1.91e-7       /* relative */
+#define LOG_BOUND 1.52e-7       /* relative */
+
+static int failures = 0;
+
+static void report(const char* name, double worst, float at, double bound, const char* kind) {
+    int ok = worst <= bound;
+    printf("%-4s max %s error %.3g at %.9g (bound %.3g) %s\n",
+           name, kind, worst, (double)at, bound, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+/* Absolute error of f against ref over [lo, hi] */
+static void check_abs(const char* name, float (*f)(float), double (*ref)(double),
+                      float lo, float hi, double bound) {
+    double worst = 0.0;
+    float at = lo;
+    for (int32_t i = 0; i <= SAMPLES; i++) {
+        float x = lo + (hi - lo) * ((float)i / SAMPLES);
+        double err = fabs((double)f(x) - ref((double)x));
+        if (err > worst) {
+            worst = err;
+            at = x;
+        }
+    }
+    report(name, worst, at, bound, "absolute");
+}
+
+/* Relative error of f against ref for the floats x in [lo, hi] */
+static void check_rel(const char* name, float (*f)(float), double (*ref)(double),
+                      float lo, float hi, double bound) {
+    double worst = 0.0;
+    float at = lo;
+    for (int32_t i = 0; i <= SAMPLES; i++) {
+        float x = lo + (hi - lo) * ((float)i / SAMPLES);
+        double want = ref((double)x);
+        double err = fabs(((double)f(x) - want) / want);
+        if (err > worst) {
+            worst = err;
+            at = x;
+        }
+    }
+    report(name, worst, at, bound, "relative");
+}
+
+/* LOG over every normal float exponent: x = m * 2^e, m swept in [1, 2) */
+static void check_log(double bound) {
+    double worst = 0.0;
+    float at = 1.0f;
+    for (int32_t e = -126; e <= 127; e++) {
+        for (int32_t i = 0; i < SAMPLES / 256; i++) {
+            float x = ldexpf(1.0f + (float)i / (SAMPLES / 256), e);
+            double want = log((double)x);
+            if (want == 0.0) continue;
+            double err = fabs(((double)rb_fn_log_fast(x) - want) / want);
+            if (err > worst) {
+                worst = err;
+                at = x;
+            }
+        }
+    }
+    report("LOG", worst, at, bound, "relative");
+}
+
+int main(void) {
+    check_abs("SIN", rb_fn_sin_fast, sin, -4096.0f, 4096.0f, SIN_COS_BOUND);
+    check_abs("SIN", rb_fn_sin_fast, sin, -8.0f, 8.0f, SIN_COS_BOUND);
+    check_abs("COS", rb_fn_cos_fast, cos, -4096.0f, 4096.0f, SIN_COS_BOUND);
+    check_abs("COS", rb_fn_cos_fast, cos, -8.0f, 8.0f, SIN_COS_BOUND);
+    check_rel("EXP", rb_fn_exp_fast, exp, -86.999f, 87.999f, EXP_BOUND);
+    check_rel("EXP", rb_fn_exp_fast, exp, -2.0f, 2.0f, EXP_BOUND);
+    check_log(LOG_BOUND);
+    check_rel("LOG", rb_fn_log_fast, log, 0.5f, 2.0f, LOG_BOUND);
+    return failures ? 1 : 0;
+}